@@ -1 +1,5 @@
 # Intentionally minimal for debug-first Android bring-up.
+
+# Called by name from native-lib.cpp
+-keep interface com.wavry.android.core.NativeBridge$NativeEventListener { *; }
+-keepclassmembers class * implements com.wavry.android.core.NativeBridge$NativeEventListener { *; }
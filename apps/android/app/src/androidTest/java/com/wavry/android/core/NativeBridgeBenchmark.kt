@@ -0,0 +1,119 @@
+package com.wavry.android.core
+
+import android.os.Debug
+import android.util.Log
+import android.view.KeyEvent
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import androidx.test.platform.app.InstrumentationRegistry
+import java.util.concurrent.CountDownLatch
+import java.util.concurrent.TimeUnit
+import org.junit.Assert.assertTrue
+import org.junit.BeforeClass
+import org.junit.Test
+import org.junit.runner.RunWith
+
+// Call cost and Java allocations of the NativeBridge paths of the UI refresh and the input, through
+// native-lib.cpp, next to the native numbers of crates/wavry-ffi/tools/ffi_bench.cpp. Run it on the
+// device with
+//
+//     ./gradlew :app:connectedMobileDebugAndroidTest \
+//         -Pandroid.testInstrumentationRunnerArguments.class=com.wavry.android.core.NativeBridgeBenchmark
+//
+// and read the results from logcat, tag NativeBridgeBenchmark. Debuggable builds run with CheckJNI,
+// which makes every JNI call slower than in a release build. There is no session: the stats are
+// zeros and the input batches stop at the missing client.
+@RunWith(AndroidJUnit4::class)
+class NativeBridgeBenchmark {
+    // Polling, the copy of the last error becomes a new String unless it is empty
+    @Test
+    fun lastError() {
+        measure("nativeLastError") { sink += core.lastError().length }
+        measure("nativeLastCloudStatus") { sink += core.lastCloudStatus().length }
+    }
+
+    // Shared memory, the fields are read from the direct buffer into a new SessionStats
+    @Test
+    fun stats() {
+        measure("stats surface") { sink += core.stats().framesDecoded }
+    }
+
+    @Test
+    fun input() {
+        val batch = InputBatch()
+        measure("nativeSendInput 1") {
+            batch.mouseMove(0.5f, 0.5f)
+            sink += core.sendInput(batch)
+        }
+        measure("nativeSendInput 16") {
+            for (i in 0 until 4) {
+                batch.mouseMove(i / 4f, 1 - i / 4f)
+                batch.mouseMove(1 - i / 4f, i / 4f)
+                batch.mouseButton(1, i % 2 == 0)
+                batch.key(KeyEvent.KEYCODE_A, i % 2 == 0)
+            }
+            sink += core.sendInput(batch)
+        }
+    }
+
+    // Callback, from registering a listener to its first event on the native event thread. The
+    // allocations of every thread are counted.
+    @Test
+    fun eventRoundTrip() {
+        measure("event round trip", allThreads = true) {
+            val delivered = CountDownLatch(1)
+            core.setEventListener { delivered.countDown() }
+            assertTrue(delivered.await(1, TimeUnit.SECONDS))
+            core.setEventListener(null)
+        }
+    }
+
+    // Runs body with a growing iteration count until a run takes MIN_TIME_NS, after a warm-up for
+    // the JIT
+    @Suppress("DEPRECATION")
+    private inline fun measure(name: String, allThreads: Boolean = false, body: () -> Unit) {
+        repeat(WARMUP_ITERATIONS) { body() }
+        var iterations = 16L
+        while (true) {
+            Debug.resetAllCounts()
+            Debug.startAllocCounting()
+            val start = System.nanoTime()
+            for (i in 0 until iterations) {
+                body()
+            }
+            val elapsed = System.nanoTime() - start
+            Debug.stopAllocCounting()
+            val allocations =
+                if (allThreads) Debug.getGlobalAllocCount() else Debug.getThreadAllocCount()
+            if (elapsed >= MIN_TIME_NS) {
+                Log.i(
+                    TAG,
+                    "%-24s %10.1f ns %8.2f allocs %10d iterations".format(
+                        name,
+                        elapsed.toDouble() / iterations,
+                        allocations.toDouble() / iterations,
+                        iterations,
+                    ),
+                )
+                return
+            }
+            iterations *= 4
+        }
+    }
+
+    companion object {
+        private const val TAG = "NativeBridgeBenchmark"
+        private const val MIN_TIME_NS = 500_000_000L
+        private const val WARMUP_ITERATIONS = 1000
+
+        private lateinit var core: WavryCore
+
+        // Results of the calls, so that they aren't optimized out
+        @Volatile private var sink = 0L
+
+        @JvmStatic
+        @BeforeClass
+        fun setUp() {
+            core = WavryCore(InstrumentationRegistry.getInstrumentation().targetContext)
+        }
+    }
+}
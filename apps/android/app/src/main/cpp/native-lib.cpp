@@ -1,8 +1,91 @@
+#include <android/native_window_jni.h>
 #include <jni.h>
 #include <string>
 
 #include "wavry.h"
 
+namespace {
+
+// Looked up once in JNI_OnLoad, the class is held by a global ref so the method ID stays valid
+JavaVM *g_vm = nullptr;
+jclass g_event_listener_class = nullptr;
+jmethodID g_on_native_event = nullptr;
+jstring g_empty_string = nullptr;
+
+// Listener given to nativeSetEventListener, only called from the event thread of the library
+jobject g_event_listener = nullptr;
+
+jstring empty_string(JNIEnv *env) {
+    return static_cast<jstring>(env->NewLocalRef(g_empty_string));
+}
+
+void deliver_event(const WavryEvent *event, void *) {
+    // The event thread lives as long as the process, so it is attached once and stays attached
+    JNIEnv *env = nullptr;
+    if (g_vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK &&
+        g_vm->AttachCurrentThreadAsDaemon(&env, nullptr) != JNI_OK) {
+        return;
+    }
+
+    // Only errors and cloud statuses carry a string, the other events allocate nothing
+    jstring message = nullptr;
+    if (event->message != nullptr && event->message[0] != '\0') {
+        message = env->NewStringUTF(event->message);
+    }
+    env->CallVoidMethod(
+        g_event_listener,
+        g_on_native_event,
+        static_cast<jint>(event->type),
+        static_cast<jboolean>(event->connected != 0),
+        static_cast<jint>(event->stats.fps),
+        static_cast<jint>(event->stats.rtt_ms),
+        static_cast<jint>(event->stats.bitrate_kbps),
+        static_cast<jint>(event->stats.jitter_us),
+        static_cast<jlong>(event->stats.frames_encoded),
+        static_cast<jlong>(event->stats.frames_decoded),
+        static_cast<jlong>(event->stats.packets_lost),
+        static_cast<jlong>(event->stats.fec_recovered),
+        message);
+    if (env->ExceptionCheck()) {
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+    }
+    if (message != nullptr) {
+        env->DeleteLocalRef(message);
+    }
+}
+
+} // namespace
+
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *) {
+    JNIEnv *env = nullptr;
+    if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK) {
+        return JNI_ERR;
+    }
+    g_vm = vm;
+
+    jclass listener_class =
+        env->FindClass("com/wavry/android/core/NativeBridge$NativeEventListener");
+    if (listener_class == nullptr) {
+        return JNI_ERR;
+    }
+    g_event_listener_class = static_cast<jclass>(env->NewGlobalRef(listener_class));
+    env->DeleteLocalRef(listener_class);
+    g_on_native_event = env->GetMethodID(
+        g_event_listener_class, "onNativeEvent", "(IZIIIIJJJJLjava/lang/String;)V");
+    if (g_on_native_event == nullptr) {
+        return JNI_ERR;
+    }
+
+    jstring empty = env->NewStringUTF("");
+    if (empty == nullptr) {
+        return JNI_ERR;
+    }
+    g_empty_string = static_cast<jstring>(env->NewGlobalRef(empty));
+    env->DeleteLocalRef(empty);
+    return JNI_VERSION_1_6;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_wavry_android_core_NativeBridge_nativeInit(JNIEnv *, jobject) {
     wavry_init();
@@ -10,11 +93,11 @@ Java_com_wavry_android_core_NativeBridge_nativeInit(JNIEnv *, jobject) {
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_wavry_android_core_NativeBridge_nativeAndroidInit(JNIEnv *env, jobject, jobject context) {
-    JavaVM *vm = nullptr;
-    env->GetJavaVM(&vm);
     // context is a jobject, but wavry_android_init expects a void* which should be the global ref to the context
     jobject global_context = env->NewGlobalRef(context);
-    wavry_android_init(vm, global_context);
+    wavry_android_init(g_vm, global_context);
+    // Keeps the decode path on the big cores and lets ADPF raise the clocks ahead of a late frame
+    wavry_android_set_perf_mode(WAVRY_PERF_MODE_LOW_LATENCY);
 }
 
 extern "C" JNIEXPORT jint JNICALL
@@ -48,7 +131,7 @@ extern "C" JNIEXPORT jstring JNICALL
 Java_com_wavry_android_core_NativeBridge_nativeGetPublicKeyHex(JNIEnv *env, jobject) {
     uint8_t key[32] = {0};
     if (wavry_get_public_key(key) != 0) {
-        return env->NewStringUTF("");
+        return empty_string(env);
     }
 
     static const char kHex[] = "0123456789abcdef";
@@ -69,6 +152,58 @@ Java_com_wavry_android_core_NativeBridge_nativeStartHost(JNIEnv *, jobject, jint
     return wavry_start_host(static_cast<uint16_t>(port));
 }
 
+// Host encoding the screen of the device, with a real-time rate control and, for intraRefresh,
+// rolling intra rows instead of IDR frames on loss. The app then renders its MediaProjection
+// into nativeHostInputSurface.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_wavry_android_core_NativeBridge_nativeStartHostWithConfig(
+    JNIEnv *,
+    jobject,
+    jint port,
+    jint width,
+    jint height,
+    jint fps,
+    jint bitrate_kbps,
+    jint keyframe_interval_ms,
+    jint codec,
+    jboolean low_latency,
+    jboolean intra_refresh
+) {
+    if (port < 0 || port > 65535 || width <= 0 || width > 65535 || height <= 0 ||
+        height > 65535 || fps <= 0 || fps > 65535 || bitrate_kbps <= 0 ||
+        keyframe_interval_ms < 0) {
+        return -10;
+    }
+
+    WavryHostConfig config = {};
+    config.width = static_cast<uint16_t>(width);
+    config.height = static_cast<uint16_t>(height);
+    config.fps = static_cast<uint16_t>(fps);
+    config.bitrate_kbps = static_cast<uint32_t>(bitrate_kbps);
+    config.keyframe_interval_ms = static_cast<uint32_t>(keyframe_interval_ms);
+    config.version = WAVRY_HOST_CONFIG_VERSION;
+    config.codec = static_cast<uint32_t>(codec);
+    config.preset = WAVRY_PRESET_SPEED;
+    config.low_latency = low_latency ? 1 : 0;
+    config.refresh_mode = intra_refresh ? WAVRY_REFRESH_INTRA_REFRESH : WAVRY_REFRESH_IDR;
+    config.content_type = WAVRY_CONTENT_SCREEN;
+    return wavry_start_host_with_config(static_cast<uint16_t>(port), &config);
+}
+
+// Surface of the input of the host encoder, for the VirtualDisplay of the MediaProjection. The
+// display composes into the buffers that MediaCodec encodes, the frames never reach the CPU.
+extern "C" JNIEXPORT jobject JNICALL
+Java_com_wavry_android_core_NativeBridge_nativeHostInputSurface(JNIEnv *env, jobject) {
+    auto *window = static_cast<ANativeWindow *>(wavry_android_host_input_window());
+    if (window == nullptr) {
+        return nullptr;
+    }
+    // The Surface takes its own reference to the window
+    jobject surface = ANativeWindow_toSurface(env, window);
+    ANativeWindow_release(window);
+    return surface;
+}
+
 extern "C" JNIEXPORT jint JNICALL
 Java_com_wavry_android_core_NativeBridge_nativeStartClient(
     JNIEnv *env,
@@ -141,29 +276,56 @@ Java_com_wavry_android_core_NativeBridge_nativeStop(JNIEnv *, jobject) {
     return wavry_stop();
 }
 
-extern "C" JNIEXPORT jlongArray JNICALL
-Java_com_wavry_android_core_NativeBridge_nativeGetStats(JNIEnv *env, jobject) {
-    WavryStats stats{};
-    int rc = wavry_get_stats(&stats);
-    if (rc != 0) {
-        return nullptr;
+// MediaCodec decodes straight into the window of the Surface, a null surface releases the
+// renderer so nothing is drawn to a destroyed window.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_wavry_android_core_NativeBridge_nativeSetSurface(JNIEnv *env, jobject, jobject surface) {
+    if (surface == nullptr) {
+        return wavry_release_renderer();
+    }
+    ANativeWindow *window = ANativeWindow_fromSurface(env, surface);
+    if (window == nullptr) {
+        return -1;
+    }
+    // The renderer owns the window reference from here, even when it fails to start
+    return wavry_init_renderer(window);
+}
+
+// Options of the MediaCodec decoder created by the next nativeSetSurface, operating_rate in fps
+// with 0 leaving it unset.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_wavry_android_core_NativeBridge_nativeSetDecoderConfig(
+    JNIEnv *,
+    jobject,
+    jboolean low_latency,
+    jboolean vendor_low_latency,
+    jboolean realtime_priority,
+    jint operating_rate
+) {
+    if (operating_rate < 0 || operating_rate > 65535) {
+        return -10;
     }
 
-    jlong values[6] = {
-        static_cast<jlong>(stats.connected ? 1 : 0),
-        static_cast<jlong>(stats.fps),
-        static_cast<jlong>(stats.rtt_ms),
-        static_cast<jlong>(stats.bitrate_kbps),
-        static_cast<jlong>(stats.frames_encoded),
-        static_cast<jlong>(stats.frames_decoded),
-    };
+    WavryDecoderConfig config = {};
+    config.version = WAVRY_DECODER_CONFIG_VERSION;
+    config.low_latency = low_latency ? 1 : 0;
+    config.vendor_low_latency = vendor_low_latency ? 1 : 0;
+    config.realtime_priority = realtime_priority ? 1 : 0;
+    config.operating_rate = static_cast<uint32_t>(operating_rate);
+    return wavry_android_set_decoder_config(&config);
+}
 
-    jlongArray arr = env->NewLongArray(6);
-    if (arr == nullptr) {
+// Wraps the live stats surface without copying, the buffer stays valid for the process lifetime.
+// Java must read it in native byte order, the layout is WavryStatsSurface. Reading the fields from
+// the buffer replaces a wavry_get_stats copy and a new long array per poll.
+extern "C" JNIEXPORT jobject JNICALL
+Java_com_wavry_android_core_NativeBridge_nativeStatsBuffer(JNIEnv *env, jobject) {
+    const WavryStatsSurface *surface = wavry_stats_surface();
+    if (surface == nullptr) {
         return nullptr;
     }
-    env->SetLongArrayRegion(arr, 0, 6, values);
-    return arr;
+    return env->NewDirectByteBuffer(
+        const_cast<WavryStatsSurface *>(surface), wavry_stats_surface_size());
 }
 
 extern "C" JNIEXPORT jstring JNICALL
@@ -171,7 +333,7 @@ Java_com_wavry_android_core_NativeBridge_nativeLastError(JNIEnv *env, jobject) {
     char buffer[512] = {0};
     int copied = wavry_copy_last_error(buffer, sizeof(buffer));
     if (copied <= 0) {
-        return env->NewStringUTF("");
+        return empty_string(env);
     }
     return env->NewStringUTF(buffer);
 }
@@ -181,7 +343,49 @@ Java_com_wavry_android_core_NativeBridge_nativeLastCloudStatus(JNIEnv *env, jobj
     char buffer[512] = {0};
     int copied = wavry_copy_last_cloud_status(buffer, sizeof(buffer));
     if (copied <= 0) {
-        return env->NewStringUTF("");
+        return empty_string(env);
     }
     return env->NewStringUTF(buffer);
 }
+
+// Sends the count WavryInputEvent records at the start of a direct buffer that Java fills in native
+// byte order, without copying them or any other JNI call on the input path.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_wavry_android_core_NativeBridge_nativeSendInput(
+    JNIEnv *env,
+    jobject,
+    jobject buffer,
+    jint count
+) {
+    if (buffer == nullptr || count < 0) {
+        return -1;
+    }
+    auto *events = static_cast<const WavryInputEvent *>(env->GetDirectBufferAddress(buffer));
+    if (events == nullptr ||
+        env->GetDirectBufferCapacity(buffer) <
+            static_cast<jlong>(count) * static_cast<jlong>(sizeof(WavryInputEvent))) {
+        return -1;
+    }
+    return wavry_send_input_batch(events, static_cast<uint32_t>(count));
+}
+
+// Replaces the event listener, null stops the events. wavry_set_event_callback waits for an event
+// being delivered, so the previous listener can be released right after.
+extern "C" JNIEXPORT void JNICALL
+Java_com_wavry_android_core_NativeBridge_nativeSetEventListener(
+    JNIEnv *env,
+    jobject,
+    jobject listener
+) {
+    wavry_set_event_callback(nullptr, nullptr);
+    if (g_event_listener != nullptr) {
+        env->DeleteGlobalRef(g_event_listener);
+        g_event_listener = nullptr;
+    }
+    if (listener == nullptr) {
+        return;
+    }
+
+    g_event_listener = env->NewGlobalRef(listener);
+    wavry_set_event_callback(deliver_event, nullptr);
+}
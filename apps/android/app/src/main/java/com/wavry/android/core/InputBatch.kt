@@ -0,0 +1,84 @@
+package com.wavry.android.core
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+// Collects the input events of a tick as WavryInputEvent records in a direct buffer, so they reach
+// wavry_send_input_batch without per-event JNI calls or copies. Not thread-safe, fill and flush it
+// from one thread. Positions are normalized to [0, 1].
+class InputBatch(private val capacity: Int = DEFAULT_CAPACITY) {
+    private val buffer: ByteBuffer =
+        ByteBuffer.allocateDirect(capacity * EVENT_SIZE).order(ByteOrder.nativeOrder())
+    private var count = 0
+
+    val size: Int
+        get() = count
+
+    fun mouseMove(x: Float, y: Float) = add(TYPE_MOUSE_MOVE, 0, 0, false, x, y)
+
+    fun mouseButton(button: Int, pressed: Boolean) =
+        add(TYPE_MOUSE_BUTTON, button, 0, pressed, 0f, 0f)
+
+    fun key(keyCode: Int, pressed: Boolean) = add(TYPE_KEY, keyCode, 0, pressed, 0f, 0f)
+
+    fun scroll(dx: Float, dy: Float) = add(TYPE_SCROLL, 0, 0, false, dx, dy)
+
+    fun gamepadAxis(gamepadId: Int, axis: Int, value: Float) =
+        add(TYPE_GAMEPAD_AXIS, axis, gamepadId, false, value, 0f)
+
+    fun gamepadButton(gamepadId: Int, button: Int, pressed: Boolean) =
+        add(TYPE_GAMEPAD_BUTTON, button, gamepadId, pressed, 0f, 0f)
+
+    // Pointer 0 moves the mouse and holds its left button on the host
+    fun touch(pointerId: Int, phase: Int, x: Float, y: Float) =
+        add(TYPE_TOUCH, phase, pointerId, false, x, y)
+
+    // Returns false once the batch is full, flush it and add the event again
+    private fun add(type: Int, code: Int, id: Int, pressed: Boolean, x: Float, y: Float): Boolean {
+        if (count == capacity) {
+            return false
+        }
+        val offset = count * EVENT_SIZE
+        // A zero timestamp is stamped by the library when the batch is sent
+        buffer.putLong(offset, 0L)
+        buffer.putInt(offset + 8, type)
+        buffer.putInt(offset + 12, code)
+        buffer.putInt(offset + 16, id)
+        buffer.putInt(offset + 20, if (pressed) 1 else 0)
+        buffer.putFloat(offset + 24, x)
+        buffer.putFloat(offset + 28, y)
+        count++
+        return true
+    }
+
+    internal fun flush(native: NativeBridge): Int {
+        if (count == 0) {
+            return 0
+        }
+        val rc = native.nativeSendInput(buffer, count)
+        count = 0
+        return rc
+    }
+
+    companion object {
+        private const val DEFAULT_CAPACITY = 64
+
+        // sizeof(WavryInputEvent) in wavry.h
+        private const val EVENT_SIZE = 32
+
+        // WavryInputType in wavry.h
+        private const val TYPE_MOUSE_MOVE = 0
+        private const val TYPE_MOUSE_BUTTON = 1
+        private const val TYPE_KEY = 2
+        private const val TYPE_SCROLL = 3
+        private const val TYPE_GAMEPAD_AXIS = 4
+        private const val TYPE_GAMEPAD_BUTTON = 5
+        private const val TYPE_TOUCH = 6
+
+        // WavryTouchPhase in wavry.h
+        const val TOUCH_DOWN = 0
+        const val TOUCH_MOVE = 1
+        const val TOUCH_UP = 2
+        const val TOUCH_CANCEL = 3
+    }
+}
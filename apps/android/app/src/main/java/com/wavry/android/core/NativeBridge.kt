@@ -7,13 +7,52 @@ class NativeBridge {
     external fun nativeGetPublicKeyHex(): String
     external fun nativeVersion(): String
     external fun nativeStartHost(port: Int): Int
+    external fun nativeStartHostWithConfig(
+        port: Int,
+        width: Int,
+        height: Int,
+        fps: Int,
+        bitrateKbps: Int,
+        keyframeIntervalMs: Int,
+        codec: Int,
+        lowLatency: Boolean,
+        intraRefresh: Boolean,
+    ): Int
+    external fun nativeHostInputSurface(): android.view.Surface?
     external fun nativeStartClient(host: String, port: Int): Int
     external fun nativeConnectSignaling(url: String, token: String): Int
     external fun nativeSendConnectRequest(username: String): Int
     external fun nativeStop(): Int
-    external fun nativeGetStats(): LongArray?
+    external fun nativeSetSurface(surface: android.view.Surface?): Int
+    external fun nativeSetDecoderConfig(
+        lowLatency: Boolean,
+        vendorLowLatency: Boolean,
+        realtimePriority: Boolean,
+        operatingRate: Int,
+    ): Int
+    external fun nativeStatsBuffer(): java.nio.ByteBuffer?
     external fun nativeLastError(): String
     external fun nativeLastCloudStatus(): String
+    external fun nativeSetEventListener(listener: NativeEventListener?)
+    external fun nativeSendInput(buffer: java.nio.ByteBuffer, count: Int): Int
+
+    // Called by native-lib.cpp on the event thread of the library, the arguments are the fields of
+    // WavryEvent in wavry.h. JNI_OnLoad looks the method up by name and signature.
+    interface NativeEventListener {
+        fun onNativeEvent(
+            type: Int,
+            connected: Boolean,
+            fps: Int,
+            rttMs: Int,
+            bitrateKbps: Int,
+            jitterUs: Int,
+            framesEncoded: Long,
+            framesDecoded: Long,
+            packetsLost: Long,
+            fecRecovered: Long,
+            message: String?,
+        )
+    }
 
     companion object {
         init {
@@ -9,4 +9,11 @@ data class SessionStats(
     val framesDecoded: Long = 0,
     val jitterMs: Long = 0,
     val packetLoss: Float = 0f,
+    /** Jitter and device buffer of the audio output, 0 with a library older than version 3 */
+    val audioBufferMs: Long = 0,
+    val audioUnderruns: Long = 0,
+    /** Median time inside the MediaCodec decoder, 0 with a library older than version 4 */
+    val decoderLatencyMs: Float = 0f,
+    /** Whether the live decoder was configured with KEY_LOW_LATENCY */
+    val decoderLowLatency: Boolean = false,
 )
@@ -1,6 +1,9 @@
 package com.wavry.android.core
 
 import android.content.Context
+import android.view.Surface
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
 
 class WavryCore(
     context: Context,
@@ -12,12 +15,37 @@ class WavryCore(
         native.nativeInitIdentity(context.filesDir.absolutePath)
     }
 
+    // WavryStatsSurface of the library, read in place instead of copied on each poll
+    private val statsSurface: ByteBuffer? by lazy {
+        native.nativeStatsBuffer()?.order(ByteOrder.nativeOrder())
+    }
+
     fun version(): String = native.nativeVersion()
 
     fun publicKeyHex(): String = native.nativeGetPublicKeyHex()
 
     fun startHost(port: Int): Int = native.nativeStartHost(port)
 
+    // Hosts the screen of this device, pass the size of the VirtualDisplay. Codec is WavryCodec
+    // in wavry.h.
+    fun startScreenHost(
+        port: Int,
+        width: Int,
+        height: Int,
+        fps: Int = 60,
+        bitrateKbps: Int = 8000,
+        keyframeIntervalMs: Int = 2000,
+        codec: Int = CODEC_H264,
+        lowLatency: Boolean = true,
+        intraRefresh: Boolean = true,
+    ): Int = native.nativeStartHostWithConfig(
+        port, width, height, fps, bitrateKbps, keyframeIntervalMs, codec, lowLatency, intraRefresh,
+    )
+
+    // Input of the host encoder, create the VirtualDisplay of the MediaProjection on it. Null
+    // until startScreenHost succeeds.
+    fun hostInputSurface(): Surface? = native.nativeHostInputSurface()
+
     fun startClient(host: String, port: Int): Int = native.nativeStartClient(host, port)
 
     fun connectSignaling(url: String, token: String): Int = native.nativeConnectSignaling(url, token)
@@ -26,10 +54,71 @@ class WavryCore(
 
     fun stop(): Int = native.nativeStop()
 
+    // Video decodes straight into this surface, pass null from surfaceDestroyed
+    fun setSurface(surface: Surface?): Int = native.nativeSetSurface(surface)
+
+    // Applies to the decoder of the next setSurface. The vendor keys cover the Qualcomm, Exynos,
+    // MediaTek and HiSilicon decoders, operatingRate 0 leaves it to the codec and
+    // OPERATING_RATE_MAX asks for the highest clocks.
+    fun setDecoderConfig(
+        lowLatency: Boolean = true,
+        vendorLowLatency: Boolean = true,
+        realtimePriority: Boolean = true,
+        operatingRate: Int = 0,
+    ): Int = native.nativeSetDecoderConfig(
+        lowLatency, vendorLowLatency, realtimePriority, operatingRate,
+    )
+
+    // Sends the events added to the batch since the last flush in one call, see InputBatch
+    fun sendInput(batch: InputBatch): Int = batch.flush(native)
+
     fun lastError(): String = native.nativeLastError().trim()
 
     fun lastCloudStatus(): String = native.nativeLastCloudStatus().trim()
 
+    // Pushes the connection state, stats, errors and cloud statuses instead of polling them. The
+    // listener runs on the native event thread and must not block, null stops the events.
+    fun setEventListener(listener: ((WavryEvent) -> Unit)?) {
+        if (listener == null) {
+            native.nativeSetEventListener(null)
+            return
+        }
+        native.nativeSetEventListener(object : NativeBridge.NativeEventListener {
+            override fun onNativeEvent(
+                type: Int,
+                connected: Boolean,
+                fps: Int,
+                rttMs: Int,
+                bitrateKbps: Int,
+                jitterUs: Int,
+                framesEncoded: Long,
+                framesDecoded: Long,
+                packetsLost: Long,
+                fecRecovered: Long,
+                message: String?,
+            ) {
+                val event = when (type) {
+                    EVENT_CONNECTION -> WavryEvent.Connection(connected)
+                    EVENT_STATS -> WavryEvent.Stats(
+                        connected = connected,
+                        fps = fps.toLong(),
+                        rttMs = rttMs.toLong(),
+                        bitrateKbps = bitrateKbps.toLong(),
+                        jitterMs = jitterUs / 1000L,
+                        framesEncoded = framesEncoded,
+                        framesDecoded = framesDecoded,
+                        packetsLost = packetsLost,
+                        fecRecovered = fecRecovered,
+                    )
+                    EVENT_ERROR -> WavryEvent.Error(message.orEmpty().trim())
+                    EVENT_CLOUD_STATUS -> WavryEvent.CloudStatus(message.orEmpty().trim())
+                    else -> return
+                }
+                listener(event)
+            }
+        })
+    }
+
     fun describeError(code: Int): String {
         val base = messageForCode(code)
         val detail = lastError()
@@ -44,22 +133,88 @@ class WavryCore(
     }
 
     fun stats(): SessionStats {
-        val raw = native.nativeGetStats() ?: return SessionStats()
-        if (raw.size < 6) return SessionStats()
+        val surface = statsSurface ?: return SessionStats()
+        if (surface.capacity() < SURFACE_MIN_SIZE) return SessionStats()
 
+        val received = surface.getLong(SURFACE_PACKETS_RECEIVED)
+        val lost = surface.getLong(SURFACE_PACKETS_LOST)
+        val hasAudio = surface.capacity() >= SURFACE_AUDIO_END
+        val hasDecoder = surface.capacity() >= SURFACE_DECODER_END
         return SessionStats(
-            connected = raw[0] != 0L,
-            fps = raw[1],
-            rttMs = raw[2],
-            bitrateKbps = raw[3],
-            framesEncoded = raw[4],
-            framesDecoded = raw[5],
-            jitterMs = 0,
-            packetLoss = 0f,
+            connected = surface.getInt(SURFACE_CONNECTED) != 0,
+            fps = surface.getInt(SURFACE_FPS).toLong(),
+            rttMs = surface.getInt(SURFACE_RTT_MS).toLong(),
+            bitrateKbps = surface.getInt(SURFACE_BITRATE_KBPS).toLong(),
+            framesEncoded = surface.getLong(SURFACE_FRAMES_ENCODED),
+            framesDecoded = surface.getLong(SURFACE_FRAMES_DECODED),
+            jitterMs = surface.getInt(SURFACE_JITTER_US) / 1000L,
+            packetLoss = if (received + lost > 0) lost.toFloat() / (received + lost) else 0f,
+            audioBufferMs = if (hasAudio) {
+                (surface.getInt(SURFACE_AUDIO_BUFFER_US) +
+                    surface.getInt(SURFACE_AUDIO_DEVICE_BUFFER_US)) / 1000L
+            } else {
+                0
+            },
+            audioUnderruns = if (hasAudio) surface.getLong(SURFACE_AUDIO_UNDERRUNS) else 0,
+            decoderLatencyMs = if (hasDecoder) medianMs(surface, SURFACE_DECODER_US) else 0f,
+            decoderLowLatency = hasDecoder &&
+                (surface.getInt(SURFACE_DECODER_OPTIONS) and DECODER_LOW_LATENCY) != 0,
         )
     }
 
+    // Upper bound of the bucket of the median sample of a WAVRY_LATENCY_BUCKETS histogram
+    private fun medianMs(surface: ByteBuffer, offset: Int): Float {
+        var total = 0L
+        for (i in 0 until LATENCY_BUCKETS) total += surface.getLong(offset + i * 8)
+        if (total == 0L) return 0f
+        var seen = 0L
+        for (i in 0 until LATENCY_BUCKETS) {
+            seen += surface.getLong(offset + i * 8)
+            if (seen * 2 >= total) return (LATENCY_BUCKET_BASE_US shl i) / 1000f
+        }
+        return (LATENCY_BUCKET_BASE_US shl (LATENCY_BUCKETS - 1)) / 1000f
+    }
+
     companion object {
+        // WavryCodec in wavry.h
+        const val CODEC_H264 = 0
+        const val CODEC_HEVC = 1
+        const val CODEC_AV1 = 2
+
+        // WavryEventType in wavry.h
+        private const val EVENT_CONNECTION = 0
+        private const val EVENT_STATS = 1
+        private const val EVENT_ERROR = 2
+        private const val EVENT_CLOUD_STATUS = 3
+
+        // Byte offsets of the fields of WavryStatsSurface in wavry.h
+        private const val SURFACE_CONNECTED = 8
+        private const val SURFACE_FPS = 12
+        private const val SURFACE_RTT_MS = 16
+        private const val SURFACE_BITRATE_KBPS = 20
+        private const val SURFACE_JITTER_US = 24
+        private const val SURFACE_FRAMES_ENCODED = 32
+        private const val SURFACE_FRAMES_DECODED = 40
+        private const val SURFACE_PACKETS_RECEIVED = 48
+        private const val SURFACE_PACKETS_LOST = 56
+        private const val SURFACE_MIN_SIZE = 64
+        // Version 3, after the four latency histograms of 16 buckets
+        private const val SURFACE_AUDIO_UNDERRUNS = 608
+        private const val SURFACE_AUDIO_BUFFER_US = 616
+        private const val SURFACE_AUDIO_DEVICE_BUFFER_US = 620
+        private const val SURFACE_AUDIO_END = 624
+        // Version 4
+        private const val SURFACE_DECODER_US = 624
+        private const val SURFACE_DECODER_OPTIONS = 752
+        private const val SURFACE_DECODER_END = 760
+        private const val LATENCY_BUCKETS = 16
+        private const val LATENCY_BUCKET_BASE_US = 256
+
+        // WavryDecoderOption in wavry.h
+        private const val DECODER_LOW_LATENCY = 1
+
+        const val OPERATING_RATE_MAX = 65535
+
         fun messageForCode(code: Int): String {
             return when (code) {
                 0 -> "Success"
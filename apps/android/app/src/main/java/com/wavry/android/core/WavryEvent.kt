@@ -0,0 +1,23 @@
+package com.wavry.android.core
+
+// Events of the native core, delivered on its event thread
+sealed interface WavryEvent {
+    data class Connection(val connected: Boolean) : WavryEvent
+
+    // The counters are the ones since the previous stats event
+    data class Stats(
+        val connected: Boolean,
+        val fps: Long,
+        val rttMs: Long,
+        val bitrateKbps: Long,
+        val jitterMs: Long,
+        val framesEncoded: Long,
+        val framesDecoded: Long,
+        val packetsLost: Long,
+        val fecRecovered: Long,
+    ) : WavryEvent
+
+    data class Error(val message: String) : WavryEvent
+
+    data class CloudStatus(val message: String) : WavryEvent
+}
@@ -11,11 +11,13 @@ import com.wavry.android.core.AuthApi
 import com.wavry.android.core.CloudAuthSession
 import com.wavry.android.core.SessionStats
 import com.wavry.android.core.WavryCore
+import com.wavry.android.core.WavryEvent
 import java.net.Inet4Address
 import java.net.InetAddress
 import java.net.URL
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.Job
+import kotlinx.coroutines.channels.Channel
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
@@ -127,7 +129,8 @@ class WavryViewModel(application: Application) : AndroidViewModel(application) {
     )
     val state: StateFlow<WavryUiState> = _state.asStateFlow()
 
-    private var statsJob: Job? = null
+    private var sessionJob: Job? = null
+    private val sessionEvents = Channel<WavryEvent>(Channel.UNLIMITED)
     private var connectStartedAtMs: Long = 0L
     private var activeTargetLabel: String = ""
     private var activeResolvedHost: String = ""
@@ -564,7 +567,7 @@ class WavryViewModel(application: Application) : AndroidViewModel(application) {
                         cloudSignalingState = CloudSignalingState.CONNECTED,
                     )
                 }
-                startStatsPolling()
+                startSessionMonitor()
             } else {
                 val detail = normalizeCloudConnectError(core.describeError(rc))
                 _state.update {
@@ -807,7 +810,7 @@ class WavryViewModel(application: Application) : AndroidViewModel(application) {
                     startup.connectedPort.toString()
                 }
                 saveConnectionFields(snapshot.hostText.trim(), portToPersist)
-                startStatsPolling()
+                startSessionMonitor()
             } else {
                 val detailed = startup.errorMessage.ifBlank { core.describeError(startup.code) }
                 val hint = networkHintForHost(resolvedHost)
@@ -839,7 +842,7 @@ class WavryViewModel(application: Application) : AndroidViewModel(application) {
                     recordSessionInHistory(activeTargetLabel, true, duration)
                 }
                 resetConnectionTracking()
-                stopStatsPolling()
+                stopSessionMonitor()
                 _state.update {
                     it.copy(
                         isBusy = false,
@@ -869,105 +872,139 @@ class WavryViewModel(application: Application) : AndroidViewModel(application) {
         }
     }
 
-    private fun startStatsPolling() {
-        stopStatsPolling()
-        statsJob = viewModelScope.launch {
-            while (true) {
-                val stats = withContext(Dispatchers.IO) {
-                    core.stats()
-                }
+    // Follows the session through the events of the native core. Nothing runs between events
+    // except the connect timeout.
+    private fun startSessionMonitor() {
+        stopSessionMonitor()
+        // Events of the previous session don't concern this one
+        while (sessionEvents.tryReceive().isSuccess) {
+        }
+        core.setEventListener { event -> sessionEvents.trySend(event) }
 
+        sessionJob = viewModelScope.launch {
+            var stats = SessionStats()
+
+            launch {
+                val elapsedMs = SystemClock.elapsedRealtime() - connectStartedAtMs
+                delay((CONNECT_TIMEOUT_MS - elapsedMs).coerceAtLeast(0L))
                 val snapshot = _state.value
-                if (snapshot.isRunning && snapshot.mode == ConnectionMode.CLIENT) {
-                    if (snapshot.connectivityMode == ConnectivityMode.WAVRY) {
-                        val cloudStatus = withContext(Dispatchers.IO) {
-                            core.lastCloudStatus()
+                if (snapshot.isRunning && snapshot.mode == ConnectionMode.CLIENT && !hasConnectedOnce) {
+                    failConnectTimeout(SystemClock.elapsedRealtime() - connectStartedAtMs)
+                }
+            }
+
+            for (event in sessionEvents) {
+                when (event) {
+                    is WavryEvent.Stats -> {
+                        stats = stats.copy(
+                            connected = event.connected,
+                            fps = event.fps,
+                            rttMs = event.rttMs,
+                            bitrateKbps = event.bitrateKbps,
+                            framesEncoded = stats.framesEncoded + event.framesEncoded,
+                            framesDecoded = stats.framesDecoded + event.framesDecoded,
+                            jitterMs = event.jitterMs,
+                        )
+                    }
+                    is WavryEvent.Connection -> {
+                        stats = stats.copy(connected = event.connected)
+                        val snapshot = _state.value
+                        if (event.connected && !hasConnectedOnce &&
+                            snapshot.isRunning && snapshot.mode == ConnectionMode.CLIENT
+                        ) {
+                            hasConnectedOnce = true
+                            _state.update {
+                                it.copy(
+                                    statusMessage = "Connected to $activeTargetLabel",
+                                    errorMessage = "",
+                                )
+                            }
                         }
-                        if (cloudStatus.isNotBlank() && cloudStatus != lastCloudStatus) {
-                            lastCloudStatus = cloudStatus
-                            val friendlyStatus = normalizeCloudProgressStatus(cloudStatus)
-                            if (!stats.connected && isTerminalCloudFailure(cloudStatus)) {
-                                val detail = withContext(Dispatchers.IO) {
-                                    core.lastError()
-                                }
-                                withContext(Dispatchers.IO) {
-                                    core.stop()
-                                }
-                                recordSessionInHistory(activeTargetLabel, false, 0)
-                                resetConnectionTracking()
-                                val message = normalizeCloudFailure(cloudStatus, detail)
-                                _state.update {
-                                    it.copy(
-                                        isBusy = false,
-                                        isRunning = false,
-                                        statusMessage = "Connection failed",
-                                        errorMessage = message,
-                                        stats = SessionStats(),
-                                    )
-                                }
-                                stopStatsPolling()
+                    }
+                    is WavryEvent.CloudStatus -> {
+                        val snapshot = _state.value
+                        if (snapshot.isRunning &&
+                            snapshot.mode == ConnectionMode.CLIENT &&
+                            snapshot.connectivityMode == ConnectivityMode.WAVRY &&
+                            event.message.isNotBlank() &&
+                            event.message != lastCloudStatus
+                        ) {
+                            lastCloudStatus = event.message
+                            if (!stats.connected && isTerminalCloudFailure(event.message)) {
+                                failCloudConnect(event.message)
                                 return@launch
                             }
                             if (!stats.connected) {
                                 _state.update {
                                     it.copy(
-                                        statusMessage = friendlyStatus,
+                                        statusMessage = normalizeCloudProgressStatus(event.message),
                                         errorMessage = "",
                                     )
                                 }
                             }
                         }
                     }
-
-                    val elapsedMs = SystemClock.elapsedRealtime() - connectStartedAtMs
-                    if (stats.connected) {
-                        if (!hasConnectedOnce) {
-                            hasConnectedOnce = true
-                            _state.update {
-                                it.copy(
-                                    statusMessage = "Connected to $activeTargetLabel",
-                                    errorMessage = "",
-                                )
-                            }
-                        }
-                    } else if (!hasConnectedOnce && elapsedMs > CONNECT_TIMEOUT_MS) {
-                        withContext(Dispatchers.IO) {
-                            core.stop()
-                        }
-                        recordSessionInHistory(activeTargetLabel, false, elapsedMs)
-                        resetConnectionTracking()
-                        val hint = networkHintForHost(activeResolvedHost)
-                        val baseMessage = if (activeTargetLabel.startsWith("@")) {
-                            "Connection timed out. Check that the remote host is online, hosting, and ready to accept cloud requests."
-                        } else {
-                            "Timed out connecting. Verify host IP/port and ensure desktop host is running."
-                        }
-                        val combined = if (hint.isNullOrBlank()) baseMessage else "$baseMessage\n$hint"
-                        _state.update {
-                            it.copy(
-                                isBusy = false,
-                                isRunning = false,
-                                statusMessage = "Connection failed",
-                                errorMessage = combined,
-                                stats = SessionStats(),
-                            )
-                        }
-                        stopStatsPolling()
-                        return@launch
-                    }
+                    // Read on demand by describeError
+                    is WavryEvent.Error -> continue
                 }
-
                 _state.update {
                     it.copy(stats = stats)
                 }
-                delay(1000)
             }
         }
     }
 
-    private fun stopStatsPolling() {
-        statsJob?.cancel()
-        statsJob = null
+    private suspend fun failCloudConnect(cloudStatus: String) {
+        val detail = withContext(Dispatchers.IO) {
+            core.lastError()
+        }
+        withContext(Dispatchers.IO) {
+            core.stop()
+        }
+        recordSessionInHistory(activeTargetLabel, false, 0)
+        resetConnectionTracking()
+        val message = normalizeCloudFailure(cloudStatus, detail)
+        _state.update {
+            it.copy(
+                isBusy = false,
+                isRunning = false,
+                statusMessage = "Connection failed",
+                errorMessage = message,
+                stats = SessionStats(),
+            )
+        }
+        stopSessionMonitor()
+    }
+
+    private suspend fun failConnectTimeout(elapsedMs: Long) {
+        withContext(Dispatchers.IO) {
+            core.stop()
+        }
+        recordSessionInHistory(activeTargetLabel, false, elapsedMs)
+        val hint = networkHintForHost(activeResolvedHost)
+        val baseMessage = if (activeTargetLabel.startsWith("@")) {
+            "Connection timed out. Check that the remote host is online, hosting, and ready to accept cloud requests."
+        } else {
+            "Timed out connecting. Verify host IP/port and ensure desktop host is running."
+        }
+        resetConnectionTracking()
+        val combined = if (hint.isNullOrBlank()) baseMessage else "$baseMessage\n$hint"
+        _state.update {
+            it.copy(
+                isBusy = false,
+                isRunning = false,
+                statusMessage = "Connection failed",
+                errorMessage = combined,
+                stats = SessionStats(),
+            )
+        }
+        stopSessionMonitor()
+    }
+
+    private fun stopSessionMonitor() {
+        sessionJob?.cancel()
+        sessionJob = null
+        core.setEventListener(null)
     }
 
     private fun resetConnectionTracking() {
@@ -1449,7 +1486,7 @@ class WavryViewModel(application: Application) : AndroidViewModel(application) {
     }
 
     override fun onCleared() {
-        stopStatsPolling()
+        stopSessionMonitor()
         super.onCleared()
     }
 
@@ -8,6 +8,48 @@ const char *wavry_version(void);
 
 // Session Management
 int wavry_start_host(uint16_t port);
+// Fields after display_id are read only with version >= WAVRY_HOST_CONFIG_VERSION, a zeroed
+// tail keeps the defaults.
+#define WAVRY_HOST_CONFIG_VERSION 3
+
+typedef enum {
+  WAVRY_CODEC_H264 = 0,
+  WAVRY_CODEC_HEVC = 1,
+  WAVRY_CODEC_AV1 = 2,
+} WavryCodec;
+
+typedef enum {
+  WAVRY_PRESET_BALANCED = 0,
+  WAVRY_PRESET_SPEED = 1, // lowest encode time
+  WAVRY_PRESET_QUALITY = 2,
+} WavryEncoderPreset;
+
+typedef enum {
+  WAVRY_REFRESH_IDR = 0,           // full IDR frames on loss
+  WAVRY_REFRESH_INTRA_REFRESH = 1, // rolling intra rows, without a bitrate spike
+} WavryRefreshMode;
+
+typedef enum {
+  WAVRY_CONTENT_DEFAULT = 0,
+  WAVRY_CONTENT_SCREEN = 1, // text and UI, screen content coding tools where available
+} WavryContentType;
+
+typedef enum {
+  WAVRY_CURSOR_IN_VIDEO = 0,
+  WAVRY_CURSOR_METADATA = 1, // sent beside the video, drawn by the client (WavryCursorEvent)
+} WavryCursorMode;
+
+// Fixed foveated encoding, same parameters as the foveated rendering of the VR streamer
+typedef struct {
+  uint32_t enabled;
+  float center_size_x;  // (0, 1]
+  float center_size_y;
+  float center_shift_x; // [-1, 1]
+  float center_shift_y;
+  float edge_ratio_x;   // [1, 10]
+  float edge_ratio_y;
+} WavryFoveation;
+
 typedef struct {
   uint16_t width;
   uint16_t height;
@@ -15,8 +57,25 @@ typedef struct {
   uint32_t bitrate_kbps;
   uint32_t keyframe_interval_ms;
   uint32_t display_id;
+  // Version 1, the encoder applies what its backend supports
+  uint32_t version;
+  uint32_t codec;        // WavryCodec
+  uint32_t preset;       // WavryEncoderPreset
+  uint32_t low_latency;  // real-time rate control keeping frames close to the average size
+  uint32_t slices;       // per frame, 0 lets the encoder choose
+  uint32_t refresh_mode; // WavryRefreshMode
+  uint32_t chroma_444;
+  uint32_t ten_bit;      // HEVC and AV1 only
+  WavryFoveation foveation;
+  // Version 2
+  uint32_t content_type; // WavryContentType
+  // Version 3
+  uint32_t cursor_mode;  // WavryCursorMode
 } WavryHostConfig;
 int wavry_start_host_with_config(uint16_t port, const WavryHostConfig *config);
+// Android: ANativeWindow* of the input surface of the host encoder, to render the VirtualDisplay of
+// a MediaProjection into. The caller releases it with ANativeWindow_release, null without a host.
+void *wavry_android_host_input_window(void);
 int wavry_start_client(const char *host_ip, uint16_t port);
 int wavry_stop(void);
 
@@ -29,9 +88,62 @@ int32_t wavry_send_connect_request(const char *target_username);
 
 // Renderer & Injector
 int wavry_init_renderer(void *layer_ptr);
+int wavry_release_renderer(void);
+
+// Zero-copy alternative to wavry_init_renderer on macOS: the decoded frames go to the callback
+// instead of a layer, for the app to present from its CADisplayLink or CVDisplayLink.
+typedef struct {
+  void *pixel_buffer;       // IOSurface backed CVPixelBufferRef, CFRetain it to keep it
+  uint64_t pts_us;          // timestamp of the stream
+  uint64_t decoded_host_us; // CACurrentMediaTime() clock in microseconds, at decoder output
+  uint32_t width;
+  uint32_t height;
+} WavryVideoFrame;
+
+// Called on the decoder thread for every frame, must not block.
+typedef void (*WavryFrameCallback)(const WavryVideoFrame *frame, void *user_data);
+
+// Released by wavry_release_renderer.
+int wavry_init_frame_callback(WavryFrameCallback callback, void *user_data);
+// Records the decoder to display latency in the present_us histogram, with presented_host_us on
+// the same clock, e.g. the targetTimestamp of the display link that showed the frame.
+void wavry_report_frame_presented(uint64_t decoded_host_us, uint64_t presented_host_us);
 int wavry_init_injector(unsigned int width, unsigned int height);
 int wavry_test_input_injection(void);
 
+// Input sent by the client with wavry_send_input_batch, all the events of a tick in one call.
+typedef enum {
+  WAVRY_INPUT_MOUSE_MOVE = 0,     // x, y normalized to the host display
+  WAVRY_INPUT_MOUSE_BUTTON = 1,   // code is the button, 1 is the left one
+  WAVRY_INPUT_KEY = 2,            // code is the key code
+  WAVRY_INPUT_SCROLL = 3,         // x, y is the scroll delta
+  WAVRY_INPUT_GAMEPAD_AXIS = 4,   // id is the gamepad, code the axis, x the value in [-1, 1]
+  WAVRY_INPUT_GAMEPAD_BUTTON = 5, // id is the gamepad, code the button
+  WAVRY_INPUT_TOUCH = 6,          // id is the pointer, code the WavryTouchPhase, x, y normalized
+} WavryInputType;
+
+// Pointer 0 of the touches moves the mouse and holds its left button.
+typedef enum {
+  WAVRY_TOUCH_DOWN = 0,
+  WAVRY_TOUCH_MOVE = 1,
+  WAVRY_TOUCH_UP = 2,
+  WAVRY_TOUCH_CANCEL = 3,
+} WavryTouchPhase;
+
+typedef struct {
+  uint64_t timestamp_us; // since the Unix epoch, 0 stamps the event when the batch is sent
+  uint32_t type;         // WavryInputType
+  uint32_t code;
+  uint32_t id;
+  uint32_t pressed;      // buttons, keys, gamepad buttons
+  float x;
+  float y;
+} WavryInputEvent;
+
+// 0 once all events are queued, -1 invalid arguments, -2 no client session, -3 queue full and the
+// rest of the batch dropped. Doesn't set the last error.
+int wavry_send_input_batch(const WavryInputEvent *events, uint32_t count);
+
 // Stats
 typedef struct {
   int32_t connected;
@@ -42,6 +154,110 @@ typedef struct {
   uint64_t frames_decoded;
 } WavryStats;
 
+// Live stats surface (see wavry_stats_surface). The session updates the fields in place while
+// they are read: load each one atomically, a snapshot can be torn between two fields.
+#define WAVRY_STATS_SURFACE_VERSION 4
+#define WAVRY_LATENCY_BUCKETS 16
+// Bucket 0 counts samples under 256us, bucket i those in [256 << (i - 1), 256 << i) and the last
+// bucket everything longer.
+#define WAVRY_LATENCY_BUCKET_BASE_US 256
+
+typedef enum {
+  WAVRY_DROP_NOT_READY = 0,   // encoded during the handshake
+  WAVRY_DROP_SEND_FAILED = 1, // the host couldn't send it
+  WAVRY_DROP_INCOMPLETE = 2,  // chunks missing when the client assembler timed out
+  WAVRY_DROP_REASON_COUNT = 3,
+} WavryDropReason;
+
+typedef struct {
+  uint32_t version; // WAVRY_STATS_SURFACE_VERSION, fields are only ever appended
+  uint32_t size;    // sizeof the struct in the library, may be larger than this one
+  uint32_t connected;
+  uint32_t fps;
+  uint32_t rtt_ms;
+  uint32_t bitrate_kbps;
+  uint32_t jitter_us;
+  uint32_t jitter_buffer_depth;
+  uint64_t frames_encoded;
+  uint64_t frames_decoded;
+  uint64_t packets_received;
+  uint64_t packets_lost;
+  uint64_t fec_recovered;
+  uint64_t frames_dropped[WAVRY_DROP_REASON_COUNT];
+  uint64_t encode_us[WAVRY_LATENCY_BUCKETS];
+  uint64_t decode_us[WAVRY_LATENCY_BUCKETS];
+  uint64_t network_us[WAVRY_LATENCY_BUCKETS];
+  uint64_t present_us[WAVRY_LATENCY_BUCKETS]; // decoder to display (version 2)
+  uint64_t audio_underruns;        // Android AAudio output (version 3)
+  uint32_t audio_buffer_us;        // jitter buffer of the AAudio output
+  uint32_t audio_device_buffer_us; // device buffer of the AAudio output
+  uint64_t decoder_us[WAVRY_LATENCY_BUCKETS]; // queue to output of MediaCodec (version 4)
+  uint32_t decoder_options;                   // options of the live Android decoder
+  uint32_t decoder_operating_rate;
+} WavryStatsSurface;
+
 int wavry_get_stats(WavryStats *out);
+const WavryStatsSurface *wavry_stats_surface(void);
+uint32_t wavry_stats_surface_size(void);
+int32_t wavry_stats_map_file(const char *path);
+
+// Events pushed to the callback of wavry_set_event_callback, instead of polling
+// wavry_copy_last_error, wavry_copy_last_cloud_status and wavry_get_stats.
+#define WAVRY_EVENT_MESSAGE_MAX 255
+
+typedef enum {
+  WAVRY_EVENT_CONNECTION = 0,   // connected changed
+  WAVRY_EVENT_STATS = 1,        // once a second at most while a session runs, if anything changed
+  WAVRY_EVENT_ERROR = 2,        // message is the new last error
+  WAVRY_EVENT_CLOUD_STATUS = 3, // message is the new cloud status
+} WavryEventType;
+
+typedef struct {
+  uint32_t fps;
+  uint32_t rtt_ms;
+  uint32_t bitrate_kbps;
+  uint32_t jitter_us;
+  // Counted since the previous stats event
+  uint64_t frames_encoded;
+  uint64_t frames_decoded;
+  uint64_t packets_lost;
+  uint64_t fec_recovered;
+} WavryStatsDelta;
+
+typedef struct {
+  uint32_t type;          // WavryEventType
+  uint32_t connected;     // connection state when the event was raised
+  WavryStatsDelta stats;  // WAVRY_EVENT_STATS only
+  const char *message;    // only valid during the callback, empty without a message
+} WavryEvent;
+
+// Called on a library thread, one event at a time. Must not block or call
+// wavry_set_event_callback.
+typedef void (*WavryEventCallback)(const WavryEvent *event, void *user_data);
+
+// A null callback unregisters. The first event is the current connection state. Returns once an
+// event being delivered to the previous callback is done, so its user_data can be freed.
+void wavry_set_event_callback(WavryEventCallback callback, void *user_data);
+
+// Cursor of a host in WAVRY_CURSOR_METADATA mode, to draw over the video with its hotspot at
+// (x, y).
+typedef struct {
+  uint32_t visible;
+  float x;             // normalized to the video, 0..1
+  float y;
+  uint64_t shape_id;   // same id, same image
+  uint32_t width;
+  uint32_t height;
+  uint32_t hotspot_x;
+  uint32_t hotspot_y;
+  const uint8_t *rgba; // straight alpha, width * height * 4, null unless the shape changed
+} WavryCursorEvent;
+
+// Called on the session thread, rgba is only valid during the callback. Must not block.
+typedef void (*WavryCursorCallback)(const WavryCursorEvent *event, void *user_data);
+
+// A null callback unregisters. Returns once an event being delivered to the previous callback is
+// done, so its user_data can be freed.
+void wavry_set_cursor_callback(WavryCursorCallback callback, void *user_data);
 
 #endif
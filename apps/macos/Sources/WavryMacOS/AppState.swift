@@ -42,7 +42,6 @@ class AppState: ObservableObject {
     }()
 
     private var permissionTimer: Timer?
-    private var statsTimer: Timer?
     public let videoLayer = AVSampleBufferDisplayLayer()
 
     // MARK: - Onboarding & Config
@@ -96,7 +95,7 @@ class AppState: ObservableObject {
 
     deinit {
         permissionTimer?.invalidate()
-        statsTimer?.invalidate()
+        wavry_set_event_callback(nil, nil)
     }
 
     var effectiveDisplayName: String {
@@ -260,14 +259,17 @@ class AppState: ObservableObject {
             let (width, height) = parsedResolution()
             let chosenDisplay = hostDisplays.contains(where: { $0.id == selectedDisplayID }) ? selectedDisplayID : UInt32.max
 
-            var config = WavryHostConfig(
-                width: width,
-                height: height,
-                fps: UInt16(max(15, min(hostFps, 240))),
-                bitrate_kbps: UInt32(max(1, bitrateMbps) * 1000),
-                keyframe_interval_ms: UInt32(max(250, min(keyframeIntervalMs, 10000))),
-                display_id: chosenDisplay
-            )
+            var config = WavryHostConfig()
+            config.width = width
+            config.height = height
+            config.fps = UInt16(max(15, min(hostFps, 240)))
+            config.bitrate_kbps = UInt32(max(1, bitrateMbps) * 1000)
+            config.keyframe_interval_ms = UInt32(max(250, min(keyframeIntervalMs, 10000)))
+            config.display_id = chosenDisplay
+            config.version = UInt32(WAVRY_HOST_CONFIG_VERSION)
+            config.codec = WAVRY_CODEC_H264.rawValue
+            config.preset = WAVRY_PRESET_SPEED.rawValue
+            config.low_latency = 1
 
             isStartingHost = true
             let res = withUnsafePointer(to: &config) { ptr in
@@ -277,7 +279,7 @@ class AppState: ObservableObject {
 
             if res == 0 {
                 isHost = true
-                startPollingStats()
+                startObservingEvents()
                 setStatus("Host started on port \(port). Waiting for a client.")
             } else {
                 setError(hostStartErrorMessage(code: res))
@@ -315,7 +317,7 @@ class AppState: ObservableObject {
                     self.isConnectingClient = false
                     if res == 0 {
                         self.isHost = false
-                        self.startPollingStats()
+                        self.startObservingEvents()
                         self.setStatus("Connecting to \(target.host):\(target.port)...")
                     } else {
                         self.setError(self.clientStartErrorMessage(code: res))
@@ -367,8 +369,7 @@ class AppState: ObservableObject {
 
     func stopSession() {
         let res = wavry_stop()
-        statsTimer?.invalidate()
-        statsTimer = nil
+        wavry_set_event_callback(nil, nil)
         isConnected = false
         isHost = false
         isStartingHost = false
@@ -381,20 +382,32 @@ class AppState: ObservableObject {
         }
     }
 
-    func startPollingStats() {
-        statsTimer?.invalidate()
-        statsTimer = Timer.scheduledTimer(withTimeInterval: 0.5, repeats: true) { [weak self] _ in
-            guard let self else { return }
-            var stats = WavryStats()
-            let res = wavry_get_stats(&stats)
-            if res == 0 {
+    func startObservingEvents() {
+        // Unretained: the callback is removed by stopSession and deinit, and
+        // wavry_set_event_callback only returns once an event in delivery is done
+        let userData = Unmanaged.passUnretained(self).toOpaque()
+        wavry_set_event_callback({ eventPtr, userData in
+            guard let eventPtr, let userData else { return }
+            let event = eventPtr.pointee
+            let state = Unmanaged<AppState>.fromOpaque(userData).takeUnretainedValue()
+            let connected = event.connected != 0
+            switch event.type {
+            case WAVRY_EVENT_STATS.rawValue:
+                let fps = Int(event.stats.fps)
+                let rtt = Double(event.stats.rtt_ms)
+                DispatchQueue.main.async {
+                    state.isConnected = connected
+                    state.fps = fps
+                    state.rtt = rtt
+                }
+            case WAVRY_EVENT_CONNECTION.rawValue:
                 DispatchQueue.main.async {
-                    self.isConnected = stats.connected != 0
-                    self.fps = Int(stats.fps)
-                    self.rtt = Double(stats.rtt_ms)
+                    state.isConnected = connected
                 }
+            default:
+                break
             }
-        }
+        }, userData)
     }
 
     func testInput() {
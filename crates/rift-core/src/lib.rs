@@ -310,6 +310,129 @@ fn xor_in_place(target: &mut [u8], payload: &[u8], max_len: usize) {
     }
 }
 
+/// Largest cursor edge sent as metadata; the host scales larger cursors down.
+pub const MAX_CURSOR_DIMENSION: u32 = 256;
+/// Cursor image bytes carried by one CursorShape message.
+pub const CURSOR_SHAPE_CHUNK_BYTES: usize = 900;
+
+/// Decoded cursor image, RGBA8 with straight alpha.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct CursorImage {
+    pub shape_id: u64,
+    pub width: u32,
+    pub height: u32,
+    pub hotspot_x: u32,
+    pub hotspot_y: u32,
+    pub rgba: Vec<u8>,
+}
+
+/// Content id of a cursor image (FNV-1a). Both ends cache shapes by it, so a
+/// shape that comes back (e.g. the arrow after a text caret) is not resent.
+pub fn cursor_shape_id(
+    width: u32,
+    height: u32,
+    hotspot_x: u32,
+    hotspot_y: u32,
+    rgba: &[u8],
+) -> u64 {
+    let mut hash: u64 = 0xcbf2_9ce4_8422_2325;
+    for byte in [width, height, hotspot_x, hotspot_y]
+        .iter()
+        .flat_map(|value| value.to_le_bytes())
+        .chain(rgba.iter().copied())
+    {
+        hash ^= byte as u64;
+        hash = hash.wrapping_mul(0x0000_0100_0000_01b3);
+    }
+    hash
+}
+
+pub fn chunk_cursor_shape(image: &CursorImage) -> Vec<CursorShape> {
+    let chunk_count = image.rgba.len().div_ceil(CURSOR_SHAPE_CHUNK_BYTES).max(1);
+    let mut chunks = Vec::with_capacity(chunk_count);
+    for index in 0..chunk_count {
+        let start = (index * CURSOR_SHAPE_CHUNK_BYTES).min(image.rgba.len());
+        let end = (start + CURSOR_SHAPE_CHUNK_BYTES).min(image.rgba.len());
+        chunks.push(CursorShape {
+            shape_id: image.shape_id,
+            width: image.width,
+            height: image.height,
+            hotspot_x: image.hotspot_x,
+            hotspot_y: image.hotspot_y,
+            chunk_index: index as u32,
+            chunk_count: chunk_count as u32,
+            rgba: image.rgba[start..end].to_vec(),
+        });
+    }
+    chunks
+}
+
+/// Reassembles CursorShape chunks. Shapes are sent one after the other, so a
+/// single shape is assembled at a time; a chunk of another shape restarts it.
+#[derive(Debug, Default)]
+pub struct CursorShapeAssembler {
+    header: Option<CursorShape>,
+    chunks: Vec<Option<Vec<u8>>>,
+    received: usize,
+}
+
+impl CursorShapeAssembler {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn push(&mut self, chunk: CursorShape) -> Option<CursorImage> {
+        let byte_len = chunk.width as usize * chunk.height as usize * 4;
+        if chunk.width == 0
+            || chunk.height == 0
+            || chunk.width > MAX_CURSOR_DIMENSION
+            || chunk.height > MAX_CURSOR_DIMENSION
+            || chunk.chunk_count as usize != byte_len.div_ceil(CURSOR_SHAPE_CHUNK_BYTES)
+            || chunk.chunk_index >= chunk.chunk_count
+            || chunk.rgba.len() > CURSOR_SHAPE_CHUNK_BYTES
+        {
+            return None;
+        }
+
+        let same_shape = self.header.as_ref().is_some_and(|header| {
+            header.shape_id == chunk.shape_id
+                && header.width == chunk.width
+                && header.height == chunk.height
+        });
+        if !same_shape {
+            self.chunks = vec![None; chunk.chunk_count as usize];
+            self.received = 0;
+        }
+        let index = chunk.chunk_index as usize;
+        if self.chunks[index].is_none() {
+            self.received += 1;
+        }
+        self.chunks[index] = Some(chunk.rgba.clone());
+        self.header = Some(CursorShape {
+            rgba: Vec::new(),
+            ..chunk
+        });
+        if self.received < self.chunks.len() {
+            return None;
+        }
+
+        let header = self.header.take()?;
+        let rgba: Vec<u8> = self.chunks.drain(..).flatten().flatten().collect();
+        self.received = 0;
+        if rgba.len() != byte_len {
+            return None;
+        }
+        Some(CursorImage {
+            shape_id: header.shape_id,
+            width: header.width,
+            height: header.height,
+            hotspot_x: header.hotspot_x,
+            hotspot_y: header.hotspot_y,
+            rgba,
+        })
+    }
+}
+
 #[derive(Debug, Clone, PartialEq, Eq)]
 pub enum HandshakeState {
     Init,
@@ -640,6 +763,43 @@ mod tests {
         assert!(matches!(builder, Err(FecError::InvalidShardCount)));
     }
 
+    #[test]
+    fn cursor_shape_round_trip() {
+        let rgba: Vec<u8> = (0..32 * 32 * 4).map(|i| i as u8).collect();
+        let image = CursorImage {
+            shape_id: cursor_shape_id(32, 32, 4, 2, &rgba),
+            width: 32,
+            height: 32,
+            hotspot_x: 4,
+            hotspot_y: 2,
+            rgba,
+        };
+        let mut chunks = chunk_cursor_shape(&image);
+        assert_eq!(chunks.len(), 5);
+        chunks.reverse();
+
+        let mut assembler = CursorShapeAssembler::new();
+        let last = chunks.pop().unwrap();
+        assert!(chunks
+            .drain(..)
+            .all(|chunk| assembler.push(chunk).is_none()));
+        assert_eq!(assembler.push(last), Some(image));
+    }
+
+    #[test]
+    fn cursor_shape_rejects_oversized() {
+        let mut assembler = CursorShapeAssembler::new();
+        let chunk = CursorShape {
+            shape_id: 1,
+            width: MAX_CURSOR_DIMENSION + 1,
+            height: 1,
+            chunk_count: 2,
+            rgba: vec![0; 16],
+            ..Default::default()
+        };
+        assert!(assembler.push(chunk).is_none());
+    }
+
     #[test]
     fn packet_priority_mapping() {
         assert_eq!(packet_priority(Channel::Control), PacketPriority::Control);
@@ -146,6 +146,8 @@ fn main() -> anyhow::Result<()> {
         file_out_dir: args.file_out_dir,
         file_max_bytes: args.file_max_bytes,
         file_command_bus,
+        input_sink: None,
+        cursor_sink: None,
     };
 
     tokio::runtime::Builder::new_multi_thread()
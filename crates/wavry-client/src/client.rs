@@ -26,8 +26,8 @@ use socket2::SockRef;
 use crate::helpers::{env_bool, local_platform, now_us};
 use crate::input::spawn_input_threads;
 use crate::media::{
-    ArrivalJitter, FecCache, FrameAssembler, JitterBuffer, NackWindow, RttTracker,
-    FRAME_TIMEOUT_US, NACK_WINDOW_SIZE,
+    ArrivalJitter, CursorReceiver, FecCache, FrameAssembler, JitterBuffer, NackWindow,
+    RttTracker, FRAME_TIMEOUT_US, NACK_WINDOW_SIZE,
 };
 use crate::types::{
     ClientConfig, ClientRuntimeStats, CryptoState, FileTransferCommand, RelayInfo, RendererFactory,
@@ -182,8 +182,7 @@ struct RuntimeStatsGuard {
 impl RuntimeStatsGuard {
     fn new(stats: Option<Arc<ClientRuntimeStats>>) -> Self {
         if let Some(s) = stats.as_ref() {
-            s.connected.store(false, Ordering::Relaxed);
-            s.frames_decoded.store(0, Ordering::Relaxed);
+            s.reset();
         }
         Self { stats }
     }
@@ -626,6 +625,9 @@ async fn run_client_inner(
 
     // Create input channel
     let (input_tx, mut input_rx) = mpsc::channel::<rift_core::InputMessage>(128);
+    if let Some(sink) = &config.input_sink {
+        *sink.lock().unwrap() = Some(input_tx.clone());
+    }
     spawn_input_threads(input_tx, config.gamepad_enabled, config.gamepad_deadzone)?;
 
     // VR adapter wiring (optional)
@@ -847,6 +849,7 @@ async fn run_client_inner(
     let _video_disabled = false;
     let mut frames = FrameAssembler::new(FRAME_TIMEOUT_US);
     let mut fec_cache = FecCache::new();
+    let mut cursor = CursorReceiver::new();
 
     let mut clipboard = ArboardClipboard::new().ok();
     let mut last_clipboard_text = clipboard.as_mut().and_then(|c| c.get_text().ok()).flatten();
@@ -1036,6 +1039,12 @@ async fn run_client_inner(
             _ = stats_interval.tick() => {
                 let stats_received = received_packets;
                 let stats_lost = lost_packets;
+                if let Some(stats) = runtime_stats.as_ref() {
+                    stats.packets_received.fetch_add(stats_received as u64, Ordering::Relaxed);
+                    stats.packets_lost.fetch_add(stats_lost as u64, Ordering::Relaxed);
+                    stats.jitter_us.store(arrival_jitter.jitter_us(), Ordering::Relaxed);
+                    stats.frames_incomplete.store(frames.timed_out(), Ordering::Relaxed);
+                }
                 if let Some(alias) = session_alias {
                     let stats = ProtoStatsReport {
                         period_ms: 1000,
@@ -1141,6 +1150,8 @@ async fn run_client_inner(
                         let render_duration_us = render_start.elapsed().as_micros() as u32;
                         if let Some(stats) = runtime_stats.as_ref() {
                             stats.frames_decoded.fetch_add(1, Ordering::Relaxed);
+                            stats.decode_us.record(render_duration_us as u64);
+                            stats.network_us.record(last_rtt_us / 2);
                         }
 
                         if let Some(alias) = session_alias {
@@ -1162,6 +1173,9 @@ async fn run_client_inner(
                         }
                     }
                 }
+                if let Some(stats) = runtime_stats.as_ref() {
+                    stats.jitter_buffer_depth.store(jitter_buffer.len() as u32, Ordering::Relaxed);
+                }
             }
 
             // Receive packets
@@ -1347,6 +1361,17 @@ async fn run_client_inner(
                                                         Err(e) => warn!("audio renderer init failed: {}", e),
                                                     }
                                                 }
+                                                #[cfg(target_os = "android")]
+                                                {
+                                                    let audio_stats = runtime_stats
+                                                        .as_ref()
+                                                        .map(|stats| stats.audio_output.clone())
+                                                        .unwrap_or_default();
+                                                    match wavry_media::AndroidAudioRenderer::new(audio_stats) {
+                                                        Ok(ar) => audio_renderer = Some(Box::new(ar)),
+                                                        Err(e) => warn!("audio renderer init failed: {}", e),
+                                                    }
+                                                }
                                             }
                                         }
                                     }
@@ -1383,6 +1408,9 @@ async fn run_client_inner(
                                 rift_core::control_message::Content::Pong(pong) => {
                                     let rtt_us = now_us().saturating_sub(pong.timestamp_us);
                                     last_rtt_us = rtt_us;
+                                    if let Some(stats) = runtime_stats.as_ref() {
+                                        stats.rtt_us.store(rtt_us, Ordering::Relaxed);
+                                    }
                                     let rtt_smooth = rtt_tracker.on_sample(rtt_us);
                                     if let Some(alias) = session_alias {
                                         if rtt_us as f64 > rtt_smooth + 30_000.0
@@ -1519,6 +1547,31 @@ async fn run_client_inner(
                                         Err(err) => warn!("invalid file offer {}: {}", file_id, err),
                                     }
                                 }
+                                rift_core::control_message::Content::CursorShape(shape) => {
+                                    if let Some(update) = cursor.on_shape(shape) {
+                                        if let Some(sink) = config.cursor_sink.as_ref() {
+                                            sink(&update);
+                                        }
+                                    }
+                                }
+                                rift_core::control_message::Content::CursorPosition(position) => {
+                                    let (update, request) = cursor.on_position(position, now_us());
+                                    if let (Some(update), Some(sink)) = (update, config.cursor_sink.as_ref()) {
+                                        sink(&update);
+                                    }
+                                    if let (Some(shape_id), Some(alias)) = (request, session_alias) {
+                                        let msg = ProtoMessage {
+                                            content: Some(rift_core::message::Content::Control(ProtoControl {
+                                                content: Some(rift_core::control_message::Content::CursorShapeRequest(
+                                                    rift_core::CursorShapeRequest { shape_id },
+                                                )),
+                                            })),
+                                        };
+                                        if let Err(e) = send_rift_msg(&socket, &mut crypto, connect_addr, msg, Some(alias), next_packet_id(), relay_info).await {
+                                            debug!("cursor shape request send error: {}", e);
+                                        }
+                                    }
+                                }
                                 rift_core::control_message::Content::FileStatus(status) => {
                                     let status_name = rift_core::file_status::Status::try_from(status.status)
                                         .map(|s| format!("{:?}", s))
@@ -1578,6 +1631,9 @@ async fn run_client_inner(
                             }
                             Some(rift_core::media_message::Content::Fec(fec)) => {
                                 if let Some(recovered_plaintext) = fec_cache.try_recover(&fec) {
+                                    if let Some(stats) = runtime_stats.as_ref() {
+                                        stats.fec_recovered.fetch_add(1, Ordering::Relaxed);
+                                    }
                                     if let Ok(recovered_msg) = decode_msg(&recovered_plaintext) {
                                         if let Some(rift_core::message::Content::Media(recovered_media)) = recovered_msg.content {
                                             match recovered_media.content {
@@ -11,8 +11,8 @@ pub use helpers::{
     discover_public_addr, env_bool, local_platform, now_us,
 };
 pub use types::{
-    ClientConfig, ClientRuntimeStats, CryptoState, FileTransferAction, FileTransferCommand,
-    RelayInfo, RendererFactory,
+    ClientConfig, ClientRuntimeStats, CryptoState, CursorSink, CursorUpdate, FileTransferAction,
+    FileTransferCommand, InputSink, LatencyHistogram, RelayInfo, RendererFactory, LATENCY_BUCKETS,
 };
 
 pub fn pcvr_status() -> String {
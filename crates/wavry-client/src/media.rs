@@ -1,6 +1,10 @@
 use crate::helpers::now_us;
-use rift_core::{FecPacket, VideoChunk};
+use crate::types::CursorUpdate;
+use rift_core::{
+    CursorImage, CursorPosition, CursorShape, CursorShapeAssembler, FecPacket, VideoChunk,
+};
 use std::collections::{BTreeSet, HashMap, VecDeque};
+use std::sync::Arc;
 use tracing::debug;
 
 pub const FRAME_TIMEOUT_US: u64 = 50_000;
@@ -9,10 +13,15 @@ pub const JITTER_GROW_THRESHOLD_US: f64 = 2_000.0;
 pub const JITTER_SHRINK_THRESHOLD_US: f64 = 500.0;
 pub const JITTER_MAX_BUFFER_US: u64 = 10_000;
 pub const NACK_WINDOW_SIZE: u64 = 128;
+/// Cursor shapes kept by id, the host sends each one once per session.
+pub const MAX_CURSOR_SHAPES: usize = 32;
+/// A missing cursor shape is requested again at most this often.
+pub const CURSOR_SHAPE_REQUEST_INTERVAL_US: u64 = 250_000;
 
 pub struct FrameAssembler {
     timeout_us: u64,
     frames: HashMap<u64, FrameBuffer>,
+    timed_out: u64,
 }
 
 pub struct FrameBuffer {
@@ -40,13 +49,22 @@ impl FrameAssembler {
         Self {
             timeout_us,
             frames: HashMap::new(),
+            timed_out: 0,
         }
     }
 
+    /// Frames dropped so far because their chunks didn't all arrive within the timeout
+    pub fn timed_out(&self) -> u64 {
+        self.timed_out
+    }
+
     pub fn push(&mut self, chunk: VideoChunk) -> Option<AssembledFrame> {
         let now = now_us();
+        let timeout_us = self.timeout_us;
+        let before = self.frames.len();
         self.frames
-            .retain(|_, frame| now.saturating_sub(frame.first_seen_us) < self.timeout_us);
+            .retain(|_, frame| now.saturating_sub(frame.first_seen_us) < timeout_us);
+        self.timed_out += (before - self.frames.len()) as u64;
 
         let entry = self
             .frames
@@ -317,6 +335,14 @@ impl JitterBuffer {
         }
     }
 
+    pub fn len(&self) -> usize {
+        self.queue.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.queue.is_empty()
+    }
+
     pub fn push(&mut self, frame: AssembledFrame, arrival_us: u64) {
         self.queue.push_back(BufferedFrame { arrival_us, frame });
     }
@@ -330,3 +356,213 @@ impl JitterBuffer {
         None
     }
 }
+
+/// Cursor sent as metadata: reassembles and caches the shapes, and pairs every position with
+/// its shape. A position whose shape is missing keeps the previous shape on screen until it
+/// arrives, and the shape is requested from the host.
+pub struct CursorReceiver {
+    assembler: CursorShapeAssembler,
+    shapes: HashMap<u64, Arc<CursorImage>>,
+    // Oldest first, for eviction
+    shape_order: VecDeque<u64>,
+    shown_shape: Option<u64>,
+    pending: Option<CursorPosition>,
+    last_request: Option<(u64, u64)>,
+}
+
+impl Default for CursorReceiver {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl CursorReceiver {
+    pub fn new() -> Self {
+        Self {
+            assembler: CursorShapeAssembler::new(),
+            shapes: HashMap::new(),
+            shape_order: VecDeque::new(),
+            shown_shape: None,
+            pending: None,
+            last_request: None,
+        }
+    }
+
+    /// The update for the position that waited on this shape, once its last chunk arrived.
+    pub fn on_shape(&mut self, chunk: CursorShape) -> Option<CursorUpdate> {
+        let image = self.assembler.push(chunk)?;
+        let shape_id = image.shape_id;
+        if self.shapes.insert(shape_id, Arc::new(image)).is_none() {
+            self.shape_order.push_back(shape_id);
+            while self.shape_order.len() > MAX_CURSOR_SHAPES {
+                if let Some(oldest) = self.shape_order.pop_front() {
+                    self.shapes.remove(&oldest);
+                }
+            }
+        }
+
+        match self.pending.take() {
+            Some(position) if position.shape_id == shape_id => self.update(&position),
+            pending => {
+                self.pending = pending;
+                None
+            }
+        }
+    }
+
+    /// The update to draw, and a shape to request from the host.
+    pub fn on_position(
+        &mut self,
+        position: CursorPosition,
+        now_us: u64,
+    ) -> (Option<CursorUpdate>, Option<u64>) {
+        if self.shapes.contains_key(&position.shape_id) {
+            self.pending = None;
+            return (self.update(&position), None);
+        }
+
+        let shape_id = position.shape_id;
+        let request = match self.last_request {
+            Some((id, at))
+                if id == shape_id
+                    && now_us.saturating_sub(at) < CURSOR_SHAPE_REQUEST_INTERVAL_US =>
+            {
+                None
+            }
+            _ => {
+                self.last_request = Some((shape_id, now_us));
+                Some(shape_id)
+            }
+        };
+        let update = CursorUpdate {
+            visible: position.visible && self.shown_shape.is_some(),
+            x: position.x,
+            y: position.y,
+            shape: self
+                .shown_shape
+                .and_then(|id| self.shapes.get(&id).cloned()),
+            shape_changed: false,
+        };
+        self.pending = Some(position);
+        (Some(update), request)
+    }
+
+    fn update(&mut self, position: &CursorPosition) -> Option<CursorUpdate> {
+        let shape = self.shapes.get(&position.shape_id).cloned()?;
+        let shape_changed = self.shown_shape != Some(position.shape_id);
+        self.shown_shape = Some(position.shape_id);
+        Some(CursorUpdate {
+            visible: position.visible,
+            x: position.x,
+            y: position.y,
+            shape: Some(shape),
+            shape_changed,
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use rift_core::chunk_cursor_shape;
+
+    fn shape(shape_id: u64, edge: u32) -> Vec<CursorShape> {
+        chunk_cursor_shape(&CursorImage {
+            shape_id,
+            width: edge,
+            height: edge,
+            hotspot_x: 0,
+            hotspot_y: 0,
+            rgba: vec![shape_id as u8; (edge * edge * 4) as usize],
+        })
+    }
+
+    fn position(shape_id: u64, x: f32) -> CursorPosition {
+        CursorPosition {
+            timestamp_us: 0,
+            visible: true,
+            x,
+            y: 0.5,
+            shape_id,
+        }
+    }
+
+    fn receive_shape(cursor: &mut CursorReceiver, shape_id: u64) -> Option<CursorUpdate> {
+        shape(shape_id, 2)
+            .into_iter()
+            .filter_map(|chunk| cursor.on_shape(chunk))
+            .last()
+    }
+
+    #[test]
+    fn test_cursor_known_shape() {
+        let mut cursor = CursorReceiver::new();
+        // Large enough to take several chunks
+        let chunks = shape(1, 32);
+        assert!(chunks.len() > 1);
+        for chunk in chunks {
+            assert!(cursor.on_shape(chunk).is_none());
+        }
+
+        let (update, request) = cursor.on_position(position(1, 0.25), 0);
+        let update = update.unwrap();
+        assert!(request.is_none());
+        assert!(update.visible && update.shape_changed);
+        assert_eq!(update.x, 0.25);
+        assert_eq!(update.shape.unwrap().width, 32);
+
+        let (update, _) = cursor.on_position(position(1, 0.5), 1_000);
+        assert!(!update.unwrap().shape_changed);
+    }
+
+    #[test]
+    fn test_cursor_missing_shape() {
+        let mut cursor = CursorReceiver::new();
+        let (update, request) = cursor.on_position(position(7, 0.1), 0);
+        let update = update.unwrap();
+        // Nothing to draw yet
+        assert!(!update.visible && update.shape.is_none());
+        assert_eq!(request, Some(7));
+
+        let (_, request) = cursor.on_position(position(7, 0.2), 100_000);
+        assert_eq!(request, None);
+        let (_, request) = cursor.on_position(position(7, 0.3), CURSOR_SHAPE_REQUEST_INTERVAL_US);
+        assert_eq!(request, Some(7));
+
+        // The position that waited is drawn once the shape is in
+        let update = receive_shape(&mut cursor, 7).unwrap();
+        assert!(update.visible && update.shape_changed);
+        assert_eq!(update.x, 0.3);
+        assert_eq!(update.shape.unwrap().shape_id, 7);
+    }
+
+    #[test]
+    fn test_cursor_keeps_shown_shape_while_waiting() {
+        let mut cursor = CursorReceiver::new();
+        assert!(receive_shape(&mut cursor, 1).is_none());
+        cursor.on_position(position(1, 0.1), 0);
+
+        let (update, request) = cursor.on_position(position(2, 0.2), 1_000);
+        let update = update.unwrap();
+        assert_eq!(request, Some(2));
+        assert!(update.visible && !update.shape_changed);
+        assert_eq!(update.x, 0.2);
+        assert_eq!(update.shape.unwrap().shape_id, 1);
+
+        // Another shape arriving doesn't complete the pending position
+        assert!(receive_shape(&mut cursor, 3).is_none());
+        assert!(receive_shape(&mut cursor, 2).unwrap().shape_changed);
+    }
+
+    #[test]
+    fn test_cursor_shape_eviction() {
+        let mut cursor = CursorReceiver::new();
+        for shape_id in 0..=MAX_CURSOR_SHAPES as u64 {
+            receive_shape(&mut cursor, shape_id);
+        }
+        let (_, request) = cursor.on_position(position(0, 0.5), 0);
+        assert_eq!(request, Some(0));
+        let (_, request) = cursor.on_position(position(1, 0.5), 0);
+        assert_eq!(request, None);
+    }
+}
@@ -5,11 +5,11 @@ use std::net::SocketAddr;
 use std::path::PathBuf;
 use std::str::FromStr;
 use std::sync::{
-    atomic::{AtomicBool, AtomicU64},
+    atomic::{AtomicBool, AtomicU32, AtomicU64, Ordering},
     Arc, Mutex,
 };
 use uuid::Uuid;
-use wavry_media::{DecodeConfig, Renderer, Resolution as MediaResolution};
+use wavry_media::{AudioOutputStats, DecodeConfig, Renderer, Resolution as MediaResolution};
 use wavry_vr::VrAdapter;
 
 #[derive(Clone)]
@@ -30,6 +30,27 @@ pub struct ClientConfig {
     pub file_out_dir: PathBuf,
     pub file_max_bytes: u64,
     pub file_command_bus: Option<tokio::sync::broadcast::Sender<FileTransferCommand>>,
+    pub input_sink: Option<InputSink>,
+    /// Receives the cursor when the host sends it as metadata instead of in the video
+    pub cursor_sink: Option<CursorSink>,
+}
+
+/// Holds the sender of the input channel while a session runs, so an embedder can send input
+/// next to the local capture threads.
+pub type InputSink = Arc<Mutex<Option<tokio::sync::mpsc::Sender<rift_core::InputMessage>>>>;
+
+/// Cursor to draw over the video, from the session loop. It must not block.
+pub type CursorSink = Arc<dyn Fn(&CursorUpdate) + Send + Sync>;
+
+#[derive(Debug, Clone)]
+pub struct CursorUpdate {
+    pub visible: bool,
+    /// Normalized to the video, 0..1, the hotspot of the shape goes there
+    pub x: f32,
+    pub y: f32,
+    pub shape: Option<Arc<rift_core::CursorImage>>,
+    /// The shape differs from the one of the previous update
+    pub shape_changed: bool,
 }
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
@@ -85,11 +106,98 @@ pub struct RelayInfo {
     pub session_id: Uuid,
 }
 
+/// Number of buckets of a [`LatencyHistogram`].
+pub const LATENCY_BUCKETS: usize = 16;
+/// Upper bound of the first [`LatencyHistogram`] bucket, each following bucket doubles it.
+pub const LATENCY_BUCKET_BASE_US: u64 = 256;
+
+/// Log2 histogram of a latency in microseconds. Bucket 0 counts the samples under 256µs and
+/// bucket `i` those in `[256 << (i - 1), 256 << i)`, the last bucket also takes everything
+/// longer. `repr(C)` so the FFI stats surface can embed it as is.
+#[repr(C)]
+#[derive(Debug)]
+pub struct LatencyHistogram {
+    pub buckets: [AtomicU64; LATENCY_BUCKETS],
+}
+
+impl Default for LatencyHistogram {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl LatencyHistogram {
+    pub const fn new() -> Self {
+        #[allow(clippy::declare_interior_mutable_const)]
+        const ZERO: AtomicU64 = AtomicU64::new(0);
+        Self {
+            buckets: [ZERO; LATENCY_BUCKETS],
+        }
+    }
+
+    pub fn bucket_index(us: u64) -> usize {
+        let scaled = us / LATENCY_BUCKET_BASE_US;
+        let index = (u64::BITS - scaled.leading_zeros()) as usize;
+        index.min(LATENCY_BUCKETS - 1)
+    }
+
+    pub fn record(&self, us: u64) {
+        self.buckets[Self::bucket_index(us)].fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Overwrites the counts with those of `other`, bucket by bucket.
+    pub fn copy_from(&self, other: &LatencyHistogram) {
+        for (dst, src) in self.buckets.iter().zip(other.buckets.iter()) {
+            dst.store(src.load(Ordering::Relaxed), Ordering::Relaxed);
+        }
+    }
+
+    pub fn reset(&self) {
+        for bucket in self.buckets.iter() {
+            bucket.store(0, Ordering::Relaxed);
+        }
+    }
+}
+
 #[derive(Debug, Default)]
 pub struct ClientRuntimeStats {
     pub connected: AtomicBool,
     pub frames_decoded: AtomicU64,
     pub monitors: Mutex<Vec<rift_core::MonitorInfo>>,
+    pub rtt_us: AtomicU64,
+    pub jitter_us: AtomicU32,
+    /// Assembled frames waiting in the jitter buffer
+    pub jitter_buffer_depth: AtomicU32,
+    pub packets_received: AtomicU64,
+    pub packets_lost: AtomicU64,
+    /// Packets rebuilt from FEC parity
+    pub fec_recovered: AtomicU64,
+    /// Frames given up by the assembler with chunks still missing
+    pub frames_incomplete: AtomicU64,
+    /// Decode and render time of each presented frame
+    pub decode_us: LatencyHistogram,
+    /// One way network delay estimated from the RTT, sampled per presented frame
+    pub network_us: LatencyHistogram,
+    /// Filled by audio renderers that track their buffering, the Android AAudio one for now
+    pub audio_output: Arc<AudioOutputStats>,
+}
+
+impl ClientRuntimeStats {
+    /// Clears the counters of the previous session, the monitor list is kept.
+    pub fn reset(&self) {
+        self.connected.store(false, Ordering::Relaxed);
+        self.frames_decoded.store(0, Ordering::Relaxed);
+        self.rtt_us.store(0, Ordering::Relaxed);
+        self.jitter_us.store(0, Ordering::Relaxed);
+        self.jitter_buffer_depth.store(0, Ordering::Relaxed);
+        self.packets_received.store(0, Ordering::Relaxed);
+        self.packets_lost.store(0, Ordering::Relaxed);
+        self.fec_recovered.store(0, Ordering::Relaxed);
+        self.frames_incomplete.store(0, Ordering::Relaxed);
+        self.decode_us.reset();
+        self.network_us.reset();
+        self.audio_output.reset();
+    }
 }
 
 pub type RendererFactory = Box<dyn Fn(DecodeConfig) -> Result<Box<dyn Renderer + Send>> + Send>;
@@ -125,6 +233,27 @@ pub enum VrOutbound {
 mod tests {
     use super::*;
 
+    #[test]
+    fn test_latency_histogram_buckets() {
+        assert_eq!(LatencyHistogram::bucket_index(0), 0);
+        assert_eq!(LatencyHistogram::bucket_index(255), 0);
+        assert_eq!(LatencyHistogram::bucket_index(256), 1);
+        assert_eq!(LatencyHistogram::bucket_index(511), 1);
+        assert_eq!(LatencyHistogram::bucket_index(512), 2);
+        assert_eq!(LatencyHistogram::bucket_index(16_384), 7);
+        assert_eq!(
+            LatencyHistogram::bucket_index(u64::MAX),
+            LATENCY_BUCKETS - 1
+        );
+
+        let histogram = LatencyHistogram::new();
+        histogram.record(300);
+        histogram.record(400);
+        assert_eq!(histogram.buckets[1].load(Ordering::Relaxed), 2);
+        histogram.reset();
+        assert_eq!(histogram.buckets[1].load(Ordering::Relaxed), 0);
+    }
+
     #[test]
     fn test_client_config_creation() {
         let config = ClientConfig {
@@ -144,6 +273,8 @@ mod tests {
             file_out_dir: PathBuf::from("received-files"),
             file_max_bytes: wavry_common::file_transfer::DEFAULT_MAX_FILE_BYTES,
             file_command_bus: None,
+            input_sink: None,
+            cursor_sink: None,
         };
 
         assert_eq!(config.client_name, "TestClient");
@@ -174,6 +305,8 @@ mod tests {
             file_out_dir: PathBuf::from("received-files"),
             file_max_bytes: wavry_common::file_transfer::DEFAULT_MAX_FILE_BYTES,
             file_command_bus: None,
+            input_sink: None,
+            cursor_sink: None,
         };
 
         let config2 = config1.clone();
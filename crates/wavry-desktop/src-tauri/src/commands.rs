@@ -401,6 +401,8 @@ pub async fn start_session(
         file_out_dir: std::path::PathBuf::from("received-files"),
         file_max_bytes: 1_073_741_824,
         file_command_bus: None,
+        input_sink: None,
+        cursor_sink: None,
     };
 
     spawn_client_session(config)?;
@@ -649,6 +651,8 @@ pub async fn connect_via_id(target_username: String) -> Result<String, String> {
                         file_out_dir: std::path::PathBuf::from("received-files"),
                         file_max_bytes: 1_073_741_824,
                         file_command_bus: None,
+                        input_sink: None,
+                        cursor_sink: None,
                     };
 
                     spawn_client_session(config)?;
@@ -739,6 +743,7 @@ pub async fn start_host(
         display_id: Some(preflight.selected_display_id),
         enable_10bit: false,
         enable_hdr: false,
+        tuning: wavry_media::EncoderTuning::default(),
     };
 
     let mut signaling_token: Option<String> = None;
@@ -0,0 +1,82 @@
+//! Cursor drawn by the app.
+//!
+//! A host in `WAVRY_CURSOR_METADATA` mode leaves the cursor out of the video and sends its shape
+//! and position beside it. The client session hands every update to the callback of
+//! `wavry_set_cursor_callback`, and the app draws the cursor over the video, so moving it never
+//! waits on an encoded frame.
+
+use once_cell::sync::Lazy;
+use std::ffi::c_void;
+use std::sync::{Arc, Mutex};
+use wavry_client::{CursorSink, CursorUpdate};
+
+/// Layout mirrored by `WavryCursorEvent` in wavry.h.
+#[repr(C)]
+pub struct WavryCursorEvent {
+    pub visible: u32,
+    /// Normalized to the video, 0..1, the hotspot goes there
+    pub x: f32,
+    pub y: f32,
+    pub shape_id: u64,
+    pub width: u32,
+    pub height: u32,
+    pub hotspot_x: u32,
+    pub hotspot_y: u32,
+    /// RGBA8 with straight alpha, `width * height * 4` bytes and only valid during the callback.
+    /// Null unless the shape changed since the previous event.
+    pub rgba: *const u8,
+}
+
+pub type WavryCursorCallback = Option<unsafe extern "C" fn(*const WavryCursorEvent, *mut c_void)>;
+
+#[derive(Clone, Copy)]
+struct Callback {
+    func: unsafe extern "C" fn(*const WavryCursorEvent, *mut c_void),
+    // Kept as an address so the sink is Send, the app owns what it points to
+    user_data: usize,
+}
+
+// Held while an update is delivered, so a replaced callback is never called afterwards
+static CALLBACK: Lazy<Mutex<Option<Callback>>> = Lazy::new(|| Mutex::new(None));
+
+fn deliver(update: &CursorUpdate) {
+    let callback = CALLBACK.lock().unwrap();
+    let Some(callback) = *callback else {
+        return;
+    };
+    let shape = update.shape.as_deref();
+    let raw = WavryCursorEvent {
+        visible: (update.visible && shape.is_some()) as u32,
+        x: update.x,
+        y: update.y,
+        shape_id: shape.map_or(0, |shape| shape.shape_id),
+        width: shape.map_or(0, |shape| shape.width),
+        height: shape.map_or(0, |shape| shape.height),
+        hotspot_x: shape.map_or(0, |shape| shape.hotspot_x),
+        hotspot_y: shape.map_or(0, |shape| shape.hotspot_y),
+        rgba: match shape {
+            Some(shape) if update.shape_changed => shape.rgba.as_ptr(),
+            _ => std::ptr::null(),
+        },
+    };
+    unsafe { (callback.func)(&raw, callback.user_data as *mut c_void) };
+}
+
+/// Handed to the client session.
+pub(crate) fn sink() -> CursorSink {
+    Arc::new(deliver)
+}
+
+/// Registers `callback`, or unregisters with a null one. Updates are delivered on the session
+/// thread: the callback must copy what it keeps and must not block. Returns once an update being
+/// delivered to the previous callback is done, so its `user_data` can be freed afterwards.
+#[no_mangle]
+pub unsafe extern "C" fn wavry_set_cursor_callback(
+    callback: WavryCursorCallback,
+    user_data: *mut c_void,
+) {
+    *CALLBACK.lock().unwrap() = callback.map(|func| Callback {
+        func,
+        user_data: user_data as usize,
+    });
+}
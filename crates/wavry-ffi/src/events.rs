@@ -0,0 +1,382 @@
+//! Event callback for the apps.
+//!
+//! Polling `wavry_copy_last_error`, `wavry_copy_last_cloud_status` and `wavry_get_stats` on a
+//! timer wakes the app and allocates on its side even when nothing changed. With
+//! `wavry_set_event_callback` the library pushes typed events instead. Whoever raises an event
+//! copies it into a preallocated ring, and a single worker thread delivers the events in order.
+//! While a session runs the worker also turns the stats surface into deltas, only when something
+//! moved since the last one.
+
+use std::ffi::{c_char, c_void};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Condvar, Mutex, Once};
+use std::time::{Duration, Instant};
+
+use once_cell::sync::Lazy;
+
+/// Longest message of an error or cloud status event in bytes, longer ones are truncated.
+pub const EVENT_MESSAGE_MAX: usize = 255;
+/// Events waiting for delivery at most, newer ones are dropped while the ring is full.
+const QUEUE_CAPACITY: usize = 64;
+/// Stats events are sent at most this often.
+const STATS_INTERVAL: Duration = Duration::from_millis(1000);
+
+/// Mirrored by `WavryEventType` in wavry.h.
+#[repr(u32)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum EventType {
+    Connection = 0,
+    Stats = 1,
+    Error = 2,
+    CloudStatus = 3,
+}
+
+/// Layout mirrored by `WavryStatsDelta` in wavry.h.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct WavryStatsDelta {
+    pub fps: u32,
+    pub rtt_ms: u32,
+    pub bitrate_kbps: u32,
+    pub jitter_us: u32,
+    /// Counted since the previous stats event
+    pub frames_encoded: u64,
+    pub frames_decoded: u64,
+    pub packets_lost: u64,
+    pub fec_recovered: u64,
+}
+
+/// Layout mirrored by `WavryEvent` in wavry.h.
+#[repr(C)]
+pub struct WavryEvent {
+    pub kind: u32,
+    pub connected: u32,
+    pub stats: WavryStatsDelta,
+    /// NUL terminated, only valid during the callback. Empty for connection and stats events.
+    pub message: *const c_char,
+}
+
+pub type WavryEventCallback = Option<unsafe extern "C" fn(*const WavryEvent, *mut c_void)>;
+
+#[derive(Clone, Copy)]
+struct Callback {
+    func: unsafe extern "C" fn(*const WavryEvent, *mut c_void),
+    // Kept as an address so the dispatcher is Send, the app owns what it points to
+    user_data: usize,
+}
+
+#[derive(Clone, Copy)]
+struct QueuedEvent {
+    kind: EventType,
+    connected: bool,
+    stats: WavryStatsDelta,
+    message: [u8; EVENT_MESSAGE_MAX + 1],
+}
+
+impl QueuedEvent {
+    const EMPTY: Self = Self {
+        kind: EventType::Connection,
+        connected: false,
+        stats: WavryStatsDelta {
+            fps: 0,
+            rtt_ms: 0,
+            bitrate_kbps: 0,
+            jitter_us: 0,
+            frames_encoded: 0,
+            frames_decoded: 0,
+            packets_lost: 0,
+            fec_recovered: 0,
+        },
+        message: [0; EVENT_MESSAGE_MAX + 1],
+    };
+
+    fn set_message(&mut self, message: &str) {
+        let mut len = message.len().min(EVENT_MESSAGE_MAX);
+        while !message.is_char_boundary(len) {
+            len -= 1;
+        }
+        self.message[..len].copy_from_slice(&message.as_bytes()[..len]);
+        self.message[len] = 0;
+    }
+}
+
+struct Queue {
+    events: Box<[QueuedEvent; QUEUE_CAPACITY]>,
+    head: usize,
+    len: usize,
+    dropped: u64,
+    /// Stats are only sampled while a session runs, the worker sleeps otherwise
+    session_active: bool,
+}
+
+struct Dispatcher {
+    queue: Mutex<Queue>,
+    wake: Condvar,
+    // Held while an event is delivered, so a replaced callback is never called afterwards
+    callback: Mutex<Option<Callback>>,
+    enabled: AtomicBool,
+}
+
+static DISPATCHER: Lazy<Dispatcher> = Lazy::new(|| Dispatcher {
+    queue: Mutex::new(Queue {
+        events: Box::new([QueuedEvent::EMPTY; QUEUE_CAPACITY]),
+        head: 0,
+        len: 0,
+        dropped: 0,
+        session_active: false,
+    }),
+    wake: Condvar::new(),
+    callback: Mutex::new(None),
+    enabled: AtomicBool::new(false),
+});
+static WORKER: Once = Once::new();
+
+fn push(kind: EventType, message: &str) {
+    let dispatcher = &*DISPATCHER;
+    if !dispatcher.enabled.load(Ordering::Acquire) {
+        return;
+    }
+    let connected = crate::stats_surface::surface().is_connected();
+    {
+        let mut queue = dispatcher.queue.lock().unwrap();
+        if queue.len == QUEUE_CAPACITY {
+            queue.dropped += 1;
+            return;
+        }
+        let index = (queue.head + queue.len) % QUEUE_CAPACITY;
+        let event = &mut queue.events[index];
+        event.kind = kind;
+        event.connected = connected;
+        event.stats = WavryStatsDelta::default();
+        event.set_message(message);
+        queue.len += 1;
+    }
+    dispatcher.wake.notify_one();
+}
+
+pub(crate) fn connection_changed() {
+    push(EventType::Connection, "");
+}
+
+pub(crate) fn error(message: &str) {
+    push(EventType::Error, message);
+}
+
+pub(crate) fn cloud_status(message: &str) {
+    push(EventType::CloudStatus, message);
+}
+
+/// Starts or stops the stats events, the counters restart with a session.
+pub(crate) fn set_session_active(active: bool) {
+    DISPATCHER.queue.lock().unwrap().session_active = active;
+    DISPATCHER.wake.notify_one();
+}
+
+/// Current values of the stats surface, with the counters since the session started.
+fn read_stats() -> WavryStatsDelta {
+    let s = crate::stats_surface::surface();
+    WavryStatsDelta {
+        fps: s.fps.load(Ordering::Relaxed),
+        rtt_ms: s.rtt_ms.load(Ordering::Relaxed),
+        bitrate_kbps: s.bitrate_kbps.load(Ordering::Relaxed),
+        jitter_us: s.jitter_us.load(Ordering::Relaxed),
+        frames_encoded: s.frames_encoded.load(Ordering::Relaxed),
+        frames_decoded: s.frames_decoded.load(Ordering::Relaxed),
+        packets_lost: s.packets_lost.load(Ordering::Relaxed),
+        fec_recovered: s.fec_recovered.load(Ordering::Relaxed),
+    }
+}
+
+fn stats_delta(now: &WavryStatsDelta, before: &WavryStatsDelta) -> WavryStatsDelta {
+    WavryStatsDelta {
+        frames_encoded: now.frames_encoded.saturating_sub(before.frames_encoded),
+        frames_decoded: now.frames_decoded.saturating_sub(before.frames_decoded),
+        packets_lost: now.packets_lost.saturating_sub(before.packets_lost),
+        fec_recovered: now.fec_recovered.saturating_sub(before.fec_recovered),
+        ..*now
+    }
+}
+
+fn run() {
+    let dispatcher = &*DISPATCHER;
+    let mut last_stats = WavryStatsDelta::default();
+    let mut next_stats: Option<Instant> = None;
+    // Delivered from here, outside of the queue lock
+    let mut event = QueuedEvent::EMPTY;
+
+    loop {
+        {
+            let mut queue = dispatcher.queue.lock().unwrap();
+            loop {
+                if queue.dropped > 0 {
+                    log::warn!("FFI: {} events dropped, the app is slow", queue.dropped);
+                    queue.dropped = 0;
+                }
+                if queue.len > 0 {
+                    event = queue.events[queue.head];
+                    queue.head = (queue.head + 1) % QUEUE_CAPACITY;
+                    queue.len -= 1;
+                    break;
+                }
+                if !queue.session_active {
+                    next_stats = None;
+                    last_stats = WavryStatsDelta::default();
+                    queue = dispatcher.wake.wait(queue).unwrap();
+                    continue;
+                }
+
+                let now = Instant::now();
+                let deadline = *next_stats.get_or_insert(now + STATS_INTERVAL);
+                if now < deadline {
+                    queue = dispatcher
+                        .wake
+                        .wait_timeout(queue, deadline - now)
+                        .unwrap()
+                        .0;
+                    continue;
+                }
+                next_stats = Some(now + STATS_INTERVAL);
+                let stats = read_stats();
+                if stats != last_stats {
+                    event.kind = EventType::Stats;
+                    event.connected = crate::stats_surface::surface().is_connected();
+                    event.stats = stats_delta(&stats, &last_stats);
+                    event.message[0] = 0;
+                    last_stats = stats;
+                    break;
+                }
+            }
+        }
+
+        let callback = dispatcher.callback.lock().unwrap();
+        if let Some(callback) = *callback {
+            let raw = WavryEvent {
+                kind: event.kind as u32,
+                connected: event.connected as u32,
+                stats: event.stats,
+                message: event.message.as_ptr() as *const c_char,
+            };
+            unsafe { (callback.func)(&raw, callback.user_data as *mut c_void) };
+        }
+    }
+}
+
+/// Registers `callback`, or unregisters with a null one. Events are delivered one at a time on a
+/// library thread, starting with the current connection state. Returns once an event being
+/// delivered to the previous callback is done, so its `user_data` can be freed afterwards.
+/// The callback must not block and must not call this function.
+#[no_mangle]
+pub unsafe extern "C" fn wavry_set_event_callback(
+    callback: WavryEventCallback,
+    user_data: *mut c_void,
+) {
+    let dispatcher = &*DISPATCHER;
+    {
+        let mut guard = dispatcher.callback.lock().unwrap();
+        *guard = callback.map(|func| Callback {
+            func,
+            user_data: user_data as usize,
+        });
+        dispatcher.enabled.store(guard.is_some(), Ordering::Release);
+    }
+
+    if callback.is_none() {
+        let mut queue = dispatcher.queue.lock().unwrap();
+        queue.len = 0;
+        queue.dropped = 0;
+        return;
+    }
+    WORKER.call_once(|| {
+        if let Err(e) = std::thread::Builder::new()
+            .name("wavry-events".into())
+            .spawn(run)
+        {
+            log::error!("FFI: Failed to start the event thread: {}", e);
+        }
+    });
+    connection_changed();
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::ffi::CStr;
+
+    type Received = Mutex<Vec<(u32, String)>>;
+
+    unsafe extern "C" fn record(event: *const WavryEvent, user_data: *mut c_void) {
+        let event = &*event;
+        let message = CStr::from_ptr(event.message).to_string_lossy().into_owned();
+        (*(user_data as *const Received))
+            .lock()
+            .unwrap()
+            .push((event.kind, message));
+    }
+
+    #[test]
+    fn test_set_message_truncates_on_char_boundary() {
+        let mut event = QueuedEvent::EMPTY;
+        event.set_message("short");
+        assert_eq!(&event.message[..6], b"short\0");
+
+        // 254 ASCII bytes then a 2 byte character, which no longer fits
+        let long = format!("{}é", "a".repeat(EVENT_MESSAGE_MAX - 1));
+        event.set_message(&long);
+        assert_eq!(event.message[EVENT_MESSAGE_MAX - 1], 0);
+        assert!(event.message[..EVENT_MESSAGE_MAX - 1]
+            .iter()
+            .all(|&b| b == b'a'));
+    }
+
+    #[test]
+    fn test_stats_delta_counts_since_last() {
+        let before = WavryStatsDelta {
+            fps: 30,
+            frames_decoded: 100,
+            packets_lost: 5,
+            ..Default::default()
+        };
+        let now = WavryStatsDelta {
+            fps: 60,
+            rtt_ms: 12,
+            frames_decoded: 160,
+            packets_lost: 4,
+            ..Default::default()
+        };
+        let delta = stats_delta(&now, &before);
+        assert_eq!(delta.fps, 60);
+        assert_eq!(delta.rtt_ms, 12);
+        assert_eq!(delta.frames_decoded, 60);
+        // Counters that went back, after a reset, don't wrap
+        assert_eq!(delta.packets_lost, 0);
+    }
+
+    #[test]
+    fn test_events_delivered_in_order() {
+        let received: &'static Received = Box::leak(Box::new(Mutex::new(Vec::new())));
+        let user_data = received as *const Received as *mut c_void;
+        unsafe { wavry_set_event_callback(Some(record), user_data) };
+        error("decoder failed");
+        cloud_status("signaling connected");
+
+        let deadline = Instant::now() + Duration::from_secs(5);
+        while received.lock().unwrap().len() < 3 && Instant::now() < deadline {
+            std::thread::sleep(Duration::from_millis(1));
+        }
+        unsafe { wavry_set_event_callback(None, std::ptr::null_mut()) };
+        error("after unregistering");
+
+        let received = received.lock().unwrap();
+        assert_eq!(
+            *received,
+            vec![
+                (EventType::Connection as u32, String::new()),
+                (EventType::Error as u32, "decoder failed".to_string()),
+                (
+                    EventType::CloudStatus as u32,
+                    "signaling connected".to_string()
+                ),
+            ]
+        );
+    }
+}
@@ -0,0 +1,366 @@
+//! Batched input from the apps.
+//!
+//! The apps collect the mouse, keyboard, gamepad and touch events of a tick and hand them over
+//! in one `wavry_send_input_batch` call. The batch is packed into RIFT input messages on the
+//! calling thread, merging what the host would only apply in sequence anyway, and queued to the
+//! client session next to the events of its own capture threads.
+
+use once_cell::sync::Lazy;
+use rift_core::input_message::Event;
+use rift_core::{
+    GamepadAxis, GamepadButton, GamepadMessage, InputMessage, Key, MouseButton, MouseMove, Scroll,
+};
+use std::sync::{Arc, Mutex};
+use tokio::sync::mpsc::error::TrySendError;
+use wavry_client::InputSink;
+
+/// Values of `WavryInputType` in wavry.h.
+pub const INPUT_MOUSE_MOVE: u32 = 0;
+pub const INPUT_MOUSE_BUTTON: u32 = 1;
+pub const INPUT_KEY: u32 = 2;
+pub const INPUT_SCROLL: u32 = 3;
+pub const INPUT_GAMEPAD_AXIS: u32 = 4;
+pub const INPUT_GAMEPAD_BUTTON: u32 = 5;
+pub const INPUT_TOUCH: u32 = 6;
+
+/// Values of `WavryTouchPhase` in wavry.h.
+pub const TOUCH_DOWN: u32 = 0;
+pub const TOUCH_MOVE: u32 = 1;
+pub const TOUCH_UP: u32 = 2;
+pub const TOUCH_CANCEL: u32 = 3;
+
+/// RIFT has no touch messages, the primary pointer drives the left mouse button.
+const TOUCH_PRIMARY_POINTER: u32 = 0;
+const MOUSE_BUTTON_LEFT: u32 = 1;
+
+/// Layout mirrored by `WavryInputEvent` in wavry.h.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct WavryInputEvent {
+    /// Microseconds since the Unix epoch, 0 stamps the event when the batch is sent
+    pub timestamp_us: u64,
+    pub kind: u32,
+    /// Mouse button, key code, gamepad axis or button, or touch phase
+    pub code: u32,
+    /// Gamepad or touch pointer
+    pub id: u32,
+    pub pressed: u32,
+    /// Position, scroll delta or axis value in `x`
+    pub x: f32,
+    pub y: f32,
+}
+
+static INPUT_SINK: Lazy<InputSink> = Lazy::new(|| Arc::new(Mutex::new(None)));
+
+/// Handed to the client session, which installs its input sender while it runs.
+pub(crate) fn sink() -> InputSink {
+    INPUT_SINK.clone()
+}
+
+pub(crate) fn detach() {
+    *INPUT_SINK.lock().unwrap() = None;
+}
+
+fn to_event(raw: &WavryInputEvent) -> Option<Event> {
+    Some(match raw.kind {
+        INPUT_MOUSE_MOVE => Event::MouseMove(MouseMove { x: raw.x, y: raw.y }),
+        INPUT_MOUSE_BUTTON => Event::MouseButton(MouseButton {
+            button: raw.code,
+            pressed: raw.pressed != 0,
+        }),
+        INPUT_KEY => Event::Key(Key {
+            keycode: raw.code,
+            pressed: raw.pressed != 0,
+        }),
+        INPUT_SCROLL => Event::Scroll(Scroll {
+            dx: raw.x,
+            dy: raw.y,
+        }),
+        INPUT_GAMEPAD_AXIS => Event::Gamepad(GamepadMessage {
+            gamepad_id: raw.id,
+            axes: vec![GamepadAxis {
+                axis: raw.code,
+                value: raw.x,
+            }],
+            buttons: Vec::new(),
+        }),
+        INPUT_GAMEPAD_BUTTON => Event::Gamepad(GamepadMessage {
+            gamepad_id: raw.id,
+            axes: Vec::new(),
+            buttons: vec![GamepadButton {
+                button: raw.code,
+                pressed: raw.pressed != 0,
+            }],
+        }),
+        _ => return None,
+    })
+}
+
+/// Folds `next` into `pending` when the host ends up in the same state applying only the merged
+/// message. Moves keep the last position, scrolls add up and a gamepad collects the axes and
+/// buttons of a tick, unless a button changes twice.
+fn merge(pending: &mut InputMessage, next: &InputMessage) -> bool {
+    let (Some(current), Some(event)) = (pending.event.as_mut(), next.event.as_ref()) else {
+        return false;
+    };
+    match (current, event) {
+        (Event::MouseMove(current), Event::MouseMove(event)) => {
+            *current = event.clone();
+        }
+        (Event::Scroll(current), Event::Scroll(event)) => {
+            current.dx += event.dx;
+            current.dy += event.dy;
+        }
+        (Event::Gamepad(current), Event::Gamepad(event))
+            if current.gamepad_id == event.gamepad_id
+                && event
+                    .buttons
+                    .iter()
+                    .all(|b| current.buttons.iter().all(|c| c.button != b.button)) =>
+        {
+            for axis in &event.axes {
+                match current.axes.iter_mut().find(|a| a.axis == axis.axis) {
+                    Some(existing) => existing.value = axis.value,
+                    None => current.axes.push(axis.clone()),
+                }
+            }
+            current.buttons.extend(event.buttons.iter().cloned());
+        }
+        _ => return false,
+    }
+    pending.timestamp_us = next.timestamp_us;
+    true
+}
+
+/// Calls `emit` with the RIFT messages of `events`, in order.
+fn pack(events: &[WavryInputEvent], now_us: u64, mut emit: impl FnMut(InputMessage) -> bool) {
+    let mut pending: Option<InputMessage> = None;
+    let mut push = |message: InputMessage| -> bool {
+        if let Some(current) = pending.as_mut() {
+            if merge(current, &message) {
+                return true;
+            }
+        }
+        match pending.replace(message) {
+            Some(ready) => emit(ready),
+            None => true,
+        }
+    };
+
+    for raw in events {
+        let timestamp_us = if raw.timestamp_us != 0 {
+            raw.timestamp_us
+        } else {
+            now_us
+        };
+        let message = |event| InputMessage {
+            timestamp_us,
+            event: Some(event),
+        };
+
+        let ok = if raw.kind == INPUT_TOUCH {
+            if raw.id != TOUCH_PRIMARY_POINTER {
+                continue;
+            }
+            let moved = push(message(Event::MouseMove(MouseMove { x: raw.x, y: raw.y })));
+            let button = match raw.code {
+                TOUCH_DOWN => Some(true),
+                TOUCH_UP | TOUCH_CANCEL => Some(false),
+                _ => None,
+            };
+            moved
+                && button.map_or(true, |pressed| {
+                    push(message(Event::MouseButton(MouseButton {
+                        button: MOUSE_BUTTON_LEFT,
+                        pressed,
+                    })))
+                })
+        } else {
+            match to_event(raw) {
+                Some(event) => push(message(event)),
+                None => true,
+            }
+        };
+        if !ok {
+            return;
+        }
+    }
+    if let Some(last) = pending {
+        emit(last);
+    }
+}
+
+/// Queues a batch of input events for the host of the running client session. Returns 0 once all
+/// of them are queued, -1 for invalid arguments, -2 without a client session and -3 when the
+/// queue was full and the rest of the batch was dropped. Meant to be called for every tick, the
+/// failures don't set the last error.
+#[no_mangle]
+pub unsafe extern "C" fn wavry_send_input_batch(events: *const WavryInputEvent, count: u32) -> i32 {
+    if count == 0 {
+        return 0;
+    }
+    if events.is_null() {
+        return -1;
+    }
+    let events = std::slice::from_raw_parts(events, count as usize);
+
+    let guard = INPUT_SINK.lock().unwrap();
+    let Some(tx) = guard.as_ref() else {
+        return -2;
+    };
+    let mut result = 0;
+    pack(events, wavry_client::now_us(), |message| {
+        match tx.try_send(message) {
+            Ok(()) => true,
+            Err(TrySendError::Full(_)) => {
+                result = -3;
+                false
+            }
+            Err(TrySendError::Closed(_)) => {
+                result = -2;
+                false
+            }
+        }
+    });
+    result
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn raw(kind: u32, code: u32, id: u32, pressed: u32, x: f32, y: f32) -> WavryInputEvent {
+        WavryInputEvent {
+            timestamp_us: 0,
+            kind,
+            code,
+            id,
+            pressed,
+            x,
+            y,
+        }
+    }
+
+    fn packed(events: &[WavryInputEvent]) -> Vec<Event> {
+        let mut messages = Vec::new();
+        pack(events, 1_000, |message| {
+            messages.push(message.event.unwrap());
+            true
+        });
+        messages
+    }
+
+    #[test]
+    fn test_moves_collapse_until_a_button() {
+        let messages = packed(&[
+            raw(INPUT_MOUSE_MOVE, 0, 0, 0, 0.1, 0.1),
+            raw(INPUT_MOUSE_MOVE, 0, 0, 0, 0.2, 0.2),
+            raw(INPUT_MOUSE_BUTTON, 1, 0, 1, 0.0, 0.0),
+            raw(INPUT_MOUSE_MOVE, 0, 0, 0, 0.3, 0.3),
+            raw(INPUT_MOUSE_MOVE, 0, 0, 0, 0.4, 0.4),
+        ]);
+        assert_eq!(
+            messages,
+            vec![
+                Event::MouseMove(MouseMove { x: 0.2, y: 0.2 }),
+                Event::MouseButton(MouseButton {
+                    button: 1,
+                    pressed: true,
+                }),
+                Event::MouseMove(MouseMove { x: 0.4, y: 0.4 }),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_scrolls_add_up() {
+        let messages = packed(&[
+            raw(INPUT_SCROLL, 0, 0, 0, 1.0, -2.0),
+            raw(INPUT_SCROLL, 0, 0, 0, 0.5, -1.0),
+        ]);
+        assert_eq!(messages, vec![Event::Scroll(Scroll { dx: 1.5, dy: -3.0 })]);
+    }
+
+    #[test]
+    fn test_gamepad_merge_keeps_repeated_button() {
+        let messages = packed(&[
+            raw(INPUT_GAMEPAD_AXIS, 0, 2, 0, 0.5, 0.0),
+            raw(INPUT_GAMEPAD_BUTTON, 3, 2, 1, 0.0, 0.0),
+            raw(INPUT_GAMEPAD_AXIS, 0, 2, 0, 0.75, 0.0),
+            raw(INPUT_GAMEPAD_BUTTON, 3, 2, 0, 0.0, 0.0),
+        ]);
+        assert_eq!(
+            messages,
+            vec![
+                Event::Gamepad(GamepadMessage {
+                    gamepad_id: 2,
+                    axes: vec![GamepadAxis {
+                        axis: 0,
+                        value: 0.75,
+                    }],
+                    buttons: vec![GamepadButton {
+                        button: 3,
+                        pressed: true,
+                    }],
+                }),
+                Event::Gamepad(GamepadMessage {
+                    gamepad_id: 2,
+                    axes: Vec::new(),
+                    buttons: vec![GamepadButton {
+                        button: 3,
+                        pressed: false,
+                    }],
+                }),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_touch_drives_the_left_button() {
+        let messages = packed(&[
+            raw(INPUT_TOUCH, TOUCH_DOWN, 0, 0, 0.1, 0.2),
+            raw(INPUT_TOUCH, TOUCH_DOWN, 1, 0, 0.9, 0.9),
+            raw(INPUT_TOUCH, TOUCH_MOVE, 0, 0, 0.3, 0.4),
+            raw(INPUT_TOUCH, TOUCH_MOVE, 1, 0, 0.8, 0.8),
+            raw(INPUT_TOUCH, TOUCH_UP, 0, 0, 0.5, 0.6),
+        ]);
+        let left = |pressed| {
+            Event::MouseButton(MouseButton {
+                button: MOUSE_BUTTON_LEFT,
+                pressed,
+            })
+        };
+        assert_eq!(
+            messages,
+            vec![
+                Event::MouseMove(MouseMove { x: 0.1, y: 0.2 }),
+                left(true),
+                Event::MouseMove(MouseMove { x: 0.5, y: 0.6 }),
+                left(false),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_full_queue_returns_minus_three() {
+        let (tx, mut rx) = tokio::sync::mpsc::channel(1);
+        *INPUT_SINK.lock().unwrap() = Some(tx);
+        let events = [
+            raw(INPUT_KEY, 30, 0, 1, 0.0, 0.0),
+            raw(INPUT_KEY, 30, 0, 0, 0.0, 0.0),
+        ];
+        let result = unsafe { wavry_send_input_batch(events.as_ptr(), events.len() as u32) };
+        detach();
+
+        assert_eq!(result, -3);
+        let first = rx.try_recv().unwrap();
+        assert_eq!(
+            first.event,
+            Some(Event::Key(Key {
+                keycode: 30,
+                pressed: true,
+            }))
+        );
+        assert!(rx.try_recv().is_err());
+    }
+}
@@ -44,16 +44,26 @@ use wavry_media::InputEvent;
 use wavry_media::{InputInjector, MacInputInjector};
 
 mod session;
-use session::{
-    run_client, run_host, ClientSessionParams, HostRuntimeConfig, SessionHandle, SessionStats,
-};
+use session::{run_client, run_host, ClientSessionParams, HostRuntimeConfig, SessionHandle};
 
+mod cursor;
+mod events;
 mod identity;
+mod input;
+mod perf;
 mod signaling_ffi;
+mod stats_surface;
+use stats_surface::WavryStatsSurface;
 
 // Global State
-static RUNTIME: Lazy<Runtime> =
-    Lazy::new(|| Runtime::new().expect("Failed to create Tokio runtime"));
+static RUNTIME: Lazy<Runtime> = Lazy::new(|| {
+    tokio::runtime::Builder::new_multi_thread()
+        .enable_all()
+        .on_thread_start(perf::register_thread)
+        .on_thread_stop(perf::unregister_thread)
+        .build()
+        .expect("Failed to create Tokio runtime")
+});
 
 static SESSION: Mutex<Option<SessionHandle>> = Mutex::new(None);
 static LAST_ERROR: Lazy<Mutex<CString>> =
@@ -79,6 +89,9 @@ fn set_last_error(msg: &str) {
         CString::new(sanitized).unwrap_or_else(|_| CString::new("invalid error").expect("cstring"));
     let mut guard = LAST_ERROR.lock().unwrap();
     *guard = cstr;
+    if !msg.is_empty() {
+        events::error(guard.to_str().unwrap_or_default());
+    }
 }
 
 fn clear_last_error() {
@@ -90,7 +103,12 @@ pub(crate) fn set_cloud_status(msg: &str) {
     let cstr = CString::new(sanitized)
         .unwrap_or_else(|_| CString::new("invalid status").expect("cstring"));
     let mut guard = LAST_CLOUD_STATUS.lock().unwrap();
-    *guard = cstr;
+    if *guard != cstr {
+        *guard = cstr;
+        if !msg.is_empty() {
+            events::cloud_status(guard.to_str().unwrap_or_default());
+        }
+    }
 }
 
 pub(crate) fn clear_cloud_status() {
@@ -174,6 +192,21 @@ pub unsafe extern "C" fn wavry_version() -> *const c_char {
     VERSION.as_ptr() as *const c_char
 }
 
+/// Fields after `display_id` are only read when `version` is at least the one that added them,
+/// so a zeroed tail keeps the defaults.
+pub const WAVRY_HOST_CONFIG_VERSION: u32 = 2;
+
+#[repr(C)]
+pub struct WavryFoveation {
+    pub enabled: u32,
+    pub center_size_x: f32,
+    pub center_size_y: f32,
+    pub center_shift_x: f32,
+    pub center_shift_y: f32,
+    pub edge_ratio_x: f32,
+    pub edge_ratio_y: f32,
+}
+
 #[repr(C)]
 pub struct WavryHostConfig {
     pub width: u16,
@@ -182,6 +215,42 @@ pub struct WavryHostConfig {
     pub bitrate_kbps: u32,
     pub keyframe_interval_ms: u32,
     pub display_id: u32,
+    // Version 1
+    pub version: u32,
+    pub codec: u32,
+    pub preset: u32,
+    pub low_latency: u32,
+    pub slices: u32,
+    pub refresh_mode: u32,
+    pub chroma_444: u32,
+    pub ten_bit: u32,
+    pub foveation: WavryFoveation,
+    // Version 2
+    pub content_type: u32,
+    // Version 3
+    pub cursor_mode: u32,
+}
+
+fn normalize_foveation(raw: &WavryFoveation) -> Option<wavry_media::Foveation> {
+    if raw.enabled == 0 {
+        return None;
+    }
+    // Same ranges as the foveated rendering settings of the VR streamer
+    let clamp = |v: f32, min: f32, max: f32, default: f32| {
+        if v.is_finite() {
+            v.clamp(min, max)
+        } else {
+            default
+        }
+    };
+    Some(wavry_media::Foveation {
+        center_size_x: clamp(raw.center_size_x, 0.01, 1.0, 0.45),
+        center_size_y: clamp(raw.center_size_y, 0.01, 1.0, 0.4),
+        center_shift_x: clamp(raw.center_shift_x, -1.0, 1.0, 0.0),
+        center_shift_y: clamp(raw.center_shift_y, -1.0, 1.0, 0.1),
+        edge_ratio_x: clamp(raw.edge_ratio_x, 1.0, 10.0, 4.0),
+        edge_ratio_y: clamp(raw.edge_ratio_y, 1.0, 10.0, 5.0),
+    })
 }
 
 fn normalize_host_config(raw: &WavryHostConfig) -> HostRuntimeConfig {
@@ -196,7 +265,7 @@ fn normalize_host_config(raw: &WavryHostConfig) -> HostRuntimeConfig {
         Some(raw.display_id)
     };
 
-    HostRuntimeConfig {
+    let mut config = HostRuntimeConfig {
         codec: wavry_media::Codec::H264,
         width,
         height,
@@ -204,7 +273,38 @@ fn normalize_host_config(raw: &WavryHostConfig) -> HostRuntimeConfig {
         bitrate_kbps,
         keyframe_interval_ms,
         display_id,
+        ..HostRuntimeConfig::default()
+    };
+    if raw.version < 1 {
+        return config;
     }
+
+    config.codec = match raw.codec {
+        1 => wavry_media::Codec::Hevc,
+        2 => wavry_media::Codec::Av1,
+        _ => wavry_media::Codec::H264,
+    };
+    // 10 bit needs HEVC or AV1
+    config.enable_10bit = raw.ten_bit != 0 && config.codec != wavry_media::Codec::H264;
+    config.tuning = wavry_media::EncoderTuning {
+        preset: match raw.preset {
+            1 => wavry_media::EncoderPreset::Speed,
+            2 => wavry_media::EncoderPreset::Quality,
+            _ => wavry_media::EncoderPreset::Balanced,
+        },
+        low_latency: raw.low_latency != 0,
+        slices: raw.slices.min(32),
+        refresh: if raw.refresh_mode == 1 {
+            wavry_media::RefreshMode::IntraRefresh
+        } else {
+            wavry_media::RefreshMode::Idr
+        },
+        chroma_444: raw.chroma_444 != 0,
+        foveation: normalize_foveation(&raw.foveation),
+        screen_content: raw.version >= 2 && raw.content_type == 1,
+        cursor_metadata: raw.version >= 3 && raw.cursor_mode == 1,
+    };
+    config
 }
 
 fn start_host_internal(port: u16, host_config: HostRuntimeConfig) -> i32 {
@@ -217,13 +317,12 @@ fn start_host_internal(port: u16, host_config: HostRuntimeConfig) -> i32 {
 
     clear_cloud_status();
 
-    let stats = Arc::new(SessionStats::default());
+    stats_surface::surface().reset();
     let (tx, rx) = tokio::sync::oneshot::channel();
     let (init_tx, init_rx) = tokio::sync::oneshot::channel::<anyhow::Result<u16>>();
 
-    let stats_clone = stats.clone();
     RUNTIME.spawn(async move {
-        if let Err(e) = run_host(port, host_config, stats_clone, rx, init_tx).await {
+        if let Err(e) = run_host(port, host_config, rx, init_tx).await {
             log::error!("Host error: {}", e);
         }
     });
@@ -233,8 +332,8 @@ fn start_host_internal(port: u16, host_config: HostRuntimeConfig) -> i32 {
             *guard = Some(SessionHandle {
                 stop_tx: Some(tx),
                 monitor_tx: None, // Host mode doesn't currently use monitor_tx
-                stats,
             });
+            events::set_session_active(true);
             clear_last_error();
             set_cloud_status(&format!("Hosting on UDP {}", bound_port));
             log::info!(
@@ -248,6 +347,12 @@ fn start_host_internal(port: u16, host_config: HostRuntimeConfig) -> i32 {
                 host_config.keyframe_interval_ms,
                 host_config.display_id
             );
+            log::info!(
+                "Host encoder {:?}, 10 bit {}, {:?}",
+                host_config.codec,
+                host_config.enable_10bit,
+                host_config.tuning
+            );
             0
         }
         Ok(Err(e)) => {
@@ -285,6 +390,26 @@ pub unsafe extern "C" fn wavry_start_host_with_config(
     start_host_internal(port, config)
 }
 
+/// `ANativeWindow*` of the input surface of the Android host encoder, for the app to render the
+/// `VirtualDisplay` of its MediaProjection into. The caller owns the returned reference and
+/// releases it with `ANativeWindow_release`. Null when no host runs.
+#[no_mangle]
+pub extern "C" fn wavry_android_host_input_window() -> *mut std::ffi::c_void {
+    #[cfg(target_os = "android")]
+    {
+        let window = wavry_media::AndroidScreenEncoder::input_window();
+        if window.is_null() {
+            set_last_error("Host input window unavailable: no host session");
+        }
+        window
+    }
+    #[cfg(not(target_os = "android"))]
+    {
+        set_last_error("Host input window only supported on Android");
+        std::ptr::null_mut()
+    }
+}
+
 /// Start Client Mode (UDP Stream -> Remote Display)
 fn start_client_internal(
     direct_target: Option<(String, u16)>,
@@ -311,12 +436,11 @@ fn start_client_internal(
         "unknown target".to_string()
     };
 
-    let stats = Arc::new(SessionStats::default());
+    stats_surface::surface().reset();
     let (tx, rx) = tokio::sync::oneshot::channel();
     let (init_tx, init_rx) = tokio::sync::oneshot::channel();
     let (monitor_tx, monitor_rx) = tokio::sync::mpsc::unbounded_channel::<u32>();
 
-    let stats_clone = stats.clone();
     let renderer = VIDEO_RENDERER.clone(); // Shared Reference
 
     RUNTIME.spawn(async move {
@@ -325,7 +449,6 @@ fn start_client_internal(
             relay_info,
             client_name,
             renderer_handle: renderer,
-            stats: stats_clone,
             stop_rx: rx,
             init_tx,
             monitor_rx,
@@ -343,8 +466,8 @@ fn start_client_internal(
             *guard = Some(SessionHandle {
                 stop_tx: Some(tx),
                 monitor_tx: Some(monitor_tx),
-                stats,
             });
+            events::set_session_active(true);
             clear_last_error();
             log::info!("Started Client connecting to {}", target_label);
             0
@@ -393,6 +516,8 @@ pub extern "C" fn wavry_stop() -> i32 {
     let mut guard = SESSION.lock().unwrap();
     if let Some(mut handle) = guard.take() {
         handle.stop();
+        input::detach();
+        events::set_session_active(false);
         clear_last_error();
         clear_cloud_status();
         log::info!("Session stopped");
@@ -423,10 +548,10 @@ pub unsafe extern "C" fn wavry_get_stats(out: *mut WavryStats) -> i32 {
     }
 
     let guard = SESSION.lock().unwrap();
-    if let Some(handle) = guard.as_ref() {
-        let s = &handle.stats;
+    if guard.is_some() {
+        let s = stats_surface::surface();
         let stats = WavryStats {
-            connected: s.connected.load(std::sync::atomic::Ordering::Relaxed),
+            connected: s.is_connected(),
             fps: s.fps.load(std::sync::atomic::Ordering::Relaxed),
             rtt_ms: s.rtt_ms.load(std::sync::atomic::Ordering::Relaxed),
             bitrate_kbps: s.bitrate_kbps.load(std::sync::atomic::Ordering::Relaxed),
@@ -451,6 +576,47 @@ pub unsafe extern "C" fn wavry_get_stats(out: *mut WavryStats) -> i32 {
     }
 }
 
+/// Live stats surface, valid for the lifetime of the process. Counters are reset when a session
+/// starts; read each field atomically and check `version` and `size` first.
+#[no_mangle]
+pub extern "C" fn wavry_stats_surface() -> *const WavryStatsSurface {
+    stats_surface::surface()
+}
+
+#[no_mangle]
+pub extern "C" fn wavry_stats_surface_size() -> u32 {
+    stats_surface::STATS_SURFACE_SIZE as u32
+}
+
+/// Moves the stats surface into a shared mapping of the file at `path_ptr`, for a dashboard in
+/// another process. Call it before starting a session, it can only be done once.
+#[no_mangle]
+pub unsafe extern "C" fn wavry_stats_map_file(path_ptr: *const c_char) -> i32 {
+    if path_ptr.is_null() {
+        set_last_error("Stats mapping failed: null path");
+        return -1;
+    }
+    let path = match CStr::from_ptr(path_ptr).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error("Stats mapping failed: invalid UTF-8 path");
+            return -2;
+        }
+    };
+
+    match stats_surface::map_file(path) {
+        Ok(()) => {
+            clear_last_error();
+            0
+        }
+        Err(e) => {
+            log::error!("Failed to map stats surface: {}", e);
+            set_last_error(&format!("Stats mapping failed: {}", e));
+            -3
+        }
+    }
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn wavry_copy_last_error(
     out_buffer: *mut c_char,
@@ -526,10 +692,18 @@ pub extern "C" fn wavry_init_renderer(layer_ptr: *mut std::ffi::c_void) -> i32 {
             enable_10bit: false,
             enable_hdr: false,
         };
-        match VideoRenderer::new(config, layer_ptr) {
+        let decoder = *DECODER_CONFIG.lock().unwrap();
+        let options = wavry_media::AndroidDecoderOptions {
+            low_latency: decoder.low_latency != 0,
+            vendor_low_latency: decoder.vendor_low_latency != 0,
+            realtime_priority: decoder.realtime_priority != 0,
+            operating_rate: decoder.operating_rate,
+        };
+        match VideoRenderer::with_options(config, layer_ptr, options) {
             Ok(renderer) => {
                 let mut guard = VIDEO_RENDERER.lock().unwrap();
                 *guard = Some(Box::new(renderer));
+                stats_surface::surface().set_decoder(&decoder);
                 log::info!("FFI: Android Renderer initialized successfully");
                 0
             }
@@ -546,6 +720,126 @@ pub extern "C" fn wavry_init_renderer(layer_ptr: *mut std::ffi::c_void) -> i32 {
     }
 }
 
+pub const DECODER_CONFIG_VERSION: u32 = 1;
+
+/// Options of the Android MediaCodec decoder, mirrored in wavry.h. Flags are 0 or 1.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct WavryDecoderConfig {
+    pub version: u32,
+    pub low_latency: u32,
+    pub vendor_low_latency: u32,
+    pub realtime_priority: u32,
+    pub operating_rate: u32,
+}
+
+static DECODER_CONFIG: Mutex<WavryDecoderConfig> = Mutex::new(WavryDecoderConfig {
+    version: DECODER_CONFIG_VERSION,
+    low_latency: 1,
+    vendor_low_latency: 1,
+    realtime_priority: 1,
+    operating_rate: 0,
+});
+
+/// Options for the decoders created by the following `wavry_init_renderer` calls on Android, the
+/// live one keeps its own until the surface is set again. Returns -1 for a null config or an
+/// unknown version.
+#[no_mangle]
+pub unsafe extern "C" fn wavry_android_set_decoder_config(
+    config_ptr: *const WavryDecoderConfig,
+) -> i32 {
+    if config_ptr.is_null() {
+        return -1;
+    }
+    let raw = &*config_ptr;
+    if raw.version == 0 || raw.version > DECODER_CONFIG_VERSION {
+        return -1;
+    }
+    let config = WavryDecoderConfig {
+        version: DECODER_CONFIG_VERSION,
+        low_latency: (raw.low_latency != 0) as u32,
+        vendor_low_latency: (raw.vendor_low_latency != 0) as u32,
+        realtime_priority: (raw.realtime_priority != 0) as u32,
+        operating_rate: raw.operating_rate.min(u16::MAX as u32),
+    };
+    log::info!("FFI: Decoder config {:?}", config);
+    *DECODER_CONFIG.lock().unwrap() = config;
+    0
+}
+
+/// Decoded frame handed to the callback of `wavry_init_frame_callback`, mirrored in wavry.h.
+#[repr(C)]
+pub struct WavryVideoFrame {
+    pub pixel_buffer: *mut std::ffi::c_void,
+    pub pts_us: u64,
+    pub decoded_host_us: u64,
+    pub width: u32,
+    pub height: u32,
+}
+
+pub type WavryFrameCallback =
+    Option<unsafe extern "C" fn(*const WavryVideoFrame, *mut std::ffi::c_void)>;
+
+/// Replaces the renderer with one that hands every decoded frame to `callback` instead of a
+/// layer, so the app presents them from its display link. Released with `wavry_release_renderer`.
+#[no_mangle]
+pub extern "C" fn wavry_init_frame_callback(
+    callback: WavryFrameCallback,
+    user_data: *mut std::ffi::c_void,
+) -> i32 {
+    #![allow(unused_variables)]
+    let Some(callback) = callback else {
+        set_last_error("Frame callback init failed: null callback");
+        return -2;
+    };
+    #[cfg(target_os = "macos")]
+    {
+        // Kept as an address so the sink is Send, the app owns what it points to
+        let user_data = user_data as usize;
+        let renderer = VideoRenderer::with_frame_sink(Box::new(move |frame| {
+            let raw = WavryVideoFrame {
+                pixel_buffer: frame.pixel_buffer,
+                pts_us: frame.pts_us,
+                decoded_host_us: frame.decoded_host_us,
+                width: frame.width,
+                height: frame.height,
+            };
+            unsafe { callback(&raw, user_data as *mut std::ffi::c_void) };
+        }));
+        let mut guard = VIDEO_RENDERER.lock().unwrap();
+        *guard = Some(Box::new(renderer));
+        log::info!("FFI: Frame callback renderer initialized");
+        0
+    }
+    #[cfg(not(target_os = "macos"))]
+    {
+        set_last_error("Frame callback init failed: only supported on macOS");
+        -1
+    }
+}
+
+/// Records the decoder to display latency of a frame from `wavry_init_frame_callback`, with its
+/// `decoded_host_us` and the host time it reached the display.
+#[no_mangle]
+pub extern "C" fn wavry_report_frame_presented(decoded_host_us: u64, presented_host_us: u64) {
+    if presented_host_us >= decoded_host_us {
+        stats_surface::surface()
+            .present_us
+            .record(presented_host_us - decoded_host_us);
+    }
+}
+
+/// Drops the renderer along with its window, for when the app's surface goes away. Frames are
+/// discarded until `wavry_init_renderer` is called again.
+#[no_mangle]
+pub extern "C" fn wavry_release_renderer() -> i32 {
+    let mut guard = VIDEO_RENDERER.lock().unwrap();
+    if guard.take().is_some() {
+        log::info!("FFI: Renderer released");
+    }
+    0
+}
+
 #[no_mangle]
 pub extern "C" fn wavry_init_injector(width: u32, height: u32) -> i32 {
     #![allow(unused_variables)]
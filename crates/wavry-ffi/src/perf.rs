@@ -0,0 +1,390 @@
+//! Performance hints and core placement for the Android client.
+//!
+//! With the default scheduling the decode path runs on whatever core the scheduler picks, at the
+//! clocks the governor guesses, and frames drop when that is a little core or a throttled one.
+//! In the low latency mode the runtime threads are kept on the big cores, and the time the
+//! renderer spends on each frame is reported to an ADPF hint session against the frame interval,
+//! so the governor raises the clocks before frames run late rather than after.
+
+use std::time::Duration;
+
+/// Values of `WavryPerfMode` in wavry.h.
+pub const PERF_MODE_DEFAULT: u32 = 0;
+pub const PERF_MODE_LOW_LATENCY: u32 = 1;
+
+/// The platform independent part of the low latency mode.
+#[cfg(any(target_os = "android", test))]
+mod policy {
+    /// Work target until the frame interval is known.
+    const DEFAULT_TARGET_NS: i64 = 16_666_667;
+    /// Range of the measured frame interval, gaps outside of it are stalls or bursts.
+    const MIN_TARGET_NS: i64 = 4_000_000;
+    const MAX_TARGET_NS: i64 = 50_000_000;
+    /// The target follows the frame interval once it moved by more than this.
+    const TARGET_SLACK_NS: i64 = 500_000;
+
+    /// Work target of the hint session, which follows the interval frames arrive at.
+    #[derive(Debug, Clone, Copy, PartialEq, Eq)]
+    pub struct HintTarget {
+        pub target_ns: i64,
+        interval_ns: i64,
+    }
+
+    impl HintTarget {
+        pub const fn new() -> Self {
+            Self {
+                target_ns: DEFAULT_TARGET_NS,
+                interval_ns: DEFAULT_TARGET_NS,
+            }
+        }
+
+        /// Takes the gap since the previous frame, smoothed over a few frames, and returns the
+        /// target to report against.
+        pub fn on_frame(&mut self, gap_ns: Option<i64>) -> i64 {
+            if let Some(gap) = gap_ns {
+                if (MIN_TARGET_NS..=MAX_TARGET_NS).contains(&gap) {
+                    self.interval_ns += (gap - self.interval_ns) / 8;
+                }
+            }
+            if (self.interval_ns - self.target_ns).abs() > TARGET_SLACK_NS {
+                self.target_ns = self.interval_ns;
+            }
+            self.target_ns
+        }
+    }
+
+    /// CPUs of the highest max frequency, together with the next cluster when the top one is a
+    /// single prime core. None for uniform cores, with nothing to prefer.
+    pub fn big_cores(freqs: &[(usize, u64)]) -> Option<Vec<usize>> {
+        let mut tiers: Vec<u64> = freqs.iter().map(|&(_, f)| f).collect();
+        tiers.sort_unstable_by(|a, b| b.cmp(a));
+        tiers.dedup();
+        if tiers.len() < 2 {
+            return None;
+        }
+        let top = freqs.iter().filter(|&&(_, f)| f == tiers[0]).count();
+        let min_freq = if top == 1 { tiers[1] } else { tiers[0] };
+        Some(
+            freqs
+                .iter()
+                .filter(|&&(_, f)| f >= min_freq)
+                .map(|&(cpu, _)| cpu)
+                .collect(),
+        )
+    }
+}
+
+#[cfg(target_os = "android")]
+mod imp {
+    use super::policy::{big_cores, HintTarget};
+    use super::*;
+    use std::ffi::c_void;
+    use std::sync::Mutex;
+    use std::time::Instant;
+
+    /// Threads in one hint session at most, further renderer threads aren't reported.
+    const MAX_HINT_THREADS: usize = 8;
+
+    type GetManagerFn = unsafe extern "C" fn() -> *mut c_void;
+    type CreateSessionFn = unsafe extern "C" fn(*mut c_void, *const i32, usize, i64) -> *mut c_void;
+    type DurationFn = unsafe extern "C" fn(*mut c_void, i64) -> i32;
+    type CloseSessionFn = unsafe extern "C" fn(*mut c_void);
+
+    /// APerformanceHint of libandroid, looked up at runtime as it needs API 33.
+    struct Adpf {
+        manager: *mut c_void,
+        create_session: CreateSessionFn,
+        update_target: DurationFn,
+        report_actual: DurationFn,
+        close_session: CloseSessionFn,
+    }
+
+    impl Adpf {
+        fn load() -> Option<Self> {
+            unsafe {
+                let lib = libc::dlopen(
+                    b"libandroid.so\0".as_ptr() as *const libc::c_char,
+                    libc::RTLD_NOW,
+                );
+                if lib.is_null() {
+                    return None;
+                }
+                let sym = |name: &[u8]| {
+                    let ptr = libc::dlsym(lib, name.as_ptr() as *const libc::c_char);
+                    (!ptr.is_null()).then_some(ptr)
+                };
+                let get_manager: GetManagerFn =
+                    std::mem::transmute(sym(b"APerformanceHint_getManager\0")?);
+                let adpf = Self {
+                    manager: get_manager(),
+                    create_session: std::mem::transmute::<*mut c_void, CreateSessionFn>(sym(
+                        b"APerformanceHint_createSession\0",
+                    )?),
+                    update_target: std::mem::transmute::<*mut c_void, DurationFn>(sym(
+                        b"APerformanceHint_updateTargetWorkDuration\0",
+                    )?),
+                    report_actual: std::mem::transmute::<*mut c_void, DurationFn>(sym(
+                        b"APerformanceHint_reportActualWorkDuration\0",
+                    )?),
+                    close_session: std::mem::transmute::<*mut c_void, CloseSessionFn>(sym(
+                        b"APerformanceHint_closeSession\0",
+                    )?),
+                };
+                // libandroid stays loaded for the process, so the symbols stay valid
+                (!adpf.manager.is_null()).then_some(adpf)
+            }
+        }
+    }
+
+    struct State {
+        mode: u32,
+        adpf: Option<Adpf>,
+        adpf_loaded: bool,
+        session: *mut c_void,
+        session_tids: Vec<i32>,
+        hint: HintTarget,
+        last_frame: Option<Instant>,
+        runtime_tids: Vec<i32>,
+        big_cores: Option<libc::cpu_set_t>,
+    }
+
+    // The raw pointers are only used under the mutex
+    unsafe impl Send for State {}
+
+    static STATE: Mutex<State> = Mutex::new(State {
+        mode: PERF_MODE_DEFAULT,
+        adpf: None,
+        adpf_loaded: false,
+        session: std::ptr::null_mut(),
+        session_tids: Vec::new(),
+        hint: HintTarget::new(),
+        last_frame: None,
+        runtime_tids: Vec::new(),
+        big_cores: None,
+    });
+
+    fn find_big_cores() -> Option<libc::cpu_set_t> {
+        let mut freqs = Vec::new();
+        for cpu in 0..libc::CPU_SETSIZE as usize {
+            let path = format!("/sys/devices/system/cpu/cpu{cpu}/cpufreq/cpuinfo_max_freq");
+            match std::fs::read_to_string(path) {
+                Ok(freq) => {
+                    if let Ok(freq) = freq.trim().parse::<u64>() {
+                        freqs.push((cpu, freq));
+                    }
+                }
+                Err(_) if cpu > 0 && freqs.is_empty() => return None,
+                Err(_) => break,
+            }
+        }
+        let mut set: libc::cpu_set_t = unsafe { std::mem::zeroed() };
+        for cpu in big_cores(&freqs)? {
+            unsafe { libc::CPU_SET(cpu, &mut set) };
+        }
+        Some(set)
+    }
+
+    fn apply_affinity(state: &State, tid: i32) {
+        let result = match (state.mode, state.big_cores.as_ref()) {
+            (PERF_MODE_LOW_LATENCY, Some(set)) => unsafe {
+                libc::sched_setaffinity(tid, std::mem::size_of::<libc::cpu_set_t>(), set)
+            },
+            _ => {
+                // Back to every core
+                let mut all: libc::cpu_set_t = unsafe { std::mem::zeroed() };
+                for cpu in 0..libc::CPU_SETSIZE as usize {
+                    unsafe { libc::CPU_SET(cpu, &mut all) };
+                }
+                unsafe {
+                    libc::sched_setaffinity(tid, std::mem::size_of::<libc::cpu_set_t>(), &all)
+                }
+            }
+        };
+        if result != 0 {
+            log::debug!("FFI: sched_setaffinity failed for thread {}", tid);
+        }
+    }
+
+    fn close_session(state: &mut State) {
+        if let Some(adpf) = state.adpf.as_ref() {
+            if !state.session.is_null() {
+                unsafe { (adpf.close_session)(state.session) };
+            }
+        }
+        state.session = std::ptr::null_mut();
+    }
+
+    pub fn set_mode(mode: u32) {
+        let mut state = STATE.lock().unwrap();
+        state.mode = mode;
+        if mode == PERF_MODE_LOW_LATENCY {
+            if !state.adpf_loaded {
+                state.adpf_loaded = true;
+                state.adpf = Adpf::load();
+                if state.adpf.is_none() {
+                    log::info!("FFI: ADPF unavailable, only placing threads on the big cores");
+                }
+            }
+            if state.big_cores.is_none() {
+                state.big_cores = find_big_cores();
+            }
+        } else {
+            close_session(&mut state);
+            state.session_tids.clear();
+            state.last_frame = None;
+        }
+        for i in 0..state.runtime_tids.len() {
+            apply_affinity(&state, state.runtime_tids[i]);
+        }
+    }
+
+    pub fn register_thread() {
+        let tid = unsafe { libc::gettid() };
+        let mut state = STATE.lock().unwrap();
+        state.runtime_tids.push(tid);
+        if state.mode != PERF_MODE_DEFAULT {
+            apply_affinity(&state, tid);
+        }
+    }
+
+    pub fn unregister_thread() {
+        let tid = unsafe { libc::gettid() };
+        STATE.lock().unwrap().runtime_tids.retain(|&t| t != tid);
+    }
+
+    pub fn report_frame_work(work: Duration) {
+        let mut guard = STATE.lock().unwrap();
+        let state = &mut *guard;
+        if state.mode != PERF_MODE_LOW_LATENCY {
+            return;
+        }
+        let Some(adpf) = state.adpf.as_ref() else {
+            return;
+        };
+        let create_session = adpf.create_session;
+        let manager = adpf.manager;
+
+        let now = Instant::now();
+        let gap_ns = state
+            .last_frame
+            .replace(now)
+            .map(|last| now.duration_since(last).as_nanos() as i64);
+        let session_target_ns = state.hint.target_ns;
+        let target_ns = state.hint.on_frame(gap_ns);
+        let tid = unsafe { libc::gettid() };
+        if !state.session_tids.contains(&tid) && state.session_tids.len() < MAX_HINT_THREADS {
+            // A session can't add threads before API 34, it is created again with all of them
+            state.session_tids.push(tid);
+            close_session(state);
+        }
+        if state.session.is_null() {
+            state.session = unsafe {
+                create_session(
+                    manager,
+                    state.session_tids.as_ptr(),
+                    state.session_tids.len(),
+                    target_ns,
+                )
+            };
+            if state.session.is_null() {
+                return;
+            }
+        } else if session_target_ns != target_ns {
+            let adpf = state.adpf.as_ref().unwrap();
+            unsafe { (adpf.update_target)(state.session, target_ns) };
+        }
+
+        let adpf = state.adpf.as_ref().unwrap();
+        let work_ns = (work.as_nanos() as i64).max(1);
+        unsafe { (adpf.report_actual)(state.session, work_ns) };
+    }
+}
+
+#[cfg(not(target_os = "android"))]
+mod imp {
+    use super::*;
+
+    pub fn set_mode(_mode: u32) {}
+    pub fn register_thread() {}
+    pub fn unregister_thread() {}
+    pub fn report_frame_work(_work: Duration) {}
+}
+
+pub(crate) use imp::{register_thread, report_frame_work, unregister_thread};
+
+/// Chooses how the Android client schedules its threads, the default mode leaves it to the
+/// system. Returns 0, or -1 for an unknown mode. A no-op on other platforms.
+#[no_mangle]
+pub extern "C" fn wavry_android_set_perf_mode(mode: u32) -> i32 {
+    if mode != PERF_MODE_DEFAULT && mode != PERF_MODE_LOW_LATENCY {
+        return -1;
+    }
+    imp::set_mode(mode);
+    log::info!("FFI: Performance mode {}", mode);
+    0
+}
+
+#[cfg(test)]
+mod tests {
+    use super::policy::*;
+
+    #[test]
+    fn test_hint_target_follows_frame_interval() {
+        let mut hint = HintTarget::new();
+        assert_eq!(hint.on_frame(None), 16_666_667);
+
+        // 60 Hz jitter stays within the slack
+        for gap in [16_000_000, 17_200_000, 16_500_000] {
+            assert_eq!(hint.on_frame(Some(gap)), 16_666_667);
+        }
+
+        // A 90 Hz stream moves the target once the interval settled past the slack
+        let mut target = 0;
+        for _ in 0..64 {
+            target = hint.on_frame(Some(11_111_111));
+        }
+        assert!((target - 11_111_111).abs() <= 500_000);
+        assert!(target < 16_666_667);
+    }
+
+    #[test]
+    fn test_hint_target_ignores_stalls_and_bursts() {
+        let mut hint = HintTarget::new();
+        for gap in [200_000_000, 1_000_000, 0, -5] {
+            assert_eq!(hint.on_frame(Some(gap)), 16_666_667);
+        }
+        assert_eq!(hint, HintTarget::new());
+    }
+
+    #[test]
+    fn test_big_cores() {
+        // Uniform cores
+        assert_eq!(big_cores(&[(0, 1_800_000), (1, 1_800_000)]), None);
+        assert_eq!(big_cores(&[]), None);
+        // 4 little and 4 big cores
+        assert_eq!(
+            big_cores(&[
+                (0, 1_800_000),
+                (1, 1_800_000),
+                (2, 1_800_000),
+                (3, 1_800_000),
+                (4, 2_400_000),
+                (5, 2_400_000),
+                (6, 2_400_000),
+                (7, 2_400_000),
+            ]),
+            Some(vec![4, 5, 6, 7])
+        );
+        // A single prime core brings the big cluster along
+        assert_eq!(
+            big_cores(&[
+                (0, 1_800_000),
+                (1, 1_800_000),
+                (2, 2_400_000),
+                (3, 2_400_000),
+                (4, 3_000_000),
+            ]),
+            Some(vec![2, 3, 4])
+        );
+    }
+}
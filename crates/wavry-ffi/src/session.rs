@@ -18,22 +18,27 @@ use tokio::sync::{mpsc, oneshot};
 use tokio::time;
 
 // Imports
-use wavry_media::{Codec, EncodeConfig, EncodedFrame, Renderer, Resolution};
+use wavry_media::{Codec, EncodeConfig, EncodedFrame, EncoderTuning, Renderer, Resolution};
 
 #[cfg(target_os = "macos")]
-use wavry_media::{MacAudioCapturer, MacScreenEncoder, MacVideoRenderer as PlatformVideoRenderer};
+use wavry_media::{
+    MacAudioCapturer, MacCursorSampler as CursorSampler, MacScreenEncoder,
+    MacVideoRenderer as PlatformVideoRenderer,
+};
 
 #[cfg(target_os = "android")]
-use wavry_media::AndroidVideoRenderer as PlatformVideoRenderer;
+use wavry_media::{AndroidScreenEncoder, AndroidVideoRenderer as PlatformVideoRenderer};
 
-#[cfg(target_os = "macos")]
+use crate::stats_surface::{surface, DropReason};
+#[cfg(any(target_os = "macos", target_os = "android"))]
 use rift_core::cc::{DeltaCC, DeltaConfig};
 #[allow(unused_imports)]
 use rift_core::{
-    chunk_video_payload, decode_msg, encode_msg, Codec as RiftCodec,
-    CongestionControl as ProtoCongestion, ControlMessage as ProtoControl, Handshake,
-    Hello as ProtoHello, HelloAck as ProtoHelloAck, Message as ProtoMessage, PhysicalPacket,
-    Pong as ProtoPong, Resolution as ProtoResolution, Role, RIFT_MAGIC, RIFT_VERSION,
+    chunk_cursor_shape, chunk_video_payload, cursor_shape_id, decode_msg, encode_msg,
+    Codec as RiftCodec, CongestionControl as ProtoCongestion, ControlMessage as ProtoControl,
+    CursorImage, CursorPosition, Handshake, Hello as ProtoHello, HelloAck as ProtoHelloAck,
+    Message as ProtoMessage, PhysicalPacket, Pong as ProtoPong, Resolution as ProtoResolution,
+    Role, RIFT_MAGIC, RIFT_VERSION,
 };
 use rift_crypto::connection::SecureServer;
 use wavry_client::{
@@ -49,6 +54,10 @@ const NACK_HISTORY: usize = 512;
 const PACER_MIN_US: u64 = 20;
 const PACER_MAX_US: u64 = 500;
 const PACER_BASE_US: f64 = 30.0;
+/// Cursor shapes the host keeps to answer shape requests, as many as the client caches.
+const CURSOR_SHAPE_CACHE: usize = wavry_client::media::MAX_CURSOR_SHAPES;
+/// An unchanged cursor position is resent this often, in case the last one was lost.
+const CURSOR_REFRESH: Duration = Duration::from_millis(500);
 
 #[derive(Debug)]
 struct SendHistory {
@@ -201,6 +210,9 @@ struct PeerState {
     frame_id: u64,
     send_history: SendHistory,
     pacer: Pacer,
+    cursor_shapes_sent: VecDeque<u64>,
+    cursor_last: Option<CursorPosition>,
+    cursor_sent_at: Instant,
 }
 
 impl PeerState {
@@ -216,25 +228,16 @@ impl PeerState {
             frame_id: 0,
             send_history: SendHistory::new(NACK_HISTORY),
             pacer: Pacer::new(),
+            cursor_shapes_sent: VecDeque::new(),
+            cursor_last: None,
+            cursor_sent_at: Instant::now(),
         })
     }
 }
 
-// Stats shared with FFI
-#[derive(Debug, Default)]
-pub struct SessionStats {
-    pub connected: AtomicBool,
-    pub fps: AtomicU32,
-    pub rtt_ms: AtomicU32,
-    pub bitrate_kbps: AtomicU32,
-    pub frames_encoded: AtomicU64,
-    pub frames_decoded: AtomicU64,
-}
-
 pub struct SessionHandle {
     pub stop_tx: Option<oneshot::Sender<()>>,
     pub monitor_tx: Option<mpsc::UnboundedSender<u32>>,
-    pub stats: Arc<SessionStats>,
 }
 
 impl SessionHandle {
@@ -254,6 +257,8 @@ pub struct HostRuntimeConfig {
     pub bitrate_kbps: u32,
     pub keyframe_interval_ms: u32,
     pub display_id: Option<u32>,
+    pub enable_10bit: bool,
+    pub tuning: EncoderTuning,
 }
 
 impl Default for HostRuntimeConfig {
@@ -266,6 +271,8 @@ impl Default for HostRuntimeConfig {
             bitrate_kbps: 8000,
             keyframe_interval_ms: 2000,
             display_id: None,
+            enable_10bit: false,
+            tuning: EncoderTuning::default(),
         }
     }
 }
@@ -352,6 +359,153 @@ async fn send_video_frame(
     Ok(())
 }
 
+/// Cursor sent as metadata (`EncoderTuning::cursor_metadata`). The capture leaves the cursor
+/// out, so moving it over a static desktop neither produces nor encodes frames; its position
+/// goes out when it changes and each shape once per peer, from a cache that also answers the
+/// shape requests of the client.
+#[cfg(any(target_os = "macos", target_os = "android"))]
+struct HostCursor {
+    sampler: CursorSampler,
+    shapes: VecDeque<CursorImage>,
+    shape_id: Option<u64>,
+}
+
+#[cfg(any(target_os = "macos", target_os = "android"))]
+impl HostCursor {
+    fn new(sampler: CursorSampler) -> Self {
+        Self {
+            sampler,
+            shapes: VecDeque::new(),
+            shape_id: None,
+        }
+    }
+
+    fn sample(&mut self) -> Option<CursorPosition> {
+        if let Some(bitmap) = self.sampler.shape_changed() {
+            let shape_id = cursor_shape_id(
+                bitmap.width,
+                bitmap.height,
+                bitmap.hotspot_x,
+                bitmap.hotspot_y,
+                &bitmap.rgba,
+            );
+            if self.shape(shape_id).is_none() {
+                if self.shapes.len() == CURSOR_SHAPE_CACHE {
+                    self.shapes.pop_front();
+                }
+                self.shapes.push_back(CursorImage {
+                    shape_id,
+                    width: bitmap.width,
+                    height: bitmap.height,
+                    hotspot_x: bitmap.hotspot_x,
+                    hotspot_y: bitmap.hotspot_y,
+                    rgba: bitmap.rgba.clone(),
+                });
+            }
+            self.shape_id = Some(shape_id);
+        }
+
+        let sample = self.sampler.position();
+        Some(CursorPosition {
+            timestamp_us: wavry_client::now_us(),
+            visible: sample.visible,
+            x: sample.x,
+            y: sample.y,
+            shape_id: self.shape_id?,
+        })
+    }
+
+    fn shape(&self, shape_id: u64) -> Option<&CursorImage> {
+        self.shapes.iter().find(|shape| shape.shape_id == shape_id)
+    }
+}
+
+/// A MediaProjection has no cursor to leave out of the video
+#[cfg(target_os = "android")]
+struct CursorSampler;
+#[cfg(target_os = "android")]
+impl CursorSampler {
+    fn position(&self) -> wavry_media::CursorSample {
+        wavry_media::CursorSample {
+            visible: false,
+            x: 0.0,
+            y: 0.0,
+        }
+    }
+
+    fn shape_changed(&mut self) -> Option<&wavry_media::CursorBitmap> {
+        None
+    }
+}
+
+#[cfg(any(target_os = "macos", target_os = "android"))]
+async fn send_cursor_shape(
+    socket: &UdpSocket,
+    peer_state: &mut PeerState,
+    peer: SocketAddr,
+    shape: &CursorImage,
+    bitrate_kbps: u32,
+) -> Result<()> {
+    for chunk in chunk_cursor_shape(shape) {
+        let packet_bytes = chunk.rgba.len() + 64;
+        let msg = ProtoMessage {
+            content: Some(rift_core::message::Content::Control(ProtoControl {
+                content: Some(rift_core::control_message::Content::CursorShape(chunk)),
+            })),
+        };
+        peer_state
+            .pacer
+            .note_packet_bytes(packet_bytes, bitrate_kbps);
+        peer_state.pacer.wait().await;
+        send_rift_msg(socket, peer_state, peer, msg).await?;
+    }
+    Ok(())
+}
+
+#[cfg(any(target_os = "macos", target_os = "android"))]
+async fn send_cursor(
+    socket: &UdpSocket,
+    peer_state: &mut PeerState,
+    peer: SocketAddr,
+    cursor: &mut HostCursor,
+    bitrate_kbps: u32,
+) -> Result<()> {
+    let Some(position) = cursor.sample() else {
+        return Ok(());
+    };
+
+    if !peer_state.cursor_shapes_sent.contains(&position.shape_id) {
+        if let Some(shape) = cursor.shape(position.shape_id) {
+            send_cursor_shape(socket, peer_state, peer, shape, bitrate_kbps).await?;
+        }
+        if peer_state.cursor_shapes_sent.len() == CURSOR_SHAPE_CACHE {
+            peer_state.cursor_shapes_sent.pop_front();
+        }
+        peer_state.cursor_shapes_sent.push_back(position.shape_id);
+    }
+
+    let unchanged = peer_state.cursor_last.as_ref().is_some_and(|last| {
+        last.visible == position.visible
+            && last.x == position.x
+            && last.y == position.y
+            && last.shape_id == position.shape_id
+    });
+    if unchanged && peer_state.cursor_sent_at.elapsed() < CURSOR_REFRESH {
+        return Ok(());
+    }
+    let msg = ProtoMessage {
+        content: Some(rift_core::message::Content::Control(ProtoControl {
+            content: Some(rift_core::control_message::Content::CursorPosition(
+                position.clone(),
+            )),
+        })),
+    };
+    send_rift_msg(socket, peer_state, peer, msg).await?;
+    peer_state.cursor_last = Some(position);
+    peer_state.cursor_sent_at = Instant::now();
+    Ok(())
+}
+
 async fn send_audio_packet(
     socket: &UdpSocket,
     peer_state: &mut PeerState,
@@ -377,11 +531,12 @@ async fn send_audio_packet(
 pub async fn run_host(
     port: u16,
     host_config: HostRuntimeConfig,
-    stats: Arc<SessionStats>,
     #[allow(unused_mut)] mut stop_rx: oneshot::Receiver<()>,
     init_tx: oneshot::Sender<Result<u16>>,
 ) -> Result<()> {
     #![allow(unused_variables)]
+    let stats = surface();
+
     // 1. Setup UDP
     let addr = format!("0.0.0.0:{}", port);
 
@@ -420,14 +575,20 @@ pub async fn run_host(
         bitrate_kbps: host_config.bitrate_kbps,
         keyframe_interval_ms: host_config.keyframe_interval_ms,
         display_id: host_config.display_id,
-        enable_10bit: false,
+        enable_10bit: host_config.enable_10bit,
         enable_hdr: false,
+        tuning: host_config.tuning,
     };
 
-    #[cfg(target_os = "macos")]
+    #[cfg(any(target_os = "macos", target_os = "android"))]
     {
-        // 2. Setup Encoder (Mac Only)
-        let mut encoder = match MacScreenEncoder::new(config).await {
+        // 2. Setup Encoder. On Android the app renders its MediaProjection into the input surface
+        // of the encoder, see wavry_android_host_input_window.
+        #[cfg(target_os = "macos")]
+        let encoder = MacScreenEncoder::new(config).await;
+        #[cfg(target_os = "android")]
+        let encoder = AndroidScreenEncoder::new(config).await;
+        let mut encoder = match encoder {
             Ok(enc) => enc,
             Err(e) => {
                 let _ = init_tx.send(Err(anyhow!("Failed to create encoder: {}", e)));
@@ -436,6 +597,7 @@ pub async fn run_host(
         };
 
         // 2b. Setup Audio (Mac Only)
+        #[cfg(target_os = "macos")]
         let mut audio_capturer = match MacAudioCapturer::new().await {
             Ok(ac) => Some(ac),
             Err(e) => {
@@ -443,6 +605,19 @@ pub async fn run_host(
                 None
             }
         };
+        #[cfg(target_os = "android")]
+        let mut audio_capturer: Option<NoAudioCapturer> = None;
+
+        // 2c. Cursor as metadata, sampled at the frame rate
+        #[cfg(target_os = "macos")]
+        let mut host_cursor = config
+            .tuning
+            .cursor_metadata
+            .then(|| HostCursor::new(CursorSampler::new(config.display_id)));
+        #[cfg(target_os = "android")]
+        let mut host_cursor: Option<HostCursor> = None;
+        let mut cursor_tick = time::interval(Duration::from_secs(1) / config.fps.max(1) as u32);
+        cursor_tick.set_missed_tick_behavior(time::MissedTickBehavior::Skip);
 
         // Signal Init Success
         let _ = init_tx.send(Ok(bound_port));
@@ -474,13 +649,13 @@ pub async fn run_host(
                 log::warn!("Client timed out");
                 client_addr = None;
                 peer_state = None;
-                stats.connected.store(false, Ordering::Relaxed);
+                stats.set_connected(false);
             }
 
             tokio::select! {
                 _ = &mut stop_rx => {
                     log::info!("Host session stopped");
-                    stats.connected.store(false, Ordering::Relaxed);
+                    stats.set_connected(false);
                     crate::signaling_ffi::clear_hosting();
                     break;
                 }
@@ -611,7 +786,7 @@ pub async fn run_host(
                                         if let Err(e) = state.handshake.on_send_hello_ack(&ack) {
                                             log::warn!("handshake ack error: {}", e);
                                         }
-                                        stats.connected.store(true, Ordering::Relaxed);
+                                        stats.set_connected(true);
                                     }
 
                                     let ack_msg = ProtoMessage {
@@ -640,6 +815,10 @@ pub async fn run_host(
                                     cc.on_rtt_sample(report.rtt_us, loss_ratio, report.jitter_us);
                                     state.pacer.on_stats(report.rtt_us, report.jitter_us, last_target_bitrate);
                                     stats.rtt_ms.store((report.rtt_us / 1000) as u32, Ordering::Relaxed);
+                                    stats.jitter_us.store(report.jitter_us, Ordering::Relaxed);
+                                    stats.packets_received.fetch_add(report.received_packets as u64, Ordering::Relaxed);
+                                    stats.packets_lost.fetch_add(report.lost_packets as u64, Ordering::Relaxed);
+                                    stats.network_us.record(report.rtt_us / 2);
 
                                     let new_bitrate = cc.target_bitrate_kbps();
                                     if new_bitrate != last_target_bitrate {
@@ -666,6 +845,11 @@ pub async fn run_host(
                                         }
                                     }
                                 }
+                                Some(rift_core::control_message::Content::CursorShapeRequest(request)) => {
+                                    if let Some(shape) = host_cursor.as_ref().and_then(|c| c.shape(request.shape_id)) {
+                                        send_cursor_shape(socket.as_ref(), state, src, shape, last_target_bitrate).await?;
+                                    }
+                                }
                                 _ => {}
                             }
                         }
@@ -681,6 +865,7 @@ pub async fn run_host(
                 res = encoder.next_frame_async() => {
                     match res {
                         Ok(frame) => {
+                            stats.encode_us.record(frame.encode_duration_us as u64);
                             if let (Some(addr), Some(state)) = (client_addr, peer_state.as_mut()) {
                                 let ready = state.crypto.is_established() &&
                                     matches!(state.handshake.state(), rift_core::HandshakeState::Established { .. });
@@ -688,6 +873,7 @@ pub async fn run_host(
                                     let frame_bytes = frame.data.len();
                                     if let Err(e) = send_video_frame(socket.as_ref(), state, addr, frame, last_target_bitrate).await {
                                         log::warn!("send frame error: {}", e);
+                                        stats.record_drop(DropReason::SendFailed);
                                     }
 
                                     stats.frames_encoded.fetch_add(1, Ordering::Relaxed);
@@ -700,6 +886,8 @@ pub async fn run_host(
                                         bytes_sent = 0;
                                         last_fps_time = std::time::Instant::now();
                                     }
+                                } else {
+                                    stats.record_drop(DropReason::NotReady);
                                 }
                             }
                         }
@@ -710,6 +898,19 @@ pub async fn run_host(
                     }
                 }
 
+                // Cursor position and shapes
+                _ = cursor_tick.tick(), if host_cursor.is_some() => {
+                    if let (Some(cursor), Some(addr), Some(state)) = (host_cursor.as_mut(), client_addr, peer_state.as_mut()) {
+                        let ready = state.crypto.is_established() &&
+                            matches!(state.handshake.state(), rift_core::HandshakeState::Established { .. });
+                        if ready {
+                            if let Err(e) = send_cursor(socket.as_ref(), state, addr, cursor, last_target_bitrate).await {
+                                log::warn!("send cursor error: {}", e);
+                            }
+                        }
+                    }
+                }
+
                 // Audio packets
                 res = async {
                     if let Some(ac) = audio_capturer.as_mut() {
@@ -735,11 +936,21 @@ pub async fn run_host(
         Ok(())
     }
 
-    #[cfg(not(target_os = "macos"))]
+    #[cfg(not(any(target_os = "macos", target_os = "android")))]
     {
-        // On non-macOS, we just error out immediately.
-        let _ = init_tx.send(Err(anyhow!("Hosting only supported on macOS")));
-        anyhow::bail!("Hosting only supported on macOS");
+        // Elsewhere, we just error out immediately.
+        let _ = init_tx.send(Err(anyhow!("Hosting only supported on macOS and Android")));
+        anyhow::bail!("Hosting only supported on macOS and Android");
+    }
+}
+
+/// The Android host streams video only, playback capture of the audio isn't wired up
+#[cfg(target_os = "android")]
+struct NoAudioCapturer;
+#[cfg(target_os = "android")]
+impl NoAudioCapturer {
+    async fn next_packet_async(&mut self) -> Result<EncodedFrame> {
+        std::future::pending().await
     }
 }
 
@@ -748,7 +959,19 @@ impl Renderer for SharedRenderer {
     fn render(&mut self, payload: &[u8], timestamp_us: u64) -> Result<()> {
         if let Ok(mut g) = self.0.lock() {
             if let Some(r) = g.as_mut() {
-                return r.render(payload, timestamp_us);
+                let started = Instant::now();
+                let result = r.render(payload, timestamp_us);
+                crate::perf::report_frame_work(started.elapsed());
+                #[cfg(target_os = "android")]
+                {
+                    for us in r.take_present_latencies() {
+                        surface().present_us.record(us);
+                    }
+                    for us in r.take_decoder_latencies() {
+                        surface().decoder_us.record(us);
+                    }
+                }
+                return result;
             }
         }
         Ok(())
@@ -760,7 +983,6 @@ pub struct ClientSessionParams {
     pub relay_info: Option<RelayInfo>,
     pub client_name: String,
     pub renderer_handle: Arc<std::sync::Mutex<Option<Box<PlatformVideoRenderer>>>>,
-    pub stats: Arc<SessionStats>,
     pub stop_rx: oneshot::Receiver<()>,
     pub init_tx: oneshot::Sender<Result<()>>,
     pub monitor_rx: mpsc::UnboundedReceiver<u32>,
@@ -772,7 +994,6 @@ pub async fn run_client(params: ClientSessionParams) -> Result<()> {
         relay_info,
         client_name,
         renderer_handle,
-        stats,
         mut stop_rx,
         init_tx,
         monitor_rx,
@@ -805,6 +1026,7 @@ pub async fn run_client(params: ClientSessionParams) -> Result<()> {
         "unknown target".to_string()
     };
 
+    let stats = surface();
     let runtime_stats = Arc::new(ClientRuntimeStats::default());
 
     // Config for lib
@@ -825,6 +1047,8 @@ pub async fn run_client(params: ClientSessionParams) -> Result<()> {
         file_out_dir: std::path::PathBuf::from("received-files"),
         file_max_bytes: wavry_common::file_transfer::DEFAULT_MAX_FILE_BYTES,
         file_command_bus: None,
+        input_sink: Some(crate::input::sink()),
+        cursor_sink: Some(crate::cursor::sink()),
     };
 
     // Factory
@@ -847,7 +1071,7 @@ pub async fn run_client(params: ClientSessionParams) -> Result<()> {
     loop {
         tokio::select! {
             res = &mut client_fut => {
-                stats.connected.store(false, Ordering::Relaxed);
+                stats.set_connected(false);
                 match res {
                     Ok(_) => {
                         if !started {
@@ -871,7 +1095,7 @@ pub async fn run_client(params: ClientSessionParams) -> Result<()> {
                 }
             }
             _ = &mut stop_rx => {
-                stats.connected.store(false, Ordering::Relaxed);
+                stats.set_connected(false);
                 if !started {
                     if let Some(tx) = init_tx.take() {
                         let _ = tx.send(Err(anyhow!("Client startup canceled")));
@@ -881,12 +1105,8 @@ pub async fn run_client(params: ClientSessionParams) -> Result<()> {
                 return Ok(());
             }
             _ = stats_tick.tick() => {
-                let connected = runtime_stats.connected.load(Ordering::Relaxed);
-                stats.connected.store(connected, Ordering::Relaxed);
-                stats.frames_decoded.store(
-                    runtime_stats.frames_decoded.load(Ordering::Relaxed),
-                    Ordering::Relaxed,
-                );
+                stats.publish_client(&runtime_stats);
+                let connected = stats.is_connected();
 
                 if connected && !started {
                     started = true;
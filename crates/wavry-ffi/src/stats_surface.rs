@@ -0,0 +1,385 @@
+//! Stats surface shared with the apps.
+//!
+//! `wavry_get_stats` copies a handful of values per call, which is too coarse and too costly for
+//! an overlay polled every frame. The surface is a fixed `repr(C)` block of atomic counters that
+//! the session updates in place: Android wraps it in a direct `ByteBuffer`, and a desktop
+//! dashboard in another process maps the file given to `wavry_stats_map_file`. Readers take the
+//! fields one by one, so a snapshot can be torn between two counters but every field is whole.
+
+use std::sync::atomic::{AtomicPtr, AtomicU32, AtomicU64, Ordering};
+
+use anyhow::Result;
+use wavry_client::{ClientRuntimeStats, LatencyHistogram};
+
+/// Bumped whenever a field is added, moved or changes meaning.
+pub const STATS_SURFACE_VERSION: u32 = 4;
+
+/// Why a video frame never reached the screen.
+#[repr(usize)]
+#[derive(Debug, Clone, Copy)]
+pub enum DropReason {
+    /// Encoded while the handshake with the client was still running
+    NotReady = 0,
+    /// The host couldn't send it
+    SendFailed = 1,
+    /// Chunks still missing when the client assembler timed out
+    Incomplete = 2,
+}
+
+pub const DROP_REASON_COUNT: usize = 3;
+
+/// Bits of `decoder_options`, the `WavryDecoderConfig` flags of the live Android decoder
+pub const DECODER_LOW_LATENCY: u32 = 1 << 0;
+pub const DECODER_VENDOR_LOW_LATENCY: u32 = 1 << 1;
+pub const DECODER_REALTIME_PRIORITY: u32 = 1 << 2;
+
+/// Layout mirrored by `WavryStatsSurface` in wavry.h. Fields are only ever appended.
+#[repr(C)]
+#[derive(Debug)]
+pub struct WavryStatsSurface {
+    pub version: AtomicU32,
+    /// Size of the struct in bytes, lets a reader built against an older version skip the tail
+    pub size: AtomicU32,
+    pub connected: AtomicU32,
+    pub fps: AtomicU32,
+    pub rtt_ms: AtomicU32,
+    pub bitrate_kbps: AtomicU32,
+    pub jitter_us: AtomicU32,
+    pub jitter_buffer_depth: AtomicU32,
+    pub frames_encoded: AtomicU64,
+    pub frames_decoded: AtomicU64,
+    pub packets_received: AtomicU64,
+    pub packets_lost: AtomicU64,
+    pub fec_recovered: AtomicU64,
+    /// Indexed by [`DropReason`]
+    pub frames_dropped: [AtomicU64; DROP_REASON_COUNT],
+    pub encode_us: LatencyHistogram,
+    pub decode_us: LatencyHistogram,
+    pub network_us: LatencyHistogram,
+    /// Decoder to display, measured by the Android MediaCodec renderer and reported by macOS apps
+    /// presenting through `wavry_init_frame_callback`
+    pub present_us: LatencyHistogram,
+    /// Device callbacks of the Android AAudio output that found its jitter buffer empty
+    pub audio_underruns: AtomicU64,
+    /// Audio waiting in that jitter buffer and in the device buffer
+    pub audio_buffer_us: AtomicU32,
+    pub audio_device_buffer_us: AtomicU32,
+    /// Queue to output of the Android MediaCodec decoder, the buffering of the device's decoder
+    pub decoder_us: LatencyHistogram,
+    /// `DECODER_*` bits and operating rate the live decoder was configured with
+    pub decoder_options: AtomicU32,
+    pub decoder_operating_rate: AtomicU32,
+}
+
+pub const STATS_SURFACE_SIZE: usize = std::mem::size_of::<WavryStatsSurface>();
+
+impl WavryStatsSurface {
+    pub const fn new() -> Self {
+        #[allow(clippy::declare_interior_mutable_const)]
+        const ZERO: AtomicU64 = AtomicU64::new(0);
+        Self {
+            version: AtomicU32::new(STATS_SURFACE_VERSION),
+            size: AtomicU32::new(STATS_SURFACE_SIZE as u32),
+            connected: AtomicU32::new(0),
+            fps: AtomicU32::new(0),
+            rtt_ms: AtomicU32::new(0),
+            bitrate_kbps: AtomicU32::new(0),
+            jitter_us: AtomicU32::new(0),
+            jitter_buffer_depth: AtomicU32::new(0),
+            frames_encoded: AtomicU64::new(0),
+            frames_decoded: AtomicU64::new(0),
+            packets_received: AtomicU64::new(0),
+            packets_lost: AtomicU64::new(0),
+            fec_recovered: AtomicU64::new(0),
+            frames_dropped: [ZERO; DROP_REASON_COUNT],
+            encode_us: LatencyHistogram::new(),
+            decode_us: LatencyHistogram::new(),
+            network_us: LatencyHistogram::new(),
+            present_us: LatencyHistogram::new(),
+            audio_underruns: AtomicU64::new(0),
+            audio_buffer_us: AtomicU32::new(0),
+            audio_device_buffer_us: AtomicU32::new(0),
+            decoder_us: LatencyHistogram::new(),
+            decoder_options: AtomicU32::new(0),
+            decoder_operating_rate: AtomicU32::new(0),
+        }
+    }
+
+    /// Zeroes the counters for a new session, the header is kept.
+    pub fn reset(&self) {
+        for counter in [
+            &self.connected,
+            &self.fps,
+            &self.rtt_ms,
+            &self.bitrate_kbps,
+            &self.jitter_us,
+            &self.jitter_buffer_depth,
+            &self.audio_buffer_us,
+            &self.audio_device_buffer_us,
+        ] {
+            counter.store(0, Ordering::Relaxed);
+        }
+        for counter in [
+            &self.frames_encoded,
+            &self.frames_decoded,
+            &self.packets_received,
+            &self.packets_lost,
+            &self.fec_recovered,
+            &self.audio_underruns,
+        ]
+        .into_iter()
+        .chain(self.frames_dropped.iter())
+        {
+            counter.store(0, Ordering::Relaxed);
+        }
+        self.encode_us.reset();
+        self.decode_us.reset();
+        self.network_us.reset();
+        self.present_us.reset();
+        self.decoder_us.reset();
+    }
+
+    /// Takes over every counter of `other`, the header is kept.
+    pub fn copy_from(&self, other: &WavryStatsSurface) {
+        for (dst, src) in [
+            (&self.connected, &other.connected),
+            (&self.fps, &other.fps),
+            (&self.rtt_ms, &other.rtt_ms),
+            (&self.bitrate_kbps, &other.bitrate_kbps),
+            (&self.jitter_us, &other.jitter_us),
+            (&self.jitter_buffer_depth, &other.jitter_buffer_depth),
+            (&self.audio_buffer_us, &other.audio_buffer_us),
+            (&self.audio_device_buffer_us, &other.audio_device_buffer_us),
+            (&self.decoder_options, &other.decoder_options),
+            (&self.decoder_operating_rate, &other.decoder_operating_rate),
+        ] {
+            dst.store(src.load(Ordering::Relaxed), Ordering::Relaxed);
+        }
+        for (dst, src) in [
+            (&self.frames_encoded, &other.frames_encoded),
+            (&self.frames_decoded, &other.frames_decoded),
+            (&self.packets_received, &other.packets_received),
+            (&self.packets_lost, &other.packets_lost),
+            (&self.fec_recovered, &other.fec_recovered),
+            (&self.audio_underruns, &other.audio_underruns),
+        ]
+        .into_iter()
+        .chain(self.frames_dropped.iter().zip(other.frames_dropped.iter()))
+        {
+            dst.store(src.load(Ordering::Relaxed), Ordering::Relaxed);
+        }
+        self.encode_us.copy_from(&other.encode_us);
+        self.decode_us.copy_from(&other.decode_us);
+        self.network_us.copy_from(&other.network_us);
+        self.present_us.copy_from(&other.present_us);
+        self.decoder_us.copy_from(&other.decoder_us);
+    }
+
+    pub fn set_connected(&self, connected: bool) {
+        if self.connected.swap(connected as u32, Ordering::Relaxed) != connected as u32 {
+            crate::events::connection_changed();
+        }
+    }
+
+    pub fn is_connected(&self) -> bool {
+        self.connected.load(Ordering::Relaxed) != 0
+    }
+
+    /// Kept across sessions, the decoder lives as long as the app's surface.
+    pub fn set_decoder(&self, config: &crate::WavryDecoderConfig) {
+        let mut options = 0;
+        for (flag, bit) in [
+            (config.low_latency, DECODER_LOW_LATENCY),
+            (config.vendor_low_latency, DECODER_VENDOR_LOW_LATENCY),
+            (config.realtime_priority, DECODER_REALTIME_PRIORITY),
+        ] {
+            if flag != 0 {
+                options |= bit;
+            }
+        }
+        self.decoder_options.store(options, Ordering::Relaxed);
+        self.decoder_operating_rate
+            .store(config.operating_rate, Ordering::Relaxed);
+    }
+
+    pub fn record_drop(&self, reason: DropReason) {
+        self.frames_dropped[reason as usize].fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Takes over the counters the client runtime keeps on its side.
+    pub fn publish_client(&self, stats: &ClientRuntimeStats) {
+        self.set_connected(stats.connected.load(Ordering::Relaxed));
+        self.rtt_ms.store(
+            (stats.rtt_us.load(Ordering::Relaxed) / 1000) as u32,
+            Ordering::Relaxed,
+        );
+        self.jitter_us
+            .store(stats.jitter_us.load(Ordering::Relaxed), Ordering::Relaxed);
+        self.jitter_buffer_depth.store(
+            stats.jitter_buffer_depth.load(Ordering::Relaxed),
+            Ordering::Relaxed,
+        );
+        for (dst, src) in [
+            (&self.frames_decoded, &stats.frames_decoded),
+            (&self.packets_received, &stats.packets_received),
+            (&self.packets_lost, &stats.packets_lost),
+            (&self.fec_recovered, &stats.fec_recovered),
+            (
+                &self.frames_dropped[DropReason::Incomplete as usize],
+                &stats.frames_incomplete,
+            ),
+            (&self.audio_underruns, &stats.audio_output.underruns),
+        ] {
+            dst.store(src.load(Ordering::Relaxed), Ordering::Relaxed);
+        }
+        self.decode_us.copy_from(&stats.decode_us);
+        self.network_us.copy_from(&stats.network_us);
+        for (dst, src) in [
+            (&self.audio_buffer_us, &stats.audio_output.buffered_us),
+            (
+                &self.audio_device_buffer_us,
+                &stats.audio_output.device_buffer_us,
+            ),
+        ] {
+            dst.store(src.load(Ordering::Relaxed), Ordering::Relaxed);
+        }
+    }
+}
+
+impl Default for WavryStatsSurface {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+static PROCESS_SURFACE: WavryStatsSurface = WavryStatsSurface::new();
+// Switched once to a file mapping, which is never unmapped so references stay valid
+static MAPPED_SURFACE: AtomicPtr<WavryStatsSurface> = AtomicPtr::new(std::ptr::null_mut());
+
+/// The surface the session writes to.
+pub fn surface() -> &'static WavryStatsSurface {
+    let mapped = MAPPED_SURFACE.load(Ordering::Acquire);
+    if mapped.is_null() {
+        &PROCESS_SURFACE
+    } else {
+        unsafe { &*mapped }
+    }
+}
+
+/// Moves the surface into a shared file mapping at `path` so other processes can read it.
+#[cfg(unix)]
+pub fn map_file(path: &str) -> Result<()> {
+    use anyhow::{anyhow, bail};
+    use std::ffi::CString;
+
+    if !MAPPED_SURFACE.load(Ordering::Acquire).is_null() {
+        bail!("stats surface already mapped");
+    }
+    let c_path = CString::new(path).map_err(|_| anyhow!("path contains a NUL byte"))?;
+
+    unsafe {
+        let fd = libc::open(c_path.as_ptr(), libc::O_RDWR | libc::O_CREAT, 0o644);
+        if fd < 0 {
+            bail!("open failed: {}", std::io::Error::last_os_error());
+        }
+        if libc::ftruncate(fd, STATS_SURFACE_SIZE as libc::off_t) != 0 {
+            let err = std::io::Error::last_os_error();
+            libc::close(fd);
+            bail!("ftruncate failed: {}", err);
+        }
+        let ptr = libc::mmap(
+            std::ptr::null_mut(),
+            STATS_SURFACE_SIZE,
+            libc::PROT_READ | libc::PROT_WRITE,
+            libc::MAP_SHARED,
+            fd,
+            0,
+        );
+        // The mapping keeps its own reference to the file
+        libc::close(fd);
+        if ptr == libc::MAP_FAILED {
+            bail!("mmap failed: {}", std::io::Error::last_os_error());
+        }
+
+        // A session may already be running, or the decoder configured, so the mapping starts
+        // from what was counted so far
+        let mapped = ptr as *mut WavryStatsSurface;
+        std::ptr::write(mapped, WavryStatsSurface::new());
+        (*mapped).copy_from(&PROCESS_SURFACE);
+        if MAPPED_SURFACE
+            .compare_exchange(
+                std::ptr::null_mut(),
+                mapped,
+                Ordering::AcqRel,
+                Ordering::Acquire,
+            )
+            .is_err()
+        {
+            libc::munmap(ptr, STATS_SURFACE_SIZE);
+            bail!("stats surface already mapped");
+        }
+    }
+    Ok(())
+}
+
+#[cfg(not(unix))]
+pub fn map_file(_path: &str) -> Result<()> {
+    anyhow::bail!("file mapped stats are only supported on unix")
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_copy_from_keeps_header() {
+        let source = WavryStatsSurface::new();
+        source.version.store(0, Ordering::Relaxed);
+        source.fps.store(60, Ordering::Relaxed);
+        source.frames_decoded.store(1234, Ordering::Relaxed);
+        source.record_drop(DropReason::Incomplete);
+        source.decode_us.record(300);
+        source.decoder_operating_rate.store(120, Ordering::Relaxed);
+
+        let target = WavryStatsSurface::new();
+        target.copy_from(&source);
+        assert_eq!(
+            target.version.load(Ordering::Relaxed),
+            STATS_SURFACE_VERSION
+        );
+        assert_eq!(
+            target.size.load(Ordering::Relaxed),
+            STATS_SURFACE_SIZE as u32
+        );
+        assert_eq!(target.fps.load(Ordering::Relaxed), 60);
+        assert_eq!(target.frames_decoded.load(Ordering::Relaxed), 1234);
+        assert_eq!(
+            target.frames_dropped[DropReason::Incomplete as usize].load(Ordering::Relaxed),
+            1
+        );
+        assert_eq!(target.decode_us.buckets[1].load(Ordering::Relaxed), 1);
+        assert_eq!(target.decoder_operating_rate.load(Ordering::Relaxed), 120);
+    }
+
+    #[cfg(unix)]
+    #[test]
+    fn test_map_file_carries_over_process_surface() {
+        PROCESS_SURFACE.frames_encoded.store(42, Ordering::Relaxed);
+        PROCESS_SURFACE.encode_us.record(600);
+
+        let path = std::env::temp_dir().join(format!("wavry-stats-{}", std::process::id()));
+        map_file(path.to_str().unwrap()).unwrap();
+        let mapped = surface();
+        assert!(!std::ptr::eq(mapped, &PROCESS_SURFACE));
+        assert_eq!(
+            mapped.version.load(Ordering::Relaxed),
+            STATS_SURFACE_VERSION
+        );
+        assert_eq!(mapped.frames_encoded.load(Ordering::Relaxed), 42);
+        assert_eq!(mapped.encode_us.buckets[2].load(Ordering::Relaxed), 1);
+        assert!(map_file(path.to_str().unwrap()).is_err());
+
+        // The mapping stays valid after the file is gone
+        std::fs::remove_file(&path).unwrap();
+    }
+}
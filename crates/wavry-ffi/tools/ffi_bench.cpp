@@ -0,0 +1,254 @@
+/*
+Microbenchmarks of the wavry.h entry points that the apps call on their UI refresh and input
+paths: the call cost and the heap allocations of the library for each. The JNI side of the
+Android app is benched by NativeBridgeBenchmark in its androidTest sources.
+
+Build it against the static library, from the repository root:
+
+    cargo build --release -p wavry-ffi
+    c++ -std=c++17 -O2 -Icrates/wavry-ffi/include crates/wavry-ffi/tools/ffi_bench.cpp \
+        target/release/libwavry_ffi.a -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc \
+        -Wl,--wrap=posix_memalign,--wrap=memalign -lpthread -ldl -lm -o ffi_bench
+
+For a low-end device, link the library of ./scripts/build-android-ffi.sh with the clang++ of the
+NDK (aarch64-linux-android28-clang++, the same flags plus -llog -landroid -lmediandk -lOpenSLES
+-static-libstdc++), then adb push the binary to /data/local/tmp and run it from adb shell.
+
+    ffi_bench [--connect <host>:<port>] [--min-time 0.5]
+
+Each benchmark runs with a growing iteration count until a run takes at least --min-time
+seconds, and reports the time per iteration of that run. The allocations are those of the
+library, counted by wrapping its calls to the allocator at link time: without the --wrap flags
+they read 0. Without --connect there is no session, wavry_get_stats reads zeros and the input
+batches stop at the missing client. --connect starts a client to a running host first.
+
+- Polling: wavry_get_stats, wavry_copy_last_error and wavry_copy_last_cloud_status, alone and
+  together as in one tick of a UI refresh timer.
+- Shared memory: every scalar field of the stats surface read atomically in place, the pointer
+  being fetched once like the apps do.
+- Input: wavry_send_input_batch with a single mouse move, and with a tick of 16 moves, buttons
+  and keys.
+- Callback: registers an event callback and waits for its first event, the connection state,
+  then unregisters it. The event is delivered on the event thread of the library, the
+  allocations of every thread are counted.
+*/
+
+#include "wavry.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Allocator calls of libwavry_ffi.a, redirected here by --wrap. The C++ runtime of the bench
+// allocates through the unwrapped symbols.
+namespace {
+std::atomic<uint64_t> g_allocations{0};
+thread_local uint64_t t_allocations = 0;
+
+void count_allocation() {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    t_allocations++;
+}
+} // namespace
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **ptr, size_t alignment, size_t size);
+void *__real_memalign(size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    count_allocation();
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    count_allocation();
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    count_allocation();
+    return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **ptr, size_t alignment, size_t size) {
+    count_allocation();
+    return __real_posix_memalign(ptr, alignment, size);
+}
+
+void *__wrap_memalign(size_t alignment, size_t size) {
+    count_allocation();
+    return __real_memalign(alignment, size);
+}
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double g_min_time = 0.5;
+// Results of the calls, so that they aren't optimized out
+volatile uint64_t g_sink = 0;
+
+// Runs body with a growing iteration count, like Google Benchmark. all_threads counts the
+// allocations of the library threads as well, the other benchmarks only those of the caller.
+void run(const char *name, bool all_threads, const std::function<void()> &body) {
+    body();
+    for (uint64_t iterations = 16;; iterations *= 4) {
+        uint64_t allocations = all_threads ? g_allocations.load() : t_allocations;
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            body();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        allocations = (all_threads ? g_allocations.load() : t_allocations) - allocations;
+        if (seconds >= g_min_time || iterations >= (1ull << 40)) {
+            printf(
+                "%-28s %12.1f ns %10.2f allocs %12llu iterations\n",
+                name,
+                seconds * 1e9 / iterations,
+                (double)allocations / iterations,
+                (unsigned long long)iterations);
+            return;
+        }
+    }
+}
+
+template <typename T> uint64_t load(const T &field) {
+    return __atomic_load_n(&field, __ATOMIC_RELAXED);
+}
+
+uint64_t read_surface(const WavryStatsSurface *s) {
+    uint64_t sum = load(s->connected) + load(s->fps) + load(s->rtt_ms) + load(s->bitrate_kbps) +
+                   load(s->jitter_us) + load(s->jitter_buffer_depth) + load(s->frames_encoded) +
+                   load(s->frames_decoded) + load(s->packets_received) + load(s->packets_lost) +
+                   load(s->fec_recovered);
+    for (const uint64_t &dropped : s->frames_dropped) {
+        sum += load(dropped);
+    }
+    return sum;
+}
+
+void on_event(const WavryEvent *, void *user_data) {
+    static_cast<std::atomic<bool> *>(user_data)->store(true, std::memory_order_release);
+}
+
+bool connect(const std::string &address) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        fprintf(stderr, "--connect needs <host>:<port>\n");
+        return false;
+    }
+    std::string host = address.substr(0, colon);
+    int port = atoi(address.c_str() + colon + 1);
+    if (wavry_start_client(host.c_str(), static_cast<uint16_t>(port)) != 0) {
+        char error[512] = {0};
+        wavry_copy_last_error(error, sizeof(error));
+        fprintf(stderr, "Failed to start the client: %s\n", error);
+        return false;
+    }
+    const WavryStatsSurface *surface = wavry_stats_surface();
+    auto deadline = Clock::now() + std::chrono::seconds(10);
+    while (load(surface->connected) == 0) {
+        if (Clock::now() > deadline) {
+            fprintf(stderr, "No connection to %s after 10 s\n", address.c_str());
+            wavry_stop();
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string address;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            address = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            g_min_time = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: ffi_bench [--connect <host>:<port>] [--min-time 0.5]\n");
+            return 1;
+        }
+    }
+
+    wavry_init();
+    if (!address.empty() && !connect(address)) {
+        return 1;
+    }
+
+    WavryStats stats;
+    char buffer[512];
+    run("wavry_get_stats", false, [&] {
+        wavry_get_stats(&stats);
+        g_sink = g_sink + stats.frames_decoded;
+    });
+    run("wavry_copy_last_error", false, [&] {
+        g_sink = g_sink + wavry_copy_last_error(buffer, sizeof(buffer));
+    });
+    run("wavry_copy_last_cloud_status", false, [&] {
+        g_sink = g_sink + wavry_copy_last_cloud_status(buffer, sizeof(buffer));
+    });
+    run("poll tick", false, [&] {
+        wavry_get_stats(&stats);
+        g_sink = g_sink + stats.frames_decoded + wavry_copy_last_error(buffer, sizeof(buffer)) +
+                 wavry_copy_last_cloud_status(buffer, sizeof(buffer));
+    });
+
+    const WavryStatsSurface *surface = wavry_stats_surface();
+    if (surface != nullptr) {
+        run("stats surface read", false, [&] { g_sink = g_sink + read_surface(surface); });
+    }
+
+    if (address.empty()) {
+        printf("No session, the input batches stop at the missing client.\n");
+    }
+    WavryInputEvent move = {};
+    move.type = WAVRY_INPUT_MOUSE_MOVE;
+    move.x = 0.5f;
+    move.y = 0.5f;
+    run("wavry_send_input_batch 1", false, [&] {
+        g_sink = g_sink + wavry_send_input_batch(&move, 1);
+    });
+
+    // Two moves for each button and key event
+    const uint32_t tick_types[4] = {
+        WAVRY_INPUT_MOUSE_MOVE, WAVRY_INPUT_MOUSE_MOVE, WAVRY_INPUT_MOUSE_BUTTON, WAVRY_INPUT_KEY};
+    WavryInputEvent tick[16] = {};
+    for (uint32_t i = 0; i < 16; i++) {
+        WavryInputEvent &event = tick[i];
+        event.type = tick_types[i % 4];
+        event.code = event.type == WAVRY_INPUT_KEY ? 30 : 1;
+        event.pressed = (i / 4) % 2;
+        event.x = i / 16.0f;
+        event.y = 1 - i / 16.0f;
+    }
+    run("wavry_send_input_batch 16", false, [&] {
+        g_sink = g_sink + wavry_send_input_batch(tick, 16);
+    });
+
+    std::atomic<bool> delivered{false};
+    run("event callback round trip", true, [&] {
+        delivered.store(false, std::memory_order_relaxed);
+        wavry_set_event_callback(on_event, &delivered);
+        while (!delivered.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        wavry_set_event_callback(nullptr, nullptr);
+    });
+
+    if (!address.empty()) {
+        wavry_stop();
+    }
+    return 0;
+}
@@ -23,6 +23,7 @@ fn bench_capture_init(c: &mut Criterion) {
                 display_id: None,
                 enable_10bit: false,
                 enable_hdr: false,
+                tuning: wavry_media::EncoderTuning::default(),
             };
             let _ = PipewireEncoder::new(config).await;
         })
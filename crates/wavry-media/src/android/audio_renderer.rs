@@ -1,23 +1,510 @@
-use crate::audio::renderer::CpalAudioRenderer;
+//! AAudio output for the Android client.
+//!
+//! Through cpal the audio went to the shared mixer at its default buffer size, which adds 40 ms
+//! and more and lets the audio fall behind the video. This stream asks AAudio for the low latency
+//! performance mode with exclusive sharing, an MMAP stream where the device has one, and its data
+//! callback reads from a lock-free ring so it never waits on the session thread. How much audio
+//! the ring keeps follows the underruns, and the device buffer grows a burst at a time whenever
+//! AAudio reports an xrun.
+
+use crate::audio::{AudioOutputStats, OPUS_CHANNELS, OPUS_FRAME_SAMPLES, OPUS_SAMPLE_RATE};
 use crate::Renderer;
-use anyhow::Result;
+use anyhow::{anyhow, Result};
+use ndk_sys::{AAudioStream, AAudioStreamBuilder};
+#[cfg(feature = "opus-support")]
+use opus::{Channels, Decoder as OpusDecoder};
+use std::ffi::{c_void, CStr};
+use std::sync::atomic::{AtomicBool, AtomicU32, AtomicUsize, Ordering};
+use std::sync::Arc;
+
+#[cfg(feature = "opus-support")]
+use crate::audio::OPUS_MAX_FRAME_SAMPLES;
+
+/// Samples the ring holds, about 340 ms. A power of two so the indexes can wrap.
+const RING_SAMPLES: usize = 1 << 15;
+/// Audio the ring aims to keep, in Opus frames of 5 ms.
+const MIN_TARGET_FRAMES: usize = 1;
+const START_TARGET_FRAMES: usize = 2;
+const MAX_TARGET_FRAMES: usize = 8;
+/// Frames above the target the ring may hold before the oldest audio is skipped, so a burst from
+/// the network doesn't turn into lasting delay.
+const SKIP_MARGIN_FRAMES: usize = 4;
+/// Played without an underrun for this many frames, about 10 s, the target drops by one.
+const STABLE_FRAMES_TO_SHRINK: u64 = OPUS_SAMPLE_RATE as u64 * 10;
+/// Device buffer the stream starts with, in bursts.
+const START_DEVICE_BURSTS: i32 = 2;
+
+const FRAME_SAMPLES: usize = OPUS_FRAME_SAMPLES * OPUS_CHANNELS;
+
+fn frames_to_us(frames: usize) -> u32 {
+    (frames as u64 * 1_000_000 / OPUS_SAMPLE_RATE as u64) as u32
+}
+
+/// Single producer, single consumer ring of interleaved samples. The session thread writes and
+/// the AAudio callback reads, neither side ever blocks.
+struct SampleRing {
+    samples: Box<[AtomicU32]>,
+    /// Samples written and read in total, taken modulo the capacity
+    write: AtomicUsize,
+    read: AtomicUsize,
+}
+
+impl SampleRing {
+    fn new() -> Self {
+        Self {
+            samples: (0..RING_SAMPLES).map(|_| AtomicU32::new(0)).collect(),
+            write: AtomicUsize::new(0),
+            read: AtomicUsize::new(0),
+        }
+    }
+
+    fn len(&self) -> usize {
+        self.write
+            .load(Ordering::Acquire)
+            .wrapping_sub(self.read.load(Ordering::Acquire))
+    }
+
+    /// Producer side, what doesn't fit is dropped.
+    fn push(&self, samples: impl ExactSizeIterator<Item = f32>) {
+        let write = self.write.load(Ordering::Relaxed);
+        let free = RING_SAMPLES - write.wrapping_sub(self.read.load(Ordering::Acquire));
+        let count = samples.len().min(free);
+        for (i, sample) in samples.take(count).enumerate() {
+            self.samples[write.wrapping_add(i) % RING_SAMPLES]
+                .store(sample.to_bits(), Ordering::Relaxed);
+        }
+        self.write
+            .store(write.wrapping_add(count), Ordering::Release);
+    }
+
+    /// Consumer side, fills the front of `out` and returns the samples read.
+    fn pop_into(&self, out: &mut [f32]) -> usize {
+        let read = self.read.load(Ordering::Relaxed);
+        let count = out
+            .len()
+            .min(self.write.load(Ordering::Acquire).wrapping_sub(read));
+        for (i, sample) in out[..count].iter_mut().enumerate() {
+            let bits = self.samples[read.wrapping_add(i) % RING_SAMPLES].load(Ordering::Relaxed);
+            *sample = f32::from_bits(bits);
+        }
+        self.read.store(read.wrapping_add(count), Ordering::Release);
+        count
+    }
+
+    /// Consumer side, drops the oldest `count` samples, at most what the ring holds.
+    fn skip(&self, count: usize) {
+        self.read.fetch_add(count, Ordering::Release);
+    }
+}
+
+struct Shared {
+    ring: SampleRing,
+    stats: Arc<AudioOutputStats>,
+    /// Set by the error callback, the stream is opened again from the session thread
+    disconnected: AtomicBool,
+}
+
+/// State of the data callback, only touched from the AAudio thread while the stream is open.
+struct Playback {
+    shared: Arc<Shared>,
+    target_frames: usize,
+    /// Playing silence until the ring is back at the target, after an underrun or at the start
+    priming: bool,
+    played_since_underrun: u64,
+    xruns: i32,
+}
+
+impl Playback {
+    fn restart(&mut self) {
+        self.priming = true;
+        self.played_since_underrun = 0;
+        self.xruns = 0;
+    }
+
+    fn fill(&mut self, stream: *mut AAudioStream, out: &mut [f32]) {
+        self.play(out);
+
+        let device_frames = unsafe {
+            // An xrun means the device buffer ran dry, one more burst absorbs the scheduling
+            // jitter of this callback
+            let xruns = ndk_sys::AAudioStream_getXRunCount(stream);
+            let size = ndk_sys::AAudioStream_getBufferSizeInFrames(stream);
+            if xruns > self.xruns {
+                self.xruns = xruns;
+                let burst = ndk_sys::AAudioStream_getFramesPerBurst(stream);
+                if size + burst <= ndk_sys::AAudioStream_getBufferCapacityInFrames(stream) {
+                    ndk_sys::AAudioStream_setBufferSizeInFrames(stream, size + burst);
+                }
+            }
+            size.max(0) as usize
+        };
+        let stats = &self.shared.stats;
+        stats.buffered_us.store(
+            frames_to_us(self.shared.ring.len() / OPUS_CHANNELS),
+            Ordering::Relaxed,
+        );
+        stats
+            .device_buffer_us
+            .store(frames_to_us(device_frames), Ordering::Relaxed);
+    }
+
+    /// Fills `out` from the ring, with silence while priming, and moves the target with the
+    /// underruns.
+    fn play(&mut self, out: &mut [f32]) {
+        let ring = &self.shared.ring;
+        let stats = &self.shared.stats;
+        let target = self.target_frames * FRAME_SAMPLES;
+        let available = ring.len();
+
+        let read = if self.priming && available < target {
+            0
+        } else {
+            self.priming = false;
+            if available > target + SKIP_MARGIN_FRAMES * FRAME_SAMPLES {
+                ring.skip(available - target);
+            }
+            ring.pop_into(out)
+        };
+        out[read..].fill(0.0);
+
+        if self.priming {
+            // Still filling up, not an underrun
+        } else if read < out.len() {
+            stats.underruns.fetch_add(1, Ordering::Relaxed);
+            self.target_frames = (self.target_frames + 1).min(MAX_TARGET_FRAMES);
+            self.priming = true;
+            self.played_since_underrun = 0;
+        } else {
+            self.played_since_underrun += (out.len() / OPUS_CHANNELS) as u64;
+            if self.played_since_underrun >= STABLE_FRAMES_TO_SHRINK {
+                self.target_frames = (self.target_frames - 1).max(MIN_TARGET_FRAMES);
+                self.played_since_underrun = 0;
+            }
+        }
+    }
+}
+
+unsafe extern "C" fn data_callback(
+    stream: *mut AAudioStream,
+    user_data: *mut c_void,
+    audio_data: *mut c_void,
+    num_frames: i32,
+) -> ndk_sys::aaudio_data_callback_result_t {
+    let playback = &mut *(user_data as *mut Playback);
+    let out = std::slice::from_raw_parts_mut(
+        audio_data as *mut f32,
+        num_frames.max(0) as usize * OPUS_CHANNELS,
+    );
+    playback.fill(stream, out);
+    ndk_sys::AAUDIO_CALLBACK_RESULT_CONTINUE as _
+}
+
+unsafe extern "C" fn error_callback(
+    _stream: *mut AAudioStream,
+    user_data: *mut c_void,
+    error: ndk_sys::aaudio_result_t,
+) {
+    // Called on its own thread, the stream can't be closed from here
+    log::warn!("AAudio stream error: {}", result_text(error));
+    let shared = &*(user_data as *const Shared);
+    shared.disconnected.store(true, Ordering::Release);
+}
+
+fn result_text(result: ndk_sys::aaudio_result_t) -> String {
+    unsafe { CStr::from_ptr(ndk_sys::AAudio_convertResultToText(result)) }
+        .to_string_lossy()
+        .into_owned()
+}
+
+fn check(result: ndk_sys::aaudio_result_t, what: &str) -> Result<()> {
+    if result < 0 {
+        return Err(anyhow!("{} failed: {}", what, result_text(result)));
+    }
+    Ok(())
+}
+
+/// Opens and starts a float stereo output stream at the Opus rate, whose callbacks get
+/// `playback` and `shared`.
+unsafe fn open_stream(playback: *mut Playback, shared: *const Shared) -> Result<*mut AAudioStream> {
+    let mut builder: *mut AAudioStreamBuilder = std::ptr::null_mut();
+    check(
+        ndk_sys::AAudio_createStreamBuilder(&mut builder),
+        "AAudio_createStreamBuilder",
+    )?;
+    ndk_sys::AAudioStreamBuilder_setDirection(builder, ndk_sys::AAUDIO_DIRECTION_OUTPUT as _);
+    ndk_sys::AAudioStreamBuilder_setPerformanceMode(
+        builder,
+        ndk_sys::AAUDIO_PERFORMANCE_MODE_LOW_LATENCY as _,
+    );
+    // AAudio falls back to the shared mixer when the device has no exclusive stream left
+    ndk_sys::AAudioStreamBuilder_setSharingMode(
+        builder,
+        ndk_sys::AAUDIO_SHARING_MODE_EXCLUSIVE as _,
+    );
+    ndk_sys::AAudioStreamBuilder_setFormat(builder, ndk_sys::AAUDIO_FORMAT_PCM_FLOAT as _);
+    ndk_sys::AAudioStreamBuilder_setChannelCount(builder, OPUS_CHANNELS as i32);
+    ndk_sys::AAudioStreamBuilder_setSampleRate(builder, OPUS_SAMPLE_RATE as i32);
+    ndk_sys::AAudioStreamBuilder_setUsage(builder, ndk_sys::AAUDIO_USAGE_GAME as _);
+    ndk_sys::AAudioStreamBuilder_setDataCallback(builder, Some(data_callback), playback.cast());
+    ndk_sys::AAudioStreamBuilder_setErrorCallback(
+        builder,
+        Some(error_callback),
+        shared as *mut c_void,
+    );
+
+    let mut stream: *mut AAudioStream = std::ptr::null_mut();
+    let result = ndk_sys::AAudioStreamBuilder_openStream(builder, &mut stream);
+    ndk_sys::AAudioStreamBuilder_delete(builder);
+    check(result, "AAudioStreamBuilder_openStream")?;
+
+    let burst = ndk_sys::AAudioStream_getFramesPerBurst(stream);
+    ndk_sys::AAudioStream_setBufferSizeInFrames(stream, burst * START_DEVICE_BURSTS);
+    if let Err(e) = check(
+        ndk_sys::AAudioStream_requestStart(stream),
+        "AAudioStream_requestStart",
+    ) {
+        ndk_sys::AAudioStream_close(stream);
+        return Err(e);
+    }
+
+    let exclusive = ndk_sys::AAudioStream_getSharingMode(stream)
+        == ndk_sys::AAUDIO_SHARING_MODE_EXCLUSIVE as ndk_sys::aaudio_sharing_mode_t;
+    let low_latency = ndk_sys::AAudioStream_getPerformanceMode(stream)
+        == ndk_sys::AAUDIO_PERFORMANCE_MODE_LOW_LATENCY as ndk_sys::aaudio_performance_mode_t;
+    log::info!(
+        "AAudio output: {} Hz, {} sharing, low latency {}, burst of {} frames",
+        ndk_sys::AAudioStream_getSampleRate(stream),
+        if exclusive { "exclusive" } else { "shared" },
+        low_latency,
+        burst
+    );
+    Ok(stream)
+}
 
 pub struct AndroidAudioRenderer {
-    inner: CpalAudioRenderer,
+    stream: *mut AAudioStream,
+    // Owned, the callbacks of the stream use it until the stream is closed
+    playback: *mut Playback,
+    shared: Arc<Shared>,
+    #[cfg(feature = "opus-support")]
+    decoder: OpusDecoder,
+    #[cfg(feature = "opus-support")]
+    decode_buf: Vec<f32>,
 }
 
 unsafe impl Send for AndroidAudioRenderer {}
 
 impl AndroidAudioRenderer {
-    pub fn new() -> Result<Self> {
+    /// The data callback reports the fill level of the ring, the device buffer and the
+    /// underruns to `stats`.
+    pub fn new(stats: Arc<AudioOutputStats>) -> Result<Self> {
+        stats.reset();
+        let shared = Arc::new(Shared {
+            ring: SampleRing::new(),
+            stats,
+            disconnected: AtomicBool::new(false),
+        });
+        let playback = Box::into_raw(Box::new(Playback {
+            shared: shared.clone(),
+            target_frames: START_TARGET_FRAMES,
+            priming: true,
+            played_since_underrun: 0,
+            xruns: 0,
+        }));
+
+        let stream = match unsafe { open_stream(playback, Arc::as_ptr(&shared)) } {
+            Ok(stream) => stream,
+            Err(e) => {
+                drop(unsafe { Box::from_raw(playback) });
+                return Err(e);
+            }
+        };
+
+        #[cfg(feature = "opus-support")]
+        let decoder = match OpusDecoder::new(OPUS_SAMPLE_RATE, Channels::Stereo) {
+            Ok(decoder) => decoder,
+            Err(e) => {
+                unsafe { ndk_sys::AAudioStream_close(stream) };
+                drop(unsafe { Box::from_raw(playback) });
+                return Err(anyhow!("Opus decoder init failed: {}", e));
+            }
+        };
+
         Ok(Self {
-            inner: CpalAudioRenderer::new()?,
+            stream,
+            playback,
+            shared,
+            #[cfg(feature = "opus-support")]
+            decoder,
+            #[cfg(feature = "opus-support")]
+            decode_buf: vec![0.0; OPUS_MAX_FRAME_SAMPLES * OPUS_CHANNELS],
         })
     }
+
+    /// Opens a new stream after the device went away, e.g. headphones plugged in or out.
+    fn reopen(&mut self) -> Result<()> {
+        unsafe {
+            ndk_sys::AAudioStream_close(self.stream);
+            self.stream = std::ptr::null_mut();
+            // No callback runs once the stream is closed
+            (*self.playback).restart();
+            self.stream = open_stream(self.playback, Arc::as_ptr(&self.shared))?;
+        }
+        Ok(())
+    }
+
+    #[cfg(feature = "opus-support")]
+    fn push(&mut self, payload: &[u8]) -> Result<()> {
+        let decoded = self
+            .decoder
+            .decode_float(payload, &mut self.decode_buf, false)
+            .map_err(|e| anyhow!("Opus decode failed: {}", e))?;
+        let samples = &self.decode_buf[..decoded * OPUS_CHANNELS];
+        self.shared.ring.push(samples.iter().copied());
+        Ok(())
+    }
+
+    #[cfg(not(feature = "opus-support"))]
+    fn push(&mut self, _payload: &[u8]) -> Result<()> {
+        // Opus disabled, no-op or implement alternate decoder
+        Ok(())
+    }
 }
 
 impl Renderer for AndroidAudioRenderer {
-    fn render(&mut self, payload: &[u8], timestamp_us: u64) -> Result<()> {
-        self.inner.render(payload, timestamp_us)
+    fn render(&mut self, payload: &[u8], _timestamp_us: u64) -> Result<()> {
+        if self.shared.disconnected.swap(false, Ordering::AcqRel) {
+            log::info!("AAudio stream disconnected, reopening");
+            self.reopen()?;
+        }
+        self.push(payload)
+    }
+}
+
+impl Drop for AndroidAudioRenderer {
+    fn drop(&mut self) {
+        unsafe {
+            if !self.stream.is_null() {
+                ndk_sys::AAudioStream_close(self.stream);
+            }
+            drop(Box::from_raw(self.playback));
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn playback() -> Playback {
+        Playback {
+            shared: Arc::new(Shared {
+                ring: SampleRing::new(),
+                stats: Arc::new(AudioOutputStats::default()),
+                disconnected: AtomicBool::new(false),
+            }),
+            target_frames: START_TARGET_FRAMES,
+            priming: true,
+            played_since_underrun: 0,
+            xruns: 0,
+        }
+    }
+
+    fn push_frames(playback: &Playback, frames: usize) {
+        let samples = (0..frames * FRAME_SAMPLES).map(|i| i as f32);
+        playback.shared.ring.push(samples);
+    }
+
+    fn underruns(playback: &Playback) -> u64 {
+        playback.shared.stats.underruns.load(Ordering::Relaxed)
+    }
+
+    #[test]
+    fn test_ring_wraps_and_drops_overflow() {
+        let ring = SampleRing::new();
+        let mut out = vec![0.0; RING_SAMPLES];
+        for round in 0..3 {
+            let base = round as f32 * 10.0;
+            ring.push([base, base + 1.0, base + 2.0].into_iter());
+            assert_eq!(ring.pop_into(&mut out[..2]), 2);
+            assert_eq!(&out[..2], &[base, base + 1.0]);
+            ring.skip(1);
+        }
+
+        ring.push((0..RING_SAMPLES + 10).map(|i| i as f32));
+        assert_eq!(ring.len(), RING_SAMPLES);
+        assert_eq!(ring.pop_into(&mut out), RING_SAMPLES);
+        assert_eq!(out[RING_SAMPLES - 1], (RING_SAMPLES - 1) as f32);
+        assert_eq!(ring.len(), 0);
+    }
+
+    #[test]
+    fn test_priming_plays_silence_until_target() {
+        let mut playback = playback();
+        let mut out = vec![1.0; FRAME_SAMPLES];
+        push_frames(&playback, START_TARGET_FRAMES - 1);
+        playback.play(&mut out);
+        assert!(out.iter().all(|&s| s == 0.0));
+        assert!(playback.priming);
+        assert_eq!(underruns(&playback), 0);
+
+        push_frames(&playback, 1);
+        playback.play(&mut out);
+        assert!(!playback.priming);
+        assert_eq!(out[1], 1.0);
+        assert_eq!(underruns(&playback), 0);
+    }
+
+    #[test]
+    fn test_underrun_raises_target() {
+        let mut playback = playback();
+        let mut out = vec![0.0; FRAME_SAMPLES];
+        push_frames(&playback, START_TARGET_FRAMES);
+        playback.play(&mut out);
+        playback.play(&mut out);
+        assert_eq!(underruns(&playback), 0);
+
+        playback.play(&mut out);
+        assert_eq!(underruns(&playback), 1);
+        assert_eq!(playback.target_frames, START_TARGET_FRAMES + 1);
+        assert!(playback.priming);
+
+        for _ in 0..MAX_TARGET_FRAMES * 2 {
+            playback.priming = false;
+            playback.play(&mut out);
+        }
+        assert_eq!(playback.target_frames, MAX_TARGET_FRAMES);
+    }
+
+    #[test]
+    fn test_burst_is_skipped_down_to_target() {
+        let mut playback = playback();
+        let mut out = vec![0.0; FRAME_SAMPLES];
+        push_frames(&playback, START_TARGET_FRAMES + SKIP_MARGIN_FRAMES);
+        playback.play(&mut out);
+        // Within the margin, nothing is skipped
+        assert_eq!(out[0], 0.0);
+
+        push_frames(&playback, SKIP_MARGIN_FRAMES + 1);
+        playback.play(&mut out);
+        assert_eq!(
+            playback.shared.ring.len(),
+            (START_TARGET_FRAMES - 1) * FRAME_SAMPLES
+        );
+    }
+
+    #[test]
+    fn test_target_shrinks_after_stable_playback() {
+        let mut playback = playback();
+        playback.target_frames = 3;
+        playback.priming = false;
+        let mut out = vec![0.0; FRAME_SAMPLES];
+        let callbacks = STABLE_FRAMES_TO_SHRINK as usize / OPUS_FRAME_SAMPLES;
+        for _ in 0..callbacks {
+            push_frames(&playback, 1);
+            playback.play(&mut out);
+        }
+        assert_eq!(underruns(&playback), 0);
+        assert_eq!(playback.target_frames, 2);
     }
 }
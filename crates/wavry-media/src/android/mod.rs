@@ -1,7 +1,9 @@
 mod audio_renderer;
 mod probe;
+mod screen_encoder;
 mod video_renderer;
 
 pub use audio_renderer::AndroidAudioRenderer;
 pub use probe::AndroidProbe;
-pub use video_renderer::AndroidVideoRenderer;
+pub use screen_encoder::AndroidScreenEncoder;
+pub use video_renderer::{AndroidDecoderOptions, AndroidVideoRenderer};
@@ -0,0 +1,304 @@
+use crate::{Codec, EncodeConfig, EncodedFrame, RefreshMode};
+use anyhow::{anyhow, Result};
+use std::ffi::c_void;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex};
+use tokio::sync::mpsc;
+
+#[cfg(target_os = "android")]
+use ndk::media::media_codec::{
+    DequeuedOutputBufferInfoResult, MediaCodec, MediaCodecDirection, MediaFormat,
+};
+#[cfg(target_os = "android")]
+use ndk::native_window::NativeWindow;
+#[cfg(target_os = "android")]
+use std::ptr::NonNull;
+
+/// `MediaCodecInfo.CodecCapabilities.COLOR_FormatSurface`: frames come from the input surface
+const COLOR_FORMAT_SURFACE: i32 = 0x7F00_0789;
+/// `MediaCodecInfo.EncoderCapabilities.BITRATE_MODE_*`
+const BITRATE_MODE_VBR: i32 = 1;
+const BITRATE_MODE_CBR: i32 = 2;
+/// `MediaCodec.BUFFER_FLAG_*`
+const BUFFER_FLAG_KEY_FRAME: u32 = 1;
+const BUFFER_FLAG_CODEC_CONFIG: u32 = 2;
+const BUFFER_FLAG_END_OF_STREAM: u32 = 4;
+/// Encoded frames not yet taken by the session, a slow network drops the newest ones
+const FRAME_QUEUE: usize = 4;
+/// A still screen produces no frames, the encoder repeats the last one after this delay so the
+/// client keeps receiving a stream
+const REPEAT_PREVIOUS_FRAME_US: i64 = 100_000;
+
+/// Input window of the live encoder, for `input_window`. Kept as an address since the window
+/// pointer isn't `Send`.
+static LIVE_INPUT_WINDOW: Mutex<usize> = Mutex::new(0);
+
+/// Hardware encoder fed by its own input surface. The app renders the screen into that surface
+/// with a `VirtualDisplay` of its MediaProjection, so the frames go from the compositor to the
+/// encoder as GPU buffers with no copy through the CPU, and MediaCodec hands back the bitstream on
+/// an output thread.
+pub struct AndroidScreenEncoder {
+    #[cfg(target_os = "android")]
+    codec: Arc<SharedCodec>,
+    // Declared after the codec so the window reference is dropped last
+    #[cfg(target_os = "android")]
+    input_window: NativeWindow,
+    running: Arc<AtomicBool>,
+    output_thread: Option<std::thread::JoinHandle<()>>,
+    rx: mpsc::Receiver<EncodedFrame>,
+}
+
+/// AMediaCodec may be called from several threads: the output thread dequeues the bitstream
+/// while the session changes the bitrate.
+#[cfg(target_os = "android")]
+struct SharedCodec(MediaCodec);
+#[cfg(target_os = "android")]
+unsafe impl Send for SharedCodec {}
+#[cfg(target_os = "android")]
+unsafe impl Sync for SharedCodec {}
+
+impl AndroidScreenEncoder {
+    pub async fn new(config: EncodeConfig) -> Result<Self> {
+        #[cfg(target_os = "android")]
+        {
+            let mime = match config.codec {
+                Codec::H264 => "video/avc",
+                Codec::Hevc => "video/hevc",
+                Codec::Av1 => "video/av01",
+            };
+            log::info!(
+                "Initializing Android MediaCodec encoder ({}) for {}x{} @ {}fps",
+                mime,
+                config.resolution.width,
+                config.resolution.height,
+                config.fps
+            );
+
+            let format = encoder_format(mime, &config);
+            let codec = MediaCodec::from_encoder_type(mime)
+                .ok_or_else(|| anyhow!("Failed to create MediaCodec encoder for {}", mime))?;
+            codec
+                .configure(&format, None, MediaCodecDirection::Encoder)
+                .map_err(|e| anyhow!("MediaCodec configure failed: {:?}", e))?;
+
+            // Between configure and start, the surface takes the place of the input buffers
+            let mut window = std::ptr::null_mut();
+            let status =
+                unsafe { ndk_sys::AMediaCodec_createInputSurface(codec.as_ptr(), &mut window) };
+            let window = NonNull::new(window)
+                .filter(|_| status == ndk_sys::media_status_t::AMEDIA_OK)
+                .ok_or_else(|| anyhow!("MediaCodec input surface failed: {:?}", status))?;
+            // Owns the reference returned by createInputSurface
+            let input_window = unsafe { NativeWindow::from_ptr(window) };
+
+            codec
+                .start()
+                .map_err(|e| anyhow!("MediaCodec start failed: {:?}", e))?;
+
+            let codec = Arc::new(SharedCodec(codec));
+            let running = Arc::new(AtomicBool::new(true));
+            let (tx, rx) = mpsc::channel(FRAME_QUEUE);
+            let output_thread = {
+                let codec = codec.clone();
+                let running = running.clone();
+                std::thread::Builder::new()
+                    .name("wavry-encoder-out".into())
+                    .spawn(move || drain_output(&codec.0, &running, &tx))?
+            };
+            *LIVE_INPUT_WINDOW.lock().unwrap() = input_window.ptr().as_ptr() as usize;
+
+            Ok(Self {
+                codec,
+                input_window,
+                running,
+                output_thread: Some(output_thread),
+                rx,
+            })
+        }
+        #[cfg(not(target_os = "android"))]
+        {
+            let _ = config;
+            Err(anyhow!("AndroidScreenEncoder only supported on Android"))
+        }
+    }
+
+    /// Window of the input surface of the live encoder, with a reference acquired for the caller,
+    /// or null when no encoder runs. The app renders its VirtualDisplay into it.
+    pub fn input_window() -> *mut c_void {
+        #[cfg(target_os = "android")]
+        {
+            let window = *LIVE_INPUT_WINDOW.lock().unwrap() as *mut ndk_sys::ANativeWindow;
+            if !window.is_null() {
+                // Acquired under the lock, so the encoder can't release the window before
+                unsafe { ndk_sys::ANativeWindow_acquire(window) };
+            }
+            window as *mut c_void
+        }
+        #[cfg(not(target_os = "android"))]
+        {
+            std::ptr::null_mut()
+        }
+    }
+
+    pub async fn next_frame_async(&mut self) -> Result<EncodedFrame> {
+        self.rx
+            .recv()
+            .await
+            .ok_or_else(|| anyhow!("encoder stream closed"))
+    }
+
+    /// Applied on the fly by MediaCodec, without waiting for a keyframe
+    pub fn set_bitrate(&mut self, bitrate_kbps: u32) -> Result<()> {
+        #[cfg(target_os = "android")]
+        {
+            let params = MediaFormat::new();
+            params.set_i32("video-bitrate", bitrate_kbps.saturating_mul(1000) as i32);
+            let status = unsafe {
+                ndk_sys::AMediaCodec_setParameters(self.codec.0.as_ptr(), params.as_ptr())
+            };
+            if status != ndk_sys::media_status_t::AMEDIA_OK {
+                return Err(anyhow!("MediaCodec setParameters failed: {:?}", status));
+            }
+            log::debug!("Encoder bitrate updated to {} kbps", bitrate_kbps);
+            Ok(())
+        }
+        #[cfg(not(target_os = "android"))]
+        {
+            let _ = bitrate_kbps;
+            Err(anyhow!("set_bitrate only supported on Android"))
+        }
+    }
+}
+
+impl Drop for AndroidScreenEncoder {
+    fn drop(&mut self) {
+        #[cfg(target_os = "android")]
+        {
+            let mut live = LIVE_INPUT_WINDOW.lock().unwrap();
+            if *live == self.input_window.ptr().as_ptr() as usize {
+                *live = 0;
+            }
+        }
+        self.running.store(false, Ordering::Relaxed);
+        if let Some(thread) = self.output_thread.take() {
+            let _ = thread.join();
+        }
+        #[cfg(target_os = "android")]
+        if let Err(e) = self.codec.0.stop() {
+            log::warn!("MediaCodec stop failed: {:?}", e);
+        }
+    }
+}
+
+#[cfg(target_os = "android")]
+fn encoder_format(mime: &str, config: &EncodeConfig) -> MediaFormat {
+    let format = MediaFormat::new();
+    format.set_str("mime", mime);
+    format.set_i32("width", config.resolution.width as i32);
+    format.set_i32("height", config.resolution.height as i32);
+    format.set_i32("color-format", COLOR_FORMAT_SURFACE);
+    format.set_i32("bitrate", config.bitrate_kbps.saturating_mul(1000) as i32);
+    format.set_i32("frame-rate", config.fps as i32);
+    format.set_f32(
+        "i-frame-interval",
+        config.keyframe_interval_ms as f32 / 1000.0,
+    );
+    let bitrate_mode = if config.tuning.low_latency {
+        BITRATE_MODE_CBR
+    } else {
+        BITRATE_MODE_VBR
+    };
+    format.set_i32("bitrate-mode", bitrate_mode);
+    // Real-time priority, no B frames and no frame held back for reordering
+    format.set_i32("priority", 0);
+    format.set_i32("max-bframes", 0);
+    format.set_i32("latency", 1);
+    format.set_i32("low-latency", 1);
+    if config.tuning.refresh == RefreshMode::IntraRefresh {
+        // In frames, a wave of intra coded rows over about a keyframe interval
+        let period = (config.keyframe_interval_ms as u64 * config.fps as u64 / 1000).max(1);
+        format.set_i32("intra-refresh-period", period as i32);
+    }
+    format.set_i64("repeat-previous-frame-after", REPEAT_PREVIOUS_FRAME_US);
+    // The display may compose faster than the stream rate, MediaCodec drops the extra frames
+    format.set_f32("max-fps-to-encoder", config.fps as f32);
+    format
+}
+
+/// Time base of the input surface timestamps, which MediaCodec passes through in microseconds
+#[cfg(target_os = "android")]
+fn monotonic_us() -> u64 {
+    let mut ts = libc::timespec {
+        tv_sec: 0,
+        tv_nsec: 0,
+    };
+    unsafe { libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut ts) };
+    ts.tv_sec as u64 * 1_000_000 + ts.tv_nsec as u64 / 1_000
+}
+
+#[cfg(target_os = "android")]
+fn drain_output(codec: &MediaCodec, running: &AtomicBool, tx: &mpsc::Sender<EncodedFrame>) {
+    // SPS, PPS (and VPS) of the stream, put in front of every keyframe so that a client can join
+    // or recover at any of them
+    let mut codec_config = Vec::new();
+    while running.load(Ordering::Relaxed) {
+        let buffer = match codec.dequeue_output_buffer(std::time::Duration::from_millis(10)) {
+            Ok(DequeuedOutputBufferInfoResult::Buffer(buffer)) => buffer,
+            Ok(DequeuedOutputBufferInfoResult::TryAgainLater) => continue,
+            Ok(DequeuedOutputBufferInfoResult::OutputFormatChanged) => {
+                log::info!("MediaCodec encoder output format changed");
+                continue;
+            }
+            Ok(DequeuedOutputBufferInfoResult::OutputBuffersChanged) => continue,
+            Err(e) => {
+                log::error!("Error dequeuing encoder output: {:?}", e);
+                break;
+            }
+        };
+
+        let flags = buffer.info().flags();
+        let timestamp_us = buffer.info().presentation_time_us() as u64;
+        let frame = if flags & BUFFER_FLAG_CODEC_CONFIG != 0 {
+            codec_config = buffer.buffer().to_vec();
+            None
+        } else if buffer.buffer().is_empty() {
+            None
+        } else {
+            let keyframe = flags & BUFFER_FLAG_KEY_FRAME != 0;
+            let mut data = Vec::with_capacity(
+                buffer.buffer().len() + if keyframe { codec_config.len() } else { 0 },
+            );
+            if keyframe {
+                data.extend_from_slice(&codec_config);
+            }
+            data.extend_from_slice(buffer.buffer());
+            Some(EncodedFrame {
+                timestamp_us,
+                keyframe,
+                data,
+                // From the composition of the frame to its bitstream, the surface doesn't tell
+                // capture and encode apart
+                capture_duration_us: 0,
+                encode_duration_us: monotonic_us().saturating_sub(timestamp_us) as u32,
+            })
+        };
+        if let Err(e) = codec.release_output_buffer(buffer, false) {
+            log::warn!("Failed to release encoder output: {:?}", e);
+        }
+        if flags & BUFFER_FLAG_END_OF_STREAM != 0 {
+            break;
+        }
+
+        if let Some(frame) = frame {
+            match tx.try_send(frame) {
+                Ok(()) => {}
+                Err(mpsc::error::TrySendError::Full(_)) => {
+                    log::debug!("Encoded frame dropped, the session is behind");
+                }
+                Err(mpsc::error::TrySendError::Closed(_)) => break,
+            }
+        }
+    }
+}
+
+unsafe impl Send for AndroidScreenEncoder {}
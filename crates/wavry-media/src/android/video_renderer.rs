@@ -1,7 +1,11 @@
 use crate::{Codec, DecodeConfig, Renderer};
 use anyhow::{anyhow, Result};
+use std::collections::VecDeque;
 use std::ffi::c_void;
 use std::ptr::NonNull;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::Instant;
 
 #[cfg(target_os = "android")]
 use ndk::media::media_codec::{
@@ -13,17 +17,110 @@ use ndk::native_window::NativeWindow;
 #[cfg(target_os = "android")]
 use ndk_sys::ANativeWindow;
 
+/// Frames queued to the decoder whose output hasn't come back yet. Older entries are frames the
+/// decoder dropped, the cap keeps a stalled decoder from growing the queue.
+const MAX_PENDING_FRAMES: usize = 32;
+/// Wait of the output thread for a decoded frame, bounds the time to notice the renderer stopping
+const OUTPUT_POLL: std::time::Duration = std::time::Duration::from_millis(10);
+
+/// Knobs of the MediaCodec decoder against its own buffering, which is most of the latency of the
+/// client on TV boxes. Keys a device doesn't know are ignored by MediaCodec.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct AndroidDecoderOptions {
+    /// `KEY_LOW_LATENCY`, honored by the decoders that advertise `FEATURE_LowLatency` (API 30+)
+    pub low_latency: bool,
+    /// Low-latency extension keys of the Qualcomm, Exynos, MediaTek and HiSilicon decoders, for
+    /// the devices that predate `KEY_LOW_LATENCY` or ignore it
+    pub vendor_low_latency: bool,
+    /// `KEY_PRIORITY` real-time, the decoder is scheduled ahead of best-effort sessions
+    pub realtime_priority: bool,
+    /// `KEY_OPERATING_RATE` in frames per second, 0 leaves it unset and `u16::MAX` asks for the
+    /// highest clocks
+    pub operating_rate: u32,
+}
+
+impl Default for AndroidDecoderOptions {
+    fn default() -> Self {
+        Self {
+            low_latency: true,
+            vendor_low_latency: true,
+            realtime_priority: true,
+            operating_rate: 0,
+        }
+    }
+}
+
+/// Decodes straight into the `ANativeWindow` of the app's `Surface`: MediaCodec renders the
+/// output buffers to the window with no copy through the CPU or another GL pass. An output thread
+/// waits on the decoder and releases each frame to the window as soon as it comes out, instead of
+/// the next `render` call picking it up.
 pub struct AndroidVideoRenderer {
     #[cfg(target_os = "android")]
-    codec: MediaCodec,
+    codec: Arc<SharedCodec>,
+    // Declared after the codec so the window reference is dropped last
     #[cfg(target_os = "android")]
-    _native_window: NonNull<ANativeWindow>,
+    _native_window: NativeWindow,
+    latencies: Arc<Mutex<FrameLatencies>>,
+    running: Arc<AtomicBool>,
+    output_thread: Option<std::thread::JoinHandle<()>>,
     #[cfg(not(target_os = "android"))]
     _dummy: (),
 }
 
+/// Shared by `render`, which queues the input, and the output thread.
+#[cfg(target_os = "android")]
+struct SharedCodec(MediaCodec);
+#[cfg(target_os = "android")]
+unsafe impl Send for SharedCodec {}
+#[cfg(target_os = "android")]
+unsafe impl Sync for SharedCodec {}
+
+#[derive(Default)]
+struct FrameLatencies {
+    /// Presentation timestamp and queue time of the frames inside the decoder
+    pending: VecDeque<(u64, Instant)>,
+    /// Queue to output latencies not yet taken by `take_decoder_latencies`
+    decoder_us: Vec<u64>,
+    /// Queue to release latencies not yet taken by `take_present_latencies`
+    present_us: Vec<u64>,
+}
+
+impl FrameLatencies {
+    fn on_queued(&mut self, timestamp_us: u64) {
+        if self.pending.len() == MAX_PENDING_FRAMES {
+            self.pending.pop_front();
+        }
+        self.pending.push_back((timestamp_us, Instant::now()));
+    }
+
+    fn on_released(&mut self, timestamp_us: u64, output_at: Instant) {
+        while let Some(&(pending_us, queued_at)) = self.pending.front() {
+            if pending_us > timestamp_us {
+                break;
+            }
+            self.pending.pop_front();
+            if pending_us == timestamp_us {
+                self.decoder_us
+                    .push(output_at.duration_since(queued_at).as_micros() as u64);
+                self.present_us.push(queued_at.elapsed().as_micros() as u64);
+                break;
+            }
+        }
+    }
+}
+
 impl AndroidVideoRenderer {
+    /// Takes ownership of the `native_window` reference, as returned by
+    /// `ANativeWindow_fromSurface`.
     pub fn new(config: DecodeConfig, native_window: *mut c_void) -> Result<Self> {
+        Self::with_options(config, native_window, AndroidDecoderOptions::default())
+    }
+
+    pub fn with_options(
+        config: DecodeConfig,
+        native_window: *mut c_void,
+        options: AndroidDecoderOptions,
+    ) -> Result<Self> {
         #[cfg(target_os = "android")]
         {
             if native_window.is_null() {
@@ -38,55 +135,169 @@ impl AndroidVideoRenderer {
             };
 
             log::info!(
-                "Initializing Android MediaCodec ({}) for {}x{}",
+                "Initializing Android MediaCodec ({}) for {}x{}, {:?}",
                 mime,
                 config.resolution.width,
-                config.resolution.height
+                config.resolution.height,
+                options
             );
 
-            let format = MediaFormat::new();
-            format.set_str("mime", mime);
-            format.set_i32("width", config.resolution.width as i32);
-            format.set_i32("height", config.resolution.height as i32);
-
-            // Optional: Set some extra parameters for low latency
-            format.set_i32("low-latency", 1);
-            format.set_i32("vendor.rtc-ext-dec-low-latency.enable", 1);
+            let format = decoder_format(mime, &config, &options);
 
             let codec = MediaCodec::from_decoder_type(mime)
                 .ok_or_else(|| anyhow!("Failed to create MediaCodec for {}", mime))?;
 
-            let nw_ref = unsafe { NativeWindow::from_ptr(nw) };
+            // Owns the reference from now on, even if the setup below fails
+            let window = unsafe { NativeWindow::from_ptr(nw) };
 
             codec
-                .configure(&format, Some(&nw_ref), MediaCodecDirection::Decoder)
+                .configure(&format, Some(&window), MediaCodecDirection::Decoder)
                 .map_err(|e| anyhow!("MediaCodec configure failed: {:?}", e))?;
 
             codec
                 .start()
                 .map_err(|e| anyhow!("MediaCodec start failed: {:?}", e))?;
 
+            let codec = Arc::new(SharedCodec(codec));
+            let latencies = Arc::new(Mutex::new(FrameLatencies {
+                pending: VecDeque::with_capacity(MAX_PENDING_FRAMES),
+                ..Default::default()
+            }));
+            let running = Arc::new(AtomicBool::new(true));
+            let output_thread = {
+                let codec = codec.clone();
+                let latencies = latencies.clone();
+                let running = running.clone();
+                std::thread::Builder::new()
+                    .name("wavry-decoder-out".into())
+                    .spawn(move || drain_output(&codec.0, &running, &latencies))?
+            };
+
             Ok(Self {
                 codec,
-                _native_window: nw,
+                _native_window: window,
+                latencies,
+                running,
+                output_thread: Some(output_thread),
             })
         }
         #[cfg(not(target_os = "android"))]
         {
             let _ = config;
             let _ = native_window;
+            let _ = options;
             Err(anyhow!("AndroidVideoRenderer only supported on Android"))
         }
     }
+
+    /// Time between queuing each frame to the decoder and releasing it to the window, for the
+    /// frames that came out since the previous call.
+    pub fn take_present_latencies(&mut self) -> Vec<u64> {
+        std::mem::take(&mut self.latencies.lock().unwrap().present_us)
+    }
+
+    /// Time between queuing each frame to the decoder and its output buffer being available, the
+    /// latency of the decoder itself on this device, for the frames since the previous call.
+    pub fn take_decoder_latencies(&mut self) -> Vec<u64> {
+        std::mem::take(&mut self.latencies.lock().unwrap().decoder_us)
+    }
+}
+
+#[cfg(target_os = "android")]
+fn decoder_format(
+    mime: &str,
+    config: &DecodeConfig,
+    options: &AndroidDecoderOptions,
+) -> MediaFormat {
+    let format = MediaFormat::new();
+    format.set_str("mime", mime);
+    format.set_i32("width", config.resolution.width as i32);
+    format.set_i32("height", config.resolution.height as i32);
+    if options.low_latency {
+        format.set_i32("low-latency", 1);
+    }
+    if options.vendor_low_latency {
+        // Qualcomm, the second key outputs in decode order without waiting for reordering
+        format.set_i32("vendor.qti-ext-dec-low-latency.enable", 1);
+        format.set_i32("vendor.qti-ext-dec-picture-order.enable", 1);
+        // Exynos
+        format.set_i32("vendor.rtc-ext-dec-low-latency.enable", 1);
+        // MediaTek
+        format.set_i32("vendor.low-latency.enable", 1);
+        // HiSilicon
+        format.set_i32(
+            "vendor.hisi-ext-low-latency-video-dec.video-scene-for-low-latency-req",
+            1,
+        );
+        format.set_i32(
+            "vendor.hisi-ext-low-latency-video-dec.video-scene-for-low-latency-rdy",
+            -1,
+        );
+    }
+    if options.realtime_priority {
+        format.set_i32("priority", 0);
+    }
+    if options.operating_rate > 0 {
+        format.set_i32(
+            "operating-rate",
+            options.operating_rate.min(i32::MAX as u32) as i32,
+        );
+    }
+    format
+}
+
+/// `System.nanoTime()` clock, the one of the release timestamps
+#[cfg(target_os = "android")]
+fn monotonic_ns() -> i64 {
+    let mut ts = libc::timespec {
+        tv_sec: 0,
+        tv_nsec: 0,
+    };
+    unsafe { libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut ts) };
+    ts.tv_sec as i64 * 1_000_000_000 + ts.tv_nsec as i64
+}
+
+#[cfg(target_os = "android")]
+fn drain_output(codec: &MediaCodec, running: &AtomicBool, latencies: &Mutex<FrameLatencies>) {
+    while running.load(Ordering::Relaxed) {
+        match codec.dequeue_output_buffer(OUTPUT_POLL) {
+            Ok(DequeuedOutputBufferInfoResult::Buffer(buffer)) => {
+                let output_at = Instant::now();
+                let released_us = buffer.info().presentation_time_us() as u64;
+                // Released for now rather than with render=true: when two frames come out within
+                // one vsync, the window shows the newer and drops the older instead of queuing it
+                if let Err(e) = codec.release_output_buffer_at_time(buffer, monotonic_ns()) {
+                    log::warn!("Failed to release output buffer: {:?}", e);
+                    continue;
+                }
+                latencies
+                    .lock()
+                    .unwrap()
+                    .on_released(released_us, output_at);
+            }
+            Ok(DequeuedOutputBufferInfoResult::TryAgainLater) => {}
+            Ok(DequeuedOutputBufferInfoResult::OutputFormatChanged) => {
+                log::info!("MediaCodec output format changed");
+            }
+            Ok(DequeuedOutputBufferInfoResult::OutputBuffersChanged) => {
+                log::info!("MediaCodec output buffers changed");
+            }
+            Err(e) => {
+                log::error!("Error dequeuing output buffer: {:?}", e);
+                break;
+            }
+        }
+    }
 }
 
 impl Renderer for AndroidVideoRenderer {
     fn render(&mut self, payload: &[u8], timestamp_us: u64) -> Result<()> {
         #[cfg(target_os = "android")]
         {
-            // 1. Queue input buffer
+            // The output thread releases the frame to the window
             match self
                 .codec
+                .0
                 .dequeue_input_buffer(std::time::Duration::from_millis(5))
             {
                 Ok(DequeuedInputBufferResult::Buffer(mut buffer)) => {
@@ -101,7 +312,10 @@ impl Renderer for AndroidVideoRenderer {
                         );
                     }
 
+                    // Before queuing, the frame may come out before this thread gets the lock back
+                    self.latencies.lock().unwrap().on_queued(timestamp_us);
                     self.codec
+                        .0
                         .queue_input_buffer(buffer, 0, len, timestamp_us, 0)
                         .map_err(|e| anyhow!("Failed to queue input buffer: {:?}", e))?;
                 }
@@ -113,33 +327,6 @@ impl Renderer for AndroidVideoRenderer {
                 }
             }
 
-            // 2. Dequeue output buffer and release to surface
-            // We do this in the same call for simplicity, but in a high-perf scenario
-            // we might want a separate thread or more frequent polling.
-            loop {
-                match self
-                    .codec
-                    .dequeue_output_buffer(std::time::Duration::from_micros(0))
-                {
-                    Ok(DequeuedOutputBufferInfoResult::Buffer(buffer)) => {
-                        self.codec
-                            .release_output_buffer(buffer, true)
-                            .map_err(|e| anyhow!("Failed to release output buffer: {:?}", e))?;
-                    }
-                    Ok(DequeuedOutputBufferInfoResult::TryAgainLater) => break,
-                    Ok(DequeuedOutputBufferInfoResult::OutputFormatChanged) => {
-                        log::info!("MediaCodec output format changed");
-                    }
-                    Ok(DequeuedOutputBufferInfoResult::OutputBuffersChanged) => {
-                        log::info!("MediaCodec output buffers changed");
-                    }
-                    Err(e) => {
-                        log::warn!("Error dequeuing output buffer: {:?}", e);
-                        break;
-                    }
-                }
-            }
-
             Ok(())
         }
         #[cfg(not(target_os = "android"))]
@@ -151,4 +338,13 @@ impl Renderer for AndroidVideoRenderer {
     }
 }
 
+impl Drop for AndroidVideoRenderer {
+    fn drop(&mut self) {
+        self.running.store(false, Ordering::Relaxed);
+        if let Some(thread) = self.output_thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
 unsafe impl Send for AndroidVideoRenderer {}
@@ -1,5 +1,7 @@
 #![allow(dead_code)]
 
+use std::sync::atomic::{AtomicU32, AtomicU64, Ordering};
+
 pub(crate) const OPUS_SAMPLE_RATE: u32 = 48_000;
 pub(crate) const OPUS_CHANNELS: usize = 2;
 pub(crate) const OPUS_FRAME_MS: u32 = 5;
@@ -16,4 +18,23 @@ pub(crate) fn opus_frame_duration_us() -> u64 {
     (OPUS_FRAME_SAMPLES as u64) * 1_000_000 / (OPUS_SAMPLE_RATE as u64)
 }
 
+/// Playback state of an audio output, updated from its device callback.
+#[derive(Debug, Default)]
+pub struct AudioOutputStats {
+    /// Decoded audio waiting in the jitter buffer
+    pub buffered_us: AtomicU32,
+    /// Buffer of the output stream on the device side
+    pub device_buffer_us: AtomicU32,
+    /// Device callbacks that found the jitter buffer empty
+    pub underruns: AtomicU64,
+}
+
+impl AudioOutputStats {
+    pub fn reset(&self) {
+        self.buffered_us.store(0, Ordering::Relaxed);
+        self.device_buffer_us.store(0, Ordering::Relaxed);
+        self.underruns.store(0, Ordering::Relaxed);
+    }
+}
+
 pub mod renderer;
@@ -90,7 +90,75 @@ pub struct Resolution {
     pub height: u16,
 }
 
-#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum EncoderPreset {
+    #[default]
+    Balanced,
+    /// Lowest encode time, at the cost of quality per bit
+    Speed,
+    Quality,
+}
+
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum RefreshMode {
+    /// Recovers from loss with a full IDR frame
+    #[default]
+    Idr,
+    /// Spreads the recovery over a wave of intra coded rows, without a bitrate spike
+    IntraRefresh,
+}
+
+/// Fixed foveated encoding, with the parameters of the foveated rendering of the VR streamer.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Foveation {
+    pub center_size_x: f32,
+    pub center_size_y: f32,
+    pub center_shift_x: f32,
+    pub center_shift_y: f32,
+    pub edge_ratio_x: f32,
+    pub edge_ratio_y: f32,
+}
+
+/// Latency and quality controls on top of the stream format. Encoders apply what their backend
+/// supports and ignore the rest.
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct EncoderTuning {
+    pub preset: EncoderPreset,
+    /// Real-time rate control that keeps every frame close to the average size
+    pub low_latency: bool,
+    /// Slices per frame, 0 lets the encoder choose
+    pub slices: u32,
+    pub refresh: RefreshMode,
+    pub chroma_444: bool,
+    pub foveation: Option<Foveation>,
+    /// Text and UI rather than camera or game content: the screen content tools of the codec
+    /// where the backend has them, otherwise coding settings that keep edges sharp
+    pub screen_content: bool,
+    /// Leave the cursor out of the captured image, the host sends it as metadata for the client
+    /// to draw
+    pub cursor_metadata: bool,
+}
+
+/// Cursor image in pixels, RGBA8 with straight alpha.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct CursorBitmap {
+    pub width: u32,
+    pub height: u32,
+    pub hotspot_x: u32,
+    pub hotspot_y: u32,
+    pub rgba: Vec<u8>,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct CursorSample {
+    /// False while the cursor is hidden or on another display
+    pub visible: bool,
+    /// Normalized to the captured display, 0..1
+    pub x: f32,
+    pub y: f32,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq)]
 pub struct EncodeConfig {
     pub codec: Codec,
     pub resolution: Resolution,
@@ -100,6 +168,7 @@ pub struct EncodeConfig {
     pub display_id: Option<u32>,
     pub enable_10bit: bool,
     pub enable_hdr: bool,
+    pub tuning: EncoderTuning,
 }
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
@@ -244,7 +313,10 @@ impl CapabilityProbe for NullProbe {
 pub mod android;
 
 #[cfg(target_os = "android")]
-pub use android::{AndroidAudioRenderer, AndroidProbe, AndroidVideoRenderer};
+pub use android::{
+    AndroidAudioRenderer, AndroidDecoderOptions, AndroidProbe, AndroidScreenEncoder,
+    AndroidVideoRenderer,
+};
 
 pub mod buffer_pool;
 pub use buffer_pool::{
@@ -264,6 +336,7 @@ pub use recorder::{Quality, RecorderConfig, VideoRecorder};
 mod linux;
 
 mod audio;
+pub use audio::AudioOutputStats;
 
 #[cfg(target_os = "linux")]
 pub use linux::{
@@ -282,7 +355,12 @@ mod mac_video_renderer;
 #[cfg(target_os = "macos")]
 pub use mac_screen_encoder::{MacProbe, MacScreenEncoder};
 #[cfg(target_os = "macos")]
-pub use mac_video_renderer::MacVideoRenderer;
+pub use mac_video_renderer::{host_time_us, DecodedFrame, FrameSink, MacVideoRenderer};
+
+#[cfg(target_os = "macos")]
+mod mac_cursor;
+#[cfg(target_os = "macos")]
+pub use mac_cursor::MacCursorSampler;
 
 #[cfg(target_os = "macos")]
 mod mac_input_injector;
@@ -674,6 +674,7 @@ fn configure_low_latency_encoder(
     bitrate_kbps: u32,
     keyframe_interval_frames: u32,
     enable_10bit: bool,
+    screen_content: bool,
 ) -> Result<()> {
     fn set_if_exists<V: ToValue>(encoder: &gst::Element, name: &str, value: V) {
         if encoder.has_property(name, None) {
@@ -708,9 +709,38 @@ fn configure_low_latency_encoder(
         set_if_exists(encoder, "profile", "main10");
     }
 
+    if screen_content {
+        configure_screen_content(encoder, encoder_name);
+    }
+
     Ok(())
 }
 
+/// Screen content coding of the software encoders. SVT-AV1 has the palette and intra block copy
+/// tools of AV1, x264 and x265 keep text sharp by lighter deblocking and no psychovisual tuning.
+/// The hardware elements expose no such controls.
+fn configure_screen_content(encoder: &gst::Element, encoder_name: &str) {
+    let (property, options) = if encoder_name.contains("x264") {
+        ("option-string", "deblock=-2,-2:psy=0")
+    } else if encoder_name.contains("x265") {
+        ("option-string", "deblock=-2,-2:psy-rd=0:rdoq-level=0")
+    } else if encoder_name.contains("svtav1") {
+        ("parameters-string", "scm=1")
+    } else {
+        log::info!("{} has no screen content settings", encoder_name);
+        return;
+    };
+    if encoder.has_property(property, None) {
+        encoder.set_property(property, options);
+    } else {
+        log::info!(
+            "{} has no {} for screen content settings",
+            encoder_name,
+            property
+        );
+    }
+}
+
 pub struct PipewireEncoder {
     _fd: Option<OwnedFd>,
     #[allow(dead_code)]
@@ -849,6 +879,7 @@ impl PipewireEncoder {
             config.bitrate_kbps,
             keyframe_interval_frames,
             config.enable_10bit,
+            config.tuning.screen_content,
         )
         .map_err(|e| MediaError::GStreamerError(e.to_string()))?;
 
@@ -1821,6 +1852,7 @@ Sink #4
             display_id: None,
             enable_10bit: false,
             enable_hdr: false,
+            tuning: crate::EncoderTuning::default(),
         };
 
         let mut encoder = match super::PipewireEncoder::new(config).await {
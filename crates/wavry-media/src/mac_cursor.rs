@@ -0,0 +1,202 @@
+//! Desktop cursor sampling for streaming the cursor as metadata: the capture hides the cursor,
+//! and its position and image are sent beside the video for the client to draw.
+
+use crate::{CursorBitmap, CursorSample};
+use objc2::msg_send;
+use objc2::rc::{autoreleasepool, Retained};
+use objc2::runtime::{AnyClass, AnyObject};
+use objc2_core_graphics::CGImage;
+use objc2_foundation::{NSPoint, NSRect, NSSize};
+use std::ffi::c_void;
+use std::ptr;
+
+/// Largest cursor edge sent, matches rift_core::MAX_CURSOR_DIMENSION.
+const MAX_CURSOR_EDGE: usize = 256;
+
+// kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big, the RGBA layout CoreGraphics draws
+const K_CG_BITMAP_RGBA_PREMULTIPLIED: u32 = 1 | (4 << 12);
+
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+struct CGPoint {
+    x: f64,
+    y: f64,
+}
+
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+struct CGSize {
+    width: f64,
+    height: f64,
+}
+
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+struct CGRect {
+    origin: CGPoint,
+    size: CGSize,
+}
+
+// NSCursor
+#[link(name = "AppKit", kind = "framework")]
+extern "C" {}
+
+#[link(name = "CoreGraphics", kind = "framework")]
+extern "C" {
+    fn CGMainDisplayID() -> u32;
+    fn CGDisplayBounds(display: u32) -> CGRect;
+    fn CGCursorIsVisible() -> i32;
+    fn CGEventCreate(source: *const c_void) -> *mut c_void;
+    fn CGEventGetLocation(event: *const c_void) -> CGPoint;
+    fn CGImageGetWidth(image: *const c_void) -> usize;
+    fn CGImageGetHeight(image: *const c_void) -> usize;
+    fn CGColorSpaceCreateDeviceRGB() -> *mut c_void;
+    fn CGColorSpaceRelease(space: *mut c_void);
+    fn CGBitmapContextCreate(
+        data: *mut c_void,
+        width: usize,
+        height: usize,
+        bits_per_component: usize,
+        bytes_per_row: usize,
+        space: *const c_void,
+        bitmap_info: u32,
+    ) -> *mut c_void;
+    fn CGContextDrawImage(context: *mut c_void, rect: CGRect, image: *const c_void);
+    fn CGContextRelease(context: *mut c_void);
+}
+
+#[link(name = "CoreFoundation", kind = "framework")]
+extern "C" {
+    fn CFRelease(cf: *const c_void);
+}
+
+pub struct MacCursorSampler {
+    display_id: u32,
+    last_shape: Option<CursorBitmap>,
+}
+
+impl MacCursorSampler {
+    /// `display_id` is the captured display, the main display when unset.
+    pub fn new(display_id: Option<u32>) -> Self {
+        Self {
+            display_id: display_id.unwrap_or_else(|| unsafe { CGMainDisplayID() }),
+            last_shape: None,
+        }
+    }
+
+    pub fn position(&self) -> CursorSample {
+        unsafe {
+            let bounds = CGDisplayBounds(self.display_id);
+            let event = CGEventCreate(ptr::null());
+            if event.is_null() || bounds.size.width <= 0.0 || bounds.size.height <= 0.0 {
+                if !event.is_null() {
+                    CFRelease(event);
+                }
+                return CursorSample {
+                    visible: false,
+                    x: 0.0,
+                    y: 0.0,
+                };
+            }
+            let location = CGEventGetLocation(event);
+            CFRelease(event);
+
+            let x = (location.x - bounds.origin.x) / bounds.size.width;
+            let y = (location.y - bounds.origin.y) / bounds.size.height;
+            let on_display = (0.0..1.0).contains(&x) && (0.0..1.0).contains(&y);
+            CursorSample {
+                visible: on_display && CGCursorIsVisible() != 0,
+                x: x.clamp(0.0, 1.0) as f32,
+                y: y.clamp(0.0, 1.0) as f32,
+            }
+        }
+    }
+
+    /// Rasterizes the current system cursor, returned only when it differs from the last one.
+    /// NSCursor hands out a new object per call, so the pixels are what tells shapes apart; a
+    /// cursor is small enough for that to be cheap at the frame rate.
+    pub fn shape_changed(&mut self) -> Option<&CursorBitmap> {
+        let shape = autoreleasepool(|_| unsafe { current_cursor_bitmap() })?;
+        if self.last_shape.as_ref() == Some(&shape) {
+            return None;
+        }
+        self.last_shape = Some(shape);
+        self.last_shape.as_ref()
+    }
+}
+
+unsafe fn current_cursor_bitmap() -> Option<CursorBitmap> {
+    let class = AnyClass::get(c"NSCursor")?;
+    let cursor: Option<Retained<AnyObject>> = msg_send![class, currentSystemCursor];
+    let cursor = cursor?;
+    let image: Option<Retained<AnyObject>> = msg_send![&*cursor, image];
+    let image = image?;
+    let hotspot: NSPoint = msg_send![&*cursor, hotSpot];
+    let size: NSSize = msg_send![&*image, size];
+    // Best representation for the main screen, twice the point size on Retina
+    let cg_image: *mut CGImage = msg_send![
+        &*image,
+        CGImageForProposedRect: ptr::null_mut::<NSRect>(),
+        context: ptr::null::<AnyObject>(),
+        hints: ptr::null::<AnyObject>()
+    ];
+    if cg_image.is_null() || size.width <= 0.0 || size.height <= 0.0 {
+        return None;
+    }
+    let cg_image = cg_image as *const c_void;
+
+    let source_width = CGImageGetWidth(cg_image);
+    let source_height = CGImageGetHeight(cg_image);
+    if source_width == 0 || source_height == 0 {
+        return None;
+    }
+    let scale = (MAX_CURSOR_EDGE as f64 / source_width.max(source_height) as f64).min(1.0);
+    let width = ((source_width as f64 * scale).round() as usize).max(1);
+    let height = ((source_height as f64 * scale).round() as usize).max(1);
+
+    let mut rgba = vec![0u8; width * height * 4];
+    let space = CGColorSpaceCreateDeviceRGB();
+    let context = CGBitmapContextCreate(
+        rgba.as_mut_ptr() as *mut c_void,
+        width,
+        height,
+        8,
+        width * 4,
+        space,
+        K_CG_BITMAP_RGBA_PREMULTIPLIED,
+    );
+    CGColorSpaceRelease(space);
+    if context.is_null() {
+        return None;
+    }
+    let rect = CGRect {
+        origin: CGPoint { x: 0.0, y: 0.0 },
+        size: CGSize {
+            width: width as f64,
+            height: height as f64,
+        },
+    };
+    CGContextDrawImage(context, rect, cg_image);
+    CGContextRelease(context);
+
+    // Bitmap contexts only draw premultiplied alpha
+    for pixel in rgba.chunks_exact_mut(4) {
+        let alpha = pixel[3] as u32;
+        if alpha != 0 && alpha != 255 {
+            for channel in &mut pixel[..3] {
+                *channel = ((*channel as u32 * 255 + alpha / 2) / alpha).min(255) as u8;
+            }
+        }
+    }
+
+    // The hotspot is in points, the image in pixels
+    let pixels_per_point_x = width as f64 / size.width;
+    let pixels_per_point_y = height as f64 / size.height;
+    Some(CursorBitmap {
+        width: width as u32,
+        height: height as u32,
+        hotspot_x: ((hotspot.x * pixels_per_point_x) as u32).min(width as u32 - 1),
+        hotspot_y: ((hotspot.y * pixels_per_point_y) as u32).min(height as u32 - 1),
+        rgba,
+    })
+}
@@ -8,6 +8,8 @@ use crate::{Codec, EncodeConfig, EncodedFrame};
 use anyhow::{anyhow, Result};
 use tokio::sync::{mpsc, oneshot};
 
+#[cfg(target_os = "macos")]
+use crate::{EncoderPreset, RefreshMode};
 #[cfg(target_os = "macos")]
 use block2::RcBlock;
 #[cfg(target_os = "macos")]
@@ -64,6 +66,10 @@ extern "C" {
     static kVTCompressionPropertyKey_ColorPrimaries: *const c_void;
     static kVTCompressionPropertyKey_TransferFunction: *const c_void;
     static kVTCompressionPropertyKey_YCbCrMatrix: *const c_void;
+    static kVTCompressionPropertyKey_PrioritizeEncodingSpeedOverQuality: *const c_void;
+
+    // Encoder specification keys
+    static kVTVideoEncoderSpecification_EnableLowLatencyRateControl: *const c_void;
 
     // Profiles
     static kVTProfileLevel_HEVC_Main10_AutoLevel: *const c_void;
@@ -122,6 +128,16 @@ extern "C" {
     fn CFArrayGetCount(array: *const c_void) -> isize;
     fn CFArrayGetValueAtIndex(array: *const c_void, idx: isize) -> *const c_void;
     fn CFDictionaryGetValue(dict: *const c_void, key: *const c_void) -> *const c_void;
+    fn CFDictionaryCreate(
+        allocator: *const c_void,
+        keys: *const *const c_void,
+        values: *const *const c_void,
+        num_values: isize,
+        key_callbacks: *const c_void,
+        value_callbacks: *const c_void,
+    ) -> *const c_void;
+    static kCFTypeDictionaryKeyCallBacks: u8;
+    static kCFTypeDictionaryValueCallBacks: u8;
     fn CFBooleanGetValue(boolean: *const c_void) -> bool;
 
     // Dictionary keys for sample buffer attachments
@@ -398,22 +414,58 @@ fn create_compression_session(
     });
     let ctx_ptr = Box::into_raw(ctx);
 
+    let tuning = config.tuning;
+    if tuning.slices != 0
+        || tuning.refresh == RefreshMode::IntraRefresh
+        || tuning.chroma_444
+        || tuning.foveation.is_some()
+        || tuning.screen_content
+    {
+        log::info!(
+            "VideoToolbox ignores slices, intra refresh, 4:4:4, foveation and screen content, \
+             requested {:?}",
+            tuning
+        );
+    }
+
+    // Low latency rate control has to be chosen when the session is created
+    let encoder_specification = if tuning.low_latency {
+        unsafe {
+            let keys = [kVTVideoEncoderSpecification_EnableLowLatencyRateControl];
+            let values = [kCFBooleanTrue];
+            CFDictionaryCreate(
+                std::ptr::null(),
+                keys.as_ptr(),
+                values.as_ptr(),
+                1,
+                &kCFTypeDictionaryKeyCallBacks as *const u8 as *const c_void,
+                &kCFTypeDictionaryValueCallBacks as *const u8 as *const c_void,
+            )
+        }
+    } else {
+        std::ptr::null()
+    };
+
     // Create compression session
     let mut session_ptr: *mut VTCompressionSession = std::ptr::null_mut();
 
     let status = unsafe {
-        VTCompressionSession::create(
+        let status = VTCompressionSession::create(
             None, // allocator
             config.resolution.width as i32,
             config.resolution.height as i32,
             cm_codec_type(config.codec),
-            None, // encoderSpecification
+            (encoder_specification as *const objc2_core_foundation::CFDictionary).as_ref(),
             None, // sourceImageBufferAttributes
             None, // compressedDataAllocator
             Some(compression_callback),
             ctx_ptr as *mut c_void,
             NonNull::new(&mut session_ptr).unwrap(),
-        )
+        );
+        if !encoder_specification.is_null() {
+            CFRelease(encoder_specification);
+        }
+        status
     };
 
     if status != 0 || session_ptr.is_null() {
@@ -499,6 +551,18 @@ fn create_compression_session(
             // which vary by macOS version.
         }
 
+        if tuning.preset != EncoderPreset::Balanced {
+            VTSessionSetProperty(
+                session,
+                kVTCompressionPropertyKey_PrioritizeEncodingSpeedOverQuality,
+                if tuning.preset == EncoderPreset::Speed {
+                    kCFBooleanTrue
+                } else {
+                    kCFBooleanFalse
+                },
+            );
+        }
+
         // Prioritize performance over battery
         VTSessionSetProperty(
             session,
@@ -672,7 +736,8 @@ impl MacScreenEncoder {
                 stream_config.setPixelFormat(0x42475241); // 'BGRA'
             }
 
-            stream_config.setShowsCursor(true);
+            // Without the cursor, moving it over a static desktop produces no frames at all
+            stream_config.setShowsCursor(!config.tuning.cursor_metadata);
             stream_config.setMinimumFrameInterval(CMTime {
                 value: 1,
                 timescale: config.fps as i32,
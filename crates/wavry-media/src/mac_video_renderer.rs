@@ -1,6 +1,7 @@
 //! macOS Video Renderer using VideoToolbox VTDecompressionSession
 //!
-//! Decodes H.264/HEVC video and displays it via AVSampleBufferDisplayLayer.
+//! Decodes H.264/HEVC video and displays it via AVSampleBufferDisplayLayer, or hands the decoded
+//! IOSurface backed pixel buffers to a frame sink so the app presents them on its own vsync.
 
 #![allow(dead_code, unused_imports, unused_variables, deprecated)]
 use anyhow::{anyhow, Result};
@@ -95,6 +96,17 @@ extern "C" {
     ) -> OSStatus;
 
     fn CFRelease(cf: *const c_void);
+    fn CFDictionaryCreate(
+        allocator: *const c_void,
+        keys: *const *const c_void,
+        values: *const *const c_void,
+        num_values: isize,
+        key_callbacks: *const c_void,
+        value_callbacks: *const c_void,
+    ) -> *const c_void;
+    static kCFTypeDictionaryKeyCallBacks: u8;
+    static kCFTypeDictionaryValueCallBacks: u8;
+    static kCFBooleanTrue: *const c_void;
     fn VTDecompressionSessionInvalidate(session: *mut VTDecompressionSession);
     fn VTDecompressionSessionDecodeFrame(
         session: *mut VTDecompressionSession,
@@ -105,13 +117,46 @@ extern "C" {
     ) -> OSStatus;
 }
 
+#[link(name = "CoreVideo", kind = "framework")]
+extern "C" {
+    static kCVPixelBufferIOSurfacePropertiesKey: *const c_void;
+    static kCVPixelBufferMetalCompatibilityKey: *const c_void;
+    fn CVPixelBufferGetWidth(pixel_buffer: *mut CVBuffer) -> usize;
+    fn CVPixelBufferGetHeight(pixel_buffer: *mut CVBuffer) -> usize;
+}
+
+#[link(name = "QuartzCore", kind = "framework")]
+extern "C" {
+    fn CACurrentMediaTime() -> f64;
+}
+
+/// Microseconds on the clock of `CACurrentMediaTime`, which display links report in too.
+pub fn host_time_us() -> u64 {
+    unsafe { (CACurrentMediaTime() * 1_000_000.0) as u64 }
+}
+
+/// A decoded frame, only valid during the call of the frame sink.
+pub struct DecodedFrame {
+    /// `CVPixelBufferRef` backed by an IOSurface, retain it to keep it past the call
+    pub pixel_buffer: *mut c_void,
+    pub pts_us: u64,
+    /// `host_time_us` when the decoder output the frame
+    pub decoded_host_us: u64,
+    pub width: u32,
+    pub height: u32,
+}
+
+/// Called on the decoder thread for every frame, must not block.
+pub type FrameSink = Box<dyn Fn(&DecodedFrame) + Send + Sync>;
+
 // Decode flags
 const K_VT_DECODE_FRAME_ENABLE_ASYNC_DECOMPRESSION: u32 = 1 << 0;
 const K_VT_DECODE_FRAME_DO_NOT_OUTPUT_FRAME: u32 = 1 << 1;
 
 /// Struct to pass context to the decompression callback
 struct DecoderContext {
-    layer: Retained<AnyObject>,
+    layer: Option<Retained<AnyObject>>,
+    sink: Option<FrameSink>,
 }
 
 pub struct MacVideoRenderer {
@@ -133,7 +178,7 @@ unsafe impl Sync for MacVideoRenderer {}
 /// Decompression output callback - receives decoded frames
 unsafe extern "C-unwind" fn decompression_callback(
     decompression_output_ref_con: *mut c_void,
-    _source_frame_ref_con: *mut c_void,
+    source_frame_ref_con: *mut c_void,
     status: OSStatus,
     _info_flags: VTDecodeInfoFlags,
     image_buffer: *mut CVBuffer,
@@ -155,6 +200,21 @@ unsafe extern "C-unwind" fn decompression_callback(
     }
     let ctx = &*ctx_ptr;
 
+    if let Some(sink) = ctx.sink.as_ref() {
+        sink(&DecodedFrame {
+            pixel_buffer: image_buffer as *mut c_void,
+            // decode_frame passes the timestamp of the stream as the frame ref con
+            pts_us: source_frame_ref_con as u64,
+            decoded_host_us: host_time_us(),
+            width: CVPixelBufferGetWidth(image_buffer) as u32,
+            height: CVPixelBufferGetHeight(image_buffer) as u32,
+        });
+        return;
+    }
+    let Some(layer) = ctx.layer.as_ref() else {
+        return;
+    };
+
     // Enqueue the decoded image buffer to AVSampleBufferDisplayLayer
     // The layer expects CMSampleBuffer, but for video display we can use a simpler path:
     // Just enqueue the CVPixelBuffer directly using the layer's enqueuePixelBuffer method
@@ -211,7 +271,7 @@ unsafe extern "C-unwind" fn decompression_callback(
         unsafe {
             // Check if layer responds to enqueueSampleBuffer:
             // For now assume it is AVSampleBufferDisplayLayer
-            let _: () = msg_send![&ctx.layer, enqueueSampleBuffer: sample_buffer];
+            let _: () = msg_send![layer, enqueueSampleBuffer: sample_buffer];
             CFRelease(sample_buffer as *const c_void);
         }
     } else {
@@ -231,19 +291,32 @@ impl MacVideoRenderer {
         let layer = unsafe { Retained::retain(layer_ptr as *mut AnyObject) }
             .ok_or(anyhow!("Failed to retain layer"))?;
 
-        let context = Box::new(DecoderContext { layer });
-        let context_ptr = Box::into_raw(context);
-
         info!("MacVideoRenderer created");
+        Ok(Self::with_context(DecoderContext {
+            layer: Some(layer),
+            sink: None,
+        }))
+    }
+
+    /// Decodes without a layer, every frame goes to `sink` for the app to present.
+    pub fn with_frame_sink(sink: FrameSink) -> Self {
+        info!("MacVideoRenderer created with a frame sink");
+        Self::with_context(DecoderContext {
+            layer: None,
+            sink: Some(sink),
+        })
+    }
 
-        Ok(Self {
+    fn with_context(context: DecoderContext) -> Self {
+        let context_ptr = Box::into_raw(Box::new(context));
+        Self {
             session: std::ptr::null_mut(),
             format_desc: std::ptr::null_mut(),
             context: context_ptr,
             sps: None,
             pps: None,
             frames_decoded: 0,
-        })
+        }
     }
 
     /// Parse AVCC/length-prefixed NAL units from the payload
@@ -350,17 +423,52 @@ impl MacVideoRenderer {
             decompressionOutputRefCon: self.context as *mut c_void,
         };
 
+        // IOSurface backed and Metal compatible, so the layer or the app uses them without a copy
+        let attributes = unsafe {
+            let surface_properties = CFDictionaryCreate(
+                std::ptr::null(),
+                std::ptr::null(),
+                std::ptr::null(),
+                0,
+                &kCFTypeDictionaryKeyCallBacks as *const u8 as *const c_void,
+                &kCFTypeDictionaryValueCallBacks as *const u8 as *const c_void,
+            );
+            let keys = [
+                kCVPixelBufferIOSurfacePropertiesKey,
+                kCVPixelBufferMetalCompatibilityKey,
+            ];
+            let values = [surface_properties, kCFBooleanTrue];
+            let attributes = CFDictionaryCreate(
+                std::ptr::null(),
+                keys.as_ptr(),
+                values.as_ptr(),
+                keys.len() as isize,
+                &kCFTypeDictionaryKeyCallBacks as *const u8 as *const c_void,
+                &kCFTypeDictionaryValueCallBacks as *const u8 as *const c_void,
+            );
+            if !surface_properties.is_null() {
+                CFRelease(surface_properties);
+            }
+            attributes
+        };
+
         let mut session: *mut VTDecompressionSession = std::ptr::null_mut();
 
         let status = unsafe {
-            VTDecompressionSessionCreate(
+            let destination_attributes =
+                (attributes as *const objc2_core_foundation::CFDictionary).as_ref();
+            let status = VTDecompressionSessionCreate(
                 None,                                // allocator
                 &*(self.format_desc as *const _),    // format description
                 None,                                // decoder specification
-                None,                                // destination image buffer attributes
+                destination_attributes,              // destination image buffer attributes
                 &record as *const _,                 // output callback record
                 NonNull::new(&mut session).unwrap(), // session out
-            )
+            );
+            if !attributes.is_null() {
+                CFRelease(attributes);
+            }
+            status
         };
 
         if status != 0 {
@@ -465,7 +573,7 @@ impl MacVideoRenderer {
                 self.session,
                 sample_buffer,
                 K_VT_DECODE_FRAME_ENABLE_ASYNC_DECOMPRESSION,
-                std::ptr::null_mut(), // source frame ref con
+                timestamp_us as *mut c_void, // source frame ref con
                 &mut info_flags,
             )
         };
@@ -231,6 +231,18 @@ impl WindowsEncoder {
 
             let transform: IMFTransform = activate.ActivateObject()?;
 
+            if config.tuning.screen_content {
+                // The vendor MFTs switch to their screen content tuning in the display remoting
+                // scenario, which has to be set before the media types
+                let scenario = VARIANT::from(eAVScenarioInfo_DisplayRemoting.0 as u32);
+                if let Err(err) = transform
+                    .cast::<ICodecAPI>()
+                    .and_then(|codec_api| codec_api.SetValue(&CODECAPI_AVScenarioInfo, &scenario))
+                {
+                    log::info!("Encoder ignores the display remoting scenario: {}", err);
+                }
+            }
+
             let output_media_type: IMFMediaType = MFCreateMediaType()?;
             output_media_type.SetGUID(&MF_MT_MAJOR_TYPE, &MFMediaType_Video)?;
             output_media_type.SetGUID(&MF_MT_SUBTYPE, &output_subtype)?;
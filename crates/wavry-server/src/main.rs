@@ -1134,6 +1134,7 @@ mod host {
             display_id: args.display_id,
             enable_10bit: false,
             enable_hdr: false,
+            tuning: wavry_media::EncoderTuning::default(),
         };
 
         let mut recorder = if args.record {
@@ -1,7 +1,73 @@
 // Derived from ALVR (MIT)
 // Original copyright preserved
 
-use std::{env, path::PathBuf};
+use std::{
+    env,
+    path::{Path, PathBuf},
+    process::Command,
+};
+
+// The permutations of the Windows pixel shaders, embedded by graphics.rs: the source, the checked
+// in .cso, the output name and the defines
+const SHADER_PERMUTATIONS: &[(&str, &str, &str, &[&str])] = &[
+    (
+        "ColorCorrectionPixelShader.hlsl",
+        "ColorCorrectionPixelShader.cso",
+        "ColorCorrection.cso",
+        &[],
+    ),
+    (
+        "ColorCorrectionPixelShader.hlsl",
+        "ColorCorrectionPixelShader.cso",
+        "ColorCorrectionUnsharpened.cso",
+        &["SHARPENING=0"],
+    ),
+];
+
+// fxc from the FXC variable or the newest Windows 10 SDK
+fn find_fxc() -> Option<PathBuf> {
+    println!("cargo:rerun-if-env-changed=FXC");
+    if let Ok(path) = env::var("FXC") {
+        return Some(PathBuf::from(path));
+    }
+
+    let sdk_bin = Path::new(r"C:\Program Files (x86)\Windows Kits\10\bin");
+    std::fs::read_dir(sdk_bin)
+        .ok()?
+        .filter_map(|maybe_entry| maybe_entry.ok())
+        .map(|entry| entry.path().join("x64").join("fxc.exe"))
+        .filter(|path| path.exists())
+        .max()
+}
+
+// Only the Windows driver loads the D3D shaders, the other platforms embed a copy of the checked
+// in .cso to keep graphics.rs the same
+fn build_shader_permutations(out_dir: &Path) {
+    let fxc = if cfg!(windows) {
+        Some(find_fxc().expect("fxc not found, install the Windows 10 SDK or set FXC"))
+    } else {
+        None
+    };
+
+    let shader_dir = Path::new("cpp/alvr_server/shader");
+    for (source, fallback, name, defines) in SHADER_PERMUTATIONS {
+        let output = out_dir.join(name);
+        if let Some(fxc) = &fxc {
+            let mut command = Command::new(fxc);
+            command.args(["/nologo", "/T", "ps_5_0", "/E", "main", "/O3"]);
+            for define in *defines {
+                command.arg("/D").arg(define);
+            }
+            command.arg("/Fo").arg(&output).arg(shader_dir.join(source));
+            assert!(
+                command.status().unwrap().success(),
+                "Failed to compile {name}"
+            );
+        } else {
+            std::fs::copy(Path::new("cpp/platform/win32").join(fallback), &output).unwrap();
+        }
+    }
+}
 
 fn get_ffmpeg_path() -> PathBuf {
     let ffmpeg_path = alvr_filesystem::deps_dir()
@@ -91,6 +157,37 @@ fn main() {
 
         assert!(ffmpeg_path.join("include").exists());
         build.include(ffmpeg_path.join("include"));
+
+        // The FFmpeg DLLs are delay loaded, only the software encoder maps them. It loads them
+        // up front to fail with an error instead of a structured exception on the first call.
+        #[cfg(windows)]
+        {
+            let dlls = std::fs::read_dir(ffmpeg_path.join("bin"))
+                .unwrap()
+                .filter_map(|maybe_entry| maybe_entry.ok())
+                .map(|entry| entry.file_name().to_string_lossy().to_string())
+                .filter(|name| {
+                    name.ends_with(".dll")
+                        && ["avutil", "avfilter", "avcodec", "swscale"]
+                            .iter()
+                            .any(|lib| name.starts_with(&format!("{lib}-")))
+                })
+                .collect::<Vec<_>>();
+
+            if !dlls.is_empty() {
+                for dll in &dlls {
+                    println!("cargo:rustc-cdylib-link-arg=/DELAYLOAD:{dll}");
+                }
+                println!("cargo:rustc-link-lib=delayimp");
+
+                let dll_list = dlls
+                    .iter()
+                    .map(|dll| format!("\"{dll}\""))
+                    .collect::<Vec<_>>()
+                    .join(",");
+                build.define("ALVR_FFMPEG_DLLS", dll_list.as_str());
+            }
+        }
     }
 
     #[cfg(all(target_os = "linux", feature = "gpl"))]
@@ -104,6 +201,9 @@ fn main() {
     #[cfg(feature = "gpl")]
     build.define("ALVR_GPL", None);
 
+    #[cfg(feature = "trace-events")]
+    build.define("ALVR_TRACE_EVENTS", None);
+
     #[cfg(target_os = "windows")]
     {
         let vpl_path = alvr_filesystem::deps_dir().join("windows/libvpl/alvr_build");
@@ -120,8 +220,16 @@ fn main() {
         println!("cargo:rustc-link-lib=vpl");
     }
 
+    #[cfg(target_os = "linux")]
+    {
+        let libdrm = pkg_config::Config::new().probe("libdrm").unwrap();
+        build.includes(libdrm.include_paths);
+    }
+
     build.compile("bindings");
 
+    build_shader_permutations(&out_dir);
+
     #[cfg(all(target_os = "linux", feature = "gpl"))]
     {
         let x264_path = get_linux_x264_path();
@@ -31,6 +31,12 @@ enum ALVR_ENTROPY_CODING {
 
 enum ALVR_ENCODER_QUALITY_PRESET { ALVR_QUALITY = 0, ALVR_BALANCED = 1, ALVR_SPEED = 2 };
 
+enum ALVR_POSE_PREDICTION_MODEL {
+    ALVR_POSE_PREDICTION_CONSTANT_VELOCITY = 0,
+    ALVR_POSE_PREDICTION_CONSTANT_ACCELERATION = 1,
+    ALVR_POSE_PREDICTION_FILTERED = 2,
+};
+
 enum ALVR_INPUT {
     ALVR_INPUT_FINGER_INDEX,
     ALVR_INPUT_FINGER_MIDDLE,
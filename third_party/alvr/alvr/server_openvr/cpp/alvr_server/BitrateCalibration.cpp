@@ -0,0 +1,156 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "BitrateCalibration.h"
+#include "DriverMetrics.h"
+#include "Instance.h"
+#include "Logger.h"
+#include "Settings.h"
+#include "bindings.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace {
+const float MIN_FACTOR = 0.5f;
+const float MAX_FACTOR = 2.5f;
+// Fraction of the error corrected per window, the measurement is noisy with scene changes
+const float GAIN = 0.5f;
+// Errors within this are left alone, every change reconfigures the encoder
+const float MIN_ERROR = 0.03f;
+// Below this fraction of the target the encoder is starved by simple content, not biased
+const float MIN_MEASURED_RATIO = 0.4f;
+
+uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+// One line "<key> <factor>" per encoder, GPU and driver seen
+std::filesystem::path cachePath() {
+    return std::filesystem::path(g_sessionPath).replace_filename("bitrate_calibration.txt");
+}
+}
+
+BitrateCalibration::BitrateCalibration(std::string key, float initialFactor)
+    : m_enabled(Settings::Instance().m_bitrateCalibration)
+    , m_key(std::move(key))
+    , m_factor(initialFactor)
+    , m_savedFactor(initialFactor) {
+    MetricsSetGauge(DRIVER_GAUGE_BITRATE_CORRECTION, initialFactor);
+    if (!m_enabled || m_key.empty()) {
+        return;
+    }
+    std::ifstream is(cachePath());
+    std::string cachedKey;
+    float factor;
+    while (is >> cachedKey >> factor) {
+        if (cachedKey == m_key) {
+            m_factor = m_savedFactor = std::clamp(factor, MIN_FACTOR, MAX_FACTOR);
+            Info("Using the saved bitrate correction %.3f for %hs\n", m_factor, m_key.c_str());
+            MetricsSetGauge(DRIVER_GAUGE_BITRATE_CORRECTION, m_factor);
+            break;
+        }
+    }
+}
+
+BitrateCalibration::~BitrateCalibration() {
+    if (!m_enabled || m_key.empty() || m_factor == m_savedFactor) {
+        return;
+    }
+
+    std::vector<std::string> lines;
+    {
+        std::ifstream is(cachePath());
+        std::string line;
+        while (std::getline(is, line)) {
+            if (line.compare(0, m_key.size() + 1, m_key + " ") != 0) {
+                lines.push_back(line);
+            }
+        }
+    }
+    std::ostringstream entry;
+    entry << m_key << " " << m_factor;
+    lines.push_back(entry.str());
+
+    // Written aside and renamed, so that an interrupted write never leaves a truncated cache
+    std::filesystem::path path = cachePath();
+    std::filesystem::path tmpPath = path;
+    tmpPath += InstanceSuffix() + ".tmp";
+    {
+        std::ofstream os(tmpPath, std::ios::out | std::ios::trunc);
+        for (auto& line : lines) {
+            os << line << "\n";
+        }
+        if (!os) {
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        Warn("Failed to write the bitrate calibration %hs\n", path.string().c_str());
+        std::filesystem::remove(tmpPath, ec);
+    }
+}
+
+float BitrateCalibration::GetFactor() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_factor;
+}
+
+void BitrateCalibration::SetTarget(uint64_t bitrateBps) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (bitrateBps != m_targetBps) {
+        m_targetBps = bitrateBps;
+        m_windowStartNs = 0;
+    }
+}
+
+void BitrateCalibration::OnFrame(uint64_t bytes) {
+    if (!m_enabled) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_targetBps == 0) {
+        return;
+    }
+    uint64_t now = nowNs();
+    // The window starts at the end of its first frame, which is not counted
+    if (m_windowStartNs == 0) {
+        m_windowStartNs = now;
+        m_windowBytes = 0;
+        return;
+    }
+    m_windowBytes += bytes;
+    uint64_t elapsed = now - m_windowStartNs;
+    if (elapsed < WINDOW_NS) {
+        return;
+    }
+
+    double measuredBps = m_windowBytes * 8e9 / elapsed;
+    m_windowStartNs = now;
+    m_windowBytes = 0;
+    if (measuredBps < m_targetBps * MIN_MEASURED_RATIO) {
+        return;
+    }
+    double ratio = m_targetBps / measuredBps;
+    if (std::abs(ratio - 1.0) < MIN_ERROR) {
+        return;
+    }
+    m_factor = std::clamp((float)(m_factor * std::pow(ratio, GAIN)), MIN_FACTOR, MAX_FACTOR);
+    MetricsSetGauge(DRIVER_GAUGE_BITRATE_CORRECTION, m_factor);
+    Debug(
+        "Encoded %.1f Mbps for a target of %.1f Mbps, bitrate correction %.3f\n",
+        measuredBps / 1e6,
+        m_targetBps / 1e6,
+        m_factor
+    );
+}
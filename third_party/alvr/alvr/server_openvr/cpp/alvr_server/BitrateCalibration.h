@@ -0,0 +1,39 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+// Closed loop correction of the bitrate given to an encoder. Rate controls miss their target by a
+// bias that depends on the encoder, the GPU and the driver, so the bytes actually encoded are
+// measured against the requested bitrate and the correction follows the ratio. The correction is
+// saved next to the session for the next start with the same key.
+class BitrateCalibration {
+public:
+    // key names the encoder, GPU and driver, empty to not save the correction. initialFactor is
+    // used until a saved or measured one replaces it, and for good with calibration disabled.
+    BitrateCalibration(std::string key, float initialFactor);
+    ~BitrateCalibration();
+
+    // What the requested bitrate is multiplied by before it is given to the encoder
+    float GetFactor();
+    // Requested bitrate, before the correction. A change restarts the measurement.
+    void SetTarget(uint64_t bitrateBps);
+    // Size of each encoded frame, may be called from any thread
+    void OnFrame(uint64_t bytes);
+
+private:
+    static const uint64_t WINDOW_NS = 2'000'000'000;
+
+    bool m_enabled;
+    std::string m_key;
+    std::mutex m_mutex;
+    float m_factor;
+    float m_savedFactor;
+    uint64_t m_targetBps = 0;
+    uint64_t m_windowStartNs = 0;
+    uint64_t m_windowBytes = 0;
+};
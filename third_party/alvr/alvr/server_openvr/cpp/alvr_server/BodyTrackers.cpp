@@ -0,0 +1,118 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "BodyTrackers.h"
+#include "FakeViveTracker.h"
+#include "Logger.h"
+#include "Utils.h"
+
+void BodyTrackers::SetActivatedCallback(
+    std::function<void(uint64_t, FakeViveTracker*)> onActivated
+) {
+    m_onActivated = std::move(onActivated);
+}
+
+void BodyTrackers::AddTracker(uint64_t deviceID) {
+    if (m_count == CAPACITY) {
+        Error("BodyTrackers: too many trackers, %llu ignored\n", (unsigned long long)deviceID);
+        return;
+    }
+    m_ids[m_count] = deviceID;
+    m_states[m_count] = State::Idle;
+    m_count++;
+}
+
+void BodyTrackers::Register(size_t i) {
+    Info("BodyTrackers: registering tracker %llu\n", (unsigned long long)m_ids[i]);
+    m_trackers[i] = new FakeViveTracker(m_ids[i]);
+    // Registered without waiting, the tracking thread polls the activation on the next ticks
+    m_states[i] = m_trackers[i]->register_device(false) ? State::Activating : State::Failed;
+}
+
+void BodyTrackers::OnPoseUpdated(
+    uint64_t targetTimestampNs,
+    float predictionS,
+    const FfiDeviceMotion* motions,
+    int motionCount
+) {
+    for (size_t i = 0; i < m_count; i++) {
+        m_motions[i] = nullptr;
+    }
+
+    // The motions come in the order the trackers were added in, with the untracked ones left
+    // out, so the next tracker is checked first and the search only runs after a gap. There
+    // are only a handful of trackers, a linear search is cheaper than any map.
+    size_t next = 0;
+    for (int m = 0; m < motionCount; m++) {
+        for (size_t n = 0; n < m_count; n++) {
+            size_t i = next + n < m_count ? next + n : next + n - m_count;
+            if (m_ids[i] == motions[m].deviceID) {
+                m_motions[i] = &motions[m];
+                next = i + 1;
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < m_count; i++) {
+        const FfiDeviceMotion* motion = m_motions[i];
+        bool tracked = motion != nullptr;
+
+        if (m_states[i] == State::Idle) {
+            if (!tracked) {
+                continue;
+            }
+            Register(i);
+        }
+        if (m_states[i] == State::Activating) {
+            ActivationState activation = m_trackers[i]->activation();
+            if (activation == ActivationState::Pending) {
+                continue;
+            }
+            if (activation == ActivationState::Failure) {
+                Error(
+                    "BodyTrackers: tracker %llu failed to activate\n",
+                    (unsigned long long)m_ids[i]
+                );
+                m_states[i] = State::Failed;
+                continue;
+            }
+            m_states[i] = State::Active;
+            if (m_onActivated) {
+                m_onActivated(m_ids[i], m_trackers[i]);
+            }
+        }
+        if (m_states[i] != State::Active || (!tracked && !m_connected[i])) {
+            continue;
+        }
+        m_connected[i] = tracked;
+
+        auto pose = vr::DriverPose_t {};
+        pose.poseIsValid = tracked;
+        pose.deviceIsConnected = tracked;
+        pose.result = tracked ? vr::TrackingResult_Running_OK : vr::TrackingResult_Uninitialized;
+
+        pose.qWorldFromDriverRotation = HmdQuaternion_Init(1, 0, 0, 0);
+        pose.qDriverFromHeadRotation = HmdQuaternion_Init(1, 0, 0, 0);
+
+        if (!tracked) {
+            m_trackers[i]->SubmitPose(pose);
+            continue;
+        }
+
+        pose.qRotation = HmdQuaternion_Init(
+            motion->pose.orientation.w,
+            motion->pose.orientation.x,
+            motion->pose.orientation.y,
+            motion->pose.orientation.z
+        );
+
+        pose.vecPosition[0] = motion->pose.position[0];
+        pose.vecPosition[1] = motion->pose.position[1];
+        pose.vecPosition[2] = motion->pose.position[2];
+
+        m_trackers[i]->SubmitPose(
+            pose, targetTimestampNs, predictionS, motion->linearVelocity, motion->angularVelocity
+        );
+    }
+}
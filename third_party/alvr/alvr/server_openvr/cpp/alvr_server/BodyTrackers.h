@@ -0,0 +1,60 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "bindings.h"
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+class FakeViveTracker;
+
+// Updates all the fake Vive trackers of a tracking tick together. The motions of the tick are
+// matched to the trackers in a preallocated table and then submitted back to back, so a tick costs
+// no allocation and no map lookup.
+//
+// A tracker is only registered with SteamVR once the first motion of its body ID arrives, so users
+// without body tracking get no extra devices for vrserver to poll and the apps to enumerate.
+class BodyTrackers {
+public:
+    // Called on the tracking thread once SteamVR activated the tracker of a body ID, which takes
+    // over the tracker. A tracker SteamVR failed to activate is never deleted, it keeps the pointer.
+    void SetActivatedCallback(std::function<void(uint64_t, FakeViveTracker*)> onActivated);
+    // Body IDs are added once when streaming starts, their trackers come with their first motion
+    void AddTracker(uint64_t deviceID);
+
+    // Trackers that lose their motion are submitted as disconnected once, then skipped until they
+    // are tracked again. The others are predicted by predictionS like the controllers.
+    void OnPoseUpdated(
+        uint64_t targetTimestampNs,
+        float predictionS,
+        const FfiDeviceMotion* motions,
+        int motionCount
+    );
+
+private:
+    static constexpr size_t CAPACITY = 32;
+
+    enum class State {
+        // No motion seen yet, not registered
+        Idle,
+        // Registered, waiting for SteamVR to activate it
+        Activating,
+        Active,
+        // SteamVR refused it, not retried
+        Failed,
+    };
+
+    void Register(size_t i);
+
+    std::function<void(uint64_t, FakeViveTracker*)> m_onActivated;
+    size_t m_count = 0;
+    uint64_t m_ids[CAPACITY] = {};
+    State m_states[CAPACITY] = {};
+    FakeViveTracker* m_trackers[CAPACITY] = {};
+    // Whether the last pose submitted for the tracker was connected
+    bool m_connected[CAPACITY] = {};
+    // Motion of each tracker in the current tick, null if it isn't tracked
+    const FfiDeviceMotion* m_motions[CAPACITY] = {};
+};
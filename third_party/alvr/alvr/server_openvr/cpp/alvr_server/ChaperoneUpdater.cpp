@@ -1,11 +1,16 @@
 // Derived from ALVR (MIT)
 // Original copyright preserved
 
+#include "ChaperoneUpdater.h"
 #include "ALVR-common/packet_types.h"
 #include "Logger.h"
 #include "bindings.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <memory>
 #include <mutex>
+#include <thread>
 
 #ifndef __APPLE__
 // Workaround symbol clash in openvr.h / openvr_driver.h
@@ -15,20 +20,30 @@ namespace alvr_chaperone {
 using namespace alvr_chaperone;
 #endif
 
-std::mutex chaperone_mutex;
+namespace {
 
-bool isOpenvrInit = false;
+struct ZeroPoseSnapshot {
+    float invZeroPose[3][4];
+    uint64_t generation;
+};
 
-void InitOpenvrClient() {
-    Debug("InitOpenvrClient");
+std::atomic<bool> isOpenvrInit { false };
+// Swapped with std::atomic_store, readers keep the snapshot they loaded alive
+std::shared_ptr<const ZeroPoseSnapshot> g_zeroPose;
 
-#ifndef __APPLE__
-    std::unique_lock<std::mutex> lock(chaperone_mutex);
-
-    if (isOpenvrInit) {
-        return;
-    }
+// Work left for the worker, under g_mutex. Only the latest area matters, requests coalesce.
+std::mutex g_mutex;
+std::condition_variable g_cv;
+std::thread g_worker;
+bool g_stop = false;
+bool g_initPending = false;
+bool g_areaPending = false;
+float g_areaWidth = 0.0f;
+float g_areaHeight = 0.0f;
+bool g_zeroPosePending = false;
 
+#ifndef __APPLE__
+void initClient() {
     vr::EVRInitError error;
     // Background needed for VRCompositor()->GetTrackingSpace()
     vr::VR_Init(&error, vr::VRApplication_Background);
@@ -37,33 +52,12 @@ void InitOpenvrClient() {
         Warn("Failed to init OpenVR client! Error: %d", error);
         return;
     }
-    isOpenvrInit = true;
-#endif
+    isOpenvrInit.store(true, std::memory_order_release);
 }
 
-void ShutdownOpenvrClient() {
-    Debug("ShutdownOpenvrClient");
-
-#ifndef __APPLE__
-    std::unique_lock<std::mutex> lock(chaperone_mutex);
-
-    if (!isOpenvrInit) {
-        return;
-    }
-
-    isOpenvrInit = false;
-    vr::VR_Shutdown();
-#endif
-}
-
-bool IsOpenvrClientReady() { return isOpenvrInit; }
-
-void _SetChaperoneArea(float areaWidth, float areaHeight) {
+void setChaperoneArea(float areaWidth, float areaHeight) {
     Debug("SetChaperoneArea");
 
-#ifndef __APPLE__
-    std::unique_lock<std::mutex> lock(chaperone_mutex);
-
     const vr::HmdMatrix34_t MATRIX_IDENTITY
         = { { { 1.0, 0.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0, 0.0 }, { 0.0, 0.0, 1.0, 0.0 } } };
 
@@ -98,30 +92,157 @@ void _SetChaperoneArea(float areaWidth, float areaHeight) {
             vr::k_pch_CollisionBounds_Section, vr::k_pch_CollisionBounds_FadeDistance_Float, 0.0f
         );
     }
-
-#endif
 }
 
 #ifdef __linux__
-std::unique_ptr<vr::HmdMatrix34_t> GetInvZeroPose() {
+void publishInvZeroPose() {
     Debug("GetInvZeroPose");
 
-    std::unique_lock<std::mutex> lock(chaperone_mutex);
-    if (!isOpenvrInit) {
-        return nullptr;
-    }
-    auto mat = std::make_unique<vr::HmdMatrix34_t>();
+    vr::HmdMatrix34_t mat;
     // revert pulls live into working copy
     vr::VRChaperoneSetup()->RevertWorkingCopy();
     auto compositor = vr::VRCompositor();
     if (compositor == nullptr) {
-        return nullptr;
+        return;
     }
     if (compositor->GetTrackingSpace() == vr::TrackingUniverseStanding) {
-        vr::VRChaperoneSetup()->GetWorkingStandingZeroPoseToRawTrackingPose(mat.get());
+        vr::VRChaperoneSetup()->GetWorkingStandingZeroPoseToRawTrackingPose(&mat);
     } else {
-        vr::VRChaperoneSetup()->GetWorkingSeatedZeroPoseToRawTrackingPose(mat.get());
+        vr::VRChaperoneSetup()->GetWorkingSeatedZeroPoseToRawTrackingPose(&mat);
+    }
+
+    auto previous = std::atomic_load(&g_zeroPose);
+    auto snapshot = std::make_shared<ZeroPoseSnapshot>();
+    memcpy(snapshot->invZeroPose, mat.m, sizeof(snapshot->invZeroPose));
+    snapshot->generation = previous ? previous->generation + 1 : 1;
+    std::atomic_store(&g_zeroPose, std::shared_ptr<const ZeroPoseSnapshot>(std::move(snapshot)));
+}
+#endif
+
+// The only thread that calls into the OpenVR client, from VR_Init to VR_Shutdown
+void workerLoop() {
+    std::unique_lock<std::mutex> lock(g_mutex);
+    while (true) {
+        g_cv.wait(lock, [] {
+            bool ready = isOpenvrInit.load(std::memory_order_relaxed);
+            return g_stop || g_initPending || (ready && (g_areaPending || g_zeroPosePending));
+        });
+        if (g_stop) {
+            break;
+        }
+
+        bool init = g_initPending;
+        g_initPending = false;
+        lock.unlock();
+        if (init && !isOpenvrInit.load(std::memory_order_relaxed)) {
+            initClient();
+        }
+        lock.lock();
+        if (!isOpenvrInit.load(std::memory_order_relaxed)) {
+            continue;
+        }
+
+        bool area = g_areaPending;
+        float areaWidth = g_areaWidth;
+        float areaHeight = g_areaHeight;
+        bool zeroPose = g_zeroPosePending;
+        g_areaPending = false;
+        g_zeroPosePending = false;
+        lock.unlock();
+
+        if (area) {
+            setChaperoneArea(areaWidth, areaHeight);
+        }
+#ifdef __linux__
+        if (zeroPose) {
+            publishInvZeroPose();
+        }
+#else
+        (void)zeroPose;
+#endif
+
+        lock.lock();
+    }
+    lock.unlock();
+
+    if (isOpenvrInit.exchange(false, std::memory_order_acq_rel)) {
+        vr::VR_Shutdown();
     }
-    return mat;
 }
 #endif
+
+} // namespace
+
+void InitOpenvrClient() {
+    Debug("InitOpenvrClient");
+
+#ifndef __APPLE__
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (!g_worker.joinable()) {
+            g_stop = false;
+            g_worker = std::thread(workerLoop);
+        }
+        g_initPending = true;
+    }
+    g_cv.notify_one();
+#endif
+}
+
+void ShutdownOpenvrClient() {
+    Debug("ShutdownOpenvrClient");
+
+#ifndef __APPLE__
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (!g_worker.joinable()) {
+            return;
+        }
+        g_stop = true;
+    }
+    g_cv.notify_one();
+    g_worker.join();
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_initPending = false;
+    g_areaPending = false;
+    g_zeroPosePending = false;
+#endif
+}
+
+bool IsOpenvrClientReady() { return isOpenvrInit.load(std::memory_order_acquire); }
+
+void _SetChaperoneArea(float areaWidth, float areaHeight) {
+#ifndef __APPLE__
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_areaPending = true;
+        g_areaWidth = areaWidth;
+        g_areaHeight = areaHeight;
+    }
+    g_cv.notify_one();
+#else
+    (void)areaWidth;
+    (void)areaHeight;
+#endif
+}
+
+void RequestZeroPoseRefresh() {
+#ifdef __linux__
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_zeroPosePending = true;
+    }
+    g_cv.notify_one();
+#endif
+}
+
+bool TakeInvZeroPose(float invZeroPose[3][4], uint64_t& generation) {
+    auto snapshot = std::atomic_load(&g_zeroPose);
+    if (!snapshot || snapshot->generation == generation) {
+        return false;
+    }
+    memcpy(invZeroPose, snapshot->invZeroPose, sizeof(snapshot->invZeroPose));
+    generation = snapshot->generation;
+    return true;
+}
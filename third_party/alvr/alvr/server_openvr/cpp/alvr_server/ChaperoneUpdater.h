@@ -0,0 +1,19 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// The OpenVR client connection belongs to a worker thread started by InitOpenvrClient. The
+// chaperone area and the zero pose requests only leave work for it, so the startup and tracking
+// paths never wait on the IPC with vrserver. The worker publishes each zero pose it reads as an
+// immutable snapshot swapped in atomically.
+
+bool IsOpenvrClientReady();
+// Reads the zero pose again on the worker, used when the playspace may have changed. A request
+// made before the client is up is served once it is.
+void RequestZeroPoseRefresh();
+// Copies the latest zero pose to raw tracking pose transform, row major, if it is newer than
+// `generation` and updates `generation`. Never blocks, false when there is nothing new.
+bool TakeInvZeroPose(float invZeroPose[3][4], uint64_t& generation);
@@ -0,0 +1,37 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "ClientClock.h"
+#include "ClockSync.h"
+#include <mutex>
+
+namespace {
+// A measurement this far from the model is a new clock, like after the client slept, the model
+// starts over instead of slowly converging to it
+const int64_t RESYNC_THRESHOLD_NS = 50'000'000;
+
+std::mutex g_mutex;
+ClockSync g_clock;
+}
+
+void ClientClockAddOffset(uint64_t hostNs, int64_t serverToClientNs, uint64_t uncertaintyNs) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    uint64_t clientNs = hostNs + serverToClientNs;
+    if (g_clock.IsCalibrated()) {
+        int64_t error = (int64_t)(clientNs - g_clock.FromHost(hostNs));
+        if (error > RESYNC_THRESHOLD_NS || error < -RESYNC_THRESHOLD_NS) {
+            g_clock = {};
+        }
+    }
+    g_clock.AddCalibration(clientNs, hostNs, uncertaintyNs);
+}
+
+int64_t ClientClockServerToClientNs(uint64_t hostNs) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return (int64_t)(g_clock.FromHost(hostNs) - hostNs);
+}
+
+void ClientClockReset() {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_clock = {};
+}
@@ -0,0 +1,19 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Model of the client clock, the clock of the target timestamps, against FrameTraceNow(). Each
+// SetClientTiming carries one measurement of the offset between the clocks, which jitters with the
+// network. The model filters them, trusting the ones taken on a slower network less, and tracks
+// the drift between the clocks, so the frame pacing, the compose delay and the vsync offset given
+// to SteamVR don't move with each measurement. Thread safe.
+
+// serverToClientNs converts hostNs to the client clock, uncertaintyNs bounds its error
+void ClientClockAddOffset(uint64_t hostNs, int64_t serverToClientNs, uint64_t uncertaintyNs);
+// The filtered offset at hostNs, 0 before the first measurement
+int64_t ClientClockServerToClientNs(uint64_t hostNs);
+// The next client may have another clock
+void ClientClockReset();
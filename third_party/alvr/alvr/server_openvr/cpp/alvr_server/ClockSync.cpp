@@ -0,0 +1,54 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "ClockSync.h"
+
+#include <algorithm>
+
+void ClockSync::AddCalibration(uint64_t clockNs, uint64_t hostNs, uint64_t deviationNs) {
+    double deviation = (double)std::max(deviationNs, DEVIATION_FLOOR_NS);
+    if (!m_calibrated) {
+        m_calibrated = true;
+        m_clockNs = m_spanClockNs = clockNs;
+        m_hostNs = m_spanHostNs = hostNs;
+        m_bestDeviationNs = deviation;
+        return;
+    }
+
+    m_bestDeviationNs = std::min(deviation, m_bestDeviationNs * 1.01);
+    double weight = m_bestDeviationNs / deviation;
+
+    // The clock may be read before its last reading, by a late query
+    if (clockNs < m_clockNs) {
+        return;
+    }
+
+    uint64_t span = clockNs - m_spanClockNs;
+    if (span >= RATE_SPAN_NS) {
+        double rate = (double)(int64_t)(hostNs - m_spanHostNs) / (double)span;
+        m_rate += (rate - m_rate) * RATE_GAIN * weight;
+        m_spanClockNs = clockNs;
+        m_spanHostNs = hostNs;
+    }
+
+    uint64_t predicted = ToHost(clockNs);
+    double error = (double)(int64_t)(hostNs - predicted);
+    m_clockNs = clockNs;
+    m_hostNs = predicted + (int64_t)(error * OFFSET_GAIN * weight);
+}
+
+uint64_t ClockSync::ToHost(uint64_t clockNs) const {
+    if (!m_calibrated) {
+        return clockNs;
+    }
+    double elapsed = (double)(int64_t)(clockNs - m_clockNs);
+    return m_hostNs + (int64_t)(elapsed * m_rate);
+}
+
+uint64_t ClockSync::FromHost(uint64_t hostNs) const {
+    if (!m_calibrated) {
+        return hostNs;
+    }
+    double elapsed = (double)(int64_t)(hostNs - m_hostNs);
+    return m_clockNs + (int64_t)(elapsed / m_rate);
+}
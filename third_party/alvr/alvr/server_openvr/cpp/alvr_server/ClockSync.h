@@ -0,0 +1,42 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Maps the times of another clock, like the GPU timestamp counter, to FrameTraceNow(). It is fed
+// with paired readings of both clocks and their uncertainty. The offset follows the readings,
+// weighted by how precise they are, and the rate between the clocks is tracked over longer spans
+// so that the conversion doesn't drift between calibrations. Not thread safe.
+class ClockSync {
+public:
+    // clockNs and hostNs were read at the same time, up to deviationNs
+    void AddCalibration(uint64_t clockNs, uint64_t hostNs, uint64_t deviationNs);
+    bool IsCalibrated() const { return m_calibrated; }
+    // Time of clockNs in the FrameTraceNow() clock, clockNs unchanged before the first calibration
+    uint64_t ToHost(uint64_t clockNs) const;
+    // Inverse of ToHost, hostNs unchanged before the first calibration
+    uint64_t FromHost(uint64_t hostNs) const;
+
+private:
+    // Span of the readings the rate is measured over
+    static constexpr uint64_t RATE_SPAN_NS = 1'000'000'000;
+    // Filtering of the offset and of the rate
+    static constexpr double OFFSET_GAIN = 0.25;
+    static constexpr double RATE_GAIN = 0.2;
+    // A reading this much less precise than the best recent one moves the offset that much less
+    static constexpr uint64_t DEVIATION_FLOOR_NS = 1'000;
+
+    bool m_calibrated = false;
+    // Reference point of the conversion
+    uint64_t m_clockNs = 0;
+    uint64_t m_hostNs = 0;
+    // Host nanoseconds per clock nanosecond
+    double m_rate = 1.0;
+    // First reading of the current rate span
+    uint64_t m_spanClockNs = 0;
+    uint64_t m_spanHostNs = 0;
+    // Best recent deviation, it slowly grows back so that a loaded system isn't locked out
+    double m_bestDeviationNs = 0;
+};
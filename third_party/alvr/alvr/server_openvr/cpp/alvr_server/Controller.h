@@ -6,7 +6,7 @@
 #include "ALVR-common/packet_types.h"
 #include "TrackedDevice.h"
 #include "openvr_driver_wrap.h"
-#include <map>
+#include <vector>
 
 class Controller : public TrackedDevice {
 public:
@@ -20,7 +20,10 @@ private:
     static const int SKELETON_BONE_COUNT = 31;
     static const int ANIMATION_FRAME_COUNT = 15;
 
-    std::map<uint64_t, vr::VRInputComponentHandle_t> m_buttonHandles;
+    // By index in STEAMVR_COMPONENT_PATHS, invalid for the paths not registered
+    std::vector<vr::VRInputComponentHandle_t> m_buttonHandles;
+    // By ALVR_INPUT finger
+    vr::VRInputComponentHandle_t m_fingerHandles[4] = {};
 
     vr::VRInputComponentHandle_t m_compHaptic;
     vr::VRInputComponentHandle_t m_compSkeleton = vr::k_ulInvalidInputComponentHandle;
@@ -39,8 +42,35 @@ private:
     float m_triggerValue = 0;
     float m_gripValue = 0;
 
+    // Inputs of the current m_handPose, it is blended again only when they change
+    struct HandAnimationState {
+        float thumbTouchAnimationProgress;
+        float indexTouchAnimationProgress;
+        float triggerValue;
+        float gripValue;
+        bool lastThumbTouch;
+        bool currentThumbTouch;
+        bool lastTriggerTouch;
+        bool currentTriggerTouch;
+
+        bool operator==(const HandAnimationState& other) const {
+            return thumbTouchAnimationProgress == other.thumbTouchAnimationProgress
+                && indexTouchAnimationProgress == other.indexTouchAnimationProgress
+                && triggerValue == other.triggerValue && gripValue == other.gripValue
+                && lastThumbTouch == other.lastThumbTouch
+                && currentThumbTouch == other.currentThumbTouch
+                && lastTriggerTouch == other.lastTriggerTouch
+                && currentTriggerTouch == other.currentTriggerTouch;
+        }
+    };
+    HandAnimationState m_handAnimationState = {};
+    bool m_handPoseValid = false;
+    // Animated skeleton of a controller-held hand, [withController]
+    vr::VRBoneTransform_t m_handPose[2][SKELETON_BONE_COUNT];
+
     vr::VRInputComponentHandle_t getHapticComponent();
-    void GetBoneTransform(bool withController, vr::VRBoneTransform_t outBoneTransform[]);
+    // Blends the reference hand poses for the current button state into m_handPose
+    void UpdateHandPose();
 
     // TrackedDevice
     bool activate() final;
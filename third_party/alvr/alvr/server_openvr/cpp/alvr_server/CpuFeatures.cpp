@@ -0,0 +1,87 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "CpuFeatures.h"
+#include "Logger.h"
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_FEATURES_X86
+#ifdef _MSC_VER
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+#ifdef CPU_FEATURES_X86
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+    __cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// The register state the OS saves on context switches, the wider registers can't be used
+// without it even when the CPU has them
+uint64_t xgetbv() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+#endif
+
+CpuFeatures detect() {
+    CpuFeatures features;
+#ifdef CPU_FEATURES_X86
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    uint32_t maxLeaf = regs[0];
+    if (maxLeaf < 1) {
+        return features;
+    }
+
+    cpuid(1, 0, regs);
+    features.sse42 = regs[2] & (1u << 20);
+    bool osxsave = regs[2] & (1u << 27);
+    bool avx = regs[2] & (1u << 28);
+    uint64_t xcr0 = osxsave ? xgetbv() : 0;
+    // XMM and YMM, then opmask and both halves of the ZMM registers
+    bool ymmState = (xcr0 & 0x6) == 0x6;
+    bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+    if (maxLeaf >= 7) {
+        cpuid(7, 0, regs);
+        features.avx2 = avx && ymmState && (regs[1] & (1u << 5));
+        features.avx512 = zmmState && (regs[1] & (1u << 16)) && (regs[1] & (1u << 30));
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+    // Part of the baseline of AArch64, and of the ARMv7 builds that enable it
+    features.neon = true;
+#endif
+    return features;
+}
+} // namespace
+
+const CpuFeatures& GetCpuFeatures() {
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+void LogCpuFeatures() {
+    const CpuFeatures& features = GetCpuFeatures();
+    Info(
+        "CPU features: SSE4.2 %d, AVX2 %d, AVX-512 %d, NEON %d\n",
+        features.sse42,
+        features.avx2,
+        features.avx512,
+        features.neon
+    );
+}
@@ -0,0 +1,21 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+// Instruction sets of the host CPU, for the kernels that pick their implementation at runtime.
+// The builds target the baseline of each architecture (SSE2 on x86-64), the faster kernels are
+// compiled for their instruction set and only called when it is available.
+struct CpuFeatures {
+    bool sse42 = false;
+    bool avx2 = false;
+    // AVX-512 F and BW, with the OS saving the ZMM registers
+    bool avx512 = false;
+    bool neon = false;
+};
+
+// Detected on the first call, which CppInit makes so that it is logged once. Thread safe.
+const CpuFeatures& GetCpuFeatures();
+
+// Logs the detected instruction sets
+void LogCpuFeatures();
@@ -0,0 +1,74 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "CrashReport.h"
+
+void CrashReport::Begin() {
+    m_size = 0;
+    Append("alvr_crash_report 1\n");
+}
+
+void CrashReport::Value(const char* key, int64_t value) {
+    Append(key);
+    Append(" ");
+    AppendDecimal(value);
+    Append("\n");
+}
+
+void CrashReport::Hex(const char* key, uint64_t value) {
+    Append(key);
+    Append(" ");
+    AppendHex(value);
+    Append("\n");
+}
+
+void CrashReport::Register(const char* name, uint64_t value) {
+    Append("reg ");
+    Hex(name, value);
+}
+
+void CrashReport::Frame(uint64_t pc) { Hex("frame", pc); }
+
+void CrashReport::Module(uint64_t base, uint64_t end, const char* path) {
+    Append("module ");
+    AppendHex(base);
+    Append(" ");
+    AppendHex(end);
+    Append(" ");
+    Append(path);
+    Append("\n");
+}
+
+void CrashReport::Append(const char* str) {
+    while (*str != '\0' && m_size < sizeof(m_buffer)) {
+        m_buffer[m_size++] = *str++;
+    }
+}
+
+void CrashReport::AppendHex(uint64_t value) {
+    char digits[19] = "0x";
+    int len = 2;
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        int digit = (value >> shift) & 0xF;
+        if (digit != 0 || len > 2 || shift == 0) {
+            digits[len++] = "0123456789abcdef"[digit];
+        }
+    }
+    digits[len] = '\0';
+    Append(digits);
+}
+
+void CrashReport::AppendDecimal(int64_t value) {
+    char digits[21];
+    int len = sizeof(digits) - 1;
+    digits[len] = '\0';
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : value;
+    do {
+        digits[--len] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        digits[--len] = '-';
+    }
+    Append(digits + len);
+}
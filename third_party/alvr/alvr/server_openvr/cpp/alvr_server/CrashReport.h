@@ -0,0 +1,44 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The crash handlers only record what the crash left behind: the signal or exception, the
+// registers, the raw return addresses and the loaded modules. Symbolizing in process costs debug
+// info in memory from startup, and can hang or fault again in a broken process. The report is
+// written next to the session file and read back by the driver on the next start, which logs each
+// frame as a module and offset for addr2line or llvm-symbolizer.
+//
+// The report is text, one "<key> <value>" line per entry, formatted into a fixed buffer with no
+// allocation or locale, so it can be built in a signal handler. On Linux it ends with a "maps"
+// line followed by a copy of /proc/self/maps.
+
+#define CRASH_REPORT_FILE_NAME "crash_report.txt"
+
+class CrashReport {
+public:
+    static const int MAX_FRAMES = 128;
+
+    void Begin();
+    void Value(const char* key, int64_t value);
+    void Hex(const char* key, uint64_t value);
+    void Register(const char* name, uint64_t value);
+    void Frame(uint64_t pc);
+    // A module mapped at [base, end), from the start of its file
+    void Module(uint64_t base, uint64_t end, const char* path);
+
+    const char* Data() const { return m_buffer; }
+    size_t Size() const { return m_size; }
+
+private:
+    void Append(const char* str);
+    void AppendHex(uint64_t value);
+    void AppendDecimal(int64_t value);
+
+    // Entries that don't fit are dropped, the frames closest to the crash come first
+    char m_buffer[32 * 1024];
+    size_t m_size = 0;
+};
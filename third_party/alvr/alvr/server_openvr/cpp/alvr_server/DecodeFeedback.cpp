@@ -0,0 +1,83 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "DecodeFeedback.h"
+#include "Logger.h"
+#include "Settings.h"
+#include <algorithm>
+#include <mutex>
+
+namespace {
+std::mutex g_mutex;
+uint64_t g_frameDecodeNs = 0;
+uint64_t g_sliceDecodeNs = 0;
+uint32_t g_sliceCount = 0;
+}
+
+void SetDecodeTiming(uint64_t frameDecodeNs, uint64_t sliceDecodeNs, uint32_t sliceCount) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_frameDecodeNs = frameDecodeNs;
+    g_sliceDecodeNs = sliceDecodeNs;
+    g_sliceCount = sliceCount;
+}
+
+DecodeAdvisor::DecodeAdvisor()
+    : m_enabled(Settings::Instance().m_encoderDecodeFeedback)
+    , m_periodNs(1'000'000'000 / std::max(Settings::Instance().m_refreshRate, 1))
+    , m_codec(Settings::Instance().m_codec)
+    , m_entropyCoding(Settings::Instance().m_entropyCoding)
+    , m_slicesPerFrame(std::max<uint32_t>(Settings::Instance().m_encoderSlicesPerFrame, 1)) { }
+
+bool DecodeAdvisor::Update(uint64_t nowNs) {
+    if (!m_enabled) {
+        return false;
+    }
+    if (m_changeNs == 0) {
+        m_changeNs = nowNs;
+    }
+    if (nowNs - m_changeNs < MIN_CHANGE_INTERVAL_NS) {
+        return false;
+    }
+
+    uint64_t frameNs, sliceNs;
+    uint32_t slices;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        frameNs = g_frameDecodeNs;
+        sliceNs = g_sliceDecodeNs;
+        slices = g_sliceCount;
+    }
+    if (frameNs < m_periodNs * SLOW_DECODE_RATIO) {
+        return false;
+    }
+
+    if (m_codec == ALVR_CODEC_H264 && m_entropyCoding == ALVR_CABAC) {
+        m_entropyCoding = ALVR_CAVLC;
+        Info(
+            "Slow client decoder (%llu us), switching to CAVLC\n",
+            (unsigned long long)frameNs / 1000
+        );
+    } else if (
+        slices > 1 && frameNs < sliceNs * slices * PARALLEL_SLICE_RATIO
+        && m_slicesPerFrame < MAX_SLICES
+        && Settings::Instance().m_encoderMaxSliceBytes == 0
+    ) {
+        m_slicesPerFrame = std::min(m_slicesPerFrame * 2, MAX_SLICES);
+        Info(
+            "Slow client decoder (%llu us), encoding %u slices\n",
+            (unsigned long long)frameNs / 1000,
+            m_slicesPerFrame
+        );
+    } else {
+        // Nothing cheaper left, don't check again
+        m_enabled = false;
+        return false;
+    }
+    m_changeNs = nowNs;
+    return true;
+}
+
+void DecodeAdvisor::Apply() {
+    Settings::Instance().m_entropyCoding = m_entropyCoding;
+    Settings::Instance().m_encoderSlicesPerFrame = m_slicesPerFrame;
+}
@@ -0,0 +1,47 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Adapts the bitstream to the decoder of the client from the decode times it reports. A decoder
+// that needs most of the frame period gets cheaper streams: CAVLC instead of CABAC for h264, and
+// more slices if it decodes the slices of a frame in parallel. Each change rebuilds the encoder
+// with the new settings, and is kept for the rest of the session so that the stream doesn't flip
+// between configurations. The codec stays the one negotiated with the client.
+//
+// Off unless encoder_decode_feedback is set. Times are in nanoseconds.
+
+// Decode time of the recent frames on the client, and of their slices when the client decodes
+// sliceCount > 1 slices separately
+void SetDecodeTiming(uint64_t frameDecodeNs, uint64_t sliceDecodeNs, uint32_t sliceCount);
+
+class DecodeAdvisor {
+public:
+    DecodeAdvisor();
+
+    bool IsEnabled() const { return m_enabled; }
+
+    // Whether the encoder should be rebuilt with the settings written by Apply
+    bool Update(uint64_t nowNs);
+    // Writes the entropy coding and slice count of the encoder settings. Only called by the
+    // thread that creates the encoders, while no encoder is being created.
+    void Apply();
+
+private:
+    // The decoder is too slow above this ratio of the decode time to the frame period
+    static constexpr double SLOW_DECODE_RATIO = 0.5;
+    // Slices are decoded in parallel when a frame takes less than this ratio of their sum
+    static constexpr double PARALLEL_SLICE_RATIO = 0.7;
+    static constexpr uint32_t MAX_SLICES = 4;
+    // Time the decoder is given after the stream start and after a change, a rebuild costs an IDR
+    static constexpr uint64_t MIN_CHANGE_INTERVAL_NS = 10'000'000'000;
+
+    bool m_enabled;
+    uint64_t m_periodNs;
+    int m_codec;
+    uint32_t m_entropyCoding;
+    uint32_t m_slicesPerFrame;
+    uint64_t m_changeNs = 0;
+};
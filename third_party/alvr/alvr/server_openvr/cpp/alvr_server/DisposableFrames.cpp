@@ -0,0 +1,104 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "DisposableFrames.h"
+#include "Logger.h"
+#include "Settings.h"
+#include <mutex>
+
+namespace {
+
+// The recent frames in encoding order, enough to cover the losses the client reports
+const size_t HISTORY_SIZE = 64;
+
+struct SentFrame {
+    uint64_t targetTimestampNs;
+    bool disposable;
+};
+
+std::mutex g_historyMutex;
+SentFrame g_history[HISTORY_SIZE];
+size_t g_historyCount = 0;
+size_t g_historyNext = 0;
+
+void record(uint64_t targetTimestampNs, bool disposable) {
+    std::lock_guard<std::mutex> lock(g_historyMutex);
+    g_history[g_historyNext] = { targetTimestampNs, disposable };
+    g_historyNext = (g_historyNext + 1) % HISTORY_SIZE;
+    if (g_historyCount < HISTORY_SIZE) {
+        g_historyCount++;
+    }
+}
+
+} // namespace
+
+DisposableFrames::DisposableFrames()
+    : m_interval(Settings::Instance().m_encoderDisposableFrames) {
+    if (m_interval > MAX_INTERVAL) {
+        Warn("Using %u disposable frames instead of %u.\n", MAX_INTERVAL, m_interval);
+        m_interval = MAX_INTERVAL;
+    }
+}
+
+void DisposableFrames::UseTopTemporalLayer(TemporalLayers& layers) {
+    if (!IsEnabled()) {
+        return;
+    }
+    if (m_interval > 1) {
+        Warn("This encoder can only make every other frame disposable.\n");
+        m_interval = 1;
+    }
+    if (!layers.IsEnabled()) {
+        layers.SetLayerCount(2);
+    }
+}
+
+void DisposableFrames::DisableWithoutLayers(const TemporalLayers& layers) {
+    if (IsEnabled() && !layers.IsEnabled()) {
+        Warn("Disposable frames are disabled without temporal layers.\n");
+        Disable();
+    }
+}
+
+bool DisposableFrames::OnFrame(uint64_t targetTimestampNs, bool forceReference) {
+    if (!IsEnabled()) {
+        return false;
+    }
+
+    bool disposable = false;
+    if (forceReference) {
+        m_sinceReference = 0;
+    } else if (m_sinceReference < m_interval) {
+        m_sinceReference++;
+        disposable = true;
+    } else {
+        m_sinceReference = 0;
+    }
+
+    record(targetTimestampNs, disposable);
+    return disposable;
+}
+
+bool DisposableFrames::OnlyDisposableLost(uint64_t firstTs, uint64_t lastTs) {
+    std::lock_guard<std::mutex> lock(g_historyMutex);
+    if (g_historyCount == 0) {
+        return false;
+    }
+    size_t oldest = (g_historyNext + HISTORY_SIZE - g_historyCount) % HISTORY_SIZE;
+    if (g_history[oldest].targetTimestampNs > firstTs) {
+        return false;
+    }
+
+    bool found = false;
+    for (size_t i = 0; i < g_historyCount; i++) {
+        const SentFrame& frame = g_history[(oldest + i) % HISTORY_SIZE];
+        if (frame.targetTimestampNs < firstTs || frame.targetTimestampNs > lastTs) {
+            continue;
+        }
+        if (!frame.disposable) {
+            return false;
+        }
+        found = true;
+    }
+    return found;
+}
@@ -0,0 +1,40 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "TemporalLayers.h"
+#include <stdint.h>
+
+// Non-reference frames, see encoder_disposable_frames. After each reference frame the encoder
+// codes this many P frames that no other frame predicts from, restarted at each frame that must be
+// a reference. A lost disposable frame costs that frame only and needs no recovery.
+class DisposableFrames {
+public:
+    static const uint32_t MAX_INTERVAL = 3;
+
+    DisposableFrames();
+
+    bool IsEnabled() const { return m_interval > 0; }
+    void Disable() { m_interval = 0; }
+    uint32_t GetInterval() const { return m_interval; }
+
+    // For the encoders that can only leave frames unreferenced through temporal SVC. The
+    // disposable frames are then the top layer, every other frame, so this sets the interval to 1
+    // and enables two layers if there were none. Called before the encoder configures the layers,
+    // and DisableWithoutLayers after it did.
+    void UseTopTemporalLayer(TemporalLayers& layers);
+    void DisableWithoutLayers(const TemporalLayers& layers);
+
+    // Called for each frame before it is encoded, in encoding order. forceReference is set for
+    // IDR and recovery frames. Returns whether the frame is disposable.
+    bool OnFrame(uint64_t targetTimestampNs, bool forceReference);
+
+    // Whether every frame sent from firstTs to lastTs was disposable, so that losing them needs no
+    // recovery. False for the frames too old to be known. Thread safe.
+    static bool OnlyDisposableLost(uint64_t firstTs, uint64_t lastTs);
+
+private:
+    uint32_t m_interval;
+    uint32_t m_sinceReference = 0;
+};
@@ -0,0 +1,100 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "DriverMetrics.h"
+#include <atomic>
+
+namespace {
+struct Histogram {
+    std::atomic<uint64_t> count { 0 };
+    std::atomic<uint64_t> totalNs { 0 };
+    std::atomic<uint64_t> buckets[GPU_PASS_HISTOGRAM_BUCKETS] = {};
+
+    void record(uint64_t durationNs) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        totalNs.fetch_add(durationNs, std::memory_order_relaxed);
+        buckets[HistogramBucket(durationNs)].fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+std::atomic_bool g_enabled { false };
+std::atomic<uint64_t> g_counters[DRIVER_COUNTER_COUNT] = {};
+std::atomic<double> g_gauges[DRIVER_GAUGE_COUNT] = {};
+Histogram g_encode;
+Histogram g_gpuPasses[GPU_PASS_COUNT];
+}
+
+bool DriverMetricsEnabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+uint32_t HistogramBucket(uint64_t durationNs) {
+    uint64_t us = durationNs / 1000;
+    uint32_t bucket = 0;
+    while (us != 0 && bucket < GPU_PASS_HISTOGRAM_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void MetricsCount(FfiDriverCounter counter, uint64_t value) {
+    g_counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+void MetricsSetGauge(FfiDriverGauge gauge, double value) {
+    g_gauges[gauge].store(value, std::memory_order_relaxed);
+}
+
+void MetricsAddGauge(FfiDriverGauge gauge, double delta) {
+    std::atomic<double>& value = g_gauges[gauge];
+    double current = value.load(std::memory_order_relaxed);
+    while (!value.compare_exchange_weak(current, current + delta, std::memory_order_relaxed)) { }
+}
+
+void MetricsFrameSent(uint64_t bytes, bool idr) {
+    MetricsCount(DRIVER_COUNTER_FRAMES_SENT);
+    MetricsCount(DRIVER_COUNTER_BYTES_SENT, bytes);
+    if (idr) {
+        MetricsCount(DRIVER_COUNTER_IDR_FRAMES_SENT);
+    }
+}
+
+void MetricsRecordEncode(uint64_t encodeNs) { g_encode.record(encodeNs); }
+
+void MetricsRecordGpuPass(FfiGpuPass pass, uint64_t durationNs) {
+    if (pass < GPU_PASS_COUNT) {
+        g_gpuPasses[pass].record(durationNs);
+    }
+}
+
+uint64_t MetricsGpuPassTotalNs() {
+    uint64_t totalNs = 0;
+    for (Histogram& histogram : g_gpuPasses) {
+        totalNs += histogram.totalNs.load(std::memory_order_relaxed);
+    }
+    return totalNs;
+}
+
+void GetDriverMetrics(FfiDriverMetrics* out) {
+    g_enabled.store(true, std::memory_order_relaxed);
+
+    // Each value is read on its own, a scrape can see a frame in one counter and not yet in another
+    for (uint32_t i = 0; i < DRIVER_COUNTER_COUNT; i++) {
+        out->counters[i] = g_counters[i].load(std::memory_order_relaxed);
+    }
+    for (uint32_t i = 0; i < DRIVER_GAUGE_COUNT; i++) {
+        out->gauges[i] = g_gauges[i].load(std::memory_order_relaxed);
+    }
+    out->encodeCount = g_encode.count.load(std::memory_order_relaxed);
+    out->encodeTotalNs = g_encode.totalNs.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < GPU_PASS_HISTOGRAM_BUCKETS; i++) {
+        out->encodeBuckets[i] = g_encode.buckets[i].load(std::memory_order_relaxed);
+    }
+    for (uint32_t pass = 0; pass < GPU_PASS_COUNT; pass++) {
+        Histogram& histogram = g_gpuPasses[pass];
+        out->gpuPassCount[pass] = histogram.count.load(std::memory_order_relaxed);
+        out->gpuPassTotalNs[pass] = histogram.totalNs.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < GPU_PASS_HISTOGRAM_BUCKETS; i++) {
+            out->gpuPassBuckets[pass][i] = histogram.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+}
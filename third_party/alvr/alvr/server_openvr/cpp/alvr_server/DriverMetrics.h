@@ -0,0 +1,26 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "bindings.h"
+#include <stdint.h>
+
+// Counters, gauges and histograms of the driver, read with GetDriverMetrics. Lock-free, safe to
+// call from any thread, each update is a relaxed atomic.
+
+// True once GetDriverMetrics was called, the GPU passes are timed from then on
+bool DriverMetricsEnabled();
+// Bucket of a duration in the histograms, see FfiGpuPassHistogram
+uint32_t HistogramBucket(uint64_t durationNs);
+
+void MetricsCount(FfiDriverCounter counter, uint64_t value = 1);
+void MetricsSetGauge(FfiDriverGauge gauge, double value);
+void MetricsAddGauge(FfiDriverGauge gauge, double delta);
+// A frame of bytes handed to the transport, the bytes of its slices if they are sent one by one
+void MetricsFrameSent(uint64_t bytes, bool idr);
+void MetricsRecordEncode(uint64_t encodeNs);
+// Called by GpuPassRecord
+void MetricsRecordGpuPass(FfiGpuPass pass, uint64_t durationNs);
+// GPU time of all the passes recorded so far
+uint64_t MetricsGpuPassTotalNs();
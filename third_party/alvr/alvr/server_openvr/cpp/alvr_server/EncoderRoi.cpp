@@ -0,0 +1,111 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "EncoderRoi.h"
+#include "Settings.h"
+#include "bindings.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+namespace {
+// A gaze older than this is considered lost (eye tracking stopped or the client disconnected)
+const uint64_t GAZE_TIMEOUT_US = 500'000;
+
+std::mutex g_gazeMutex;
+float g_gaze[2][2];
+uint64_t g_gazeTimeUs = 0;
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+bool isNormalized(float v) { return v >= 0.0f && v <= 1.0f; }
+}
+
+void SetEncoderGaze(float leftX, float leftY, float rightX, float rightY) {
+    std::lock_guard<std::mutex> lock(g_gazeMutex);
+    if (!isNormalized(leftX) || !isNormalized(leftY) || !isNormalized(rightX)
+        || !isNormalized(rightY)) {
+        g_gazeTimeUs = 0;
+        return;
+    }
+    g_gaze[0][0] = leftX;
+    g_gaze[0][1] = leftY;
+    g_gaze[1][0] = rightX;
+    g_gaze[1][1] = rightY;
+    g_gazeTimeUs = nowUs();
+}
+
+bool GetEncoderRoi(uint32_t width, uint32_t height, EncoderRoi& roi) {
+    int maxQpDelta = (int)Settings::Instance().m_gazeRoiQpDelta;
+    if (maxQpDelta <= 0) {
+        return false;
+    }
+
+    float gaze[2][2];
+    {
+        std::lock_guard<std::mutex> lock(g_gazeMutex);
+        if (g_gazeTimeUs == 0 || nowUs() - g_gazeTimeUs > GAZE_TIMEOUT_US) {
+            return false;
+        }
+        memcpy(gaze, g_gaze, sizeof(gaze));
+    }
+
+    float eyeWidth = width / 2.0f;
+    for (int eye = 0; eye < 2; eye++) {
+        roi.gazeX[eye] = (eye + gaze[eye][0]) * eyeWidth;
+        roi.gazeY[eye] = gaze[eye][1] * height;
+    }
+    roi.eyeSplit = eyeWidth;
+    roi.radius = Settings::Instance().Live()->m_gazeRoiRadius * eyeWidth;
+    roi.maxQpDelta = maxQpDelta;
+    return roi.radius > 0.0f;
+}
+
+int RoiQpDelta(const EncoderRoi& roi, float x, float y) {
+    int eye = x < roi.eyeSplit ? 0 : 1;
+    float distance = std::hypot(x - roi.gazeX[eye], y - roi.gazeY[eye]);
+    if (distance <= roi.radius) {
+        return 0;
+    }
+    // Linear ramp over one radius, so that the quality drop is not visible as an edge
+    float ramp = (distance - roi.radius) / roi.radius;
+    return ramp >= 1.0f ? roi.maxQpDelta : (int)std::lround(ramp * roi.maxQpDelta);
+}
+
+void BuildRoiQpDeltaMap(
+    const EncoderRoi& roi,
+    uint32_t width,
+    uint32_t height,
+    uint32_t blockSize,
+    std::vector<int8_t>& map
+) {
+    uint32_t blocksX = (width + blockSize - 1) / blockSize;
+    uint32_t blocksY = (height + blockSize - 1) / blockSize;
+    map.resize(blocksX * blocksY);
+
+    for (uint32_t by = 0; by < blocksY; by++) {
+        float y = (by + 0.5f) * blockSize;
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            float x = (bx + 0.5f) * blockSize;
+            map[by * blocksX + bx] = (int8_t)RoiQpDelta(roi, x, y);
+        }
+    }
+}
+
+RoiRect GetRoiRect(const EncoderRoi& roi, int eye, uint32_t width, uint32_t height) {
+    float eyeLeft = eye * (width / 2.0f);
+    float eyeRight = eyeLeft + width / 2.0f;
+
+    RoiRect rect;
+    rect.left = (uint32_t)std::fmax(roi.gazeX[eye] - roi.radius, eyeLeft);
+    rect.right = (uint32_t)std::fmin(roi.gazeX[eye] + roi.radius, eyeRight);
+    rect.top = (uint32_t)std::fmax(roi.gazeY[eye] - roi.radius, 0.0f);
+    rect.bottom = (uint32_t)std::fmin(roi.gazeY[eye] + roi.radius, (float)height);
+    return rect;
+}
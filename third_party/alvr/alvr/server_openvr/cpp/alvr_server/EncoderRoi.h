@@ -0,0 +1,49 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Gaze driven region of interest, shared by the encoders. The encoded frame has the left eye on
+// its left half and the right eye on its right half, blocks away from the gaze of their eye get
+// a higher QP.
+struct EncoderRoi {
+    // Gaze of each eye in pixels of the encoded frame
+    float gazeX[2];
+    float gazeY[2];
+    // x coordinate of the boundary between the eyes
+    float eyeSplit;
+    // Radius of the full quality region, in pixels
+    float radius;
+    // QP offset reached one radius past the full quality region
+    int maxQpDelta;
+};
+
+// Snapshot of the gaze set by SetEncoderGaze, scaled to a width x height frame. Returns false if
+// the ROI is disabled or there is no recent gaze, in which case the frame is encoded uniformly.
+bool GetEncoderRoi(uint32_t width, uint32_t height, EncoderRoi& roi);
+
+// QP offset of the pixel (x, y), between 0 and roi.maxQpDelta
+int RoiQpDelta(const EncoderRoi& roi, float x, float y);
+
+// One QP offset per blockSize x blockSize block of the frame, in raster order, sampled at the
+// block centers. The map is resized to the block count.
+void BuildRoiQpDeltaMap(
+    const EncoderRoi& roi,
+    uint32_t width,
+    uint32_t height,
+    uint32_t blockSize,
+    std::vector<int8_t>& map
+);
+
+// Bounding box of the full quality region of an eye, clamped to its half of the frame, for the
+// APIs that take rectangles instead of maps
+struct RoiRect {
+    uint32_t left;
+    uint32_t top;
+    uint32_t right;
+    uint32_t bottom;
+};
+RoiRect GetRoiRect(const EncoderRoi& roi, int eye, uint32_t width, uint32_t height);
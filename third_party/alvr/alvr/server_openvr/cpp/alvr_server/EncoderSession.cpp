@@ -0,0 +1,98 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "EncoderSession.h"
+#include "DriverMetrics.h"
+#include "Logger.h"
+#include "Settings.h"
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// The lock files of all the instances and GPUs, in the temp directory which every instance of a
+// user shares
+std::filesystem::path slotPath(const std::string& gpu, int slot) {
+    std::string name = "encoder-session-";
+    for (char c : gpu) {
+        bool safe = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        name += safe ? c : '_';
+    }
+    name += "-" + std::to_string(slot) + ".lock";
+
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "alvr";
+    std::filesystem::create_directories(dir, ec);
+    return dir / name;
+}
+}
+
+EncoderSession::EncoderSession(const std::string& gpu) {
+    uint32_t limit = Settings::Instance().m_encoderSessionLimit;
+    if (limit == 0) {
+        m_acquired = true;
+        return;
+    }
+
+    for (int slot = 0; slot < (int)limit && !m_acquired; slot++) {
+        std::filesystem::path path = slotPath(gpu, slot);
+#ifdef _WIN32
+        // Without sharing, the open fails while another instance has the file open
+        HANDLE file = CreateFileW(
+            path.c_str(),
+            GENERIC_READ | GENERIC_WRITE,
+            0,
+            nullptr,
+            OPEN_ALWAYS,
+            FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+            nullptr
+        );
+        if (file != INVALID_HANDLE_VALUE) {
+            m_file = file;
+            m_acquired = true;
+        }
+#else
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) == 0) {
+            m_fd = fd;
+            m_acquired = true;
+        } else if (fd >= 0) {
+            close(fd);
+        }
+#endif
+        if (m_acquired) {
+            m_slot = slot;
+        }
+    }
+
+    if (m_acquired) {
+        MetricsAddGauge(DRIVER_GAUGE_ENCODER_SESSIONS, 1);
+        Info("Encoder session %d of %u on GPU %s\n", m_slot + 1, limit, gpu.c_str());
+    } else {
+        Warn(
+            "All %u encoder sessions of GPU %s are taken by other instances\n", limit, gpu.c_str()
+        );
+    }
+}
+
+EncoderSession::~EncoderSession() {
+    if (m_acquired && m_slot >= 0) {
+        MetricsAddGauge(DRIVER_GAUGE_ENCODER_SESSIONS, -1);
+    }
+#ifdef _WIN32
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+#else
+    // The file stays for the next instance, removing it could race with one that opened it
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+#endif
+}
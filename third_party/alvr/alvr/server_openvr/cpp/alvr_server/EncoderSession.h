@@ -0,0 +1,33 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <string>
+
+// One of the hardware encode sessions of a GPU, counted across every driver instance of the host,
+// see encoder_session_limit. The GPUs cap their concurrent sessions, an instance that finds them
+// all taken uses another encoder instead of failing to open one. A session is a lock file held
+// while the encoder runs, which the OS releases when the process exits, even if it crashed.
+class EncoderSession {
+public:
+    // gpu names the GPU the same way in every process, like its LUID or its render node. Without
+    // a limit the session is always acquired and no file is used.
+    EncoderSession(const std::string& gpu);
+    ~EncoderSession();
+    EncoderSession(const EncoderSession&) = delete;
+    EncoderSession& operator=(const EncoderSession&) = delete;
+
+    // False if the other instances hold all the sessions of the GPU
+    bool IsAcquired() const { return m_acquired; }
+    int GetSlot() const { return m_slot; }
+
+private:
+    bool m_acquired = false;
+    int m_slot = -1;
+#ifdef _WIN32
+    void* m_file = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
@@ -115,24 +115,34 @@ bool FakeViveTracker::activate() {
     vr_properties->SetStringProperty(this->prop_container, vr::Prop_ResourceRoot_String, "htc");
 
     const char* name;
-    if (this->device_id == BODY_CHEST_ID) {
+    switch (this->device_id) {
+    case BODY_CHEST_ID:
         name = "ALVR/tracker/chest";
-    } else if (this->device_id == BODY_HIPS_ID) {
+        break;
+    case BODY_HIPS_ID:
         name = "ALVR/tracker/waist";
-    } else if (this->device_id == BODY_LEFT_FOOT_ID) {
+        break;
+    case BODY_LEFT_FOOT_ID:
         name = "ALVR/tracker/left_foot";
-    } else if (this->device_id == BODY_RIGHT_FOOT_ID) {
+        break;
+    case BODY_RIGHT_FOOT_ID:
         name = "ALVR/tracker/right_foot";
-    } else if (this->device_id == BODY_LEFT_KNEE_ID) {
+        break;
+    case BODY_LEFT_KNEE_ID:
         name = "ALVR/tracker/left_knee";
-    } else if (this->device_id == BODY_RIGHT_KNEE_ID) {
+        break;
+    case BODY_RIGHT_KNEE_ID:
         name = "ALVR/tracker/right_knee";
-    } else if (this->device_id == BODY_LEFT_ELBOW_ID) {
+        break;
+    case BODY_LEFT_ELBOW_ID:
         name = "ALVR/tracker/left_elbow";
-    } else if (this->device_id == BODY_RIGHT_ELBOW_ID) {
+        break;
+    case BODY_RIGHT_ELBOW_ID:
         name = "ALVR/tracker/right_elbow";
-    } else {
+        break;
+    default:
         name = "ALVR/tracker/unknown";
+        break;
     }
     vr_properties->SetStringProperty(
         this->prop_container, vr::Prop_RegisteredDeviceType_String, name
@@ -206,33 +216,26 @@ bool FakeViveTracker::activate() {
     return true;
 }
 
-void FakeViveTracker::OnPoseUpdated(uint64_t targetTimestampNs, const FfiDeviceMotion* motion) {
+void FakeViveTracker::SubmitPose(const vr::DriverPose_t& pose) {
     if (this->object_id == vr::k_unTrackedDeviceIndexInvalid) {
         return;
     }
 
-    bool tracked = motion != nullptr;
-
-    auto pose = vr::DriverPose_t {};
-    pose.poseIsValid = tracked;
-    pose.deviceIsConnected = tracked;
-    pose.result = tracked ? vr::TrackingResult_Running_OK : vr::TrackingResult_Uninitialized;
-
-    pose.qWorldFromDriverRotation = HmdQuaternion_Init(1, 0, 0, 0);
-    pose.qDriverFromHeadRotation = HmdQuaternion_Init(1, 0, 0, 0);
-
-    if (motion != nullptr) {
-        pose.qRotation = HmdQuaternion_Init(
-            motion->pose.orientation.w,
-            motion->pose.orientation.x,
-            motion->pose.orientation.y,
-            motion->pose.orientation.z
-        );
+    this->submit_pose(pose);
+}
 
-        pose.vecPosition[0] = motion->pose.position[0];
-        pose.vecPosition[1] = motion->pose.position[1];
-        pose.vecPosition[2] = motion->pose.position[2];
+void FakeViveTracker::SubmitPose(
+    const vr::DriverPose_t& pose,
+    uint64_t targetTimestampNs,
+    float predictionS,
+    const float linearVelocity[3],
+    const float angularVelocity[3]
+) {
+    if (this->object_id == vr::k_unTrackedDeviceIndexInvalid) {
+        return;
     }
 
-    this->submit_pose(pose);
+    this->submit_predicted_pose(
+        pose, targetTimestampNs, predictionS, linearVelocity, angularVelocity
+    );
 }
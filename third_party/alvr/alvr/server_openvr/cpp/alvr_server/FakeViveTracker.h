@@ -10,7 +10,15 @@
 class FakeViveTracker : public TrackedDevice {
 public:
     FakeViveTracker(uint64_t deviceID);
-    void OnPoseUpdated(uint64_t targetTimestampNs, const FfiDeviceMotion* motion);
+    // Poses are built for all trackers at once by BodyTrackers
+    void SubmitPose(const vr::DriverPose_t& pose);
+    void SubmitPose(
+        const vr::DriverPose_t& pose,
+        uint64_t targetTimestampNs,
+        float predictionS,
+        const float linearVelocity[3],
+        const float angularVelocity[3]
+    );
 
 private:
     // TrackedDevice
@@ -0,0 +1,35 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "FrameBudget.h"
+#include "bindings.h"
+#include <atomic>
+#include <chrono>
+
+namespace {
+// The congestion controller refreshes the budget while it is congested, a budget it stopped
+// updating would keep frames small for no reason
+const uint64_t BUDGET_TIMEOUT_US = 1'000'000;
+
+std::atomic<uint32_t> g_budgetBytes { 0 };
+std::atomic<uint64_t> g_budgetTimeUs { 0 };
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+}
+
+void SetEncoderFrameBudget(unsigned int maxFrameBytes) {
+    g_budgetBytes = maxFrameBytes;
+    g_budgetTimeUs = nowUs();
+}
+
+uint32_t GetEncoderFrameBudget() {
+    if (nowUs() - g_budgetTimeUs > BUDGET_TIMEOUT_US) {
+        return 0;
+    }
+    return g_budgetBytes;
+}
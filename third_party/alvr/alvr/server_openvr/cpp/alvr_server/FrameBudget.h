@@ -0,0 +1,10 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Frame size budget set by SetEncoderFrameBudget, in bytes. Returns 0 if there is none or it
+// expired, the encoders then only follow the bitrate.
+uint32_t GetEncoderFrameBudget();
@@ -0,0 +1,195 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "FrameIncidents.h"
+#include "DriverMetrics.h"
+#include "FrameTrace.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+namespace {
+// Weight of a new sample in the usual times
+const double AVERAGE_WEIGHT = 0.05;
+const uint32_t RING_SIZE = 64;
+// A present that comes more than this many refreshes after the previous one is a game frame the
+// compositor had to repeat
+const double GAME_LATE_INTERVAL = 1.5;
+
+std::atomic_bool g_polled { false };
+
+std::mutex g_mutex;
+uint64_t g_vsyncNs = 0;
+uint64_t g_periodNs = 0;
+int64_t g_serverToClientNs = 0;
+uint64_t g_networkLatencyNs = 0;
+uint64_t g_decodeNs = 0;
+
+// Usual value of each cause, 0 until the first frame. GAME_LATE and COMPOSITOR_LATE share the
+// lateness of the present relative to the target timestamp.
+double g_usual[FRAME_INCIDENT_CAUSE_COUNT] = {};
+bool g_haveUsual = false;
+double g_lateSlots = 0;
+uint64_t g_lastReceiveNs = 0;
+// Of the last frame sent, for the drops
+double g_lastExcess[FRAME_INCIDENT_CAUSE_COUNT] = {};
+FfiFrameTrace g_lastTrace = {};
+
+FfiFrameIncident g_ring[RING_SIZE];
+uint64_t g_ringCount = 0;
+
+int64_t FloorDiv(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    if (value % divisor != 0 && value < 0) {
+        quotient--;
+    }
+    return quotient;
+}
+
+double Elapsed(uint64_t fromNs, uint64_t toNs) {
+    return fromNs != 0 && toNs > fromNs ? (double)(toNs - fromNs) : 0.0;
+}
+
+// Under g_mutex
+void record(
+    const FfiFrameTrace& trace,
+    FfiFrameIncidentCause cause,
+    uint32_t lateSlots,
+    uint32_t droppedPresents,
+    double excessNs
+) {
+    FfiFrameIncident& incident = g_ring[g_ringCount % RING_SIZE];
+    incident.targetTimestampNs = trace.targetTimestampNs;
+    incident.timeNs = FrameTraceNow();
+    incident.cause = cause;
+    incident.lateSlots = lateSlots;
+    incident.droppedPresents = droppedPresents;
+    incident.excessNs = excessNs > 0 ? (uint64_t)excessNs : 0;
+    std::copy(std::begin(trace.stageNs), std::end(trace.stageNs), incident.stageNs);
+    g_ringCount++;
+
+    MetricsCount(
+        (FfiDriverCounter)(DRIVER_COUNTER_INCIDENT_GAME_LATE + cause),
+        droppedPresents != 0 ? droppedPresents : 1
+    );
+}
+}
+
+bool FrameIncidentsEnabled() {
+    return g_polled.load(std::memory_order_relaxed) || DriverMetricsEnabled();
+}
+
+void FrameIncidentsSetClient(
+    uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_vsyncNs = vsyncNs;
+    g_periodNs = periodNs;
+    g_serverToClientNs = serverToClientNs;
+    g_networkLatencyNs = networkLatencyNs;
+}
+
+void FrameIncidentsSetClientDecode(uint64_t frameDecodeNs) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_decodeNs = frameDecodeNs;
+}
+
+void FrameIncidentsOnFrame(const FfiFrameTrace& trace) {
+    const unsigned long long* stage = trace.stageNs;
+    uint64_t receiveNs = stage[FRAME_TRACE_IPC_RECEIVE];
+    uint64_t sendNs = stage[FRAME_TRACE_VIDEO_SEND];
+    if (receiveNs == 0 || sendNs == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_periodNs == 0) {
+        return;
+    }
+    int64_t period = (int64_t)g_periodNs;
+
+    // The compositor passes of the driver run from the pose match, Windows marks them as the
+    // render, Linux and the software encoders mark the end of the conversion
+    uint64_t convertStartNs = stage[FRAME_TRACE_POSE_MATCH] ? stage[FRAME_TRACE_POSE_MATCH]
+                                                            : receiveNs;
+    uint64_t convertEndNs
+        = std::max(stage[FRAME_TRACE_RENDER_END], stage[FRAME_TRACE_FORMAT_CONVERT]);
+    if (convertEndNs == 0) {
+        convertEndNs = stage[FRAME_TRACE_ENCODE_SUBMIT];
+    }
+    uint64_t encodedNs
+        = stage[FRAME_TRACE_ENCODE_COMPLETE] ? stage[FRAME_TRACE_ENCODE_COMPLETE] : sendNs;
+    double transportNs = g_networkLatencyNs > g_decodeNs
+        ? (double)(g_networkLatencyNs - g_decodeNs)
+        : 0.0;
+
+    double value[FRAME_INCIDENT_CAUSE_COUNT];
+    value[FRAME_INCIDENT_GAME_LATE]
+        = (double)((int64_t)receiveNs + g_serverToClientNs - (int64_t)trace.targetTimestampNs);
+    value[FRAME_INCIDENT_COMPOSITOR_LATE] = value[FRAME_INCIDENT_GAME_LATE];
+    value[FRAME_INCIDENT_CONVERT_OVER_BUDGET] = Elapsed(convertStartNs, convertEndNs);
+    value[FRAME_INCIDENT_ENCODER_OVER_BUDGET]
+        = Elapsed(stage[FRAME_TRACE_ENCODE_SUBMIT], stage[FRAME_TRACE_ENCODE_COMPLETE]);
+    value[FRAME_INCIDENT_SEND_BACKPRESSURE] = Elapsed(encodedNs, sendNs) + transportNs;
+    value[FRAME_INCIDENT_CLIENT_DECODE_LATE] = (double)g_decodeNs;
+
+    if (!g_haveUsual) {
+        std::copy(std::begin(value), std::end(value), g_usual);
+        g_haveUsual = true;
+    }
+    double excess[FRAME_INCIDENT_CAUSE_COUNT];
+    for (int i = 0; i < FRAME_INCIDENT_CAUSE_COUNT; i++) {
+        excess[i] = value[i] - g_usual[i];
+        g_usual[i] += AVERAGE_WEIGHT * (value[i] - g_usual[i]);
+    }
+    // Only one of the two causes of a late present applies
+    bool gameLate = g_lastReceiveNs != 0 && receiveNs > g_lastReceiveNs
+        && (double)(receiveNs - g_lastReceiveNs) > GAME_LATE_INTERVAL * (double)period;
+    excess[gameLate ? FRAME_INCIDENT_COMPOSITOR_LATE : FRAME_INCIDENT_GAME_LATE] = 0;
+    g_lastReceiveNs = receiveNs;
+
+    // The display slot of the frame and the one it reaches the client for, as in FramePacer
+    int64_t arrival = (int64_t)sendNs + g_serverToClientNs + (int64_t)g_networkLatencyNs;
+    int64_t targetSlot
+        = FloorDiv((int64_t)trace.targetTimestampNs - (int64_t)g_vsyncNs + period / 2, period);
+    int64_t arrivalSlot = -FloorDiv((int64_t)g_vsyncNs - arrival, period);
+    int64_t lateSlots = arrivalSlot - targetSlot;
+    bool late = lateSlots > 0 && (double)lateSlots > g_lateSlots + 0.5;
+    g_lateSlots += AVERAGE_WEIGHT * ((double)(lateSlots > 0 ? lateSlots : 0) - g_lateSlots);
+
+    std::copy(std::begin(excess), std::end(excess), g_lastExcess);
+    g_lastTrace = trace;
+
+    if (late) {
+        int cause = (int)(std::max_element(std::begin(excess), std::end(excess)) - excess);
+        record(trace, (FfiFrameIncidentCause)cause, (uint32_t)lateSlots, 0, excess[cause]);
+    }
+}
+
+void FrameIncidentsOnPresentsDropped(uint32_t count) {
+    if (count == 0 || !FrameIncidentsEnabled()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    // Only the stages of the encoder loop keep it from taking the presents
+    FfiFrameIncidentCause cause = FRAME_INCIDENT_ENCODER_OVER_BUDGET;
+    for (FfiFrameIncidentCause loopCause :
+         { FRAME_INCIDENT_CONVERT_OVER_BUDGET, FRAME_INCIDENT_SEND_BACKPRESSURE }) {
+        if (g_lastExcess[loopCause] > g_lastExcess[cause]) {
+            cause = loopCause;
+        }
+    }
+    record(g_lastTrace, cause, 0, count, g_lastExcess[cause]);
+}
+
+unsigned int GetFrameIncidents(FfiFrameIncident* out, unsigned int maxCount) {
+    g_polled.store(true, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    uint64_t count = std::min<uint64_t>({ maxCount, g_ringCount, RING_SIZE });
+    for (uint64_t i = 0; i < count; i++) {
+        out[i] = g_ring[(g_ringCount - count + i) % RING_SIZE];
+    }
+    return (unsigned int)count;
+}
@@ -0,0 +1,32 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "bindings.h"
+#include <stdint.h>
+
+// Attributes the frames that reach the client after their display slot, and the presents the
+// encoder drops, to the stage that held them up. Each stage of a committed frame trace is compared
+// with its usual time, a moving average, and the one furthest beyond it is the cause. Frames are
+// late when they arrive more refreshes after their slot than usual, like for FramePacer. The client
+// part only comes as the recent averages it reports, a single frame slowed down in transport or
+// decode is not told apart from the others.
+//
+// Times are in the FrameTraceNow() clock unless noted.
+
+// Whether the frames are traced and classified, once the metrics or the incidents are read
+bool FrameIncidentsEnabled();
+
+// Client display timing, as given to SetClientTiming
+void FrameIncidentsSetClient(
+    uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+);
+// Decode time of the recent frames on the client, part of the network latency
+void FrameIncidentsSetClientDecode(uint64_t frameDecodeNs);
+
+// Called by FrameTraceCommit with each frame sent
+void FrameIncidentsOnFrame(const FfiFrameTrace& trace);
+// Presents superseded by a newer one before the encoder took them. The encoder loop was held up
+// by the stages of the frames before, the last one sent stands for them.
+void FrameIncidentsOnPresentsDropped(uint32_t count);
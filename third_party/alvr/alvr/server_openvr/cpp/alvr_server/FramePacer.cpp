@@ -0,0 +1,145 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "FramePacer.h"
+#include "DriverMetrics.h"
+#include "Logger.h"
+#include "Settings.h"
+#include <algorithm>
+
+namespace {
+
+int64_t FloorDiv(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    if (value % divisor != 0 && value < 0) {
+        quotient--;
+    }
+    return quotient;
+}
+
+} // namespace
+
+FramePacer::FramePacer()
+    : m_halfRateFallback(Settings::Instance().m_halfRateFallback) { }
+
+void FramePacer::SetClientTiming(
+    uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_vsyncNs = vsyncNs;
+    m_periodNs = periodNs;
+    m_serverToClientNs = serverToClientNs;
+    m_networkLatencyNs = networkLatencyNs;
+}
+
+void FramePacer::OnFrameEncoded(uint64_t encodeNs) {
+    MetricsRecordEncode(encodeNs);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_encodeNs == 0) {
+        m_encodeNs = (double)encodeNs;
+    } else {
+        m_encodeNs += AVERAGE_WEIGHT * ((double)encodeNs - m_encodeNs);
+    }
+}
+
+void FramePacer::OnFrameComposed(uint64_t composeNs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_composeNs == 0) {
+        m_composeNs = (double)composeNs;
+    } else {
+        m_composeNs += AVERAGE_WEIGHT * ((double)composeNs - m_composeNs);
+    }
+}
+
+uint64_t FramePacer::GetComposeDelay(uint64_t targetTimestampNs, uint64_t nowNs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_periodNs == 0 || m_encodeNs == 0 || m_composeNs == 0) {
+        return 0;
+    }
+
+    // The vsync of the display slot of the frame, as in ShouldEncode, back to the server clock
+    int64_t period = (int64_t)m_periodNs;
+    int64_t targetSlot
+        = FloorDiv((int64_t)targetTimestampNs - (int64_t)m_vsyncNs + period / 2, period);
+    int64_t slotVsync = (int64_t)m_vsyncNs + targetSlot * period - m_serverToClientNs;
+    int64_t latestStart = slotVsync - COMPOSE_MARGIN_NS - (int64_t)m_networkLatencyNs
+        - (int64_t)m_encodeNs - (int64_t)m_composeNs;
+    int64_t delay = latestStart - (int64_t)nowNs;
+    if (delay <= 0) {
+        return 0;
+    }
+    return (uint64_t)std::min(delay, period / 2);
+}
+
+bool FramePacer::ShouldEncode(uint64_t targetTimestampNs, uint64_t nowNs, bool idr) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_periodNs == 0 || m_encodeNs == 0) {
+        return true;
+    }
+
+    int64_t period = (int64_t)m_periodNs;
+    int64_t arrival = (int64_t)nowNs + m_serverToClientNs + (int64_t)m_encodeNs
+        + (int64_t)m_networkLatencyNs;
+    // The frame is meant for the vsync nearest to its target timestamp, and is shown at the first
+    // vsync after it arrives
+    int64_t targetSlot
+        = FloorDiv((int64_t)targetTimestampNs - (int64_t)m_vsyncNs + period / 2, period);
+    int64_t arrivalSlot = -FloorDiv((int64_t)m_vsyncNs - arrival, period);
+    int64_t lateSlots = arrivalSlot - targetSlot;
+
+    bool skip;
+    bool cadence = m_halfRate;
+    if (m_halfRate) {
+        // The encoder gets two refreshes per frame, late frames are no reason to skip more
+        skip = !idr && (targetSlot & 1) != 0;
+        if (m_encodeNs < FULL_RATE_ENCODE_RATIO * period && m_lateSlots < AVERAGE_WEIGHT
+            && nowNs - m_halfRateStartNs > MIN_HALF_RATE_NS) {
+            setHalfRate(false, nowNs);
+        }
+    } else {
+        // Arriving late every frame means the client's latency prediction is off, skipping would
+        // only halve the frame rate. Only frames later than usual are skipped.
+        skip = !idr && !m_skipped && lateSlots > 0 && (double)lateSlots > m_lateSlots + 0.5;
+        m_skipRatio += AVERAGE_WEIGHT * ((skip ? 1.0 : 0.0) - m_skipRatio);
+        if (m_halfRateFallback
+            && (m_encodeNs > HALF_RATE_ENCODE_RATIO * period
+                || m_skipRatio > HALF_RATE_SKIP_RATIO)) {
+            setHalfRate(true, nowNs);
+        }
+    }
+    m_lateSlots += AVERAGE_WEIGHT * ((double)(lateSlots > 0 ? lateSlots : 0) - m_lateSlots);
+    m_skipped = skip;
+
+    if (skip) {
+        MetricsCount(DRIVER_COUNTER_FRAMES_SKIPPED);
+    }
+    if (skip && !cadence) {
+        Debug(
+            "FramePacer: skipping frame %llu, %lld refreshes late\n",
+            (unsigned long long)targetTimestampNs,
+            (long long)lateSlots
+        );
+    }
+    return !skip;
+}
+
+void FramePacer::Reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_encodeNs = 0;
+    m_lateSlots = 0;
+    m_skipped = false;
+    if (m_halfRate) {
+        setHalfRate(false, 0);
+    }
+}
+
+void FramePacer::setHalfRate(bool enabled, uint64_t nowNs) {
+    m_halfRate = enabled;
+    m_halfRateStartNs = nowNs;
+    m_skipRatio = 0;
+    Info(
+        "FramePacer: %s, encode %.1f ms per frame\n",
+        enabled ? "switching to half rate" : "back to full rate",
+        m_encodeNs / 1e6
+    );
+}
@@ -0,0 +1,76 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+
+// Skips frames before they are encoded when they can't reach the client before the display slot
+// they were rendered for. Such a frame is shown at least one refresh late anyway, and skipping it
+// gives the encoder and the network back the time the following frame needs to be on time.
+//
+// Times are in the FrameTraceNow() clock unless noted. Pacing stays off until the client timing is
+// known, and never skips IDR frames or two frames in a row.
+//
+// With half_rate_fallback, an encoder that can't keep up switches to half rate instead: only the
+// frames of even display slots are encoded, so the client gets a frame every other refresh at a
+// fixed cadence and its reprojection fills the others.
+//
+// With jit_composition, the composition of a presented frame waits until just enough time is left
+// to compose, encode and send it for its display slot, so that late latching picks a newer pose.
+class FramePacer {
+public:
+    FramePacer();
+
+    // vsyncNs is the time of any client vsync in the clock of the target timestamps,
+    // serverToClientNs converts FrameTraceNow() times to that clock. networkLatencyNs is the
+    // transport and decode time of the recent frames, as measured by the client.
+    void SetClientTiming(
+        uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+    );
+    // Time from encode submission to the bitstream being sent
+    void OnFrameEncoded(uint64_t encodeNs);
+    // Time from the present to the composed frame being handed to the encoder
+    void OnFrameComposed(uint64_t composeNs);
+    // How long a frame presented at nowNs can wait before it is composed. 0 without the client
+    // timing or the encode and compose times, or for a frame that is already late.
+    uint64_t GetComposeDelay(uint64_t targetTimestampNs, uint64_t nowNs);
+    // Whether a frame that starts encoding at nowNs should be encoded and sent
+    bool ShouldEncode(uint64_t targetTimestampNs, uint64_t nowNs, bool idr);
+    void Reset();
+
+private:
+    // Weight of a new sample in the encode time and lateness averages
+    static constexpr double AVERAGE_WEIGHT = 0.1;
+    // Half rate starts above either ratio, of the encode time to the refresh period or of the
+    // frames skipped for being late
+    static constexpr double HALF_RATE_ENCODE_RATIO = 0.9;
+    static constexpr double HALF_RATE_SKIP_RATIO = 0.2;
+    // And ends below this encode ratio without late frames, after at least MIN_HALF_RATE_NS
+    static constexpr double FULL_RATE_ENCODE_RATIO = 0.6;
+    static constexpr uint64_t MIN_HALF_RATE_NS = 2'000'000'000;
+    // Left before the display slot for the variation of the encode and network times and the
+    // precision of the wait. The wait never exceeds half a period, the game renders meanwhile.
+    static constexpr int64_t COMPOSE_MARGIN_NS = 2'000'000;
+
+    void setHalfRate(bool enabled, uint64_t nowNs);
+
+    bool m_halfRateFallback;
+
+    std::mutex m_mutex;
+    uint64_t m_vsyncNs = 0;
+    uint64_t m_periodNs = 0;
+    int64_t m_serverToClientNs = 0;
+    uint64_t m_networkLatencyNs = 0;
+    double m_encodeNs = 0;
+    double m_composeNs = 0;
+    // Usual number of refreshes between the display slot of a frame and its arrival. The pose
+    // prediction of the client should keep it at 0, a skip is only worth it above that.
+    double m_lateSlots = 0;
+    bool m_skipped = false;
+    // Fraction of the recent frames skipped for being late
+    double m_skipRatio = 0;
+    bool m_halfRate = false;
+    uint64_t m_halfRateStartNs = 0;
+};
@@ -0,0 +1,163 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "FrameTrace.h"
+#include "FrameIncidents.h"
+#include <atomic>
+#include <chrono>
+
+namespace {
+const uint32_t OPEN_RECORDS = 16;
+const uint32_t QUEUE_SIZE = 256;
+
+// Frames between their first mark and their commit
+struct OpenRecord {
+    std::atomic<uint64_t> targetTimestampNs { 0 };
+    std::atomic<uint64_t> stageNs[FRAME_TRACE_STAGE_COUNT] = {};
+};
+
+// Bounded multi-producer multi-consumer queue. Each cell carries a sequence number that tells
+// whether it is free for the enqueue position or filled for the dequeue position.
+class TraceQueue {
+public:
+    TraceQueue() {
+        for (uint32_t i = 0; i < QUEUE_SIZE; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool Push(const FfiFrameTrace& trace) {
+        uint64_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &m_cells[pos % QUEUE_SIZE];
+            uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)sequence - (int64_t)pos;
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->trace = trace;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(FfiFrameTrace& trace) {
+        uint64_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &m_cells[pos % QUEUE_SIZE];
+            uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)sequence - (int64_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        trace = cell->trace;
+        cell->sequence.store(pos + QUEUE_SIZE, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        FfiFrameTrace trace;
+    };
+
+    Cell m_cells[QUEUE_SIZE];
+    std::atomic<uint64_t> m_enqueuePos { 0 };
+    std::atomic<uint64_t> m_dequeuePos { 0 };
+};
+
+// Set by DrainFrameTraces, the frames are also recorded for FrameIncidents
+std::atomic_bool g_draining { false };
+OpenRecord g_records[OPEN_RECORDS];
+TraceQueue g_queue;
+
+bool recording() { return g_draining.load(std::memory_order_relaxed) || FrameIncidentsEnabled(); }
+
+OpenRecord& recordFor(uint64_t targetTimestampNs) {
+    // Fibonacci hashing, target timestamps are spaced by a whole number of frame intervals
+    return g_records[(targetTimestampNs * 0x9E3779B97F4A7C15ull) >> 60];
+}
+}
+
+uint64_t FrameTraceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+void FrameTraceMark(uint64_t targetTimestampNs, FfiFrameTraceStage stage, uint64_t timeNs) {
+    if (targetTimestampNs == 0 || !recording()) {
+        return;
+    }
+
+    OpenRecord& record = recordFor(targetTimestampNs);
+    uint64_t current = record.targetTimestampNs.load(std::memory_order_acquire);
+    if (current != targetTimestampNs) {
+        // Take over the slot from an older frame that was never committed. A mark of the new
+        // frame racing with this can be lost, which is acceptable for tracing.
+        if (record.targetTimestampNs.compare_exchange_strong(current, targetTimestampNs)) {
+            for (auto& stageNs : record.stageNs) {
+                stageNs.store(0, std::memory_order_relaxed);
+            }
+        } else if (current != targetTimestampNs) {
+            return;
+        }
+    }
+
+    record.stageNs[stage].store(timeNs ? timeNs : FrameTraceNow(), std::memory_order_relaxed);
+}
+
+void FrameTraceCommit(uint64_t targetTimestampNs) {
+    if (targetTimestampNs == 0 || !recording()) {
+        return;
+    }
+
+    OpenRecord& record = recordFor(targetTimestampNs);
+    if (record.targetTimestampNs.load(std::memory_order_acquire) != targetTimestampNs) {
+        return;
+    }
+
+    FfiFrameTrace trace;
+    trace.targetTimestampNs = targetTimestampNs;
+    for (uint32_t i = 0; i < FRAME_TRACE_STAGE_COUNT; i++) {
+        trace.stageNs[i] = record.stageNs[i].load(std::memory_order_relaxed);
+    }
+
+    // Release the slot, unless a newer frame took it over while copying
+    uint64_t current = targetTimestampNs;
+    if (!record.targetTimestampNs.compare_exchange_strong(current, 0)) {
+        return;
+    }
+    if (g_draining.load(std::memory_order_relaxed)) {
+        g_queue.Push(trace);
+    }
+    if (FrameIncidentsEnabled()) {
+        FrameIncidentsOnFrame(trace);
+    }
+}
+
+unsigned int DrainFrameTraces(FfiFrameTrace* out, unsigned int maxCount) {
+    g_draining.store(true, std::memory_order_relaxed);
+
+    unsigned int count = 0;
+    while (count < maxCount && g_queue.Pop(out[count])) {
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,21 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "bindings.h"
+#include <stdint.h>
+
+// Per-frame stage timing, drained with DrainFrameTraces. Records are keyed by the target
+// timestamp of the frame and cost a couple of atomic loads until the transport starts draining or
+// the frame incidents are classified.
+
+// Steady clock, the time base of all the stages
+uint64_t FrameTraceNow();
+
+// Records the end of `stage` for a frame, at `timeNs` or now if 0. Safe to call from any thread,
+// a frame that is never committed is overwritten by a later one.
+void FrameTraceMark(uint64_t targetTimestampNs, FfiFrameTraceStage stage, uint64_t timeNs = 0);
+
+// Closes the record of a frame and queues it for DrainFrameTraces. Dropped if the queue is full.
+void FrameTraceCommit(uint64_t targetTimestampNs);
@@ -0,0 +1,453 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "GpuEngineUsage.h"
+#include "DriverMetrics.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winternl.h>
+#include <d3dkmthk.h>
+#else
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fstream>
+#include <set>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const auto SAMPLE_INTERVAL = std::chrono::seconds(1);
+
+// In the order of their DRIVER_GAUGE_GPU_*_BUSY gauge
+enum GpuEngine {
+    ENGINE_3D,
+    ENGINE_COMPUTE,
+    ENGINE_COPY,
+    ENGINE_VIDEO_ENCODE,
+    ENGINE_VIDEO_DECODE,
+    ENGINE_COUNT,
+};
+
+// Running time of the engines of each class since they started, summed over the engines
+struct EngineTimes {
+    uint64_t busyNs[ENGINE_COUNT] = {};
+    bool known[ENGINE_COUNT] = {};
+};
+
+// Utilization averaged by NVML over its own sampling period, as a share
+struct EngineShares {
+    double share[ENGINE_COUNT] = {};
+    bool known[ENGINE_COUNT] = {};
+    // Whole GPU, every process
+    double encoderUtilization = -1.0;
+};
+
+#ifdef _WIN32
+uint32_t ProcessId() { return GetCurrentProcessId(); }
+
+void* LoadLib(const char* name) { return (void*)LoadLibraryA(name); }
+void* LoadSym(void* lib, const char* name) { return (void*)GetProcAddress((HMODULE)lib, name); }
+void CloseLib(void* lib) { FreeLibrary((HMODULE)lib); }
+const char* NVML_LIBRARY = "nvml.dll";
+#else
+uint32_t ProcessId() { return (uint32_t)getpid(); }
+
+void* LoadLib(const char* name) { return dlopen(name, RTLD_LAZY); }
+void* LoadSym(void* lib, const char* name) { return dlsym(lib, name); }
+void CloseLib(void* lib) { dlclose(lib); }
+const char* NVML_LIBRARY = "libnvidia-ml.so.1";
+#endif
+
+// The few NVML entry points used, loaded at runtime so that the driver doesn't depend on the
+// NVIDIA driver being installed
+class NvmlSampler {
+public:
+    ~NvmlSampler() {
+        if (m_shutdown) {
+            m_shutdown();
+        }
+        if (m_lib) {
+            CloseLib(m_lib);
+        }
+    }
+
+    bool Open() {
+        m_lib = LoadLib(NVML_LIBRARY);
+        if (!m_lib) {
+            return false;
+        }
+        auto init = (int (*)())LoadSym(m_lib, "nvmlInit_v2");
+        auto getCount = (int (*)(unsigned int*))LoadSym(m_lib, "nvmlDeviceGetCount_v2");
+        auto getHandle
+            = (int (*)(unsigned int, Device*))LoadSym(m_lib, "nvmlDeviceGetHandleByIndex_v2");
+        m_processUtilization = (decltype(m_processUtilization)
+        )LoadSym(m_lib, "nvmlDeviceGetProcessUtilization");
+        m_encoderUtilization = (decltype(m_encoderUtilization)
+        )LoadSym(m_lib, "nvmlDeviceGetEncoderUtilization");
+        if (!init || !getCount || !getHandle || !m_processUtilization || !m_encoderUtilization
+            || init() != NVML_SUCCESS) {
+            return false;
+        }
+        m_shutdown = (int (*)())LoadSym(m_lib, "nvmlShutdown");
+
+        unsigned int count = 0;
+        getCount(&count);
+        for (unsigned int i = 0; i < count; i++) {
+            Device device;
+            if (getHandle(i, &device) == NVML_SUCCESS) {
+                m_devices.push_back({ device, 0 });
+            }
+        }
+        return !m_devices.empty();
+    }
+
+    // The process is looked up on every GPU, the first one it runs on is reported
+    void Sample(EngineShares& shares) {
+        uint32_t pid = ProcessId();
+        for (DeviceState& state : m_devices) {
+            unsigned int count = 0;
+            // Sizes the sample array, returns NVML_ERROR_INSUFFICIENT_SIZE
+            m_processUtilization(state.device, nullptr, &count, state.lastSeenUs);
+            if (count == 0) {
+                continue;
+            }
+            m_samples.resize(count);
+            if (m_processUtilization(state.device, m_samples.data(), &count, state.lastSeenUs)
+                != NVML_SUCCESS) {
+                continue;
+            }
+
+            uint64_t sm = 0, enc = 0, dec = 0, samples = 0;
+            for (unsigned int i = 0; i < count; i++) {
+                const ProcessSample& sample = m_samples[i];
+                state.lastSeenUs = std::max(state.lastSeenUs, sample.timeStamp);
+                if (sample.pid == pid) {
+                    sm += sample.smUtil;
+                    enc += sample.encUtil;
+                    dec += sample.decUtil;
+                    samples++;
+                }
+            }
+            if (samples == 0) {
+                continue;
+            }
+            // The SMs run both the 3D and the compute work
+            shares.share[ENGINE_3D] = sm / (100.0 * samples);
+            shares.share[ENGINE_VIDEO_ENCODE] = enc / (100.0 * samples);
+            shares.share[ENGINE_VIDEO_DECODE] = dec / (100.0 * samples);
+            shares.known[ENGINE_3D] = true;
+            shares.known[ENGINE_VIDEO_ENCODE] = true;
+            shares.known[ENGINE_VIDEO_DECODE] = true;
+
+            unsigned int utilization, periodUs;
+            if (m_encoderUtilization(state.device, &utilization, &periodUs) == NVML_SUCCESS) {
+                shares.encoderUtilization = utilization / 100.0;
+            }
+            return;
+        }
+    }
+
+private:
+    static const int NVML_SUCCESS = 0;
+    typedef struct nvmlDevice_st* Device;
+    // nvmlProcessUtilizationSample_t
+    struct ProcessSample {
+        unsigned int pid;
+        unsigned long long timeStamp;
+        unsigned int smUtil;
+        unsigned int memUtil;
+        unsigned int encUtil;
+        unsigned int decUtil;
+    };
+    struct DeviceState {
+        Device device;
+        // Samples up to this NVML timestamp were already counted
+        unsigned long long lastSeenUs;
+    };
+
+    void* m_lib = nullptr;
+    int (*m_shutdown)() = nullptr;
+    int (*m_processUtilization)(Device, ProcessSample*, unsigned int*, unsigned long long)
+        = nullptr;
+    int (*m_encoderUtilization)(Device, unsigned int*, unsigned int*) = nullptr;
+    std::vector<DeviceState> m_devices;
+    std::vector<ProcessSample> m_samples;
+};
+
+#ifdef _WIN32
+int ClassifyKmtNode(const DXGK_NODEMETADATA& node) {
+    // Compute queues have their own nodes on some GPUs, of the 3D or the other type
+    bool compute = wcsstr(node.FriendlyName, L"Compute") != nullptr;
+    switch (node.EngineType) {
+    case DXGK_ENGINE_TYPE_3D:
+        return compute ? ENGINE_COMPUTE : ENGINE_3D;
+    case DXGK_ENGINE_TYPE_VIDEO_DECODE:
+        return ENGINE_VIDEO_DECODE;
+    case DXGK_ENGINE_TYPE_VIDEO_ENCODE:
+        return ENGINE_VIDEO_ENCODE;
+    case DXGK_ENGINE_TYPE_COPY:
+        return ENGINE_COPY;
+    case DXGK_ENGINE_TYPE_OTHER:
+        return compute ? ENGINE_COMPUTE : -1;
+    default:
+        return -1;
+    }
+}
+
+// Running time of the process on each node of the adapter, the same numbers as the GPU engine
+// columns of the task manager
+class EngineSampler {
+public:
+    ~EngineSampler() {
+        if (m_adapter) {
+            D3DKMT_CLOSEADAPTER close = {};
+            close.hAdapter = m_adapter;
+            m_closeAdapter(&close);
+        }
+    }
+
+    bool Open(uint64_t adapterLuid) {
+        HMODULE gdi32 = GetModuleHandleW(L"GDI32");
+        if (!gdi32) {
+            return false;
+        }
+        auto openAdapter = (NTSTATUS(APIENTRY*)(D3DKMT_OPENADAPTERFROMLUID*)
+        )GetProcAddress(gdi32, "D3DKMTOpenAdapterFromLuid");
+        auto queryAdapterInfo = (NTSTATUS(APIENTRY*)(const D3DKMT_QUERYADAPTERINFO*)
+        )GetProcAddress(gdi32, "D3DKMTQueryAdapterInfo");
+        m_closeAdapter = (decltype(m_closeAdapter))GetProcAddress(gdi32, "D3DKMTCloseAdapter");
+        m_queryStatistics
+            = (decltype(m_queryStatistics))GetProcAddress(gdi32, "D3DKMTQueryStatistics");
+        if (!openAdapter || !queryAdapterInfo || !m_closeAdapter || !m_queryStatistics) {
+            return false;
+        }
+
+        D3DKMT_OPENADAPTERFROMLUID open = {};
+        open.AdapterLuid.LowPart = (DWORD)adapterLuid;
+        open.AdapterLuid.HighPart = (LONG)(adapterLuid >> 32);
+        if (openAdapter(&open) != 0) {
+            return false;
+        }
+        m_adapter = open.hAdapter;
+        m_luid = open.AdapterLuid;
+
+        D3DKMT_QUERYSTATISTICS query = {};
+        query.Type = D3DKMT_QUERYSTATISTICS_ADAPTER;
+        query.AdapterLuid = m_luid;
+        if (m_queryStatistics(&query) != 0) {
+            return false;
+        }
+        for (ULONG i = 0; i < query.QueryResult.AdapterInformation.NodeCount; i++) {
+            D3DKMT_NODEMETADATA metadata = {};
+            metadata.NodeOrdinalAndAdapterIndex = i;
+            D3DKMT_QUERYADAPTERINFO info = {};
+            info.hAdapter = m_adapter;
+            info.Type = KMTQAITYPE_NODEMETADATA;
+            info.pPrivateDriverData = &metadata;
+            info.PrivateDriverDataSize = sizeof(metadata);
+            m_nodes.push_back(
+                queryAdapterInfo(&info) == 0 ? ClassifyKmtNode(metadata.NodeData) : -1
+            );
+        }
+        return true;
+    }
+
+    void Sample(EngineTimes& times) {
+        for (ULONG i = 0; i < m_nodes.size(); i++) {
+            if (m_nodes[i] < 0) {
+                continue;
+            }
+            D3DKMT_QUERYSTATISTICS query = {};
+            query.Type = D3DKMT_QUERYSTATISTICS_PROCESS_NODE;
+            query.AdapterLuid = m_luid;
+            query.hProcess = GetCurrentProcess();
+            query.QueryProcessNode.NodeId = i;
+            if (m_queryStatistics(&query) == 0) {
+                // In 100 ns units
+                times.busyNs[m_nodes[i]]
+                    += query.QueryResult.ProcessNodeInformation.RunningTime.QuadPart * 100;
+                times.known[m_nodes[i]] = true;
+            }
+        }
+    }
+
+private:
+    NTSTATUS(APIENTRY* m_closeAdapter)(const D3DKMT_CLOSEADAPTER*) = nullptr;
+    NTSTATUS(APIENTRY* m_queryStatistics)(const D3DKMT_QUERYSTATISTICS*) = nullptr;
+    D3DKMT_HANDLE m_adapter = 0;
+    LUID m_luid = {};
+    // GpuEngine of each node, -1 for the ones not reported
+    std::vector<int> m_nodes;
+};
+#else
+// Engine names of the drm-engine-<name> keys of amdgpu, i915 and the other drivers following
+// the DRM client usage stats
+int ClassifyDrmEngine(const std::string& name) {
+    if (name == "gfx" || name == "render") {
+        return ENGINE_3D;
+    }
+    if (name == "compute") {
+        return ENGINE_COMPUTE;
+    }
+    if (name == "dma" || name == "copy") {
+        return ENGINE_COPY;
+    }
+    // The i915 video engines both encode and decode, the session only encodes
+    if (name.rfind("enc", 0) == 0 || name == "video") {
+        return ENGINE_VIDEO_ENCODE;
+    }
+    if (name == "dec") {
+        return ENGINE_VIDEO_DECODE;
+    }
+    return -1;
+}
+
+// Sums the DRM fdinfo of the process, every open DRM client counted once even if several file
+// descriptors share it
+class EngineSampler {
+public:
+    bool Open(uint64_t) { return true; }
+
+    void Sample(EngineTimes& times) {
+        DIR* dir = opendir("/proc/self/fdinfo");
+        if (!dir) {
+            return;
+        }
+        std::set<std::string> clients;
+        while (dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            std::ifstream file(std::string("/proc/self/fdinfo/") + entry->d_name);
+            std::string line, client, pdev;
+            std::vector<std::pair<int, uint64_t>> engines;
+            while (std::getline(file, line)) {
+                size_t colon = line.find(':');
+                if (colon == std::string::npos) {
+                    continue;
+                }
+                std::string key = line.substr(0, colon);
+                std::string value = line.substr(colon + 1);
+                if (key == "drm-client-id") {
+                    client = value;
+                } else if (key == "drm-pdev") {
+                    pdev = value;
+                } else if (key.rfind("drm-engine-", 0) == 0
+                           && key.rfind("drm-engine-capacity-", 0) != 0) {
+                    int engine = ClassifyDrmEngine(key.substr(11));
+                    if (engine >= 0) {
+                        engines.push_back({ engine, strtoull(value.c_str(), nullptr, 10) });
+                    }
+                }
+            }
+            if (client.empty() || !clients.insert(pdev + client).second) {
+                continue;
+            }
+            for (auto& [engine, busyNs] : engines) {
+                times.busyNs[engine] += busyNs;
+                times.known[engine] = true;
+            }
+        }
+        closedir(dir);
+    }
+};
+#endif
+
+std::mutex g_mutex;
+std::condition_variable g_cv;
+std::thread g_worker;
+bool g_stop = false;
+
+void SetUnknownGauges() {
+    for (uint32_t engine = 0; engine < ENGINE_COUNT; engine++) {
+        MetricsSetGauge((FfiDriverGauge)(DRIVER_GAUGE_GPU_3D_BUSY + engine), -1.0);
+    }
+    MetricsSetGauge(DRIVER_GAUGE_GPU_PASS_BUSY, -1.0);
+    MetricsSetGauge(DRIVER_GAUGE_GPU_ENCODER_UTILIZATION, -1.0);
+}
+
+void WorkerLoop(uint64_t adapterLuid) {
+    EngineSampler engines;
+    if (!engines.Open(adapterLuid)) {
+        Debug("GPU engine statistics not available on this adapter\n");
+    }
+    NvmlSampler nvml;
+    bool hasNvml = nvml.Open();
+
+    EngineTimes previous;
+    auto previousTime = std::chrono::steady_clock::now();
+    uint64_t previousPassNs = MetricsGpuPassTotalNs();
+
+    std::unique_lock<std::mutex> lock(g_mutex);
+    while (!g_cv.wait_for(lock, SAMPLE_INTERVAL, [] { return g_stop; })) {
+        if (!DriverMetricsEnabled()) {
+            continue;
+        }
+        lock.unlock();
+
+        EngineTimes times;
+        engines.Sample(times);
+        EngineShares shares;
+        if (hasNvml) {
+            nvml.Sample(shares);
+        }
+        auto now = std::chrono::steady_clock::now();
+        uint64_t passNs = MetricsGpuPassTotalNs();
+        double intervalNs
+            = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - previousTime)
+                  .count();
+
+        for (uint32_t engine = 0; engine < ENGINE_COUNT; engine++) {
+            double busy = -1.0;
+            if (times.known[engine] && previous.known[engine]
+                && times.busyNs[engine] >= previous.busyNs[engine]) {
+                busy = (times.busyNs[engine] - previous.busyNs[engine]) / intervalNs;
+            } else if (shares.known[engine]) {
+                busy = shares.share[engine];
+            }
+            MetricsSetGauge((FfiDriverGauge)(DRIVER_GAUGE_GPU_3D_BUSY + engine), busy);
+        }
+        MetricsSetGauge(DRIVER_GAUGE_GPU_PASS_BUSY, (passNs - previousPassNs) / intervalNs);
+        MetricsSetGauge(DRIVER_GAUGE_GPU_ENCODER_UTILIZATION, shares.encoderUtilization);
+
+        previous = times;
+        previousTime = now;
+        previousPassNs = passNs;
+        lock.lock();
+    }
+}
+
+} // namespace
+
+void StartGpuEngineUsage(uint64_t adapterLuid) {
+    StopGpuEngineUsage();
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    SetUnknownGauges();
+    g_stop = false;
+    g_worker = std::thread(WorkerLoop, adapterLuid);
+}
+
+void StopGpuEngineUsage() {
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (!g_worker.joinable()) {
+            return;
+        }
+        g_stop = true;
+    }
+    g_cv.notify_one();
+    g_worker.join();
+    SetUnknownGauges();
+}
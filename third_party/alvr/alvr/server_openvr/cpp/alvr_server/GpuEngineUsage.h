@@ -0,0 +1,18 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// GPU engine time of this process, for the DRIVER_GAUGE_GPU_* gauges. A worker thread samples it
+// once per second while the driver metrics are read: D3DKMT process node statistics on Windows,
+// DRM fdinfo on Linux, and the per-process utilization of NVML on NVIDIA GPUs for the engines the
+// former don't report. The driver process streams a single session, so its engine time is the
+// session's, and the GPU time of the compositor passes is published over the same interval to be
+// set against it.
+
+// adapterLuid is the LUID of the encode adapter on Windows, ignored elsewhere. Starting again
+// restarts the sampling on the given adapter.
+void StartGpuEngineUsage(uint64_t adapterLuid);
+void StopGpuEngineUsage();
@@ -0,0 +1,66 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "GpuPassStats.h"
+#include "DriverMetrics.h"
+#include "TraceEvents.h"
+#include <atomic>
+
+namespace {
+struct PassHistogram {
+    std::atomic<uint64_t> count { 0 };
+    std::atomic<uint64_t> totalNs { 0 };
+    std::atomic<uint64_t> maxNs { 0 };
+    std::atomic<uint32_t> buckets[GPU_PASS_HISTOGRAM_BUCKETS] = {};
+};
+
+std::atomic_bool g_enabled { false };
+PassHistogram g_histograms[GPU_PASS_COUNT];
+
+#ifdef ALVR_TRACE_EVENTS
+const char* const PASS_NAMES[GPU_PASS_COUNT] = {
+    "Layers", "ColorCorrection", "Foveation", "CustomShader", "YuvConvert", "EncoderCopy",
+};
+#endif
+}
+
+bool GpuPassStatsEnabled() {
+    return g_enabled.load(std::memory_order_relaxed) || DriverMetricsEnabled()
+        || TraceEventsEnabled();
+}
+
+void GpuPassRecord(FfiGpuPass pass, uint64_t durationNs) {
+    if (pass >= GPU_PASS_COUNT) {
+        return;
+    }
+    ALVR_TRACE_GPU("compositor", PASS_NAMES[pass], durationNs, 0);
+    MetricsRecordGpuPass(pass, durationNs);
+    if (!g_enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    PassHistogram& histogram = g_histograms[pass];
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    histogram.totalNs.fetch_add(durationNs, std::memory_order_relaxed);
+    histogram.buckets[HistogramBucket(durationNs)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t maxNs = histogram.maxNs.load(std::memory_order_relaxed);
+    while (durationNs > maxNs
+           && !histogram.maxNs.compare_exchange_weak(
+               maxNs, durationNs, std::memory_order_relaxed
+           )) { }
+}
+
+void GetGpuPassHistograms(FfiGpuPassHistogram* out) {
+    g_enabled.store(true, std::memory_order_relaxed);
+
+    // Each counter is reset on its own, a pass recorded meanwhile can be split across two reads
+    for (uint32_t pass = 0; pass < GPU_PASS_COUNT; pass++) {
+        PassHistogram& histogram = g_histograms[pass];
+        out[pass].count = histogram.count.exchange(0, std::memory_order_relaxed);
+        out[pass].totalNs = histogram.totalNs.exchange(0, std::memory_order_relaxed);
+        out[pass].maxNs = histogram.maxNs.exchange(0, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < GPU_PASS_HISTOGRAM_BUCKETS; i++) {
+            out[pass].buckets[i] = histogram.buckets[i].exchange(0, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,17 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "bindings.h"
+#include <stdint.h>
+
+// Per-pass GPU time histograms, read with GetGpuPassHistograms. The renderers read their timestamp
+// queries back without waiting and report the passes of each frame here.
+
+// False until the transport first reads the histograms or the driver metrics, or a trace session
+// records the GPU passes, the renderers skip the queries meanwhile
+bool GpuPassStatsEnabled();
+
+// Safe to call from any thread
+void GpuPassRecord(FfiGpuPass pass, uint64_t durationNs);
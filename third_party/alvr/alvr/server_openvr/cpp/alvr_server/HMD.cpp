@@ -7,7 +7,9 @@
 #include "Logger.h"
 #include "Paths.h"
 #include "PoseHistory.h"
+#include "RenderTargetScale.h"
 #include "Settings.h"
+#include "ThreadProfiles.h"
 #include "Utils.h"
 #include "ViveTrackerProxy.h"
 #include "bindings.h"
@@ -54,6 +56,12 @@ Hmd::Hmd()
 Hmd::~Hmd() {
     Debug("Hmd::destructor");
 
+#ifdef _WIN32
+    if (m_encoderStartup.joinable()) {
+        m_encoderStartup.join();
+    }
+#endif
+
     if (m_encoder) {
         Debug("Hmd::~Hmd(): Stopping encoder...\n");
         m_encoder->Stop();
@@ -73,7 +81,7 @@ bool Hmd::activate() {
 
     auto vr_properties = vr::VRProperties();
 
-    SetOpenvrProps((void*)this, this->device_id);
+    this->set_openvr_props();
 
     vr_properties->SetFloatProperty(
         this->prop_container,
@@ -122,7 +130,10 @@ bool Hmd::activate() {
             // Prop_GraphicsAdapterLuid_Uint64 is only for redirect display and is ignored on direct
             // mode driver. So we can't specify an adapter for vrcompositor. m_nAdapterIndex is set
             // 0 on the dashboard.
-            if (!m_D3DRender->Initialize(Settings::Instance().m_nAdapterIndex)) {
+            if (!m_D3DRender->Initialize(
+                    Settings::Instance().m_nAdapterIndex,
+                    Settings::Instance().m_d3d12HighPriorityQueue
+                )) {
                 Error(
                     "Could not create graphics device for adapter %d.  Requires a minimum of two "
                     "graphics cards.\n",
@@ -192,21 +203,20 @@ void Hmd::OnPoseUpdated(uint64_t targetTimestampNs, FfiDeviceMotion motion) {
     pose.qWorldFromDriverRotation = HmdQuaternion_Init(1, 0, 0, 0);
     pose.qDriverFromHeadRotation = HmdQuaternion_Init(1, 0, 0, 0);
 
-    pose.qRotation = HmdQuaternion_Init(
-        motion.pose.orientation.w,
-        motion.pose.orientation.x,
-        motion.pose.orientation.y,
-        motion.pose.orientation.z
-    );
+    // The compositor renders with the tagged orientation, the history recognizes it by the tag
+    FfiQuat orientation = m_poseHistory->OnPoseUpdated(targetTimestampNs, motion);
+    pose.qRotation
+        = HmdQuaternion_Init(orientation.w, orientation.x, orientation.y, orientation.z);
 
     pose.vecPosition[0] = motion.pose.position[0];
     pose.vecPosition[1] = motion.pose.position[1];
     pose.vecPosition[2] = motion.pose.position[2];
 
+    // Unlike the other devices the head pose is not extrapolated by a pose predictor. The client
+    // already predicted it for the target timestamp, and the rendered rotation has to match the
+    // pose history to find which timestamp a frame was rendered for.
     this->submit_pose(pose);
 
-    m_poseHistory->OnPoseUpdated(targetTimestampNs, motion);
-
     if (m_viveTrackerProxy)
         m_viveTrackerProxy->update();
 
@@ -222,6 +232,50 @@ void Hmd::OnPoseUpdated(uint64_t targetTimestampNs, FfiDeviceMotion motion) {
         );
     }
 #endif
+
+    float scale;
+    if (Settings::Instance().m_adaptiveRenderResolution && m_encoder
+        && UpdateRenderTargetScale(scale)) {
+        m_renderTargetScale = scale;
+        uint32_t width, height;
+        GetRecommendedRenderTargetSize(&width, &height);
+        Info("Recommending a render target of %ux%u per eye\n", width, height);
+        vr::VRServerDriverHost()->SetRecommendedRenderTargetSize(this->object_id, width, height);
+    }
+}
+
+#ifdef _WIN32
+void Hmd::createEncoder() {
+    m_encoder = std::make_shared<CEncoder>();
+    try {
+        m_encoder->Initialize(m_D3DRender);
+    } catch (Exception e) {
+        Error(
+            "Your GPU does not meet the requirements for video encoding. %s %s\n%s %s\n",
+            "If you get this error after changing some settings, you can revert them by",
+            "deleting the file \"session.json\" in the installation folder.",
+            "Failed to initialize CEncoder:",
+            e.what()
+        );
+    }
+}
+#endif
+
+void Hmd::PrepareStreaming() {
+    // The shaders of FrameRender and the encoder probe take most of the time to the first frame.
+    // Linux creates its encoder in the encoder thread already.
+#ifdef _WIN32
+    if (m_streamComponentsInitialized || m_encoderStartup.joinable()
+        || this->device_class != vr::TrackedDeviceClass_HMD) {
+        return;
+    }
+    m_encoderStartup = std::thread([this] {
+        // The D3D device is created in activate(), which SteamVR may not have called yet
+        if (this->wait_activation() && m_D3DRender) {
+            createEncoder();
+        }
+    });
+#endif
 }
 
 void Hmd::StartStreaming() {
@@ -236,18 +290,13 @@ void Hmd::StartStreaming() {
     // Spin up a separate thread to handle the overlapped encoding/transmit step.
     if (this->device_class == vr::TrackedDeviceClass_HMD) {
 #ifdef _WIN32
-        m_encoder = std::make_shared<CEncoder>();
-        try {
-            m_encoder->Initialize(m_D3DRender);
-        } catch (Exception e) {
-            Error(
-                "Your GPU does not meet the requirements for video encoding. %s %s\n%s %s\n",
-                "If you get this error after changing some settings, you can revert them by",
-                "deleting the file \"session.json\" in the installation folder.",
-                "Failed to initialize CEncoder:",
-                e.what()
-            );
+        if (m_encoderStartup.joinable()) {
+            m_encoderStartup.join();
+        }
+        if (!m_encoder) {
+            createEncoder();
         }
+        m_encoder->SetProfile(EncoderThreadProfile());
         m_encoder->Start();
 
         m_directModeComponent->SetEncoder(m_encoder);
@@ -256,6 +305,7 @@ void Hmd::StartStreaming() {
         m_encoder = std::make_shared<CEncoder>();
 #else
         m_encoder = std::make_shared<CEncoder>(m_poseHistory);
+        m_encoder->SetProfile(EncoderThreadProfile());
         m_encoder->Start();
 #endif
         m_encoder->OnStreamStart();
@@ -301,6 +351,11 @@ void Hmd::SetViewParams(const FfiViewParams params[2]) {
 
 void Hmd::SetProximityState(bool headsetIsWorn) {
     vr::VRDriverInput()->UpdateBooleanComponent(m_proximity, headsetIsWorn, 0.0);
+#if !defined(_WIN32) && !defined(__APPLE__)
+    if (m_encoder) {
+        m_encoder->SetHeadsetWorn(headsetIsWorn);
+    }
+#endif
 }
 
 void Hmd::GetWindowBounds(int32_t* pnX, int32_t* pnY, uint32_t* pnWidth, uint32_t* pnHeight) {
@@ -327,8 +382,11 @@ bool Hmd::IsDisplayRealDisplay() {
 }
 
 void Hmd::GetRecommendedRenderTargetSize(uint32_t* pnWidth, uint32_t* pnHeight) {
-    *pnWidth = Settings::Instance().m_recommendedTargetWidth / 2;
-    *pnHeight = Settings::Instance().m_recommendedTargetHeight;
+    // Even sizes, which all the games handle
+    *pnWidth = (uint32_t)(Settings::Instance().m_recommendedTargetWidth / 2 * m_renderTargetScale)
+        & ~1u;
+    *pnHeight = (uint32_t)(Settings::Instance().m_recommendedTargetHeight * m_renderTargetScale)
+        & ~1u;
     Debug("Hmd::GetRecommendedRenderTargetSize %dx%d\n", *pnWidth, *pnHeight);
 }
 
@@ -7,6 +7,7 @@
 #include "TrackedDevice.h"
 #include "openvr_driver_wrap.h"
 #include <memory>
+#include <thread>
 #ifdef _WIN32
 #include "platform/win32/OvrDirectModeComponent.h"
 #endif
@@ -29,6 +30,8 @@ public:
     Hmd();
     virtual ~Hmd();
     void OnPoseUpdated(uint64_t targetTimestampNs, FfiDeviceMotion motion);
+    // Starts creating the encoder on a startup thread, StartStreaming then only waits for it
+    void PrepareStreaming();
     void StartStreaming();
     void StopStreaming();
     void SetViewParams(const FfiViewParams params[2]);
@@ -59,10 +62,20 @@ private:
 
     std::shared_ptr<ViveTrackerProxy> m_viveTrackerProxy;
 
+#ifdef _WIN32
+    // Runs createEncoder between PrepareStreaming and StartStreaming
+    std::thread m_encoderStartup;
+
+    void createEncoder();
+#endif
+
 #ifndef _WIN32
     bool m_refreshRateSet = false;
 #endif
 
+    // Of the recommended render target size, see RenderTargetScale.h
+    float m_renderTargetScale = 1;
+
     // TrackedDevice
     virtual bool activate() final;
     virtual void* get_component(const char* component_name_and_version) final;
@@ -2,35 +2,113 @@
 // Original copyright preserved
 
 #include "IDRScheduler.h"
+#include "DriverMetrics.h"
 
-#include "Utils.h"
-#include <mutex>
+namespace {
+struct ReasonCounter {
+    uint32_t reason;
+    FfiDriverCounter counter;
+};
+
+const ReasonCounter REASON_COUNTERS[] = {
+    { IDRScheduler::REASON_LOSS, DRIVER_COUNTER_IDR_LOSS },
+    { IDRScheduler::REASON_STREAM_START, DRIVER_COUNTER_IDR_STREAM_START },
+    { IDRScheduler::REASON_RESOLUTION_CHANGE, DRIVER_COUNTER_IDR_RESOLUTION_CHANGE },
+    { IDRScheduler::REASON_REQUEST, DRIVER_COUNTER_IDR_REQUEST },
+    { IDRScheduler::REASON_RESUME, DRIVER_COUNTER_IDR_RESUME },
+};
+}
 
 IDRScheduler::IDRScheduler() { }
 
 IDRScheduler::~IDRScheduler() { }
 
 void IDRScheduler::OnStreamStart() {
-    m_minIDRFrameInterval = Settings::Instance().m_minimumIdrIntervalMs * 1000;
-    m_scheduled = false;
-    InsertIDR();
+    m_minIDRFrameInterval = Settings::Instance().Live()->m_minimumIdrIntervalMs * 1000;
+    m_idrSent = false;
+    m_firstInvalidTs = NO_INVALIDATION;
+    m_pending.store(REASON_STREAM_START, std::memory_order_release);
 }
 
-void IDRScheduler::InsertIDR() {
-    std::unique_lock lock(m_mutex);
+void IDRScheduler::InsertIDR(uint32_t reason) {
+    m_pending.fetch_or(reason & IDR_REASONS, std::memory_order_release);
+}
 
-    m_insertIDRTime = GetTimestampUs() - MIN_IDR_FRAME_INTERVAL * 2;
-    m_scheduled = true;
+void IDRScheduler::InsertRecovery() {
+    if (m_ltrRecovery && m_idrSent) {
+        m_pending.fetch_or(PENDING_LTR, std::memory_order_release);
+        return;
+    }
+    InsertFallbackRecovery();
+}
+
+void IDRScheduler::InsertFallbackRecovery() {
+    if (m_intraRefresh && m_idrSent) {
+        m_pending.fetch_or(PENDING_REFRESH, std::memory_order_release);
+        return;
+    }
+    InsertIDR(REASON_LOSS);
 }
 
-bool IDRScheduler::CheckIDRInsertion() {
-    std::unique_lock lock(m_mutex);
+void IDRScheduler::SetLtrRecovery(bool enabled) { m_ltrRecovery = enabled; }
 
-    if (m_scheduled) {
-        if (m_insertIDRTime <= GetTimestampUs()) {
-            m_scheduled = false;
-            return true;
+void IDRScheduler::SetIntraRefresh(bool enabled) { m_intraRefresh = enabled; }
+
+void IDRScheduler::InvalidateFrames(uint64_t firstTs) {
+    if (m_refInvalidation && m_idrSent) {
+        // Losses reported before the encoder ran are handled at once, from the earliest
+        uint64_t current = m_firstInvalidTs.load(std::memory_order_relaxed);
+        while (firstTs < current
+               && !m_firstInvalidTs.compare_exchange_weak(
+                   current, firstTs, std::memory_order_release, std::memory_order_relaxed
+               )) {
         }
+        return;
+    }
+    InsertRecovery();
+}
+
+void IDRScheduler::SetRefInvalidation(bool enabled) { m_refInvalidation = enabled; }
+
+uint32_t IDRScheduler::take(uint32_t bits) {
+    if ((m_pending.load(std::memory_order_relaxed) & bits) == 0) {
+        return 0;
     }
-    return false;
+    return m_pending.fetch_and(~bits, std::memory_order_acquire) & bits;
 }
+
+uint32_t IDRScheduler::CheckIDRInsertion() {
+    if ((m_pending.load(std::memory_order_relaxed) & IDR_REASONS) == 0) {
+        return 0;
+    }
+    // The IDR also repairs what the other recoveries would have
+    uint32_t reasons = take(IDR_REASONS | PENDING_REFRESH | PENDING_LTR) & IDR_REASONS;
+    m_firstInvalidTs = NO_INVALIDATION;
+    m_idrSent = true;
+    for (const ReasonCounter& entry : REASON_COUNTERS) {
+        if (reasons & entry.reason) {
+            MetricsCount(entry.counter);
+        }
+    }
+    return reasons;
+}
+
+uint32_t IDRScheduler::PendingIDRReasons() const {
+    return m_pending.load(std::memory_order_acquire) & IDR_REASONS;
+}
+
+bool IDRScheduler::CheckIntraRefreshInsertion() { return take(PENDING_REFRESH) != 0; }
+
+bool IDRScheduler::CheckInvalidation(uint64_t& firstTs) {
+    if (m_firstInvalidTs.load(std::memory_order_relaxed) == NO_INVALIDATION) {
+        return false;
+    }
+    uint64_t ts = m_firstInvalidTs.exchange(NO_INVALIDATION, std::memory_order_acquire);
+    if (ts == NO_INVALIDATION) {
+        return false;
+    }
+    firstTs = ts;
+    return true;
+}
+
+bool IDRScheduler::CheckLtrRecovery() { return take(PENDING_LTR) != 0; }
@@ -4,23 +4,75 @@
 #pragma once
 
 #include "Settings.h"
-#include <mutex>
+#include <atomic>
 #include <stdint.h>
 
+// Lock-free: the network thread schedules, the encoder thread checks every frame. Each pending
+// recovery is a bit of a single atomic mask, taking one is an atomic and-not, and the checks only
+// load the mask while nothing is pending.
 class IDRScheduler {
 public:
+    // Why an IDR is pending, combined in the mask returned by CheckIDRInsertion
+    enum Reason : uint32_t {
+        // The client lost frames and no other recovery applies
+        REASON_LOSS = 1 << 0,
+        // The decoder needs an IDR first, for a new stream or a new encoder
+        REASON_STREAM_START = 1 << 1,
+        // The encoder switched to another resolution
+        REASON_RESOLUTION_CHANGE = 1 << 2,
+        // A new consumer of the stream needs a keyframe
+        REASON_REQUEST = 1 << 3,
+        // The encoder leaves the idle mode, the client may have dropped the stream meanwhile
+        REASON_RESUME = 1 << 4,
+    };
+
     IDRScheduler();
     ~IDRScheduler();
 
     void OnStreamStart();
-    void InsertIDR();
+    void InsertIDR(uint32_t reason);
+    // Recovery from a loss reported by the client. Once the stream has started with an IDR, this
+    // predicts the next frame from an acknowledged long-term reference, or else starts an intra
+    // refresh wave, if the encoder supports them. Otherwise it is an IDR.
+    void InsertRecovery();
+    // Recovery without long-term references, when the encoder has no acknowledged one left
+    void InsertFallbackRecovery();
+    void SetLtrRecovery(bool enabled);
+    void SetIntraRefresh(bool enabled);
+    // Loss of the frames from firstTs on. With reference invalidation the encoder predicts the
+    // next frame from an older one instead, otherwise this is a recovery.
+    void InvalidateFrames(uint64_t firstTs);
+    void SetRefInvalidation(bool enabled);
 
-    bool CheckIDRInsertion();
+    // The reasons of the pending IDR, 0 if there is none. Taking the IDR also drops the other
+    // recoveries, it repairs what they would have.
+    uint32_t CheckIDRInsertion();
+    // The reasons of the pending IDR, without taking it
+    uint32_t PendingIDRReasons() const;
+    bool CheckIntraRefreshInsertion();
+    bool CheckLtrRecovery();
+    // Returns the first lost frame since the last call, if any
+    bool CheckInvalidation(uint64_t& firstTs);
 
 private:
     static const int MIN_IDR_FRAME_INTERVAL = 100 * 1000; // 100-milliseconds
-    uint64_t m_insertIDRTime = 0;
-    bool m_scheduled = false;
-    std::mutex m_mutex;
+    static constexpr uint32_t IDR_REASONS
+        = REASON_LOSS | REASON_STREAM_START | REASON_RESOLUTION_CHANGE | REASON_REQUEST
+        | REASON_RESUME;
+    static constexpr uint32_t PENDING_REFRESH = 1 << 8;
+    static constexpr uint32_t PENDING_LTR = 1 << 9;
+    // m_firstInvalidTs when no invalidation is pending
+    static constexpr uint64_t NO_INVALIDATION = UINT64_MAX;
+
+    // Takes the bits of the mask that are pending, only loading it when none are
+    uint32_t take(uint32_t bits);
+
+    std::atomic<uint32_t> m_pending = 0;
+    std::atomic<uint64_t> m_firstInvalidTs = NO_INVALIDATION;
+    std::atomic_bool m_ltrRecovery = false;
+    std::atomic_bool m_intraRefresh = false;
+    std::atomic_bool m_refInvalidation = false;
+    // Intra refresh and references can't start a stream, the decoder needs an IDR first
+    std::atomic_bool m_idrSent = false;
     uint64_t m_minIDRFrameInterval = MIN_IDR_FRAME_INTERVAL;
 };
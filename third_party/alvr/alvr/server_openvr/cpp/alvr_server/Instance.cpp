@@ -0,0 +1,29 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "Instance.h"
+#include <cstdlib>
+
+namespace {
+// Only the characters that are safe in file and socket names are kept
+std::string readName() {
+    const char* env = getenv("ALVR_INSTANCE");
+    std::string name;
+    for (const char* c = env ? env : ""; *c; c++) {
+        bool safe = (*c >= '0' && *c <= '9') || (*c >= 'a' && *c <= 'z')
+            || (*c >= 'A' && *c <= 'Z') || *c == '-' || *c == '_';
+        name += safe ? *c : '_';
+    }
+    return name;
+}
+}
+
+const std::string& InstanceName() {
+    static const std::string name = readName();
+    return name;
+}
+
+const std::string& InstanceSuffix() {
+    static const std::string suffix = InstanceName().empty() ? "" : "-" + InstanceName();
+    return suffix;
+}
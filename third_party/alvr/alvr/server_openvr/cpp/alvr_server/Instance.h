@@ -0,0 +1,14 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <string>
+
+// Name of this driver instance when several run on one host, from the ALVR_INSTANCE environment
+// variable that SteamVR passes on to vrcompositor. Empty for a single instance, which keeps the
+// historical names.
+const std::string& InstanceName();
+// "-<name>" for the names shared by the host, like the IPC socket, the capture files and the
+// temporary files of the caches. Empty for a single instance.
+const std::string& InstanceSuffix();
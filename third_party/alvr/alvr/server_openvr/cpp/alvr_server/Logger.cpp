@@ -3,23 +3,217 @@
 
 #include "Logger.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
+#include "TraceEvents.h"
 #include "bindings.h"
 #include "driverlog.h"
 
-void _log(const char* format, va_list args, void (*logFn)(const char*), bool driverLog = false) {
-    char buf[1024];
-    int count = vsnprintf(buf, sizeof(buf), format, args);
-    if (count > (int)sizeof(buf))
-        count = (int)sizeof(buf);
+namespace {
+
+const size_t MESSAGE_SIZE = 1024;
+const size_t TAG_SIZE = 64;
+const uint32_t QUEUE_SIZE = 256;
+// How often the worker delivers the queued messages. Producers never wake it, that would cost a
+// syscall on every log call.
+const auto DRAIN_INTERVAL = std::chrono::milliseconds(5);
+
+enum class Level { Info, Debug, Period };
+
+// Bounded multi-producer queue of formatted messages. Like the frame trace queue, each cell
+// carries a sequence number telling whether it is free for the enqueue position or filled for the
+// dequeue position. Producers format straight into the claimed cell.
+class LogQueue {
+public:
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        Level level;
+        char tag[TAG_SIZE];
+        char message[MESSAGE_SIZE];
+    };
+
+    LogQueue() {
+        for (uint32_t i = 0; i < QUEUE_SIZE; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns a cell to fill and pass to Publish, or null if the queue is full
+    Cell* Claim(uint64_t& pos) {
+        pos = m_enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell* cell = &m_cells[pos % QUEUE_SIZE];
+            uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)sequence - (int64_t)pos;
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return cell;
+                }
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Publish(Cell* cell, uint64_t pos) {
+        cell->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    // Returns the oldest filled cell, to pass to Release once delivered, or null if empty
+    Cell* Front(uint64_t& pos) {
+        pos = m_dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell* cell = &m_cells[pos % QUEUE_SIZE];
+            uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)sequence - (int64_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return cell;
+                }
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Release(Cell* cell, uint64_t pos) {
+        cell->sequence.store(pos + QUEUE_SIZE, std::memory_order_release);
+    }
+
+private:
+    Cell m_cells[QUEUE_SIZE];
+    std::atomic<uint64_t> m_enqueuePos { 0 };
+    std::atomic<uint64_t> m_dequeuePos { 0 };
+};
+
+LogQueue g_queue;
+std::atomic<bool> g_workerRunning { false };
+std::atomic<uint64_t> g_dropped { 0 };
+std::thread g_worker;
+std::mutex g_workerMutex;
+std::condition_variable g_workerCv;
+bool g_workerStop = false;
+
+// Formats into buf and strips the trailing newline
+void format(char* buf, size_t size, const char* format, va_list args) {
+    int count = vsnprintf(buf, size, format, args);
+    if (count >= (int)size)
+        count = (int)size - 1;
     if (count > 0 && buf[count - 1] == '\n')
         buf[count - 1] = '\0';
+}
+
+void deliver(Level level, const char* tag, const char* message) {
+    switch (level) {
+    case Level::Info:
+        LogInfo(message);
+        break;
+    case Level::Debug:
+        LogDebug(message);
+        break;
+    case Level::Period:
+        LogPeriodically(tag, message);
+        break;
+    }
+}
+
+void drain() {
+    ALVR_TRACE_SCOPE("LogDrain");
+    uint64_t pos;
+    while (LogQueue::Cell* cell = g_queue.Front(pos)) {
+        deliver(cell->level, cell->tag, cell->message);
+        g_queue.Release(cell, pos);
+    }
+
+    uint64_t dropped = g_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        char buf[128];
+        snprintf(
+            buf, sizeof(buf), "Log queue full, %llu messages dropped", (unsigned long long)dropped
+        );
+        LogWarn(buf);
+    }
+}
 
+// Queued while the worker runs, delivered on the calling thread otherwise
+void enqueue(Level level, const char* tag, const char* format, va_list args) {
+    if (!g_workerRunning.load(std::memory_order_acquire)) {
+        char buf[MESSAGE_SIZE];
+        ::format(buf, sizeof(buf), format, args);
+        deliver(level, tag, buf);
+        return;
+    }
+
+    uint64_t pos;
+    LogQueue::Cell* cell = g_queue.Claim(pos);
+    if (!cell) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    cell->level = level;
+    cell->tag[0] = '\0';
+    if (tag) {
+        strncpy(cell->tag, tag, TAG_SIZE - 1);
+        cell->tag[TAG_SIZE - 1] = '\0';
+    }
+    ::format(cell->message, MESSAGE_SIZE, format, args);
+    g_queue.Publish(cell, pos);
+}
+
+// Errors and warnings stay synchronous, they are rare and must not be lost if the process is
+// about to crash. What was queued before them is delivered first to keep the order.
+void logNow(const char* format, va_list args, void (*logFn)(const char*)) {
+    char buf[MESSAGE_SIZE];
+    ::format(buf, sizeof(buf), format, args);
+
+    drain();
     logFn(buf);
+    DriverLog(buf);
+}
 
-    if (driverLog)
-        DriverLog(buf);
+} // namespace
+
+void StartLogWorker() {
+    std::lock_guard<std::mutex> lock(g_workerMutex);
+    if (g_worker.joinable()) {
+        return;
+    }
+    g_workerStop = false;
+    g_worker = std::thread([] {
+        std::unique_lock<std::mutex> lock(g_workerMutex);
+        while (!g_workerStop) {
+            lock.unlock();
+            drain();
+            lock.lock();
+            g_workerCv.wait_for(lock, DRAIN_INTERVAL, [] { return g_workerStop; });
+        }
+    });
+    g_workerRunning.store(true, std::memory_order_release);
+}
+
+void StopLogWorker() {
+    {
+        std::lock_guard<std::mutex> lock(g_workerMutex);
+        if (!g_worker.joinable()) {
+            return;
+        }
+        g_workerRunning.store(false, std::memory_order_release);
+        g_workerStop = true;
+    }
+    g_workerCv.notify_one();
+    g_worker.join();
+    // Messages claimed right before the worker stopped
+    drain();
 }
 
 Exception MakeException(const char* format, ...) {
@@ -34,14 +228,14 @@ Exception MakeException(const char* format, ...) {
 void Error(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    _log(format, args, LogError, true);
+    logNow(format, args, LogError);
     va_end(args);
 }
 
 void Warn(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    _log(format, args, LogWarn, true);
+    logNow(format, args, LogWarn);
     va_end(args);
 }
 
@@ -49,33 +243,22 @@ void Info(const char* format, ...) {
     va_list args;
     va_start(args, format);
     // Don't log to SteamVR/writing to file for info level, this is mostly statistics info
-    _log(format, args, LogInfo);
+    enqueue(Level::Info, nullptr, format, args);
     va_end(args);
 }
 
-void Debug(const char* format, ...) {
 #ifdef ALVR_DEBUG_LOG
+void Debug(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    _log(format, args, LogDebug);
+    enqueue(Level::Debug, nullptr, format, args);
     va_end(args);
-#else
-    (void)format;
-#endif
 }
+#endif
 
 void LogPeriod(const char* tag, const char* format, ...) {
     va_list args;
     va_start(args, format);
-
-    char buf[1024];
-    int count = vsnprintf(buf, sizeof(buf), format, args);
-    if (count > (int)sizeof(buf))
-        count = (int)sizeof(buf);
-    if (count > 0 && buf[count - 1] == '\n')
-        buf[count - 1] = '\0';
-
-    LogPeriodically(tag, buf);
-
+    enqueue(Level::Period, tag, format, args);
     va_end(args);
 }
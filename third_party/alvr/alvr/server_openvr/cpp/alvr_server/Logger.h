@@ -7,8 +7,19 @@
 
 Exception MakeException(const char* format, ...);
 
+// While the worker runs, Info, Debug and LogPeriod only format the message into a queue and the
+// worker thread hands it to the Rust logger. Error and Warn are always delivered synchronously.
+void StartLogWorker();
+// Delivers the queued messages and stops the worker, logging is synchronous again afterwards
+void StopLogWorker();
+
 void Error(const char* format, ...);
 void Warn(const char* format, ...);
 void Info(const char* format, ...);
+#ifdef ALVR_DEBUG_LOG
 void Debug(const char* format, ...);
+#else
+// Compiled out in release builds
+inline void Debug(const char* format, ...) { (void)format; }
+#endif
 void LogPeriod(const char* tag, const char* format, ...);
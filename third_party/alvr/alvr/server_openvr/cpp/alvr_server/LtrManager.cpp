@@ -0,0 +1,97 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "LtrManager.h"
+#include "Logger.h"
+#include "Settings.h"
+
+LtrManager::LtrManager()
+    : m_enabled(Settings::Instance().m_longTermReferenceRecovery) { }
+
+int LtrManager::newestAcknowledged() const {
+    int newest = -1;
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        const Slot& slot = m_slots[i];
+        if (slot.valid && slot.acknowledged
+            && (newest < 0 || slot.targetTimestampNs > m_slots[newest].targetTimestampNs)) {
+            newest = i;
+        }
+    }
+    return newest;
+}
+
+LtrManager::FrameLtr LtrManager::OnFrame(uint64_t targetTimestampNs, bool idr) {
+    FrameLtr ltr;
+    if (!m_enabled) {
+        return ltr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (idr) {
+        for (auto& slot : m_slots) {
+            slot = {};
+        }
+        m_recoverySlot = -1;
+        ltr.markSlot = 0;
+    } else {
+        if (m_recoverySlot >= 0) {
+            ltr.useSlot = m_recoverySlot;
+            // Golden frames newer than the reference were predicted from the lost frames
+            uint64_t referenceTs = m_slots[m_recoverySlot].targetTimestampNs;
+            for (auto& slot : m_slots) {
+                if (slot.targetTimestampNs > referenceTs) {
+                    slot = {};
+                }
+            }
+            m_recoverySlot = -1;
+        }
+
+        if (targetTimestampNs - m_lastGoldenTs >= GOLDEN_INTERVAL_NS) {
+            // Replace a free slot, or else the oldest one that isn't the newest acknowledged
+            int keep = newestAcknowledged();
+            for (int i = 0; i < SLOT_COUNT; i++) {
+                if (i == keep) {
+                    continue;
+                }
+                if (ltr.markSlot < 0 || !m_slots[i].valid
+                    || (m_slots[ltr.markSlot].valid
+                        && m_slots[i].targetTimestampNs
+                            < m_slots[ltr.markSlot].targetTimestampNs)) {
+                    ltr.markSlot = i;
+                }
+            }
+        }
+    }
+
+    if (ltr.markSlot >= 0) {
+        m_slots[ltr.markSlot] = { targetTimestampNs, true, false };
+        m_lastGoldenTs = targetTimestampNs;
+    }
+    return ltr;
+}
+
+void LtrManager::Acknowledge(uint64_t targetTimestampNs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto& slot : m_slots) {
+        if (slot.valid && slot.targetTimestampNs == targetTimestampNs) {
+            slot.acknowledged = true;
+        }
+    }
+}
+
+bool LtrManager::Recover() {
+    if (!m_enabled) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_recoverySlot = newestAcknowledged();
+    if (m_recoverySlot < 0) {
+        return false;
+    }
+    Debug("Recovering from the long-term reference %d\n", m_recoverySlot);
+    return true;
+}
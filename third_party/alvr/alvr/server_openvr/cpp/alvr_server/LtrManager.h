@@ -0,0 +1,57 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+
+// Long-term reference bookkeeping shared by the encoders. A "golden" frame is marked as long-term
+// reference about once per second, in a slot that doesn't hold the newest frame acknowledged by
+// the client, so an acknowledged reference is always kept. After a loss the next frame is
+// predicted from that reference only, which the client is known to have decoded.
+class LtrManager {
+public:
+    static const int SLOT_COUNT = 2;
+
+    // What the encoder does with the long-term references for a frame, -1 for nothing
+    struct FrameLtr {
+        int markSlot = -1;
+        int useSlot = -1;
+    };
+
+    LtrManager();
+
+    // Disabled by the long_term_reference_recovery setting, or by the backend
+    bool IsEnabled() const { return m_enabled; }
+    void Disable() { m_enabled = false; }
+
+    // Called for each frame before it is encoded. An IDR drops the references and is marked as
+    // the first one.
+    FrameLtr OnFrame(uint64_t targetTimestampNs, bool idr);
+
+    // The client decoded this frame. Only golden frames are tracked, other ones are ignored.
+    void Acknowledge(uint64_t targetTimestampNs);
+
+    // Makes the next frame reference the newest acknowledged golden frame. Returns false if there
+    // is none, the loss then needs another recovery.
+    bool Recover();
+
+private:
+    struct Slot {
+        uint64_t targetTimestampNs = 0;
+        bool valid = false;
+        bool acknowledged = false;
+    };
+
+    // Newest acknowledged slot, or -1
+    int newestAcknowledged() const;
+
+    static const uint64_t GOLDEN_INTERVAL_NS = 1'000'000'000;
+
+    bool m_enabled;
+    std::mutex m_mutex;
+    Slot m_slots[SLOT_COUNT];
+    uint64_t m_lastGoldenTs = 0;
+    int m_recoverySlot = -1;
+};
@@ -0,0 +1,286 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "NalIndex.h"
+#include "ALVR-common/packet_types.h"
+#include "CpuFeatures.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define NAL_INDEX_SSE2
+// The AVX2 and AVX-512 kernels are compiled for their instruction set alone and picked at runtime
+#define NAL_INDEX_AVX
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define NAL_INDEX_NEON
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+inline uint32_t lowestSetBit(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+uint32_t findStartCodeScalar(const unsigned char* buf, uint32_t pos, uint32_t len) {
+    while (pos + 3 <= len) {
+        // A start code can't begin at pos, pos + 1 or pos + 2 if the third byte is above 1
+        if (buf[pos + 2] > 1) {
+            pos += 3;
+        } else if (buf[pos] == 0 && buf[pos + 1] == 0 && buf[pos + 2] == 1) {
+            return pos;
+        } else {
+            pos++;
+        }
+    }
+
+    return len;
+}
+
+// Each iteration of the vector kernels compares bytes i, i + 1 and i + 2 for every lane i at once,
+// the scalar loop finishes the last bytes
+#if defined(NAL_INDEX_AVX)
+TARGET_AVX512 uint32_t findStartCodeAvx512(const unsigned char* buf, uint32_t pos, uint32_t len) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi8(1);
+    while (pos + 66 <= len) {
+        __m512i b0 = _mm512_loadu_si512((const void*)(buf + pos));
+        __m512i b1 = _mm512_loadu_si512((const void*)(buf + pos + 1));
+        __m512i b2 = _mm512_loadu_si512((const void*)(buf + pos + 2));
+        uint64_t mask = _mm512_cmpeq_epi8_mask(b0, zero) & _mm512_cmpeq_epi8_mask(b1, zero)
+            & _mm512_cmpeq_epi8_mask(b2, one);
+        if (mask) {
+            return pos + lowestSetBit(mask);
+        }
+        pos += 64;
+    }
+    return findStartCodeScalar(buf, pos, len);
+}
+
+TARGET_AVX2 uint32_t findStartCodeAvx2(const unsigned char* buf, uint32_t pos, uint32_t len) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    while (pos + 34 <= len) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(buf + pos));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(buf + pos + 1));
+        __m256i b2 = _mm256_loadu_si256((const __m256i*)(buf + pos + 2));
+        __m256i match = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)),
+            _mm256_cmpeq_epi8(b2, one)
+        );
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+        if (mask) {
+            return pos + lowestSetBit(mask);
+        }
+        pos += 32;
+    }
+    return findStartCodeScalar(buf, pos, len);
+}
+#endif
+
+#if defined(NAL_INDEX_SSE2)
+uint32_t findStartCodeSse2(const unsigned char* buf, uint32_t pos, uint32_t len) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    while (pos + 18 <= len) {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(buf + pos));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(buf + pos + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i*)(buf + pos + 2));
+        __m128i match = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+            _mm_cmpeq_epi8(b2, one)
+        );
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+        if (mask) {
+            return pos + lowestSetBit(mask);
+        }
+        pos += 16;
+    }
+    return findStartCodeScalar(buf, pos, len);
+}
+#elif defined(NAL_INDEX_NEON)
+uint32_t findStartCodeNeon(const unsigned char* buf, uint32_t pos, uint32_t len) {
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+    while (pos + 18 <= len) {
+        uint8x16_t b0 = vld1q_u8(buf + pos);
+        uint8x16_t b1 = vld1q_u8(buf + pos + 1);
+        uint8x16_t b2 = vld1q_u8(buf + pos + 2);
+        uint8x16_t match = vandq_u8(
+            vandq_u8(vceqq_u8(b0, zero), vceqq_u8(b1, zero)), vceqq_u8(b2, one)
+        );
+        // Narrow to 4 bits per lane to get a movemask equivalent
+        uint64_t mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0
+        );
+        if (mask) {
+            return pos + (lowestSetBit(mask) >> 2);
+        }
+        pos += 16;
+    }
+    return findStartCodeScalar(buf, pos, len);
+}
+#endif
+
+using FindStartCodeFn = uint32_t (*)(const unsigned char*, uint32_t, uint32_t);
+
+FindStartCodeFn selectFindStartCode() {
+    const CpuFeatures& cpu = GetCpuFeatures();
+#if defined(NAL_INDEX_AVX)
+    if (cpu.avx512) {
+        return findStartCodeAvx512;
+    }
+    if (cpu.avx2) {
+        return findStartCodeAvx2;
+    }
+#endif
+#if defined(NAL_INDEX_SSE2)
+    return findStartCodeSse2;
+#elif defined(NAL_INDEX_NEON)
+    return cpu.neon ? findStartCodeNeon : findStartCodeScalar;
+#else
+    return findStartCodeScalar;
+#endif
+}
+
+// Picked once, at load
+const FindStartCodeFn findStartCodeKernel = selectFindStartCode();
+
+bool buildAnnexBIndex(
+    int codec, const unsigned char* buf, uint32_t len, std::vector<NalUnit>& nals
+) {
+    uint32_t pos = FindStartCode(buf, 0, len);
+    if (pos == len) {
+        return false;
+    }
+
+    while (pos < len) {
+        NalUnit nal;
+        // A zero byte in front of the start code belongs to it (4 byte prefix)
+        bool longPrefix = pos > 0 && buf[pos - 1] == 0;
+        nal.offset = longPrefix ? pos - 1 : pos;
+        nal.prefixSize = longPrefix ? 4 : 3;
+
+        uint32_t header = pos + 3;
+        if (header >= len) {
+            return false;
+        }
+        nal.type = codec == ALVR_CODEC_H264 ? buf[header] & 0x1F : (buf[header] >> 1) & 0x3F;
+
+        uint32_t next = FindStartCode(buf, header, len);
+        uint32_t end = next;
+        if (next < len && next > header && buf[next - 1] == 0) {
+            end = next - 1;
+        }
+        nal.size = end - nal.offset;
+
+        nals.push_back(nal);
+        pos = next;
+    }
+
+    return true;
+}
+
+// AV1 low overhead bitstream format (section 5.2 of the AV1 spec), as produced by all the
+// encoders once the IVF container has been stripped
+bool buildObuIndex(const unsigned char* buf, uint32_t len, std::vector<NalUnit>& nals) {
+    uint32_t pos = 0;
+    while (pos < len) {
+        uint8_t header = buf[pos];
+        if (header & 0x80) { // obu_forbidden_bit
+            return false;
+        }
+        bool hasExtension = (header >> 2) & 1;
+        bool hasSizeField = (header >> 1) & 1;
+
+        uint32_t cursor = pos + 1 + (hasExtension ? 1 : 0);
+        uint64_t obuSize = 0;
+        if (hasSizeField) {
+            // leb128(), at most 8 bytes
+            for (int i = 0;; i++) {
+                if (i == 8 || cursor >= len) {
+                    return false;
+                }
+                uint8_t byte = buf[cursor++];
+                obuSize |= uint64_t(byte & 0x7F) << (i * 7);
+                if (!(byte & 0x80)) {
+                    break;
+                }
+            }
+        } else {
+            // Without size field the OBU extends to the end of the frame
+            obuSize = cursor <= len ? len - cursor : 0;
+        }
+        if (cursor > len || obuSize > len - cursor) {
+            return false;
+        }
+
+        NalUnit nal;
+        nal.offset = pos;
+        nal.prefixSize = 0;
+        nal.type = (header >> 3) & 0xF;
+        nal.size = cursor + (uint32_t)obuSize - pos;
+
+        nals.push_back(nal);
+        pos += nal.size;
+    }
+
+    return true;
+}
+}
+
+uint32_t FindStartCode(const unsigned char* buf, uint32_t pos, uint32_t len) {
+    return findStartCodeKernel(buf, pos, len);
+}
+
+bool BuildNalIndex(int codec, const unsigned char* buf, uint32_t len, std::vector<NalUnit>& nals) {
+    nals.clear();
+
+    if (codec == ALVR_CODEC_AV1) {
+        return buildObuIndex(buf, len, nals);
+    } else {
+        return buildAnnexBIndex(codec, buf, len, nals);
+    }
+}
+
+bool IsKeyframeNal(int codec, const NalUnit& nal) {
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        return nal.type == H264_NAL_TYPE_IDR;
+    case ALVR_CODEC_HEVC:
+        return nal.type == HEVC_NAL_TYPE_IDR_W_RADL || nal.type == HEVC_NAL_TYPE_IDR_N_LP;
+    case ALVR_CODEC_AV1:
+        // Approximation: the encoders emit a sequence header in front of every key frame
+        return nal.type == AV1_OBU_SEQUENCE_HEADER;
+    default:
+        return false;
+    }
+}
+
+bool IsConfigNal(int codec, const NalUnit& nal) {
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        return nal.type == H264_NAL_TYPE_SPS || nal.type == H264_NAL_TYPE_PPS;
+    case ALVR_CODEC_HEVC:
+        return nal.type >= HEVC_NAL_TYPE_VPS && nal.type <= HEVC_NAL_TYPE_PPS;
+    case ALVR_CODEC_AV1:
+        return nal.type == AV1_OBU_SEQUENCE_HEADER;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,54 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// One NAL unit (h264/HEVC) or OBU (AV1) inside an encoded frame.
+struct NalUnit {
+    // Start of the unit, including the Annex B start code for h264/HEVC
+    uint32_t offset;
+    // Size of the start code, 0 for AV1
+    uint8_t prefixSize;
+    // nal_unit_type for h264/HEVC, obu_type for AV1
+    uint8_t type;
+    // Size of the unit including the start code, up to the next unit
+    uint32_t size;
+};
+
+enum : uint8_t {
+    H264_NAL_TYPE_IDR = 5,
+    H264_NAL_TYPE_SPS = 7,
+    H264_NAL_TYPE_PPS = 8,
+    H264_NAL_TYPE_AUD = 9,
+
+    HEVC_NAL_TYPE_IDR_W_RADL = 19,
+    HEVC_NAL_TYPE_IDR_N_LP = 20,
+    HEVC_NAL_TYPE_VPS = 32,
+    HEVC_NAL_TYPE_SPS = 33,
+    HEVC_NAL_TYPE_PPS = 34,
+    HEVC_NAL_TYPE_AUD = 35,
+
+    AV1_OBU_SEQUENCE_HEADER = 1,
+    AV1_OBU_TEMPORAL_DELIMITER = 2,
+    AV1_OBU_FRAME_HEADER = 3,
+    AV1_OBU_TILE_GROUP = 4,
+    AV1_OBU_FRAME = 6,
+};
+
+// Returns the offset of the next 00 00 01 sequence at or after `pos`, or `len` if there is none.
+// Uses the AVX-512, AVX2, SSE2 or NEON kernel the CPU supports, see CpuFeatures.
+uint32_t FindStartCode(const unsigned char* buf, uint32_t pos, uint32_t len);
+
+// Lists all NAL units (or OBUs for AV1) of a frame in a single pass. `nals` is cleared first so
+// the same vector can be reused across frames without reallocating. Returns false if the
+// bitstream is malformed, in which case `nals` holds the units parsed so far.
+bool BuildNalIndex(int codec, const unsigned char* buf, uint32_t len, std::vector<NalUnit>& nals);
+
+// Whether the unit starts a new coded video sequence (IDR for h264/HEVC, sequence header for AV1)
+bool IsKeyframeNal(int codec, const NalUnit& nal);
+
+// Whether the unit is a parameter set (SPS/PPS/VPS, AV1 sequence header)
+bool IsConfigNal(int codec, const NalUnit& nal);
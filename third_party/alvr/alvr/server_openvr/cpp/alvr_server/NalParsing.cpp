@@ -1,121 +1,228 @@
 // Derived from ALVR (MIT)
 // Original copyright preserved
 
-
+#include "DriverMetrics.h"
+#include "FrameTrace.h"
 #include "Logger.h"
+#include "NalIndex.h"
 #include "Settings.h"
 #include "Utils.h"
 #include "bindings.h"
+#include <algorithm>
 #include <mutex>
 #include <string.h>
 
-static const char NAL_PREFIX_3B[] = { 0x00, 0x00, 0x01 };
-static const char NAL_PREFIX_4B[] = { 0x00, 0x00, 0x00, 0x01 };
+namespace {
+// Reused across frames to avoid reallocating, encoders call this from a single thread
+thread_local std::vector<NalUnit> t_nals;
+thread_local std::vector<NalUnit> t_sliceNals;
 
-static const unsigned char H264_NAL_TYPE_SPS = 7;
-static const unsigned char HEVC_NAL_TYPE_VPS = 32;
+bool isSliceNal(int codec, const NalUnit& nal) {
+    if (codec == ALVR_CODEC_H264) {
+        return nal.type >= 1 && nal.type <= H264_NAL_TYPE_IDR;
+    }
+    if (codec == ALVR_CODEC_AV1) {
+        // Tile groups, the first one may be coded together with the frame header
+        return nal.type == AV1_OBU_FRAME || nal.type == AV1_OBU_TILE_GROUP;
+    }
+    // HEVC VCL units
+    return nal.type < 32;
+}
 
-static const unsigned char H264_NAL_TYPE_AUD = 9;
-static const unsigned char HEVC_NAL_TYPE_AUD = 35;
+// Hash of the parameter sets last given to SetVideoConfigNals, under g_configMutex. Cleared by
+// ResendVideoConfig for a new client.
+std::mutex g_configMutex;
+bool g_configSent = false;
+uint64_t g_configHash = 0;
+
+// FNV-1a over the codec and the parameter set bytes
+uint64_t hashConfig(int codec, const unsigned char* buf, size_t len) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto mix = [&](unsigned char byte) {
+        hash ^= byte;
+        hash *= 0x100000001B3ull;
+    };
+    mix((unsigned char)codec);
+    for (size_t i = 0; i < len; i++) {
+        mix(buf[i]);
+    }
+    return hash;
+}
 
-int8_t getNalPrefixSize(unsigned char* buf) {
-    if (memcmp(buf, NAL_PREFIX_3B, sizeof(NAL_PREFIX_3B)) == 0) {
-        return sizeof(NAL_PREFIX_3B);
-    } else if (memcmp(buf, NAL_PREFIX_4B, sizeof(NAL_PREFIX_4B)) == 0) {
-        return sizeof(NAL_PREFIX_4B);
-    } else {
-        return -1;
+// The encoders repeat the parameter sets with each IDR, and bring identical ones after a re-init
+// with the same configuration. Only a change reaches the client, or the first ones after a new
+// client connected.
+void sendVideoConfig(
+    int codec, const unsigned char* config, int len, const unsigned char* hashed, size_t hashedLen
+) {
+    uint64_t hash = hashConfig(codec, hashed, hashedLen);
+    {
+        std::lock_guard<std::mutex> lock(g_configMutex);
+        if (g_configSent && g_configHash == hash) {
+            return;
+        }
+        g_configSent = true;
+        g_configHash = hash;
     }
+
+    SetVideoConfigNals(config, len, codec);
+}
+}
+
+void ResendVideoConfig() {
+    std::lock_guard<std::mutex> lock(g_configMutex);
+    g_configSent = false;
 }
 
 /*
-Sends the (VPS + )SPS + PPS video configuration headers from H.264 or H.265 stream as a sequence of
-NALs. (VPS + )SPS + PPS have short size (8bytes + 28bytes in some environment), so we can assume
-SPS + PPS is contained in first fragment.
+Strips the leading AUD and sends the (VPS + )SPS + PPS video configuration headers from H.264 or
+H.265 stream as a sequence of NALs. The configuration NALs must be followed by at least one other
+NAL, otherwise the frame is left untouched.
 */
-void sendHeaders(int codec, unsigned char*& buf, int& len, int nalNum) {
-    unsigned char* cursor = buf;
-    int headersLen = 0;
-    int foundHeaders = -1; // Offset by 1 header to find the length until the next header
-
-    while (headersLen <= len) {
-        if (headersLen + sizeof(NAL_PREFIX_4B) > (unsigned)len) {
-            cursor++;
-            headersLen++;
-            continue;
-        }
-        int8_t prefixSize = getNalPrefixSize(cursor);
-        if (prefixSize == -1) {
-            cursor++;
-            headersLen++;
-            continue;
-        }
-        foundHeaders++;
-        if (foundHeaders == nalNum) {
-            break;
-        }
-        headersLen += prefixSize;
-        cursor += prefixSize;
+void processNals(
+    int codec,
+    unsigned char*& buf,
+    int& len,
+    const std::vector<NalUnit>& nals,
+    unsigned char audType,
+    unsigned char firstConfigType,
+    size_t configCount
+) {
+    if (nals.empty()) {
+        return;
     }
 
-    if (foundHeaders != nalNum) {
+    unsigned char* frame = buf;
+    int frameLen = len;
+
+    size_t first = 0;
+    if (nals[0].type == audType && nals.size() > 1) {
+        first = 1;
+        buf = frame + nals[1].offset;
+        len = frameLen - nals[1].offset;
+    }
+
+    if (nals[first].type != firstConfigType || nals.size() <= first + configCount) {
         return;
     }
 
-    SetVideoConfigNals((const unsigned char*)buf, headersLen, codec);
+    uint32_t headersEnd = nals[first + configCount].offset;
+    const unsigned char* config = frame + nals[first].offset;
+    int configLen = headersEnd - nals[first].offset;
+    sendVideoConfig(codec, config, configLen, config, configLen);
 
     // move the cursor forward excluding config NALs
-    buf = cursor;
-    len -= headersLen;
+    buf = frame + headersEnd;
+    len = frameLen - headersEnd;
 }
 
-void processH264Nals(unsigned char*& buf, int& len) {
-    unsigned char prefixSize = getNalPrefixSize(buf);
-    unsigned char nalType = buf[prefixSize] & 0x1F;
+// Strips the AUD and sends the configuration NALs. Returns false if the frame is too short to be
+// sent.
+bool PrepareFrameNals(int codec, unsigned char*& buf, int& len) {
+    if (len < 4) {
+        return false;
+    }
 
-    if (nalType == H264_NAL_TYPE_AUD && len > prefixSize * 2 + 2) {
-        buf += prefixSize + 2;
-        len -= prefixSize + 2;
-        prefixSize = getNalPrefixSize(buf);
-        nalType = buf[prefixSize] & 0x1F;
+    if (codec == ALVR_CODEC_H264) {
+        BuildNalIndex(codec, buf, len, t_nals);
+        processNals(codec, buf, len, t_nals, H264_NAL_TYPE_AUD, H264_NAL_TYPE_SPS, 2);
+    } else if (codec == ALVR_CODEC_HEVC) {
+        BuildNalIndex(codec, buf, len, t_nals);
+        processNals(codec, buf, len, t_nals, HEVC_NAL_TYPE_AUD, HEVC_NAL_TYPE_VPS, 3);
+    } else if (codec == ALVR_CODEC_AV1) {
+        // The sequence header stays in band, decoders take it from the keyframes. The empty
+        // configuration stands for it, sent again when the sequence header changes.
+        BuildNalIndex(codec, buf, len, t_nals);
+        auto sequenceHeader = std::find_if(t_nals.begin(), t_nals.end(), [](const NalUnit& obu) {
+            return obu.type == AV1_OBU_SEQUENCE_HEADER;
+        });
+        if (sequenceHeader != t_nals.end()) {
+            sendVideoConfig(codec, 0, 0, buf + sequenceHeader->offset, sequenceHeader->size);
+        }
     }
-    if (nalType == H264_NAL_TYPE_SPS) {
-        sendHeaders(ALVR_CODEC_H264, buf, len, 2); // 2 headers SPS and PPS
+    return true;
+}
+
+void ParseFrameNals(
+    int codec, unsigned char* buf, int len, unsigned long long targetTimestampNs, bool isIdr
+) {
+    FrameTraceMark(targetTimestampNs, FRAME_TRACE_ENCODE_COMPLETE);
+    if (!PrepareFrameNals(codec, buf, len)) {
+        return;
     }
+    FrameTraceMark(targetTimestampNs, FRAME_TRACE_NAL_PARSE);
+
+    VideoSend(targetTimestampNs, buf, len, isIdr);
+    MetricsFrameSent(len, isIdr);
+    FrameTraceMark(targetTimestampNs, FRAME_TRACE_VIDEO_SEND);
+    FrameTraceCommit(targetTimestampNs);
+}
+
+bool SliceOutputEnabled() {
+    const auto& settings = Settings::Instance();
+    return (settings.m_encoderSlicesPerFrame > 1 || settings.m_encoderMaxSliceBytes > 0)
+        && VideoSendSlice != nullptr;
 }
 
-void processHevcNals(unsigned char*& buf, int& len) {
-    unsigned char prefixSize = getNalPrefixSize(buf);
-    unsigned char nalType = (buf[prefixSize] >> 1) & 0x3F;
+// Only the first slice of a frame can carry the AUD and configuration NALs
+void ParseSliceNals(
+    int codec,
+    unsigned char* buf,
+    int len,
+    unsigned long long targetTimestampNs,
+    bool isIdr,
+    bool isFirstSlice,
+    bool isLastSlice
+) {
+    if (isFirstSlice) {
+        if (!PrepareFrameNals(codec, buf, len)) {
+            len = 0;
+        }
+        FrameTraceMark(targetTimestampNs, FRAME_TRACE_NAL_PARSE);
+    }
+    // An empty call still has to be made to mark the end of the frame
+    if (len <= 0 && !isLastSlice) {
+        return;
+    }
 
-    if (nalType == HEVC_NAL_TYPE_AUD && len > prefixSize * 2 + 3) {
-        buf += prefixSize + 3;
-        len -= prefixSize + 3;
-        prefixSize = getNalPrefixSize(buf);
-        nalType = (buf[prefixSize] >> 1) & 0x3F;
+    if (isLastSlice) {
+        FrameTraceMark(targetTimestampNs, FRAME_TRACE_ENCODE_COMPLETE);
+    }
+    VideoSendSlice(targetTimestampNs, buf, len, isIdr, isLastSlice);
+    if (isLastSlice) {
+        MetricsFrameSent(0, isIdr);
     }
-    if (nalType == HEVC_NAL_TYPE_VPS) {
-        sendHeaders(ALVR_CODEC_HEVC, buf, len, 3); // 3 headers VPS, SPS and PPS
+    MetricsCount(DRIVER_COUNTER_BYTES_SENT, len > 0 ? len : 0);
+    if (isLastSlice) {
+        FrameTraceMark(targetTimestampNs, FRAME_TRACE_VIDEO_SEND);
+        FrameTraceCommit(targetTimestampNs);
     }
 }
 
-void ParseFrameNals(
+void ParseFrameSliceNals(
     int codec, unsigned char* buf, int len, unsigned long long targetTimestampNs, bool isIdr
 ) {
-    static bool av1GotFrame = false;
-
-    if ((unsigned)len < sizeof(NAL_PREFIX_4B)) {
+    if (len < 4 || !BuildNalIndex(codec, buf, len, t_sliceNals)) {
+        ParseFrameNals(codec, buf, len, targetTimestampNs, isIdr);
         return;
     }
 
-    if (codec == ALVR_CODEC_H264) {
-        processH264Nals(buf, len);
-    } else if (codec == ALVR_CODEC_HEVC) {
-        processHevcNals(buf, len);
-    } else if (codec == ALVR_CODEC_AV1 && !av1GotFrame) {
-        av1GotFrame = true;
-        SetVideoConfigNals(0, 0, codec);
+    // Each slice starts at its slice NAL or AV1 tile group, the units before the first go with it
+    uint32_t start = 0;
+    bool firstSlice = true;
+    bool sliceSeen = false;
+    for (const NalUnit& nal : t_sliceNals) {
+        if (!isSliceNal(codec, nal)) {
+            continue;
+        }
+        if (sliceSeen) {
+            ParseSliceNals(
+                codec, buf + start, nal.offset - start, targetTimestampNs, isIdr, firstSlice, false
+            );
+            firstSlice = false;
+            start = nal.offset;
+        }
+        sliceSeen = true;
     }
-
-    VideoSend(targetTimestampNs, buf, len, isIdr);
+    ParseSliceNals(codec, buf + start, len - start, targetTimestampNs, isIdr, firstSlice, true);
 }
@@ -2,79 +2,79 @@
 // Original copyright preserved
 
 #include "Paths.h"
+#include "Logger.h"
 #include "bindings.h"
-
-uint64_t HEAD_ID;
-uint64_t HAND_LEFT_ID;
-uint64_t HAND_RIGHT_ID;
-uint64_t HAND_TRACKER_LEFT_ID;
-uint64_t HAND_TRACKER_RIGHT_ID;
-uint64_t BODY_CHEST_ID;
-uint64_t BODY_HIPS_ID;
-uint64_t BODY_LEFT_ELBOW_ID;
-uint64_t BODY_RIGHT_ELBOW_ID;
-uint64_t BODY_LEFT_KNEE_ID;
-uint64_t BODY_LEFT_FOOT_ID;
-uint64_t BODY_RIGHT_KNEE_ID;
-uint64_t BODY_RIGHT_FOOT_ID;
-
-uint64_t LEFT_A_TOUCH_ID;
-uint64_t LEFT_B_TOUCH_ID;
-uint64_t LEFT_X_TOUCH_ID;
-uint64_t LEFT_Y_TOUCH_ID;
-uint64_t LEFT_TRACKPAD_TOUCH_ID;
-uint64_t LEFT_THUMBSTICK_TOUCH_ID;
-uint64_t LEFT_THUMBREST_TOUCH_ID;
-uint64_t LEFT_TRIGGER_TOUCH_ID;
-uint64_t LEFT_TRIGGER_VALUE_ID;
-uint64_t LEFT_SQUEEZE_VALUE_ID;
-uint64_t RIGHT_A_TOUCH_ID;
-uint64_t RIGHT_B_TOUCH_ID;
-uint64_t RIGHT_TRACKPAD_TOUCH_ID;
-uint64_t RIGHT_THUMBSTICK_TOUCH_ID;
-uint64_t RIGHT_THUMBREST_TOUCH_ID;
-uint64_t RIGHT_TRIGGER_TOUCH_ID;
-uint64_t RIGHT_TRIGGER_VALUE_ID;
-uint64_t RIGHT_SQUEEZE_VALUE_ID;
+#include <cstring>
 
 std::set<uint64_t> BODY_IDS;
 std::map<uint64_t, ButtonInfo> LEFT_CONTROLLER_BUTTON_MAPPING;
 std::map<uint64_t, ButtonInfo> RIGHT_CONTROLLER_BUTTON_MAPPING;
-std::map<uint64_t, std::vector<uint64_t>> ALVR_TO_STEAMVR_PATH_IDS;
+std::vector<const char*> STEAMVR_COMPONENT_PATHS;
+std::vector<ButtonSlot> BUTTON_SLOTS(1, ButtonSlot {});
+uint64_t BUTTON_SLOT_MULTIPLIER = 0;
+int BUTTON_SLOT_SHIFT = 63;
 
-void init_paths() {
-    HEAD_ID = PathStringToHash("/user/head");
-    HAND_LEFT_ID = PathStringToHash("/user/hand/left");
-    HAND_RIGHT_ID = PathStringToHash("/user/hand/right");
-    HAND_TRACKER_LEFT_ID = PathStringToHash("/user/hand_tracker/left");
-    HAND_TRACKER_RIGHT_ID = PathStringToHash("/user/hand_tracker/right");
-    BODY_CHEST_ID = PathStringToHash("/user/body/chest");
-    BODY_HIPS_ID = PathStringToHash("/user/body/waist");
-    BODY_LEFT_ELBOW_ID = PathStringToHash("/user/body/left_elbow");
-    BODY_RIGHT_ELBOW_ID = PathStringToHash("/user/body/right_elbow");
-    BODY_LEFT_KNEE_ID = PathStringToHash("/user/body/left_knee");
-    BODY_LEFT_FOOT_ID = PathStringToHash("/user/body/left_foot");
-    BODY_RIGHT_KNEE_ID = PathStringToHash("/user/body/right_knee");
-    BODY_RIGHT_FOOT_ID = PathStringToHash("/user/body/right_foot");
+namespace {
+
+uint32_t component_index(const char* path) {
+    for (uint32_t i = 0; i < STEAMVR_COMPONENT_PATHS.size(); i++) {
+        if (strcmp(STEAMVR_COMPONENT_PATHS[i], path) == 0) {
+            return i;
+        }
+    }
+    STEAMVR_COMPONENT_PATHS.push_back(path);
+    return STEAMVR_COMPONENT_PATHS.size() - 1;
+}
+
+void build_button_slots(std::vector<ButtonSlot> buttons) {
+    // Start at twice as many slots as buttons, a multiplier without collisions is then quick to
+    // find among a few random ones
+    int bits = 1;
+    while (((size_t)1 << bits) < buttons.size() * 2) {
+        bits++;
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15;
+    for (;; bits++) {
+        for (int attempt = 0; attempt < 64; attempt++) {
+            // splitmix64, odd so the multiplication is a bijection
+            seed += 0x9e3779b97f4a7c15;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            uint64_t multiplier = (z ^ (z >> 31)) | 1;
 
-    LEFT_A_TOUCH_ID = PathStringToHash("/user/hand/left/input/a/touch");
-    LEFT_B_TOUCH_ID = PathStringToHash("/user/hand/left/input/b/touch");
-    LEFT_X_TOUCH_ID = PathStringToHash("/user/hand/left/input/x/touch");
-    LEFT_Y_TOUCH_ID = PathStringToHash("/user/hand/left/input/y/touch");
-    LEFT_TRACKPAD_TOUCH_ID = PathStringToHash("/user/hand/left/input/trackpad/touch");
-    LEFT_THUMBSTICK_TOUCH_ID = PathStringToHash("/user/hand/left/input/thumbstick/touch");
-    LEFT_THUMBREST_TOUCH_ID = PathStringToHash("/user/hand/left/input/thumbrest/touch");
-    LEFT_TRIGGER_TOUCH_ID = PathStringToHash("/user/hand/left/input/trigger/touch");
-    LEFT_TRIGGER_VALUE_ID = PathStringToHash("/user/hand/left/input/trigger/value");
-    LEFT_SQUEEZE_VALUE_ID = PathStringToHash("/user/hand/left/input/squeeze/value");
-    RIGHT_A_TOUCH_ID = PathStringToHash("/user/hand/right/input/a/touch");
-    RIGHT_B_TOUCH_ID = PathStringToHash("/user/hand/right/input/b/touch");
-    RIGHT_TRACKPAD_TOUCH_ID = PathStringToHash("/user/hand/right/input/trackpad/touch");
-    RIGHT_THUMBSTICK_TOUCH_ID = PathStringToHash("/user/hand/right/input/thumbstick/touch");
-    RIGHT_THUMBREST_TOUCH_ID = PathStringToHash("/user/hand/right/input/thumbrest/touch");
-    RIGHT_TRIGGER_TOUCH_ID = PathStringToHash("/user/hand/right/input/trigger/touch");
-    RIGHT_TRIGGER_VALUE_ID = PathStringToHash("/user/hand/right/input/trigger/value");
-    RIGHT_SQUEEZE_VALUE_ID = PathStringToHash("/user/hand/right/input/squeeze/value");
+            std::vector<ButtonSlot> slots((size_t)1 << bits, ButtonSlot {});
+            bool collision = false;
+            for (auto& button : buttons) {
+                ButtonSlot& slot = slots[(button.id * multiplier) >> (64 - bits)];
+                // An ID in both mappings is kept as a button of the left controller
+                if (slot.id == button.id) {
+                    continue;
+                }
+                if (slot.id != 0) {
+                    collision = true;
+                    break;
+                }
+                slot = button;
+            }
+            if (!collision) {
+                BUTTON_SLOTS = std::move(slots);
+                BUTTON_SLOT_MULTIPLIER = multiplier;
+                BUTTON_SLOT_SHIFT = 64 - bits;
+                return;
+            }
+        }
+    }
+}
+
+} // namespace
+
+void init_paths() {
+    // The IDs were computed at compile time, a server core hashing differently would not
+    // recognize any device or input
+    if (PathStringToHash("/user/head") != HEAD_ID) {
+        Error("The path hash of the driver differs from the server core, inputs will not work.");
+    }
 
     BODY_IDS.insert(BODY_CHEST_ID);
     BODY_IDS.insert(BODY_HIPS_ID);
@@ -85,215 +85,215 @@ void init_paths() {
     BODY_IDS.insert(BODY_RIGHT_KNEE_ID);
     BODY_IDS.insert(BODY_RIGHT_FOOT_ID);
 
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/system/click"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/system/click"),
                                             { { "/input/system/click", "/input/left_ps/click" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/system/touch"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/system/touch"),
                                             { { "/input/system/touch", "/input/left_ps/touch" },
                                               ButtonType::Binary } });
     LEFT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/left/input/menu/click"),
+        { PathHash("/user/hand/left/input/menu/click"),
           { { "/input/system/click", "/input/application_menu/click", "/input/create/click" },
             ButtonType::Binary } }
     );
     LEFT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/left/input/menu/touch"),
+        { PathHash("/user/hand/left/input/menu/touch"),
           { { "/input/system/touch", "/input/application_menu/touch", "/input/create/touch" },
             ButtonType::Binary } }
     );
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/a/click"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/a/click"),
                                             { { "/input/a/click", "/input/cross/click" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/a/touch"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/a/touch"),
                                             { { "/input/a/touch", "/input/cross/touch" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/b/click"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/b/click"),
                                             { { "/input/b/click", "/input/circle/click" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/b/touch"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/b/touch"),
                                             { { "/input/b/touch", "/input/circle/touch" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/x/click"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/x/click"),
                                             { { "/input/x/click", "/input/square/click" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/x/touch"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/x/touch"),
                                             { { "/input/x/touch", "/input/square/touch" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/y/click"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/y/click"),
                                             { { "/input/y/click", "/input/triangle/click" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/y/touch"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/y/touch"),
                                             { { "/input/y/touch", "/input/triangle/touch" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/squeeze/click"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/squeeze/click"),
                                             { { "/input/grip/click", "/input/l1/click" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/squeeze/touch"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/squeeze/touch"),
                                             { { "/input/grip/touch", "/input/l1/touch" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/squeeze/value"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/squeeze/value"),
                                             { { "/input/grip/value", "/input/l1/value" },
                                               ButtonType::ScalarOneSided } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/squeeze/force"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/squeeze/force"),
                                             { { "/input/grip/force" },
                                               ButtonType::ScalarOneSided } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/trigger/click"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/trigger/click"),
                                             { { "/input/trigger/click", "/input/l2/click" },
                                               ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/trigger/value"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/trigger/value"),
                                             { { "/input/trigger/value", "/input/l2/value" },
                                               ButtonType::ScalarOneSided } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/trigger/touch"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/trigger/touch"),
                                             { { "/input/trigger/touch", "/input/l2/touch" },
                                               ButtonType::Binary } });
     LEFT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/left/input/thumbstick/x"),
+        { PathHash("/user/hand/left/input/thumbstick/x"),
           { { "/input/joystick/x", "/input/thumbstick/x", "/input/left_stick/x" },
             ButtonType::ScalarTwoSided } }
     );
     LEFT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/left/input/thumbstick/y"),
+        { PathHash("/user/hand/left/input/thumbstick/y"),
           { { "/input/joystick/y", "/input/thumbstick/y", "/input/left_stick/y" },
             ButtonType::ScalarTwoSided } }
     );
     LEFT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/left/input/thumbstick/click"),
+        { PathHash("/user/hand/left/input/thumbstick/click"),
           { { "/input/joystick/click", "/input/thumbstick/click", "/input/left_stick/click" },
             ButtonType::Binary } }
     );
     LEFT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/left/input/thumbstick/touch"),
+        { PathHash("/user/hand/left/input/thumbstick/touch"),
           { { "/input/joystick/touch", "/input/thumbstick/touch", "/input/left_stick/touch" },
             ButtonType::Binary } }
     );
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/trackpad/x"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/trackpad/x"),
                                             { { "/input/trackpad/x" },
                                               ButtonType::ScalarTwoSided } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/trackpad/y"),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/trackpad/y"),
                                             { { "/input/trackpad/y" },
                                               ButtonType::ScalarTwoSided } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/trackpad/click"
-                                            ),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/trackpad/click"),
                                             { { "/input/trackpad/click" }, ButtonType::Binary } });
     LEFT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/left/input/trackpad/force"),
+        { PathHash("/user/hand/left/input/trackpad/force"),
           { { "/input/trackpad/force" }, ButtonType::ScalarOneSided } }
     );
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/trackpad/touch"
-                                            ),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/trackpad/touch"),
                                             { { "/input/trackpad/touch" }, ButtonType::Binary } });
-    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/left/input/thumbrest/touch"
-                                            ),
+    LEFT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/left/input/thumbrest/touch"),
                                             { { "/input/thumbrest/touch" }, ButtonType::Binary } });
 
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/system/click"),
+        { PathHash("/user/hand/right/input/system/click"),
           { { "/input/system/click", "/input/right_ps/click" }, ButtonType::Binary } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/system/touch"),
+        { PathHash("/user/hand/right/input/system/touch"),
           { { "/input/system/touch", "/input/right_ps/touch" }, ButtonType::Binary } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/menu/click"),
+        { PathHash("/user/hand/right/input/menu/click"),
           { { "/input/system/click", "/input/application_menu/click", "/input/options/click" },
             ButtonType::Binary } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/menu/touch"),
+        { PathHash("/user/hand/right/input/menu/touch"),
           { { "/input/system/touch", "/input/application_menu/touch", "/input/options/touch" },
             ButtonType::Binary } }
     );
-    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/right/input/a/click"),
+    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/right/input/a/click"),
                                              { { "/input/a/click", "/input/cross/click" },
                                                ButtonType::Binary } });
-    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/right/input/a/touch"),
+    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/right/input/a/touch"),
                                              { { "/input/a/touch", "/input/cross/touch" },
                                                ButtonType::Binary } });
-    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/right/input/b/click"),
+    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/right/input/b/click"),
                                              { { "/input/b/click", "/input/circle/click" },
                                                ButtonType::Binary } });
-    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/right/input/b/touch"),
+    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/right/input/b/touch"),
                                              { { "/input/b/touch", "/input/circle/touch" },
                                                ButtonType::Binary } });
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/squeeze/click"),
+        { PathHash("/user/hand/right/input/squeeze/click"),
           { { "/input/grip/click", "/input/r1/click" }, ButtonType::Binary } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/squeeze/touch"),
+        { PathHash("/user/hand/right/input/squeeze/touch"),
           { { "/input/grip/touch", "/input/r1/touch" }, ButtonType::Binary } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/squeeze/value"),
+        { PathHash("/user/hand/right/input/squeeze/value"),
           { { "/input/grip/value", "/input/r1/value" }, ButtonType::ScalarOneSided } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/squeeze/force"),
+        { PathHash("/user/hand/right/input/squeeze/force"),
           { { "/input/grip/force" }, ButtonType::ScalarOneSided } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/trigger/click"),
+        { PathHash("/user/hand/right/input/trigger/click"),
           { { "/input/trigger/click", "/input/r2/click" }, ButtonType::Binary } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/trigger/value"),
+        { PathHash("/user/hand/right/input/trigger/value"),
           { { "/input/trigger/value", "/input/r2/value" }, ButtonType::ScalarOneSided } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/trigger/touch"),
+        { PathHash("/user/hand/right/input/trigger/touch"),
           { { "/input/trigger/touch", "/input/r2/touch" }, ButtonType::Binary } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/thumbstick/x"),
+        { PathHash("/user/hand/right/input/thumbstick/x"),
           { { "/input/joystick/x", "/input/thumbstick/x", "/input/right_stick/x" },
             ButtonType::ScalarTwoSided } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/thumbstick/y"),
+        { PathHash("/user/hand/right/input/thumbstick/y"),
           { { "/input/joystick/y", "/input/thumbstick/y", "/input/right_stick/y" },
             ButtonType::ScalarTwoSided } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/thumbstick/click"),
+        { PathHash("/user/hand/right/input/thumbstick/click"),
           { { "/input/joystick/click", "/input/thumbstick/click", "/input/right_stick/click" },
             ButtonType::Binary } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/thumbstick/touch"),
+        { PathHash("/user/hand/right/input/thumbstick/touch"),
           { { "/input/joystick/touch", "/input/thumbstick/touch", "/input/right_stick/touch" },
             ButtonType::Binary } }
     );
-    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/right/input/trackpad/x"),
+    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/right/input/trackpad/x"),
                                              { { "/input/trackpad/x" },
                                                ButtonType::ScalarTwoSided } });
-    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathStringToHash("/user/hand/right/input/trackpad/y"),
+    RIGHT_CONTROLLER_BUTTON_MAPPING.insert({ PathHash("/user/hand/right/input/trackpad/y"),
                                              { { "/input/trackpad/y" },
                                                ButtonType::ScalarTwoSided } });
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/trackpad/click"),
+        { PathHash("/user/hand/right/input/trackpad/click"),
           { { "/input/trackpad/click" }, ButtonType::Binary } }
     );
     LEFT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/trackpad/force"),
+        { PathHash("/user/hand/right/input/trackpad/force"),
           { { "/input/trackpad/force" }, ButtonType::ScalarOneSided } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/trackpad/touch"),
+        { PathHash("/user/hand/right/input/trackpad/touch"),
           { { "/input/trackpad/touch" }, ButtonType::Binary } }
     );
     RIGHT_CONTROLLER_BUTTON_MAPPING.insert(
-        { PathStringToHash("/user/hand/right/input/thumbrest/touch"),
+        { PathHash("/user/hand/right/input/thumbrest/touch"),
           { { "/input/thumbrest/touch" }, ButtonType::Binary } }
     );
 
-    for (auto hand : { LEFT_CONTROLLER_BUTTON_MAPPING, RIGHT_CONTROLLER_BUTTON_MAPPING }) {
-        for (auto info : hand) {
-            std::vector<uint64_t> ids;
+    std::vector<ButtonSlot> buttons;
+    for (bool left : { true, false }) {
+        for (auto& info :
+             left ? LEFT_CONTROLLER_BUTTON_MAPPING : RIGHT_CONTROLLER_BUTTON_MAPPING) {
+            ButtonSlot button = { info.first, left, info.second.type, {} };
             for (auto path : info.second.steamvr_paths) {
-                ids.push_back(PathStringToHash(path));
+                button.components.push_back(component_index(path));
             }
-            ALVR_TO_STEAMVR_PATH_IDS.insert({ info.first, ids });
+            buttons.push_back(std::move(button));
         }
     }
+    build_button_slots(std::move(buttons));
 }
@@ -10,42 +10,106 @@
 
 #include "openvr_driver_wrap.h"
 
-extern uint64_t HEAD_ID;
-extern uint64_t HAND_LEFT_ID;
-extern uint64_t HAND_RIGHT_ID;
-extern uint64_t HAND_TRACKER_LEFT_ID;
-extern uint64_t HAND_TRACKER_RIGHT_ID;
-extern uint64_t BODY_CHEST_ID;
-extern uint64_t BODY_HIPS_ID;
-extern uint64_t BODY_LEFT_ELBOW_ID;
-extern uint64_t BODY_RIGHT_ELBOW_ID;
-extern uint64_t BODY_LEFT_KNEE_ID;
-extern uint64_t BODY_LEFT_FOOT_ID;
-extern uint64_t BODY_RIGHT_KNEE_ID;
-extern uint64_t BODY_RIGHT_FOOT_ID;
+namespace paths_detail {
+
+constexpr uint64_t rotl(uint64_t x, int bits) { return (x << bits) | (x >> (64 - bits)); }
+
+struct SipState {
+    uint64_t v0 = 0x736f6d6570736575;
+    uint64_t v1 = 0x646f72616e646f6d;
+    uint64_t v2 = 0x6c7967656e657261;
+    uint64_t v3 = 0x7465646279746573;
+
+    constexpr void round() {
+        v0 += v1;
+        v1 = rotl(v1, 13);
+        v1 ^= v0;
+        v0 = rotl(v0, 32);
+        v2 += v3;
+        v3 = rotl(v3, 16);
+        v3 ^= v2;
+        v0 += v3;
+        v3 = rotl(v3, 21);
+        v3 ^= v0;
+        v2 += v1;
+        v1 = rotl(v1, 17);
+        v1 ^= v2;
+        v2 = rotl(v2, 32);
+    }
+
+    constexpr void compress(uint64_t word) {
+        v3 ^= word;
+        round();
+        v0 ^= word;
+    }
+};
+
+} // namespace paths_detail
+
+// The ID of a device or input path, the same as alvr_common::hash_string on the server core
+// side: SipHash-1-3 with zero keys of the path bytes followed by the 0xFF that Rust appends to
+// hashed strings. The server core still hashes at runtime with Rust's DefaultHasher, whose
+// algorithm is not guaranteed to stay the same, init_paths checks that both still agree.
+constexpr uint64_t PathHash(const char* path) {
+    paths_detail::SipState state;
+    uint64_t word = 0;
+    size_t length = 0;
+    for (bool end = false; !end; length++) {
+        uint64_t byte = (unsigned char)path[length];
+        if (byte == 0) {
+            byte = 0xFF;
+            end = true;
+        }
+        word |= byte << (8 * (length % 8));
+        if (length % 8 == 7) {
+            state.compress(word);
+            word = 0;
+        }
+    }
+    state.compress(word | ((uint64_t)length << 56));
+    state.v2 ^= 0xFF;
+    state.round();
+    state.round();
+    state.round();
+    return state.v0 ^ state.v1 ^ state.v2 ^ state.v3;
+}
+
+constexpr uint64_t HEAD_ID = PathHash("/user/head");
+constexpr uint64_t HAND_LEFT_ID = PathHash("/user/hand/left");
+constexpr uint64_t HAND_RIGHT_ID = PathHash("/user/hand/right");
+constexpr uint64_t HAND_TRACKER_LEFT_ID = PathHash("/user/hand_tracker/left");
+constexpr uint64_t HAND_TRACKER_RIGHT_ID = PathHash("/user/hand_tracker/right");
+constexpr uint64_t BODY_CHEST_ID = PathHash("/user/body/chest");
+constexpr uint64_t BODY_HIPS_ID = PathHash("/user/body/waist");
+constexpr uint64_t BODY_LEFT_ELBOW_ID = PathHash("/user/body/left_elbow");
+constexpr uint64_t BODY_RIGHT_ELBOW_ID = PathHash("/user/body/right_elbow");
+constexpr uint64_t BODY_LEFT_KNEE_ID = PathHash("/user/body/left_knee");
+constexpr uint64_t BODY_LEFT_FOOT_ID = PathHash("/user/body/left_foot");
+constexpr uint64_t BODY_RIGHT_KNEE_ID = PathHash("/user/body/right_knee");
+constexpr uint64_t BODY_RIGHT_FOOT_ID = PathHash("/user/body/right_foot");
 
 // These values are needed to determine the hand skeleton when holding a controller.
 // todo: move inferred hand skeleton to rust
-extern uint64_t LEFT_A_TOUCH_ID;
-extern uint64_t LEFT_B_TOUCH_ID;
-extern uint64_t LEFT_X_TOUCH_ID;
-extern uint64_t LEFT_Y_TOUCH_ID;
-extern uint64_t LEFT_TRACKPAD_TOUCH_ID;
-extern uint64_t LEFT_THUMBSTICK_TOUCH_ID;
-extern uint64_t LEFT_THUMBREST_TOUCH_ID;
-extern uint64_t LEFT_TRIGGER_TOUCH_ID;
-extern uint64_t LEFT_TRIGGER_VALUE_ID;
-extern uint64_t LEFT_SQUEEZE_TOUCH_ID;
-extern uint64_t LEFT_SQUEEZE_VALUE_ID;
-extern uint64_t RIGHT_A_TOUCH_ID;
-extern uint64_t RIGHT_B_TOUCH_ID;
-extern uint64_t RIGHT_TRACKPAD_TOUCH_ID;
-extern uint64_t RIGHT_THUMBSTICK_TOUCH_ID;
-extern uint64_t RIGHT_THUMBREST_TOUCH_ID;
-extern uint64_t RIGHT_TRIGGER_TOUCH_ID;
-extern uint64_t RIGHT_TRIGGER_VALUE_ID;
-extern uint64_t RIGHT_SQUEEZE_TOUCH_ID;
-extern uint64_t RIGHT_SQUEEZE_VALUE_ID;
+constexpr uint64_t LEFT_A_TOUCH_ID = PathHash("/user/hand/left/input/a/touch");
+constexpr uint64_t LEFT_B_TOUCH_ID = PathHash("/user/hand/left/input/b/touch");
+constexpr uint64_t LEFT_X_TOUCH_ID = PathHash("/user/hand/left/input/x/touch");
+constexpr uint64_t LEFT_Y_TOUCH_ID = PathHash("/user/hand/left/input/y/touch");
+constexpr uint64_t LEFT_TRACKPAD_TOUCH_ID = PathHash("/user/hand/left/input/trackpad/touch");
+constexpr uint64_t LEFT_THUMBSTICK_TOUCH_ID = PathHash("/user/hand/left/input/thumbstick/touch");
+constexpr uint64_t LEFT_THUMBREST_TOUCH_ID = PathHash("/user/hand/left/input/thumbrest/touch");
+constexpr uint64_t LEFT_TRIGGER_TOUCH_ID = PathHash("/user/hand/left/input/trigger/touch");
+constexpr uint64_t LEFT_TRIGGER_VALUE_ID = PathHash("/user/hand/left/input/trigger/value");
+constexpr uint64_t LEFT_SQUEEZE_TOUCH_ID = PathHash("/user/hand/left/input/squeeze/touch");
+constexpr uint64_t LEFT_SQUEEZE_VALUE_ID = PathHash("/user/hand/left/input/squeeze/value");
+constexpr uint64_t RIGHT_A_TOUCH_ID = PathHash("/user/hand/right/input/a/touch");
+constexpr uint64_t RIGHT_B_TOUCH_ID = PathHash("/user/hand/right/input/b/touch");
+constexpr uint64_t RIGHT_TRACKPAD_TOUCH_ID = PathHash("/user/hand/right/input/trackpad/touch");
+constexpr uint64_t RIGHT_THUMBSTICK_TOUCH_ID = PathHash("/user/hand/right/input/thumbstick/touch");
+constexpr uint64_t RIGHT_THUMBREST_TOUCH_ID = PathHash("/user/hand/right/input/thumbrest/touch");
+constexpr uint64_t RIGHT_TRIGGER_TOUCH_ID = PathHash("/user/hand/right/input/trigger/touch");
+constexpr uint64_t RIGHT_TRIGGER_VALUE_ID = PathHash("/user/hand/right/input/trigger/value");
+constexpr uint64_t RIGHT_SQUEEZE_TOUCH_ID = PathHash("/user/hand/right/input/squeeze/touch");
+constexpr uint64_t RIGHT_SQUEEZE_VALUE_ID = PathHash("/user/hand/right/input/squeeze/value");
 
 enum class ButtonType {
     Binary,
@@ -58,9 +122,33 @@ struct ButtonInfo {
     ButtonType type;
 };
 
+// A button ID of either controller with everything needed to register and update it
+struct ButtonSlot {
+    uint64_t id; // 0 for an empty slot
+    bool left;
+    ButtonType type;
+    // Indices in STEAMVR_COMPONENT_PATHS of the steamvr_paths of the button
+    std::vector<uint32_t> components;
+};
+
 extern std::set<uint64_t> BODY_IDS;
 extern std::map<uint64_t, ButtonInfo> LEFT_CONTROLLER_BUTTON_MAPPING;
 extern std::map<uint64_t, ButtonInfo> RIGHT_CONTROLLER_BUTTON_MAPPING;
-extern std::map<uint64_t, std::vector<uint64_t>> ALVR_TO_STEAMVR_PATH_IDS;
+// Distinct SteamVR paths of the buttons of both controllers, a controller keeps one component
+// handle for each
+extern std::vector<const char*> STEAMVR_COMPONENT_PATHS;
+
+// The button IDs are hashes spread over the whole 64 bits, too sparse to index a table.
+// init_paths searches a multiplier that sends every known ID to a slot of its own, a lookup is
+// then a multiplication, a shift and a single compare.
+extern std::vector<ButtonSlot> BUTTON_SLOTS;
+extern uint64_t BUTTON_SLOT_MULTIPLIER;
+extern int BUTTON_SLOT_SHIFT;
+
+// Null if the ID is not a button of either controller
+inline const ButtonSlot* FindButton(uint64_t id) {
+    const ButtonSlot& slot = BUTTON_SLOTS[(id * BUTTON_SLOT_MULTIPLIER) >> BUTTON_SLOT_SHIFT];
+    return slot.id == id && id != 0 ? &slot : nullptr;
+}
 
 void init_paths();
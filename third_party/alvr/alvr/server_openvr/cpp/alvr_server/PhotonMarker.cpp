@@ -0,0 +1,39 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "PhotonMarker.h"
+
+namespace {
+uint16_t crc16(const uint8_t* data, uint32_t size) {
+    uint16_t crc = 0xFFFF;
+    for (uint32_t i = 0; i < size; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+}
+
+void GetPhotonMarkerCells(
+    uint64_t targetTimestampNs, uint32_t frameCounter, uint8_t cells[PHOTON_MARKER_CELLS]
+) {
+    uint8_t bytes[14];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t)(targetTimestampNs >> (i * 8));
+    }
+    for (int i = 0; i < 4; i++) {
+        bytes[8 + i] = (uint8_t)(frameCounter >> (i * 8));
+    }
+    uint16_t crc = crc16(bytes, 12);
+    bytes[12] = (uint8_t)crc;
+    bytes[13] = (uint8_t)(crc >> 8);
+
+    for (uint32_t i = 0; i < PHOTON_MARKER_COLUMNS; i++) {
+        cells[i] = (i + 1) & 1;
+    }
+    for (uint32_t i = 0; i < sizeof(bytes) * 8; i++) {
+        cells[PHOTON_MARKER_COLUMNS + i] = (bytes[i / 8] >> (i % 8)) & 1;
+    }
+}
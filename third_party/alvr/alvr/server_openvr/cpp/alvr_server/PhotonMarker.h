@@ -0,0 +1,27 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Marker stamped into the top left corner of every encoded frame with photon_marker, for the
+// client to read back from the decoded frame and from the presented one. It measures the render
+// to photon latency of each frame without relying on the clock sync.
+//
+// PHOTON_MARKER_ROWS rows of PHOTON_MARKER_COLUMNS square cells, black for 0 and white for 1, in
+// row-major order: a row of alternating cells starting with white to locate the marker and pick
+// the threshold, then targetTimestampNs (64 bits), the frame counter (32 bits) and the
+// CRC-16/CCITT-FALSE of their 12 little endian bytes (16 bits), each least significant bit first.
+// The cells are large enough to survive 4:2:0 subsampling and the quantization of low bitrates.
+const uint32_t PHOTON_MARKER_CELL_SIZE = 8;
+const uint32_t PHOTON_MARKER_COLUMNS = 16;
+const uint32_t PHOTON_MARKER_ROWS = 8;
+const uint32_t PHOTON_MARKER_CELLS = PHOTON_MARKER_COLUMNS * PHOTON_MARKER_ROWS;
+const uint32_t PHOTON_MARKER_WIDTH = PHOTON_MARKER_COLUMNS * PHOTON_MARKER_CELL_SIZE;
+const uint32_t PHOTON_MARKER_HEIGHT = PHOTON_MARKER_ROWS * PHOTON_MARKER_CELL_SIZE;
+
+// Sets each cell of the marker to 1 for white and 0 for black
+void GetPhotonMarkerCells(
+    uint64_t targetTimestampNs, uint32_t frameCounter, uint8_t cells[PHOTON_MARKER_CELLS]
+);
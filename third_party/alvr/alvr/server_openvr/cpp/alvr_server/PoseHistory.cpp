@@ -5,66 +5,279 @@
 #include "Logger.h"
 #include "Utils.h"
 #include "include/openvr_math.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <mutex>
 #include <optional>
 
-void PoseHistory::OnPoseUpdated(uint64_t targetTimestampNs, FfiDeviceMotion motion) {
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define POSE_HISTORY_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define POSE_HISTORY_NEON
+#endif
+
+namespace {
+
+const size_t SIMD_LANES = 4;
+// Squared distance below which a stored rotation is considered the one the compositor used
+const float EXACT_MATCH_DISTANCE = 1e-6f;
+// Roll between consecutive tags. The matrix entries then differ by about this much, far above the
+// float rounding of the compositor and far below a pixel.
+const float TAG_ROLL_STEP = 4e-6f;
+// Squared distance below which a rotation is the one of a tag, a quarter of the step
+const float TAG_MATCH_DISTANCE = TAG_ROLL_STEP * TAG_ROLL_STEP / 16;
+
+// Squared Frobenius distance between `target` and the rotations of slots [pos, pos + 4). Entry k of
+// slot s lives at columns[k * stride + s].
+void RotationDistances(
+    const float* columns, size_t stride, size_t pos, const float target[9], float out[SIMD_LANES]
+) {
+#if defined(POSE_HISTORY_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (size_t k = 0; k < 9; k++) {
+        __m128 d = _mm_sub_ps(_mm_load_ps(columns + k * stride + pos), _mm_set1_ps(target[k]));
+        acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+    }
+    _mm_storeu_ps(out, acc);
+#elif defined(POSE_HISTORY_NEON)
+    float32x4_t acc = vdupq_n_f32(0);
+    for (size_t k = 0; k < 9; k++) {
+        float32x4_t d = vsubq_f32(vld1q_f32(columns + k * stride + pos), vdupq_n_f32(target[k]));
+        acc = vmlaq_f32(acc, d, d);
+    }
+    vst1q_f32(out, acc);
+#else
+    for (size_t lane = 0; lane < SIMD_LANES; lane++) {
+        float distance = 0;
+        for (size_t k = 0; k < 9; k++) {
+            float d = columns[k * stride + pos + lane] - target[k];
+            distance += d * d;
+        }
+        out[lane] = distance;
+    }
+#endif
+}
+
+} // namespace
+
+FfiQuat PoseHistory::OnPoseUpdated(uint64_t targetTimestampNs, FfiDeviceMotion motion) {
+    uint64_t index = m_writeIndex.load(std::memory_order_relaxed);
+    // A newer orientation for the same timestamp replaces the newest sample and keeps its tag, the
+    // compositor renders with the last pose it was given
+    bool repeated = index != 0 && m_lastTimestampNs == targetTimestampNs;
+    if (repeated) {
+        index--;
+    }
+    m_lastTimestampNs = targetTimestampNs;
+
     // Put pose history buffer
     TrackingHistoryFrame history;
     history.targetTimestampNs = targetTimestampNs;
     history.motion = motion;
 
-    HmdMatrix_QuatToMat(
-        motion.pose.orientation.w,
-        motion.pose.orientation.x,
-        motion.pose.orientation.y,
-        motion.pose.orientation.z,
-        &history.rotationMatrix
-    );
+    // Roll around the view axis, applied on the right of the orientation
+    const FfiQuat& q = motion.pose.orientation;
+    float halfRoll = TAG_ROLL_STEP * (index % TAG_COUNT) / 2;
+    float c = cosf(halfRoll);
+    float s = sinf(halfRoll);
+    FfiQuat tagged = {
+        q.x * c + q.y * s, q.y * c - q.x * s, q.z * c + q.w * s, q.w * c - q.z * s
+    };
 
-    std::unique_lock<std::mutex> lock(m_mutex);
-    if (!m_transformIdentity) {
-        vr::HmdMatrix34_t rotation = vrmath::matMul33(m_transform, history.rotationMatrix);
-        history.rotationMatrix = rotation;
+    HmdMatrix_QuatToMat(tagged.w, tagged.x, tagged.y, tagged.z, &history.rotationMatrix);
+
+    {
+        std::unique_lock<std::mutex> lock(m_transformMutex);
+        if (!m_transformIdentity) {
+            vr::HmdMatrix34_t rotation = vrmath::matMul33(m_transform, history.rotationMatrix);
+            history.rotationMatrix = rotation;
+        }
     }
 
-    if (m_poseBuffer.size() == 0) {
-        m_poseBuffer.push_back(history);
-    } else {
-        if (m_poseBuffer.back().targetTimestampNs != targetTimestampNs) {
-            // New track info
-            m_poseBuffer.push_back(history);
+    // Seqlock write: mark the slot busy, fill it, then publish it with an even sequence
+    Slot& slot = m_slots[index % CAPACITY];
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.index = index;
+    slot.frame = history;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            m_rotations[i * 3 + j][index % CAPACITY] = history.rotationMatrix.m[i][j];
         }
     }
-    // The value should match with the client's MAXIMUM_TRACKING_FRAMES in ovr_context.cpp
-    if (m_poseBuffer.size() > 120 * 3) {
-        m_poseBuffer.pop_front();
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+
+    if (!repeated) {
+        m_writeIndex.store(index + 1, std::memory_order_release);
     }
+
+    return tagged;
 }
 
-std::optional<PoseHistory::TrackingHistoryFrame>
-PoseHistory::GetBestPoseMatch(const vr::HmdMatrix34_t& pose) const {
-    std::unique_lock<std::mutex> lock(m_mutex);
+bool PoseHistory::ReadSlot(uint64_t index, TrackingHistoryFrame& out) const {
+    const Slot& slot = m_slots[index % CAPACITY];
+    uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+        return false;
+    }
+    uint64_t slotIndex = slot.index;
+    out = slot.frame;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+    return before == after && slotIndex == index;
+}
+
+std::optional<uint64_t> PoseHistory::FindClosestRotation(const float target[9]) const {
+    uint64_t end = m_writeIndex.load(std::memory_order_acquire);
+    if (end == 0) {
+        return {};
+    }
+    uint64_t count = end < CAPACITY ? end : CAPACITY;
+    size_t newestPos = (end - 1) % CAPACITY;
+
+    // Walk the ring from the block holding the newest frame towards older ones. The compositor
+    // usually hands back a pose we gave it a few frames ago, so an exact match ends the search.
     float minDiff = 100000;
-    auto minIt = m_poseBuffer.begin();
-    for (auto it = m_poseBuffer.begin(); it != m_poseBuffer.end(); ++it) {
-        float distance = 0;
-        // Rotation matrix composes a part of ViewMatrix of TrackingInfo.
-        // Be carefull of transpose.
-        // And bottom side and right side of matrix should not be compared, because pPose does not
-        // contain that part of matrix.
-        for (int i = 0; i < 3; i++) {
-            for (int j = 0; j < 3; j++) {
-                distance += pow(it->rotationMatrix.m[j][i] - pose.m[j][i], 2);
+    uint64_t bestIndex = 0;
+    size_t block = newestPos / SIMD_LANES * SIMD_LANES;
+    for (size_t visited = 0; visited < CAPACITY; visited += SIMD_LANES) {
+        float distances[SIMD_LANES];
+        RotationDistances(&m_rotations[0][0], CAPACITY, block, target, distances);
+
+        for (size_t lane = 0; lane < SIMD_LANES; lane++) {
+            // How many frames older than the newest one this slot is
+            uint64_t age = (newestPos + CAPACITY - (block + lane)) % CAPACITY;
+            if (age < count && minDiff > distances[lane]) {
+                minDiff = distances[lane];
+                bestIndex = end - 1 - age;
             }
         }
-        if (minDiff > distance) {
-            minIt = it;
-            minDiff = distance;
+        if (minDiff < EXACT_MATCH_DISTANCE) {
+            break;
+        }
+        block = (block + CAPACITY - SIMD_LANES) % CAPACITY;
+    }
+
+    return bestIndex;
+}
+
+std::optional<uint64_t> PoseHistory::FindTaggedRotation(const float target[9]) const {
+    uint64_t end = m_writeIndex.load(std::memory_order_acquire);
+    uint64_t count = std::min<uint64_t>(end, TAG_COUNT);
+    for (uint64_t index = end - count; index < end; index++) {
+        size_t pos = index % CAPACITY;
+        float distance = 0;
+        for (size_t k = 0; k < 9; k++) {
+            float d = m_rotations[k][pos] - target[k];
+            distance += d * d;
+        }
+        // The tags of these frames differ, at most one of them is this close
+        if (distance < TAG_MATCH_DISTANCE) {
+            return index;
+        }
+    }
+    return {};
+}
+
+std::optional<uint64_t> PoseHistory::FindTimestamp(uint64_t timestampNs) const {
+    uint64_t end = m_writeIndex.load(std::memory_order_acquire);
+    if (end == 0) {
+        return {};
+    }
+    uint64_t lo = end > CAPACITY ? end - CAPACITY : 0;
+    uint64_t hi = end - 1;
+
+    TrackingHistoryFrame frame;
+    if (!ReadSlot(hi, frame)) {
+        return {};
+    }
+    if (frame.targetTimestampNs <= timestampNs) {
+        return hi;
+    }
+    uint64_t hiTs = frame.targetTimestampNs;
+    // The oldest slots are the next ones recycled by the tracking thread
+    while (!ReadSlot(lo, frame)) {
+        if (++lo == hi) {
+            return {};
         }
     }
-    if (minIt != m_poseBuffer.end()) {
-        return *minIt;
+    if (frame.targetTimestampNs > timestampNs) {
+        return {};
+    }
+    uint64_t loTs = frame.targetTimestampNs;
+
+    // Keeps ts(lo) <= timestampNs < ts(hi). Guesses alternate with bisections, so that uneven
+    // timestamps can't turn the search into a walk over the whole ring.
+    bool bisect = false;
+    while (hi - lo > 1) {
+        uint64_t probe;
+        if (bisect) {
+            probe = lo + (hi - lo) / 2;
+        } else {
+            double ratio = (double)(timestampNs - loTs) / (double)(hiTs - loTs);
+            probe = lo + (uint64_t)(ratio * (hi - lo));
+            probe = std::min(std::max(probe, lo + 1), hi - 1);
+        }
+        bisect = !bisect;
+
+        if (!ReadSlot(probe, frame)) {
+            return {};
+        }
+        if (frame.targetTimestampNs > timestampNs) {
+            hi = probe;
+            hiTs = frame.targetTimestampNs;
+            continue;
+        }
+        lo = probe;
+        loTs = frame.targetTimestampNs;
+        if (loTs == timestampNs || lo + 1 == hi) {
+            break;
+        }
+        // A good guess lands just before the timestamp, the next frame closes the range
+        if (!ReadSlot(lo + 1, frame)) {
+            return {};
+        }
+        if (frame.targetTimestampNs > timestampNs) {
+            break;
+        }
+        lo++;
+        loTs = frame.targetTimestampNs;
+    }
+
+    return lo;
+}
+
+std::optional<PoseHistory::TrackingHistoryFrame>
+PoseHistory::GetBestPoseMatch(const vr::HmdMatrix34_t& pose) const {
+    // Rotation matrix composes a part of ViewMatrix of TrackingInfo.
+    // Be carefull of transpose.
+    // And bottom side and right side of matrix should not be compared, because pPose does not
+    // contain that part of matrix.
+    float target[9];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            target[i * 3 + j] = pose.m[i][j];
+        }
+    }
+
+    // The slot may be recycled by the tracking thread between the search and the copy, in which
+    // case the search is repeated on the updated history.
+    for (int attempt = 0; attempt < 3; attempt++) {
+        auto index = FindTaggedRotation(target);
+        if (!index) {
+            index = FindClosestRotation(target);
+        }
+        if (!index) {
+            break;
+        }
+        TrackingHistoryFrame frame;
+        if (ReadSlot(*index, frame)) {
+            return frame;
+        }
     }
 
     Debug("PoseHistory::GetBestPoseMatch: No pose matched.");
@@ -73,18 +286,91 @@ PoseHistory::GetBestPoseMatch(const vr::HmdMatrix34_t& pose) const {
 
 std::optional<PoseHistory::TrackingHistoryFrame> PoseHistory::GetPoseAt(uint64_t timestampNs
 ) const {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    for (auto it = m_poseBuffer.rbegin(), end = m_poseBuffer.rend(); it != end; ++it) {
-        if (it->targetTimestampNs == timestampNs)
-            return *it;
+    auto index = FindTimestamp(timestampNs);
+    TrackingHistoryFrame frame;
+    if (index && ReadSlot(*index, frame) && frame.targetTimestampNs == timestampNs) {
+        return frame;
     }
 
     Debug("PoseHistory::GetPoseAt: No pose matched.");
     return {};
 }
 
+std::optional<PoseHistory::TrackingHistoryFrame>
+PoseHistory::GetInterpolatedPose(uint64_t timestampNs) const {
+    auto index = FindTimestamp(timestampNs);
+    TrackingHistoryFrame before;
+    if (!index || !ReadSlot(*index, before)) {
+        return {};
+    }
+    if (before.targetTimestampNs == timestampNs) {
+        return before;
+    }
+    TrackingHistoryFrame after;
+    if (*index + 1 >= m_writeIndex.load(std::memory_order_acquire)
+        || !ReadSlot(*index + 1, after)) {
+        return {};
+    }
+
+    float t = (float)(timestampNs - before.targetTimestampNs)
+        / (float)(after.targetTimestampNs - before.targetTimestampNs);
+    TrackingHistoryFrame frame = t < 0.5f ? before : after;
+    frame.targetTimestampNs = timestampNs;
+
+    FfiPose& pose = frame.motion.pose;
+    for (int i = 0; i < 3; i++) {
+        pose.position[i] = before.motion.pose.position[i]
+            + (after.motion.pose.position[i] - before.motion.pose.position[i]) * t;
+        frame.motion.linearVelocity[i] = before.motion.linearVelocity[i]
+            + (after.motion.linearVelocity[i] - before.motion.linearVelocity[i]) * t;
+        frame.motion.angularVelocity[i] = before.motion.angularVelocity[i]
+            + (after.motion.angularVelocity[i] - before.motion.angularVelocity[i]) * t;
+    }
+
+    // Normalized lerp, the samples are a few milliseconds apart
+    const FfiQuat& a = before.motion.pose.orientation;
+    FfiQuat b = after.motion.pose.orientation;
+    if (a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0) {
+        b = { -b.x, -b.y, -b.z, -b.w };
+    }
+    FfiQuat q = { a.x + (b.x - a.x) * t,
+                  a.y + (b.y - a.y) * t,
+                  a.z + (b.z - a.z) * t,
+                  a.w + (b.w - a.w) * t };
+    float norm = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    pose.orientation = { q.x / norm, q.y / norm, q.z / norm, q.w / norm };
+
+    // The stored rotation holds the transform of its own time, before.rotation * inverse(before)
+    // keeps it without taking the transform lock
+    vr::HmdMatrix34_t rotation = vrmath::matMul33(
+        vrmath::matMul33(
+            before.rotationMatrix, vrmath::transposeMul33(pose_to_mat(before.motion.pose))
+        ),
+        pose_to_mat(pose)
+    );
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            frame.rotationMatrix.m[i][j] = rotation.m[i][j];
+        }
+    }
+
+    return frame;
+}
+
+std::optional<PoseHistory::TrackingHistoryFrame> PoseHistory::GetLatestPose() const {
+    uint64_t end = m_writeIndex.load(std::memory_order_acquire);
+    // The writer fills the slot after the newest one, so this can only fail if the tracking thread
+    // wrapped around the whole ring meanwhile
+    TrackingHistoryFrame frame;
+    if (end != 0 && ReadSlot(end - 1, frame)) {
+        return frame;
+    }
+
+    return {};
+}
+
 void PoseHistory::SetTransform(const vr::HmdMatrix34_t& transform) {
-    std::unique_lock<std::mutex> lock(m_mutex);
+    std::unique_lock<std::mutex> lock(m_transformMutex);
     m_transform = transform;
 
     for (int i = 0; i < 3; ++i) {
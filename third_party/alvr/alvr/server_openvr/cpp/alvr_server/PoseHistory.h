@@ -6,10 +6,14 @@
 #include "ALVR-common/packet_types.h"
 #include "openvr_driver_wrap.h"
 
-#include <list>
+#include <array>
+#include <atomic>
 #include <mutex>
 #include <optional>
 
+// Poses are written by the tracking thread only and read by the encoder/compositor threads. The
+// history is a preallocated ring where each slot is guarded by a sequence counter, so readers never
+// block the writer and the writer never allocates.
 class PoseHistory {
 public:
     struct TrackingHistoryFrame {
@@ -18,17 +22,58 @@ public:
         vr::HmdMatrix34_t rotationMatrix;
     };
 
-    void OnPoseUpdated(uint64_t targetTimestampNs, FfiDeviceMotion motion);
+    // Returns the orientation to submit to SteamVR. It is turned by a tag of the sample, a roll
+    // of a few microradians, so that the pose the compositor hands back names the sample even
+    // when the head holds still. The frame is rendered with that roll: at most 28 microradians,
+    // which moves the corner of a 2k eye buffer by less than 0.05 pixels.
+    FfiQuat OnPoseUpdated(uint64_t targetTimestampNs, FfiDeviceMotion motion);
 
     std::optional<TrackingHistoryFrame> GetBestPoseMatch(const vr::HmdMatrix34_t& pose) const;
-    // Return the most recent pose known at the given timestamp
+    // Return the pose received for exactly the given timestamp
     std::optional<TrackingHistoryFrame> GetPoseAt(uint64_t timestampNs) const;
+    // Return the pose at the given timestamp, interpolated between the two poses received around
+    // it. Timestamps outside of the history are not extrapolated.
+    std::optional<TrackingHistoryFrame> GetInterpolatedPose(uint64_t timestampNs) const;
+    // Return the newest pose received from the client
+    std::optional<TrackingHistoryFrame> GetLatestPose() const;
 
     void SetTransform(const vr::HmdMatrix34_t& transform);
 
 private:
-    mutable std::mutex m_mutex;
-    std::list<TrackingHistoryFrame> m_poseBuffer;
+    // The value should match with the client's MAXIMUM_TRACKING_FRAMES in ovr_context.cpp
+    // Must stay a multiple of 4 for the SIMD search.
+    static constexpr size_t CAPACITY = 120 * 3;
+    // Consecutive samples with distinct tags, the compositor nearly always renders one of them
+    static constexpr size_t TAG_COUNT = 8;
+
+    struct Slot {
+        // Odd while the writer is updating the slot
+        std::atomic<uint64_t> sequence { 0 };
+        // Absolute write position of the frame, used to detect a recycled slot
+        uint64_t index = 0;
+        TrackingHistoryFrame frame;
+    };
+
+    // Copy slot `index` (absolute write position). Returns false if it was being overwritten.
+    bool ReadSlot(uint64_t index, TrackingHistoryFrame& out) const;
+    // Absolute index of the newest stored frame at or before `timestampNs`. The target timestamps
+    // grow with the write index, so the index is first guessed from where the timestamp lies
+    // between the oldest and the newest frame, which is exact for a steady tracking rate.
+    std::optional<uint64_t> FindTimestamp(uint64_t timestampNs) const;
+    // Absolute index of the stored frame closest to `target` (row-major 3x3 rotation)
+    std::optional<uint64_t> FindClosestRotation(const float target[9]) const;
+    // Absolute index of the one of the last TAG_COUNT frames that `target` is, if any
+    std::optional<uint64_t> FindTaggedRotation(const float target[9]) const;
+
+    std::array<Slot, CAPACITY> m_slots;
+    // Structure-of-arrays copy of the 3x3 rotations, m_rotations[k][slot] holds entry k (row-major)
+    // of each slot so that the nearest pose search can compare several slots at once.
+    alignas(16) float m_rotations[9][CAPACITY] = {};
+    // Number of frames ever written, the newest frame is at m_writeIndex - 1
+    std::atomic<uint64_t> m_writeIndex { 0 };
+    uint64_t m_lastTimestampNs = 0;
+
+    std::mutex m_transformMutex;
     vr::HmdMatrix34_t m_transform
         = { { { 1.0, 0.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0, 0.0 }, { 0.0, 0.0, 1.0, 0.0 } } };
     bool m_transformIdentity = true;
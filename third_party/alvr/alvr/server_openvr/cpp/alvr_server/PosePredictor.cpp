@@ -0,0 +1,73 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "PosePredictor.h"
+#include "Settings.h"
+#include <cmath>
+
+void PosePredictor::Update(
+    uint64_t targetTimestampNs, const float linearVelocity[3], const float angularVelocity[3]
+) {
+    // The client can resend a target timestamp, or reorder them after a resync
+    if (m_valid && targetTimestampNs == m_lastTimestampNs) {
+        return;
+    }
+    if (!m_valid || targetTimestampNs < m_lastTimestampNs
+        || targetTimestampNs - m_lastTimestampNs > MAX_GAP_NS) {
+        for (int i = 0; i < 3; i++) {
+            m_linearVelocity[i] = m_filteredLinearVelocity[i] = m_windowLinearVelocity[i]
+                = linearVelocity[i];
+            m_angularVelocity[i] = m_filteredAngularVelocity[i] = m_windowAngularVelocity[i]
+                = angularVelocity[i];
+            m_linearAcceleration[i] = 0;
+            m_angularAcceleration[i] = 0;
+        }
+        m_valid = true;
+        m_lastTimestampNs = targetTimestampNs;
+        m_windowTimestampNs = targetTimestampNs;
+        return;
+    }
+
+    double dt = (double)(targetTimestampNs - m_lastTimestampNs) / 1e9;
+    double alpha = 1 - exp(-dt / FILTER_TIME_CONSTANT_S);
+    for (int i = 0; i < 3; i++) {
+        m_linearVelocity[i] = linearVelocity[i];
+        m_angularVelocity[i] = angularVelocity[i];
+        m_filteredLinearVelocity[i] += alpha * (linearVelocity[i] - m_filteredLinearVelocity[i]);
+        m_filteredAngularVelocity[i]
+            += alpha * (angularVelocity[i] - m_filteredAngularVelocity[i]);
+    }
+    m_lastTimestampNs = targetTimestampNs;
+
+    uint64_t windowNs = targetTimestampNs - m_windowTimestampNs;
+    if (windowNs >= MEASURE_WINDOW_NS) {
+        double windowS = (double)windowNs / 1e9;
+        double beta = 1 - exp(-windowS / ACCELERATION_TIME_CONSTANT_S);
+        for (int i = 0; i < 3; i++) {
+            double linear = (linearVelocity[i] - m_windowLinearVelocity[i]) / windowS;
+            double angular = (angularVelocity[i] - m_windowAngularVelocity[i]) / windowS;
+            m_linearAcceleration[i] += beta * (linear - m_linearAcceleration[i]);
+            m_angularAcceleration[i] += beta * (angular - m_angularAcceleration[i]);
+            m_windowLinearVelocity[i] = linearVelocity[i];
+            m_windowAngularVelocity[i] = angularVelocity[i];
+        }
+        m_windowTimestampNs = targetTimestampNs;
+    }
+}
+
+void PosePredictor::Apply(vr::DriverPose_t& pose, float predictionS) const {
+    pose.poseTimeOffset = predictionS;
+
+    uint32_t model = Settings::Instance().Live()->m_posePredictionModel;
+    bool filtered = model == ALVR_POSE_PREDICTION_FILTERED;
+    bool accelerate = model == ALVR_POSE_PREDICTION_CONSTANT_ACCELERATION;
+
+    for (int i = 0; i < 3; i++) {
+        pose.vecVelocity[i] = filtered ? m_filteredLinearVelocity[i] : m_linearVelocity[i];
+        pose.vecAngularVelocity[i] = filtered ? m_filteredAngularVelocity[i] : m_angularVelocity[i];
+        pose.vecAcceleration[i] = accelerate ? m_linearAcceleration[i] : 0;
+        pose.vecAngularAcceleration[i] = accelerate ? m_angularAcceleration[i] : 0;
+    }
+}
+
+void PosePredictor::Reset() { m_valid = false; }
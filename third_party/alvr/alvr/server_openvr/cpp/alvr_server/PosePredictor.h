@@ -0,0 +1,52 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "openvr_driver_wrap.h"
+#include <stdint.h>
+
+// Motion model used by the tracked devices to describe how their pose moves past the pose time
+// offset. SteamVR extrapolates the submitted pose with the velocities and accelerations of the
+// DriverPose_t, the predictor only chooses them from the recent velocities sent by the client.
+//
+// ConstantVelocity submits the client velocities as they are. ConstantAcceleration adds the
+// averaged velocity change of the last samples, which follows the start and end of fast movements
+// better. Filtered smooths the velocities first, for long prediction offsets on high latency links
+// where the noise of raw velocities becomes visible jitter.
+class PosePredictor {
+public:
+    // Feeds the velocities of the pose targeted at targetTimestampNs. Called once per tracking
+    // tick, before Apply.
+    void Update(
+        uint64_t targetTimestampNs, const float linearVelocity[3], const float angularVelocity[3]
+    );
+    // Fills the velocities, accelerations and time offset of `pose` for the configured model
+    void Apply(vr::DriverPose_t& pose, float predictionS) const;
+    // Forgets the history, for when the device stops being tracked
+    void Reset();
+
+private:
+    // Span of the velocity difference giving the acceleration. Shorter spans amplify the noise.
+    static constexpr uint64_t MEASURE_WINDOW_NS = 20'000'000;
+    // The measured accelerations are still noisy and are averaged with this time constant
+    static constexpr double ACCELERATION_TIME_CONSTANT_S = 0.05;
+    // A longer gap between samples means tracking was lost, the history is stale
+    static constexpr uint64_t MAX_GAP_NS = 200'000'000;
+    // Time constant of the Filtered velocity smoothing
+    static constexpr double FILTER_TIME_CONSTANT_S = 0.03;
+
+    bool m_valid = false;
+    uint64_t m_lastTimestampNs = 0;
+    double m_linearVelocity[3] = {};
+    double m_angularVelocity[3] = {};
+    double m_filteredLinearVelocity[3] = {};
+    double m_filteredAngularVelocity[3] = {};
+    double m_linearAcceleration[3] = {};
+    double m_angularAcceleration[3] = {};
+
+    // Start of the current acceleration measurement
+    uint64_t m_windowTimestampNs = 0;
+    double m_windowLinearVelocity[3] = {};
+    double m_windowAngularVelocity[3] = {};
+};
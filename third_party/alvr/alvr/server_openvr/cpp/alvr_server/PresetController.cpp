@@ -0,0 +1,74 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "PresetController.h"
+#include "Logger.h"
+#include "Settings.h"
+#include <algorithm>
+
+PresetController::PresetController(uint32_t pipelineDepth)
+    : m_enabled(Settings::Instance().m_dynamicEncoderPreset)
+    , m_periodNs(1'000'000'000 / std::max(Settings::Instance().m_refreshRate, 1))
+    , m_pipelineDepth(std::max<uint32_t>(pipelineDepth, 1)) { }
+
+int PresetController::OnFrameEncoded(uint64_t encodeNs, uint64_t renderNs, uint64_t nowNs) {
+    if (!m_enabled) {
+        return 0;
+    }
+    if (m_encodeNs == 0) {
+        m_encodeNs = (double)encodeNs;
+        m_renderNs = (double)renderNs;
+    } else {
+        m_encodeNs += AVERAGE_WEIGHT * ((double)encodeNs - m_encodeNs);
+        m_renderNs += AVERAGE_WEIGHT * ((double)renderNs - m_renderNs);
+    }
+    if (nowNs - m_stepNs < MIN_PRESET_DURATION_NS) {
+        return 0;
+    }
+
+    // The render time is taken once per frame, however many frames are in flight. A quarter of the
+    // period is always left to the encoder, a render that takes more already misses frames.
+    double budgetNs = std::max(
+        (double)m_periodNs * m_pipelineDepth - m_renderNs, (double)m_periodNs / 4
+    );
+    double ratio = m_encodeNs / budgetNs;
+
+    if (ratio > OVERLOAD_RATIO && !m_atFastest) {
+        m_headroomStartNs = 0;
+        if (m_overloadStartNs == 0) {
+            m_overloadStartNs = nowNs;
+        }
+        return nowNs - m_overloadStartNs >= OVERLOAD_NS ? -1 : 0;
+    }
+    m_overloadStartNs = 0;
+    if (ratio < HEADROOM_RATIO && !m_atSlowest) {
+        if (m_headroomStartNs == 0) {
+            m_headroomStartNs = nowNs;
+        }
+        return nowNs - m_headroomStartNs >= m_headroomNs ? 1 : 0;
+    }
+    m_headroomStartNs = 0;
+    return 0;
+}
+
+void PresetController::OnStepApplied(int step, bool applied, uint64_t nowNs) {
+    if (step == 0) {
+        return;
+    }
+    m_overloadStartNs = 0;
+    m_headroomStartNs = 0;
+    if (!applied) {
+        (step > 0 ? m_atSlowest : m_atFastest) = true;
+        return;
+    }
+
+    if (step < 0 && m_lastStep > 0 && nowNs - m_stepNs < REVERSAL_NS) {
+        m_headroomNs = std::min(m_headroomNs * 2, MAX_HEADROOM_NS);
+    }
+    (step > 0 ? m_atFastest : m_atSlowest) = false;
+    m_lastStep = step;
+    m_stepNs = nowNs;
+    m_encodeNs = 0;
+    m_renderNs = 0;
+    Info("Encoder preset %s\n", step > 0 ? "slower" : "faster");
+}
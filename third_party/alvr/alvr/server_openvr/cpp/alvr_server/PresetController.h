@@ -0,0 +1,57 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Steps the encoder preset at runtime by the headroom of the encoder in the frame budget, the
+// refresh period minus the render time. An encoder that keeps running out of the budget gets a
+// faster preset, one that has plenty to spare for a while gets a slower one of better quality, as
+// far as the backend has presets in that direction. The configured preset is the starting point.
+//
+// Times are in the FrameTraceNow() clock. Off unless dynamic_encoder_preset is set.
+class PresetController {
+public:
+    // The encode times are measured over `pipelineDepth` frames in flight, which share the budget
+    explicit PresetController(uint32_t pipelineDepth = 1);
+
+    bool IsEnabled() const { return m_enabled; }
+
+    // Submission to bitstream time of a frame, and its render time or 0 if unknown. Returns the
+    // step to apply to the preset before the next frame: 1 for a slower preset, -1 for a faster
+    // one, 0 to keep it.
+    int OnFrameEncoded(uint64_t encodeNs, uint64_t renderNs, uint64_t nowNs);
+    // Whether the encoder took the step returned by OnFrameEncoded. A step it couldn't take is not
+    // asked for again until the preset moved the other way.
+    void OnStepApplied(int step, bool applied, uint64_t nowNs);
+
+private:
+    // Weight of a new sample in the encode and render time averages
+    static constexpr double AVERAGE_WEIGHT = 0.1;
+    // A faster preset above this ratio of the encode time to the budget, held for OVERLOAD_NS
+    static constexpr double OVERLOAD_RATIO = 0.9;
+    static constexpr uint64_t OVERLOAD_NS = 250'000'000;
+    // A slower preset below this ratio, held for m_headroomNs
+    static constexpr double HEADROOM_RATIO = 0.6;
+    static constexpr uint64_t MIN_HEADROOM_NS = 5'000'000'000;
+    static constexpr uint64_t MAX_HEADROOM_NS = 80'000'000'000;
+    // No step for this long after one, the averages restart with the new preset
+    static constexpr uint64_t MIN_PRESET_DURATION_NS = 2'000'000'000;
+    // A slower preset given back within this time was too slow, the next one waits twice as long
+    static constexpr uint64_t REVERSAL_NS = 10'000'000'000;
+
+    bool m_enabled;
+    uint64_t m_periodNs;
+    uint32_t m_pipelineDepth;
+    double m_encodeNs = 0;
+    double m_renderNs = 0;
+    uint64_t m_overloadStartNs = 0;
+    uint64_t m_headroomStartNs = 0;
+    uint64_t m_headroomNs = MIN_HEADROOM_NS;
+    uint64_t m_stepNs = 0;
+    int m_lastStep = 0;
+    // The backend has no preset further in this direction
+    bool m_atFastest = false;
+    bool m_atSlowest = false;
+};
@@ -0,0 +1,94 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "RenderTargetScale.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <stdint.h>
+
+namespace {
+// Frames are counted over windows of this length, the scale changes at most once per window
+const uint64_t WINDOW_US = 2'000'000;
+// Fewer frames in a window tell nothing about the game, it is paused or loading
+const uint32_t MIN_WINDOW_FRAMES = 60;
+// Share of repeated frames over which the game renders at a lower size, and under which it gets
+// its pixels back after RAISE_WINDOWS windows in a row
+const float MISSED_FRAMES_HIGH = 0.1f;
+const float MISSED_FRAMES_LOW = 0.02f;
+const uint32_t RAISE_WINDOWS = 3;
+const float SCALE_STEP = 0.1f;
+const float MIN_SCALE = 0.6f;
+// The game renders a little more than the encoder takes, the compositor resamples the frame
+const float ENCODE_MARGIN = 1.1f;
+
+std::mutex g_mutex;
+float g_encodeScale = 1;
+float g_frameScale = 1;
+uint32_t g_frames = 0;
+uint32_t g_repeated = 0;
+uint32_t g_goodWindows = 0;
+uint64_t g_windowUs = 0;
+float g_scale = 1;
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+// Share of the rendered pixels the encoder consumes along each dimension. Relative to the
+// configured sizes, a recommended size above the render size is the user's choice of
+// supersampling.
+float encodeLimit() { return g_encodeScale * ENCODE_MARGIN; }
+}
+
+void ReportEncodeScale(float scale) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_encodeScale = scale;
+}
+
+void ReportGameFrame(bool repeated) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_frames++;
+    if (repeated) {
+        g_repeated++;
+    }
+}
+
+bool UpdateRenderTargetScale(float& scale) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    uint64_t now = nowUs();
+    if (g_windowUs == 0) {
+        g_windowUs = now;
+    }
+    if (now - g_windowUs < WINDOW_US) {
+        return false;
+    }
+
+    if (g_frames >= MIN_WINDOW_FRAMES) {
+        float missed = (float)g_repeated / g_frames;
+        if (missed > MISSED_FRAMES_HIGH) {
+            g_frameScale = std::max(g_frameScale - SCALE_STEP, MIN_SCALE);
+            g_goodWindows = 0;
+        } else if (missed < MISSED_FRAMES_LOW && ++g_goodWindows >= RAISE_WINDOWS) {
+            g_frameScale = std::min(g_frameScale + SCALE_STEP, 1.f);
+            g_goodWindows = 0;
+        }
+    }
+    g_frames = 0;
+    g_repeated = 0;
+    g_windowUs = now;
+
+    // Steps of 5%, so that a ladder level and the frame scale land on the same sizes
+    float target = std::clamp(std::min(encodeLimit(), g_frameScale), MIN_SCALE, 1.f);
+    target = std::round(target * 20) / 20;
+    if (target == g_scale) {
+        return false;
+    }
+    g_scale = target;
+    scale = target;
+    return true;
+}
@@ -0,0 +1,17 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+// Scale of the recommended render target size, see adaptive_render_resolution. The games are asked
+// for fewer pixels when the resolution ladder encodes fewer than they render, or when they miss
+// frames. Thread safe: the encoders and the compositor report, Hmd applies the scale.
+
+// Encoded width per full encode width, of the resolution ladder. 1 at full resolution.
+void ReportEncodeScale(float scale);
+// Called for every frame from the compositor. repeated if it brings no new game frame, the game
+// missed the refresh.
+void ReportGameFrame(bool repeated);
+// Sets the scale the recommended size should have and returns true when it changed. At most one
+// change every few seconds, each one costs the games a swapchain reallocation.
+bool UpdateRenderTargetScale(float& scale);
@@ -0,0 +1,89 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "ResolutionLadder.h"
+#include "DriverMetrics.h"
+#include "Logger.h"
+#include "RenderTargetScale.h"
+#include "Settings.h"
+#include <chrono>
+
+namespace {
+const float LEVEL_SCALES[ResolutionLadder::LEVEL_COUNT] = { 1.0f, 0.75f, 0.5f };
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+}
+
+ResolutionLadder::ResolutionLadder(uint32_t width, uint32_t height)
+    : m_width(width)
+    , m_height(height)
+    , m_thresholdBps(Settings::Instance().m_dynamicResolutionBitrateMbps * 1'000'000ull) {
+    m_enabled = m_thresholdBps > 0;
+    // A new encoder starts at full resolution
+    ReportEncodeScale(1);
+}
+
+uint64_t ResolutionLadder::threshold(int level) const { return m_thresholdBps >> level; }
+
+bool ResolutionLadder::Update(const FfiDynamicEncoderParams& params) {
+    if (params.updated) {
+        MetricsSetGauge(DRIVER_GAUGE_TARGET_BITRATE_BPS, (double)params.bitrate_bps);
+    }
+    if (!m_enabled) {
+        return false;
+    }
+    if (params.updated) {
+        m_bitrateBps = params.bitrate_bps;
+    }
+    if (m_bitrateBps == 0) {
+        return false;
+    }
+
+    uint64_t now = nowUs();
+    if (now - m_levelTimeUs < MIN_LEVEL_DURATION_US) {
+        return false;
+    }
+
+    // Going back up needs 25% more than the threshold, so that a bitrate hovering around it
+    // doesn't switch back and forth
+    int level = m_level;
+    if (level + 1 < LEVEL_COUNT && m_bitrateBps < threshold(level)) {
+        level++;
+    } else if (level > 0 && m_bitrateBps > threshold(level - 1) + threshold(level - 1) / 4) {
+        level--;
+    }
+    if (level == m_level) {
+        return false;
+    }
+
+    m_level = level;
+    m_levelTimeUs = now;
+    ReportEncodeScale(LEVEL_SCALES[level]);
+    Info(
+        "Encoding at %ux%u for %llu kbps\n",
+        GetWidth(),
+        GetHeight(),
+        (unsigned long long)(m_bitrateBps / 1000)
+    );
+    return true;
+}
+
+// Each eye half stays a multiple of 16 pixels wide
+uint32_t ResolutionLadder::GetWidth(int level) const {
+    if (level == 0) {
+        return m_width;
+    }
+    return (uint32_t)(m_width * LEVEL_SCALES[level]) / 32 * 32;
+}
+
+uint32_t ResolutionLadder::GetHeight(int level) const {
+    if (level == 0) {
+        return m_height;
+    }
+    return (uint32_t)(m_height * LEVEL_SCALES[level]) / 16 * 16;
+}
@@ -0,0 +1,47 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "bindings.h"
+#include <stdint.h>
+
+// Resolution ladder for low bitrates. Every encode of the ladder is a downscale of the renderer
+// output into the top-left corner of the encoder input, the encoder is reconfigured to the new
+// size and restarts with an IDR instead of being rebuilt.
+class ResolutionLadder {
+public:
+    static const int LEVEL_COUNT = 3;
+
+    // width x height is the full resolution, the renderer output
+    ResolutionLadder(uint32_t width, uint32_t height);
+
+    // Disabled by a 0 dynamic_resolution_bitrate_mbps setting, or by the backend
+    bool IsEnabled() const { return m_enabled; }
+    void Disable() { m_enabled = false; }
+
+    // Takes the encoder params of the frame. Returns true if the encode size changed, in which
+    // case the encoder must be reconfigured before the frame is encoded.
+    bool Update(const FfiDynamicEncoderParams& params);
+
+    int GetLevel() const { return m_level; }
+    uint32_t GetWidth() const { return GetWidth(m_level); }
+    uint32_t GetHeight() const { return GetHeight(m_level); }
+    uint32_t GetWidth(int level) const;
+    uint32_t GetHeight(int level) const;
+
+private:
+    // Bitrate under which level + 1 is used
+    uint64_t threshold(int level) const;
+
+    // Switches cost an IDR, so the ladder holds a level for at least this long
+    static const uint64_t MIN_LEVEL_DURATION_US = 2'000'000;
+
+    uint32_t m_width;
+    uint32_t m_height;
+    bool m_enabled;
+    uint64_t m_thresholdBps;
+    uint64_t m_bitrateBps = 0;
+    int m_level = 0;
+    uint64_t m_levelTimeUs = 0;
+};
@@ -2,129 +2,325 @@
 // Original copyright preserved
 
 #include "Settings.h"
+#include "Instance.h"
 #include "Logger.h"
 #include "bindings.h"
+#include "include/config_reader.h"
+#include "include/drm_lease_config.h"
+#include <algorithm>
+#include <array>
+#include <bitset>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <streambuf>
 #include <string>
-
-#define PICOJSON_USE_INT64
-#include "include/picojson.h"
+#include <string_view>
 
 using namespace std;
 
 extern uint64_t g_DriverTestMode;
 
+namespace {
+
+using config_reader::Value;
+
+// Field of openvr_config read into a Settings member
+struct SettingsField {
+    std::string_view name;
+    bool (*assign)(Settings& settings, const Value& value);
+    // Applied again by Settings::Reload(). The other fields are only read once when the driver
+    // starts, changing them needs a SteamVR restart.
+    bool live;
+};
+
+template <auto Member> bool Assign(Settings& settings, const Value& value) {
+    return value.Get(settings.*Member);
+}
+
+// The config stores the size of one eye, the settings the size of both side by side
+template <auto Member> bool AssignDoubled(Settings& settings, const Value& value) {
+    if (!value.Get(settings.*Member)) {
+        return false;
+    }
+    settings.*Member *= 2;
+    return true;
+}
+
+// Live field, published by Settings::Load() and Settings::Reload()
+template <auto Member> bool AssignLive(Settings& settings, const Value& value) {
+    return value.Get(settings.m_liveFields.*Member);
+}
+
+// Boolean config value stored in an int member
+template <auto Member> bool AssignFlag(Settings& settings, const Value& value) {
+    bool flag;
+    if (!value.Get(flag)) {
+        return false;
+    }
+    settings.*Member = flag;
+    return true;
+}
+
+// Sorted by name for the lookup
+constexpr SettingsField SETTINGS_FIELDS[] = {
+    { "adapter_index", Assign<&Settings::m_nAdapterIndex>, false },
+    { "adaptive_render_resolution", Assign<&Settings::m_adaptiveRenderResolution>, false },
+    { "amd_bitrate_corruption_fix", Assign<&Settings::m_amdBitrateCorruptionFix>, false },
+    { "amf_frame_rate_conversion", Assign<&Settings::m_amfFrameRateConversion>, false },
+    { "amf_hq_scaler", Assign<&Settings::m_amfHqScaler>, false },
+    { "amf_preproc_sigma", Assign<&Settings::m_amfPreProcSigma>, false },
+    { "amf_preproc_tor", Assign<&Settings::m_amfPreProcTor>, false },
+    { "bitrate_calibration", Assign<&Settings::m_bitrateCalibration>, false },
+    { "body_tracking_has_legs", AssignFlag<&Settings::m_bodyTrackingHasLegs>, false },
+    { "body_tracking_vive_enabled", AssignFlag<&Settings::m_enableBodyTrackingFakeVive>, false },
+    { "brightness", Assign<&Settings::m_brightness>, false },
+    { "capture_frame_dir", Assign<&Settings::m_captureFrameDir>, false },
+    { "clamp_hdr_extended_range", AssignLive<&LiveSettings::m_clampHdrExtendedRange>, true },
+    { "codec", Assign<&Settings::m_codec>, false },
+    { "contrast", Assign<&Settings::m_contrast>, false },
+    { "controller_is_tracker", AssignFlag<&Settings::m_controllerIsTracker>, false },
+    { "controllers_enabled", Assign<&Settings::m_enableControllers>, false },
+    { "d3d12_high_priority_queue", Assign<&Settings::m_d3d12HighPriorityQueue>, false },
+    { "dynamic_encoder_preset", Assign<&Settings::m_dynamicEncoderPreset>, false },
+    { "dynamic_resolution_bitrate_mbps", Assign<&Settings::m_dynamicResolutionBitrateMbps>, false },
+    { "enable_amf_hmqb", Assign<&Settings::m_enableAmfHmqb>, false },
+    { "enable_amf_pre_analysis", Assign<&Settings::m_enableAmfPreAnalysis>, false },
+    { "enable_color_correction", Assign<&Settings::m_enableColorCorrection>, false },
+    { "enable_foveated_encoding", Assign<&Settings::m_enableFoveatedEncoding>, false },
+    { "enable_hdr", Assign<&Settings::m_enableHdr>, false },
+    { "enable_intra_refresh", Assign<&Settings::m_nvencEnableIntraRefresh>, false },
+    { "enable_vbaq", Assign<&Settings::m_enableVbaq>, false },
+    { "enable_vive_tracker_proxy", Assign<&Settings::m_enableViveTrackerProxy>, false },
+    { "encode_adapter_index", Assign<&Settings::m_encodeAdapterIndex>, false },
+    { "encoder_av1_tile_columns", Assign<&Settings::m_encoderAv1TileColumns>, false },
+    { "encoder_av1_tile_rows", Assign<&Settings::m_encoderAv1TileRows>, false },
+    { "encoder_chroma_444", Assign<&Settings::m_encoderChroma444>, false },
+    { "encoder_decode_feedback", Assign<&Settings::m_encoderDecodeFeedback>, false },
+    { "encoder_disposable_frames", Assign<&Settings::m_encoderDisposableFrames>, false },
+    { "encoder_max_slice_bytes", Assign<&Settings::m_encoderMaxSliceBytes>, false },
+    { "encoder_quality_preset", Assign<&Settings::m_encoderQualityPreset>, false },
+    { "encoder_session_limit", Assign<&Settings::m_encoderSessionLimit>, false },
+    { "encoder_slices_per_frame", Assign<&Settings::m_encoderSlicesPerFrame>, false },
+    { "encoder_temporal_layers", Assign<&Settings::m_encoderTemporalLayers>, false },
+    { "encoding_gamma", Assign<&Settings::m_encodingGamma>, false },
+    { "entropy_coding", Assign<&Settings::m_entropyCoding>, false },
+    { "eye_resolution_height", Assign<&Settings::m_renderHeight>, false },
+    { "eye_resolution_width", AssignDoubled<&Settings::m_renderWidth>, false },
+    { "filler_data", Assign<&Settings::m_fillerData>, false },
+    { "flight_recorder_downscale", Assign<&Settings::m_flightRecorderDownscale>, false },
+    { "flight_recorder_dump_on_glitch", Assign<&Settings::m_flightRecorderDumpOnGlitch>, false },
+    { "flight_recorder_duration_s", Assign<&Settings::m_flightRecorderDurationS>, false },
+    { "force_hdr_srgb_correction", AssignLive<&LiveSettings::m_forceHdrSrgbCorrection>, true },
+    { "force_sw_encoding", Assign<&Settings::m_force_sw_encoding>, false },
+    { "foveation_center_shift_x", Assign<&Settings::m_foveationCenterShiftX>, false },
+    { "foveation_center_shift_y", Assign<&Settings::m_foveationCenterShiftY>, false },
+    { "foveation_center_size_x", Assign<&Settings::m_foveationCenterSizeX>, false },
+    { "foveation_center_size_y", Assign<&Settings::m_foveationCenterSizeY>, false },
+    { "foveation_edge_ratio_x", Assign<&Settings::m_foveationEdgeRatioX>, false },
+    { "foveation_edge_ratio_y", Assign<&Settings::m_foveationEdgeRatioY>, false },
+    { "gamma", Assign<&Settings::m_gamma>, false },
+    { "gaze_roi_qp_delta", Assign<&Settings::m_gazeRoiQpDelta>, false },
+    { "gaze_roi_radius", AssignLive<&LiveSettings::m_gazeRoiRadius>, true },
+    { "gop_length", Assign<&Settings::m_nvencGopLength>, false },
+    { "h264_profile", Assign<&Settings::m_h264Profile>, false },
+    { "half_rate_fallback", Assign<&Settings::m_halfRateFallback>, false },
+    { "hdr_nvenc_rgb_input", Assign<&Settings::m_hdrNvencRgbInput>, false },
+    { "intra_refresh_count", Assign<&Settings::m_nvencIntraRefreshCount>, false },
+    { "intra_refresh_frames", Assign<&Settings::m_intraRefreshFrames>, false },
+    { "intra_refresh_period", Assign<&Settings::m_nvencIntraRefreshPeriod>, false },
+    { "isolated_cores", Assign<&Settings::m_isolatedCores>, false },
+    { "jit_composition", Assign<&Settings::m_jitComposition>, false },
+    { "late_latch_reprojection", AssignLive<&LiveSettings::m_lateLatchReprojection>, true },
+    { "linux_async_compute", Assign<&Settings::m_enableLinuxVulkanAsyncCompute>, false },
+    { "linux_async_reprojection", Assign<&Settings::m_enableLinuxAsyncReprojection>, false },
+    { "linux_encode_device", Assign<&Settings::m_linuxEncodeDevice>, false },
+    { "linux_encode_pipeline_depth", Assign<&Settings::m_linuxEncodePipelineDepth>, false },
+    { "linux_idle_mode", Assign<&Settings::m_linuxIdleMode>, false },
+    { "linux_local_display_connector", Assign<&Settings::m_linuxLocalDisplayConnector>, false },
+    { "linux_local_display_device", Assign<&Settings::m_linuxLocalDisplayDevice>, false },
+    { "linux_quality_metrics_interval_ms",
+      Assign<&Settings::m_linuxQualityMetricsIntervalMs>,
+      false },
+    { "linux_vulkan_video_encode", Assign<&Settings::m_linuxVulkanVideoEncode>, false },
+    { "long_term_reference_recovery", Assign<&Settings::m_longTermReferenceRecovery>, false },
+    { "max_num_ref_frames", Assign<&Settings::m_nvencMaxNumRefFrames>, false },
+    { "minimum_idr_interval_ms", AssignLive<&LiveSettings::m_minimumIdrIntervalMs>, true },
+    { "nvenc_adaptive_quantization_mode",
+      Assign<&Settings::m_nvencAdaptiveQuantizationMode>,
+      false },
+    { "nvenc_async_depth", Assign<&Settings::m_nvencAsyncDepth>, false },
+    { "nvenc_enable_weighted_prediction",
+      Assign<&Settings::m_nvencEnableWeightedPrediction>,
+      false },
+    { "nvenc_low_delay_key_frame_scale", Assign<&Settings::m_nvencLowDelayKeyFrameScale>, false },
+    { "nvenc_multi_pass", Assign<&Settings::m_nvencMultiPass>, false },
+    { "nvenc_quality_preset", Assign<&Settings::m_nvencQualityPreset>, false },
+    { "nvenc_rate_control_mode", Assign<&Settings::m_nvencRateControlMode>, false },
+    { "nvenc_refresh_rate", Assign<&Settings::m_nvencRefreshRate>, false },
+    { "nvenc_split_encode_mode", Assign<&Settings::m_nvencSplitEncodeMode>, false },
+    { "nvenc_stereo_interleave", Assign<&Settings::m_nvencStereoInterleave>, false },
+    { "nvenc_tuning_preset", Assign<&Settings::m_nvencTuningPreset>, false },
+    { "p_frame_strategy", Assign<&Settings::m_nvencPFrameStrategy>, false },
+    { "photon_marker", Assign<&Settings::m_photonMarker>, false },
+    { "pose_prediction_model", AssignLive<&LiveSettings::m_posePredictionModel>, true },
+    { "raise_gpu_priority", Assign<&Settings::m_raiseGpuPriority>, false },
+    { "rate_control_mode", Assign<&Settings::m_rateControlMode>, false },
+    { "rc_average_bitrate", Assign<&Settings::m_nvencRcAverageBitrate>, false },
+    { "rc_buffer_size", Assign<&Settings::m_nvencRcBufferSize>, false },
+    { "rc_initial_delay", Assign<&Settings::m_nvencRcInitialDelay>, false },
+    { "rc_max_bitrate", Assign<&Settings::m_nvencRcMaxBitrate>, false },
+    { "realtime_threads", Assign<&Settings::m_realtimeThreads>, false },
+    { "refresh_rate", Assign<&Settings::m_refreshRate>, false },
+    { "saturation", Assign<&Settings::m_saturation>, false },
+    { "sharpening", Assign<&Settings::m_sharpening>, false },
+    { "sw_thread_count", Assign<&Settings::m_swThreadCount>, false },
+    { "target_eye_resolution_height", Assign<&Settings::m_recommendedTargetHeight>, false },
+    { "target_eye_resolution_width", AssignDoubled<&Settings::m_recommendedTargetWidth>, false },
+    { "tracking_ref_only", Assign<&Settings::m_TrackingRefOnly>, false },
+    { "use_10bit_encoder", Assign<&Settings::m_use10bitEncoder>, false },
+    { "use_amf_preproc", Assign<&Settings::m_useAmfPreproc>, false },
+    { "use_separate_hand_trackers", Assign<&Settings::m_useSeparateHandTrackers>, false },
+    { "vpl_async_depth", Assign<&Settings::m_vplAsyncDepth>, false },
+    { "vpl_hyper_encode", Assign<&Settings::m_vplHyperEncode>, false },
+    { "vsync_latency_compensation", Assign<&Settings::m_vsyncLatencyCompensation>, false },
+};
+
+constexpr bool FieldsSorted() {
+    for (size_t i = 1; i < std::size(SETTINGS_FIELDS); i++) {
+        if (!(SETTINGS_FIELDS[i - 1].name < SETTINGS_FIELDS[i].name)) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(FieldsSorted(), "SETTINGS_FIELDS must be sorted by name");
+
+const SettingsField* FindField(std::string_view name) {
+    auto end = std::end(SETTINGS_FIELDS);
+    auto field = std::lower_bound(
+        std::begin(SETTINGS_FIELDS),
+        end,
+        name,
+        [](const SettingsField& field, std::string_view name) { return field.name < name; }
+    );
+    return field != end && field->name == name ? field : nullptr;
+}
+
+#ifdef __linux__
+// Precomputes the settings of the compositor shim, see drm_lease_config.h
+void WriteDrmLeaseConfig(const Settings& settings) {
+    drm_lease_config::Config config = {};
+    config.magic = drm_lease_config::MAGIC;
+    config.version = drm_lease_config::VERSION;
+    config.size = sizeof(config);
+    config.modeWidth = settings.m_renderWidth;
+    config.modeHeight = settings.m_renderHeight;
+    config.refreshRate = std::max(settings.m_refreshRate, 0);
+
+    // Swapped in with a rename so a compositor starting meanwhile never maps half a file
+    auto path = std::filesystem::path(g_sessionPath).replace_filename(drm_lease_config::FILE_NAME);
+    auto tmpPath = path;
+    tmpPath += InstanceSuffix() + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&config), sizeof(config));
+        if (!file) {
+            Warn("Failed to write %s\n", tmpPath.c_str());
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tmpPath, path, error);
+    if (error) {
+        Warn("Failed to replace %s: %s\n", path.c_str(), error.message().c_str());
+    }
+}
+#endif
+
+} // namespace
+
 Settings Settings::m_Instance;
 
 Settings::Settings()
-    : m_loaded(false) { }
+    : m_loaded(false)
+    , m_live(std::make_shared<const LiveSettings>()) { }
 
 Settings::~Settings() { }
 
 void Settings::Load() {
-    try {
-        auto sessionFile = std::ifstream(g_sessionPath);
+    if (!Read(false)) {
+        return;
+    }
+    std::atomic_store(&m_live, std::make_shared<const LiveSettings>(m_liveFields));
 
-        auto json = std::string(
-            std::istreambuf_iterator<char>(sessionFile), std::istreambuf_iterator<char>()
-        );
+    Info("Render Target: %d %d\n", m_renderWidth, m_renderHeight);
+    Info("Refresh Rate: %d\n", m_refreshRate);
+#ifdef __linux__
+    WriteDrmLeaseConfig(*this);
+#endif
+    m_loaded = true;
+}
 
-        picojson::value v;
-        std::string err = picojson::parse(v, json);
-        if (!err.empty()) {
-            Error("Error on parsing session config (%s): %hs\n", g_sessionPath, err.c_str());
+void Settings::Reload() {
+    if (!m_loaded) {
+        return;
+    }
+    // The other threads keep reading this instance, only the published snapshot changes
+    Settings next(*this);
+    if (!next.Read(true)) {
+        return;
+    }
+    std::atomic_store(&m_live, std::make_shared<const LiveSettings>(next.m_liveFields));
+    Info("Reloaded the live settings\n");
+}
+
+bool Settings::Read(bool liveOnly) {
+    auto sessionFile = std::ifstream(g_sessionPath, std::ios::binary);
+    auto json = std::string(
+        std::istreambuf_iterator<char>(sessionFile), std::istreambuf_iterator<char>()
+    );
+
+    std::bitset<std::size(SETTINGS_FIELDS)> found;
+    const SettingsField* badField = nullptr;
+    config_reader::Reader reader(json);
+    auto visit = [&](std::string_view key, const Value& value) {
+        // Fields only used by the Rust side have no entry
+        const SettingsField* field = FindField(key);
+        if (!field) {
             return;
         }
+        found.set(field - SETTINGS_FIELDS);
+        if ((!liveOnly || field->live) && !field->assign(*this, value) && !badField) {
+            badField = field;
+        }
+    };
+    bool parsed = reader.ForEachMember("openvr_config", visit);
 
-        auto config = v.get("openvr_config");
-
-        m_refreshRate = (int)config.get("refresh_rate").get<int64_t>();
-        m_renderWidth = config.get("eye_resolution_width").get<int64_t>() * 2;
-        m_renderHeight = config.get("eye_resolution_height").get<int64_t>();
-        m_recommendedTargetWidth = config.get("target_eye_resolution_width").get<int64_t>() * 2;
-        m_recommendedTargetHeight = config.get("target_eye_resolution_height").get<int64_t>();
-        m_nAdapterIndex = (int32_t)config.get("adapter_index").get<int64_t>();
-        m_captureFrameDir = config.get("capture_frame_dir").get<std::string>();
-
-        m_enableFoveatedEncoding = config.get("enable_foveated_encoding").get<bool>();
-        m_foveationCenterSizeX = (float)config.get("foveation_center_size_x").get<double>();
-        m_foveationCenterSizeY = (float)config.get("foveation_center_size_y").get<double>();
-        m_foveationCenterShiftX = (float)config.get("foveation_center_shift_x").get<double>();
-        m_foveationCenterShiftY = (float)config.get("foveation_center_shift_y").get<double>();
-        m_foveationEdgeRatioX = (float)config.get("foveation_edge_ratio_x").get<double>();
-        m_foveationEdgeRatioY = (float)config.get("foveation_edge_ratio_y").get<double>();
-
-        m_enableColorCorrection = config.get("enable_color_correction").get<bool>();
-        m_brightness = (float)config.get("brightness").get<double>();
-        m_contrast = (float)config.get("contrast").get<double>();
-        m_saturation = (float)config.get("saturation").get<double>();
-        m_gamma = (float)config.get("gamma").get<double>();
-        m_sharpening = (float)config.get("sharpening").get<double>();
-
-        m_codec = (int32_t)config.get("codec").get<int64_t>();
-        m_h264Profile = (int32_t)config.get("h264_profile").get<int64_t>();
-        m_rateControlMode = (uint32_t)config.get("rate_control_mode").get<int64_t>();
-        m_fillerData = config.get("filler_data").get<bool>();
-        m_entropyCoding = (uint32_t)config.get("entropy_coding").get<int64_t>();
-        m_use10bitEncoder = config.get("use_10bit_encoder").get<bool>();
-        m_encodingGamma = config.get("encoding_gamma").get<double>();
-        m_enableHdr = config.get("enable_hdr").get<bool>();
-        m_forceHdrSrgbCorrection = config.get("force_hdr_srgb_correction").get<bool>();
-        m_clampHdrExtendedRange = config.get("clamp_hdr_extended_range").get<bool>();
-        m_enableAmfPreAnalysis = config.get("enable_amf_pre_analysis").get<bool>();
-        m_enableVbaq = config.get("enable_vbaq").get<bool>();
-        m_enableAmfHmqb = config.get("enable_amf_hmqb").get<bool>();
-        m_useAmfPreproc = config.get("use_amf_preproc").get<bool>();
-        m_amfPreProcSigma = (uint32_t)config.get("amf_preproc_sigma").get<int64_t>();
-        m_amfPreProcTor = (uint32_t)config.get("amf_preproc_tor").get<int64_t>();
-        m_encoderQualityPreset = (uint32_t)config.get("encoder_quality_preset").get<int64_t>();
-        m_amdBitrateCorruptionFix = (bool)config.get("amd_bitrate_corruption_fix").get<bool>();
-        m_nvencQualityPreset = (uint32_t)config.get("nvenc_quality_preset").get<int64_t>();
-        m_force_sw_encoding = config.get("force_sw_encoding").get<bool>();
-        m_swThreadCount = (int32_t)config.get("sw_thread_count").get<int64_t>();
-
-        m_nvencTuningPreset = (uint32_t)config.get("nvenc_tuning_preset").get<int64_t>();
-        m_nvencMultiPass = (uint32_t)config.get("nvenc_multi_pass").get<int64_t>();
-        m_nvencAdaptiveQuantizationMode
-            = (uint32_t)config.get("nvenc_adaptive_quantization_mode").get<int64_t>();
-        m_nvencLowDelayKeyFrameScale = config.get("nvenc_low_delay_key_frame_scale").get<int64_t>();
-        m_nvencRefreshRate = config.get("nvenc_refresh_rate").get<int64_t>();
-        m_nvencEnableIntraRefresh = config.get("enable_intra_refresh").get<bool>();
-        m_nvencIntraRefreshPeriod = config.get("intra_refresh_period").get<int64_t>();
-        m_nvencIntraRefreshCount = config.get("intra_refresh_count").get<int64_t>();
-        m_nvencMaxNumRefFrames = config.get("max_num_ref_frames").get<int64_t>();
-        m_nvencGopLength = config.get("gop_length").get<int64_t>();
-        m_nvencPFrameStrategy = config.get("p_frame_strategy").get<int64_t>();
-        m_nvencRateControlMode = config.get("nvenc_rate_control_mode").get<int64_t>();
-        m_nvencRcBufferSize = config.get("rc_buffer_size").get<int64_t>();
-        m_nvencRcInitialDelay = config.get("rc_initial_delay").get<int64_t>();
-        m_nvencRcMaxBitrate = config.get("rc_max_bitrate").get<int64_t>();
-        m_nvencRcAverageBitrate = config.get("rc_average_bitrate").get<int64_t>();
-        m_nvencEnableWeightedPrediction
-            = config.get("nvenc_enable_weighted_prediction").get<bool>();
-
-        m_minimumIdrIntervalMs = config.get("minimum_idr_interval_ms").get<int64_t>();
-
-        m_enableViveTrackerProxy = config.get("enable_vive_tracker_proxy").get<bool>();
-        m_TrackingRefOnly = config.get("tracking_ref_only").get<bool>();
-        m_enableLinuxVulkanAsyncCompute = config.get("linux_async_compute").get<bool>();
-        m_enableLinuxAsyncReprojection = config.get("linux_async_reprojection").get<bool>();
-
-        m_enableControllers = config.get("controllers_enabled").get<bool>();
-        m_controllerIsTracker = config.get("controller_is_tracker").get<bool>();
-
-        m_enableBodyTrackingFakeVive = config.get("body_tracking_vive_enabled").get<bool>();
-        m_bodyTrackingHasLegs = config.get("body_tracking_has_legs").get<bool>();
-
-        m_useSeparateHandTrackers = config.get("use_separate_hand_trackers").get<bool>();
-
-        Info("Render Target: %d %d\n", m_renderWidth, m_renderHeight);
-        Info("Refresh Rate: %d\n", m_refreshRate);
-        m_loaded = true;
-    } catch (std::exception& e) {
-        Error("Exception on parsing session config (%s): %hs\n", g_sessionPath, e.what());
+    if (!parsed) {
+        Error(
+            "Error on parsing session config (%s): %hs at offset %zu\n",
+            g_sessionPath,
+            reader.Error(),
+            reader.ErrorOffset()
+        );
+        return false;
+    }
+    if (badField) {
+        Error(
+            "Invalid value of %hs in session config (%s)\n", badField->name.data(), g_sessionPath
+        );
+        return false;
+    }
+    for (size_t i = 0; i < found.size(); i++) {
+        if (!found[i]) {
+            Error(
+                "Missing %hs in session config (%s)\n",
+                SETTINGS_FIELDS[i].name.data(),
+                g_sessionPath
+            );
+            return false;
+        }
     }
+    return true;
 }
@@ -4,18 +4,40 @@
 #pragma once
 
 #include "ALVR-common/packet_types.h"
+#include <memory>
 #include <string>
 
+// The fields that can change while streaming, see Settings::Reload()
+struct LiveSettings {
+    bool m_lateLatchReprojection = false;
+    bool m_forceHdrSrgbCorrection = false;
+    bool m_clampHdrExtendedRange = false;
+    float m_gazeRoiRadius = 0;
+    uint64_t m_minimumIdrIntervalMs = 0;
+    uint32_t m_posePredictionModel = ALVR_POSE_PREDICTION_CONSTANT_VELOCITY;
+};
+
 class Settings {
     static Settings m_Instance;
     bool m_loaded;
+    // Published by Load() and Reload(), replaced as a whole
+    std::shared_ptr<const LiveSettings> m_live;
 
     Settings();
     virtual ~Settings();
 
+    // Reads openvr_config from the session file, only the live fields if liveOnly is set
+    bool Read(bool liveOnly);
+
 public:
     void Load();
+    // Applies the fields that can change while streaming, after the session was updated. They are
+    // read into a copy of the settings, which is published only once all of them are valid.
+    void Reload();
     static Settings& Instance() { return m_Instance; }
+    // The live fields of the last load or reload. The snapshot doesn't change, a caller that reads
+    // several fields gets the values of the same reload.
+    std::shared_ptr<const LiveSettings> Live() const { return std::atomic_load(&m_live); }
 
     bool IsLoaded() { return m_loaded; }
 
@@ -25,7 +47,17 @@ public:
     int32_t m_recommendedTargetWidth;
     int32_t m_recommendedTargetHeight;
     int32_t m_nAdapterIndex;
+    // -1 to encode on m_nAdapterIndex
+    int32_t m_encodeAdapterIndex = -1;
+    // Hardware encode sessions per GPU across the instances of the host, 0 for no limit
+    uint32_t m_encoderSessionLimit;
+    bool m_d3d12HighPriorityQueue;
+    bool m_raiseGpuPriority;
     std::string m_captureFrameDir;
+    // 0 disables the flight recorder
+    float m_flightRecorderDurationS;
+    uint32_t m_flightRecorderDownscale;
+    bool m_flightRecorderDumpOnGlitch;
 
     bool m_enableFoveatedEncoding;
     float m_foveationCenterSizeX;
@@ -42,25 +74,50 @@ public:
     float m_gamma;
     float m_sharpening;
 
+    bool m_jitComposition;
+    bool m_adaptiveRenderResolution;
+    bool m_halfRateFallback;
+    bool m_vsyncLatencyCompensation;
+    bool m_photonMarker;
+    bool m_encoderChroma444;
+    bool m_realtimeThreads;
+    uint32_t m_isolatedCores;
+
     int m_codec;
     int m_h264Profile;
     bool m_use10bitEncoder;
     double m_encodingGamma;
     bool m_enableHdr;
-    bool m_forceHdrSrgbCorrection;
-    bool m_clampHdrExtendedRange;
+    bool m_hdrNvencRgbInput;
     bool m_enableAmfPreAnalysis;
     bool m_enableVbaq;
     bool m_enableAmfHmqb;
     bool m_useAmfPreproc;
     uint32_t m_amfPreProcSigma;
     uint32_t m_amfPreProcTor;
+    bool m_amfFrameRateConversion;
+    bool m_amfHqScaler;
     uint32_t m_encoderQualityPreset;
+    bool m_dynamicEncoderPreset;
     bool m_amdBitrateCorruptionFix;
+    bool m_bitrateCalibration;
     uint32_t m_nvencQualityPreset;
     uint32_t m_rateControlMode;
     bool m_fillerData;
+    uint32_t m_encoderSlicesPerFrame;
+    uint32_t m_encoderMaxSliceBytes;
+    uint32_t m_encoderAv1TileColumns;
+    uint32_t m_encoderAv1TileRows;
+    uint32_t m_encoderTemporalLayers;
+    uint32_t m_encoderDisposableFrames;
+    uint32_t m_vplAsyncDepth;
+    bool m_vplHyperEncode;
+    uint32_t m_gazeRoiQpDelta;
+    uint32_t m_dynamicResolutionBitrateMbps;
+    uint32_t m_intraRefreshFrames;
+    bool m_longTermReferenceRecovery;
     uint32_t m_entropyCoding;
+    bool m_encoderDecodeFeedback;
     bool m_force_sw_encoding;
     uint32_t m_swThreadCount;
 
@@ -81,17 +138,28 @@ public:
     int64_t m_nvencRcMaxBitrate;
     int64_t m_nvencRcAverageBitrate;
     bool m_nvencEnableWeightedPrediction;
-
-    uint64_t m_minimumIdrIntervalMs;
+    uint32_t m_nvencAsyncDepth;
+    uint32_t m_nvencSplitEncodeMode;
+    bool m_nvencStereoInterleave;
 
     bool m_enableViveTrackerProxy = false;
     bool m_TrackingRefOnly = false;
     bool m_enableLinuxVulkanAsyncCompute;
     bool m_enableLinuxAsyncReprojection;
+    uint32_t m_linuxEncodePipelineDepth;
+    bool m_linuxVulkanVideoEncode;
+    std::string m_linuxEncodeDevice;
+    uint32_t m_linuxQualityMetricsIntervalMs;
+    std::string m_linuxLocalDisplayDevice;
+    std::string m_linuxLocalDisplayConnector;
+    bool m_linuxIdleMode;
 
     bool m_enableControllers;
     int m_controllerIsTracker = false;
     int m_enableBodyTrackingFakeVive = false;
     int m_bodyTrackingHasLegs = false;
     bool m_useSeparateHandTrackers = false;
+
+    // Parsed live fields, read them with Live()
+    LiveSettings m_liveFields;
 };
@@ -0,0 +1,16 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "TemporalLayers.h"
+#include "Logger.h"
+#include "Settings.h"
+
+TemporalLayers::TemporalLayers()
+    : m_layerCount(Settings::Instance().m_encoderTemporalLayers) {
+    if (m_layerCount == 0) {
+        m_layerCount = 1;
+    } else if (m_layerCount > MAX_LAYER_COUNT) {
+        Warn("Using %u temporal layers instead of %u.\n", MAX_LAYER_COUNT, m_layerCount);
+        m_layerCount = MAX_LAYER_COUNT;
+    }
+}
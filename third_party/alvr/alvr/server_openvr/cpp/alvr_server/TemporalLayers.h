@@ -0,0 +1,25 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Temporal layer bookkeeping shared by the encoders. With N layers the encoders use the dyadic
+// pattern restarted at each IDR: every 2^(N-1)th frame is in layer 0, and a frame in layer L only
+// references frames of the layers up to L. Dropping the top layer halves the frame rate.
+class TemporalLayers {
+public:
+    static const uint32_t MAX_LAYER_COUNT = 3;
+
+    TemporalLayers();
+
+    // More than one layer set by encoder_temporal_layers, and not disabled by the backend
+    bool IsEnabled() const { return m_layerCount > 1; }
+    void Disable() { m_layerCount = 1; }
+    void SetLayerCount(uint32_t layerCount) { m_layerCount = layerCount; }
+    uint32_t GetLayerCount() const { return m_layerCount; }
+
+private:
+    uint32_t m_layerCount;
+};
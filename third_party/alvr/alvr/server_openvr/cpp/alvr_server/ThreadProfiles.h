@@ -0,0 +1,28 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "Settings.h"
+#include "shared/threadtools.h"
+
+// Profile of the threads that render, encode and send the frames. Realtime scheduling keeps the
+// worker threads of the game from preempting them, the isolated cores keep them off the cores
+// the game is scheduled on first. With `numaNode`, the threads that read frames back stay on the
+// node of the GPU, within the isolated cores if some of them are on it.
+inline ThreadProfile EncoderThreadProfile(int numaNode = -1) {
+    ThreadProfile profile;
+    profile.bUrgent = true;
+    if (Settings::Instance().m_realtimeThreads) {
+        // Below the audio servers, which rtkit gives 20 at most
+        profile.nRealtimePriority = 10;
+    }
+    profile.nAffinityMask = LastCoresMask(Settings::Instance().m_isolatedCores);
+    uint64_t nodeMask = NumaNodeCoresMask(numaNode);
+    if (nodeMask && (profile.nAffinityMask & nodeMask)) {
+        profile.nAffinityMask &= nodeMask;
+    } else if (nodeMask && !profile.nAffinityMask) {
+        profile.nAffinityMask = nodeMask;
+    }
+    return profile;
+}
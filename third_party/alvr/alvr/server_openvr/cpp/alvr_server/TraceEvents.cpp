@@ -0,0 +1,172 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "TraceEvents.h"
+
+#ifdef ALVR_TRACE_EVENTS
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#include <TraceLoggingProvider.h>
+
+// {5B3F6D2E-8E0C-4C4A-9D7E-3A1F2B6C8D41}
+TRACELOGGING_DEFINE_PROVIDER(
+    g_traceProvider,
+    "ALVR.Driver",
+    (0x5b3f6d2e, 0x8e0c, 0x4c4a, 0x9d, 0x7e, 0x3a, 0x1f, 0x2b, 0x6c, 0x8d, 0x41)
+);
+
+namespace {
+// Registered for the lifetime of the driver DLL
+struct ProviderRegistration {
+    ProviderRegistration() { TraceLoggingRegister(g_traceProvider); }
+    ~ProviderRegistration() { TraceLoggingUnregister(g_traceProvider); }
+} g_registration;
+}
+
+bool TraceEventsEnabled() { return TraceLoggingProviderEnabled(g_traceProvider, 0, 0); }
+
+void TraceBegin(const char* name) {
+    TraceLoggingWrite(
+        g_traceProvider,
+        "Slice",
+        TraceLoggingOpcode(WINEVENT_OPCODE_START),
+        TraceLoggingString(name, "Name")
+    );
+}
+
+void TraceEnd() {
+    TraceLoggingWrite(g_traceProvider, "Slice", TraceLoggingOpcode(WINEVENT_OPCODE_STOP));
+}
+
+void TraceCounter(const char* name, int64_t value) {
+    TraceLoggingWrite(
+        g_traceProvider,
+        "Counter",
+        TraceLoggingString(name, "Name"),
+        TraceLoggingInt64(value, "Value")
+    );
+}
+
+void TraceGpuWork(const char* queue, const char* name, uint64_t durationNs, uint64_t endNs) {
+    TraceLoggingWrite(
+        g_traceProvider,
+        "GpuWork",
+        TraceLoggingString(queue, "Queue"),
+        TraceLoggingString(name, "Name"),
+        TraceLoggingUInt64(durationNs, "DurationNs"),
+        TraceLoggingUInt64(endNs, "EndNs")
+    );
+}
+
+#else
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace {
+// The marker is written to while tracing_on is set, which is checked again every second
+const int64_t CHECK_INTERVAL_NS = 1'000'000'000;
+
+std::atomic<int> g_markerFd { -2 };
+std::atomic_bool g_tracing { false };
+std::atomic<int64_t> g_checkNs { 0 };
+int g_pid = getpid();
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+int markerFd() {
+    int fd = g_markerFd.load(std::memory_order_acquire);
+    if (fd != -2) {
+        return fd;
+    }
+    fd = open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fd = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+    }
+    int expected = -2;
+    if (!g_markerFd.compare_exchange_strong(expected, fd < 0 ? -1 : fd)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return expected;
+    }
+    return fd < 0 ? -1 : fd;
+}
+
+bool tracingOn() {
+    int fd = open("/sys/kernel/tracing/tracing_on", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fd = open("/sys/kernel/debug/tracing/tracing_on", O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        return false;
+    }
+    char value = '0';
+    bool on = read(fd, &value, 1) == 1 && value == '1';
+    close(fd);
+    return on;
+}
+
+void writeMarker(const char* buffer, int len) {
+    int fd = markerFd();
+    if (fd >= 0 && len > 0) {
+        // A marker that doesn't fit is truncated by snprintf, a failed write is dropped
+        (void)!write(fd, buffer, len);
+    }
+}
+}
+
+bool TraceEventsEnabled() {
+    int64_t now = nowNs();
+    int64_t checkNs = g_checkNs.load(std::memory_order_relaxed);
+    if (now - checkNs >= CHECK_INTERVAL_NS
+        && g_checkNs.compare_exchange_strong(checkNs, now, std::memory_order_relaxed)) {
+        g_tracing.store(markerFd() >= 0 && tracingOn(), std::memory_order_relaxed);
+    }
+    return g_tracing.load(std::memory_order_relaxed);
+}
+
+void TraceBegin(const char* name) {
+    char buffer[128];
+    int len = snprintf(buffer, sizeof(buffer), "B|%d|%s", g_pid, name);
+    writeMarker(buffer, std::min<int>(len, sizeof(buffer) - 1));
+}
+
+void TraceEnd() {
+    char buffer[32];
+    int len = snprintf(buffer, sizeof(buffer), "E|%d", g_pid);
+    writeMarker(buffer, len);
+}
+
+void TraceCounter(const char* name, int64_t value) {
+    char buffer[128];
+    int len = snprintf(buffer, sizeof(buffer), "C|%d|%s|%" PRId64, g_pid, name, value);
+    writeMarker(buffer, std::min<int>(len, sizeof(buffer) - 1));
+}
+
+void TraceGpuWork(const char* queue, const char* name, uint64_t durationNs, uint64_t) {
+    // The marker is timestamped when written and can't be placed at endNs, so the work is a
+    // counter track per queue and pass with its duration
+    char buffer[160];
+    int len = snprintf(
+        buffer, sizeof(buffer), "C|%d|GPU %s %s|%" PRIu64, g_pid, queue, name, durationNs
+    );
+    writeMarker(buffer, std::min<int>(len, sizeof(buffer) - 1));
+}
+
+#endif
+
+#endif
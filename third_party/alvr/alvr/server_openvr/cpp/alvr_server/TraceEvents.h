@@ -0,0 +1,68 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Trace events of the driver threads, for a system-wide timeline with SteamVR and the game. On
+// Windows they go to the ETW TraceLogging provider "ALVR.Driver", on Linux to the ftrace marker
+// in the atrace format, which the Perfetto ftrace data source records as track events.
+//
+// Built with the trace-events feature only, the macros are empty otherwise. When built, an event
+// costs a single check until a trace session is recording.
+
+#ifdef ALVR_TRACE_EVENTS
+
+bool TraceEventsEnabled();
+void TraceBegin(const char* name);
+void TraceEnd();
+void TraceCounter(const char* name, int64_t value);
+// GPU work completed on `queue`, only recorded once its timestamps are read back. endNs is in the
+// FrameTraceNow() clock, 0 if the GPU clock of the queue isn't calibrated.
+void TraceGpuWork(const char* queue, const char* name, uint64_t durationNs, uint64_t endNs);
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : m_active(TraceEventsEnabled()) {
+        if (m_active) {
+            TraceBegin(name);
+        }
+    }
+    ~TraceScope() {
+        if (m_active) {
+            TraceEnd();
+        }
+    }
+
+private:
+    bool m_active;
+};
+
+#define ALVR_TRACE_CONCAT_(a, b) a##b
+#define ALVR_TRACE_CONCAT(a, b) ALVR_TRACE_CONCAT_(a, b)
+// Slice on the thread track from here to the end of the scope, name must be a literal
+#define ALVR_TRACE_SCOPE(name) TraceScope ALVR_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define ALVR_TRACE_COUNTER(name, value)                                                            \
+    do {                                                                                           \
+        if (TraceEventsEnabled()) {                                                                \
+            TraceCounter(name, value);                                                             \
+        }                                                                                          \
+    } while (0)
+#define ALVR_TRACE_GPU(queue, name, durationNs, endNs)                                             \
+    do {                                                                                           \
+        if (TraceEventsEnabled()) {                                                                \
+            TraceGpuWork(queue, name, durationNs, endNs);                                          \
+        }                                                                                          \
+    } while (0)
+
+#else
+
+inline bool TraceEventsEnabled() { return false; }
+
+#define ALVR_TRACE_SCOPE(name)
+#define ALVR_TRACE_COUNTER(name, value)
+#define ALVR_TRACE_GPU(queue, name, durationNs, endNs)
+
+#endif
@@ -5,6 +5,7 @@
 #include "Logger.h"
 #include "Utils.h"
 #include <chrono>
+#include <cstring>
 #include <thread>
 
 TrackedDevice::TrackedDevice(uint64_t device_id, vr::ETrackedDeviceClass device_class)
@@ -29,63 +30,165 @@ std::string TrackedDevice::get_serial_number() {
     return std::string(&buffer[0]);
 }
 
-void TrackedDevice::set_prop(FfiOpenvrProperty prop) {
+namespace {
+
+bool same_prop_value(const FfiOpenvrProperty& a, const FfiOpenvrProperty& b) {
+    if (a.type != b.type) {
+        return false;
+    }
+    switch (a.type) {
+    case FfiOpenvrPropertyType::Bool:
+        return a.value.bool_ == b.value.bool_;
+    case FfiOpenvrPropertyType::Float:
+        return a.value.float_ == b.value.float_;
+    case FfiOpenvrPropertyType::Int32:
+        return a.value.int32 == b.value.int32;
+    case FfiOpenvrPropertyType::Uint64:
+        return a.value.uint64 == b.value.uint64;
+    case FfiOpenvrPropertyType::Vector3:
+        return a.value.vector3[0] == b.value.vector3[0] && a.value.vector3[1] == b.value.vector3[1]
+            && a.value.vector3[2] == b.value.vector3[2];
+    case FfiOpenvrPropertyType::Double:
+        return a.value.double_ == b.value.double_;
+    case FfiOpenvrPropertyType::String:
+        return strncmp(a.value.string, b.value.string, sizeof(a.value.string)) == 0;
+    }
+    return false;
+}
+
+} // namespace
+
+void TrackedDevice::set_prop(FfiOpenvrProperty prop, bool notify) {
     if (this->object_id == vr::k_unTrackedDeviceIndexInvalid) {
         return;
     }
+    if (prop.type > FfiOpenvrPropertyType::String) {
+        Error("Unreachable");
+        return;
+    }
+
+    auto lock = std::lock_guard<std::mutex>(this->prop_mutex);
+
+    auto cached = this->prop_cache.find(prop.key);
+    if (cached != this->prop_cache.end() && same_prop_value(cached->second, prop)) {
+        return;
+    }
 
-    auto key = (vr::ETrackedDeviceProperty)prop.key;
-
-    auto props = vr::VRProperties();
-
-    vr::ETrackedPropertyError result;
-
-    if (prop.type == FfiOpenvrPropertyType::Bool) {
-        result = props->SetBoolProperty(this->prop_container, key, prop.value.bool_);
-    } else if (prop.type == FfiOpenvrPropertyType::Float) {
-        result = props->SetFloatProperty(this->prop_container, key, prop.value.float_);
-    } else if (prop.type == FfiOpenvrPropertyType::Int32) {
-        result = props->SetInt32Property(this->prop_container, key, prop.value.int32);
-    } else if (prop.type == FfiOpenvrPropertyType::Uint64) {
-        result = props->SetUint64Property(this->prop_container, key, prop.value.uint64);
-    } else if (prop.type == FfiOpenvrPropertyType::Vector3) {
-        auto vec3 = vr::HmdVector3_t {};
-        vec3.v[0] = prop.value.vector3[0];
-        vec3.v[1] = prop.value.vector3[1];
-        vec3.v[2] = prop.value.vector3[2];
-        result = props->SetVec3Property(this->prop_container, key, vec3);
-    } else if (prop.type == FfiOpenvrPropertyType::Double) {
-        result = props->SetDoubleProperty(this->prop_container, key, prop.value.double_);
-    } else if (prop.type == FfiOpenvrPropertyType::String) {
-        result = props->SetStringProperty(this->prop_container, key, prop.value.string);
+    if (this->queue_props) {
+        this->queued_props.push_back(prop);
     } else {
-        Error("Unreachable");
-        result = vr::TrackedProp_Success;
+        write_props(&prop, 1, notify);
     }
+}
 
-    if (result != vr::TrackedProp_Success) {
-        Error(
-            "Error setting property %d: %s",
-            key,
-            vr::VRPropertiesRaw()->GetPropErrorNameFromEnum(result)
-        );
+void TrackedDevice::set_openvr_props() {
+    {
+        auto lock = std::lock_guard<std::mutex>(this->prop_mutex);
+        this->queue_props = true;
     }
 
-    auto event_data = vr::VREvent_Data_t {};
-    event_data.property.container = this->prop_container;
-    event_data.property.prop = key;
-    vr::VRServerDriverHost()->VendorSpecificEvent(
-        this->object_id, vr::VREvent_PropertyChanged, event_data, 0.
-    );
+    SetOpenvrProps((void*)this, this->device_id);
+
+    auto lock = std::lock_guard<std::mutex>(this->prop_mutex);
+    write_props(this->queued_props.data(), this->queued_props.size(), false);
+    this->queued_props.clear();
+    this->queue_props = false;
+}
+
+void TrackedDevice::write_props(const FfiOpenvrProperty* props, size_t count, bool notify) {
+    if (count == 0) {
+        return;
+    }
+
+    auto batch = std::vector<vr::PropertyWrite_t>(count);
+    // OpenVR bools are a single byte, the FFI ones are not
+    auto bools = std::vector<char>(count);
+    for (size_t i = 0; i < count; i++) {
+        const FfiOpenvrProperty& prop = props[i];
+        vr::PropertyWrite_t& write = batch[i];
+        write.prop = (vr::ETrackedDeviceProperty)prop.key;
+        write.writeType = vr::PropertyWrite_Set;
+        write.pvBuffer = (void*)&prop.value;
+
+        if (prop.type == FfiOpenvrPropertyType::Bool) {
+            bools[i] = prop.value.bool_ != 0;
+            static_assert(sizeof(bool) == sizeof(char));
+            write.pvBuffer = &bools[i];
+            write.unBufferSize = sizeof(bool);
+            write.unTag = vr::k_unBoolPropertyTag;
+        } else if (prop.type == FfiOpenvrPropertyType::Float) {
+            write.unBufferSize = sizeof(float);
+            write.unTag = vr::k_unFloatPropertyTag;
+        } else if (prop.type == FfiOpenvrPropertyType::Int32) {
+            write.unBufferSize = sizeof(int32_t);
+            write.unTag = vr::k_unInt32PropertyTag;
+        } else if (prop.type == FfiOpenvrPropertyType::Uint64) {
+            write.unBufferSize = sizeof(uint64_t);
+            write.unTag = vr::k_unUint64PropertyTag;
+        } else if (prop.type == FfiOpenvrPropertyType::Vector3) {
+            static_assert(sizeof(vr::HmdVector3_t) == sizeof(prop.value.vector3));
+            write.unBufferSize = sizeof(vr::HmdVector3_t);
+            write.unTag = vr::k_unHmdVector3PropertyTag;
+        } else if (prop.type == FfiOpenvrPropertyType::Double) {
+            write.unBufferSize = sizeof(double);
+            write.unTag = vr::k_unDoublePropertyTag;
+        } else {
+            write.unBufferSize = strnlen(prop.value.string, sizeof(prop.value.string) - 1) + 1;
+            write.unTag = vr::k_unStringPropertyTag;
+        }
+    }
+
+    vr::VRPropertiesRaw()->WritePropertyBatch(this->prop_container, batch.data(), count);
+
+    for (size_t i = 0; i < count; i++) {
+        const vr::PropertyWrite_t& write = batch[i];
+        if (write.eError != vr::TrackedProp_Success) {
+            Error(
+                "Error setting property %d: %s",
+                write.prop,
+                vr::VRPropertiesRaw()->GetPropErrorNameFromEnum(write.eError)
+            );
+            // Not cached, the next set_prop tries again
+            this->prop_cache.erase(props[i].key);
+            continue;
+        }
+        this->prop_cache[props[i].key] = props[i];
+
+        if (notify) {
+            auto event_data = vr::VREvent_Data_t {};
+            event_data.property.container = this->prop_container;
+            event_data.property.prop = write.prop;
+            vr::VRServerDriverHost()->VendorSpecificEvent(
+                this->object_id, vr::VREvent_PropertyChanged, event_data, 0.
+            );
+        }
+    }
 }
 
 void TrackedDevice::submit_pose(vr::DriverPose_t pose) {
+    if (!pose.poseIsValid) {
+        this->pose_predictor.Reset();
+    }
+
     this->last_pose = pose;
     vr::VRServerDriverHost()->TrackedDevicePoseUpdated(
         this->object_id, pose, sizeof(vr::DriverPose_t)
     );
 }
 
+void TrackedDevice::submit_predicted_pose(
+    vr::DriverPose_t pose,
+    uint64_t targetTimestampNs,
+    float predictionS,
+    const float linearVelocity[3],
+    const float angularVelocity[3]
+) {
+    this->pose_predictor.Update(targetTimestampNs, linearVelocity, angularVelocity);
+    this->pose_predictor.Apply(pose, predictionS);
+
+    this->submit_pose(pose);
+}
+
 bool TrackedDevice::register_device(bool await_activation) {
     if (!vr::VRServerDriverHost()->TrackedDeviceAdded(
             this->get_serial_number().c_str(),
@@ -97,22 +200,33 @@ bool TrackedDevice::register_device(bool await_activation) {
         return false;
     }
 
-    if (await_activation) {
-        auto lock = std::unique_lock<std::mutex>(this->activation_mutex);
-        this->activation_condvar.wait_for(lock, std::chrono::seconds(1), [this] {
-            return this->activation_state != ActivationState::Pending;
-        });
+    return await_activation ? this->wait_activation() : true;
+}
+
+bool TrackedDevice::wait_activation() {
+    auto lock = std::unique_lock<std::mutex>(this->activation_mutex);
+    this->activation_condvar.wait_for(lock, std::chrono::seconds(1), [this] {
+        return this->activation_state != ActivationState::Pending;
+    });
 
-        return this->activation_state == ActivationState::Success;
-    } else {
-        return true;
-    }
+    return this->activation_state == ActivationState::Success;
+}
+
+ActivationState TrackedDevice::activation() {
+    auto lock = std::lock_guard<std::mutex>(this->activation_mutex);
+    return this->activation_state;
 }
 
 vr::EVRInitError TrackedDevice::Activate(vr::TrackedDeviceIndex_t object_id) {
     this->object_id = object_id;
     this->prop_container = vr::VRProperties()->TrackedDeviceToPropertyContainer(this->object_id);
 
+    {
+        // A new container has none of the properties of a previous activation
+        auto lock = std::lock_guard<std::mutex>(this->prop_mutex);
+        this->prop_cache.clear();
+    }
+
     {
         auto guard = std::lock_guard<std::mutex>(this->activation_mutex);
 
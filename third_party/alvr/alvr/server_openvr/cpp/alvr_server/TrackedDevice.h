@@ -3,12 +3,14 @@
 
 #pragma once
 
+#include "PosePredictor.h"
 #include "bindings.h"
 #include "openvr_driver_wrap.h"
 #include <condition_variable>
 #include <map>
 #include <mutex>
 #include <optional>
+#include <vector>
 
 enum class ActivationState {
     Pending,
@@ -23,7 +25,13 @@ public:
     vr::DriverPose_t last_pose;
 
     bool register_device(bool await_activation);
-    void set_prop(FfiOpenvrProperty prop);
+    // Waits up to a second for SteamVR to activate a device registered without awaiting it
+    bool wait_activation();
+    // Activation outcome so far, without waiting
+    ActivationState activation();
+    // Sends the property to SteamVR unless it already has this value. notify also sends a
+    // VREvent_PropertyChanged for it.
+    void set_prop(FfiOpenvrProperty prop, bool notify = true);
 
 protected:
     uint64_t device_id;
@@ -32,10 +40,34 @@ protected:
     TrackedDevice(uint64_t device_id, vr::ETrackedDeviceClass device_class);
     std::string get_serial_number();
     void submit_pose(vr::DriverPose_t pose);
+    // Submits a tracked pose with the velocities chosen by the pose predictor, for SteamVR to
+    // extrapolate by predictionS. Untracked poses go through submit_pose, which also resets the
+    // predictor.
+    void submit_predicted_pose(
+        vr::DriverPose_t pose,
+        uint64_t targetTimestampNs,
+        float predictionS,
+        const float linearVelocity[3],
+        const float angularVelocity[3]
+    );
+    // The initial properties of the device from the server core. They are written in a single
+    // batch, without change events since SteamVR has not read any of them yet.
+    void set_openvr_props();
     virtual bool activate() = 0;
     virtual void* get_component(const char*) = 0;
 
 private:
+    PosePredictor pose_predictor;
+
+    // Last value written of each property by key, for set_prop to skip the unchanged ones
+    std::map<uint32_t, FfiOpenvrProperty> prop_cache;
+    // Set during set_openvr_props, set_prop then only queues the properties
+    bool queue_props = false;
+    std::vector<FfiOpenvrProperty> queued_props;
+    std::mutex prop_mutex = {};
+
+    void write_props(const FfiOpenvrProperty* props, size_t count, bool notify);
+
     ActivationState activation_state = ActivationState::Pending;
     std::mutex activation_mutex = {};
     std::condition_variable activation_condvar = {};
@@ -73,6 +73,16 @@ inline vr::HmdQuaternion_t HmdQuaternion_Init(double w, double x, double y, doub
     return quat;
 }
 
+// Rotation from orientation `from` to orientation `to`, to * conjugate(from)
+inline FfiQuat QuatDelta(const FfiQuat& from, const FfiQuat& to) {
+    FfiQuat delta;
+    delta.w = to.w * from.w + to.x * from.x + to.y * from.y + to.z * from.z;
+    delta.x = -to.w * from.x + to.x * from.w - to.y * from.z + to.z * from.y;
+    delta.y = -to.w * from.y + to.x * from.z + to.y * from.w - to.z * from.x;
+    delta.z = -to.w * from.z - to.x * from.y + to.y * from.x + to.z * from.w;
+    return delta;
+}
+
 inline vr::HmdRect2_t fov_to_tangents(FfiFov fov) {
     auto proj_bounds = vr::HmdRect2_t {};
     proj_bounds.vTopLeft.v[0] = tanf(fov.left);
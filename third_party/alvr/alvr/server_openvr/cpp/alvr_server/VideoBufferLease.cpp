@@ -0,0 +1,67 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "VideoBufferLease.h"
+#include "DriverMetrics.h"
+#include "FrameTrace.h"
+#include "Logger.h"
+#include "bindings.h"
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+std::mutex g_leaseMutex;
+std::unordered_map<unsigned long long, std::function<void()>> g_leases;
+unsigned long long g_nextLeaseId = 1;
+}
+
+void ParseFrameNalsLeased(
+    int codec,
+    unsigned char* buf,
+    int len,
+    unsigned long long targetTimestampNs,
+    bool isIdr,
+    std::function<void()> release
+) {
+    FrameTraceMark(targetTimestampNs, FRAME_TRACE_ENCODE_COMPLETE);
+    if (!PrepareFrameNals(codec, buf, len)) {
+        release();
+        return;
+    }
+    FrameTraceMark(targetTimestampNs, FRAME_TRACE_NAL_PARSE);
+
+    if (!VideoSendLeased) {
+        VideoSend(targetTimestampNs, buf, len, isIdr);
+        MetricsFrameSent(len, isIdr);
+        release();
+        FrameTraceMark(targetTimestampNs, FRAME_TRACE_VIDEO_SEND);
+        FrameTraceCommit(targetTimestampNs);
+        return;
+    }
+
+    unsigned long long leaseId;
+    {
+        std::lock_guard<std::mutex> lock(g_leaseMutex);
+        leaseId = g_nextLeaseId++;
+        g_leases.emplace(leaseId, std::move(release));
+    }
+    VideoSendLeased(targetTimestampNs, buf, len, isIdr, leaseId);
+    MetricsFrameSent(len, isIdr);
+    FrameTraceMark(targetTimestampNs, FRAME_TRACE_VIDEO_SEND);
+    FrameTraceCommit(targetTimestampNs);
+}
+
+void ReleaseVideoBuffer(unsigned long long leaseId) {
+    std::function<void()> release;
+    {
+        std::lock_guard<std::mutex> lock(g_leaseMutex);
+        auto it = g_leases.find(leaseId);
+        if (it == g_leases.end()) {
+            Warn("ReleaseVideoBuffer: unknown lease %llu\n", leaseId);
+            return;
+        }
+        release = std::move(it->second);
+        g_leases.erase(it);
+    }
+    release();
+}
@@ -0,0 +1,20 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <functional>
+
+// Encoder-owned bitstream buffers can be handed to the transport without a copy on the encoder
+// thread, the transport copies them on its own thread. The buffer stays valid until the transport
+// calls ReleaseVideoBuffer with the lease id, at which point `release` runs on the calling thread.
+// If the transport does not support leases the frame goes through VideoSend and `release` runs
+// before this returns.
+void ParseFrameNalsLeased(
+    int codec,
+    unsigned char* buf,
+    int len,
+    unsigned long long targetTimestampNs,
+    bool isIdr,
+    std::function<void()> release
+);
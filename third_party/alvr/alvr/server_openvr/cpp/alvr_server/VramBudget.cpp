@@ -0,0 +1,44 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "VramBudget.h"
+#include "DriverMetrics.h"
+#include "Logger.h"
+#include <atomic>
+
+namespace {
+// Pressure starts above this share of the budget and ends below the lower one, so that the
+// encoders aren't recreated over and over around a single value
+const double PRESSURE_HIGH = 0.9;
+const double PRESSURE_LOW = 0.8;
+
+std::atomic_bool g_pressure { false };
+}
+
+void ReportVramBudget(uint64_t usageBytes, uint64_t budgetBytes) {
+    MetricsSetGauge(DRIVER_GAUGE_VRAM_USAGE_BYTES, (double)usageBytes);
+    MetricsSetGauge(DRIVER_GAUGE_VRAM_BUDGET_BYTES, (double)budgetBytes);
+    if (budgetBytes == 0) {
+        return;
+    }
+
+    double ratio = (double)usageBytes / budgetBytes;
+    bool pressure = g_pressure.load(std::memory_order_relaxed);
+    if (!pressure && ratio > PRESSURE_HIGH) {
+        Warn(
+            "Video memory at %.0f%% of the budget (%llu of %llu MiB), keeping fewer frames in "
+            "flight\n",
+            ratio * 100,
+            (unsigned long long)(usageBytes >> 20),
+            (unsigned long long)(budgetBytes >> 20)
+        );
+        g_pressure = true;
+    } else if (pressure && ratio < PRESSURE_LOW) {
+        Info("Video memory back at %.0f%% of the budget\n", ratio * 100);
+        g_pressure = false;
+    }
+}
+
+bool VramUnderPressure() { return g_pressure.load(std::memory_order_relaxed); }
+
+uint32_t VramLimitedDepth(uint32_t depth) { return VramUnderPressure() && depth > 1 ? 1 : depth; }
@@ -0,0 +1,19 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Video memory pressure of the GPU the frames are encoded on. The budget the OS gives this process
+// shrinks as the game takes memory, and going over it makes the driver page allocations out to
+// system memory, which stalls the game and the encoder alike. The encoders keep fewer frames in
+// flight while the process is close to its budget. Thread safe.
+
+// Video memory this process uses and its budget, polled by the platform code from
+// VK_EXT_memory_budget or IDXGIAdapter3::QueryVideoMemoryInfo
+void ReportVramBudget(uint64_t usageBytes, uint64_t budgetBytes);
+// Whether the usage went over the budget margin and hasn't come back well under it since
+bool VramUnderPressure();
+// depth frames in flight, or a single one under pressure. Applied when the encoders are created.
+uint32_t VramLimitedDepth(uint32_t depth);
@@ -0,0 +1,68 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "VsyncTiming.h"
+#include <mutex>
+
+namespace {
+// Weight of a new sample in the server latency average
+const double AVERAGE_WEIGHT = 0.05;
+
+std::mutex g_mutex;
+uint64_t g_vsyncNs = 0;
+uint64_t g_periodNs = 0;
+int64_t g_serverToClientNs = 0;
+uint64_t g_networkLatencyNs = 0;
+double g_serverLatencyNs = 0;
+
+int64_t PositiveMod(int64_t value, int64_t divisor) {
+    int64_t rest = value % divisor;
+    return rest < 0 ? rest + divisor : rest;
+}
+}
+
+void VsyncTimingSetClient(
+    uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_vsyncNs = vsyncNs;
+    g_periodNs = periodNs;
+    g_serverToClientNs = serverToClientNs;
+    g_networkLatencyNs = networkLatencyNs;
+}
+
+void VsyncTimingOnFrameSent(uint64_t presentToSendNs) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_serverLatencyNs == 0) {
+        g_serverLatencyNs = (double)presentToSendNs;
+    } else {
+        g_serverLatencyNs += AVERAGE_WEIGHT * ((double)presentToSendNs - g_serverLatencyNs);
+    }
+}
+
+void VsyncTimingReset() {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_periodNs = 0;
+    g_serverLatencyNs = 0;
+}
+
+double VsyncTimingOffsetSeconds(uint64_t nowNs) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_periodNs == 0 || g_serverLatencyNs == 0) {
+        return 0;
+    }
+    // A frame presented at a vsync reaches the client just in time for the client vsync one
+    // latency later
+    int64_t latency = (int64_t)g_serverLatencyNs + (int64_t)g_networkLatencyNs;
+    int64_t vsyncNs = (int64_t)g_vsyncNs - g_serverToClientNs - latency;
+    int64_t sinceVsync = PositiveMod((int64_t)nowNs - vsyncNs, (int64_t)g_periodNs);
+    return -(double)sinceVsync / 1e9;
+}
+
+double VsyncTimingToPhotonsSeconds() {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_serverLatencyNs == 0) {
+        return 0;
+    }
+    return (g_serverLatencyNs + (double)g_networkLatencyNs) / 1e9;
+}
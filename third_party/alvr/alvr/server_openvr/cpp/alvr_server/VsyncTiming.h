@@ -0,0 +1,29 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <stdint.h>
+
+// Where SteamVR's vsync falls and how long it takes from there to the photons on the client
+// display, from the measured stages of the recent frames: the compositor present to the bitstream
+// being sent on the server, then the transport and decode time the client measures. With
+// vsync_latency_compensation, SendVSync places the vsync one pipeline latency before a client
+// vsync and reports that latency as Prop_SecondsFromVsyncToPhotons_Float, so that games start
+// their frames and predict their poses for when the frames are actually shown.
+//
+// Times are in the FrameTraceNow() clock unless noted.
+
+// Client display timing, as given to SetClientTiming
+void VsyncTimingSetClient(
+    uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+);
+// Time from the compositor presenting a frame to its bitstream being sent
+void VsyncTimingOnFrameSent(uint64_t presentToSendNs);
+void VsyncTimingReset();
+
+// Offset from nowNs of the last vsync, in seconds and at most 0, for VsyncEvent. 0 until the
+// client timing and a frame are known.
+double VsyncTimingOffsetSeconds(uint64_t nowNs);
+// Vsync to photons latency, 0 until known
+double VsyncTimingToPhotonsSeconds();
@@ -9,36 +9,35 @@
 #else
 #include "platform/linux/CEncoder.h"
 #endif
+#include "BodyTrackers.h"
+#include "ChaperoneUpdater.h"
+#include "ClientClock.h"
 #include "Controller.h"
+#include "CpuFeatures.h"
+#include "DecodeFeedback.h"
 #include "FakeViveTracker.h"
+#include "FrameIncidents.h"
+#include "FrameTrace.h"
 #include "HMD.h"
 #include "Logger.h"
 #include "Paths.h"
 #include "PoseHistory.h"
 #include "Settings.h"
+#include "TraceEvents.h"
 #include "TrackedDevice.h"
+#include "VsyncTiming.h"
 #include "bindings.h"
 #include "driverlog.h"
 #include "openvr_driver_wrap.h"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstring>
-#include <map>
+#include <functional>
 #include <optional>
 
 #ifdef __linux__
 #include "include/openvr_math.h"
-std::unique_ptr<vr::HmdMatrix34_t> GetInvZeroPose();
-
-std::unique_ptr<vr::HmdMatrix34_t> GetRawZeroPose() {
-    auto invZeroPose = GetInvZeroPose();
-    if (invZeroPose == nullptr) {
-        return nullptr;
-    }
-    return std::make_unique<vr::HmdMatrix34_t>(vrmath::matInv33(*invZeroPose));
-}
-
-bool IsOpenvrClientReady();
 #endif
 void _SetChaperoneArea(float areaWidth, float areaHeight);
 
@@ -88,10 +87,40 @@ public:
     std::unique_ptr<Controller> left_controller, right_controller;
     std::unique_ptr<Controller> left_hand_tracker, right_hand_tracker;
     std::vector<std::unique_ptr<FakeViveTracker>> generic_trackers;
+    BodyTrackers body_trackers;
     bool devices_initialized = false;
     bool shutdown_called = false;
+    // Of the last zero pose given to the pose history
+    uint64_t zero_pose_generation = 0;
+
+    // Registered devices by registration order. There are at most a dozen, a linear search of
+    // the packed IDs beats any map. Body trackers are added by the tracking thread while the
+    // other threads look devices up: entries are only appended, and published by the count.
+    static constexpr size_t MAX_DEVICES = 16;
+    std::atomic<size_t> device_count { 0 };
+    uint64_t device_ids[MAX_DEVICES] = {};
+    TrackedDevice* devices[MAX_DEVICES] = {};
+
+    void add_device(uint64_t id, TrackedDevice* device) {
+        size_t count = this->device_count.load(std::memory_order_relaxed);
+        if (count == MAX_DEVICES) {
+            Error("DriverProvider: too many devices, %llu ignored", (unsigned long long)id);
+            return;
+        }
+        this->device_ids[count] = id;
+        this->devices[count] = device;
+        this->device_count.store(count + 1, std::memory_order_release);
+    }
 
-    std::map<uint64_t, TrackedDevice*> tracked_devices;
+    TrackedDevice* find_device(uint64_t id) {
+        size_t count = this->device_count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            if (this->device_ids[i] == id) {
+                return this->devices[i];
+            }
+        }
+        return nullptr;
+    }
 
     virtual vr::EVRInitError Init(vr::IVRDriverContext* pContext) override {
         Debug("DriverProvider::Init");
@@ -105,7 +134,7 @@ public:
             // IServerTrackedDeviceProvider::Init() (this function) returns.
             hmd->register_device(false);
             this->hmd = std::unique_ptr<Hmd>(hmd);
-            this->tracked_devices.insert({ HEAD_ID, this->hmd.get() });
+            this->add_device(HEAD_ID, this->hmd.get());
         }
 
         return vr::VRInitError_None;
@@ -120,6 +149,7 @@ public:
         this->hmd.reset();
         // this->generic_trackers.clear();
 
+        StopLogWorker();
         CleanupDriverLog();
 
         VR_CLEANUP_SERVER_DRIVER_CONTEXT();
@@ -129,6 +159,18 @@ public:
         return vr::ITrackedDeviceServerDriver_Version;
     }
     virtual void RunFrame() override {
+        // Pulses of the same device polled in one frame are sent as one: the last pulse, lasting
+        // and as strong as the longest and strongest of them
+        struct HapticsPulse {
+            uint64_t id;
+            float duration_s;
+            float frequency;
+            float amplitude;
+        };
+        // Left, right and the containers of neither controller
+        HapticsPulse pulses[3];
+        int pulseCount = 0;
+
         vr::VREvent_t event;
         while (vr::VRServerDriverHost()->PollNextEvent(&event, sizeof(vr::VREvent_t))) {
             if (event.eventType == vr::VREvent_Input_HapticVibration) {
@@ -145,7 +187,16 @@ public:
                     id = HAND_RIGHT_ID;
                 }
 
-                HapticsSend(id, haptics.fDurationSeconds, haptics.fFrequency, haptics.fAmplitude);
+                HapticsPulse* pulse = std::find_if(
+                    pulses, pulses + pulseCount, [&](const HapticsPulse& p) { return p.id == id; }
+                );
+                if (pulse == pulses + pulseCount) {
+                    *pulse = { id, 0.0f, 0.0f, 0.0f };
+                    pulseCount++;
+                }
+                pulse->duration_s = std::max(pulse->duration_s, haptics.fDurationSeconds);
+                pulse->frequency = haptics.fFrequency;
+                pulse->amplitude = std::max(pulse->amplitude, haptics.fAmplitude);
             }
 #ifdef __linux__
             else if (event.eventType == vr::VREvent_ChaperoneUniverseHasChanged
@@ -156,15 +207,24 @@ public:
                      || event.eventType == vr::VREvent_StandingZeroPoseReset
                      || event.eventType == vr::VREvent_SceneApplicationChanged
                      || event.eventType == VendorEvent_ALVRDriverResync) {
-                if (hmd && hmd->m_poseHistory) {
-                    auto rawZeroPose = GetRawZeroPose();
-                    if (rawZeroPose != nullptr) {
-                        hmd->m_poseHistory->SetTransform(*rawZeroPose);
-                    }
-                }
+                RequestZeroPoseRefresh();
             }
 #endif
         }
+#ifdef __linux__
+        // Read by the chaperone worker, applied on the first frame after it is published
+        vr::HmdMatrix34_t invZeroPose;
+        if (hmd && hmd->m_poseHistory
+            && TakeInvZeroPose(invZeroPose.m, this->zero_pose_generation)) {
+            hmd->m_poseHistory->SetTransform(vrmath::matInv33(invZeroPose));
+        }
+#endif
+        for (int i = 0; i < pulseCount; i++) {
+            HapticsSend(
+                pulses[i].id, pulses[i].duration_s, pulses[i].frequency, pulses[i].amplitude
+            );
+        }
+
         if (vr::VRServerDriverHost()->IsExiting() && !shutdown_called) {
             Debug("DriverProvider: Received shutdown event");
 
@@ -189,6 +249,8 @@ const unsigned char* COMPRESS_AXIS_ALIGNED_CSO_PTR;
 unsigned int COMPRESS_AXIS_ALIGNED_CSO_LEN;
 const unsigned char* COLOR_CORRECTION_CSO_PTR;
 unsigned int COLOR_CORRECTION_CSO_LEN;
+const unsigned char* COLOR_CORRECTION_UNSHARPENED_CSO_PTR;
+unsigned int COLOR_CORRECTION_UNSHARPENED_CSO_LEN;
 const unsigned char* RGBTOYUV420_CSO_PTR;
 unsigned int RGBTOYUV420_CSO_LEN;
 
@@ -213,11 +275,26 @@ void (*LogPeriodically)(const char* tag, const char* stringPtr);
 void (*DriverReadyIdle)(bool setDefaultChaprone);
 void (*SetVideoConfigNals)(const unsigned char* configBuffer, int len, int codec);
 void (*VideoSend)(unsigned long long targetTimestampNs, unsigned char* buf, int len, bool isIdr);
+void (*VideoSendLeased)(
+    unsigned long long targetTimestampNs,
+    unsigned char* buf,
+    int len,
+    bool isIdr,
+    unsigned long long leaseId
+);
+void (*VideoSendSlice)(
+    unsigned long long targetTimestampNs,
+    unsigned char* buf,
+    int len,
+    bool isIdr,
+    bool isLastSlice
+);
 void (*HapticsSend)(unsigned long long path, float duration_s, float frequency, float amplitude);
 void (*ShutdownRuntime)();
 unsigned long long (*PathStringToHash)(const char* path);
 void (*ReportPresent)(unsigned long long timestamp_ns, unsigned long long offset_ns);
 void (*ReportComposed)(unsigned long long timestamp_ns, unsigned long long offset_ns);
+void (*ReportReprojection)(unsigned long long timestamp_ns, FfiQuat rotationDelta);
 FfiDynamicEncoderParams (*GetDynamicEncoderParams)();
 unsigned long long (*GetSerialNumber)(unsigned long long deviceID, char* outString);
 void (*SetOpenvrProps)(void* instancePtr, unsigned long long deviceID);
@@ -228,11 +305,13 @@ void CppInit(bool earlyHmdInitialization) {
     g_driver_provider.early_hmd_initialization = earlyHmdInitialization;
 
     HookCrashHandler();
+    StartLogWorker();
 
     // Initialize path constants
     init_paths();
 
     Settings::Instance().Load();
+    LogCpuFeatures();
 
     load_debug_privilege();
 }
@@ -249,6 +328,8 @@ void* CppOpenvrEntryPoint(const char* interface_name, int* return_code) {
 
 bool InitializeStreaming() {
     Settings::Instance().Load();
+    // The client may be a new one, it gets the parameter sets with the IDR of the stream start
+    ResendVideoConfig();
 
     if (!g_driver_provider.devices_initialized) {
         if (!g_driver_provider.early_hmd_initialization) {
@@ -258,109 +339,85 @@ bool InitializeStreaming() {
                 return false;
             }
             g_driver_provider.hmd = std::unique_ptr<Hmd>(hmd);
-            g_driver_provider.tracked_devices.insert({ HEAD_ID, g_driver_provider.hmd.get() });
+            g_driver_provider.add_device(HEAD_ID, g_driver_provider.hmd.get());
+        }
+
+        // The encoder is brought up while SteamVR activates the other devices
+        if (g_driver_provider.hmd) {
+            g_driver_provider.hmd->PrepareStreaming();
         }
 
-        // Note: for controllers, hands and trackers don't bail out if registration fails
+        // SteamVR activates each device in the background, all of them are added before waiting
+        // for any so that the activations overlap instead of taking up to a second each.
+        // Note: for controllers, hands and trackers don't bail out if registration fails. SteamVR
+        // keeps the pointer of a device it was given, so a failed one is not deleted.
+        std::vector<std::pair<TrackedDevice*, std::function<void()>>> pending;
+        auto add_pending = [&](TrackedDevice* device, std::function<void()> on_activated) {
+            if (device->register_device(false)) {
+                pending.push_back({ device, std::move(on_activated) });
+            }
+        };
+
         if (Settings::Instance().m_enableControllers) {
             auto controllerSkeletonLevel = Settings::Instance().m_useSeparateHandTrackers
                 ? vr::VRSkeletalTracking_Estimated
                 : vr::VRSkeletalTracking_Partial;
 
             auto left_controller = new Controller(HAND_LEFT_ID, controllerSkeletonLevel);
-            if (left_controller->register_device(true)) {
+            add_pending(left_controller, [=] {
                 g_driver_provider.left_controller = std::unique_ptr<Controller>(left_controller);
-                g_driver_provider.tracked_devices.insert(
-                    { HAND_LEFT_ID, g_driver_provider.left_controller.get() }
-                );
-            }
+                g_driver_provider.add_device(HAND_LEFT_ID, left_controller);
+            });
 
             auto right_controller = new Controller(HAND_RIGHT_ID, controllerSkeletonLevel);
-            if (right_controller->register_device(true)) {
+            add_pending(right_controller, [=] {
                 g_driver_provider.right_controller = std::unique_ptr<Controller>(right_controller);
-                g_driver_provider.tracked_devices.insert(
-                    { HAND_RIGHT_ID, g_driver_provider.right_controller.get() }
-                );
-            }
+                g_driver_provider.add_device(HAND_RIGHT_ID, right_controller);
+            });
 
             if (Settings::Instance().m_useSeparateHandTrackers) {
                 auto left_hand_tracker
                     = new Controller(HAND_TRACKER_LEFT_ID, vr::VRSkeletalTracking_Full);
-                if (left_hand_tracker->register_device(true)) {
+                add_pending(left_hand_tracker, [=] {
                     g_driver_provider.left_hand_tracker
                         = std::unique_ptr<Controller>(left_hand_tracker);
-                    g_driver_provider.tracked_devices.insert(
-                        { HAND_TRACKER_LEFT_ID, g_driver_provider.left_hand_tracker.get() }
-                    );
-                }
+                    g_driver_provider.add_device(HAND_TRACKER_LEFT_ID, left_hand_tracker);
+                });
 
                 auto right_hand_tracker
                     = new Controller(HAND_TRACKER_RIGHT_ID, vr::VRSkeletalTracking_Full);
-                if (right_hand_tracker->register_device(true)) {
+                add_pending(right_hand_tracker, [=] {
                     g_driver_provider.right_hand_tracker
                         = std::unique_ptr<Controller>(right_hand_tracker);
-                    g_driver_provider.tracked_devices.insert(
-                        { HAND_TRACKER_RIGHT_ID, g_driver_provider.right_hand_tracker.get() }
-                    );
-                }
+                    g_driver_provider.add_device(HAND_TRACKER_RIGHT_ID, right_hand_tracker);
+                });
             }
         }
 
+        // The body trackers are registered by SetTracking, with the first motion of each
         if (Settings::Instance().m_enableBodyTrackingFakeVive) {
-            auto chestTracker = std::make_unique<FakeViveTracker>(BODY_CHEST_ID);
-            if (chestTracker->register_device(true)) {
-                g_driver_provider.tracked_devices.insert({ BODY_CHEST_ID, chestTracker.get() });
-                g_driver_provider.generic_trackers.push_back(std::move(chestTracker));
-            }
+            auto& body_trackers = g_driver_provider.body_trackers;
+            body_trackers.SetActivatedCallback([](uint64_t id, FakeViveTracker* tracker) {
+                g_driver_provider.add_device(id, tracker);
+                g_driver_provider.generic_trackers.emplace_back(tracker);
+            });
 
-            auto waistTracker = std::make_unique<FakeViveTracker>(BODY_HIPS_ID);
-            if (waistTracker->register_device(true)) {
-                g_driver_provider.tracked_devices.insert({ BODY_HIPS_ID, waistTracker.get() });
-                g_driver_provider.generic_trackers.push_back(std::move(waistTracker));
-            }
-
-            auto leftElbowTracker = std::make_unique<FakeViveTracker>(BODY_LEFT_ELBOW_ID);
-            if (leftElbowTracker->register_device(true)) {
-                g_driver_provider.tracked_devices.insert({ BODY_LEFT_ELBOW_ID,
-                                                           leftElbowTracker.get() });
-                g_driver_provider.generic_trackers.push_back(std::move(leftElbowTracker));
-            }
-
-            auto rightElbowTracker = std::make_unique<FakeViveTracker>(BODY_RIGHT_ELBOW_ID);
-            if (rightElbowTracker->register_device(true)) {
-                g_driver_provider.tracked_devices.insert({ BODY_RIGHT_ELBOW_ID,
-                                                           rightElbowTracker.get() });
-                g_driver_provider.generic_trackers.push_back(std::move(rightElbowTracker));
-            }
+            body_trackers.AddTracker(BODY_CHEST_ID);
+            body_trackers.AddTracker(BODY_HIPS_ID);
+            body_trackers.AddTracker(BODY_LEFT_ELBOW_ID);
+            body_trackers.AddTracker(BODY_RIGHT_ELBOW_ID);
 
             if (Settings::Instance().m_bodyTrackingHasLegs) {
-                auto leftKneeTracker = std::make_unique<FakeViveTracker>(BODY_LEFT_KNEE_ID);
-                if (leftKneeTracker->register_device(true)) {
-                    g_driver_provider.tracked_devices.insert({ BODY_LEFT_KNEE_ID,
-                                                               leftKneeTracker.get() });
-                    g_driver_provider.generic_trackers.push_back(std::move(leftKneeTracker));
-                }
-
-                auto leftFootTracker = std::make_unique<FakeViveTracker>(BODY_LEFT_FOOT_ID);
-                if (leftFootTracker->register_device(true)) {
-                    g_driver_provider.tracked_devices.insert({ BODY_LEFT_FOOT_ID,
-                                                               leftFootTracker.get() });
-                    g_driver_provider.generic_trackers.push_back(std::move(leftFootTracker));
-                }
-
-                auto rightKneeTracker = std::make_unique<FakeViveTracker>(BODY_RIGHT_KNEE_ID);
-                if (rightKneeTracker->register_device(true)) {
-                    g_driver_provider.tracked_devices.insert({ BODY_RIGHT_KNEE_ID,
-                                                               rightKneeTracker.get() });
-                    g_driver_provider.generic_trackers.push_back(std::move(rightKneeTracker));
-                }
+                body_trackers.AddTracker(BODY_LEFT_KNEE_ID);
+                body_trackers.AddTracker(BODY_LEFT_FOOT_ID);
+                body_trackers.AddTracker(BODY_RIGHT_KNEE_ID);
+                body_trackers.AddTracker(BODY_RIGHT_FOOT_ID);
+            }
+        }
 
-                auto rightFootTracker = std::make_unique<FakeViveTracker>(BODY_RIGHT_FOOT_ID);
-                if (rightFootTracker->register_device(true)) {
-                    g_driver_provider.tracked_devices.insert({ BODY_RIGHT_FOOT_ID,
-                                                               rightFootTracker.get() });
-                    g_driver_provider.generic_trackers.push_back(std::move(rightFootTracker));
-                }
+        for (auto& [device, on_activated] : pending) {
+            if (device->wait_activation()) {
+                on_activated();
             }
         }
 
@@ -375,12 +432,43 @@ bool InitializeStreaming() {
 }
 
 void DeinitializeStreaming() {
+    VsyncTimingReset();
+    ClientClockReset();
     if (g_driver_provider.hmd) {
         g_driver_provider.hmd->StopStreaming();
     }
 }
 
-void SendVSync() { vr::VRServerDriverHost()->VsyncEvent(0.0); }
+void SendVSync() {
+    if (!Settings::Instance().m_vsyncLatencyCompensation) {
+        vr::VRServerDriverHost()->VsyncEvent(0.0);
+        return;
+    }
+
+    uint64_t nowNs = FrameTraceNow();
+    vr::VRServerDriverHost()->VsyncEvent(VsyncTimingOffsetSeconds(nowNs));
+
+    // The property is a hint for the pose prediction of the games, it is only updated once the
+    // latency moved noticeably
+    static uint64_t lastUpdateNs = 0;
+    static double reportedSeconds = 0;
+    const uint64_t UPDATE_INTERVAL_NS = 1'000'000'000;
+    const double UPDATE_THRESHOLD_S = 0.001;
+    if (nowNs - lastUpdateNs < UPDATE_INTERVAL_NS) {
+        return;
+    }
+    lastUpdateNs = nowNs;
+    double seconds = VsyncTimingToPhotonsSeconds();
+    if (g_driver_provider.hmd && seconds != 0
+        && std::abs(seconds - reportedSeconds) > UPDATE_THRESHOLD_S) {
+        vr::VRProperties()->SetFloatProperty(
+            g_driver_provider.hmd->prop_container,
+            vr::Prop_SecondsFromVsyncToPhotons_Float,
+            (float)seconds
+        );
+        reportedSeconds = seconds;
+    }
+}
 
 void RequestIDR() {
     if (g_driver_provider.hmd && g_driver_provider.hmd->m_encoder) {
@@ -388,6 +476,49 @@ void RequestIDR() {
     }
 }
 
+void InvalidateFrames(
+    unsigned long long firstTargetTimestampNs, unsigned long long lastTargetTimestampNs
+) {
+    if (g_driver_provider.hmd && g_driver_provider.hmd->m_encoder) {
+        g_driver_provider.hmd->m_encoder->InvalidateFrames(
+            firstTargetTimestampNs, lastTargetTimestampNs
+        );
+    }
+}
+
+void AcknowledgeFrame(unsigned long long targetTimestampNs) {
+    if (g_driver_provider.hmd && g_driver_provider.hmd->m_encoder) {
+        g_driver_provider.hmd->m_encoder->AcknowledgeFrame(targetTimestampNs);
+    }
+}
+
+void SetClientTiming(
+    unsigned long long vsyncNs,
+    unsigned long long vsyncPeriodNs,
+    long long serverToClientNs,
+    unsigned long long networkLatencyNs
+) {
+    // The pacing works on the filtered offset, the measured one jitters with the network
+    uint64_t nowNs = FrameTraceNow();
+    ClientClockAddOffset(nowNs, serverToClientNs, networkLatencyNs);
+    serverToClientNs = ClientClockServerToClientNs(nowNs);
+
+    VsyncTimingSetClient(vsyncNs, vsyncPeriodNs, serverToClientNs, networkLatencyNs);
+    FrameIncidentsSetClient(vsyncNs, vsyncPeriodNs, serverToClientNs, networkLatencyNs);
+    if (g_driver_provider.hmd && g_driver_provider.hmd->m_encoder) {
+        g_driver_provider.hmd->m_encoder->SetClientTiming(
+            vsyncNs, vsyncPeriodNs, serverToClientNs, networkLatencyNs
+        );
+    }
+}
+
+void SetClientDecodeTiming(
+    unsigned long long frameDecodeNs, unsigned long long sliceDecodeNs, unsigned int sliceCount
+) {
+    SetDecodeTiming(frameDecodeNs, sliceDecodeNs, sliceCount);
+    FrameIncidentsSetClientDecode(frameDecodeNs);
+}
+
 void SetTracking(
     unsigned long long targetTimestampNs,
     float controllerPoseTimeOffsetS,
@@ -397,6 +528,7 @@ void SetTracking(
     const FfiDeviceMotion* bodyTrackerMotions,
     int bodyTrackerMotionCount
 ) {
+    ALVR_TRACE_SCOPE("SetTracking");
     if (g_driver_provider.hmd) {
         g_driver_provider.hmd->OnPoseUpdated(targetTimestampNs, headMotion);
     }
@@ -426,22 +558,12 @@ void SetTracking(
     }
 
     if (Settings::Instance().m_enableBodyTrackingFakeVive) {
-        std::map<uint64_t, FfiDeviceMotion> motionsMap;
-        for (int i = 0; i < bodyTrackerMotionCount; i++) {
-            auto m = bodyTrackerMotions[i];
-            motionsMap.insert({ m.deviceID, m });
-        }
-
-        for (auto id : BODY_IDS) {
-            auto it = g_driver_provider.tracked_devices.find(id);
-            if (it != g_driver_provider.tracked_devices.end()) {
-                auto* maybeTracker = (FakeViveTracker*)it->second;
-                auto res = motionsMap.find(id);
-                auto* maybeMotion = res != motionsMap.end() ? &res->second : nullptr;
-
-                maybeTracker->OnPoseUpdated(targetTimestampNs, maybeMotion);
-            }
-        }
+        g_driver_provider.body_trackers.OnPoseUpdated(
+            targetTimestampNs,
+            controllerPoseTimeOffsetS,
+            bodyTrackerMotions,
+            bodyTrackerMotionCount
+        );
     }
 }
 
@@ -453,6 +575,8 @@ void RequestDriverResync() {
     }
 }
 
+void ReloadSettings() { Settings::Instance().Reload(); }
+
 void ShutdownSteamvr() {
     if (g_driver_provider.hmd) {
         vr::VRServerDriverHost()->VendorSpecificEvent(
@@ -466,10 +590,10 @@ void SetOpenvrProperty(void* instancePtr, FfiOpenvrProperty prop) {
 }
 
 void SetOpenvrPropByDeviceID(unsigned long long deviceID, FfiOpenvrProperty prop) {
-    auto device_it = g_driver_provider.tracked_devices.find(deviceID);
+    auto device = g_driver_provider.find_device(deviceID);
 
-    if (device_it != g_driver_provider.tracked_devices.end()) {
-        device_it->second->set_prop(prop);
+    if (device) {
+        device->set_prop(prop);
     }
 }
 
@@ -485,28 +609,37 @@ void SetLocalViewParams(const FfiViewParams params[2]) {
 }
 
 void SetBattery(unsigned long long deviceID, float gauge_value, bool is_plugged) {
-    auto device_it = g_driver_provider.tracked_devices.find(deviceID);
-
-    if (device_it != g_driver_provider.tracked_devices.end()) {
-        vr::VRProperties()->SetFloatProperty(
-            device_it->second->prop_container, vr::Prop_DeviceBatteryPercentage_Float, gauge_value
-        );
-        vr::VRProperties()->SetBoolProperty(
-            device_it->second->prop_container, vr::Prop_DeviceIsCharging_Bool, is_plugged
-        );
+    auto device = g_driver_provider.find_device(deviceID);
+
+    if (device) {
+        // Sent with every battery report of the client, most of them don't change anything
+        auto gauge = FfiOpenvrProperty {};
+        gauge.key = vr::Prop_DeviceBatteryPercentage_Float;
+        gauge.type = FfiOpenvrPropertyType::Float;
+        gauge.value.float_ = gauge_value;
+        device->set_prop(gauge, false);
+
+        auto charging = FfiOpenvrProperty {};
+        charging.key = vr::Prop_DeviceIsCharging_Bool;
+        charging.type = FfiOpenvrPropertyType::Bool;
+        charging.value.bool_ = is_plugged;
+        device->set_prop(charging, false);
     }
 }
 
 void SetButton(unsigned long long buttonID, FfiButtonValue value) {
-    if (LEFT_CONTROLLER_BUTTON_MAPPING.find(buttonID) != LEFT_CONTROLLER_BUTTON_MAPPING.end()) {
+    const ButtonSlot* button = FindButton(buttonID);
+    if (!button) {
+        return;
+    }
+    if (button->left) {
         if (g_driver_provider.left_controller) {
             g_driver_provider.left_controller->SetButton(buttonID, value);
         }
         if (g_driver_provider.left_hand_tracker) {
             g_driver_provider.left_hand_tracker->SetButton(buttonID, value);
         }
-    } else if (RIGHT_CONTROLLER_BUTTON_MAPPING.find(buttonID)
-               != RIGHT_CONTROLLER_BUTTON_MAPPING.end()) {
+    } else {
         if (g_driver_provider.right_controller) {
             g_driver_provider.right_controller->SetButton(buttonID, value);
         }
@@ -516,6 +649,12 @@ void SetButton(unsigned long long buttonID, FfiButtonValue value) {
     }
 }
 
+void SetButtons(const FfiButtonEntry* entries, int count) {
+    for (int i = 0; i < count; i++) {
+        SetButton(entries[i].id, entries[i].value);
+    }
+}
+
 void SetProximityState(bool headset_is_worn) {
     if (g_driver_provider.hmd) {
         g_driver_provider.hmd->SetProximityState(headset_is_worn);
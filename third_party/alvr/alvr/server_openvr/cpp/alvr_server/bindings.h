@@ -85,6 +85,160 @@ struct FfiButtonValue {
     };
 };
 
+struct FfiButtonEntry {
+    unsigned long long id;
+    FfiButtonValue value;
+};
+
+enum FfiFrameTraceStage {
+    FRAME_TRACE_IPC_RECEIVE,
+    FRAME_TRACE_POSE_MATCH,
+    FRAME_TRACE_RENDER_BEGIN,
+    FRAME_TRACE_RENDER_END,
+    FRAME_TRACE_FORMAT_CONVERT,
+    FRAME_TRACE_ENCODE_SUBMIT,
+    FRAME_TRACE_ENCODE_COMPLETE,
+    FRAME_TRACE_NAL_PARSE,
+    FRAME_TRACE_VIDEO_SEND,
+    FRAME_TRACE_STAGE_COUNT,
+};
+
+// Time at which each stage of a frame ended, in steady clock nanoseconds, 0 if not recorded
+struct FfiFrameTrace {
+    unsigned long long targetTimestampNs;
+    unsigned long long stageNs[FRAME_TRACE_STAGE_COUNT];
+};
+
+// What made a frame miss its display slot on the client, or made the encoder drop presents. Each
+// is the stage that took the longest beyond its usual time, see FrameIncidents.h.
+enum FfiFrameIncidentCause {
+    // The present reached the driver later than usual after a refresh without a new game frame
+    FRAME_INCIDENT_GAME_LATE,
+    // The present reached the driver later than usual with the game on time
+    FRAME_INCIDENT_COMPOSITOR_LATE,
+    // The compositor passes of the driver, foveation included, and the conversion to the
+    // encoder input
+    FRAME_INCIDENT_CONVERT_OVER_BUDGET,
+    FRAME_INCIDENT_ENCODER_OVER_BUDGET,
+    // From the bitstream out of the encoder to VideoSend returning, and the transport time the
+    // client measures
+    FRAME_INCIDENT_SEND_BACKPRESSURE,
+    FRAME_INCIDENT_CLIENT_DECODE_LATE,
+    FRAME_INCIDENT_CAUSE_COUNT,
+};
+
+struct FfiFrameIncident {
+    // Of the late frame, or of the last frame sent before the dropped presents
+    unsigned long long targetTimestampNs;
+    // When it was classified, in the frame trace clock
+    unsigned long long timeNs;
+    FfiFrameIncidentCause cause;
+    // Refreshes after its display slot the frame reached the client, 0 for dropped presents
+    unsigned int lateSlots;
+    // Presents superseded before the encoder took them, 0 for a late frame
+    unsigned int droppedPresents;
+    // Time the cause took beyond its usual time
+    unsigned long long excessNs;
+    // The stages of the frame, as in FfiFrameTrace
+    unsigned long long stageNs[FRAME_TRACE_STAGE_COUNT];
+};
+
+// GPU passes of the compositor, timed with GPU timestamp queries. The Linux renderer runs the
+// custom shaders as passes of their own; the Windows one converts to YUV in a pass and copies its
+// output into the encoder input.
+enum FfiGpuPass {
+    GPU_PASS_LAYERS,
+    GPU_PASS_COLOR_CORRECTION,
+    GPU_PASS_FOVEATION,
+    GPU_PASS_CUSTOM_SHADER,
+    GPU_PASS_YUV_CONVERT,
+    GPU_PASS_ENCODER_COPY,
+    GPU_PASS_COUNT,
+};
+
+enum FfiGpuPassHistogramLayout {
+    GPU_PASS_HISTOGRAM_BUCKETS = 16,
+};
+
+// Bucket 0 counts the passes under 1 us, bucket i those from 2^(i-1) up to 2^i us, the last bucket
+// also counts all the longer ones
+struct FfiGpuPassHistogram {
+    unsigned long long count;
+    unsigned long long totalNs;
+    unsigned long long maxNs;
+    unsigned int buckets[GPU_PASS_HISTOGRAM_BUCKETS];
+};
+
+// Counters of the driver, see GetDriverMetrics. They only grow, from the start of the driver.
+enum FfiDriverCounter {
+    // Frames and bytes handed to the transport, and the IDR frames among them
+    DRIVER_COUNTER_FRAMES_SENT,
+    DRIVER_COUNTER_BYTES_SENT,
+    DRIVER_COUNTER_IDR_FRAMES_SENT,
+    // IDR frames inserted for each IDRScheduler reason, an IDR can have several
+    DRIVER_COUNTER_IDR_LOSS,
+    DRIVER_COUNTER_IDR_STREAM_START,
+    DRIVER_COUNTER_IDR_RESOLUTION_CHANGE,
+    DRIVER_COUNTER_IDR_REQUEST,
+    DRIVER_COUNTER_IDR_RESUME,
+    // Frames the pacer skipped before encoding them, and presents superseded by a newer one
+    // before the encoder took them
+    DRIVER_COUNTER_FRAMES_SKIPPED,
+    DRIVER_COUNTER_PRESENTS_DROPPED,
+    // Frames late on the client and drops of presents, by FfiFrameIncidentCause. Counted once the
+    // metrics or the incidents are read.
+    DRIVER_COUNTER_INCIDENT_GAME_LATE,
+    DRIVER_COUNTER_INCIDENT_COMPOSITOR_LATE,
+    DRIVER_COUNTER_INCIDENT_CONVERT_OVER_BUDGET,
+    DRIVER_COUNTER_INCIDENT_ENCODER_OVER_BUDGET,
+    DRIVER_COUNTER_INCIDENT_SEND_BACKPRESSURE,
+    DRIVER_COUNTER_INCIDENT_CLIENT_DECODE_LATE,
+    DRIVER_COUNTER_COUNT,
+};
+
+// Current values, see GetDriverMetrics
+enum FfiDriverGauge {
+    DRIVER_GAUGE_TARGET_BITRATE_BPS,
+    // Factor applied to the target bitrate for the encoder to hit it, 1 without calibration
+    DRIVER_GAUGE_BITRATE_CORRECTION,
+    // Frames submitted to the encoder and not sent yet
+    DRIVER_GAUGE_ENCODE_QUEUE_DEPTH,
+    // Hardware encoder sessions this instance holds under encoder_session_limit
+    DRIVER_GAUGE_ENCODER_SESSIONS,
+    // Video memory this process uses on the GPU of the encoder and the budget the OS gives it,
+    // 0 if the driver doesn't tell
+    DRIVER_GAUGE_VRAM_USAGE_BYTES,
+    DRIVER_GAUGE_VRAM_BUDGET_BYTES,
+    // Share of the last second each GPU engine class ran work of this process, see
+    // GpuEngineUsage.h. Summed over the engines of the class, so it can exceed 1. -1 when neither
+    // the OS nor NVML tells.
+    DRIVER_GAUGE_GPU_3D_BUSY,
+    DRIVER_GAUGE_GPU_COMPUTE_BUSY,
+    DRIVER_GAUGE_GPU_COPY_BUSY,
+    DRIVER_GAUGE_GPU_VIDEO_ENCODE_BUSY,
+    DRIVER_GAUGE_GPU_VIDEO_DECODE_BUSY,
+    // Share of the same second taken by the compositor passes timed with GPU queries, the part of
+    // the 3D engine time the driver accounts for
+    DRIVER_GAUGE_GPU_PASS_BUSY,
+    // NVML encoder utilization of the whole GPU, all processes included, -1 without NVML
+    DRIVER_GAUGE_GPU_ENCODER_UTILIZATION,
+    DRIVER_GAUGE_COUNT,
+};
+
+// Everything is cumulative, like the OpenMetrics counters and histograms. The histograms have the
+// buckets of FfiGpuPassHistogram.
+struct FfiDriverMetrics {
+    unsigned long long counters[DRIVER_COUNTER_COUNT];
+    double gauges[DRIVER_GAUGE_COUNT];
+    // Time from encode submission to the bitstream being sent
+    unsigned long long encodeCount;
+    unsigned long long encodeTotalNs;
+    unsigned long long encodeBuckets[GPU_PASS_HISTOGRAM_BUCKETS];
+    unsigned long long gpuPassCount[GPU_PASS_COUNT];
+    unsigned long long gpuPassTotalNs[GPU_PASS_COUNT];
+    unsigned long long gpuPassBuckets[GPU_PASS_COUNT][GPU_PASS_HISTOGRAM_BUCKETS];
+};
+
 struct FfiDynamicEncoderParams {
     unsigned int updated;
     unsigned long long bitrate_bps;
@@ -101,6 +255,8 @@ extern "C" const unsigned char* COMPRESS_AXIS_ALIGNED_CSO_PTR;
 extern "C" unsigned int COMPRESS_AXIS_ALIGNED_CSO_LEN;
 extern "C" const unsigned char* COLOR_CORRECTION_CSO_PTR;
 extern "C" unsigned int COLOR_CORRECTION_CSO_LEN;
+extern "C" const unsigned char* COLOR_CORRECTION_UNSHARPENED_CSO_PTR;
+extern "C" unsigned int COLOR_CORRECTION_UNSHARPENED_CSO_LEN;
 extern "C" const unsigned char* RGBTOYUV420_CSO_PTR;
 extern "C" unsigned int RGBTOYUV420_CSO_LEN;
 
@@ -124,9 +280,29 @@ extern "C" void (*LogEncoder)(const char* stringPtr);
 extern "C" void (*LogPeriodically)(const char* tag, const char* stringPtr);
 extern "C" void (*DriverReadyIdle)(bool setDefaultChaprone);
 extern "C" void (*SetVideoConfigNals)(const unsigned char* configBuffer, int len, int codec);
+// Copies the frame and queues it for the transport, it is sent after this returns
+// With nvenc_stereo_interleave a frame is two pictures, the left then the right eye, each sent
+// in its own call with the frame timestamp
 extern "C" void (*VideoSend)(
     unsigned long long targetTimestampNs, unsigned char* buf, int len, bool isIdr
 );
+// Same as VideoSend, but the buffer stays owned by the encoder until ReleaseVideoBuffer(leaseId)
+extern "C" void (*VideoSendLeased)(
+    unsigned long long targetTimestampNs,
+    unsigned char* buf,
+    int len,
+    bool isIdr,
+    unsigned long long leaseId
+);
+// Sends one or more slices of an encoded frame. The last call for a frame has isLastSlice set. Only
+// used when slice output is enabled, see SliceOutputEnabled()
+extern "C" void (*VideoSendSlice)(
+    unsigned long long targetTimestampNs,
+    unsigned char* buf,
+    int len,
+    bool isIdr,
+    bool isLastSlice
+);
 extern "C" void (*HapticsSend)(
     unsigned long long path, float duration_s, float frequency, float amplitude
 );
@@ -134,6 +310,9 @@ extern "C" void (*ShutdownRuntime)();
 extern "C" unsigned long long (*PathStringToHash)(const char* path);
 extern "C" void (*ReportPresent)(unsigned long long timestamp_ns, unsigned long long offset_ns);
 extern "C" void (*ReportComposed)(unsigned long long timestamp_ns, unsigned long long offset_ns);
+// Rotation the frame was reprojected by after the game rendered it, see late_latch_reprojection.
+// Optional, late latching stays off if it is not set.
+extern "C" void (*ReportReprojection)(unsigned long long timestamp_ns, FfiQuat rotationDelta);
 extern "C" FfiDynamicEncoderParams (*GetDynamicEncoderParams)();
 extern "C" unsigned long long (*GetSerialNumber)(unsigned long long deviceID, char* outString);
 extern "C" void (*SetOpenvrProps)(void* instancePtr, unsigned long long deviceID);
@@ -146,6 +325,31 @@ extern "C" bool InitializeStreaming();
 extern "C" void DeinitializeStreaming();
 extern "C" void SendVSync();
 extern "C" void RequestIDR();
+// The client lost the frames with target timestamps from firstTargetTimestampNs to
+// lastTargetTimestampNs. Encoders that support it predict the next frames from the last frame
+// before them instead of sending an IDR.
+extern "C" void InvalidateFrames(
+    unsigned long long firstTargetTimestampNs, unsigned long long lastTargetTimestampNs
+);
+// The client decoded the frame with this target timestamp. Acknowledged long-term references are
+// used to recover from losses without an IDR.
+extern "C" void AcknowledgeFrame(unsigned long long targetTimestampNs);
+// Display timing of the client, for the encoder frame pacing. vsyncNs is the time of any client
+// vsync in the clock of the target timestamps and serverToClientNs converts the frame trace clock
+// to it, measured again with each call: the driver filters it and tracks the drift between the
+// clocks. networkLatencyNs is the transport and decode time of the recent frames. Frames that would
+// reach the client later than usual after their display slot are skipped before encoding.
+extern "C" void SetClientTiming(
+    unsigned long long vsyncNs,
+    unsigned long long vsyncPeriodNs,
+    long long serverToClientNs,
+    unsigned long long networkLatencyNs
+);
+// Decode time of the recent frames on the client, and of their slices when it decodes sliceCount
+// > 1 slices separately, see encoder_decode_feedback.
+extern "C" void SetClientDecodeTiming(
+    unsigned long long frameDecodeNs, unsigned long long sliceDecodeNs, unsigned int sliceCount
+);
 extern "C" void SetTracking(
     unsigned long long targetTimestampNs,
     float controllerPoseTimeOffsetS,
@@ -156,6 +360,9 @@ extern "C" void SetTracking(
     int bodyTrackerMotionCount
 );
 extern "C" void RequestDriverResync();
+// The session was saved with new values. Settings that can change while streaming are applied, the
+// others keep their value until SteamVR restarts.
+extern "C" void ReloadSettings();
 extern "C" void ShutdownSteamvr();
 
 extern "C" void SetOpenvrProperty(void* instancePtr, FfiOpenvrProperty prop);
@@ -164,6 +371,8 @@ extern "C" void RegisterButton(void* instancePtr, unsigned long long buttonID);
 extern "C" void SetLocalViewParams(const FfiViewParams params[2]);
 extern "C" void SetBattery(unsigned long long deviceID, float gauge_value, bool is_plugged);
 extern "C" void SetButton(unsigned long long buttonID, FfiButtonValue value);
+// The button changes of one input packet, applied in order with a single crossing of the FFI
+extern "C" void SetButtons(const FfiButtonEntry* entries, int count);
 extern "C" void SetProximityState(bool headset_is_worn);
 
 extern "C" void InitOpenvrClient();
@@ -172,10 +381,57 @@ extern "C" void SetChaperoneArea(float areaWidth, float areaHeight);
 
 extern "C" void CaptureFrame();
 
+extern "C" void ReleaseVideoBuffer(unsigned long long leaseId);
+
+// Copies up to maxCount completed frame traces into out and returns how many were copied. Tracing
+// starts with the first call.
+extern "C" unsigned int DrainFrameTraces(FfiFrameTrace* out, unsigned int maxCount);
+// Copies up to maxCount of the most recent frame incidents into out, oldest first, and returns how
+// many were copied. They are kept in a ring and not consumed, the classification starts with the
+// first call or with GetDriverMetrics.
+extern "C" unsigned int GetFrameIncidents(FfiFrameIncident* out, unsigned int maxCount);
+
+// Fills out[GPU_PASS_COUNT] with the GPU time of each pass since the previous call. The passes are
+// timed from the first call on; a frame is counted once its queries are ready, which can be a few
+// frames late.
+extern "C" void GetGpuPassHistograms(FfiGpuPassHistogram* out);
+
+// Snapshot of the driver counters, gauges and histograms, for the transport to export. Cheap
+// enough to be called on every scrape. The GPU passes are timed from the first call on, like with
+// GetGpuPassHistograms.
+extern "C" void GetDriverMetrics(FfiDriverMetrics* out);
+
+// Eye tracking gaze for the encoder ROI, as normalized coordinates of each eye half of the encoded
+// frame (0, 0 top left). Values outside [0, 1] clear it, the gaze also expires after 500 ms.
+extern "C" void SetEncoderGaze(float leftX, float leftY, float rightX, float rightY);
+
+// Maximum size in bytes of the next encoded frames, set by the congestion controller. Encoders cap
+// their rate control buffer to it from the next frame on, instead of waiting for the bitrate of
+// GetDynamicEncoderParams to drain it. 0 clears it, it also expires after 1 s.
+extern "C" void SetEncoderFrameBudget(unsigned int maxFrameBytes);
+
 // NalParsing.cpp
 void ParseFrameNals(
     int codec, unsigned char* buf, int len, unsigned long long targetTimestampNs, bool isIdr
 );
+bool PrepareFrameNals(int codec, unsigned char*& buf, int& len);
+// The next parameter sets are sent even if unchanged, for a new client
+void ResendVideoConfig();
+bool SliceOutputEnabled();
+void ParseSliceNals(
+    int codec,
+    unsigned char* buf,
+    int len,
+    unsigned long long targetTimestampNs,
+    bool isIdr,
+    bool isFirstSlice,
+    bool isLastSlice
+);
+// Sends a whole encoded frame one slice (AV1 tile group) per VideoSendSlice call, for the encoders
+// that don't output their slices separately.
+void ParseFrameSliceNals(
+    int codec, unsigned char* buf, int len, unsigned long long targetTimestampNs, bool isIdr
+);
 
 // CrashHandler.cpp
 void HookCrashHandler();
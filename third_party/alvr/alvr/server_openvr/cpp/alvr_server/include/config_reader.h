@@ -0,0 +1,375 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+// Single pass reader for the session JSON. Members of one top level object are handed to a visitor
+// as views into the source text, without building a document. Only string values are copied, when
+// they are read into a std::string. Header only, it is shared with the compositor shim.
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace config_reader {
+
+class Value {
+public:
+    enum Type { Null, Bool, Number, String, Object, Array };
+
+    Value(Type type, std::string_view raw)
+        : m_type(type)
+        , m_raw(raw) { }
+
+    Type type() const { return m_type; }
+
+    // Converts to the type of `out`. Returns false, leaving `out` untouched, if the JSON type
+    // doesn't match. Integers only accept numbers without fraction or exponent.
+    template <typename T> bool Get(T& out) const {
+        if constexpr (std::is_same_v<T, bool>) {
+            if (m_type != Bool) {
+                return false;
+            }
+            out = m_raw == "true";
+            return true;
+        } else if constexpr (std::is_integral_v<T>) {
+            int64_t value;
+            if (!ParseInt(value)) {
+                return false;
+            }
+            out = (T)value;
+            return true;
+        } else if constexpr (std::is_floating_point_v<T>) {
+            double value;
+            if (!ParseDouble(value)) {
+                return false;
+            }
+            out = (T)value;
+            return true;
+        } else {
+            static_assert(std::is_same_v<T, std::string>, "unsupported config type");
+            if (m_type != String) {
+                return false;
+            }
+            return Unescape(out);
+        }
+    }
+
+private:
+    bool ParseInt(int64_t& out) const {
+        if (m_type != Number) {
+            return false;
+        }
+        size_t pos = m_raw[0] == '-' ? 1 : 0;
+        uint64_t magnitude = 0;
+        for (; pos < m_raw.size(); pos++) {
+            char c = m_raw[pos];
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            magnitude = magnitude * 10 + (uint64_t)(c - '0');
+        }
+        out = m_raw[0] == '-' ? -(int64_t)magnitude : (int64_t)magnitude;
+        return true;
+    }
+
+    bool ParseDouble(double& out) const {
+        char buffer[64];
+        if (m_type != Number || m_raw.size() >= sizeof(buffer)) {
+            return false;
+        }
+        m_raw.copy(buffer, m_raw.size());
+        buffer[m_raw.size()] = '\0';
+        out = strtod(buffer, nullptr);
+        return true;
+    }
+
+    static int HexDigit(char c) {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    static bool ParseHex4(std::string_view text, size_t pos, uint32_t& out) {
+        if (pos + 4 > text.size()) {
+            return false;
+        }
+        out = 0;
+        for (size_t i = pos; i < pos + 4; i++) {
+            int digit = HexDigit(text[i]);
+            if (digit < 0) {
+                return false;
+            }
+            out = out << 4 | (uint32_t)digit;
+        }
+        return true;
+    }
+
+    static void AppendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += (char)code;
+        } else if (code < 0x800) {
+            out += (char)(0xC0 | code >> 6);
+            out += (char)(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += (char)(0xE0 | code >> 12);
+            out += (char)(0x80 | (code >> 6 & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        } else {
+            out += (char)(0xF0 | code >> 18);
+            out += (char)(0x80 | (code >> 12 & 0x3F));
+            out += (char)(0x80 | (code >> 6 & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool Unescape(std::string& out) const {
+        std::string result;
+        result.reserve(m_raw.size());
+        for (size_t pos = 0; pos < m_raw.size(); pos++) {
+            char c = m_raw[pos];
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (++pos == m_raw.size()) {
+                return false;
+            }
+            switch (m_raw[pos]) {
+            case '"':
+            case '\\':
+            case '/':
+                result += m_raw[pos];
+                break;
+            case 'b':
+                result += '\b';
+                break;
+            case 'f':
+                result += '\f';
+                break;
+            case 'n':
+                result += '\n';
+                break;
+            case 'r':
+                result += '\r';
+                break;
+            case 't':
+                result += '\t';
+                break;
+            case 'u': {
+                uint32_t code;
+                if (!ParseHex4(m_raw, pos + 1, code)) {
+                    return false;
+                }
+                pos += 4;
+                // Characters outside the BMP are written as a surrogate pair
+                uint32_t low;
+                if (code >= 0xD800 && code < 0xDC00 && pos + 2 < m_raw.size()
+                    && m_raw[pos + 1] == '\\' && m_raw[pos + 2] == 'u'
+                    && ParseHex4(m_raw, pos + 3, low) && low >= 0xDC00 && low < 0xE000) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    pos += 6;
+                }
+                AppendUtf8(result, code);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        out = std::move(result);
+        return true;
+    }
+
+    Type m_type;
+    // Text of the value. Strings without their quotes and still escaped.
+    std::string_view m_raw;
+};
+
+class Reader {
+public:
+    explicit Reader(std::string_view json)
+        : m_json(json) { }
+
+    // Calls visit(std::string_view key, const Value& value) for each member of the top level
+    // object member `object`. Nested objects and arrays are passed with their raw text. Returns
+    // false if `object` is missing or the text is not valid JSON, see Error().
+    template <typename Visit> bool ForEachMember(std::string_view object, Visit&& visit) {
+        m_pos = 0;
+        m_error = nullptr;
+        bool found = false;
+        bool ok = ParseObject([&](std::string_view key) {
+            if (found || key != object) {
+                return SkipValue();
+            }
+            found = true;
+            SkipWhitespace();
+            if (Peek() != '{') {
+                return Fail("not an object");
+            }
+            return ParseObject([&](std::string_view member) {
+                size_t begin;
+                Value::Type type;
+                if (!ScanValue(begin, type)) {
+                    return false;
+                }
+                std::string_view raw = m_json.substr(begin, m_pos - begin);
+                if (type == Value::String) {
+                    raw = raw.substr(1, raw.size() - 2);
+                }
+                visit(member, Value(type, raw));
+                return true;
+            });
+        });
+        if (ok && !found) {
+            return Fail("object not found");
+        }
+        return ok;
+    }
+
+    const char* Error() const { return m_error ? m_error : ""; }
+    size_t ErrorOffset() const { return m_pos; }
+
+private:
+    bool Fail(const char* error) {
+        m_error = error;
+        return false;
+    }
+
+    char Peek() const { return m_pos < m_json.size() ? m_json[m_pos] : '\0'; }
+
+    void SkipWhitespace() {
+        while (m_pos < m_json.size()
+               && (m_json[m_pos] == ' ' || m_json[m_pos] == '\t' || m_json[m_pos] == '\n'
+                   || m_json[m_pos] == '\r')) {
+            m_pos++;
+        }
+    }
+
+    bool Expect(char c) {
+        SkipWhitespace();
+        if (Peek() != c) {
+            return Fail("unexpected character");
+        }
+        m_pos++;
+        return true;
+    }
+
+    // Leaves m_pos after the closing quote
+    bool ScanString(std::string_view& contents) {
+        if (!Expect('"')) {
+            return false;
+        }
+        size_t begin = m_pos;
+        while (m_pos < m_json.size() && m_json[m_pos] != '"') {
+            if (m_json[m_pos] == '\\') {
+                m_pos++;
+            }
+            m_pos++;
+        }
+        if (m_pos >= m_json.size()) {
+            return Fail("unterminated string");
+        }
+        contents = m_json.substr(begin, m_pos - begin);
+        m_pos++;
+        return true;
+    }
+
+    // Calls member(key) with m_pos on the value of each member, which it has to consume
+    template <typename Member> bool ParseObject(Member&& member) {
+        if (!Expect('{')) {
+            return false;
+        }
+        SkipWhitespace();
+        if (Peek() == '}') {
+            m_pos++;
+            return true;
+        }
+        while (true) {
+            std::string_view key;
+            if (!ScanString(key) || !Expect(':') || !member(key)) {
+                return false;
+            }
+            SkipWhitespace();
+            if (Peek() == ',') {
+                m_pos++;
+            } else {
+                return Expect('}');
+            }
+        }
+    }
+
+    bool SkipValue() {
+        size_t begin;
+        Value::Type type;
+        return ScanValue(begin, type);
+    }
+
+    // Moves m_pos past the next value. Objects and arrays are skipped by counting brackets, their
+    // contents are only checked as far as strings go.
+    bool ScanValue(size_t& begin, Value::Type& type) {
+        SkipWhitespace();
+        begin = m_pos;
+        char c = Peek();
+        if (c == '"') {
+            std::string_view contents;
+            type = Value::String;
+            return ScanString(contents);
+        }
+        if (c == '{' || c == '[') {
+            type = c == '{' ? Value::Object : Value::Array;
+            int depth = 0;
+            do {
+                c = Peek();
+                if (c == '"') {
+                    std::string_view contents;
+                    if (!ScanString(contents)) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (c == '\0') {
+                    return Fail("unterminated object");
+                }
+                if (c == '{' || c == '[') {
+                    depth++;
+                } else if (c == '}' || c == ']') {
+                    depth--;
+                }
+                m_pos++;
+            } while (depth > 0);
+            return true;
+        }
+        for (auto literal : { "true", "false", "null" }) {
+            if (m_json.substr(m_pos).rfind(literal, 0) == 0) {
+                type = literal[0] == 'n' ? Value::Null : Value::Bool;
+                m_pos += std::char_traits<char>::length(literal);
+                return true;
+            }
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            type = Value::Number;
+            m_pos++;
+            while (m_pos < m_json.size()
+                   && ((m_json[m_pos] >= '0' && m_json[m_pos] <= '9') || m_json[m_pos] == '.'
+                       || m_json[m_pos] == 'e' || m_json[m_pos] == 'E' || m_json[m_pos] == '+'
+                       || m_json[m_pos] == '-')) {
+                m_pos++;
+            }
+            return true;
+        }
+        return Fail("unexpected character");
+    }
+
+    std::string_view m_json;
+    size_t m_pos = 0;
+    const char* m_error = nullptr;
+};
+
+} // namespace config_reader
@@ -0,0 +1,38 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+// Settings of the compositor shim, precomputed by the driver and written as a flat block next to
+// the session file. The shim maps it when it is loaded into vrcompositor, so nothing is parsed
+// once the compositor asks for the lease. Header only, it is shared with the compositor shim.
+
+#include <cstdint>
+
+namespace drm_lease_config {
+
+inline constexpr uint32_t MAGIC = 0x4c445641; // "AVDL"
+inline constexpr uint32_t VERSION = 1;
+inline constexpr const char* FILE_NAME = "drm_lease_shim.bin";
+// Set by the vrcompositor wrapper to the path of the file
+inline constexpr const char* PATH_ENV = "ALVR_DRM_LEASE_CONFIG";
+
+struct Config {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size; // sizeof(Config) of the writer, fields are only ever appended
+    // Connector handed out by the lease, 0 for the first one of the first card that has any
+    uint32_t connectorId;
+    // Only mode of the leased connector, both eyes side by side
+    uint32_t modeWidth;
+    uint32_t modeHeight;
+    uint32_t refreshRate; // Hz, 0 keeps the refresh of the real connector
+    uint32_t reserved;
+};
+
+inline bool IsValid(const Config& config, uint64_t fileSize) {
+    return fileSize >= sizeof(Config) && config.magic == MAGIC && config.version == VERSION
+        && config.size >= sizeof(Config) && config.modeWidth != 0 && config.modeHeight != 0;
+}
+
+} // namespace drm_lease_config
@@ -6,6 +6,14 @@
 #include <cmath>
 #include <memory>
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define OPENVR_MATH_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define OPENVR_MATH_NEON
+#endif
+
 inline vr::HmdQuaternion_t operator+(const vr::HmdQuaternion_t& lhs, const vr::HmdQuaternion_t& rhs) {
 	return {
 		lhs.w + rhs.w,
@@ -231,8 +239,34 @@ namespace vrmath {
 		}
 	}
 
+	// Each row of the result is a sum of the rows of b, computed 4 columns at a time. The sums
+	// run in the order of the scalar loop, from 0 without fused multiply-adds, so the results are
+	// the same. The fourth column is the product of the translation columns, it is left
+	// undefined by the scalar loop.
 	inline vr::HmdMatrix34_t matMul33(const vr::HmdMatrix34_t& a, const vr::HmdMatrix34_t& b) {
 		vr::HmdMatrix34_t result;
+#if defined(OPENVR_MATH_SSE2)
+		const __m128 b0 = _mm_loadu_ps(b.m[0]);
+		const __m128 b1 = _mm_loadu_ps(b.m[1]);
+		const __m128 b2 = _mm_loadu_ps(b.m[2]);
+		for (unsigned i = 0; i < 3; i++) {
+			__m128 row = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2));
+			_mm_storeu_ps(result.m[i], row);
+		}
+#elif defined(OPENVR_MATH_NEON)
+		const float32x4_t b0 = vld1q_f32(b.m[0]);
+		const float32x4_t b1 = vld1q_f32(b.m[1]);
+		const float32x4_t b2 = vld1q_f32(b.m[2]);
+		for (unsigned i = 0; i < 3; i++) {
+			// vmulq and vaddq, vmlaq may be fused on AArch64
+			float32x4_t row = vaddq_f32(vdupq_n_f32(0.0f), vmulq_n_f32(b0, a.m[i][0]));
+			row = vaddq_f32(row, vmulq_n_f32(b1, a.m[i][1]));
+			row = vaddq_f32(row, vmulq_n_f32(b2, a.m[i][2]));
+			vst1q_f32(result.m[i], row);
+		}
+#else
 		for (unsigned i = 0; i < 3; i++) {
 			for (unsigned j = 0; j < 3; j++) {
 				result.m[i][j] = 0.0f;
@@ -241,6 +275,7 @@ namespace vrmath {
 				}
 			}
 		}
+#endif
 		return result;
 	}
 
@@ -1,4 +1,9 @@
 
+// Compiled with SHARPENING 0 for the sessions without sharpening, see build.rs
+#ifndef SHARPENING
+#define SHARPENING 1
+#endif
+
 cbuffer ColorCorrectionParams {
 	float renderWidth;
 	float renderHeight;
@@ -32,6 +37,7 @@ float3 blendLighten(float3 base, float3 blend) {
 
 // https://forum.unity.com/threads/hue-saturation-brightness-contrast-shader.260649/
 float4 main(float2 uv : TEXCOORD0) : SV_Target{
+#if SHARPENING
 	// sharpening
 	float3 pixel = sourceTexture.Sample(bilinearSampler, uv).rgb * (sharpening + 1.);
 	pixel += GetSharpenNeighborComponent(uv, -DX, -DY);
@@ -42,6 +48,9 @@ float4 main(float2 uv : TEXCOORD0) : SV_Target{
 	pixel += GetSharpenNeighborComponent(uv, 0, +DY);
 	pixel += GetSharpenNeighborComponent(uv, -DX, +DY);
 	pixel += GetSharpenNeighborComponent(uv, -DX, 0);
+#else
+	float3 pixel = sourceTexture.Sample(bilinearSampler, uv).rgb;
+#endif
 
 	pixel += brightness;                                                                            // brightness
 	pixel = (pixel - 0.5) * contrast + 0.5f;                                                        // contast
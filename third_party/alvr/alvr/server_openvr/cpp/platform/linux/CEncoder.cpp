@@ -3,7 +3,9 @@
 
 #include "CEncoder.h"
 
-#include <chrono>
+#include <algorithm>
+#include <array>
+#include <deque>
 #include <exception>
 #include <fstream>
 #include <iostream>
@@ -13,6 +15,7 @@
 #include <stdexcept>
 #include <stdlib.h>
 #include <string>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
@@ -20,11 +23,28 @@
 #include <unistd.h>
 
 #include "ALVR-common/packet_types.h"
+#include "DisplayOutput.h"
 #include "EncodePipeline.h"
 #include "FrameRender.h"
+#include "QualityProbe.h"
+#include "alvr_server/BitrateCalibration.h"
+#include "alvr_server/DecodeFeedback.h"
+#include "alvr_server/DriverMetrics.h"
+#include "alvr_server/FrameBudget.h"
+#include "alvr_server/FrameIncidents.h"
+#include "alvr_server/FrameTrace.h"
+#include "alvr_server/GpuEngineUsage.h"
+#include "alvr_server/Instance.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/PoseHistory.h"
+#include "alvr_server/PresetController.h"
+#include "alvr_server/RenderTargetScale.h"
+#include "alvr_server/ResolutionLadder.h"
 #include "alvr_server/Settings.h"
+#include "alvr_server/TraceEvents.h"
+#include "alvr_server/VideoBufferLease.h"
+#include "alvr_server/VramBudget.h"
+#include "alvr_server/VsyncTiming.h"
 #include "ffmpeg_helper.h"
 #include "protocol.h"
 
@@ -33,54 +53,325 @@ extern "C" {
 }
 
 CEncoder::CEncoder(std::shared_ptr<PoseHistory> poseHistory)
-    : m_poseHistory(poseHistory) { }
+    : m_poseHistory(poseHistory)
+    , m_wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (m_wakeFd == -1) {
+        throw MakeException("eventfd failed: %s", strerror(errno));
+    }
+}
 
-CEncoder::~CEncoder() { Stop(); }
+CEncoder::~CEncoder() {
+    Stop();
+    // The thread may still be waiting on the wake fd
+    Join();
+    close(m_wakeFd);
+}
 
 namespace {
-void read_exactly(pollfd pollfds, char* out, size_t size, std::atomic_bool& exiting) {
-    while (not exiting and size != 0) {
-        int timeout = 1; // poll api doesn't fit perfectly(100 mircoseconds) poll uses milliseconds
-                         // we do the best we can(1000 mircoseconds)
-        pollfds.events = POLLIN;
-        int count = poll(&pollfds, 1, timeout);
+struct InFlightFrame {
+    uint64_t targetTimestampNs = 0;
+    // Renderer frame id, its GPU timestamps are read back once the frame is drained
+    uint64_t renderFrame = 0;
+    alvr::EncodePipeline::Timestamp encode = {};
+    // FrameTraceNow() when the present packet was received and when the frame was pushed to
+    // the encoder
+    uint64_t receiveNs = 0;
+    uint64_t submitNs = 0;
+};
+
+// The bias of the rate control depends on the encoder, the GPU and its driver
+std::string calibration_key(alvr::EncodePipeline& pipeline, alvr::VkContext& vk_ctx) {
+    VkPhysicalDeviceProperties props = {};
+    vkGetPhysicalDeviceProperties(vk_ctx.get_vk_phys_device(), &props);
+    char key[128];
+    snprintf(
+        key,
+        sizeof(key),
+        "%s-%04x:%04x-%08x",
+        pipeline.GetEncoderName().c_str(),
+        props.vendorID,
+        props.deviceID,
+        props.driverVersion
+    );
+    return key;
+}
+
+// Drops the encode rate to one frame per REFRESH_NS while nobody is watching, the headset is not
+// worn and has been still for a moment. The encoders stay open, and putting the headset on or the
+// first head movement brings back the full rate.
+class IdleMode {
+public:
+    static constexpr uint64_t REFRESH_NS = 1'000'000'000;
+
+    explicit IdleMode(uint64_t nowNs)
+        : m_lastMotionNs(nowNs) { }
+
+    // Whether the frame rendered with `pose` finds the encoder idle. `resumed` is set on the frame
+    // that ends the idle mode.
+    bool Update(const float (&pose)[3][4], bool worn, uint64_t nowNs, bool& resumed) {
+        if (Moved(pose)) {
+            memcpy(m_pose, pose, sizeof(m_pose));
+            m_lastMotionNs = nowNs;
+        }
+        bool idle = not worn and nowNs - m_lastMotionNs >= UNWORN_TIMEOUT_NS;
+        resumed = m_idle and not idle;
+        if (idle != m_idle) {
+            m_idle = idle;
+            Info("Encoder %s\n", idle ? "idle" : "resumed");
+        }
+        return idle;
+    }
+
+private:
+    // A headset put down still jitters for a moment
+    static constexpr uint64_t UNWORN_TIMEOUT_NS = 1'000'000'000;
+    static constexpr float MOVE_DISTANCE = 0.01f; // m
+    static constexpr float MOVE_COS = 0.9994f; // Cosine of 2 degrees
+
+    bool Moved(const float (&pose)[3][4]) const {
+        float distance2 = 0;
+        // trace(A^T B) = 1 + 2 cos of the rotation between A and B
+        float trace = 0;
+        for (int i = 0; i < 3; i++) {
+            float d = pose[i][3] - m_pose[i][3];
+            distance2 += d * d;
+            for (int j = 0; j < 3; j++) {
+                trace += pose[i][j] * m_pose[i][j];
+            }
+        }
+        return distance2 > MOVE_DISTANCE * MOVE_DISTANCE or (trace - 1) / 2 < MOVE_COS;
+    }
+
+    // Pose at the last movement, zero until the first frame so that it counts as one
+    float m_pose[3][4] = {};
+    uint64_t m_lastMotionNs;
+    bool m_idle = false;
+};
+
+// Blocks until `fd` is readable. Returns false once the encoder is stopping, Stop() signals
+// `wake_fd` so this never has to poll with a timeout.
+bool wait_readable(int fd, int wake_fd, std::atomic_bool& exiting) {
+    pollfd fds[2] = { { fd, POLLIN, 0 }, { wake_fd, POLLIN, 0 } };
+    while (not exiting) {
+        int count = poll(fds, 2, -1);
         if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             throw MakeException("poll failed: %s", strerror(errno));
-        } else if (count == 1) {
-            int s = read(pollfds.fd, out, size);
-            if (s == -1) {
-                throw MakeException("read failed: %s", strerror(errno));
+        }
+        if (fds[0].revents != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns false if the encoder is stopping or the compositor closed the socket.
+bool read_exactly(int fd, int wake_fd, char* out, size_t size, std::atomic_bool& exiting) {
+    while (size != 0) {
+        if (!wait_readable(fd, wake_fd, exiting)) {
+            return false;
+        }
+        ssize_t s = read(fd, out, size);
+        if (s == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
             }
-            out += s;
-            size -= s;
+            throw MakeException("read failed: %s", strerror(errno));
+        }
+        if (s == 0) {
+            Warn("Compositor closed the IPC socket\n");
+            return false;
         }
+        out += s;
+        size -= s;
     }
+    return true;
 }
 
-void read_latest(pollfd pollfds, char* out, size_t size, std::atomic_bool& exiting) {
-    read_exactly(pollfds, out, size, exiting);
-    while (not exiting) {
-        int timeout = 0; // poll api fixes the original perfectly(0 microseconds)
-        pollfds.events = POLLIN;
-        int count = poll(&pollfds, 1, timeout);
-        if (count == 0)
-            return;
-        read_exactly(pollfds, out, size, exiting);
+// Waits for a packet, then drains everything the compositor queued in the meantime with as few
+// reads as possible and keeps only the newest packet. The older ones are counted in `dropped`.
+// Stops at a REINIT_IMAGE packet, the init packet and fds after it are left on the socket.
+bool read_latest(
+    int fd, int wake_fd, present_packet& out, uint64_t& dropped, std::atomic_bool& exiting
+) {
+    if (!read_exactly(fd, wake_fd, (char*)&out, sizeof(out), exiting)) {
+        return false;
     }
+
+    std::array<present_packet, 8> batch;
+    while (not exiting and out.image != REINIT_IMAGE) {
+        // Peeked first, a read past a swapchain change would discard the fds that follow it
+        ssize_t s = recv(fd, batch.data(), sizeof(batch), MSG_DONTWAIT | MSG_PEEK);
+        if (s == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            throw MakeException("read failed: %s", strerror(errno));
+        }
+        if (s == 0) {
+            Warn("Compositor closed the IPC socket\n");
+            return false;
+        }
+
+        // A partial packet is left for the next read, it may be a swapchain change
+        size_t count = s / sizeof(present_packet);
+        bool complete = (size_t)s == sizeof(batch);
+        for (size_t i = 0; i < count; i++) {
+            if (batch[i].image == REINIT_IMAGE) {
+                count = i + 1;
+                complete = false;
+                break;
+            }
+        }
+        if (count == 0) {
+            return true;
+        }
+        size_t size = count * sizeof(present_packet);
+        if (!read_exactly(fd, wake_fd, (char*)batch.data(), size, exiting)) {
+            return false;
+        }
+        out = batch[count - 1];
+        dropped += count;
+
+        if (!complete) {
+            return true;
+        }
+    }
+    return not exiting;
 }
 
-int accept_timeout(pollfd socket, std::atomic_bool& exiting) {
-    while (not exiting) {
-        int timeout = 15; // poll api also fits the original perfectly(15000 microseconds)
-        socket.events = POLLIN;
-        int count = poll(&socket, 1, timeout);
-        if (count < 0) {
-            throw MakeException("poll failed: %s", strerror(errno));
-        } else if (count == 1) {
-            return accept4(socket.fd, NULL, NULL, SOCK_CLOEXEC);
+void send_feedback(int fd, const feedback_packet& packet) {
+    ssize_t s = send(fd, &packet, sizeof(packet), MSG_DONTWAIT | MSG_NOSIGNAL);
+    // Full when the compositor doesn't read them, a closed socket ends the next read instead
+    if (s == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EPIPE) {
+        Warn("Failed to send compositor feedback: %s\n", strerror(errno));
+    }
+}
+
+int accept_blocking(int socket, int wake_fd, std::atomic_bool& exiting) {
+    if (!wait_readable(socket, wake_fd, exiting)) {
+        return -1;
+    }
+    return accept4(socket, NULL, NULL, SOCK_CLOEXEC);
+}
+
+bool has_pending(pollfd pollfds) {
+    pollfds.events = POLLIN;
+    return poll(&pollfds, 1, 0) == 1;
+}
+
+void ReportFrameTimestamps(
+    const InFlightFrame& frame, const Renderer::Timestamps& render, const Renderer& renderer
+) {
+    // render.now is sampled when the frame is drained, so the offsets include the time the frame
+    // spent in the pipeline. All the times are in the FrameTraceNow() clock.
+    uint64_t present_offset = render.now - render.renderBegin;
+    uint64_t composed_offset = 0;
+
+    if (frame.encode.gpu) {
+        composed_offset = render.now - renderer.DeviceToHostNs(frame.encode.gpu);
+    } else if (frame.encode.cpu) {
+        composed_offset = render.now - frame.encode.cpu;
+    } else {
+        composed_offset = render.now - render.renderComplete;
+    }
+
+    if (present_offset < composed_offset) {
+        present_offset = composed_offset;
+    }
+
+    ReportPresent(frame.targetTimestampNs, present_offset);
+    ReportComposed(frame.targetTimestampNs, composed_offset);
+}
+
+// Everything that depends on the codec. After an encoder failure only this is rebuilt, the Vulkan
+// device, the renderer with its compiled pipelines and its output stay.
+struct Encoders {
+    Encoders(FrameRender& render, alvr::VkContext& vk_ctx)
+        : ladder(render.GetEncodingWidth(), render.GetEncodingHeight()) { }
+
+    // Declared first, the pipelines reading them are destroyed before them
+    std::unique_ptr<alvr::VkFrame> frame;
+    std::unique_ptr<alvr::VkFrame> ladder_frame;
+    // One encoder per level of the resolution ladder, the lower ones are created upfront so
+    // that switching level costs no encoder initialization, only an IDR
+    std::unique_ptr<alvr::EncodePipeline> ladder_pipelines[ResolutionLadder::LEVEL_COUNT];
+    alvr::EncodePipeline* active = nullptr;
+    ResolutionLadder ladder;
+};
+
+std::unique_ptr<Encoders> create_encoders(FrameRender& render, alvr::VkContext& vk_ctx) {
+    auto encoders = std::make_unique<Encoders>(render, vk_ctx);
+
+    // Each DRM modifier that the encoder can't import is replaced, down to a linear output
+    while (true) {
+        // A previous headset encoder may have replaced the output, wrap the current one
+        // A copy, the encoder can replace the output while it is created
+        Renderer::Output output = render.GetOutput();
+        encoders->frame = std::make_unique<alvr::VkFrame>(
+            vk_ctx, output.image, output.imageInfo, output.size, output.memory, output.drm
+        );
+        try {
+            encoders->ladder_pipelines[0] = alvr::EncodePipeline::Create(
+                &render,
+                vk_ctx,
+                *encoders->frame,
+                output.imageInfo,
+                render.GetEncodingWidth(),
+                render.GetEncodingHeight()
+            );
+            break;
+        } catch (alvr::DrmImportError& e) {
+            Warn(
+                "The encoder rejected DRM modifier 0x%llx, recreating the output: %s\n",
+                (unsigned long long)output.drm.modifier,
+                e.what()
+            );
+            encoders->frame.reset();
+            render.RecreateOutput();
+        }
+    }
+    render.SaveOutputModifier();
+    encoders->active = encoders->ladder_pipelines[0].get();
+
+    ResolutionLadder& ladder = encoders->ladder;
+    if (ladder.IsEnabled() and not encoders->active->SupportsScaling()) {
+        Warn("Dynamic resolution needs the VAAPI encoder, the resolution stays fixed\n");
+        ladder.Disable();
+    } else if (ladder.IsEnabled()) {
+        try {
+            // The headset encoder may have replaced the output, wrap the current one
+            auto& ladder_output = render.GetOutput();
+            encoders->ladder_frame = std::make_unique<alvr::VkFrame>(
+                vk_ctx,
+                ladder_output.image,
+                ladder_output.imageInfo,
+                ladder_output.size,
+                ladder_output.memory,
+                ladder_output.drm
+            );
+            for (int level = 1; level < ResolutionLadder::LEVEL_COUNT; level++) {
+                encoders->ladder_pipelines[level] = alvr::EncodePipeline::Create(
+                    &render,
+                    vk_ctx,
+                    *encoders->ladder_frame,
+                    ladder_output.imageInfo,
+                    ladder.GetWidth(level),
+                    ladder.GetHeight(level),
+                    true
+                );
+                encoders->ladder_pipelines[level]->SetTraced(true);
+            }
+        } catch (std::exception& e) {
+            Error("Failed to create the dynamic resolution encoders: %s\n", e.what());
+            ladder.Disable();
         }
     }
-    return -1;
+    return encoders;
 }
 
 void av_logfn(void*, int level, const char* data, va_list va) {
@@ -144,7 +435,7 @@ void CEncoder::GetFds(int client, int (*received_fds)[6]) {
 void CEncoder::Run() {
     Info("CEncoder::Run\n");
     m_socketPath = getenv("XDG_RUNTIME_DIR");
-    m_socketPath += "/alvr-ipc";
+    m_socketPath += "/alvr-ipc" + InstanceSuffix();
 
     int ret;
     // we don't really care about what happends with unlink, it's just incase we crashed before this
@@ -175,146 +466,502 @@ void CEncoder::Run() {
     }
 
     Info("CEncoder Listening\n");
-    struct pollfd client;
-    client.fd = accept_timeout(m_socket, m_exiting);
-    if (m_exiting)
-        return;
-    init_packet init;
-    client.events = POLLIN;
-    read_exactly(client, (char*)&init, sizeof(init), m_exiting);
-    if (m_exiting)
-        return;
+    av_log_set_callback(av_logfn);
 
-    // check that pointer types are null, other values would not make sense over a socket
-    assert(init.image_create_info.queueFamilyIndexCount == 0);
-    assert(init.image_create_info.pNext == NULL);
+    // Kept across compositor connections on the same GPU, the compositor reconnects when it
+    // recreates its swapchain
+    std::unique_ptr<alvr::VkContext> vk_ctx;
+    std::array<uint8_t, VK_UUID_SIZE> vk_device_uuid = {};
 
-    char ifbuf[256];
-    char ifbuf2[256];
-    sprintf(ifbuf, "/proc/%d/cmdline", (int)init.source_pid);
-    std::ifstream ifscmdl(ifbuf);
-    ifscmdl >> ifbuf2;
-    Info("CEncoder client connected, pid %d, cmdline %s\n", (int)init.source_pid, ifbuf2);
+    while (not m_exiting) {
+        int client = accept_blocking(m_socket.fd, m_wakeFd, m_exiting);
+        if (m_exiting or client == -1)
+            break;
+        init_packet init;
+        if (!read_exactly(client, m_wakeFd, (char*)&init, sizeof(init), m_exiting)) {
+            close(client);
+            continue;
+        }
 
-    try {
-        GetFds(client.fd, &m_fds);
+        // check that pointer types are null, other values would not make sense over a socket
+        assert(init.image_create_info.queueFamilyIndexCount == 0);
+        assert(init.image_create_info.pNext == NULL);
 
-        m_connected = true;
+        char ifbuf[256];
+        char ifbuf2[256];
+        sprintf(ifbuf, "/proc/%d/cmdline", (int)init.source_pid);
+        std::ifstream ifscmdl(ifbuf);
+        ifscmdl >> ifbuf2;
+        Info("CEncoder client connected, pid %d, cmdline %s\n", (int)init.source_pid, ifbuf2);
 
-        fprintf(stderr, "\n\nWe are initalizing Vulkan in CEncoder thread\n\n\n");
+        try {
+            GetFds(client, &m_fds);
 
-        av_log_set_callback(av_logfn);
+            m_connected = true;
 
-        alvr::VkContext vk_ctx(init.device_uuid.data(), {});
+            if (not vk_ctx or vk_device_uuid != init.device_uuid) {
+                fprintf(stderr, "\n\nWe are initalizing Vulkan in CEncoder thread\n\n\n");
+                vk_ctx.reset();
+                vk_ctx = std::make_unique<alvr::VkContext>(
+                    init.device_uuid.data(), std::vector<const char*> {}
+                );
+                vk_device_uuid = init.device_uuid;
+            }
 
-        FrameRender render(vk_ctx, init, m_fds);
-        auto output = render.CreateOutput();
+            Serve(client, init, *vk_ctx);
+        } catch (std::exception& e) {
+            std::stringstream err;
+            err << "error in encoder thread: " << e.what();
+            Error(err.str().c_str());
+        }
 
-        alvr::VkFrame frame(
-            vk_ctx, output.image, output.imageInfo, output.size, output.memory, output.drm
+        close(client);
+    }
+}
+
+void CEncoder::Serve(int client_fd, init_packet& init, alvr::VkContext& vk_ctx) {
+    pollfd client;
+    client.fd = client_fd;
+    client.events = POLLIN;
+
+    FrameRender render(vk_ctx, init, m_fds);
+    render.CreateOutput();
+
+    // Polled while streaming, the encoders are created with fewer frames in flight under pressure
+    const uint64_t VRAM_POLL_INTERVAL_NS = 1'000'000'000;
+    uint64_t vram_poll_ns = 0;
+    auto poll_vram = [&](uint64_t now_ns) {
+        uint64_t usage, budget;
+        if (vk_ctx.QueryMemoryBudget(usage, budget)) {
+            ReportVramBudget(usage, budget);
+        }
+        vram_poll_ns = now_ns;
+    };
+    poll_vram(FrameTraceNow());
+    StartGpuEngineUsage(0);
+
+    std::unique_ptr<Encoders> encoders = create_encoders(render, vk_ctx);
+    m_scheduler.SetIntraRefresh(encoders->active->SupportsIntraRefresh());
+
+    std::unique_ptr<DisplayOutput> local_display;
+    if (!Settings::Instance().m_linuxLocalDisplayDevice.empty()) {
+        try {
+            local_display = std::make_unique<DisplayOutput>(
+                Settings::Instance().m_linuxLocalDisplayDevice,
+                Settings::Instance().m_linuxLocalDisplayConnector
+            );
+        } catch (std::exception& e) {
+            Warn("Local display disabled: %s\n", e.what());
+        }
+    }
+    // Of the last encoded frame, the idle mode keeps encoding one frame per refresh interval
+    uint64_t last_encode_ns = 0;
+    // Of the last matched frame, the compositor repeats it when the game missed the refresh
+    uint64_t last_frame_target_ns = 0;
+
+    std::unique_ptr<IdleMode> idle_mode;
+    if (Settings::Instance().m_linuxIdleMode) {
+        idle_mode = std::make_unique<IdleMode>(FrameTraceNow());
+    }
+
+    std::unique_ptr<QualityProbe> quality_probe;
+    if (Settings::Instance().m_linuxQualityMetricsIntervalMs > 0) {
+        quality_probe = std::make_unique<QualityProbe>(
+            &render, Settings::Instance().m_linuxQualityMetricsIntervalMs * 1'000'000ull
         );
-        auto encode_pipeline = alvr::EncodePipeline::Create(
-            &render,
-            vk_ctx,
-            frame,
-            output.imageInfo,
-            render.GetEncodingWidth(),
-            render.GetEncodingHeight()
+    }
+
+    // Last bitrate update, given to an encoder once it becomes active
+    FfiDynamicEncoderParams encoder_params = {};
+    // Seeded with the correction of the encoder, which is kept without calibration
+    BitrateCalibration calibration(
+        calibration_key(*encoders->active, vk_ctx), encoders->active->GetBitrateCorrection()
+    );
+
+    const bool valid_timestamps = render.HasTimestamps();
+
+    if (Settings::Instance().m_flightRecorderDurationS > 0) {
+        render.SetupRecorder(
+            Settings::Instance().m_flightRecorderDurationS * Settings::Instance().m_refreshRate,
+            Settings::Instance().m_flightRecorderDownscale
         );
+    }
+
+    // Frames that were pushed to the encoder but whose bitstream has not been sent yet. With a
+    // depth of 1 every frame is drained right after PushFrame, which is the serial loop.
+    auto get_pipeline_depth = [&]() -> size_t {
+        return encoders->active->SupportsPipelining()
+            ? VramLimitedDepth(
+                  std::clamp<uint32_t>(Settings::Instance().m_linuxEncodePipelineDepth, 1, 3)
+              )
+            : 1;
+    };
+    size_t pipeline_depth = get_pipeline_depth();
+    std::deque<InFlightFrame> in_flight;
+    Info("CEncoder pipeline depth %zu\n", pipeline_depth);
+
+    // Only steps the preset of the active encoder, the other ladder levels keep theirs
+    PresetController preset_controller(pipeline_depth);
+
+    // Failures in a row without an encoded frame in between. An encoder that keeps failing right
+    // after being rebuilt ends the connection.
+    const int MAX_ENCODER_RESTARTS = 3;
+    int encoder_failures = 0;
+
+    // Slices capped in bytes and AV1 tile groups are sent one by one, so that the transport can
+    // keep them apart
+    const bool send_slices = (Settings::Instance().m_encoderMaxSliceBytes > 0
+                              || Settings::Instance().m_codec == ALVR_CODEC_AV1)
+        && SliceOutputEnabled();
+
+    // Submission to bitstream time of the recent frames, for the ready time of the feedback
+    double encode_ns = 0;
+    const double ENCODE_AVERAGE_WEIGHT = 0.1;
+
+    // Presents superseded before the encoder took them
+    uint64_t dropped_frames = 0;
+    uint64_t counted_drops = 0;
+
+    // Retrieves the bitstream of the oldest frame in flight and sends it
+    auto finish_oldest = [&]() {
+        ALVR_TRACE_SCOPE("FinishEncode");
+        alvr::EncodePipeline* encode_pipeline = encoders->active;
+        alvr::FramePacket packet;
+        InFlightFrame inflight = in_flight.front();
+        in_flight.pop_front();
+        MetricsSetGauge(DRIVER_GAUGE_ENCODE_QUEUE_DEPTH, (double)in_flight.size());
+        if (!encode_pipeline->GetEncoded(packet)) {
+            Error("Failed to get encoded data!");
+            return;
+        }
+        encoder_failures = 0;
+        uint64_t frame_encode_ns = FrameTraceNow() - inflight.submitNs;
+        m_pacer.OnFrameEncoded(frame_encode_ns);
+        encode_ns += (frame_encode_ns - encode_ns) * ENCODE_AVERAGE_WEIGHT;
+        calibration.OnFrame(packet.size);
+        if (quality_probe) {
+            quality_probe->PushPacket(
+                encode_pipeline->GetCodec(), packet, inflight.targetTimestampNs
+            );
+        }
+
+        // The encoder has consumed the frame, so its render queries are normally
+        // available by now and this doesn't wait for the GPU
+        Renderer::Timestamps render_timestamps;
+        uint64_t frame_render_ns = 0;
+        if (valid_timestamps and render.GetTimestamps(inflight.renderFrame, render_timestamps)) {
+            frame_render_ns = render_timestamps.renderComplete - render_timestamps.renderBegin;
+            ReportFrameTimestamps(inflight, render_timestamps, render);
+            ALVR_TRACE_GPU(
+                "compositor", "Frame", frame_render_ns, render_timestamps.renderComplete
+            );
+            FrameTraceMark(
+                inflight.targetTimestampNs, FRAME_TRACE_RENDER_BEGIN, render_timestamps.renderBegin
+            );
+            FrameTraceMark(
+                inflight.targetTimestampNs, FRAME_TRACE_RENDER_END, render_timestamps.renderComplete
+            );
+        }
+        if (preset_controller.IsEnabled()) {
+            uint64_t now_ns = FrameTraceNow();
+            int step = preset_controller.OnFrameEncoded(frame_encode_ns, frame_render_ns, now_ns);
+            if (step != 0) {
+                bool applied = encode_pipeline->StepQualityPreset(step);
+                preset_controller.OnStepApplied(step, applied, now_ns);
+            }
+        }
+
+        if (send_slices) {
+            // VideoSendSlice copies the data, the packet needs no lease
+            ParseFrameSliceNals(
+                encode_pipeline->GetCodec(), packet.data, packet.size, packet.pts, packet.isIDR
+            );
+        } else if (auto release = encode_pipeline->LeasePacket()) {
+            ParseFrameNalsLeased(
+                encode_pipeline->GetCodec(),
+                packet.data,
+                packet.size,
+                packet.pts,
+                packet.isIDR,
+                std::move(release)
+            );
+        } else {
+            ParseFrameNals(
+                encode_pipeline->GetCodec(), packet.data, packet.size, packet.pts, packet.isIDR
+            );
+        }
+        VsyncTimingOnFrameSent(FrameTraceNow() - inflight.receiveNs);
+    };
+
+    // Only the codec contexts are swapped, the stream resumes with an IDR at the next frame
+    // instead of waiting for a new Vulkan device and renderer
+    auto rebuild_encoders = [&]() {
+        vkDeviceWaitIdle(vk_ctx.get_vk_device());
+        encoders.reset();
+        encoders = create_encoders(render, vk_ctx);
+        encoders->active->SetParams(encoder_params);
+        if (quality_probe) {
+            quality_probe->Reset();
+        }
+        m_scheduler.SetIntraRefresh(encoders->active->SupportsIntraRefresh());
+        m_scheduler.InsertIDR(IDRScheduler::REASON_STREAM_START);
+        size_t depth = get_pipeline_depth();
+        if (depth != pipeline_depth) {
+            Info("CEncoder pipeline depth %zu\n", depth);
+            pipeline_depth = depth;
+            preset_controller = PresetController(pipeline_depth);
+        }
+    };
+
+    DecodeAdvisor decode_advisor;
+
+    fprintf(stderr, "CEncoder starting to read present packets");
+    present_packet frame_info;
+    // Socket errors end the connection, they are no reason to restart the encoder
+    bool reading = false;
+    while (not m_exiting) {
+        try {
+            // Only start the next frame while there is room in the pipeline and the compositor
+            // has already presented it, otherwise finish the oldest frame first.
+            if (in_flight.size() >= pipeline_depth
+                or (in_flight.size() >= encoders->active->GetAsyncDepth()
+                    and not in_flight.empty() and not has_pending(client))) {
+                finish_oldest();
+                continue;
+            }
 
-        bool valid_timestamps = true;
+            reading = true;
+            if (!read_latest(client.fd, m_wakeFd, frame_info, dropped_frames, m_exiting))
+                break;
+            reading = false;
 
-        fprintf(stderr, "CEncoder starting to read present packets");
-        present_packet frame_info;
-        while (not m_exiting) {
-            read_latest(client, (char*)&frame_info, sizeof(frame_info), m_exiting);
+            if (frame_info.image == REINIT_IMAGE) {
+                // The frames in flight were rendered from the previous images. The encoders and
+                // the pipelines are kept, the stream goes on with the next present.
+                while (not in_flight.empty()) {
+                    finish_oldest();
+                }
+                reading = true;
+                init_packet reinit;
+                if (!read_exactly(client.fd, m_wakeFd, (char*)&reinit, sizeof(reinit), m_exiting))
+                    break;
+                GetFds(client.fd, &m_fds);
+                if (reinit.device_uuid != init.device_uuid
+                    or not render.ReplaceImages(
+                        reinit.image_create_info, reinit.mem_index, m_fds, std::size(m_fds) / 2
+                    )) {
+                    for (int fd : m_fds) {
+                        close(fd);
+                    }
+                    // The compositor connects again, with a new renderer
+                    throw MakeException("The compositor swapchain changed size or format");
+                }
+                reading = false;
+                Info("CEncoder swapchain replaced\n");
+                continue;
+            }
+            uint64_t receive_ns = FrameTraceNow();
+
+            // The next frame waits for as many frames to finish as this one fills the pipeline
+            // beyond its depth. FrameTraceNow() is the steady clock, CLOCK_MONOTONIC.
+            feedback_packet feedback = {};
+            feedback.frame = frame_info.frame;
+            feedback.queue_depth = in_flight.size() + 1;
+            size_t wait_frames = in_flight.size() + 2 > pipeline_depth
+                ? in_flight.size() + 2 - pipeline_depth
+                : 0;
+            feedback.ready_ns = receive_ns + uint64_t(wait_frames * encode_ns);
+            feedback.dropped_frames = dropped_frames;
+            send_feedback(client.fd, feedback);
+
+            MetricsCount(DRIVER_COUNTER_PRESENTS_DROPPED, dropped_frames - counted_drops);
+            FrameIncidentsOnPresentsDropped(dropped_frames - counted_drops);
+            counted_drops = dropped_frames;
+
+            if (receive_ns - vram_poll_ns >= VRAM_POLL_INTERVAL_NS) {
+                poll_vram(receive_ns);
+                // Only the frames in flight at the new depth are kept, the other encoder surfaces
+                // are freed. The depth comes back with the next rebuild.
+                if (VramUnderPressure() and pipeline_depth > 1) {
+                    while (not in_flight.empty()) {
+                        finish_oldest();
+                    }
+                    rebuild_encoders();
+                }
+            }
 
-            encode_pipeline->SetParams(GetDynamicEncoderParams());
+            if (decode_advisor.Update(receive_ns)) {
+                // The new entropy coding or slice count needs new codec contexts, the frames in
+                // flight are sent by the current ones first
+                while (not in_flight.empty()) {
+                    finish_oldest();
+                }
+                decode_advisor.Apply();
+                rebuild_encoders();
+            }
+
+            auto params = GetDynamicEncoderParams();
+            if (params.updated) {
+                encoder_params = params;
+                calibration.SetTarget(params.bitrate_bps);
+            }
+            if (encoders->ladder.Update(params)) {
+                // The frames in flight belong to the previous encoder, which then sits idle until
+                // the ladder comes back to its level
+                while (not in_flight.empty()) {
+                    finish_oldest();
+                }
+                encoders->active = encoders->ladder_pipelines[encoders->ladder.GetLevel()].get();
+                params = encoder_params;
+                // The first frame at a new ladder level must be an IDR
+                m_scheduler.InsertIDR(IDRScheduler::REASON_RESOLUTION_CHANGE);
+                if (quality_probe) {
+                    quality_probe->Reset();
+                }
+            }
+            alvr::EncodePipeline* encode_pipeline = encoders->active;
+            // A new correction is applied to the last bitrate
+            if (encode_pipeline->GetBitrateCorrection() != calibration.GetFactor()) {
+                encode_pipeline->SetBitrateCorrection(calibration.GetFactor());
+                params = encoder_params;
+            }
+            encode_pipeline->SetParams(params);
+            encode_pipeline->SetFrameBudget(GetEncoderFrameBudget());
 
             auto pose = m_poseHistory->GetBestPoseMatch((const vr::HmdMatrix34_t&)frame_info.pose);
             if (!pose) {
                 continue;
             }
+            FrameTraceMark(pose->targetTimestampNs, FRAME_TRACE_IPC_RECEIVE, receive_ns);
+            FrameTraceMark(pose->targetTimestampNs, FRAME_TRACE_POSE_MATCH);
+            ReportGameFrame(pose->targetTimestampNs == last_frame_target_ns);
+            last_frame_target_ns = pose->targetTimestampNs;
+
+            if (idle_mode) {
+                bool resumed = false;
+                bool idle = idle_mode->Update(frame_info.pose, m_headsetWorn, receive_ns, resumed);
+                if (resumed) {
+                    m_scheduler.InsertIDR(IDRScheduler::REASON_RESUME);
+                }
+                // Not even rendered, the compositor image is simply not read
+                if (idle and receive_ns - last_encode_ns < IdleMode::REFRESH_NS) {
+                    continue;
+                }
+            }
 
+            bool idr = m_scheduler.CheckIDRInsertion() != 0;
+            // Skipped before rendering, a pending recovery is kept for the next frame
+            if (not m_pacer.ShouldEncode(pose->targetTimestampNs, FrameTraceNow(), idr)) {
+                continue;
+            }
+
+            // The flight recorder dumps the frames around the request instead, with as many
+            // frames after it as before
+            bool dump_recorder = m_recorderGlitch.exchange(false) and render.HasRecorder();
             if (m_captureFrame) {
                 m_captureFrame = false;
-                render.CaptureInputFrame(
-                    Settings::Instance().m_captureFrameDir + "/alvr_frame_input.ppm"
-                );
-                render.CaptureOutputFrame(
-                    Settings::Instance().m_captureFrameDir + "/alvr_frame_output.ppm"
+                if (render.HasRecorder()) {
+                    dump_recorder = true;
+                } else {
+                    const std::string& dir = Settings::Instance().m_captureFrameDir;
+                    render.CaptureInputFrame(dir + "/alvr_frame_input" + InstanceSuffix() + ".ppm");
+                    render.CaptureOutputFrame(
+                        dir + "/alvr_frame_output" + InstanceSuffix() + ".ppm"
+                    );
+                }
+            }
+            if (dump_recorder) {
+                render.DumpRecorder(
+                    Settings::Instance().m_captureFrameDir, render.GetRecorderFrames() / 2
                 );
             }
 
-            render.Render(frame_info.image, frame_info.semaphore_value);
+            render.SetPhotonMarker(pose->targetTimestampNs);
+            uint64_t render_frame = render.Render(frame_info.image, frame_info.semaphore_value);
+
+            last_encode_ns = receive_ns;
+
+            if (quality_probe) {
+                quality_probe->Sample(pose->targetTimestampNs);
+            }
 
             if (!valid_timestamps) {
                 ReportPresent(pose->targetTimestampNs, 0);
                 ReportComposed(pose->targetTimestampNs, 0);
             }
 
-            encode_pipeline->PushFrame(pose->targetTimestampNs, m_scheduler.CheckIDRInsertion());
+            if (not idr and m_scheduler.CheckIntraRefreshInsertion()) {
+                encode_pipeline->InsertIntraRefresh();
+            }
+            uint64_t submit_ns = FrameTraceNow();
+            {
+                ALVR_TRACE_SCOPE("PushFrame");
+                encode_pipeline->PushFrame(pose->targetTimestampNs, idr);
+            }
+            FrameTraceMark(pose->targetTimestampNs, FRAME_TRACE_ENCODE_SUBMIT);
+            if (local_display and not local_display->Present(render.GetOutput())) {
+                Warn("Local display disabled\n");
+                local_display.reset();
+            }
 
             static_assert(sizeof(frame_info.pose) == sizeof(vr::HmdMatrix34_t&));
 
-            alvr::FramePacket packet;
-            if (!encode_pipeline->GetEncoded(packet)) {
-                Error("Failed to get encoded data!");
-                continue;
-            }
-
+            InFlightFrame inflight;
+            inflight.targetTimestampNs = pose->targetTimestampNs;
+            inflight.renderFrame = render_frame;
+            inflight.receiveNs = receive_ns;
+            inflight.submitNs = submit_ns;
             if (valid_timestamps) {
-                auto render_timestamps = render.GetTimestamps();
-                auto encode_timestamp = encode_pipeline->GetTimestamp();
-
-                uint64_t present_offset = render_timestamps.now - render_timestamps.renderBegin;
-                uint64_t composed_offset = 0;
-
-                valid_timestamps = render_timestamps.now != 0;
-
-                if (encode_timestamp.gpu) {
-                    composed_offset = render_timestamps.now - encode_timestamp.gpu;
-                } else if (encode_timestamp.cpu) {
-                    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
-                                   std::chrono::steady_clock::now().time_since_epoch()
-                    )
-                                   .count();
-                    composed_offset = now - encode_timestamp.cpu;
-                } else {
-                    composed_offset = render_timestamps.now - render_timestamps.renderComplete;
-                }
-
-                if (present_offset < composed_offset) {
-                    present_offset = composed_offset;
-                }
-
-                ReportPresent(pose->targetTimestampNs, present_offset);
-                ReportComposed(pose->targetTimestampNs, composed_offset);
+                inflight.encode = encode_pipeline->GetTimestamp();
             }
-
-            ParseFrameNals(
-                encode_pipeline->GetCodec(), packet.data, packet.size, packet.pts, packet.isIDR
-            );
+            in_flight.push_back(inflight);
+            MetricsSetGauge(DRIVER_GAUGE_ENCODE_QUEUE_DEPTH, (double)in_flight.size());
+        } catch (std::exception& e) {
+            if (reading or ++encoder_failures > MAX_ENCODER_RESTARTS) {
+                throw;
+            }
+            // The frames in flight are lost with the encoders
+            Error("Encoder failed, restarting it: %s\n", e.what());
+            OnGlitch();
+            in_flight.clear();
+            rebuild_encoders();
         }
-    } catch (std::exception& e) {
-        std::stringstream err;
-        err << "error in encoder thread: " << e.what();
-        Error(err.str().c_str());
     }
-
-    client.events = POLLHUP;
-    close(client.fd);
 }
 
 void CEncoder::Stop() {
     m_exiting = true;
+    StopGpuEngineUsage();
+    uint64_t wake = 1;
+    // EAGAIN means the counter is already saturated, the waiters are woken all the same
+    if (write(m_wakeFd, &wake, sizeof(wake)) < 0 && errno != EAGAIN) {
+        Warn("Failed to wake the encoder thread: %s\n", strerror(errno));
+    }
     m_socket.events = POLLHUP;
     close(m_socket.fd);
     unlink(m_socketPath.c_str());
 }
 
-void CEncoder::OnStreamStart() { m_scheduler.OnStreamStart(); }
+void CEncoder::OnStreamStart() {
+    m_pacer.Reset();
+    m_scheduler.OnStreamStart();
+}
+
+// Called by RequestIDR, when the client lost a frame
+void CEncoder::InsertIDR() {
+    m_scheduler.InsertRecovery();
+    OnGlitch();
+}
 
-void CEncoder::InsertIDR() { m_scheduler.InsertIDR(); }
+void CEncoder::OnGlitch() {
+    if (Settings::Instance().m_flightRecorderDumpOnGlitch) {
+        m_recorderGlitch = true;
+    }
+}
+
+// None of the pipelines can invalidate references, the scheduler falls back to a recovery
+void CEncoder::InvalidateFrames(uint64_t firstTs, uint64_t lastTs) {
+    m_scheduler.InvalidateFrames(firstTs);
+}
 
 void CEncoder::CaptureFrame() { m_captureFrame = true; }
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "alvr_server/FramePacer.h"
 #include "alvr_server/IDRScheduler.h"
 #include "shared/threadtools.h"
 #include <atomic>
@@ -11,6 +12,10 @@
 #include <sys/types.h>
 
 class PoseHistory;
+struct init_packet;
+namespace alvr {
+class VkContext;
+}
 
 class CEncoder : public CThread {
 public:
@@ -22,17 +27,36 @@ public:
     void Stop();
     void OnStreamStart();
     void InsertIDR();
+    void InvalidateFrames(uint64_t firstTs, uint64_t lastTs);
+    // None of the pipelines keep long-term references
+    void AcknowledgeFrame(uint64_t /*targetTimestampNs*/) { }
+    void SetClientTiming(
+        uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+    ) {
+        m_pacer.SetClientTiming(vsyncNs, periodNs, serverToClientNs, networkLatencyNs);
+    }
     bool IsConnected() { return m_connected; }
+    // From the proximity sensor, the encoder idles while the headset is not worn
+    void SetHeadsetWorn(bool worn) { m_headsetWorn = worn; }
     void CaptureFrame();
 
 private:
     void GetFds(int client, int (*fds)[6]);
+    // Renders and encodes the frames of one compositor connection
+    void Serve(int client, init_packet& init, alvr::VkContext& vk_ctx);
+    // Has the flight recorder write out the frames around a lost frame or an encoder failure
+    void OnGlitch();
     std::shared_ptr<PoseHistory> m_poseHistory;
     std::atomic_bool m_exiting { false };
+    // eventfd signalled by Stop() to wake up the blocking socket reads
+    int m_wakeFd;
     IDRScheduler m_scheduler;
+    FramePacer m_pacer;
     pollfd m_socket;
     std::string m_socketPath;
     int m_fds[6];
     bool m_connected = false;
     std::atomic_bool m_captureFrame = false;
+    std::atomic_bool m_recorderGlitch = false;
+    std::atomic_bool m_headsetWorn = true;
 };
@@ -1,6 +1,159 @@
 // Derived from ALVR (MIT)
 // Original copyright preserved
 
+#include "../../alvr_server/CrashReport.h"
 #include "../../alvr_server/bindings.h"
 
-void HookCrashHandler() { }
+#include <atomic>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <signal.h>
+#include <string>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace {
+
+const int CRASH_SIGNALS[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+const int CRASH_SIGNAL_COUNT = sizeof(CRASH_SIGNALS) / sizeof(CRASH_SIGNALS[0]);
+
+struct sigaction g_previous[CRASH_SIGNAL_COUNT];
+std::atomic<bool> g_crashed { false };
+
+// For a fault on an exhausted stack. The alternate stack is per thread, only the thread that hooks
+// the handler has it.
+alignas(16) char g_altStack[64 * 1024];
+
+// Everything the handler touches is allocated before it runs
+std::string g_reportPath;
+CrashReport g_report;
+void* g_frames[CrashReport::MAX_FRAMES];
+char g_chunk[4096];
+
+void writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written <= 0) {
+            return;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
+void writeRegisters(const ucontext_t* context) {
+#if defined(__x86_64__)
+    static const struct {
+        const char* name;
+        int index;
+    } REGISTERS[] = {
+        { "rip", REG_RIP }, { "rsp", REG_RSP }, { "rbp", REG_RBP }, { "rax", REG_RAX },
+        { "rbx", REG_RBX }, { "rcx", REG_RCX }, { "rdx", REG_RDX }, { "rsi", REG_RSI },
+        { "rdi", REG_RDI }, { "r8", REG_R8 },   { "r9", REG_R9 },   { "r10", REG_R10 },
+        { "r11", REG_R11 }, { "r12", REG_R12 }, { "r13", REG_R13 }, { "r14", REG_R14 },
+        { "r15", REG_R15 }, { "eflags", REG_EFL },
+    };
+    for (const auto& reg : REGISTERS) {
+        g_report.Register(reg.name, context->uc_mcontext.gregs[reg.index]);
+    }
+#elif defined(__aarch64__)
+    static const char* const NAMES[] = {
+        "x0",  "x1",  "x2",  "x3",  "x4",  "x5",  "x6",  "x7",  "x8",  "x9",  "x10",
+        "x11", "x12", "x13", "x14", "x15", "x16", "x17", "x18", "x19", "x20", "x21",
+        "x22", "x23", "x24", "x25", "x26", "x27", "x28", "x29", "x30",
+    };
+    for (int i = 0; i < 31; i++) {
+        g_report.Register(NAMES[i], context->uc_mcontext.regs[i]);
+    }
+    g_report.Register("sp", context->uc_mcontext.sp);
+    g_report.Register("pc", context->uc_mcontext.pc);
+#else
+    (void)context;
+#endif
+}
+
+// The mappings resolve the frames to a module and file offset offline. Streamed through a fixed
+// chunk, /proc/self/maps has no size known up front.
+void appendMaps(int fd) {
+    int maps = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (maps < 0) {
+        return;
+    }
+    writeAll(fd, "maps\n", 5);
+    ssize_t len;
+    while ((len = read(maps, g_chunk, sizeof(g_chunk))) > 0) {
+        writeAll(fd, g_chunk, len);
+    }
+    close(maps);
+}
+
+// SteamVR's handler gets the crash next. Without one, the signal is raised again and its default
+// action runs once this handler returns.
+void chainPrevious(int signal, siginfo_t* info, void* context) {
+    for (int i = 0; i < CRASH_SIGNAL_COUNT; i++) {
+        if (CRASH_SIGNALS[i] != signal) {
+            continue;
+        }
+        const struct sigaction& previous = g_previous[i];
+        sigaction(signal, &previous, nullptr);
+        if ((previous.sa_flags & SA_SIGINFO) != 0 && previous.sa_sigaction != nullptr) {
+            previous.sa_sigaction(signal, info, context);
+        } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+            previous.sa_handler(signal);
+        } else {
+            raise(signal);
+        }
+        return;
+    }
+}
+
+void handler(int signal, siginfo_t* info, void* context) {
+    // A fault while reporting, or on a second thread, goes straight to the previous handler
+    if (!g_crashed.exchange(true)) {
+        g_report.Begin();
+        g_report.Value("signal", signal);
+        g_report.Value("code", info->si_code);
+        g_report.Hex("address", reinterpret_cast<uintptr_t>(info->si_addr));
+        writeRegisters(static_cast<const ucontext_t*>(context));
+
+        // The unwinder was loaded by HookCrashHandler, it walks through the signal frame
+        int count = backtrace(g_frames, CrashReport::MAX_FRAMES);
+        for (int i = 0; i < count; i++) {
+            g_report.Frame(reinterpret_cast<uintptr_t>(g_frames[i]));
+        }
+
+        int fd = open(g_reportPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            writeAll(fd, g_report.Data(), g_report.Size());
+            appendMaps(fd);
+            close(fd);
+        }
+    }
+
+    chainPrevious(signal, info, context);
+}
+
+} // namespace
+
+void HookCrashHandler() {
+    g_reportPath = std::filesystem::path(g_sessionPath)
+                       .replace_filename(CRASH_REPORT_FILE_NAME)
+                       .string();
+
+    // backtrace() dlopens the unwinder on first use, which must not happen in the handler
+    backtrace(g_frames, 1);
+
+    stack_t altStack = {};
+    altStack.ss_sp = g_altStack;
+    altStack.ss_size = sizeof(g_altStack);
+    sigaltstack(&altStack, nullptr);
+
+    struct sigaction action = {};
+    action.sa_sigaction = handler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (int i = 0; i < CRASH_SIGNAL_COUNT; i++) {
+        sigaction(CRASH_SIGNALS[i], &action, &g_previous[i]);
+    }
+}
@@ -0,0 +1,409 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "DisplayOutput.h"
+#include "alvr_server/Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <poll.h>
+#include <unistd.h>
+
+#include <drm_fourcc.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+namespace {
+
+template <typename T, void (*Free)(T*)> struct DrmFree {
+    void operator()(T* p) const { Free(p); }
+};
+using ResourcesPtr = std::unique_ptr<drmModeRes, DrmFree<drmModeRes, drmModeFreeResources>>;
+using ConnectorPtr
+    = std::unique_ptr<drmModeConnector, DrmFree<drmModeConnector, drmModeFreeConnector>>;
+using EncoderPtr = std::unique_ptr<drmModeEncoder, DrmFree<drmModeEncoder, drmModeFreeEncoder>>;
+using PlaneResourcesPtr
+    = std::unique_ptr<drmModePlaneRes, DrmFree<drmModePlaneRes, drmModeFreePlaneResources>>;
+using PlanePtr = std::unique_ptr<drmModePlane, DrmFree<drmModePlane, drmModeFreePlane>>;
+using PropertiesPtr = std::unique_ptr<
+    drmModeObjectProperties,
+    DrmFree<drmModeObjectProperties, drmModeFreeObjectProperties>>;
+using AtomicReqPtr
+    = std::unique_ptr<drmModeAtomicReq, DrmFree<drmModeAtomicReq, drmModeAtomicFree>>;
+
+// Finds the property called `name` of a KMS object, with its current value in `value`
+uint32_t find_property(
+    int fd, uint32_t object, uint32_t type, const char* name, uint64_t* value = nullptr
+) {
+    PropertiesPtr props(drmModeObjectGetProperties(fd, object, type));
+    for (uint32_t i = 0; props && i < props->count_props; i++) {
+        drmModePropertyPtr prop = drmModeGetProperty(fd, props->props[i]);
+        bool match = prop && strcmp(prop->name, name) == 0;
+        uint32_t id = match ? prop->prop_id : 0;
+        drmModeFreeProperty(prop);
+        if (match) {
+            if (value) {
+                *value = props->prop_values[i];
+            }
+            return id;
+        }
+    }
+    throw MakeException("KMS object %u has no %s property", object, name);
+}
+
+// Name as the kernel prints it, e.g. DP-2
+std::string connector_name(const drmModeConnector& connector) {
+    const char* type = drmModeGetConnectorTypeName(connector.connector_type);
+    return std::string(type ? type : "Unknown") + "-"
+        + std::to_string(connector.connector_type_id);
+}
+
+// Primary planes rarely blend, the alpha channel of the output is ignored
+uint32_t opaque_format(uint32_t format) {
+    switch (format) {
+    case DRM_FORMAT_ARGB8888:
+        return DRM_FORMAT_XRGB8888;
+    case DRM_FORMAT_ABGR8888:
+        return DRM_FORMAT_XBGR8888;
+    case DRM_FORMAT_ARGB2101010:
+        return DRM_FORMAT_XRGB2101010;
+    case DRM_FORMAT_ABGR2101010:
+        return DRM_FORMAT_XBGR2101010;
+    default:
+        return format;
+    }
+}
+
+} // namespace
+
+DisplayOutput::DisplayOutput(const std::string& device, const std::string& connector) {
+    m_fd = open(device.c_str(), O_RDWR | O_CLOEXEC);
+    if (m_fd < 0) {
+        throw MakeException("Failed to open %s: %s", device.c_str(), strerror(errno));
+    }
+    try {
+        Open(device, connector);
+    } catch (...) {
+        if (m_modeBlob) {
+            drmModeDestroyPropertyBlob(m_fd, m_modeBlob);
+        }
+        close(m_fd);
+        throw;
+    }
+}
+
+void DisplayOutput::Open(const std::string& device, const std::string& connector) {
+    if (drmSetClientCap(m_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) != 0
+        || drmSetClientCap(m_fd, DRM_CLIENT_CAP_ATOMIC, 1) != 0) {
+        throw MakeException("%s has no atomic modesetting", device.c_str());
+    }
+    // Fails while a desktop compositor drives the card
+    if (!drmIsMaster(m_fd) && drmSetMaster(m_fd) != 0) {
+        throw MakeException(
+            "%s is driven by another process, use a free card or a VT: %s",
+            device.c_str(),
+            strerror(errno)
+        );
+    }
+
+    ResourcesPtr res(drmModeGetResources(m_fd));
+    if (!res) {
+        throw MakeException("%s has no KMS resources", device.c_str());
+    }
+
+    ConnectorPtr con;
+    for (int i = 0; i < res->count_connectors && !con; i++) {
+        ConnectorPtr candidate(drmModeGetConnector(m_fd, res->connectors[i]));
+        if (!candidate) {
+            continue;
+        }
+        bool connected = candidate->connection == DRM_MODE_CONNECTED && candidate->count_modes > 0;
+        if (connector.empty() ? connected : connector_name(*candidate) == connector) {
+            if (!connected) {
+                throw MakeException("%s has no display connected", connector.c_str());
+            }
+            con = std::move(candidate);
+        }
+    }
+    if (!con) {
+        throw MakeException(
+            "%s not found on %s",
+            connector.empty() ? "Connected display" : connector.c_str(),
+            device.c_str()
+        );
+    }
+    m_connectorId = con->connector_id;
+
+    drmModeModeInfo mode = con->modes[0];
+    for (int i = 0; i < con->count_modes; i++) {
+        if (con->modes[i].type & DRM_MODE_TYPE_PREFERRED) {
+            mode = con->modes[i];
+            break;
+        }
+    }
+    m_modeWidth = mode.hdisplay;
+    m_modeHeight = mode.vdisplay;
+
+    // Any CRTC the encoders of the connector can feed
+    int crtcIndex = -1;
+    for (int i = 0; i < con->count_encoders && crtcIndex < 0; i++) {
+        EncoderPtr encoder(drmModeGetEncoder(m_fd, con->encoders[i]));
+        for (int c = 0; encoder && c < res->count_crtcs; c++) {
+            if (encoder->possible_crtcs & (1u << c)) {
+                crtcIndex = c;
+                break;
+            }
+        }
+    }
+    if (crtcIndex < 0) {
+        throw MakeException("No CRTC can drive %s", connector_name(*con).c_str());
+    }
+    m_crtcId = res->crtcs[crtcIndex];
+
+    PlaneResourcesPtr planes(drmModeGetPlaneResources(m_fd));
+    for (uint32_t i = 0; planes && i < planes->count_planes && !m_planeId; i++) {
+        PlanePtr plane(drmModeGetPlane(m_fd, planes->planes[i]));
+        if (!plane || !(plane->possible_crtcs & (1u << crtcIndex))) {
+            continue;
+        }
+        uint64_t type = 0;
+        find_property(m_fd, plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", &type);
+        if (type == DRM_PLANE_TYPE_PRIMARY) {
+            m_planeId = plane->plane_id;
+        }
+    }
+    if (!m_planeId) {
+        throw MakeException("No primary plane for CRTC %u", m_crtcId);
+    }
+
+    if (drmModeCreatePropertyBlob(m_fd, &mode, sizeof(mode), &m_modeBlob) != 0) {
+        throw MakeException("Failed to create the mode blob: %s", strerror(errno));
+    }
+
+    m_props.connectorCrtcId
+        = find_property(m_fd, m_connectorId, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID");
+    m_props.crtcModeId = find_property(m_fd, m_crtcId, DRM_MODE_OBJECT_CRTC, "MODE_ID");
+    m_props.crtcActive = find_property(m_fd, m_crtcId, DRM_MODE_OBJECT_CRTC, "ACTIVE");
+    m_props.planeFbId = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "FB_ID");
+    m_props.planeCrtcId = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "CRTC_ID");
+    m_props.planeSrcX = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "SRC_X");
+    m_props.planeSrcY = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "SRC_Y");
+    m_props.planeSrcW = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "SRC_W");
+    m_props.planeSrcH = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "SRC_H");
+    m_props.planeCrtcX = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "CRTC_X");
+    m_props.planeCrtcY = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "CRTC_Y");
+    m_props.planeCrtcW = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "CRTC_W");
+    m_props.planeCrtcH = find_property(m_fd, m_planeId, DRM_MODE_OBJECT_PLANE, "CRTC_H");
+
+    Info(
+        "Local display on %s of %s, %ux%u@%u\n",
+        connector_name(*con).c_str(),
+        device.c_str(),
+        m_modeWidth,
+        m_modeHeight,
+        mode.vrefresh
+    );
+}
+
+DisplayOutput::~DisplayOutput() {
+    DrainEvents(100);
+    if (m_modeSet) {
+        // Turns the display off again, the next master starts from a clean state
+        AtomicReqPtr req(drmModeAtomicAlloc());
+        drmModeAtomicAddProperty(req.get(), m_planeId, m_props.planeFbId, 0);
+        drmModeAtomicAddProperty(req.get(), m_planeId, m_props.planeCrtcId, 0);
+        drmModeAtomicAddProperty(req.get(), m_crtcId, m_props.crtcActive, 0);
+        drmModeAtomicAddProperty(req.get(), m_crtcId, m_props.crtcModeId, 0);
+        drmModeAtomicAddProperty(req.get(), m_connectorId, m_props.connectorCrtcId, 0);
+        drmModeAtomicCommit(m_fd, req.get(), DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+    }
+    ReleaseFramebuffer(m_previousFb);
+    ReleaseFramebuffer(m_fb);
+    if (m_modeBlob) {
+        drmModeDestroyPropertyBlob(m_fd, m_modeBlob);
+    }
+    drmDropMaster(m_fd);
+    close(m_fd);
+}
+
+bool DisplayOutput::Import(const Renderer::Output& output) {
+    const DrmImage& drm = output.drm;
+    if (drm.fd < 0) {
+        Warn("Local display: the renderer output has no dma-buf\n");
+        return false;
+    }
+
+    Framebuffer fb;
+    fb.width = output.imageInfo.extent.width;
+    fb.height = output.imageInfo.extent.height;
+    fb.sourceImage = output.image;
+    fb.sourceFd = drm.fd;
+    if (drmPrimeFDToHandle(m_fd, drm.fd, &fb.handle) != 0) {
+        Warn("Local display: failed to import the output: %s\n", strerror(errno));
+        return false;
+    }
+
+    uint32_t handles[4] = {};
+    uint32_t pitches[4] = {};
+    uint32_t offsets[4] = {};
+    uint64_t modifiers[4] = {};
+    uint32_t planeCount = std::clamp(drm.planes, 1u, 4u);
+    for (uint32_t i = 0; i < planeCount; i++) {
+        handles[i] = fb.handle;
+        pitches[i] = drm.strides[i];
+        offsets[i] = drm.offsets[i];
+        modifiers[i] = drm.modifier;
+    }
+    bool explicitModifier = drm.modifier != DRM_FORMAT_MOD_INVALID;
+    if (drmModeAddFB2WithModifiers(
+            m_fd,
+            fb.width,
+            fb.height,
+            opaque_format(drm.format),
+            handles,
+            pitches,
+            offsets,
+            explicitModifier ? modifiers : nullptr,
+            &fb.id,
+            explicitModifier ? DRM_MODE_FB_MODIFIERS : 0
+        )
+        != 0) {
+        Warn(
+            "Local display: format 0x%x with modifier 0x%llx can't be scanned out: %s\n",
+            drm.format,
+            (unsigned long long)drm.modifier,
+            strerror(errno)
+        );
+        if (fb.handle != m_fb.handle && fb.handle != m_previousFb.handle) {
+            drmCloseBufferHandle(m_fd, fb.handle);
+        }
+        return false;
+    }
+
+    ReleaseFramebuffer(m_previousFb);
+    m_previousFb = m_fb;
+    m_fb = fb;
+    return true;
+}
+
+void DisplayOutput::ReleaseFramebuffer(Framebuffer& fb) {
+    if (fb.id) {
+        drmModeRmFB(m_fd, fb.id);
+    }
+    // Importing the same buffer again returns the same handle, it isn't reference counted
+    Framebuffer& other = &fb == &m_fb ? m_previousFb : m_fb;
+    if (fb.handle && fb.handle != other.handle) {
+        drmCloseBufferHandle(m_fd, fb.handle);
+    }
+    fb = Framebuffer();
+}
+
+int DisplayOutput::Commit(uint32_t flags, bool modeset) {
+    uint32_t srcW = m_fb.width;
+    uint32_t srcH = m_fb.height;
+    uint32_t crtcX = 0;
+    uint32_t crtcY = 0;
+    uint32_t crtcW = m_modeWidth;
+    uint32_t crtcH = m_modeHeight;
+    if (m_fit == Fit::Letterbox) {
+        if (uint64_t(srcW) * m_modeHeight > uint64_t(srcH) * m_modeWidth) {
+            crtcH = uint64_t(srcH) * m_modeWidth / srcW;
+            crtcY = (m_modeHeight - crtcH) / 2;
+        } else {
+            crtcW = uint64_t(srcW) * m_modeHeight / srcH;
+            crtcX = (m_modeWidth - crtcW) / 2;
+        }
+    } else if (m_fit == Fit::Crop) {
+        // Without scaling, the top left of the frame at its own size
+        srcW = crtcW = std::min(srcW, m_modeWidth);
+        srcH = crtcH = std::min(srcH, m_modeHeight);
+    }
+
+    AtomicReqPtr req(drmModeAtomicAlloc());
+    drmModeAtomicReq* r = req.get();
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeFbId, m_fb.id);
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeCrtcId, m_crtcId);
+    // Source coordinates are 16.16 fixed point
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeSrcX, 0);
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeSrcY, 0);
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeSrcW, uint64_t(srcW) << 16);
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeSrcH, uint64_t(srcH) << 16);
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeCrtcX, crtcX);
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeCrtcY, crtcY);
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeCrtcW, crtcW);
+    drmModeAtomicAddProperty(r, m_planeId, m_props.planeCrtcH, crtcH);
+    if (modeset) {
+        drmModeAtomicAddProperty(r, m_connectorId, m_props.connectorCrtcId, m_crtcId);
+        drmModeAtomicAddProperty(r, m_crtcId, m_props.crtcModeId, m_modeBlob);
+        drmModeAtomicAddProperty(r, m_crtcId, m_props.crtcActive, 1);
+    }
+    return drmModeAtomicCommit(m_fd, r, flags, this) == 0 ? 0 : errno;
+}
+
+bool DisplayOutput::SetMode() {
+    // Not every plane scales, or covers only part of the CRTC
+    for (Fit fit : { Fit::Letterbox, Fit::Stretch, Fit::Crop }) {
+        m_fit = fit;
+        if (Commit(DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET, true) == 0) {
+            int error = Commit(DRM_MODE_ATOMIC_ALLOW_MODESET, true);
+            if (error != 0) {
+                Warn("Local display: modeset failed: %s\n", strerror(error));
+                return false;
+            }
+            m_modeSet = true;
+            return true;
+        }
+    }
+    Warn("Local display: no placement of the frame passes the atomic check\n");
+    return false;
+}
+
+void DisplayOutput::OnPageFlip(int, unsigned int, unsigned int, unsigned int, void* data) {
+    static_cast<DisplayOutput*>(data)->m_flipPending = false;
+}
+
+void DisplayOutput::DrainEvents(int timeoutMs) {
+    pollfd pfd = {};
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    while (m_flipPending && poll(&pfd, 1, timeoutMs) > 0) {
+        drmEventContext context = {};
+        context.version = 2;
+        context.page_flip_handler = OnPageFlip;
+        drmHandleEvent(m_fd, &context);
+    }
+}
+
+bool DisplayOutput::Present(const Renderer::Output& output) {
+    DrainEvents(0);
+    if (m_flipPending) {
+        return true;
+    }
+    // The flip to m_fb is done, the framebuffer before it isn't scanned out anymore
+    ReleaseFramebuffer(m_previousFb);
+
+    bool replaced = m_fb.sourceImage != output.image || m_fb.sourceFd != output.drm.fd
+        || m_fb.width != output.imageInfo.extent.width
+        || m_fb.height != output.imageInfo.extent.height;
+    if (replaced && !Import(output)) {
+        return false;
+    }
+    if (!m_modeSet) {
+        return SetMode();
+    }
+
+    // Flipping to the same framebuffer still latches it at the next vblank
+    int error = Commit(DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, false);
+    if (error == EBUSY) {
+        return true;
+    }
+    if (error != 0) {
+        Warn("Local display: page flip failed: %s\n", strerror(error));
+        return false;
+    }
+    m_flipPending = true;
+    return true;
+}
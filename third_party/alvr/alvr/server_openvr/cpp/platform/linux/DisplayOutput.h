@@ -0,0 +1,78 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "Renderer.h"
+#include <cstdint>
+#include <string>
+
+// Local preview of the composed frames on a monitor: the output dma-buf of the renderer is
+// imported as a KMS framebuffer and scanned out on a connector of its own with atomic commits, no
+// window system or copy in between. The connector has to be free for the driver, on a card no
+// desktop compositor is running on or from a VT, since wp_drm_lease is not requested here.
+class DisplayOutput {
+public:
+    // Opens `device`, e.g. /dev/dri/card1, and takes the connector named `connector`, e.g. DP-2,
+    // or the first connected one if empty. Throws if the connector can't be driven.
+    DisplayOutput(const std::string& device, const std::string& connector);
+    ~DisplayOutput();
+
+    // Queues `output` for the next vblank, imported again only when the renderer replaced it.
+    // Never blocks: a frame is skipped while the previous flip is pending. Returns false once
+    // the display can't be used anymore.
+    bool Present(const Renderer::Output& output);
+
+private:
+    struct PropertyIds {
+        uint32_t connectorCrtcId = 0;
+        uint32_t crtcModeId = 0;
+        uint32_t crtcActive = 0;
+        uint32_t planeFbId = 0;
+        uint32_t planeCrtcId = 0;
+        uint32_t planeSrcX = 0;
+        uint32_t planeSrcY = 0;
+        uint32_t planeSrcW = 0;
+        uint32_t planeSrcH = 0;
+        uint32_t planeCrtcX = 0;
+        uint32_t planeCrtcY = 0;
+        uint32_t planeCrtcW = 0;
+        uint32_t planeCrtcH = 0;
+    };
+
+    struct Framebuffer {
+        uint32_t id = 0;
+        uint32_t handle = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // Identify the renderer output it was imported from
+        VkImage sourceImage = VK_NULL_HANDLE;
+        int sourceFd = -1;
+    };
+
+    // How the frame is placed on the mode, in the order they are tried
+    enum class Fit { Letterbox, Stretch, Crop };
+
+    void Open(const std::string& device, const std::string& connector);
+    bool Import(const Renderer::Output& output);
+    void ReleaseFramebuffer(Framebuffer& fb);
+    bool SetMode();
+    int Commit(uint32_t flags, bool modeset);
+    void DrainEvents(int timeoutMs);
+    static void OnPageFlip(int fd, unsigned int, unsigned int, unsigned int, void* data);
+
+    int m_fd = -1;
+    uint32_t m_connectorId = 0;
+    uint32_t m_crtcId = 0;
+    uint32_t m_planeId = 0;
+    uint32_t m_modeBlob = 0;
+    uint32_t m_modeWidth = 0;
+    uint32_t m_modeHeight = 0;
+    PropertyIds m_props;
+    Framebuffer m_fb;
+    // Still scanned out until the flip to m_fb completes
+    Framebuffer m_previousFb;
+    bool m_modeSet = false;
+    bool m_flipPending = false;
+    Fit m_fit = Fit::Letterbox;
+};
@@ -4,19 +4,34 @@
 #include "EncodePipeline.h"
 
 #include "EncodePipelineNvEnc.h"
+#include "EncodePipelineSVT.h"
 #include "EncodePipelineSW.h"
 #include "EncodePipelineVAAPI.h"
+#include "EncodePipelineVulkan.h"
+#include "alvr_server/EncoderRoi.h"
+#include "alvr_server/EncoderSession.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
 #include "ffmpeg_helper.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+// Rings of decreasing quality approximating the QP map, regions earlier in the list take
+// precedence where they overlap
+const int ROI_RINGS = 3;
 }
 
 void alvr::EncodePipeline::SetParams(FfiDynamicEncoderParams params) {
     if (params.updated) {
-        encoder_ctx->bit_rate = params.bitrate_bps / params.framerate * 60.0;
+        encoder_ctx->bit_rate = params.bitrate_bps * bitrate_correction / params.framerate * 60.0;
         encoder_ctx->framerate = AVRational { 60, 1 };
         encoder_ctx->rc_buffer_size = encoder_ctx->bit_rate / 60.0 * 1.1;
         encoder_ctx->rc_max_rate = encoder_ctx->bit_rate;
@@ -24,36 +39,169 @@ void alvr::EncodePipeline::SetParams(FfiDynamicEncoderParams params) {
     }
 }
 
+void alvr::EncodePipeline::SetFrameBudget(uint32_t maxFrameBytes) {
+    if (encoder_ctx == nullptr) {
+        return;
+    }
+    if (encoder_ctx->rc_buffer_size != budget_buffer_size) {
+        uncapped_buffer_size = encoder_ctx->rc_buffer_size;
+    }
+    int64_t size = uncapped_buffer_size;
+    if (maxFrameBytes > 0) {
+        size = std::min<int64_t>(size, (int64_t)maxFrameBytes * 8);
+    }
+    // Picked up by the encoder like a buffer size set by SetParams
+    encoder_ctx->rc_buffer_size = budget_buffer_size = (int)size;
+    encoder_ctx->rc_initial_buffer_occupancy
+        = std::min(encoder_ctx->rc_initial_buffer_occupancy, budget_buffer_size);
+}
+
+void alvr::EncodePipeline::applyRoi(AVFrame* frame) {
+    av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+
+    std::vector<AVRegionOfInterest> regions;
+    EncoderRoi roi;
+    if (GetEncoderRoi(encoder_ctx->width, encoder_ctx->height, roi)) {
+        // Libavcodec only lowers the QP inside the regions, rate control then takes the bits from
+        // the rest of the frame
+        float radius = roi.radius;
+        for (int ring = 0; ring < ROI_RINGS; ring++) {
+            roi.radius = radius * (1.0f + (float)ring / ROI_RINGS);
+            for (int eye = 0; eye < 2; eye++) {
+                RoiRect rect = GetRoiRect(roi, eye, encoder_ctx->width, encoder_ctx->height);
+                AVRegionOfInterest region = {};
+                region.self_size = sizeof(AVRegionOfInterest);
+                region.left = rect.left;
+                region.top = rect.top;
+                region.right = rect.right;
+                region.bottom = rect.bottom;
+                // qoffset is relative to the QP range of the codec
+                region.qoffset = av_make_q(-roi.maxQpDelta * (ROI_RINGS - ring) / ROI_RINGS, 51);
+                regions.push_back(region);
+            }
+        }
+    }
+    if (regions.empty()) {
+        return;
+    }
+
+    AVFrameSideData* sd = av_frame_new_side_data(
+        frame, AV_FRAME_DATA_REGIONS_OF_INTEREST, sizeof(AVRegionOfInterest) * regions.size()
+    );
+    if (!sd) {
+        return;
+    }
+    memcpy(sd->data, regions.data(), sizeof(AVRegionOfInterest) * regions.size());
+}
+
+void alvr::EncodePipeline::applyAv1Tiles() {
+    const auto& settings = Settings::Instance();
+    int columns = std::max<int>(settings.m_encoderAv1TileColumns, 1);
+    int rows = std::max<int>(settings.m_encoderAv1TileRows, 1);
+    if (columns == 1 && rows == 1) {
+        return;
+    }
+
+    // av1_nvenc takes the counts, av1_vaapi and av1_vulkan a CxR size
+    void* options = encoder_ctx->priv_data;
+    if (av_opt_set_int(options, "tile-columns", columns, 0) >= 0) {
+        av_opt_set_int(options, "tile-rows", rows, 0);
+    } else {
+        std::string tiles = std::to_string(columns) + "x" + std::to_string(rows);
+        if (av_opt_set(options, "tiles", tiles.c_str(), 0) < 0) {
+            Warn("This AV1 encoder has no tile options, encoding one tile");
+            return;
+        }
+    }
+    // Each tile group is its own OBU, CEncoder sends them as slices
+    if (settings.m_encoderSlicesPerFrame > 1) {
+        int groups = std::min<int>(settings.m_encoderSlicesPerFrame, columns * rows);
+        av_opt_set_int(options, "tile_groups", groups, 0);
+    }
+}
+
 std::unique_ptr<alvr::EncodePipeline> alvr::EncodePipeline::Create(
     Renderer* render,
     VkContext& vk_ctx,
     VkFrame& input_frame,
     VkImageCreateInfo& image_create_info,
     uint32_t width,
-    uint32_t height
+    uint32_t height,
+    bool shared_input
+) {
+    auto pipeline = createBackend(
+        render, vk_ctx, input_frame, image_create_info, width, height, shared_input
+    );
+    pipeline->traced = !shared_input;
+    if (Settings::Instance().m_encoderMaxSliceBytes > 0 && !pipeline->SupportsMaxSliceBytes()) {
+        Warn("This encoder can't cap the slice size in bytes, using the slice count");
+    }
+    // None of the FFmpeg encoders used here can encode temporal layers
+    if (Settings::Instance().m_encoderTemporalLayers > 1) {
+        Warn("Temporal layers are not supported on Linux, encoding a single layer");
+    }
+    // Nor code P frames as non-reference, x264 only leaves B frames unreferenced
+    if (Settings::Instance().m_encoderDisposableFrames > 0) {
+        Warn("Disposable frames are not supported on Linux, all frames are references");
+    }
+    return pipeline;
+}
+
+std::unique_ptr<alvr::EncodePipeline> alvr::EncodePipeline::createBackend(
+    Renderer* render,
+    VkContext& vk_ctx,
+    VkFrame& input_frame,
+    VkImageCreateInfo& image_create_info,
+    uint32_t width,
+    uint32_t height,
+    bool shared_input
 ) {
     if (Settings::Instance().m_force_sw_encoding == false) {
-        if (vk_ctx.nvidia) {
+        if (Settings::Instance().m_linuxVulkanVideoEncode && !vk_ctx.crossDeviceEncode) {
             try {
-                auto nvenc = std::make_unique<alvr::EncodePipelineNvEnc>(
+                auto vulkan = std::make_unique<alvr::EncodePipelineVulkan>(
                     render, vk_ctx, input_frame, image_create_info, width, height
                 );
-                Info("Using NvEnc encoder");
-                return nvenc;
+                Info("Using Vulkan Video encoder");
+                return vulkan;
             } catch (std::exception& e) {
-                Error(
-                    "Failed to create NvEnc encoder: %s\nPlease make sure you have installed CUDA "
-                    "runtime.",
-                    e.what()
-                );
+                Warn("Failed to create Vulkan Video encoder, falling back: %s", e.what());
+            }
+        }
+        if (vk_ctx.nvidia && !vk_ctx.crossDeviceEncode) {
+            // The GeForce drivers cap the concurrent NVENC sessions, opening one more fails
+            auto session = std::make_unique<EncoderSession>(vk_ctx.devicePath);
+            if (!session->IsAcquired()) {
+                Warn("All the NvEnc sessions of this GPU are in use, falling back");
+            } else {
+                try {
+                    auto nvenc = std::make_unique<alvr::EncodePipelineNvEnc>(
+                        render, vk_ctx, input_frame, image_create_info, width, height
+                    );
+                    nvenc->session = std::move(session);
+                    Info("Using NvEnc encoder");
+                    return nvenc;
+                } catch (std::exception& e) {
+                    Error(
+                        "Failed to create NvEnc encoder: %s\nPlease make sure you have installed "
+                        "CUDA runtime.",
+                        e.what()
+                    );
+                }
             }
         } else {
             try {
                 auto vaapi = std::make_unique<alvr::EncodePipelineVAAPI>(
-                    render, vk_ctx, input_frame, width, height
+                    render, vk_ctx, input_frame, width, height, shared_input
                 );
                 Info("Using VAAPI encoder");
                 return vaapi;
+            } catch (alvr::DrmImportError& e) {
+                // The caller recreates the output with another modifier and tries again
+                if (!shared_input && render->CanChangeOutputModifier()) {
+                    throw;
+                }
+                Error("Failed to import the output into VAAPI: %s", e.what());
             } catch (std::exception& e) {
                 Error(
                     "Failed to create VAAPI encoder: %s\nPlease make sure you have installed VAAPI "
@@ -63,7 +211,18 @@ std::unique_ptr<alvr::EncodePipeline> alvr::EncodePipeline::Create(
             }
         }
     }
-    auto sw = std::make_unique<alvr::EncodePipelineSW>(render, width, height);
+    // x264 only encodes h264, AV1 can be encoded by SVT-AV1 if libavcodec has it
+    if (Settings::Instance().m_codec == ALVR_CODEC_AV1) {
+        try {
+            auto svt
+                = std::make_unique<alvr::EncodePipelineSVT>(render, width, height, vk_ctx.numaNode);
+            Info("Using SVT-AV1 encoder");
+            return svt;
+        } catch (std::exception& e) {
+            Warn("Failed to create SVT-AV1 encoder, falling back to x264: %s", e.what());
+        }
+    }
+    auto sw = std::make_unique<alvr::EncodePipelineSW>(render, width, height, vk_ctx.numaNode);
     Info("Using SW encoder");
     return sw;
 }
@@ -88,4 +247,17 @@ bool alvr::EncodePipeline::GetEncoded(FramePacket& packet) {
     return true;
 }
 
+std::function<void()> alvr::EncodePipeline::LeasePacket() {
+    if (!encoder_packet) {
+        return {};
+    }
+    AVPacket* packet = encoder_packet;
+    encoder_packet = nullptr;
+    return [packet]() mutable { av_packet_free(&packet); };
+}
+
 int alvr::EncodePipeline::GetCodec() { return Settings::Instance().m_codec; }
+
+std::string alvr::EncodePipeline::GetEncoderName() {
+    return encoder_ctx ? encoder_ctx->codec->name : "";
+}
@@ -4,13 +4,17 @@
 #pragma once
 #include "alvr_server/bindings.h"
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
 extern "C" struct AVCodecContext;
+extern "C" struct AVFrame;
 extern "C" struct AVPacket;
 
+class EncoderSession;
 class Renderer;
 
 namespace alvr {
@@ -28,6 +32,8 @@ struct FramePacket {
 
 class EncodePipeline {
 public:
+    // When the encoder read its input. gpu is in nanoseconds of the device clock of the renderer,
+    // cpu in the FrameTraceNow() clock.
     struct Timestamp {
         uint64_t gpu = 0;
         uint64_t cpu = 0;
@@ -37,23 +43,80 @@ public:
 
     virtual void PushFrame(uint64_t targetTimestampNs, bool idr) = 0;
     virtual bool GetEncoded(FramePacket& data);
+    // Take ownership of the packet returned by the last GetEncoded. The returned function frees it,
+    // an empty function means the packet can't outlive the next encode and must be copied.
+    virtual std::function<void()> LeasePacket();
     virtual Timestamp GetTimestamp() { return timestamp; }
     virtual int GetCodec();
+    // Name of the codec implementation, part of the bitrate calibration key
+    virtual std::string GetEncoderName();
+    // Whether frames can be pushed before the previous packet has been retrieved.
+    virtual bool SupportsPipelining() { return true; }
+    // Frames the encoder holds before it outputs the packet of the oldest one. GetEncoded finds no
+    // packet while fewer frames are in flight.
+    virtual uint32_t GetAsyncDepth() { return 1; }
+    // Whether the backend can encode at another size than the input frame
+    virtual bool SupportsScaling() { return false; }
+    // Whether slices can be capped to encoder_max_slice_bytes instead of a slice count
+    virtual bool SupportsMaxSliceBytes() { return false; }
+    // Whether loss recovery can use InsertIntraRefresh instead of an IDR
+    virtual bool SupportsIntraRefresh() { return false; }
+    // Starts an intra refresh wave with the next pushed frame. Encoders that refresh continuously
+    // have nothing to do.
+    virtual void InsertIntraRefresh() { }
+    // Moves the preset one step towards quality for a positive step, towards speed otherwise,
+    // from the next frames on. Returns false if the backend has no preset in that direction.
+    virtual bool StepQualityPreset(int step) { return false; }
+    void SetTraced(bool enabled) { traced = enabled; }
 
     virtual void SetParams(FfiDynamicEncoderParams params);
+    // What the bitrate given to the next SetParams is multiplied by, see BitrateCalibration
+    void SetBitrateCorrection(float factor) { bitrate_correction = factor; }
+    float GetBitrateCorrection() const { return bitrate_correction; }
+    // Caps the rate control buffer to maxFrameBytes, 0 for no cap. Called after SetParams for each
+    // frame, a buffer size set by SetParams is capped again.
+    virtual void SetFrameBudget(uint32_t maxFrameBytes);
+    // `shared_input` is set for the lower resolution encoders of CEncoder, which read the renderer
+    // output after the headset encoder and must not replace it.
     static std::unique_ptr<EncodePipeline> Create(
         Renderer* render,
         VkContext& vk_ctx,
         VkFrame& input_frame,
         VkImageCreateInfo& image_create_info,
         uint32_t width,
-        uint32_t height
+        uint32_t height,
+        bool shared_input = false
     );
 
 protected:
+    static std::unique_ptr<EncodePipeline> createBackend(
+        Renderer* render,
+        VkContext& vk_ctx,
+        VkFrame& input_frame,
+        VkImageCreateInfo& image_create_info,
+        uint32_t width,
+        uint32_t height,
+        bool shared_input
+    );
+
+    // Replaces the regions of interest of the frame by the current gaze ROI, if any
+    void applyRoi(AVFrame* frame);
+    // Sets the AV1 tile layout and tile groups of the settings, on the ffmpeg encoders that have
+    // options for them
+    void applyAv1Tiles();
+
     AVCodecContext* encoder_ctx = nullptr; // shall be initialized by child class
     AVPacket* encoder_packet = NULL;
     Timestamp timestamp = {};
+    // Whether PushFrame records FrameTrace stages, only the headset encoder does
+    bool traced = true;
+    float bitrate_correction = 1.0f;
+    // Buffer size set by SetParams, and the capped size last given to the encoder
+    int uncapped_buffer_size = 0;
+    int budget_buffer_size = 0;
+    // Held by the hardware encoders that count against encoder_session_limit, released after the
+    // encoder is closed
+    std::unique_ptr<EncoderSession> session;
 };
 
 }
@@ -3,14 +3,19 @@
 
 #include "EncodePipelineNvEnc.h"
 #include "ALVR-common/packet_types.h"
+#include "alvr_server/FrameTrace.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
 #include "ffmpeg_helper.h"
 #include <chrono>
 #include <memory>
+#include <unistd.h>
+
+#include <ffnvcodec/dynlink_loader.h>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext_cuda.h>
 #include <libavutil/opt.h>
 }
 
@@ -63,6 +68,33 @@ void set_hwframe_ctx(AVCodecContext* ctx, AVBufferRef* hw_device_ctx) {
 }
 
 } // namespace
+
+// The renderer output memory mapped as a CUDA buffer. NVENC registers the pointer on the first
+// frame and keeps it registered, so each frame is encoded without any copy.
+struct alvr::EncodePipelineNvEnc::CudaInput {
+    CudaFunctions* cu = nullptr;
+    CUcontext cu_ctx = nullptr;
+    CUexternalMemory ext_mem = nullptr;
+    CUdeviceptr ptr = 0;
+    AVFrame* frame = nullptr;
+
+    ~CudaInput() {
+        av_frame_free(&frame);
+        if (cu) {
+            CUcontext dummy;
+            cu->cuCtxPushCurrent(cu_ctx);
+            if (ptr) {
+                cu->cuMemFree(ptr);
+            }
+            if (ext_mem) {
+                cu->cuDestroyExternalMemory(ext_mem);
+            }
+            cu->cuCtxPopCurrent(&dummy);
+            cuda_free_functions(&cu);
+        }
+    }
+};
+
 alvr::EncodePipelineNvEnc::EncodePipelineNvEnc(
     Renderer* render,
     VkContext& vk_ctx,
@@ -113,6 +145,7 @@ alvr::EncodePipelineNvEnc::EncodePipelineNvEnc(
     case ALVR_CODEC_HEVC:
         break;
     case ALVR_CODEC_AV1:
+        applyAv1Tiles();
         break;
     }
 
@@ -163,6 +196,16 @@ alvr::EncodePipelineNvEnc::EncodePipelineNvEnc(
     // work around ffmpeg default not working for older NVIDIA cards
     av_opt_set_int(encoder_ctx->priv_data, "b_ref_mode", 0, 0);
 
+    // NV_ENC_SPLIT_ENCODE_MODE of the split encode settings after the driver default. The driver
+    // encodes stripes of the frame on different engines and still outputs a single frame.
+    const int64_t SPLIT_ENCODE_MODES[] = { 15, 1, 2, 3 };
+    if (settings.m_nvencSplitEncodeMode > 0 && settings.m_nvencSplitEncodeMode <= 4) {
+        int64_t mode = SPLIT_ENCODE_MODES[settings.m_nvencSplitEncodeMode - 1];
+        if (av_opt_set_int(encoder_ctx->priv_data, "split_encode_mode", mode, 0) < 0) {
+            Warn("Split frame encoding needs HEVC or AV1 and FFmpeg 7.1 or newer");
+        }
+    }
+
     encoder_ctx->pix_fmt = AV_PIX_FMT_CUDA;
     encoder_ctx->width = width;
     encoder_ctx->height = height;
@@ -171,7 +214,19 @@ alvr::EncodePipelineNvEnc::EncodePipelineNvEnc(
     encoder_ctx->sample_aspect_ratio = AVRational { 1, 1 };
     encoder_ctx->max_b_frames = 0;
     encoder_ctx->gop_size = INT16_MAX;
+    if (settings.m_intraRefreshFrames > 0) {
+        // The refresh period is the GOP, ffmpeg then only sends an IDR at the start
+        if (av_opt_set_int(encoder_ctx->priv_data, "intra-refresh", 1, 0) >= 0) {
+            encoder_ctx->gop_size = settings.m_intraRefreshFrames;
+            intra_refresh = true;
+        } else {
+            Warn("Intra refresh is not supported by this ffmpeg, recovering with IDRs.");
+        }
+    }
     encoder_ctx->color_range = AVCOL_RANGE_JPEG;
+    if (settings.m_encoderSlicesPerFrame > 1) {
+        encoder_ctx->slices = settings.m_encoderSlicesPerFrame;
+    }
     auto params = FfiDynamicEncoderParams {};
     params.updated = true;
     params.bitrate_bps = 30'000'000;
@@ -186,13 +241,98 @@ alvr::EncodePipelineNvEnc::EncodePipelineNvEnc(
     }
 
     hw_frame = av_frame_alloc();
+
+    try {
+        importInput();
+    } catch (std::exception& e) {
+        Warn("Failed to import the output into CUDA, copying frames instead: %s", e.what());
+        cuda_input.reset();
+    }
 }
 
 alvr::EncodePipelineNvEnc::~EncodePipelineNvEnc() {
+    // NVENC unregisters the imported input on close, before the memory is released
+    avcodec_free_context(&encoder_ctx);
+    cuda_input.reset();
     av_buffer_unref(&hw_ctx);
     av_frame_free(&hw_frame);
 }
 
+void alvr::EncodePipelineNvEnc::importInput() {
+    const auto& output = r->GetOutput();
+    if (output.imageInfo.tiling != VK_IMAGE_TILING_LINEAR
+        or output.imageInfo.extent.width != (uint32_t)encoder_ctx->width
+        or output.imageInfo.extent.height != (uint32_t)encoder_ctx->height) {
+        throw std::runtime_error("output is not a linear image of the encoding size");
+    }
+
+    VkImageSubresource subresource = {};
+    subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    VkSubresourceLayout layout;
+    vkGetImageSubresourceLayout(r->m_dev, output.image, &subresource, &layout);
+
+    VkMemoryGetFdInfoKHR fd_info = {};
+    fd_info.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+    fd_info.memory = output.memory;
+    fd_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+    int fd = -1;
+    VK_CHECK(r->d.vkGetMemoryFdKHR(r->m_dev, &fd_info, &fd));
+
+    cuda_input = std::make_unique<CudaInput>();
+    if (cuda_load_functions(&cuda_input->cu, nullptr) < 0) {
+        close(fd);
+        throw std::runtime_error("failed to load CUDA");
+    }
+    auto cu = cuda_input->cu;
+    auto device_ctx = (AVHWDeviceContext*)hw_ctx->data;
+    cuda_input->cu_ctx = ((AVCUDADeviceContext*)device_ctx->hwctx)->cuda_ctx;
+
+    CUcontext dummy;
+    if (cu->cuCtxPushCurrent(cuda_input->cu_ctx) != CUDA_SUCCESS) {
+        close(fd);
+        throw std::runtime_error("failed to make the CUDA context current");
+    }
+
+    CUDA_EXTERNAL_MEMORY_HANDLE_DESC mem_desc = {};
+    mem_desc.type = CU_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD;
+    mem_desc.handle.fd = fd;
+    mem_desc.size = output.size;
+    mem_desc.flags = CUDA_EXTERNAL_MEMORY_DEDICATED;
+    CUresult res = cu->cuImportExternalMemory(&cuda_input->ext_mem, &mem_desc);
+    if (res != CUDA_SUCCESS) {
+        // CUDA only owns the fd once the import succeeded
+        close(fd);
+    } else {
+        CUDA_EXTERNAL_MEMORY_BUFFER_DESC buffer_desc = {};
+        buffer_desc.offset = 0;
+        buffer_desc.size = output.size;
+        res = cu->cuExternalMemoryGetMappedBuffer(
+            &cuda_input->ptr, cuda_input->ext_mem, &buffer_desc
+        );
+    }
+    cu->cuCtxPopCurrent(&dummy);
+    if (res != CUDA_SUCCESS) {
+        throw std::runtime_error("failed to import the output memory: " + std::to_string(res));
+    }
+
+    // The buffer only keeps the frame refcounted, the memory belongs to the renderer
+    auto frame = av_frame_alloc();
+    cuda_input->frame = frame;
+    frame->format = AV_PIX_FMT_CUDA;
+    frame->width = encoder_ctx->width;
+    frame->height = encoder_ctx->height;
+    frame->data[0] = (uint8_t*)(cuda_input->ptr + layout.offset);
+    frame->linesize[0] = layout.rowPitch;
+    frame->buf[0] = av_buffer_create(
+        frame->data[0], layout.size, [](void*, uint8_t*) { }, nullptr, 0
+    );
+    frame->hw_frames_ctx = av_buffer_ref(encoder_ctx->hw_frames_ctx);
+    if (not frame->buf[0] or not frame->hw_frames_ctx) {
+        throw std::runtime_error("failed to allocate the CUDA input frame");
+    }
+    Info("Encoding the output in place from CUDA, pitch %u", (uint32_t)layout.rowPitch);
+}
+
 void alvr::EncodePipelineNvEnc::PushFrame(uint64_t targetTimestampNs, bool idr) {
     AVVkFrame* vkf = reinterpret_cast<AVVkFrame*>(vk_frame->data[0]);
     vkf->sem_value[0]++;
@@ -214,17 +354,37 @@ void alvr::EncodePipelineNvEnc::PushFrame(uint64_t targetTimestampNs, bool idr)
     submitInfo.pSignalSemaphores = &vkf->sem[0];
     VK_CHECK(vkQueueSubmit(r->m_queue, 1, &submitInfo, nullptr));
 
-    int err = av_hwframe_get_buffer(encoder_ctx->hw_frames_ctx, hw_frame, 0);
-    if (err < 0) {
-        throw alvr::AvException("Failed to allocate CUDA frame", err);
+    int err;
+    if (cuda_input) {
+        // NVENC reads the memory as soon as the frame is sent, the rendering must be complete
+        VkSemaphoreWaitInfo waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &vkf->sem[0];
+        waitInfo.pValues = &vkf->sem_value[0];
+        VK_CHECK(vkWaitSemaphores(r->m_dev, &waitInfo, UINT64_MAX));
+
+        err = av_frame_ref(hw_frame, cuda_input->frame);
+        if (err < 0) {
+            throw alvr::AvException("Failed to reference the CUDA input frame", err);
+        }
+    } else {
+        err = av_hwframe_get_buffer(encoder_ctx->hw_frames_ctx, hw_frame, 0);
+        if (err < 0) {
+            throw alvr::AvException("Failed to allocate CUDA frame", err);
+        }
+        err = av_hwframe_transfer_data(hw_frame, vk_frame.get(), 0);
+        if (err < 0) {
+            throw alvr::AvException("Failed to transfer Vulkan image to CUDA frame", err);
+        }
     }
-    err = av_hwframe_transfer_data(hw_frame, vk_frame.get(), 0);
-    if (err < 0) {
-        throw alvr::AvException("Failed to transfer Vulkan image to CUDA frame", err);
+    if (traced) {
+        FrameTraceMark(targetTimestampNs, FRAME_TRACE_FORMAT_CONVERT);
     }
 
     hw_frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
     hw_frame->pts = targetTimestampNs;
+    applyRoi(hw_frame);
 
     if ((err = avcodec_send_frame(encoder_ctx, hw_frame)) < 0) {
         throw alvr::AvException("avcodec_send_frame failed:", err);
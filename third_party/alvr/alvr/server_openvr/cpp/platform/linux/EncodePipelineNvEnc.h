@@ -28,12 +28,24 @@ public:
     );
 
     void PushFrame(uint64_t targetTimestampNs, bool idr) override;
+    // The refresh is continuous, so recovery needs no keyframe
+    bool SupportsIntraRefresh() override { return intra_refresh; }
+    // Encoding in place, the renderer can't overwrite the output before the frame is encoded
+    bool SupportsPipelining() override { return cuda_input == nullptr; }
 
 private:
+    struct CudaInput;
+
+    // Imports the renderer output into CUDA so that NVENC reads it in place. On failure the
+    // frames are copied with av_hwframe_transfer_data instead.
+    void importInput();
+
     Renderer* r = nullptr;
     std::unique_ptr<alvr::VkFrameCtx> vk_frame_ctx;
     AVBufferRef* hw_ctx = nullptr;
     std::unique_ptr<AVFrame, std::function<void(AVFrame*)>> vk_frame;
     AVFrame* hw_frame = nullptr;
+    std::unique_ptr<CudaInput> cuda_input;
+    bool intra_refresh = false;
 };
 }
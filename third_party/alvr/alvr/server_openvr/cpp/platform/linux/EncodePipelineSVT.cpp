@@ -0,0 +1,152 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "EncodePipelineSVT.h"
+
+#include "FormatConverter.h"
+#include "alvr_server/FrameTrace.h"
+#include "alvr_server/Logger.h"
+#include "alvr_server/Settings.h"
+#include "alvr_server/ThreadProfiles.h"
+#include "ffmpeg_helper.h"
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <climits>
+#include <sstream>
+#include <thread>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+
+int floor_log2(uint32_t value) {
+    int log2 = 0;
+    while ((value >> (log2 + 1)) != 0) {
+        log2++;
+    }
+    return log2;
+}
+
+// Tiles are the unit SVT-AV1 encodes in parallel beyond its segments, about one per 4 cores, or
+// more if the settings ask for more so the client can decode them in parallel. AV1 has at most 64
+// tiles, they aren't made narrower than 256 pixels or lower than 128.
+void tile_layout(uint32_t width, uint32_t height, int cores, int& log2_cols, int& log2_rows) {
+    const auto& settings = Settings::Instance();
+    int log2_tiles = 0;
+    while (log2_tiles < 6 && (4 << (log2_tiles + 1)) <= cores) {
+        log2_tiles++;
+    }
+    log2_cols = std::max((log2_tiles + 1) / 2, floor_log2(settings.m_encoderAv1TileColumns));
+    log2_rows = std::max(log2_tiles / 2, floor_log2(settings.m_encoderAv1TileRows));
+    while (log2_cols > 0 && (width >> log2_cols) < 256) {
+        log2_cols--;
+    }
+    while (log2_rows > 0 && (height >> log2_rows) < 128) {
+        log2_rows--;
+    }
+}
+
+}
+
+alvr::EncodePipelineSVT::EncodePipelineSVT(
+    Renderer* render, uint32_t width, uint32_t height, int numa_node
+) {
+    const auto& settings = Settings::Instance();
+
+    const AVCodec* codec = avcodec_find_encoder_by_name("libsvtav1");
+    if (codec == nullptr) {
+        throw std::runtime_error("Failed to find encoder libsvtav1");
+    }
+
+    encoder_ctx = avcodec_alloc_context3(codec);
+    if (not encoder_ctx) {
+        throw std::runtime_error("failed to allocate SVT-AV1 encoder");
+    }
+
+    encoder_ctx->width = width;
+    encoder_ctx->height = height;
+    encoder_ctx->time_base = { 1, (int)1e9 };
+    encoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    // The conversion shader writes limited range, like for x264
+    encoder_ctx->color_range = AVCOL_RANGE_MPEG;
+    encoder_ctx->max_b_frames = 0;
+    // Keyframes only when CEncoder asks for one
+    encoder_ctx->gop_size = INT_MAX;
+
+    auto params = FfiDynamicEncoderParams {};
+    params.updated = true;
+    params.bitrate_bps = 30'000'000;
+    params.framerate = settings.m_refreshRate;
+    SetParams(params);
+
+    // The encoder threads are started by avcodec_open2 and inherit the affinity of this thread, so
+    // limiting it for the open pins the whole pool to the isolated cores and the node of the GPU
+    uint64_t mask = EncoderThreadProfile(numa_node).nAffinityMask;
+    int cores
+        = mask ? (int)std::bitset<64>(mask).count() : (int)std::thread::hardware_concurrency();
+    int log2_cols, log2_rows;
+    tile_layout(width, height, cores, log2_cols, log2_rows);
+
+    // Low delay prediction without lookahead, and one of the real time presets
+    std::ostringstream svt_params;
+    svt_params << "pred-struct=1:tile-columns=" << log2_cols << ":tile-rows=" << log2_rows;
+    av_opt_set_int(encoder_ctx->priv_data, "preset", 12, 0);
+    av_opt_set_int(encoder_ctx->priv_data, "la_depth", 0, 0);
+    av_opt_set(encoder_ctx->priv_data, "svtav1-params", svt_params.str().c_str(), 0);
+
+    int err;
+    {
+        CScopedAffinity affinity(mask);
+        err = avcodec_open2(encoder_ctx, codec, NULL);
+    }
+    if (err < 0) {
+        throw alvr::AvException("Cannot open SVT-AV1 encoder:", err);
+    }
+    Info("SVT-AV1 on %d cores, %dx%d tiles", cores, 1 << log2_cols, 1 << log2_rows);
+
+    frame = av_frame_alloc();
+    frame->width = width;
+    frame->height = height;
+    frame->format = AV_PIX_FMT_YUV420P;
+
+    rgbtoyuv = new RgbToYuv420(
+        render,
+        render->GetOutput().image,
+        render->GetOutput().imageInfo,
+        render->GetOutput().semaphore
+    );
+    rgbtoyuv->BindToNumaNode(numa_node);
+}
+
+alvr::EncodePipelineSVT::~EncodePipelineSVT() {
+    if (rgbtoyuv) {
+        delete rgbtoyuv;
+    }
+    av_frame_free(&frame);
+}
+
+void alvr::EncodePipelineSVT::PushFrame(uint64_t targetTimestampNs, bool idr) {
+    // The frame points to the mapped planes, libavcodec copies them when it takes the frame, so a
+    // single output set is enough
+    rgbtoyuv->Convert(0, frame->data, frame->linesize);
+    rgbtoyuv->Sync();
+    if (traced) {
+        FrameTraceMark(targetTimestampNs, FRAME_TRACE_FORMAT_CONVERT);
+    }
+    timestamp.cpu = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()
+    )
+                        .count();
+
+    frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    frame->pts = targetTimestampNs;
+
+    int err;
+    if ((err = avcodec_send_frame(encoder_ctx, frame)) < 0) {
+        throw alvr::AvException("avcodec_send_frame failed:", err);
+    }
+}
@@ -0,0 +1,30 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "ALVR-common/packet_types.h"
+#include "EncodePipeline.h"
+
+class FormatConverter;
+
+namespace alvr {
+
+// SVT-AV1 through libavcodec, for hosts without a hardware encoder. The sliced threads of x264
+// stop scaling at about 8 threads, SVT-AV1 splits each frame into tiles and superblock segments
+// that its worker pool encodes in parallel, and still outputs one temporal unit per frame.
+class EncodePipelineSVT : public EncodePipeline {
+public:
+    ~EncodePipelineSVT();
+    // The encoder threads and the readback are kept on `numa_node` if not -1
+    EncodePipelineSVT(Renderer* render, uint32_t width, uint32_t height, int numa_node = -1);
+
+    void PushFrame(uint64_t targetTimestampNs, bool idr) override;
+    int GetCodec() override { return ALVR_CODEC_AV1; }
+
+private:
+    FormatConverter* rgbtoyuv = nullptr;
+    AVFrame* frame = nullptr;
+};
+
+}
@@ -3,14 +3,23 @@
 
 #include "EncodePipelineSW.h"
 
+#include <algorithm>
 #include <chrono>
+#include <iterator>
 
 #include "FormatConverter.h"
+#include "alvr_server/EncoderRoi.h"
+#include "alvr_server/FrameTrace.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
+#include "alvr_server/ThreadProfiles.h"
 
 namespace {
 
+// Presets StepQualityPreset moves through, from the initial one towards quality. The slower ones
+// can't keep up with a headset at any useful resolution.
+const char* const PRESETS[] = { "ultrafast", "superfast", "veryfast", "faster" };
+
 void x264_log(void*, int level, const char* fmt, va_list args) {
     char buf[256];
     vsnprintf(buf, sizeof(buf), fmt, args);
@@ -34,10 +43,13 @@ void x264_log(void*, int level, const char* fmt, va_list args) {
 
 }
 
-alvr::EncodePipelineSW::EncodePipelineSW(Renderer* render, uint32_t width, uint32_t height) {
+alvr::EncodePipelineSW::EncodePipelineSW(
+    Renderer* render, uint32_t width, uint32_t height, int numa_node
+)
+    : numa_node(numa_node) {
     const auto& settings = Settings::Instance();
 
-    x264_param_default_preset(&param, "ultrafast", "zerolatency");
+    x264_param_default_preset(&param, PRESETS[0], "zerolatency");
 
     param.pf_log = x264_log;
     param.i_log_level = X264_LOG_INFO;
@@ -46,9 +58,23 @@ alvr::EncodePipelineSW::EncodePipelineSW(Renderer* render, uint32_t width, uint3
     param.b_cabac = settings.m_entropyCoding == ALVR_CABAC;
     param.b_sliced_threads = true;
     param.i_threads = settings.m_swThreadCount;
+    if (settings.m_encoderMaxSliceBytes > 0) {
+        param.i_slice_max_size = settings.m_encoderMaxSliceBytes;
+    } else if (settings.m_encoderSlicesPerFrame > 1) {
+        param.i_slice_count = settings.m_encoderSlicesPerFrame;
+    }
     param.i_width = width;
     param.i_height = height;
     param.rc.i_rc_method = X264_RC_ABR;
+    if (settings.m_gazeRoiQpDelta > 0 && param.rc.i_aq_mode == X264_AQ_NONE) {
+        // quant_offsets are ignored without adaptive quantization, which ultrafast disables
+        param.rc.i_aq_mode = X264_AQ_VARIANCE;
+    }
+    if (settings.m_intraRefreshFrames > 0) {
+        // Refresh waves instead of keyframes, one wave per keyint
+        param.b_intra_refresh = 1;
+        param.i_keyint_max = settings.m_intraRefreshFrames;
+    }
 
     switch (settings.m_h264Profile) {
     case ALVR_H264_PROFILE_BASELINE:
@@ -63,32 +89,51 @@ alvr::EncodePipelineSW::EncodePipelineSW(Renderer* render, uint32_t width, uint3
         break;
     }
 
+    // Needs a higher value to hit the target bitrate, the calibration starts from it
+    bitrate_correction = 1.4f;
     auto params = FfiDynamicEncoderParams {};
     params.updated = true;
     params.bitrate_bps = 30'000'000;
     params.framerate = Settings::Instance().m_refreshRate;
     SetParams(params);
 
-    enc = x264_encoder_open(&param);
+    {
+        // The sliced threads are started by the open and inherit the affinity of this thread, and
+        // x264 first touches its frame buffers from them
+        CScopedAffinity affinity(EncoderThreadProfile(numa_node).nAffinityMask);
+        enc = x264_encoder_open(&param);
+    }
     if (!enc) {
         throw std::runtime_error("Failed to open encoder");
     }
 
-    x264_picture_init(&picture);
-    picture.img.i_csp = X264_CSP_I420;
-    picture.img.i_plane = 3;
-
-    x264_picture_init(&picture_out);
+    for (Slot& slot : slots) {
+        x264_picture_init(&slot.picture);
+        slot.picture.img.i_csp = X264_CSP_I420;
+        slot.picture.img.i_plane = 3;
+    }
 
     rgbtoyuv = new RgbToYuv420(
         render,
         render->GetOutput().image,
         render->GetOutput().imageInfo,
-        render->GetOutput().semaphore
+        render->GetOutput().semaphore,
+        RING_SIZE
     );
+    rgbtoyuv->BindToNumaNode(numa_node);
+
+    worker = std::thread(&EncodePipelineSW::EncodeLoop, this);
 }
 
 alvr::EncodePipelineSW::~EncodePipelineSW() {
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            exiting = true;
+        }
+        frame_pushed.Set();
+        worker.join();
+    }
     if (rgbtoyuv) {
         delete rgbtoyuv;
     }
@@ -98,49 +143,185 @@ alvr::EncodePipelineSW::~EncodePipelineSW() {
 }
 
 void alvr::EncodePipelineSW::PushFrame(uint64_t targetTimestampNs, bool idr) {
-    rgbtoyuv->Convert(picture.img.plane, picture.img.i_stride);
+    // The slot is free once its packet has been retrieved, which CEncoder does before pushing
+    // more than its pipeline depth
+    if (pushed - drained >= RING_SIZE) {
+        throw std::runtime_error("x264 frame ring overflow");
+    }
+    uint32_t index = pushed % RING_SIZE;
+    Slot& slot = slots[index];
+
+    // Sync only waits for the conversion, x264 then reads the mapped planes directly
+    rgbtoyuv->Convert(index, slot.picture.img.plane, slot.picture.img.i_stride);
     rgbtoyuv->Sync();
+    if (traced) {
+        FrameTraceMark(targetTimestampNs, FRAME_TRACE_FORMAT_CONVERT);
+    }
     timestamp.cpu = std::chrono::duration_cast<std::chrono::nanoseconds>(
                         std::chrono::steady_clock::now().time_since_epoch()
     )
                         .count();
 
-    picture.i_type = idr ? X264_TYPE_IDR : X264_TYPE_AUTO;
-    pts = picture.i_pts = targetTimestampNs;
-    is_idr = idr;
+    slot.picture.i_type = idr ? X264_TYPE_IDR : X264_TYPE_AUTO;
+    slot.pts = slot.picture.i_pts = targetTimestampNs;
 
-    int nnal = 0;
-    nal_size = x264_encoder_encode(enc, &nal, &nnal, &picture, &picture_out);
-    if (nal_size < 0) {
-        throw std::runtime_error("x264 encoder_encode failed");
+    EncoderRoi roi;
+    slot.picture.prop.quant_offsets = nullptr;
+    if (GetEncoderRoi(param.i_width, param.i_height, roi)) {
+        int mbWidth = (param.i_width + 15) / 16;
+        int mbHeight = (param.i_height + 15) / 16;
+        slot.quantOffsets.resize(mbWidth * mbHeight);
+        for (int y = 0; y < mbHeight; y++) {
+            for (int x = 0; x < mbWidth; x++) {
+                slot.quantOffsets[y * mbWidth + x] = RoiQpDelta(roi, x * 16 + 8, y * 16 + 8);
+            }
+        }
+        slot.picture.prop.quant_offsets = slot.quantOffsets.data();
+    }
+    slot.idr = idr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pushed++;
     }
+    frame_pushed.Set();
 }
 
 bool alvr::EncodePipelineSW::GetEncoded(FramePacket& packet) {
-    if (!nal) {
+    if (drained == pushed) {
         return false;
     }
-    packet.size = nal_size;
-    packet.data = nal[0].p_payload;
-    packet.pts = pts;
-    packet.isIDR = is_idr;
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (encoded > drained) {
+                break;
+            }
+        }
+        frame_encoded.Wait();
+    }
+    Slot& slot = slots[drained % RING_SIZE];
+    drained++;
+    if (slot.failed) {
+        throw std::runtime_error("x264 encoder_encode failed");
+    }
+
+    packet.size = slot.bitstream.size();
+    packet.data = slot.bitstream.data();
+    packet.pts = slot.pts;
+    packet.isIDR = slot.idr;
     return packet.size > 0;
 }
 
+void alvr::EncodePipelineSW::EncodeLoop() {
+    ApplyThreadProfile(EncoderThreadProfile(numa_node));
+
+    x264_picture_t picture_out;
+    x264_picture_init(&picture_out);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        while (!exiting && encoded == pushed) {
+            lock.unlock();
+            frame_pushed.Wait();
+            lock.lock();
+        }
+        if (exiting) {
+            return;
+        }
+        Slot& slot = slots[encoded % RING_SIZE];
+        // Reconfigure between frames, never while an encode is running
+        bool reconfig = param_changed;
+        x264_param_t new_param = param;
+        param_changed = false;
+        bool refresh = intra_refresh;
+        intra_refresh = false;
+        lock.unlock();
+
+        if (reconfig) {
+            x264_encoder_reconfig(enc, &new_param);
+        }
+        if (refresh) {
+            x264_encoder_intra_refresh(enc);
+        }
+
+        x264_nal_t* nal = nullptr;
+        int nnal = 0;
+        int size = x264_encoder_encode(enc, &nal, &nnal, &slot.picture, &picture_out);
+        slot.failed = size < 0;
+        // The NAL payloads are contiguous but only valid until the next encode call
+        if (size > 0) {
+            slot.bitstream.assign(nal[0].p_payload, nal[0].p_payload + size);
+        } else {
+            slot.bitstream.clear();
+        }
+
+        lock.lock();
+        encoded++;
+        frame_encoded.Set();
+    }
+}
+
+bool alvr::EncodePipelineSW::SupportsIntraRefresh() {
+    return Settings::Instance().m_intraRefreshFrames > 0;
+}
+
+void alvr::EncodePipelineSW::InsertIntraRefresh() {
+    std::lock_guard<std::mutex> lock(mutex);
+    intra_refresh = true;
+}
+
+bool alvr::EncodePipelineSW::StepQualityPreset(int step) {
+    int index = preset_index + (step > 0 ? 1 : -1);
+    if (index < 0 || index >= (int)std::size(PRESETS)) {
+        return false;
+    }
+    x264_param_t preset;
+    x264_param_default_preset(&preset, PRESETS[index], "zerolatency");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    preset_index = index;
+    // Reconfiguration takes the analysis and deblocking parameters, which is what tells these
+    // presets apart. The rate control and slicing settings are kept.
+    param.analyse = preset.analyse;
+    param.b_deblocking_filter = preset.b_deblocking_filter;
+    param_changed = enc != nullptr;
+    return true;
+}
+
 void alvr::EncodePipelineSW::SetParams(FfiDynamicEncoderParams params) {
     if (!params.updated) {
         return;
     }
+    std::lock_guard<std::mutex> lock(mutex);
     // x264 doesn't work well with adaptive bitrate/fps
     param.i_fps_num = Settings::Instance().m_refreshRate;
     param.i_fps_den = 1;
-    param.rc.i_bitrate
-        = params.bitrate_bps / 1'000 * 1.4; // needs higher value to hit target bitrate
-    param.rc.i_vbv_buffer_size = param.rc.i_bitrate / param.i_fps_num * 1.1;
+    param.rc.i_bitrate = params.bitrate_bps * bitrate_correction / 1'000;
+    updateVbvBuffer();
     param.rc.i_vbv_max_bitrate = param.rc.i_bitrate;
     param.rc.f_vbv_buffer_init = 0.75;
-    if (enc) {
-        x264_encoder_reconfig(enc, &param);
+    // Applied by the encode thread before its next frame
+    param_changed = enc != nullptr;
+}
+
+void alvr::EncodePipelineSW::SetFrameBudget(uint32_t maxFrameBytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (maxFrameBytes == frame_budget) {
+        return;
+    }
+    frame_budget = maxFrameBytes;
+    updateVbvBuffer();
+    param_changed = enc != nullptr;
+}
+
+void alvr::EncodePipelineSW::updateVbvBuffer() {
+    // In kbit. A single frame buffer caps each frame, and x264 applies it from the next frame on
+    param.rc.i_vbv_buffer_size = param.rc.i_bitrate / param.i_fps_num * 1.1;
+    if (frame_budget > 0) {
+        param.rc.i_vbv_buffer_size
+            = std::min<int>(param.rc.i_vbv_buffer_size, std::max<int>(frame_budget * 8 / 1000, 1));
     }
 }
 
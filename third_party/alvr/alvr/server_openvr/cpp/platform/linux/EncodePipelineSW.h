@@ -5,6 +5,10 @@
 
 #include "EncodePipeline.h"
 
+#include "shared/threadtools.h"
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <x264.h>
 
 class FormatConverter;
@@ -14,22 +18,60 @@ namespace alvr {
 class EncodePipelineSW : public EncodePipeline {
 public:
     ~EncodePipelineSW();
-    EncodePipelineSW(Renderer* render, uint32_t width, uint32_t height);
+    // The x264 threads and the readback are kept on `numa_node` if not -1
+    EncodePipelineSW(Renderer* render, uint32_t width, uint32_t height, int numa_node = -1);
 
     void PushFrame(uint64_t targetTimestampNs, bool idr) override;
     bool GetEncoded(FramePacket& packet) override;
+    std::function<void()> LeasePacket() override { return {}; }
     void SetParams(FfiDynamicEncoderParams params) override;
+    void SetFrameBudget(uint32_t maxFrameBytes) override;
+    bool SupportsIntraRefresh() override;
+    // Restarts the refresh wave at the next encoded frame
+    void InsertIntraRefresh() override;
+    bool StepQualityPreset(int step) override;
     int GetCodec() override;
+    std::string GetEncoderName() override { return "x264"; }
+    bool SupportsMaxSliceBytes() override { return true; }
 
 private:
+    // One frame in flight: its YUV planes (a FormatConverter output set) and its bitstream.
+    struct Slot {
+        x264_picture_t picture;
+        std::vector<uint8_t> bitstream;
+        // Gaze ROI offset of each MB, read by x264 while it encodes the slot
+        std::vector<float> quantOffsets;
+        uint64_t pts = 0;
+        bool idr = false;
+        bool failed = false;
+    };
+    // Matches the maximum CEncoder pipeline depth.
+    static constexpr uint32_t RING_SIZE = 3;
+
+    void EncodeLoop();
+    // VBV buffer for the current bitrate, capped to frame_budget
+    void updateVbvBuffer();
+
     x264_t* enc = nullptr;
     x264_param_t param;
-    x264_picture_t picture;
-    x264_picture_t picture_out;
-    x264_nal_t* nal = nullptr;
-    int nal_size = 0;
-    int64_t pts = 0;
-    bool is_idr = false;
+    bool param_changed = false;
+    // In PRESETS
+    int preset_index = 0;
+    uint32_t frame_budget = 0;
+    bool intra_refresh = false;
+    Slot slots[RING_SIZE];
+    // Frame counters: converted by PushFrame, encoded by the worker, retrieved by GetEncoded.
+    uint64_t pushed = 0;
+    uint64_t encoded = 0;
+    uint64_t drained = 0;
+    bool exiting = false;
+    int numa_node;
+    std::mutex mutex;
+    // Signalled for the worker by PushFrame and the destructor, and by the worker for GetEncoded,
+    // which polls briefly since it waits for an encode about to finish
+    CThreadEvent frame_pushed;
+    CThreadEvent frame_encoded { false, 2000 };
+    std::thread worker;
     FormatConverter* rgbtoyuv = nullptr;
 };
 }
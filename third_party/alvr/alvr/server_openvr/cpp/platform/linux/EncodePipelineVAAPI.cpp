@@ -3,19 +3,23 @@
 
 #include "EncodePipelineVAAPI.h"
 #include "ALVR-common/packet_types.h"
+#include "alvr_server/FrameTrace.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
+#include "alvr_server/VramBudget.h"
 #include "ffmpeg_helper.h"
+#include <algorithm>
 #include <chrono>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
-#include <libavfilter/avfilter.h>
-#include <libavfilter/buffersink.h>
-#include <libavfilter/buffersrc.h>
 #include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_drm.h>
+#include <libavutil/hwcontext_vaapi.h>
 #include <libavutil/opt.h>
 }
+#include <va/va.h>
+#include <va/va_vpp.h>
 
 namespace {
 
@@ -31,7 +35,13 @@ const char* encoder(ALVR_CODEC codec) {
     throw std::runtime_error("invalid codec " + std::to_string(codec));
 }
 
-void set_hwframe_ctx(AVCodecContext* ctx, AVBufferRef* hw_device_ctx) {
+bool use_10bit() {
+    return (Settings::Instance().m_codec == ALVR_CODEC_HEVC
+            || Settings::Instance().m_codec == ALVR_CODEC_AV1)
+        && Settings::Instance().m_use10bitEncoder;
+}
+
+void set_hwframe_ctx(AVCodecContext* ctx, AVBufferRef* hw_device_ctx, int pool_size) {
     AVBufferRef* hw_frames_ref;
     AVHWFramesContext* frames_ctx = NULL;
     int err = 0;
@@ -41,14 +51,10 @@ void set_hwframe_ctx(AVCodecContext* ctx, AVBufferRef* hw_device_ctx) {
     }
     frames_ctx = (AVHWFramesContext*)(hw_frames_ref->data);
     frames_ctx->format = AV_PIX_FMT_VAAPI;
-    frames_ctx->sw_format = (Settings::Instance().m_codec == ALVR_CODEC_HEVC
-                             || Settings::Instance().m_codec == ALVR_CODEC_AV1)
-            && Settings::Instance().m_use10bitEncoder
-        ? AV_PIX_FMT_P010
-        : AV_PIX_FMT_NV12;
+    frames_ctx->sw_format = use_10bit() ? AV_PIX_FMT_P010 : AV_PIX_FMT_NV12;
     frames_ctx->width = ctx->width;
     frames_ctx->height = ctx->height;
-    frames_ctx->initial_pool_size = 3;
+    frames_ctx->initial_pool_size = pool_size;
     if ((err = av_hwframe_ctx_init(hw_frames_ref)) < 0) {
         av_buffer_unref(&hw_frames_ref);
         throw alvr::AvException("Failed to initialize VAAPI frame context:", err);
@@ -92,11 +98,15 @@ map_frame(AVBufferRef* hw_frames_ref, AVBufferRef* drm_device_ctx, alvr::VkFrame
     vk_frame->data[0] = (uint8_t*)(AVDRMFrameDescriptor*)input_frame;
     vk_frame->format = AV_PIX_FMT_DRM_PRIME;
     vk_frame->buf[0] = av_buffer_alloc(1);
-    av_hwframe_map(mapped_frame, vk_frame, AV_HWFRAME_MAP_READ);
+    err = av_hwframe_map(mapped_frame, vk_frame, AV_HWFRAME_MAP_READ);
     av_frame_free(&vk_frame);
 
     av_buffer_unref(&hw_frames_ref);
 
+    if (err < 0) {
+        av_frame_free(&mapped_frame);
+        throw alvr::DrmImportError("Failed to map the output into VAAPI:", err);
+    }
     return mapped_frame;
 }
 
@@ -121,8 +131,8 @@ AVFrame* import_frame(AVBufferRef* hw_frames_ref, DrmImage& drm) {
     drm.modifier = desc->objects[0].format_modifier;
     drm.planes = desc->layers[0].nb_planes;
     for (uint32_t i = 0; i < drm.planes; ++i) {
-        drm.strides[0] = desc->layers[0].planes[i].pitch;
-        drm.offsets[0] = desc->layers[0].planes[i].offset;
+        drm.strides[i] = desc->layers[0].planes[i].pitch;
+        drm.offsets[i] = desc->layers[0].planes[i].offset;
     }
 
     return va_frame;
@@ -131,21 +141,27 @@ AVFrame* import_frame(AVBufferRef* hw_frames_ref, DrmImage& drm) {
 }
 
 alvr::EncodePipelineVAAPI::EncodePipelineVAAPI(
-    Renderer* render, VkContext& vk_ctx, VkFrame& input_frame, uint32_t width, uint32_t height
+    Renderer* render,
+    VkContext& vk_ctx,
+    VkFrame& input_frame,
+    uint32_t width,
+    uint32_t height,
+    bool shared_input
 )
     : r(render) {
     /* VAAPI Encoding pipeline
      * The encoding pipeline has 3 frame types:
      * - input vulkan frames, only used to initialize the mapped frames
      * - mapped frames, one per input frame, same format, and point to the same memory on the device
-     * - encoder frame, with a format compatible with the encoder, created by the filter
+     * - encoder frames, with a format compatible with the encoder, from the encoder frame pool
      * Each frame type has a corresponding hardware frame context, the vulkan one is provided
      *
-     * The pipeline is simply made of a scale_vaapi object, that does the conversion between formats
-     * and the encoder that takes the converted frame and produces packets.
+     * The pipeline is simply made of a VA-API video processing pass, that does the conversion
+     * between formats like scale_vaapi, and the encoder that takes the converted frame and
+     * produces packets.
      */
     int err = av_hwdevice_ctx_create(
-        &hw_ctx, AV_HWDEVICE_TYPE_VAAPI, vk_ctx.devicePath.c_str(), NULL, 0
+        &hw_ctx, AV_HWDEVICE_TYPE_VAAPI, vk_ctx.encodeDevicePath.c_str(), NULL, 0
     );
     if (err < 0) {
         throw alvr::AvException("Failed to create a VAAPI device:", err);
@@ -208,6 +224,7 @@ alvr::EncodePipelineVAAPI::EncodePipelineVAAPI(
         break;
     case ALVR_CODEC_AV1:
         encoder_ctx->profile = FF_PROFILE_AV1_MAIN;
+        applyAv1Tiles();
         break;
     }
 
@@ -230,6 +247,9 @@ alvr::EncodePipelineVAAPI::EncodePipelineVAAPI(
     encoder_ctx->pix_fmt = AV_PIX_FMT_VAAPI;
     encoder_ctx->max_b_frames = 0;
     encoder_ctx->color_range = AVCOL_RANGE_JPEG;
+    if (settings.m_encoderSlicesPerFrame > 1) {
+        encoder_ctx->slices = settings.m_encoderSlicesPerFrame;
+    }
 
     auto params = FfiDynamicEncoderParams {};
     params.updated = true;
@@ -244,44 +264,56 @@ alvr::EncodePipelineVAAPI::EncodePipelineVAAPI(
                              // quality by allocating more bits to smooth areas
     switch (settings.m_encoderQualityPreset) {
     case ALVR_QUALITY:
-        if (vk_ctx.amd) {
+        if (vk_ctx.encodeAmd) {
             quality.preset_mode = PRESET_MODE_QUALITY;
             encoder_ctx->compression_level
                 = quality.quality; // (QUALITY preset, no pre-encoding, vbaq)
-        } else if (vk_ctx.intel) {
+        } else if (vk_ctx.encodeIntel) {
             encoder_ctx->compression_level = 1;
         }
         break;
     case ALVR_BALANCED:
-        if (vk_ctx.amd) {
+        if (vk_ctx.encodeAmd) {
             quality.preset_mode = PRESET_MODE_BALANCE;
             encoder_ctx->compression_level
                 = quality.quality; // (BALANCE preset, no pre-encoding, vbaq)
-        } else if (vk_ctx.intel) {
+        } else if (vk_ctx.encodeIntel) {
             encoder_ctx->compression_level = 4;
         }
         break;
     case ALVR_SPEED:
     default:
-        if (vk_ctx.amd) {
+        if (vk_ctx.encodeAmd) {
             quality.preset_mode = PRESET_MODE_SPEED;
             encoder_ctx->compression_level
                 = quality.quality; // (speed preset, no pre-encoding, vbaq)
-        } else if (vk_ctx.intel) {
+        } else if (vk_ctx.encodeIntel) {
             encoder_ctx->compression_level = 7;
         }
         break;
     }
 
-    av_opt_set_int(encoder_ctx->priv_data, "async_depth", 1, 0);
+    // Keeping several frames in the encoder lets encoding overlap with the next render, at the
+    // cost of output latency. The retrieval of a frame then waits for the next ones, that the
+    // dynamic resolution encoders can't do as they may be drained at any time.
+    if (!shared_input && Settings::Instance().m_dynamicResolutionBitrateMbps == 0) {
+        async_depth = VramLimitedDepth(
+            std::clamp<uint32_t>(Settings::Instance().m_linuxEncodePipelineDepth, 1, 3)
+        );
+    }
+    av_opt_set_int(encoder_ctx->priv_data, "async_depth", async_depth, 0);
 
-    set_hwframe_ctx(encoder_ctx, hw_ctx);
+    // The encoder holds async_depth surfaces while the next one is converted
+    const uint32_t convert_count = async_depth + 1;
+    set_hwframe_ctx(encoder_ctx, hw_ctx, 3 + convert_count);
 
     err = avcodec_open2(encoder_ctx, codec, NULL);
     if (err < 0) {
         throw alvr::AvException("Cannot open video encoder codec:", err);
     }
 
+    encoder_frame = av_frame_alloc();
+
     AVBufferRef* hw_frames_ref;
     if (!(hw_frames_ref = av_hwframe_ctx_alloc(hw_ctx))) {
         throw std::runtime_error("Failed to create VAAPI frame context.");
@@ -297,8 +329,9 @@ alvr::EncodePipelineVAAPI::EncodePipelineVAAPI(
         throw alvr::AvException("Failed to initialize VAAPI frame context:", err);
     }
 
-    encoder_frame = av_frame_alloc();
-    if (vk_ctx.intel || getenv("ALVR_VAAPI_IMPORT_SURFACE")) {
+    // A VA surface of another GPU has a tiling the Vulkan device can't render to
+    if (!shared_input && !vk_ctx.crossDeviceEncode
+        && (vk_ctx.intel || getenv("ALVR_VAAPI_IMPORT_SURFACE"))) {
         Info("Importing VA surface");
         DrmImage drm;
         mapped_frame = import_frame(hw_frames_ref, drm);
@@ -307,78 +340,83 @@ alvr::EncodePipelineVAAPI::EncodePipelineVAAPI(
         mapped_frame = map_frame(hw_frames_ref, drm_ctx, input_frame);
     }
 
-    filter_graph = avfilter_graph_alloc();
-
-    AVFilterInOut* outputs = avfilter_inout_alloc();
-    AVFilterInOut* inputs = avfilter_inout_alloc();
-
-    std::stringstream buffer_filter_args;
-    buffer_filter_args << "video_size=" << mapped_frame->width << "x" << mapped_frame->height;
-    buffer_filter_args << ":pix_fmt=" << mapped_frame->format;
-    buffer_filter_args << ":time_base=" << encoder_ctx->time_base.num << "/"
-                       << encoder_ctx->time_base.den;
-    if ((err = avfilter_graph_create_filter(
-             &filter_in,
-             avfilter_get_by_name("buffer"),
-             "in",
-             buffer_filter_args.str().c_str(),
-             NULL,
-             filter_graph
-         ))) {
-        throw alvr::AvException("filter_in creation failed:", err);
-    }
-    AVBufferSrcParameters* par = av_buffersrc_parameters_alloc();
-    memset(par, 0, sizeof(*par));
-    par->format = AV_PIX_FMT_NONE;
-    par->hw_frames_ctx = av_buffer_ref(mapped_frame->hw_frames_ctx);
-    av_buffersrc_parameters_set(filter_in, par);
-    av_free(par);
-
-    if ((err = avfilter_graph_create_filter(
-             &filter_out, avfilter_get_by_name("buffersink"), "out", NULL, NULL, filter_graph
-         ))) {
-        throw alvr::AvException("filter_out creation failed:", err);
-    }
-
-    outputs->name = av_strdup("in");
-    outputs->filter_ctx = filter_in;
-    outputs->pad_idx = 0;
-    outputs->next = NULL;
-
-    inputs->name = av_strdup("out");
-    inputs->filter_ctx = filter_out;
-    inputs->pad_idx = 0;
-    inputs->next = NULL;
-
-    std::string filters = "scale_vaapi=out_range=full:format=";
-    if ((Settings::Instance().m_codec == ALVR_CODEC_HEVC
-         || Settings::Instance().m_codec == ALVR_CODEC_AV1)
-        && Settings::Instance().m_use10bitEncoder) {
-        filters += "p010";
-    } else {
-        filters += "nv12";
-    }
-    if ((err = avfilter_graph_parse_ptr(filter_graph, filters.c_str(), &inputs, &outputs, NULL))
-        < 0) {
-        throw alvr::AvException("avfilter_graph_parse_ptr failed:", err);
-    }
+    initVpp();
+}
 
-    avfilter_inout_free(&outputs);
-    avfilter_inout_free(&inputs);
+void alvr::EncodePipelineVAAPI::initVpp() {
+    auto device_ctx = (AVHWDeviceContext*)hw_ctx->data;
+    va_display = ((AVVAAPIDeviceContext*)device_ctx->hwctx)->display;
 
-    for (unsigned i = 0; i < filter_graph->nb_filters; ++i) {
-        filter_graph->filters[i]->hw_device_ctx = av_buffer_ref(hw_ctx);
+    VAStatus status = vaCreateConfig(
+        va_display, VAProfileNone, VAEntrypointVideoProc, nullptr, 0, &vpp_config
+    );
+    if (status != VA_STATUS_SUCCESS) {
+        throw std::runtime_error(
+            std::string("Failed to create the VA-API video processing config: ")
+            + vaErrorStr(status)
+        );
+    }
+
+    // The render targets are the surfaces of the fixed encoder pool
+    auto frames_ctx = (AVHWFramesContext*)encoder_ctx->hw_frames_ctx->data;
+    auto va_frames = (AVVAAPIFramesContext*)frames_ctx->hwctx;
+    status = vaCreateContext(
+        va_display,
+        vpp_config,
+        encoder_ctx->width,
+        encoder_ctx->height,
+        VA_PROGRESSIVE,
+        va_frames->surface_ids,
+        va_frames->nb_surfaces,
+        &vpp_context
+    );
+    if (status != VA_STATUS_SUCCESS) {
+        throw std::runtime_error(
+            std::string("Failed to create the VA-API video processing context: ")
+            + vaErrorStr(status)
+        );
     }
+}
 
-    if ((err = avfilter_graph_config(filter_graph, NULL))) {
-        throw alvr::AvException("avfilter_graph_config failed:", err);
+void alvr::EncodePipelineVAAPI::convertVpp() {
+    auto display = (VADisplay)va_display;
+    // What scale_vaapi sets for full range output, scaling to the encoder size if it differs
+    VAProcPipelineParameterBuffer params = {};
+    params.surface = (VASurfaceID)(uintptr_t)mapped_frame->data[3];
+    params.surface_color_standard = VAProcColorStandardBT709;
+    params.output_background_color = 0xff000000;
+    params.output_color_standard = VAProcColorStandardBT709;
+    params.filter_flags = VA_FILTER_SCALING_DEFAULT;
+    params.output_color_properties.color_range = VA_SOURCE_RANGE_FULL;
+
+    VABufferID buffer;
+    VAStatus status = vaCreateBuffer(
+        display, vpp_context, VAProcPipelineParameterBufferType, sizeof(params), 1, &params, &buffer
+    );
+    if (status != VA_STATUS_SUCCESS) {
+        throw std::runtime_error(std::string("vaCreateBuffer failed: ") + vaErrorStr(status));
+    }
+    // The encoder is queued after the conversion on the same surface, nothing is waited for
+    VASurfaceID target = (VASurfaceID)(uintptr_t)encoder_frame->data[3];
+    status = vaBeginPicture(display, vpp_context, target);
+    if (status == VA_STATUS_SUCCESS) {
+        status = vaRenderPicture(display, vpp_context, &buffer, 1);
+        VAStatus end_status = vaEndPicture(display, vpp_context);
+        if (status == VA_STATUS_SUCCESS) {
+            status = end_status;
+        }
+    }
+    vaDestroyBuffer(display, buffer);
+    if (status != VA_STATUS_SUCCESS) {
+        throw std::runtime_error(
+            std::string("VA-API video processing failed: ") + vaErrorStr(status)
+        );
     }
 }
 
 alvr::EncodePipelineVAAPI::~EncodePipelineVAAPI() {
     // Commented because freeing it here causes a gpu reset, it should be cleaned up away
     // avcodec_free_context(&encoder_ctx);
-    // avfilter_graph_free(&filter_graph);
     // av_frame_free(&mapped_frame);
     // av_frame_free(&encoder_frame);
     // av_buffer_unref(&hw_ctx);
@@ -386,24 +424,23 @@ alvr::EncodePipelineVAAPI::~EncodePipelineVAAPI() {
 }
 
 void alvr::EncodePipelineVAAPI::PushFrame(uint64_t targetTimestampNs, bool idr) {
+    int err;
     r->Sync();
     timestamp.cpu = std::chrono::duration_cast<std::chrono::nanoseconds>(
                         std::chrono::steady_clock::now().time_since_epoch()
     )
                         .count();
-    int err = av_buffersrc_add_frame_flags(
-        filter_in, mapped_frame, AV_BUFFERSRC_FLAG_PUSH | AV_BUFFERSRC_FLAG_KEEP_REF
-    );
-    if (err != 0) {
-        throw alvr::AvException("av_buffersrc_add_frame failed", err);
+    if ((err = av_hwframe_get_buffer(encoder_ctx->hw_frames_ctx, encoder_frame, 0)) < 0) {
+        throw alvr::AvException("Failed to get hwframe buffer:", err);
     }
-    err = av_buffersink_get_frame(filter_out, encoder_frame);
-    if (err != 0) {
-        throw alvr::AvException("av_buffersink_get_frame failed", err);
+    convertVpp();
+    if (traced) {
+        FrameTraceMark(targetTimestampNs, FRAME_TRACE_FORMAT_CONVERT);
     }
 
     encoder_frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
     encoder_frame->pts = targetTimestampNs;
+    applyRoi(encoder_frame);
 
     if ((err = avcodec_send_frame(encoder_ctx, encoder_frame)) < 0) {
         throw alvr::AvException("avcodec_send_frame failed: ", err);
@@ -415,7 +452,7 @@ void alvr::EncodePipelineVAAPI::SetParams(FfiDynamicEncoderParams params) {
     if (!params.updated) {
         return;
     }
-    encoder_ctx->bit_rate = params.bitrate_bps;
+    encoder_ctx->bit_rate = params.bitrate_bps * bitrate_correction;
     encoder_ctx->framerate = AVRational { int(params.framerate * 1000), 1000 };
     encoder_ctx->rc_buffer_size = encoder_ctx->bit_rate / params.framerate;
     encoder_ctx->rc_max_rate = encoder_ctx->bit_rate;
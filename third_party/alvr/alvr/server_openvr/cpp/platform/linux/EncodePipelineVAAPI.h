@@ -7,8 +7,6 @@
 
 extern "C" struct AVBufferRef;
 extern "C" struct AVCodecContext;
-extern "C" struct AVFilterContext;
-extern "C" struct AVFilterGraph;
 extern "C" struct AVFrame;
 
 class Renderer;
@@ -25,21 +23,36 @@ class EncodePipelineVAAPI : public EncodePipeline {
 public:
     ~EncodePipelineVAAPI();
     EncodePipelineVAAPI(
-        Renderer* render, VkContext& vk_ctx, VkFrame& input_frame, uint32_t width, uint32_t height
+        Renderer* render,
+        VkContext& vk_ctx,
+        VkFrame& input_frame,
+        uint32_t width,
+        uint32_t height,
+        bool shared_input = false
     );
 
     void PushFrame(uint64_t targetTimestampNs, bool idr) override;
     void SetParams(FfiDynamicEncoderParams params) override;
+    bool SupportsScaling() override { return true; }
+    uint32_t GetAsyncDepth() override { return async_depth; }
 
 private:
+    // Creates the video processing context that converts the mapped frame to encoder surfaces
+    void initVpp();
+    // Converts the mapped frame into the encoder surface of encoder_frame
+    void convertVpp();
+
     Renderer* r = nullptr;
     AVBufferRef* hw_ctx = nullptr;
     AVBufferRef* drm_ctx = nullptr;
     AVFrame* mapped_frame = nullptr;
     AVFrame* encoder_frame = nullptr;
-    AVFilterGraph* filter_graph = nullptr;
-    AVFilterContext* filter_in = nullptr;
-    AVFilterContext* filter_out = nullptr;
+    // VA-API video processing, in place of a scale_vaapi filter graph. The VADisplay, VAConfigID
+    // and VAContextID, the ids are VA_INVALID_ID until created.
+    void* va_display = nullptr;
+    unsigned int vpp_config = 0xffffffff;
+    unsigned int vpp_context = 0xffffffff;
+    uint32_t async_depth = 1;
 
     union vlVaQualityBits {
         unsigned int quality;
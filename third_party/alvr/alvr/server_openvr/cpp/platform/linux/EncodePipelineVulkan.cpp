@@ -0,0 +1,278 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "EncodePipelineVulkan.h"
+#include "ALVR-common/packet_types.h"
+#include "alvr_server/FrameTrace.h"
+#include "alvr_server/Logger.h"
+#include "alvr_server/Settings.h"
+#include "ffmpeg_helper.h"
+#include <chrono>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_vulkan.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+
+const char* encoder(ALVR_CODEC codec) {
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        return "h264_vulkan";
+    case ALVR_CODEC_HEVC:
+        return "hevc_vulkan";
+    case ALVR_CODEC_AV1:
+        return "av1_vulkan";
+    }
+    throw std::runtime_error("invalid codec " + std::to_string(codec));
+}
+
+} // namespace
+
+alvr::EncodePipelineVulkan::EncodePipelineVulkan(
+    Renderer* render,
+    VkContext& vk_ctx,
+    VkFrame& input_frame,
+    VkImageCreateInfo& image_create_info,
+    uint32_t width,
+    uint32_t height
+)
+    : r(render) {
+    if (vk_ctx.encodeQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED) {
+        throw std::runtime_error("the Vulkan device has no video encode queue");
+    }
+
+    const auto& settings = Settings::Instance();
+
+    auto codec_id = ALVR_CODEC(settings.m_codec);
+    const char* encoder_name = encoder(codec_id);
+    const AVCodec* codec = avcodec_find_encoder_by_name(encoder_name);
+    if (codec == nullptr) {
+        throw std::runtime_error(std::string("Failed to find encoder ") + encoder_name);
+    }
+
+    vk_frame_ctx = std::make_unique<alvr::VkFrameCtx>(vk_ctx, image_create_info);
+    vk_frame = input_frame.make_av_frame(*vk_frame_ctx);
+
+    /* Vulkan encoding pipeline
+     * - the renderer output, wrapped as a Vulkan frame of the shared device
+     * - scale_vulkan converting it to NV12 at the encoding size, in frames that the encoder can
+     *   read directly (video maintenance 1 makes them independent of the video profile)
+     * - the Vulkan Video encoder, on the encode queue of the same device
+     */
+    filter_graph = avfilter_graph_alloc();
+
+    AVFilterInOut* outputs = avfilter_inout_alloc();
+    AVFilterInOut* inputs = avfilter_inout_alloc();
+
+    int err;
+    std::stringstream buffer_filter_args;
+    buffer_filter_args << "video_size=" << vk_frame->width << "x" << vk_frame->height;
+    buffer_filter_args << ":pix_fmt=" << AV_PIX_FMT_VULKAN;
+    buffer_filter_args << ":time_base=1/" << (int)1e9;
+    if ((err = avfilter_graph_create_filter(
+             &filter_in,
+             avfilter_get_by_name("buffer"),
+             "in",
+             buffer_filter_args.str().c_str(),
+             NULL,
+             filter_graph
+         ))) {
+        throw alvr::AvException("filter_in creation failed:", err);
+    }
+    AVBufferSrcParameters* par = av_buffersrc_parameters_alloc();
+    memset(par, 0, sizeof(*par));
+    par->format = AV_PIX_FMT_NONE;
+    par->hw_frames_ctx = av_buffer_ref(vk_frame_ctx->ctx);
+    av_buffersrc_parameters_set(filter_in, par);
+    av_free(par);
+
+    if ((err = avfilter_graph_create_filter(
+             &filter_out, avfilter_get_by_name("buffersink"), "out", NULL, NULL, filter_graph
+         ))) {
+        throw alvr::AvException("filter_out creation failed:", err);
+    }
+
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = filter_in;
+    outputs->pad_idx = 0;
+    outputs->next = NULL;
+
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = filter_out;
+    inputs->pad_idx = 0;
+    inputs->next = NULL;
+
+    if (settings.m_use10bitEncoder) {
+        Warn("The Vulkan encoder only encodes 8 bit, ignoring the 10 bit setting");
+    }
+    std::string filters = "scale_vulkan=format=nv12:out_range=full";
+    if (width != image_create_info.extent.width || height != image_create_info.extent.height) {
+        filters += ":w=" + std::to_string(width) + ":h=" + std::to_string(height);
+    }
+    if ((err = avfilter_graph_parse_ptr(filter_graph, filters.c_str(), &inputs, &outputs, NULL))
+        < 0) {
+        throw alvr::AvException("avfilter_graph_parse_ptr failed:", err);
+    }
+
+    avfilter_inout_free(&outputs);
+    avfilter_inout_free(&inputs);
+
+    for (unsigned i = 0; i < filter_graph->nb_filters; ++i) {
+        filter_graph->filters[i]->hw_device_ctx = av_buffer_ref(vk_ctx.ctx);
+    }
+
+    if ((err = avfilter_graph_config(filter_graph, NULL))) {
+        throw alvr::AvException("avfilter_graph_config failed:", err);
+    }
+
+    encoder_ctx = avcodec_alloc_context3(codec);
+    if (not encoder_ctx) {
+        throw std::runtime_error("failed to allocate Vulkan encoder");
+    }
+
+    switch (codec_id) {
+    case ALVR_CODEC_H264:
+        switch (settings.m_h264Profile) {
+        case ALVR_H264_PROFILE_BASELINE:
+            encoder_ctx->profile = FF_PROFILE_H264_BASELINE;
+            break;
+        case ALVR_H264_PROFILE_MAIN:
+            encoder_ctx->profile = FF_PROFILE_H264_MAIN;
+            break;
+        default:
+        case ALVR_H264_PROFILE_HIGH:
+            encoder_ctx->profile = FF_PROFILE_H264_HIGH;
+            break;
+        }
+        break;
+    case ALVR_CODEC_HEVC:
+        encoder_ctx->profile = FF_PROFILE_HEVC_MAIN;
+        break;
+    case ALVR_CODEC_AV1:
+        encoder_ctx->profile = FF_PROFILE_AV1_MAIN;
+        applyAv1Tiles();
+        break;
+    }
+
+    switch (settings.m_rateControlMode) {
+    case ALVR_VBR:
+        av_opt_set(encoder_ctx->priv_data, "rc_mode", "vbr", 0);
+        break;
+    case ALVR_CBR:
+    default:
+        av_opt_set(encoder_ctx->priv_data, "rc_mode", "cbr", 0);
+        break;
+    }
+    // Ultra low latency tuning, and no frame held back in the encoder
+    av_opt_set(encoder_ctx->priv_data, "tune", "ull", 0);
+    av_opt_set_int(encoder_ctx->priv_data, "async_depth", 1, 0);
+
+    encoder_ctx->width = av_buffersink_get_w(filter_out);
+    encoder_ctx->height = av_buffersink_get_h(filter_out);
+    encoder_ctx->time_base = { 1, (int)1e9 };
+    encoder_ctx->sample_aspect_ratio = AVRational { 1, 1 };
+    encoder_ctx->pix_fmt = AV_PIX_FMT_VULKAN;
+    encoder_ctx->hw_frames_ctx = av_buffer_ref(av_buffersink_get_hw_frames_ctx(filter_out));
+    encoder_ctx->gop_size = INT16_MAX;
+    encoder_ctx->max_b_frames = 0;
+    encoder_ctx->color_range = AVCOL_RANGE_JPEG;
+    if (settings.m_encoderSlicesPerFrame > 1) {
+        encoder_ctx->slices = settings.m_encoderSlicesPerFrame;
+    }
+    if (not encoder_ctx->hw_frames_ctx) {
+        throw std::runtime_error("scale_vulkan has no output frame context");
+    }
+
+    auto params = FfiDynamicEncoderParams {};
+    params.updated = true;
+    params.bitrate_bps = 30'000'000;
+    params.framerate = settings.m_refreshRate;
+    SetParams(params);
+
+    err = avcodec_open2(encoder_ctx, codec, NULL);
+    if (err < 0) {
+        throw alvr::AvException("Cannot open video encoder codec:", err);
+    }
+
+    encoder_frame = av_frame_alloc();
+}
+
+alvr::EncodePipelineVulkan::~EncodePipelineVulkan() {
+    avfilter_graph_free(&filter_graph);
+    av_frame_free(&encoder_frame);
+}
+
+void alvr::EncodePipelineVulkan::PushFrame(uint64_t targetTimestampNs, bool idr) {
+    timestamp.cpu = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()
+    )
+                        .count();
+
+    // ffmpeg waits for the current value of the frame semaphore, signal it once the render is done
+    AVVkFrame* vkf = reinterpret_cast<AVVkFrame*>(vk_frame->data[0]);
+    vkf->sem_value[0]++;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &vkf->sem_value[0];
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &r->GetOutput().semaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &vkf->sem[0];
+    VK_CHECK(vkQueueSubmit(r->m_queue, 1, &submitInfo, nullptr));
+
+    // The render leaves the output in GENERAL, ffmpeg then keeps its content on the transition
+    vkf->layout[0] = r->GetOutput().layout;
+    vkf->access[0] = VK_ACCESS_SHADER_WRITE_BIT;
+
+    int err = av_buffersrc_add_frame_flags(
+        filter_in, vk_frame.get(), AV_BUFFERSRC_FLAG_PUSH | AV_BUFFERSRC_FLAG_KEEP_REF
+    );
+    if (err != 0) {
+        throw alvr::AvException("av_buffersrc_add_frame failed", err);
+    }
+    err = av_buffersink_get_frame(filter_out, encoder_frame);
+    if (err != 0) {
+        throw alvr::AvException("av_buffersink_get_frame failed", err);
+    }
+    // scale_vulkan moved the output to its own layout, the next render transitions it back
+    r->GetOutput().layout = vkf->layout[0];
+    if (traced) {
+        FrameTraceMark(targetTimestampNs, FRAME_TRACE_FORMAT_CONVERT);
+    }
+
+    encoder_frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    encoder_frame->pts = targetTimestampNs;
+    applyRoi(encoder_frame);
+
+    if ((err = avcodec_send_frame(encoder_ctx, encoder_frame)) < 0) {
+        throw alvr::AvException("avcodec_send_frame failed: ", err);
+    }
+    av_frame_unref(encoder_frame);
+}
+
+void alvr::EncodePipelineVulkan::SetParams(FfiDynamicEncoderParams params) {
+    if (!params.updated) {
+        return;
+    }
+    encoder_ctx->bit_rate = params.bitrate_bps * bitrate_correction;
+    encoder_ctx->framerate = AVRational { int(params.framerate * 1000), 1000 };
+    encoder_ctx->rc_buffer_size = encoder_ctx->bit_rate / params.framerate;
+    encoder_ctx->rc_max_rate = encoder_ctx->bit_rate;
+    encoder_ctx->rc_initial_buffer_occupancy = encoder_ctx->rc_buffer_size;
+}
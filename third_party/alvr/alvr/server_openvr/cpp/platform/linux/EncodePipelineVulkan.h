@@ -0,0 +1,47 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "EncodePipeline.h"
+#include <functional>
+#include <memory>
+
+extern "C" struct AVFilterContext;
+extern "C" struct AVFilterGraph;
+extern "C" struct AVFrame;
+
+class Renderer;
+
+namespace alvr {
+
+// Vulkan Video encoding on the device and queue family of the Renderer. The output image is
+// handed to ffmpeg as a Vulkan frame, ordered after the render by the frame's timeline semaphore,
+// so there is no export to another API and no wait on the CPU.
+class EncodePipelineVulkan : public EncodePipeline {
+public:
+    ~EncodePipelineVulkan();
+    EncodePipelineVulkan(
+        Renderer* render,
+        VkContext& vk_ctx,
+        VkFrame& input_frame,
+        VkImageCreateInfo& image_create_info,
+        uint32_t width,
+        uint32_t height
+    );
+
+    void PushFrame(uint64_t targetTimestampNs, bool idr) override;
+    void SetParams(FfiDynamicEncoderParams params) override;
+    bool SupportsScaling() override { return true; }
+
+private:
+    Renderer* r = nullptr;
+    std::unique_ptr<alvr::VkFrameCtx> vk_frame_ctx;
+    std::unique_ptr<AVFrame, std::function<void(AVFrame*)>> vk_frame;
+    AVFrame* encoder_frame = nullptr;
+    // The encode engine only takes YUV, scale_vulkan converts with one compute dispatch
+    AVFilterGraph* filter_graph = nullptr;
+    AVFilterContext* filter_in = nullptr;
+    AVFilterContext* filter_out = nullptr;
+};
+}
@@ -2,7 +2,11 @@
 // Original copyright preserved
 
 #include "FormatConverter.h"
+#include "alvr_server/Logger.h"
 #include "alvr_server/bindings.h"
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 FormatConverter::FormatConverter(Renderer* render)
     : r(render) { }
@@ -30,10 +34,13 @@ void FormatConverter::init(
     VkImageCreateInfo imageCreateInfo,
     VkSemaphore semaphore,
     int count,
+    int sets,
     const unsigned char* shaderData,
     unsigned shaderLen
 ) {
-    m_images.resize(count);
+    m_planeCount = count;
+    m_setCount = sets;
+    m_images.resize(count * sets);
     m_semaphore = semaphore;
 
     // Timestamp query
@@ -43,13 +50,14 @@ void FormatConverter::init(
     queryPoolInfo.queryCount = 1;
     VK_CHECK(vkCreateQueryPool(r->m_dev, &queryPoolInfo, nullptr, &m_queryPool));
 
-    // Command buffer
+    // Command buffers
+    m_commandBuffers.resize(sets);
     VkCommandBufferAllocateInfo commandBufferInfo = {};
     commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     commandBufferInfo.commandPool = r->m_commandPool;
-    commandBufferInfo.commandBufferCount = 1;
-    VK_CHECK(vkAllocateCommandBuffers(r->m_dev, &commandBufferInfo, &m_commandBuffer));
+    commandBufferInfo.commandBufferCount = sets;
+    VK_CHECK(vkAllocateCommandBuffers(r->m_dev, &commandBufferInfo, m_commandBuffers.data()));
 
     // Descriptors
     VkDescriptorSetLayoutBinding descriptorBindings[2];
@@ -92,7 +100,7 @@ void FormatConverter::init(
     VK_CHECK(vkCreateImageView(r->m_dev, &viewInfo, nullptr, &m_view));
 
     // Output images
-    for (int i = 0; i < count; ++i) {
+    for (size_t i = 0; i < m_images.size(); ++i) {
         VkImageCreateInfo imageInfo = {};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -113,6 +121,7 @@ void FormatConverter::init(
         memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
         vkGetImageMemoryRequirements(r->m_dev, m_images[i].image, &memReqs);
         memAllocInfo.allocationSize = memReqs.size;
+        m_images[i].size = memReqs.size;
 
         VkMemoryPropertyFlags memType = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
             | VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
@@ -179,8 +188,12 @@ void FormatConverter::init(
         ));
     }
 
+    VkSemaphoreTypeCreateInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
     VkSemaphoreCreateInfo semInfo = {};
     semInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semInfo.pNext = &timelineInfo;
     VK_CHECK(vkCreateSemaphore(r->m_dev, &semInfo, nullptr, &m_output.semaphore));
 
     // Shader
@@ -207,20 +220,31 @@ void FormatConverter::init(
     pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
     pipelineInfo.layout = m_pipelineLayout;
     pipelineInfo.stage = stageInfo;
-    VK_CHECK(vkCreateComputePipelines(r->m_dev, nullptr, 1, &pipelineInfo, nullptr, &m_pipeline));
+    VK_CHECK(vkCreateComputePipelines(
+        r->m_dev, r->m_pipelineCache, 1, &pipelineInfo, nullptr, &m_pipeline
+    ));
 
     m_groupCountX = (imageCreateInfo.extent.width + 7) / 8;
     m_groupCountY = (imageCreateInfo.extent.height + 7) / 8;
+
+    // Nothing in a conversion changes between frames, the input image and its view are fixed
+    for (int i = 0; i < sets; ++i) {
+        record(i);
+    }
 }
 
-void FormatConverter::Convert(uint8_t** data, int* linesize) {
+void FormatConverter::record(uint32_t set) {
+    const OutputImage* planes = &m_images[set * m_planeCount];
+    VkCommandBuffer commandBuffer = m_commandBuffers[set];
+
+    // Without ONE_TIME_SUBMIT, the buffer can be submitted again once it has completed
     VkCommandBufferBeginInfo commandBufferBegin = {};
     commandBufferBegin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    VK_CHECK(vkBeginCommandBuffer(m_commandBuffer, &commandBufferBegin));
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &commandBufferBegin));
 
-    vkCmdResetQueryPool(m_commandBuffer, m_queryPool, 0, 1);
+    vkCmdResetQueryPool(commandBuffer, m_queryPool, 0, 1);
 
-    vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
 
     std::vector<VkWriteDescriptorSet> descriptorWriteSets;
 
@@ -237,8 +261,8 @@ void FormatConverter::Convert(uint8_t** data, int* linesize) {
     descriptorWriteSets.push_back(descriptorWriteSet);
 
     VkDescriptorImageInfo descriptorImageInfoOuts[3] = {};
-    for (size_t i = 0; i < m_images.size(); ++i) {
-        descriptorImageInfoOuts[i].imageView = m_images[i].view;
+    for (size_t i = 0; i < m_planeCount; ++i) {
+        descriptorImageInfoOuts[i].imageView = planes[i].view;
         descriptorImageInfoOuts[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
         descriptorWriteSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
@@ -249,7 +273,7 @@ void FormatConverter::Convert(uint8_t** data, int* linesize) {
     }
 
     r->d.vkCmdPushDescriptorSetKHR(
-        m_commandBuffer,
+        commandBuffer,
         VK_PIPELINE_BIND_POINT_COMPUTE,
         m_pipelineLayout,
         0,
@@ -257,43 +281,84 @@ void FormatConverter::Convert(uint8_t** data, int* linesize) {
         descriptorWriteSets.data()
     );
 
-    vkCmdDispatch(m_commandBuffer, m_groupCountX, m_groupCountY, 1);
+    vkCmdDispatch(commandBuffer, m_groupCountX, m_groupCountY, 1);
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 0);
 
-    vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 0);
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+}
 
-    vkEndCommandBuffer(m_commandBuffer);
+void FormatConverter::Convert(uint32_t set, uint8_t** data, int* linesize) {
+    set %= m_setCount;
+    const OutputImage* planes = &m_images[set * m_planeCount];
 
     VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 
+    // The input semaphore is binary, its wait value is ignored
+    uint64_t waitValue = 0;
+    uint64_t signalValue = ++m_convertValue;
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
     submitInfo.waitSemaphoreCount = 1;
     submitInfo.pWaitSemaphores = &m_semaphore;
     submitInfo.pWaitDstStageMask = &waitStage;
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = &m_output.semaphore;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_commandBuffer;
+    submitInfo.pCommandBuffers = &m_commandBuffers[set];
     VK_CHECK(vkQueueSubmit(r->m_queue, 1, &submitInfo, nullptr));
 
-    for (size_t i = 0; i < m_images.size(); ++i) {
-        data[i] = m_images[i].mapped;
-        linesize[i] = m_images[i].linesize;
+    for (size_t i = 0; i < m_planeCount; ++i) {
+        data[i] = planes[i].mapped;
+        linesize[i] = planes[i].linesize;
     }
 }
 
 void FormatConverter::Sync() {
-    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &m_output.semaphore;
-    submitInfo.pWaitDstStageMask = &waitStage;
-    VK_CHECK(vkQueueSubmit(r->m_queue, 1, &submitInfo, r->m_fence));
+    // Waiting on the timeline directly saves the empty submit and fence round trip
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_output.semaphore;
+    waitInfo.pValues = &m_convertValue;
+    VK_CHECK(vkWaitSemaphores(r->m_dev, &waitInfo, UINT64_MAX));
+}
 
-    VK_CHECK(vkWaitForFences(r->m_dev, 1, &r->m_fence, VK_TRUE, UINT64_MAX));
-    VK_CHECK(vkResetFences(r->m_dev, 1, &r->m_fence));
+void FormatConverter::BindToNumaNode(int node) {
+    if (node < 0 || node >= 64) {
+        return;
+    }
+    unsigned long nodemask = 1ul << node;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    int moved = 0;
+    for (const OutputImage& image : m_images) {
+        uintptr_t begin = (uintptr_t)image.mapped & ~(uintptr_t)(pageSize - 1);
+        uintptr_t end = (uintptr_t)image.mapped + image.size;
+        // The driver may have pinned the pages, then they stay where they are
+        if (syscall(
+                SYS_mbind,
+                (void*)begin,
+                end - begin,
+                MPOL_PREFERRED,
+                &nodemask,
+                sizeof(nodemask) * 8,
+                MPOL_MF_MOVE
+            )
+            == 0) {
+            moved++;
+        }
+    }
+    if (moved < (int)m_images.size()) {
+        Debug("Bound %d of %zu converter planes to NUMA node %d", moved, m_images.size(), node);
+    }
 }
 
 uint64_t FormatConverter::GetTimestamp() {
@@ -312,7 +377,7 @@ uint64_t FormatConverter::GetTimestamp() {
 }
 
 RgbToYuv420::RgbToYuv420(
-    Renderer* render, VkImage image, VkImageCreateInfo imageInfo, VkSemaphore semaphore
+    Renderer* render, VkImage image, VkImageCreateInfo imageInfo, VkSemaphore semaphore, int sets
 )
     : FormatConverter(render) {
     init(
@@ -320,6 +385,7 @@ RgbToYuv420::RgbToYuv420(
         imageInfo,
         semaphore,
         3,
+        sets,
         RGBTOYUV420_SHADER_COMP_SPV_PTR,
         RGBTOYUV420_SHADER_COMP_SPV_LEN
     );
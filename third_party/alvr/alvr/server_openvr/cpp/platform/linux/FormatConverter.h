@@ -8,6 +8,7 @@
 class FormatConverter {
 public:
     struct Output {
+        // Timeline semaphore, signalled with an increasing value by each conversion
         VkSemaphore semaphore = VK_NULL_HANDLE;
     };
 
@@ -15,10 +16,19 @@ public:
 
     Output GetOutput();
 
-    void Convert(uint8_t** data, int* linesize);
+    // Converts into the planes of output set `set` (0 to GetSetCount() - 1) and returns their
+    // mapped pointers. Sets let the caller read a previous result while the next one is written.
+    void Convert(uint32_t set, uint8_t** data, int* linesize);
 
+    // Waits for the last conversion to complete.
     void Sync();
 
+    uint32_t GetSetCount() const { return m_setCount; }
+
+    // Moves the mapped planes to NUMA node `node`, where the CPU reads them. Best effort, memory
+    // pinned by the driver can't move.
+    void BindToNumaNode(int node);
+
     uint64_t GetTimestamp();
 
 protected:
@@ -28,6 +38,7 @@ protected:
         VkImageView view = VK_NULL_HANDLE;
         VkSemaphore semaphore = VK_NULL_HANDLE;
         VkDeviceSize linesize = 0;
+        VkDeviceSize size = 0;
         uint8_t* mapped = nullptr;
     };
 
@@ -37,13 +48,18 @@ protected:
         VkImageCreateInfo imageCreateInfo,
         VkSemaphore semaphore,
         int count,
+        int sets,
         const unsigned char* shaderData,
         unsigned shaderLen
     );
 
+    // Records the conversion into output set `set`, once in init
+    void record(uint32_t set);
+
     Renderer* r;
     VkQueryPool m_queryPool = VK_NULL_HANDLE;
-    VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+    // One per output set, recorded once and submitted unchanged by every Convert
+    std::vector<VkCommandBuffer> m_commandBuffers;
     VkDescriptorSetLayout m_descriptorLayout = VK_NULL_HANDLE;
     VkImageView m_view = VK_NULL_HANDLE;
     VkSemaphore m_semaphore = VK_NULL_HANDLE;
@@ -52,13 +68,21 @@ protected:
     VkPipeline m_pipeline = VK_NULL_HANDLE;
     uint32_t m_groupCountX = 0;
     uint32_t m_groupCountY = 0;
+    // `m_planeCount` planes for each of the `m_setCount` output sets
     std::vector<OutputImage> m_images;
+    uint32_t m_planeCount = 0;
+    uint32_t m_setCount = 0;
     Output m_output;
+    uint64_t m_convertValue = 0;
 };
 
 class RgbToYuv420 : public FormatConverter {
 public:
     explicit RgbToYuv420(
-        Renderer* render, VkImage image, VkImageCreateInfo imageInfo, VkSemaphore semaphore
+        Renderer* render,
+        VkImage image,
+        VkImageCreateInfo imageInfo,
+        VkSemaphore semaphore,
+        int sets = 1
     );
 };
@@ -25,6 +25,11 @@ FrameRender::FrameRender(alvr::VkContext& ctx, init_packet& init, int fds[])
         init.image_create_info.extent.height,
         init.image_create_info.format
     );
+    LoadPipelineCache(std::filesystem::path(g_sessionPath).parent_path());
+    LoadModifierCache(std::filesystem::path(g_sessionPath).parent_path());
+    if (Settings::Instance().m_photonMarker && !EnablePhotonMarker()) {
+        Warn("Photon marker disabled for this output format\n");
+    }
 
     for (size_t i = 0; i < 3; ++i) {
         AddImage(init.image_create_info, init.mem_index, fds[2 * i], fds[2 * i + 1]);
@@ -37,11 +42,14 @@ FrameRender::FrameRender(alvr::VkContext& ctx, init_packet& init, int fds[])
 
     if (Settings::Instance().m_force_sw_encoding) {
         m_handle = ExternalHandle::None;
-    } else if (ctx.amd || ctx.intel) {
+    } else if (ctx.amd || ctx.intel || ctx.crossDeviceEncode) {
         m_handle = ExternalHandle::DmaBuf;
     } else if (ctx.nvidia) {
         m_handle = ExternalHandle::OpaqueFd;
     }
+    if (ctx.crossDeviceEncode) {
+        RequireLinearOutput();
+    }
 
     setupCustomShaders("pre");
 
@@ -58,6 +66,7 @@ FrameRender::FrameRender(alvr::VkContext& ctx, init_packet& init, int fds[])
     if (m_pipelines.empty()) {
         RenderPipeline* pipeline = new RenderPipeline(this);
         pipeline->SetShader(QUAD_SHADER_COMP_SPV_PTR, QUAD_SHADER_COMP_SPV_LEN);
+        pipeline->SetGpuPass(GPU_PASS_LAYERS);
         m_pipelines.push_back(pipeline);
         AddPipeline(pipeline);
     }
@@ -100,6 +109,7 @@ void FrameRender::setupColorCorrection() {
 
     RenderPipeline* pipeline = new RenderPipeline(this);
     pipeline->SetShader(COLOR_SHADER_COMP_SPV_PTR, COLOR_SHADER_COMP_SPV_LEN);
+    pipeline->SetGpuPass(GPU_PASS_COLOR_CORRECTION);
     pipeline->SetConstants(&m_colorCorrectionConstants, std::move(entries));
     m_pipelines.push_back(pipeline);
     AddPipeline(pipeline);
@@ -168,6 +178,7 @@ void FrameRender::setupFoveatedRendering() {
 
     RenderPipeline* pipeline = new RenderPipeline(this);
     pipeline->SetShader(FFR_SHADER_COMP_SPV_PTR, FFR_SHADER_COMP_SPV_LEN);
+    pipeline->SetGpuPass(GPU_PASS_FOVEATION);
     pipeline->SetConstants(&m_foveatedRenderingConstants, std::move(entries));
     m_pipelines.push_back(pipeline);
     AddPipeline(pipeline);
@@ -0,0 +1,304 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "QualityProbe.h"
+
+#include "ALVR-common/packet_types.h"
+#include "FormatConverter.h"
+#include "alvr_server/Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+namespace {
+
+AVCodecID decoder_id(int codec) {
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        return AV_CODEC_ID_H264;
+    case ALVR_CODEC_HEVC:
+        return AV_CODEC_ID_HEVC;
+    case ALVR_CODEC_AV1:
+        return AV_CODEC_ID_AV1;
+    default:
+        return AV_CODEC_ID_NONE;
+    }
+}
+
+// Identical frames are reported at this PSNR instead of infinity
+const double MAX_PSNR = 100.0;
+
+double psnr(double sse, uint64_t count) {
+    if (sse == 0 || count == 0) {
+        return MAX_PSNR;
+    }
+    return std::min(MAX_PSNR, 10.0 * std::log10(255.0 * 255.0 * count / sse));
+}
+
+} // namespace
+
+QualityProbe::QualityProbe(Renderer* render, uint64_t intervalNs)
+    : r(render)
+    , m_intervalNs(intervalNs) {
+    auto& output = r->GetOutput();
+    m_width = output.imageInfo.extent.width;
+    m_height = output.imageInfo.extent.height;
+    m_converter
+        = std::make_unique<RgbToYuv420>(r, output.image, output.imageInfo, output.semaphore);
+    m_frame = av_frame_alloc();
+
+    m_worker = std::thread(&QualityProbe::Run, this);
+}
+
+QualityProbe::~QualityProbe() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_exiting = true;
+    }
+    m_cv.notify_all();
+    m_worker.join();
+
+    avcodec_free_context(&m_decoder);
+    av_frame_free(&m_frame);
+}
+
+void QualityProbe::Sample(uint64_t targetTimestampNs) {
+    if (m_converting || targetTimestampNs - m_lastSampleNs < m_intervalNs) {
+        return;
+    }
+    m_lastSampleNs = targetTimestampNs;
+
+    uint8_t* data[3];
+    int linesize[3];
+    m_converter->Convert(0, data, linesize);
+    r->ResignalOutput();
+    m_luma = data[0];
+    m_lumaLinesize = linesize[0];
+    m_converting = true;
+
+    Job job;
+    job.type = Job::Type::Reference;
+    job.targetTimestampNs = targetTimestampNs;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+}
+
+void QualityProbe::PushPacket(
+    int codec, const alvr::FramePacket& packet, uint64_t targetTimestampNs
+) {
+    Job job;
+    job.type = Job::Type::Packet;
+    job.codec = codec;
+    job.data.assign(packet.data, packet.data + packet.size);
+    job.targetTimestampNs = targetTimestampNs;
+    job.idr = packet.isIDR;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queuedPackets >= MAX_QUEUED_PACKETS) {
+            // The references stay queued, their conversion must still be waited for
+            m_jobs.erase(
+                std::remove_if(
+                    m_jobs.begin(),
+                    m_jobs.end(),
+                    [](const Job& queued) { return queued.type == Job::Type::Packet; }
+                ),
+                m_jobs.end()
+            );
+            m_queuedPackets = 0;
+            Job reset;
+            reset.type = Job::Type::Reset;
+            m_jobs.push_back(std::move(reset));
+            Debug("QualityProbe: decoder behind, skipping to the next IDR");
+        }
+        m_jobs.push_back(std::move(job));
+        m_queuedPackets++;
+    }
+    m_cv.notify_one();
+}
+
+void QualityProbe::Reset() {
+    Job job;
+    job.type = Job::Type::Reset;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+}
+
+void QualityProbe::Run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&] { return m_exiting || !m_jobs.empty(); });
+            if (m_exiting) {
+                break;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            if (job.type == Job::Type::Packet) {
+                m_queuedPackets--;
+            }
+        }
+
+        switch (job.type) {
+        case Job::Type::Reference: {
+            m_converter->Sync();
+            std::vector<uint8_t> luma((size_t)m_width * m_height);
+            for (uint32_t y = 0; y < m_height; y++) {
+                memcpy(&luma[(size_t)y * m_width], m_luma + (size_t)y * m_lumaLinesize, m_width);
+            }
+            m_converting = false;
+            m_references[job.targetTimestampNs] = std::move(luma);
+            if (m_references.size() > MAX_REFERENCES) {
+                m_references.erase(m_references.begin());
+            }
+            break;
+        }
+        case Job::Type::Reset:
+            avcodec_free_context(&m_decoder);
+            m_references.clear();
+            m_waitIdr = true;
+            break;
+        case Job::Type::Packet:
+            decode(job);
+            break;
+        }
+    }
+}
+
+void QualityProbe::decode(Job& job) {
+    if (m_waitIdr) {
+        if (!job.idr) {
+            return;
+        }
+        m_waitIdr = false;
+    }
+
+    if (!m_decoder || m_decoderCodec != job.codec) {
+        avcodec_free_context(&m_decoder);
+        const AVCodec* codec = avcodec_find_decoder(decoder_id(job.codec));
+        if (!codec) {
+            Error("QualityProbe: no decoder for codec %d", job.codec);
+            m_waitIdr = true;
+            return;
+        }
+        m_decoder = avcodec_alloc_context3(codec);
+        m_decoder->thread_count = 0;
+        if (avcodec_open2(m_decoder, codec, NULL) < 0) {
+            Error("QualityProbe: failed to open the %s decoder", codec->name);
+            avcodec_free_context(&m_decoder);
+            m_waitIdr = true;
+            return;
+        }
+        m_decoderCodec = job.codec;
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    packet->data = job.data.data();
+    packet->size = job.data.size();
+    packet->pts = job.targetTimestampNs;
+    int err = avcodec_send_packet(m_decoder, packet);
+    av_packet_free(&packet);
+    if (err < 0) {
+        Debug("QualityProbe: decoding failed, waiting for an IDR");
+        avcodec_free_context(&m_decoder);
+        m_waitIdr = true;
+        return;
+    }
+
+    while (avcodec_receive_frame(m_decoder, m_frame) == 0) {
+        uint64_t pts = m_frame->pts;
+        auto reference = m_references.find(pts);
+        if (reference != m_references.end()) {
+            measure(pts, m_frame, reference->second);
+        }
+        // Older samples belong to frames that were never encoded
+        m_references.erase(m_references.begin(), m_references.upper_bound(pts));
+        av_frame_unref(m_frame);
+    }
+}
+
+void QualityProbe::measure(
+    uint64_t targetTimestampNs, const AVFrame* frame, const std::vector<uint8_t>& luma
+) {
+    // Frames of another ladder level, or of a 10 bit stream
+    if ((uint32_t)frame->width != m_width || (uint32_t)frame->height != m_height
+        || (frame->format != AV_PIX_FMT_YUV420P && frame->format != AV_PIX_FMT_YUVJ420P
+            && frame->format != AV_PIX_FMT_NV12)) {
+        return;
+    }
+
+    const uint32_t tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+    std::vector<double> tileSse(tilesX * tilesY, 0.0);
+    double sse = 0;
+    for (uint32_t y = 0; y < m_height; y++) {
+        const uint8_t* a = &luma[(size_t)y * m_width];
+        const uint8_t* b = frame->data[0] + (size_t)y * frame->linesize[0];
+        double* tileRow = &tileSse[(y / TILE_SIZE) * tilesX];
+        for (uint32_t x = 0; x < m_width; x++) {
+            int d = (int)a[x] - (int)b[x];
+            tileRow[x / TILE_SIZE] += d * d;
+        }
+    }
+    double minTilePsnr = MAX_PSNR;
+    for (uint32_t ty = 0; ty < tilesY; ty++) {
+        for (uint32_t tx = 0; tx < tilesX; tx++) {
+            uint32_t w = std::min(TILE_SIZE, m_width - tx * TILE_SIZE);
+            uint32_t h = std::min(TILE_SIZE, m_height - ty * TILE_SIZE);
+            double tile = tileSse[ty * tilesX + tx];
+            sse += tile;
+            minTilePsnr = std::min(minTilePsnr, psnr(tile, (uint64_t)w * h));
+        }
+    }
+
+    // Mean SSIM of the 8x8 blocks, without the gaussian weighting
+    const double C1 = (0.01 * 255) * (0.01 * 255);
+    const double C2 = (0.03 * 255) * (0.03 * 255);
+    double ssimSum = 0;
+    uint32_t blocks = 0;
+    for (uint32_t by = 0; by + 8 <= m_height; by += 8) {
+        for (uint32_t bx = 0; bx + 8 <= m_width; bx += 8) {
+            uint32_t sumA = 0, sumB = 0;
+            uint64_t sumAA = 0, sumBB = 0, sumAB = 0;
+            for (uint32_t y = by; y < by + 8; y++) {
+                const uint8_t* a = &luma[(size_t)y * m_width + bx];
+                const uint8_t* b = frame->data[0] + (size_t)y * frame->linesize[0] + bx;
+                for (uint32_t x = 0; x < 8; x++) {
+                    sumA += a[x];
+                    sumB += b[x];
+                    sumAA += a[x] * a[x];
+                    sumBB += b[x] * b[x];
+                    sumAB += a[x] * b[x];
+                }
+            }
+            double meanA = sumA / 64.0;
+            double meanB = sumB / 64.0;
+            double varA = sumAA / 64.0 - meanA * meanA;
+            double varB = sumBB / 64.0 - meanB * meanB;
+            double covariance = sumAB / 64.0 - meanA * meanB;
+            ssimSum += ((2 * meanA * meanB + C1) * (2 * covariance + C2))
+                / ((meanA * meanA + meanB * meanB + C1) * (varA + varB + C2));
+            blocks++;
+        }
+    }
+    double ssim = blocks ? ssimSum / blocks : 1.0;
+    double framePsnr = psnr(sse, (uint64_t)m_width * m_height);
+
+    Info(
+        "QualityProbe: frame %llu PSNR %.2f dB, worst tile %.2f dB, SSIM %.4f",
+        (unsigned long long)targetTimestampNs,
+        framePsnr,
+        minTilePsnr,
+        ssim
+    );
+}
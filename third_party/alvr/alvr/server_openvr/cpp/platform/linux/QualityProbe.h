@@ -0,0 +1,88 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "EncodePipeline.h"
+#include "Renderer.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct AVCodecContext;
+struct AVFrame;
+class FormatConverter;
+
+// Measures the quality of the stream as the client sees it. On a sampled schedule, the renderer
+// output is converted to YUV420 like for the software encoder and its luma is kept. Every packet
+// is decoded in software on a background thread, and the decoded luma of a sampled frame is
+// compared with the kept one, then logged.
+class QualityProbe {
+public:
+    // Tiles of the worst tile PSNR
+    static constexpr uint32_t TILE_SIZE = 64;
+
+    QualityProbe(Renderer* render, uint64_t intervalNs);
+    ~QualityProbe();
+
+    // Keeps the output of the last Render if a sample is due. The conversion consumes the output
+    // semaphore and signals it again, the encoder then waits on it as usual.
+    void Sample(uint64_t targetTimestampNs);
+
+    // Every packet of the stream in encode order, copied before returning
+    void PushPacket(int codec, const alvr::FramePacket& packet, uint64_t targetTimestampNs);
+
+    // The stream restarts with another encoder, decoding resumes at its first IDR
+    void Reset();
+
+private:
+    // Packets queued at most, a decoder falling further behind skips to the next IDR
+    static constexpr size_t MAX_QUEUED_PACKETS = 30;
+    // Samples kept at most while waiting for the decoder to reach them
+    static constexpr size_t MAX_REFERENCES = 4;
+
+    struct Job {
+        enum class Type { Packet, Reference, Reset } type;
+        int codec = 0;
+        std::vector<uint8_t> data;
+        uint64_t targetTimestampNs = 0;
+        bool idr = false;
+    };
+
+    void Run();
+    void decode(Job& job);
+    void measure(
+        uint64_t targetTimestampNs, const AVFrame* frame, const std::vector<uint8_t>& luma
+    );
+
+    Renderer* r;
+    std::unique_ptr<FormatConverter> m_converter;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint64_t m_intervalNs;
+    uint64_t m_lastSampleNs = 0;
+    // Set from the conversion of a sample until the worker has copied its luma
+    std::atomic_bool m_converting = false;
+    uint8_t* m_luma = nullptr;
+    int m_lumaLinesize = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Job> m_jobs;
+    size_t m_queuedPackets = 0;
+    bool m_exiting = false;
+    std::thread m_worker;
+
+    // Worker state
+    AVCodecContext* m_decoder = nullptr;
+    AVFrame* m_frame = nullptr;
+    int m_decoderCodec = -1;
+    bool m_waitIdr = true;
+    // Luma of the sampled frames not decoded yet, by target timestamp
+    std::map<uint64_t, std::vector<uint8_t>> m_references;
+};
@@ -2,13 +2,21 @@
 // Original copyright preserved
 
 #include "Renderer.h"
+#include "alvr_server/FrameTrace.h"
+#include "alvr_server/GpuPassStats.h"
+#include "alvr_server/Instance.h"
+#include "alvr_server/PhotonMarker.h"
 
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <ctime>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <unistd.h>
 
 #ifndef DRM_FORMAT_INVALID
 #define DRM_FORMAT_INVALID 0
@@ -43,6 +51,29 @@ static uint32_t to_drm_format(VkFormat format) {
     }
 }
 
+// Writes the RGB channels of a linear RGBA8 image
+static void write_ppm(
+    const std::string& filename,
+    const char* data,
+    VkDeviceSize rowPitch,
+    uint32_t width,
+    uint32_t height
+) {
+    std::ofstream file(filename, std::ios::out | std::ios::binary);
+
+    // PPM header
+    file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
+
+    // PPM binary pixel data
+    for (uint32_t y = 0; y < height; y++) {
+        const uint32_t* row = (const uint32_t*)data;
+        for (uint32_t x = 0; x < width; x++) {
+            file.write((const char*)row++, 3);
+        }
+        data += rowPitch;
+    }
+}
+
 static bool filter_modifier(uint64_t modifier) {
     if (IS_AMD_FMT_MOD(modifier)) {
         // DCC not supported as encode input
@@ -87,17 +118,42 @@ Renderer::Renderer(
     VK_LOAD_PFN(vkGetMemoryFdPropertiesKHR);
     VK_LOAD_PFN(vkGetImageDrmFormatModifierPropertiesEXT);
     VK_LOAD_PFN(vkGetCalibratedTimestampsEXT);
+    VK_LOAD_PFN(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT);
     VK_LOAD_PFN(vkCmdPushDescriptorSetKHR);
 #undef VK_LOAD_PFN
 
     VkPhysicalDeviceProperties props = {};
     vkGetPhysicalDeviceProperties(m_physDev, &props);
     m_timestampPeriod = props.limits.timestampPeriod;
+
+    if (d.haveCalibratedTimestamps && d.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT) {
+        uint32_t count = 0;
+        d.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(m_physDev, &count, nullptr);
+        std::vector<VkTimeDomainEXT> domains(count);
+        d.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(m_physDev, &count, domains.data());
+        d.haveMonotonicTimeDomain
+            = std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT)
+            != domains.end();
+    }
 }
 
 Renderer::~Renderer() {
     vkDeviceWaitIdle(m_dev);
 
+    if (m_recorder.writer.joinable()) {
+        m_recorder.writer.join();
+    }
+    for (const RecorderSlot& slot : m_recorder.slots) {
+        for (const RecorderImage* image : { &slot.input, &slot.output }) {
+            vkDestroyImageView(m_dev, image->view, nullptr);
+            vkDestroyImage(m_dev, image->image, nullptr);
+            vkFreeMemory(m_dev, image->memory, nullptr);
+        }
+    }
+    vkDestroyPipeline(m_dev, m_recorder.pipeline, nullptr);
+    vkDestroyPipelineLayout(m_dev, m_recorder.pipelineLayout, nullptr);
+    vkDestroyShaderModule(m_dev, m_recorder.shader, nullptr);
+
     for (const InputImage& image : m_images) {
         vkDestroyImageView(m_dev, image.view, nullptr);
         vkDestroyImage(m_dev, image.image, nullptr);
@@ -111,16 +167,24 @@ Renderer::~Renderer() {
         vkFreeMemory(m_dev, image.memory, nullptr);
     }
 
-    vkDestroyImageView(m_dev, m_output.view, nullptr);
-    vkDestroyImage(m_dev, m_output.image, nullptr);
-    vkFreeMemory(m_dev, m_output.memory, nullptr);
-    vkDestroySemaphore(m_dev, m_output.semaphore, nullptr);
+    destroyOutput();
+
+    for (const FrameSlot& slot : m_frameSlots) {
+        vkDestroyBuffer(m_dev, slot.markerBuffer, nullptr);
+        vkFreeMemory(m_dev, slot.markerMemory, nullptr);
+    }
 
     vkDestroyQueryPool(m_dev, m_queryPool, nullptr);
+    vkDestroySemaphore(m_dev, m_frameTimeline, nullptr);
     vkDestroyCommandPool(m_dev, m_commandPool, nullptr);
     vkDestroySampler(m_dev, m_sampler, nullptr);
     vkDestroyDescriptorSetLayout(m_dev, m_descriptorLayout, nullptr);
     vkDestroyFence(m_dev, m_fence, nullptr);
+
+    if (m_pipelineCache) {
+        savePipelineCache();
+        vkDestroyPipelineCache(m_dev, m_pipelineCache, nullptr);
+    }
 }
 
 void Renderer::Startup(uint32_t width, uint32_t height, VkFormat format) {
@@ -134,7 +198,7 @@ void Renderer::Startup(uint32_t width, uint32_t height, VkFormat format) {
     VkQueryPoolCreateInfo queryPoolInfo = {};
     queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
     queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
-    queryPoolInfo.queryCount = 2;
+    queryPoolInfo.queryCount = SLOT_QUERIES * FRAME_SLOTS;
     VK_CHECK(vkCreateQueryPool(m_dev, &queryPoolInfo, nullptr, &m_queryPool));
 
     // Command buffer
@@ -151,6 +215,20 @@ void Renderer::Startup(uint32_t width, uint32_t height, VkFormat format) {
     commandBufferInfo.commandBufferCount = 1;
     VK_CHECK(vkAllocateCommandBuffers(m_dev, &commandBufferInfo, &m_commandBuffer));
 
+    // Each in-flight frame records into its own command buffer, so Render doesn't have to wait
+    // for the previous frame to finish on the GPU
+    for (auto& slot : m_frameSlots) {
+        VK_CHECK(vkAllocateCommandBuffers(m_dev, &commandBufferInfo, &slot.commandBuffer));
+    }
+
+    VkSemaphoreTypeCreateInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    VkSemaphoreCreateInfo semInfo = {};
+    semInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semInfo.pNext = &timelineInfo;
+    VK_CHECK(vkCreateSemaphore(m_dev, &semInfo, nullptr, &m_frameTimeline));
+
     // Sampler
     VkSamplerCreateInfo samplerInfo = {};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -192,6 +270,68 @@ void Renderer::Startup(uint32_t width, uint32_t height, VkFormat format) {
     VK_CHECK(vkCreateFence(m_dev, &fenceInfo, nullptr, &m_fence));
 }
 
+void Renderer::LoadPipelineCache(const std::string& dir) {
+    VkPhysicalDeviceProperties props = {};
+    vkGetPhysicalDeviceProperties(m_physDev, &props);
+
+    std::string uuid;
+    char hex[3];
+    for (uint8_t byte : props.pipelineCacheUUID) {
+        snprintf(hex, sizeof(hex), "%02x", byte);
+        uuid += hex;
+    }
+    m_pipelineCachePath = dir + "/vulkan_pipeline_cache_" + uuid + ".bin";
+
+    std::vector<char> data;
+    std::ifstream is(m_pipelineCachePath, std::ios::binary | std::ios::in | std::ios::ate);
+    if (is.is_open()) {
+        data.resize(is.tellg());
+        is.seekg(0, std::ios::beg);
+        is.read(data.data(), data.size());
+    }
+
+    // Drivers should reject foreign data themselves, not all of them do it gracefully
+    VkPipelineCacheHeaderVersionOne header = {};
+    if (data.size() >= sizeof(header)) {
+        memcpy(&header, data.data(), sizeof(header));
+    }
+    if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        || header.vendorID != props.vendorID || header.deviceID != props.deviceID
+        || memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        data.clear();
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.data();
+    VK_CHECK(vkCreatePipelineCache(m_dev, &cacheInfo, nullptr, &m_pipelineCache));
+    std::cout << "Pipeline cache " << m_pipelineCachePath << ": " << data.size() << " bytes"
+              << std::endl;
+}
+
+void Renderer::savePipelineCache() {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(m_dev, m_pipelineCache, &size, nullptr) != VK_SUCCESS) {
+        return;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(m_dev, m_pipelineCache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    // Written aside and renamed, so that an interrupted write never leaves a truncated cache
+    // The other instances of the host may be writing the same cache
+    const std::string tmpPath = m_pipelineCachePath + InstanceSuffix() + ".tmp";
+    std::ofstream os(tmpPath, std::ios::binary | std::ios::out | std::ios::trunc);
+    os.write(data.data(), size);
+    os.close();
+    if (!os || rename(tmpPath.c_str(), m_pipelineCachePath.c_str()) != 0) {
+        std::cerr << "Failed to write pipeline cache " << m_pipelineCachePath << std::endl;
+        remove(tmpPath.c_str());
+    }
+}
+
 void Renderer::AddImage(
     VkImageCreateInfo imageInfo, size_t memoryIndex, int imageFd, int semaphoreFd
 ) {
@@ -264,9 +404,35 @@ void Renderer::AddImage(
     m_images.push_back({ image, VK_IMAGE_LAYOUT_UNDEFINED, mem, semaphore, view });
 }
 
+bool Renderer::ReplaceImages(
+    VkImageCreateInfo imageInfo, size_t memoryIndex, const int fds[], size_t count
+) {
+    if (imageInfo.format != m_format || imageInfo.extent.width != m_imageSize.width
+        || imageInfo.extent.height != m_imageSize.height) {
+        return false;
+    }
+
+    // The frames still executing read the previous images
+    vkDeviceWaitIdle(m_dev);
+    for (const InputImage& image : m_images) {
+        vkDestroyImageView(m_dev, image.view, nullptr);
+        vkDestroyImage(m_dev, image.image, nullptr);
+        vkFreeMemory(m_dev, image.memory, nullptr);
+        vkDestroySemaphore(m_dev, image.semaphore, nullptr);
+    }
+    m_images.clear();
+    for (size_t i = 0; i < count; ++i) {
+        AddImage(imageInfo, memoryIndex, fds[2 * i], fds[2 * i + 1]);
+    }
+    // The recorded command buffers bind the previous image views
+    ++m_recordingGeneration;
+    return true;
+}
+
 void Renderer::AddPipeline(RenderPipeline* pipeline) {
     pipeline->Build();
     m_pipelines.push_back(pipeline);
+    ++m_recordingGeneration;
 
     if (m_pipelines.size() > 1 && m_stagingImages.size() < 2) {
         addStagingImage(m_imageSize.width, m_imageSize.height);
@@ -274,6 +440,8 @@ void Renderer::AddPipeline(RenderPipeline* pipeline) {
 }
 
 void Renderer::CreateOutput(uint32_t width, uint32_t height, ExternalHandle handle) {
+    m_outputHandle = handle;
+    ++m_recordingGeneration;
     m_output.imageInfo = {};
     m_output.imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     m_output.imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -285,6 +453,9 @@ void Renderer::CreateOutput(uint32_t width, uint32_t height, ExternalHandle hand
     m_output.imageInfo.arrayLayers = 1;
     m_output.imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     m_output.imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (m_markerTexelSize) {
+        m_output.imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
     m_output.imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     m_output.imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
@@ -321,6 +492,13 @@ void Renderer::CreateOutput(uint32_t width, uint32_t height, ExternalHandle hand
                 std::cout << " filtered" << std::endl;
                 continue;
             }
+            if (std::find(
+                    m_rejectedModifiers.begin(), m_rejectedModifiers.end(), prop.drmFormatModifier
+                )
+                != m_rejectedModifiers.end()) {
+                std::cout << " rejected by the encoder" << std::endl;
+                continue;
+            }
 
             VkPhysicalDeviceImageDrmFormatModifierInfoEXT modInfo = {};
             modInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_DRM_FORMAT_MODIFIER_INFO_EXT;
@@ -349,6 +527,18 @@ void Renderer::CreateOutput(uint32_t width, uint32_t height, ExternalHandle hand
                 imageModifiers.push_back(prop.drmFormatModifier);
             }
         }
+        // The driver picks any modifier of the list, usually the most compressed tiling. Offering
+        // only the one the encoder imported before skips the modifiers that it would reject. An
+        // encoder on another GPU can only rely on linear.
+        if (m_linearOutput) {
+            imageModifiers = { DRM_FORMAT_MOD_LINEAR };
+        } else if (m_haveCachedModifier
+            && std::find(imageModifiers.begin(), imageModifiers.end(), m_cachedModifier)
+                != imageModifiers.end()) {
+            imageModifiers = { m_cachedModifier };
+        } else if (imageModifiers.empty()) {
+            imageModifiers.push_back(DRM_FORMAT_MOD_LINEAR);
+        }
         modifierListInfo.drmFormatModifierCount = imageModifiers.size();
         modifierListInfo.pDrmFormatModifiers = imageModifiers.data();
 
@@ -366,7 +556,8 @@ void Renderer::CreateOutput(uint32_t width, uint32_t height, ExternalHandle hand
         extMemImageInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
         m_output.imageInfo.pNext = &extMemImageInfo;
 
-        m_output.imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        // Linear so that NVENC can read the memory imported into CUDA as a pitched surface
+        m_output.imageInfo.tiling = VK_IMAGE_TILING_LINEAR;
         VK_CHECK(vkCreateImage(m_dev, &m_output.imageInfo, nullptr, &m_output.image));
     } else {
         m_output.imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -481,6 +672,82 @@ void Renderer::CreateOutput(uint32_t width, uint32_t height, ExternalHandle hand
     VK_CHECK(vkCreateSemaphore(m_dev, &semInfo, nullptr, &m_output.semaphore));
 }
 
+void Renderer::LoadModifierCache(const std::string& dir) {
+    VkPhysicalDeviceProperties props = {};
+    vkGetPhysicalDeviceProperties(m_physDev, &props);
+
+    char name[64];
+    snprintf(
+        name,
+        sizeof(name),
+        "/drm_modifier_%04x_%04x_%08x.txt",
+        props.vendorID,
+        props.deviceID,
+        props.driverVersion
+    );
+    m_modifierCachePath = dir + name;
+
+    // A single line "<VkFormat> <modifier in hex>", for the format of the last output
+    std::ifstream is(m_modifierCachePath);
+    uint32_t format = 0;
+    uint64_t modifier = 0;
+    if (is >> format >> std::hex >> modifier && format == (uint32_t)m_format) {
+        m_haveCachedModifier = true;
+        m_cachedModifier = modifier;
+        std::cout << "Cached DRM modifier " << std::hex << modifier << std::dec << std::endl;
+    }
+}
+
+bool Renderer::CanChangeOutputModifier() const {
+    return m_outputHandle == ExternalHandle::DmaBuf && d.haveDrmModifiers
+        && m_output.imageInfo.tiling == VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT
+        && m_output.drm.modifier != DRM_FORMAT_MOD_LINEAR;
+}
+
+void Renderer::RecreateOutput() {
+    m_rejectedModifiers.push_back(m_output.drm.modifier);
+    if (m_haveCachedModifier && m_cachedModifier == m_output.drm.modifier) {
+        m_haveCachedModifier = false;
+    }
+
+    // A rebuilt encoder can renegotiate while frames are still in flight
+    vkDeviceWaitIdle(m_dev);
+    const VkExtent3D extent = m_output.imageInfo.extent;
+    destroyOutput();
+    if (m_output.drm.fd != -1) {
+        close(m_output.drm.fd);
+    }
+    m_output = {};
+    CreateOutput(extent.width, extent.height, m_outputHandle);
+}
+
+void Renderer::SaveOutputModifier() {
+    if (m_modifierCachePath.empty()
+        || m_output.imageInfo.tiling != VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT
+        || (m_haveCachedModifier && m_cachedModifier == m_output.drm.modifier)) {
+        return;
+    }
+    m_haveCachedModifier = true;
+    m_cachedModifier = m_output.drm.modifier;
+
+    // Written aside and renamed, so that an interrupted write never leaves a truncated cache
+    const std::string tmpPath = m_modifierCachePath + InstanceSuffix() + ".tmp";
+    std::ofstream os(tmpPath, std::ios::out | std::ios::trunc);
+    os << (uint32_t)m_format << " " << std::hex << m_cachedModifier << "\n";
+    os.close();
+    if (!os || rename(tmpPath.c_str(), m_modifierCachePath.c_str()) != 0) {
+        std::cerr << "Failed to write DRM modifier cache " << m_modifierCachePath << std::endl;
+        remove(tmpPath.c_str());
+    }
+}
+
+void Renderer::destroyOutput() {
+    vkDestroyImageView(m_dev, m_output.view, nullptr);
+    vkDestroyImage(m_dev, m_output.image, nullptr);
+    vkFreeMemory(m_dev, m_output.memory, nullptr);
+    vkDestroySemaphore(m_dev, m_output.semaphore, nullptr);
+}
+
 void Renderer::ImportOutput(const DrmImage& drm) {
     vkDestroyImageView(m_dev, m_output.view, nullptr);
     vkDestroyImage(m_dev, m_output.image, nullptr);
@@ -488,6 +755,7 @@ void Renderer::ImportOutput(const DrmImage& drm) {
 
     m_output.drm = drm;
     m_output.imageInfo.tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
+    ++m_recordingGeneration;
 
     VkExternalMemoryImageCreateInfo extMemImageInfo = {};
     extMemImageInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
@@ -567,7 +835,7 @@ void Renderer::ImportOutput(const DrmImage& drm) {
     VK_CHECK(vkCreateImageView(m_dev, &viewInfo, nullptr, &m_output.view));
 }
 
-void Renderer::Render(uint32_t index, uint64_t waitValue) {
+uint64_t Renderer::Render(uint32_t index, uint64_t waitValue) {
     if (!m_inputImageCapture.empty()) {
         VkSemaphoreWaitInfo waitInfo = {};
         waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
@@ -587,13 +855,236 @@ void Renderer::Render(uint32_t index, uint64_t waitValue) {
         m_inputImageCapture.clear();
     }
 
-    VkCommandBufferBeginInfo commandBufferBegin = {};
-    commandBufferBegin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    VK_CHECK(vkBeginCommandBuffer(m_commandBuffer, &commandBufferBegin));
+    uint64_t frame = ++m_frameCounter;
+    FrameSlot& slot = m_frameSlots[frame % FRAME_SLOTS];
+    // Only blocks if the frame submitted FRAME_SLOTS frames ago is still executing
+    waitFrame(slot.frame);
+    slot.frame = frame;
+    if (m_markerTexelSize) {
+        writePhotonMarker(slot, frame);
+    }
+    uint32_t query = (frame % FRAME_SLOTS) * SLOT_QUERIES;
+
+    // The flight recorder copies into a different ring slot every frame, those frames are
+    // recorded each time. Otherwise the commands only depend on the input image and the slot.
+    VkCommandBuffer commandBuffer = slot.commandBuffer;
+    Recording* recording = nullptr;
+    if (m_recorder.slots.empty()) {
+        if (m_recordings.size() < m_images.size() * FRAME_SLOTS) {
+            m_recordings.resize(m_images.size() * FRAME_SLOTS);
+        }
+        recording = &m_recordings[index * FRAME_SLOTS + frame % FRAME_SLOTS];
+        commandBuffer = recording->commandBuffer;
+        if (commandBuffer == VK_NULL_HANDLE) {
+            VkCommandBufferAllocateInfo commandBufferInfo = {};
+            commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            commandBufferInfo.commandPool = m_commandPool;
+            commandBufferInfo.commandBufferCount = 1;
+            VK_CHECK(vkAllocateCommandBuffers(m_dev, &commandBufferInfo, &commandBuffer));
+            recording->commandBuffer = commandBuffer;
+        }
+
+        getTrackedLayouts(index, m_layoutScratch);
+        if (recording->generation == m_recordingGeneration
+            && recording->layoutsBefore == m_layoutScratch) {
+            // Its last submission has completed, waitFrame covered every frame of this slot
+            setTrackedLayouts(index, recording->layoutsAfter);
+        } else {
+            recording->generation = 0;
+            recording->layoutsBefore.swap(m_layoutScratch);
+        }
+    }
+
+    if (recording == nullptr || recording->generation == 0) {
+        VkCommandBufferBeginInfo commandBufferBegin = {};
+        commandBufferBegin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        VK_CHECK(vkBeginCommandBuffer(commandBuffer, &commandBufferBegin));
+
+        vkCmdResetQueryPool(commandBuffer, m_queryPool, query, SLOT_QUERIES);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, query);
+
+        recordPipelines(commandBuffer, index, query);
+        // Reads the pixels of the slot, which are written before each submission
+        if (m_markerTexelSize) {
+            recordPhotonMarker(commandBuffer, slot);
+        }
+
+        vkCmdWriteTimestamp(
+            commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, query + 1
+        );
+
+        // After the timestamp, the copies are not part of the render time
+        if (!m_recorder.slots.empty() && !m_recorder.writing) {
+            recordFrame(commandBuffer, index, frame);
+        }
+
+        VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+        if (recording) {
+            recording->generation = m_recordingGeneration;
+            getTrackedLayouts(index, recording->layoutsAfter);
+        }
+    }
+
+    // The binary output semaphore ignores its value
+    VkSemaphore signalSemaphores[2] = { m_output.semaphore, m_frameTimeline };
+    uint64_t signalValues[2] = { 0, frame };
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = 2;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &m_images[index].semaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.signalSemaphoreCount = 2;
+    submitInfo.pSignalSemaphores = signalSemaphores;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, nullptr));
+
+    if (m_recorder.dumpAt && frame >= m_recorder.dumpAt) {
+        m_recorder.dumpAt = 0;
+        m_recorder.writing = true;
+        if (m_recorder.writer.joinable()) {
+            m_recorder.writer.join();
+        }
+        m_recorder.writer = std::thread(&Renderer::writeRecorder, this, m_recorder.dumpDir, frame);
+    }
+
+    return frame;
+}
+
+bool Renderer::EnablePhotonMarker() {
+    // All ones is white in the UNORM formats, 0x3C00 is 1.0 in half floats. Black leaves the alpha
+    // at 0, which the encoders ignore.
+    switch (m_format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+        m_markerTexelSize = 4;
+        m_markerTexels[1] = 0xFFFFFFFF;
+        break;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        m_markerTexelSize = 8;
+        m_markerTexels[1] = 0x3C003C003C003C00;
+        break;
+    case VK_FORMAT_R16G16B16A16_UNORM:
+        m_markerTexelSize = 8;
+        m_markerTexels[1] = UINT64_MAX;
+        break;
+    default:
+        std::cerr << "Photon marker: unsupported format " << m_format << std::endl;
+        return false;
+    }
+
+    for (FrameSlot& slot : m_frameSlots) {
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = PHOTON_MARKER_WIDTH * PHOTON_MARKER_HEIGHT * m_markerTexelSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VK_CHECK(vkCreateBuffer(m_dev, &bufferInfo, nullptr, &slot.markerBuffer));
+
+        VkMemoryRequirements memoryReqs;
+        vkGetBufferMemoryRequirements(m_dev, slot.markerBuffer, &memoryReqs);
+        VkMemoryAllocateInfo memoryAllocInfo = {};
+        memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memoryAllocInfo.allocationSize = memoryReqs.size;
+        memoryAllocInfo.memoryTypeIndex = memoryTypeIndex(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            memoryReqs.memoryTypeBits
+        );
+        VK_CHECK(vkAllocateMemory(m_dev, &memoryAllocInfo, nullptr, &slot.markerMemory));
+        VK_CHECK(vkBindBufferMemory(m_dev, slot.markerBuffer, slot.markerMemory, 0));
+        void* mapped;
+        VK_CHECK(vkMapMemory(m_dev, slot.markerMemory, 0, VK_WHOLE_SIZE, 0, &mapped));
+        slot.markerPixels = static_cast<uint8_t*>(mapped);
+    }
+    return true;
+}
+
+// The previous submission of the slot has completed, its pixels can be overwritten
+void Renderer::writePhotonMarker(FrameSlot& slot, uint64_t frame) {
+    uint8_t cells[PHOTON_MARKER_CELLS];
+    GetPhotonMarkerCells(m_markerTimestampNs, (uint32_t)frame, cells);
+    uint8_t* pixel = slot.markerPixels;
+    for (uint32_t y = 0; y < PHOTON_MARKER_HEIGHT; y++) {
+        const uint8_t* row = &cells[y / PHOTON_MARKER_CELL_SIZE * PHOTON_MARKER_COLUMNS];
+        for (uint32_t x = 0; x < PHOTON_MARKER_WIDTH; x++) {
+            memcpy(pixel, &m_markerTexels[row[x / PHOTON_MARKER_CELL_SIZE]], m_markerTexelSize);
+            pixel += m_markerTexelSize;
+        }
+    }
+}
+
+void Renderer::recordPhotonMarker(VkCommandBuffer commandBuffer, const FrameSlot& slot) {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1,
+        &barrier,
+        0,
+        nullptr,
+        0,
+        nullptr
+    );
+
+    VkBufferImageCopy region = {};
+    region.bufferRowLength = PHOTON_MARKER_WIDTH;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = std::min(PHOTON_MARKER_WIDTH, m_output.imageInfo.extent.width);
+    region.imageExtent.height = std::min(PHOTON_MARKER_HEIGHT, m_output.imageInfo.extent.height);
+    region.imageExtent.depth = 1;
+    vkCmdCopyBufferToImage(
+        commandBuffer, slot.markerBuffer, m_output.image, VK_IMAGE_LAYOUT_GENERAL, 1, &region
+    );
+
+    // For the flight recorder, which samples the output
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1,
+        &barrier,
+        0,
+        nullptr,
+        0,
+        nullptr
+    );
+}
 
-    vkCmdResetQueryPool(m_commandBuffer, m_queryPool, 0, 2);
-    vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, 0);
+uint32_t Renderer::passTimestampCount() const {
+    if (m_pipelines.empty()) {
+        return 0;
+    }
+    return std::min<uint32_t>(m_pipelines.size() - 1, SLOT_QUERIES - 2);
+}
 
+void Renderer::recordPipelines(VkCommandBuffer commandBuffer, uint32_t index, uint32_t query) {
+    const uint32_t passTimestamps = passTimestampCount();
     for (size_t i = 0; i < m_pipelines.size(); ++i) {
         VkRect2D rect = {};
         VkImage in = VK_NULL_HANDLE;
@@ -652,7 +1143,7 @@ void Renderer::Render(uint32_t index, uint64_t waitValue) {
         }
         if (imageBarriers.size()) {
             vkCmdPipelineBarrier(
-                m_commandBuffer,
+                commandBuffer,
                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                 0,
@@ -664,31 +1155,43 @@ void Renderer::Render(uint32_t index, uint64_t waitValue) {
                 imageBarriers.data()
             );
         }
-        m_pipelines[i]->Render(inView, outView, rect);
+        m_pipelines[i]->Render(commandBuffer, inView, outView, rect);
+        if (i < passTimestamps) {
+            vkCmdWriteTimestamp(
+                commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, query + 2 + i
+            );
+        }
     }
+}
 
-    vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 1);
-
-    VK_CHECK(vkEndCommandBuffer(m_commandBuffer));
+void Renderer::getTrackedLayouts(uint32_t index, std::vector<VkImageLayout>& layouts) const {
+    layouts.clear();
+    layouts.push_back(m_images[index].layout);
+    layouts.push_back(m_output.layout);
+    for (const StagingImage& img : m_stagingImages) {
+        layouts.push_back(img.layout);
+    }
+}
 
-    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
-    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
-    timelineInfo.waitSemaphoreValueCount = 1;
-    timelineInfo.pWaitSemaphoreValues = &waitValue;
+void Renderer::setTrackedLayouts(uint32_t index, const std::vector<VkImageLayout>& layouts) {
+    m_images[index].layout = layouts[0];
+    m_output.layout = layouts[1];
+    for (size_t i = 0; i < m_stagingImages.size(); ++i) {
+        m_stagingImages[i].layout = layouts[i + 2];
+    }
+}
 
-    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+void Renderer::waitFrame(uint64_t frame) {
+    if (frame == 0) {
+        return;
+    }
 
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pNext = &timelineInfo;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &m_images[index].semaphore;
-    submitInfo.pWaitDstStageMask = &waitStage;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &m_output.semaphore;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_commandBuffer;
-    VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, nullptr));
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_frameTimeline;
+    waitInfo.pValues = &frame;
+    VK_CHECK(vkWaitSemaphores(m_dev, &waitInfo, UINT64_MAX));
 }
 
 void Renderer::Sync() {
@@ -705,34 +1208,83 @@ void Renderer::Sync() {
     VK_CHECK(vkResetFences(m_dev, 1, &m_fence));
 }
 
+void Renderer::ResignalOutput() {
+    // Signal operations cover everything earlier in submission order, including the render
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_output.semaphore;
+    VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE));
+}
+
 Renderer::Output& Renderer::GetOutput() { return m_output; }
 
-Renderer::Timestamps Renderer::GetTimestamps() {
-    if (!d.haveCalibratedTimestamps) {
-        return { 0, 0, 0 };
+bool Renderer::GetTimestamps(uint64_t frame, Timestamps& out) {
+    if (!d.haveCalibratedTimestamps || frame == 0 || frame + FRAME_SLOTS <= m_frameCounter) {
+        return false;
+    }
+
+    uint64_t completed = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(m_dev, m_frameTimeline, &completed));
+    if (completed < frame) {
+        return false;
     }
 
-    uint64_t queries[2];
-    VK_CHECK(vkGetQueryPoolResults(
+    const uint32_t queryCount = 2 + passTimestampCount();
+    uint64_t queries[SLOT_QUERIES];
+    VkResult res = vkGetQueryPoolResults(
         m_dev,
         m_queryPool,
-        0,
-        2,
-        2 * sizeof(uint64_t),
+        (frame % FRAME_SLOTS) * SLOT_QUERIES,
+        queryCount,
+        queryCount * sizeof(uint64_t),
         queries,
         sizeof(uint64_t),
         VK_QUERY_RESULT_64_BIT
-    ));
-    queries[0] *= m_timestampPeriod;
-    queries[1] *= m_timestampPeriod;
+    );
+    if (res == VK_NOT_READY) {
+        return false;
+    }
+    VK_CHECK(res);
+    for (uint32_t i = 0; i < queryCount; i++) {
+        queries[i] *= m_timestampPeriod;
+    }
 
-    VkCalibratedTimestampInfoEXT timestampInfo = {};
-    timestampInfo.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
-    timestampInfo.timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    if (GpuPassStatsEnabled()) {
+        uint64_t passBegin = queries[0];
+        for (size_t i = 0; i < m_pipelines.size(); i++) {
+            // The last timed pipeline also covers the ones past SLOT_QUERIES
+            bool last = i + 2 >= queryCount;
+            uint64_t passEnd = last ? queries[1] : queries[2 + i];
+            GpuPassRecord(m_pipelines[i]->m_gpuPass, passEnd - passBegin);
+            if (last) {
+                break;
+            }
+            passBegin = passEnd;
+        }
+    }
+
+    // Both clocks are read together when the driver can, otherwise the host clock is read
+    // around the device one and the deviation covers the call
+    VkCalibratedTimestampInfoEXT timestampInfo[2] = {};
+    timestampInfo[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    timestampInfo[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    timestampInfo[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    timestampInfo[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+    uint32_t domains = d.haveMonotonicTimeDomain ? 2 : 1;
+    uint64_t timestamps[2];
     uint64_t deviation;
-    uint64_t timestamp;
-    VK_CHECK(d.vkGetCalibratedTimestampsEXT(m_dev, 1, &timestampInfo, &timestamp, &deviation));
-    timestamp *= m_timestampPeriod;
+    uint64_t before = FrameTraceNow();
+    VK_CHECK(
+        d.vkGetCalibratedTimestampsEXT(m_dev, domains, timestampInfo, timestamps, &deviation)
+    );
+    uint64_t after = FrameTraceNow();
+    uint64_t hostNs = timestamps[1];
+    if (!d.haveMonotonicTimeDomain) {
+        hostNs = before + (after - before) / 2;
+        deviation = std::max(deviation, (after - before) / 2);
+    }
+    m_deviceClock.AddCalibration(timestamps[0] * m_timestampPeriod, hostNs, deviation);
 
     if (!m_outputImageCapture.empty()) {
         dumpImage(
@@ -746,13 +1298,280 @@ Renderer::Timestamps Renderer::GetTimestamps() {
         m_outputImageCapture.clear();
     }
 
-    return { timestamp, queries[0], queries[1] };
+    out = { hostNs, m_deviceClock.ToHost(queries[0]), m_deviceClock.ToHost(queries[1]) };
+    return true;
 }
 
 void Renderer::CaptureInputFrame(const std::string& filename) { m_inputImageCapture = filename; }
 
 void Renderer::CaptureOutputFrame(const std::string& filename) { m_outputImageCapture = filename; }
 
+void Renderer::SetupRecorder(uint32_t frames, uint32_t divisor) {
+    divisor = std::max(divisor, 1u);
+    m_recorder.inputSize.width = std::max(m_imageSize.width / divisor, 1u);
+    m_recorder.inputSize.height = std::max(m_imageSize.height / divisor, 1u);
+    m_recorder.outputSize.width = std::max(m_output.imageInfo.extent.width / divisor, 1u);
+    m_recorder.outputSize.height = std::max(m_output.imageInfo.extent.height / divisor, 1u);
+
+    // A slot is only reused once the frame it was written by has completed, which waitFrame
+    // guarantees for the frames FRAME_SLOTS apart
+    m_recorder.slots.resize(std::max(frames, FRAME_SLOTS));
+    for (RecorderSlot& slot : m_recorder.slots) {
+        slot.input = createRecorderImage(m_recorder.inputSize.width, m_recorder.inputSize.height);
+        slot.output
+            = createRecorderImage(m_recorder.outputSize.width, m_recorder.outputSize.height);
+    }
+
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = m_quadShaderSize;
+    moduleInfo.pCode = m_quadShaderCode;
+    VK_CHECK(vkCreateShaderModule(m_dev, &moduleInfo, nullptr, &m_recorder.shader));
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_descriptorLayout;
+    VK_CHECK(
+        vkCreatePipelineLayout(m_dev, &pipelineLayoutInfo, nullptr, &m_recorder.pipelineLayout)
+    );
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.layout = m_recorder.pipelineLayout;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.module = m_recorder.shader;
+    VK_CHECK(vkCreateComputePipelines(
+        m_dev, m_pipelineCache, 1, &pipelineInfo, nullptr, &m_recorder.pipeline
+    ));
+
+    std::cout << "Flight recorder: " << m_recorder.slots.size() << " frames of "
+              << m_recorder.inputSize.width << "x" << m_recorder.inputSize.height << " and "
+              << m_recorder.outputSize.width << "x" << m_recorder.outputSize.height << std::endl;
+}
+
+void Renderer::DumpRecorder(const std::string& dir, uint32_t framesAfter) {
+    if (m_recorder.slots.empty() || m_recorder.dumpAt || m_recorder.writing) {
+        return;
+    }
+    // Named after the frame of the event, the files after the frames
+    m_recorder.dumpDir = dir + "/alvr_recorder" + InstanceSuffix() + "_"
+        + std::to_string(std::time(nullptr)) + "_" + std::to_string(m_frameCounter + 1);
+    m_recorder.dumpAt = m_frameCounter + 1 + framesAfter;
+}
+
+Renderer::RecorderImage Renderer::createRecorderImage(uint32_t width, uint32_t height) {
+    RecorderImage image;
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_LINEAR;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+    VK_CHECK(vkCreateImage(m_dev, &imageInfo, nullptr, &image.image));
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(m_dev, image.image, &memReqs);
+    VkMemoryAllocateInfo memAllocInfo = {};
+    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memAllocInfo.allocationSize = memReqs.size;
+    memAllocInfo.memoryTypeIndex = memoryTypeIndex(
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        memReqs.memoryTypeBits
+    );
+    VK_CHECK(vkAllocateMemory(m_dev, &memAllocInfo, nullptr, &image.memory));
+    VK_CHECK(vkBindImageMemory(m_dev, image.image, image.memory, 0));
+
+    VkImageSubresource subresource = {};
+    subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    VkSubresourceLayout layout;
+    vkGetImageSubresourceLayout(m_dev, image.image, &subresource, &layout);
+    image.rowPitch = layout.rowPitch;
+    // Mapped for the lifetime of the recorder
+    VK_CHECK(vkMapMemory(m_dev, image.memory, 0, VK_WHOLE_SIZE, 0, (void**)&image.mapped));
+    image.mapped += layout.offset;
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = imageInfo.format;
+    viewInfo.image = image.image;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+    VK_CHECK(vkCreateImageView(m_dev, &viewInfo, nullptr, &image.view));
+
+    return image;
+}
+
+void Renderer::recordFrame(VkCommandBuffer commandBuffer, uint32_t index, uint64_t frame) {
+    RecorderSlot& slot = m_recorder.slots[frame % m_recorder.slots.size()];
+    slot.frame = frame;
+    InputImage& input = m_images[index];
+
+    VkImageMemoryBarrier imageBarrier = {};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageBarrier.subresourceRange.layerCount = 1;
+    imageBarrier.subresourceRange.levelCount = 1;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    if (input.layout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        imageBarrier.image = input.image;
+        imageBarrier.oldLayout = input.layout;
+        input.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageBarrier.newLayout = input.layout;
+        imageBarrier.srcAccessMask = 0;
+        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        imageBarriers.push_back(imageBarrier);
+    }
+    // The output was just written by the last pipeline
+    imageBarrier.image = m_output.image;
+    imageBarrier.oldLayout = m_output.layout;
+    imageBarrier.newLayout = m_output.layout;
+    imageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    imageBarriers.push_back(imageBarrier);
+    for (RecorderImage* image : { &slot.input, &slot.output }) {
+        if (image->layout != VK_IMAGE_LAYOUT_GENERAL) {
+            imageBarrier.image = image->image;
+            imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            image->layout = VK_IMAGE_LAYOUT_GENERAL;
+            imageBarrier.newLayout = image->layout;
+            imageBarrier.srcAccessMask = 0;
+            imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            imageBarriers.push_back(imageBarrier);
+        }
+    }
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0,
+        nullptr,
+        0,
+        nullptr,
+        imageBarriers.size(),
+        imageBarriers.data()
+    );
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_recorder.pipeline);
+    struct Copy {
+        VkImageView in;
+        VkImageLayout inLayout;
+        const RecorderImage& out;
+        VkExtent2D size;
+    };
+    for (const Copy& copy :
+         { Copy { input.view, input.layout, slot.input, m_recorder.inputSize },
+           Copy { m_output.view, m_output.layout, slot.output, m_recorder.outputSize } }) {
+        VkDescriptorImageInfo descriptorImageInfoIn = {};
+        descriptorImageInfoIn.imageView = copy.in;
+        descriptorImageInfoIn.imageLayout = copy.inLayout;
+
+        VkDescriptorImageInfo descriptorImageInfoOut = {};
+        descriptorImageInfoOut.imageView = copy.out.view;
+        descriptorImageInfoOut.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWriteSets = {};
+        descriptorWriteSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWriteSets[0].descriptorCount = 1;
+        descriptorWriteSets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWriteSets[0].pImageInfo = &descriptorImageInfoIn;
+        descriptorWriteSets[0].dstBinding = 0;
+        descriptorWriteSets[1] = descriptorWriteSets[0];
+        descriptorWriteSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWriteSets[1].pImageInfo = &descriptorImageInfoOut;
+        descriptorWriteSets[1].dstBinding = 1;
+
+        d.vkCmdPushDescriptorSetKHR(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            m_recorder.pipelineLayout,
+            0,
+            descriptorWriteSets.size(),
+            descriptorWriteSets.data()
+        );
+        vkCmdDispatch(commandBuffer, (copy.size.width + 7) / 8, (copy.size.height + 7) / 8, 1);
+    }
+
+    // Made visible to the host once the frame timeline is signalled
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1,
+        &memoryBarrier,
+        0,
+        nullptr,
+        0,
+        nullptr
+    );
+}
+
+// Runs on the writer thread, the render thread doesn't touch the ring until writing is cleared
+void Renderer::writeRecorder(const std::string& dir, uint64_t lastFrame) {
+    waitFrame(lastFrame);
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "Flight recorder: can't create \"" << dir << "\": " << ec.message()
+                  << std::endl;
+    } else {
+        std::vector<RecorderSlot*> slots;
+        for (RecorderSlot& slot : m_recorder.slots) {
+            if (slot.frame != 0) {
+                slots.push_back(&slot);
+            }
+        }
+        std::sort(slots.begin(), slots.end(), [](RecorderSlot* a, RecorderSlot* b) {
+            return a->frame < b->frame;
+        });
+        for (RecorderSlot* slot : slots) {
+            std::string prefix = dir + "/frame_" + std::to_string(slot->frame);
+            write_ppm(
+                prefix + "_input.ppm",
+                slot->input.mapped,
+                slot->input.rowPitch,
+                m_recorder.inputSize.width,
+                m_recorder.inputSize.height
+            );
+            write_ppm(
+                prefix + "_output.ppm",
+                slot->output.mapped,
+                slot->output.rowPitch,
+                m_recorder.outputSize.width,
+                m_recorder.outputSize.height
+            );
+        }
+        std::cout << "Flight recorder: " << slots.size() << " frames saved to \"" << dir << "\""
+                  << std::endl;
+    }
+
+    // The next dump only holds the frames recorded after this one
+    for (RecorderSlot& slot : m_recorder.slots) {
+        slot.frame = 0;
+    }
+    m_recorder.writing = false;
+}
+
 std::string Renderer::result_to_str(VkResult result) {
     switch (result) {
 #define VAL(x)                                                                                     \
@@ -972,7 +1791,9 @@ void Renderer::dumpImage(
     pipelineInfo.layout = pipelineLayout;
     pipelineInfo.stage = stageInfo;
     VkPipeline pipeline;
-    VK_CHECK(vkCreateComputePipelines(m_dev, nullptr, 1, &pipelineInfo, nullptr, &pipeline));
+    VK_CHECK(
+        vkCreateComputePipelines(m_dev, m_pipelineCache, 1, &pipelineInfo, nullptr, &pipeline)
+    );
 
     std::array<VkImageMemoryBarrier, 2> imageBarrierOut;
     imageBarrierOut[0] = {};
@@ -1067,20 +1888,7 @@ void Renderer::dumpImage(
     VK_CHECK(vkMapMemory(m_dev, dstMemory, 0, VK_WHOLE_SIZE, 0, (void**)&imageData));
     imageData += layout.offset;
 
-    std::ofstream file(filename, std::ios::out | std::ios::binary);
-
-    // PPM header
-    file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
-
-    // PPM binary pixel data
-    for (uint32_t y = 0; y < height; y++) {
-        uint32_t* row = (uint32_t*)imageData;
-        for (uint32_t x = 0; x < width; x++) {
-            file.write((char*)row++, 3);
-        }
-        imageData += layout.rowPitch;
-    }
-    file.close();
+    write_ppm(filename, imageData, layout.rowPitch, width, height);
 
     std::cout << "Image saved to \"" << filename << "\"" << std::endl;
 
@@ -1161,11 +1969,15 @@ void RenderPipeline::Build() {
     pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
     pipelineInfo.layout = m_pipelineLayout;
     pipelineInfo.stage = stageInfo;
-    VK_CHECK(vkCreateComputePipelines(r->m_dev, nullptr, 1, &pipelineInfo, nullptr, &m_pipeline));
+    VK_CHECK(vkCreateComputePipelines(
+        r->m_dev, r->m_pipelineCache, 1, &pipelineInfo, nullptr, &m_pipeline
+    ));
 }
 
-void RenderPipeline::Render(VkImageView in, VkImageView out, VkRect2D outSize) {
-    vkCmdBindPipeline(r->m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+void RenderPipeline::Render(
+    VkCommandBuffer commandBuffer, VkImageView in, VkImageView out, VkRect2D outSize
+) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
 
     VkDescriptorImageInfo descriptorImageInfoIn = {};
     descriptorImageInfoIn.imageView = in;
@@ -1187,7 +1999,7 @@ void RenderPipeline::Render(VkImageView in, VkImageView out, VkRect2D outSize) {
     descriptorWriteSets[1].pImageInfo = &descriptorImageInfoOut;
     descriptorWriteSets[1].dstBinding = 1;
     r->d.vkCmdPushDescriptorSetKHR(
-        r->m_commandBuffer,
+        commandBuffer,
         VK_PIPELINE_BIND_POINT_COMPUTE,
         m_pipelineLayout,
         0,
@@ -1196,6 +2008,6 @@ void RenderPipeline::Render(VkImageView in, VkImageView out, VkRect2D outSize) {
     );
 
     vkCmdDispatch(
-        r->m_commandBuffer, (outSize.extent.width + 7) / 8, (outSize.extent.height + 7) / 8, 1
+        commandBuffer, (outSize.extent.width + 7) / 8, (outSize.extent.height + 7) / 8, 1
     );
 }
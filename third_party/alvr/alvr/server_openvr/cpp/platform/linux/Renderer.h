@@ -3,9 +3,13 @@
 
 #pragma once
 
+#include "alvr_server/ClockSync.h"
+#include "alvr_server/bindings.h"
 #include <array>
+#include <atomic>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <vulkan/vulkan.h>
 
@@ -50,12 +54,20 @@ public:
         DrmImage drm;
     };
 
+    // In the FrameTraceNow() clock
     struct Timestamps {
         uint64_t now;
         uint64_t renderBegin;
         uint64_t renderComplete;
     };
 
+    // Frames whose GPU work and timestamp queries can be outstanding at once. One more than the
+    // deepest encode pipeline, so a frame can still be queried when it is drained.
+    static constexpr uint32_t FRAME_SLOTS = 4;
+    // Timestamps of a frame slot: the start, the end and the end of each pipeline but the last.
+    // The pipelines past the limit are timed together with the last one.
+    static constexpr uint32_t SLOT_QUERIES = 8;
+
     explicit Renderer(
         const VkInstance& inst,
         const VkDevice& dev,
@@ -67,23 +79,74 @@ public:
 
     void Startup(uint32_t width, uint32_t height, VkFormat format);
 
+    // Creates the pipelines through a cache stored in dir, which is written back on destruction.
+    // The file is named after the pipeline cache UUID, so a driver update starts a new one.
+    void LoadPipelineCache(const std::string& dir);
+
     void AddImage(VkImageCreateInfo imageInfo, size_t memoryIndex, int imageFd, int semaphoreFd);
+    // Replaces the input images with count new ones, fds holds their image and semaphore fds in
+    // turn. The pipelines and the output are kept, so the images must have the size and format of
+    // the previous ones, false otherwise.
+    bool ReplaceImages(
+        VkImageCreateInfo imageInfo, size_t memoryIndex, const int fds[], size_t count
+    );
 
     void AddPipeline(RenderPipeline* pipeline);
 
     void CreateOutput(uint32_t width, uint32_t height, ExternalHandle handle);
     void ImportOutput(const DrmImage& drm);
 
-    void Render(uint32_t index, uint64_t waitValue);
+    // DRM format modifier negotiation of a DmaBuf output. When the encoder can't import the
+    // output, RecreateOutput creates it again without the modifiers rejected so far, the last
+    // resort being linear. The modifier of an output that was imported is cached in dir per GPU
+    // and driver version, and is then the only one offered to the driver.
+    void LoadModifierCache(const std::string& dir);
+    bool CanChangeOutputModifier() const;
+    void RecreateOutput();
+    void SaveOutputModifier();
+    // For an encoder on another GPU, which doesn't share the tiled layouts of this one
+    void RequireLinearOutput() { m_linearOutput = true; }
+
+    // Stamps the marker of PhotonMarker.h into the top left corner of every output, with the
+    // timestamp given to SetPhotonMarker. Before CreateOutput. Returns false for the output
+    // formats it can't write.
+    bool EnablePhotonMarker();
+    // Timestamp of the next Render
+    void SetPhotonMarker(uint64_t targetTimestampNs) { m_markerTimestampNs = targetTimestampNs; }
+
+    // Returns the id of the submitted frame, to be used with GetTimestamps
+    uint64_t Render(uint32_t index, uint64_t waitValue);
 
     void Sync();
 
+    // Signals the output semaphore again once all work submitted so far has completed, so that
+    // another consumer can wait on the frame its first consumer already waited on.
+    void ResignalOutput();
+
     Output& GetOutput();
-    Timestamps GetTimestamps();
+    bool HasTimestamps() const { return d.haveCalibratedTimestamps; }
+    // Never waits for the GPU. Returns false if the frame is still rendering, if its queries have
+    // already been reused by a newer frame or if timestamps are not supported. Also reports the
+    // GPU time of each pipeline to GpuPassRecord.
+    bool GetTimestamps(uint64_t frame, Timestamps& out);
+    // Time of a GPU timestamp, in nanoseconds of the device clock, in the FrameTraceNow() clock.
+    // Calibrated by GetTimestamps.
+    uint64_t DeviceToHostNs(uint64_t deviceNs) const { return m_deviceClock.ToHost(deviceNs); }
 
     void CaptureInputFrame(const std::string& filename);
     void CaptureOutputFrame(const std::string& filename);
 
+    // Flight recorder: the inputs and outputs of the last `frames` frames, downscaled by
+    // `divisor`, are copied to a host-visible ring by the render submissions themselves. Nothing
+    // is read back before DumpRecorder, and the render thread never waits for it.
+    void SetupRecorder(uint32_t frames, uint32_t divisor);
+    bool HasRecorder() const { return !m_recorder.slots.empty(); }
+    uint32_t GetRecorderFrames() const { return m_recorder.slots.size(); }
+    // Writes the ring to a new directory in dir from a background thread once `framesAfter` more
+    // frames were rendered, so that it holds the frames around the event. Ignored while a dump is
+    // pending or being written.
+    void DumpRecorder(const std::string& dir, uint32_t framesAfter);
+
     static std::string result_to_str(VkResult result);
 
     // private:
@@ -102,9 +165,58 @@ public:
         VkImageView view = VK_NULL_HANDLE;
     };
 
+    struct RecorderImage {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        const char* mapped = nullptr;
+        VkDeviceSize rowPitch = 0;
+    };
+
+    struct RecorderSlot {
+        RecorderImage input;
+        RecorderImage output;
+        // Render frame copied to this slot, 0 if none since the last dump
+        uint64_t frame = 0;
+    };
+
+    struct FrameSlot {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        // Timeline value signalled once this slot's work is complete
+        uint64_t frame = 0;
+        // Pixels of the photon marker of the frame, copied into the output
+        VkBuffer markerBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory markerMemory = VK_NULL_HANDLE;
+        uint8_t* markerPixels = nullptr;
+    };
+
+    // Render commands of one input image in one frame slot. Submitted again unchanged while the
+    // images start in the layouts it was recorded from.
+    struct Recording {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        // m_recordingGeneration it was recorded in, 0 if never
+        uint64_t generation = 0;
+        // Of the images in trackedLayouts order
+        std::vector<VkImageLayout> layoutsBefore;
+        std::vector<VkImageLayout> layoutsAfter;
+    };
+
+    void waitFrame(uint64_t frame);
+    void recordPipelines(VkCommandBuffer commandBuffer, uint32_t index, uint32_t query);
+    uint32_t passTimestampCount() const;
+    // Layouts of the images a frame of input `index` goes through: the input, the output and
+    // the staging images
+    void getTrackedLayouts(uint32_t index, std::vector<VkImageLayout>& layouts) const;
+    void setTrackedLayouts(uint32_t index, const std::vector<VkImageLayout>& layouts);
     void commandBufferBegin();
     void commandBufferSubmit();
     void addStagingImage(uint32_t width, uint32_t height);
+    RecorderImage createRecorderImage(uint32_t width, uint32_t height);
+    void recordFrame(VkCommandBuffer commandBuffer, uint32_t index, uint64_t frame);
+    void writePhotonMarker(FrameSlot& slot, uint64_t frame);
+    void recordPhotonMarker(VkCommandBuffer commandBuffer, const FrameSlot& slot);
+    void writeRecorder(const std::string& dir, uint64_t lastFrame);
     void dumpImage(
         VkImage image,
         VkImageView imageView,
@@ -114,6 +226,8 @@ public:
         const std::string& filename
     );
     uint32_t memoryTypeIndex(VkMemoryPropertyFlags properties, uint32_t typeBits) const;
+    void savePipelineCache();
+    void destroyOutput();
 
     struct {
         PFN_vkImportSemaphoreFdKHR vkImportSemaphoreFdKHR = nullptr;
@@ -122,10 +236,15 @@ public:
         PFN_vkGetImageDrmFormatModifierPropertiesEXT vkGetImageDrmFormatModifierPropertiesEXT
             = nullptr;
         PFN_vkGetCalibratedTimestampsEXT vkGetCalibratedTimestampsEXT = nullptr;
+        PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT
+            vkGetPhysicalDeviceCalibrateableTimeDomainsEXT
+            = nullptr;
         PFN_vkCmdPushDescriptorSetKHR vkCmdPushDescriptorSetKHR = nullptr;
         bool haveDmaBuf = false;
         bool haveDrmModifiers = false;
         bool haveCalibratedTimestamps = false;
+        // CLOCK_MONOTONIC can be read together with the device clock, it is the steady clock
+        bool haveMonotonicTimeDomain = false;
     } d;
 
     Output m_output;
@@ -144,15 +263,52 @@ public:
     VkCommandPool m_commandPool = VK_NULL_HANDLE;
     VkSampler m_sampler = VK_NULL_HANDLE;
     VkDescriptorSetLayout m_descriptorLayout = VK_NULL_HANDLE;
+    VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+    std::string m_pipelineCachePath;
+    ExternalHandle m_outputHandle = ExternalHandle::None;
+    std::vector<uint64_t> m_rejectedModifiers;
+    bool m_linearOutput = false;
+    bool m_haveCachedModifier = false;
+    uint64_t m_cachedModifier = 0;
+    std::string m_modifierCachePath;
     VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
     VkFence m_fence = VK_NULL_HANDLE;
+    std::array<FrameSlot, FRAME_SLOTS> m_frameSlots;
+    // FRAME_SLOTS per input image
+    std::vector<Recording> m_recordings;
+    // Bumped when an image view or a pipeline the recordings refer to is replaced
+    uint64_t m_recordingGeneration = 1;
+    std::vector<VkImageLayout> m_layoutScratch;
+    VkSemaphore m_frameTimeline = VK_NULL_HANDLE;
+    uint64_t m_frameCounter = 0;
+    // Bytes of an output texel, 0 without the photon marker
+    uint32_t m_markerTexelSize = 0;
+    // Black and white texels in the output format, little endian
+    uint64_t m_markerTexels[2] = {};
+    uint64_t m_markerTimestampNs = 0;
     double m_timestampPeriod = 0;
+    ClockSync m_deviceClock;
 
     size_t m_quadShaderSize = 0;
     const uint32_t* m_quadShaderCode = nullptr;
 
     std::string m_inputImageCapture;
     std::string m_outputImageCapture;
+
+    struct {
+        std::vector<RecorderSlot> slots;
+        VkExtent2D inputSize = { 0, 0 };
+        VkExtent2D outputSize = { 0, 0 };
+        VkShaderModule shader = VK_NULL_HANDLE;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        // Frame after which the ring is written to dumpDir, 0 if no dump is pending
+        uint64_t dumpAt = 0;
+        std::string dumpDir;
+        // Set while the writer reads the ring, which isn't recorded to meanwhile
+        std::atomic_bool writing = false;
+        std::thread writer;
+    } m_recorder;
 };
 
 class RenderPipeline {
@@ -170,15 +326,19 @@ public:
         m_constantEntries = std::move(entries);
     }
 
+    // The histogram the GPU time of the pipeline is reported to
+    void SetGpuPass(FfiGpuPass pass) { m_gpuPass = pass; }
+
 private:
     void Build();
-    void Render(VkImageView in, VkImageView out, VkRect2D outSize);
+    void Render(VkCommandBuffer commandBuffer, VkImageView in, VkImageView out, VkRect2D outSize);
 
     Renderer* r;
     VkShaderModule m_shader = VK_NULL_HANDLE;
     const void* m_constant = nullptr;
     uint32_t m_constantSize = 0;
     std::vector<VkSpecializationMapEntry> m_constantEntries;
+    FfiGpuPass m_gpuPass = GPU_PASS_CUSTOM_SHADER;
     VkPipeline m_pipeline = VK_NULL_HANDLE;
     VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
 
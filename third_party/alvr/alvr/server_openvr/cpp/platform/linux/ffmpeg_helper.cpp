@@ -3,13 +3,16 @@
 
 #include "ffmpeg_helper.h"
 
+#include <algorithm>
 #include <chrono>
 #include <fcntl.h>
+#include <fstream>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <unistd.h>
 
 #include "alvr_server/Logger.h"
+#include "alvr_server/Settings.h"
 #include "alvr_server/bindings.h"
 
 extern "C" {
@@ -19,6 +22,57 @@ extern "C" {
 }
 
 namespace {
+// Extensions of the Vulkan Video encoders of ffmpeg. Maintenance 1 lets the frames of the vulkan
+// filters be encoded without creating them for a specific video profile.
+const char* const VIDEO_ENCODE_EXTENSIONS[] = {
+    VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
+    VK_KHR_VIDEO_QUEUE_EXTENSION_NAME,
+    VK_KHR_VIDEO_ENCODE_QUEUE_EXTENSION_NAME,
+    VK_KHR_VIDEO_ENCODE_H264_EXTENSION_NAME,
+    VK_KHR_VIDEO_ENCODE_H265_EXTENSION_NAME,
+#ifdef VK_KHR_video_encode_av1
+    VK_KHR_VIDEO_ENCODE_AV1_EXTENSION_NAME,
+#endif
+#ifdef VK_KHR_video_maintenance1
+    VK_KHR_VIDEO_MAINTENANCE_1_EXTENSION_NAME,
+#endif
+};
+
+bool has_extension(const std::vector<const char*>& extensions, const char* name) {
+    return std::any_of(extensions.begin(), extensions.end(), [name](const char* e) {
+        return strcmp(e, name) == 0;
+    });
+}
+
+// PCI vendor of the GPU behind a DRM device node, 0 if unknown
+uint32_t drm_device_vendor(const std::string& path) {
+    struct stat s = {};
+    if (stat(path.c_str(), &s) != 0) {
+        return 0;
+    }
+    std::string sysfs = "/sys/dev/char/" + std::to_string(major(s.st_rdev)) + ":"
+        + std::to_string(minor(s.st_rdev)) + "/device/vendor";
+    std::ifstream is(sysfs);
+    uint32_t vendor = 0;
+    is >> std::hex >> vendor;
+    return vendor;
+}
+
+// NUMA node of the PCIe root of the GPU behind a DRM device node, -1 if unknown or if the host
+// has a single node
+int drm_device_numa_node(const std::string& path) {
+    struct stat s = {};
+    if (stat(path.c_str(), &s) != 0 || access("/sys/devices/system/node/node1", F_OK) != 0) {
+        return -1;
+    }
+    std::string sysfs = "/sys/dev/char/" + std::to_string(major(s.st_rdev)) + ":"
+        + std::to_string(minor(s.st_rdev)) + "/device/numa_node";
+    std::ifstream is(sysfs);
+    int node = -1;
+    is >> node;
+    return node;
+}
+
 // it seems that ffmpeg does not provide this mapping
 AVPixelFormat vk_format_to_av_format(vk::Format vk_fmt) {
     for (int f = AV_PIX_FMT_NONE; f < AV_PIX_FMT_NB; ++f) {
@@ -55,10 +109,22 @@ alvr::VkContext::VkContext(
         VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME,
         VK_EXT_PHYSICAL_DEVICE_DRM_EXTENSION_NAME,
         VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME,
+        VK_EXT_GLOBAL_PRIORITY_EXTENSION_NAME,
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
     };
     device_extensions.insert(
         device_extensions.end(), requiredDeviceExtensions.begin(), requiredDeviceExtensions.end()
     );
+    // Only enabled when they are used, so the device of the other encoders doesn't change
+    const bool video_encode = Settings::Instance().m_linuxVulkanVideoEncode
+        && !Settings::Instance().m_force_sw_encoding;
+    if (video_encode) {
+        device_extensions.insert(
+            device_extensions.end(),
+            std::begin(VIDEO_ENCODE_EXTENSIONS),
+            std::end(VIDEO_ENCODE_EXTENSIONS)
+        );
+    }
 
     uint32_t instanceExtensionCount = 0;
     vkEnumerateInstanceExtensionProperties(nullptr, &instanceExtensionCount, nullptr);
@@ -149,6 +215,9 @@ alvr::VkContext::VkContext(
             deviceExtensions.push_back(name);
         }
     }
+    memoryBudget = std::any_of(deviceExtensions.begin(), deviceExtensions.end(), [](auto name) {
+        return strcmp(name, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+    });
 
     float queuePriority = 1.0;
     std::vector<VkDeviceQueueCreateInfo> queueInfos;
@@ -159,12 +228,20 @@ alvr::VkContext::VkContext(
     vkGetPhysicalDeviceQueueFamilyProperties(
         physicalDevice, &queueFamilyCount, queueFamilyProperties.data()
     );
+    const bool video_encode_queue
+        = has_extension(deviceExtensions, VK_KHR_VIDEO_ENCODE_QUEUE_EXTENSION_NAME);
+    // A compute only family is the asynchronous compute queue, which runs next to the graphics
+    // queue of the game instead of after it
     for (uint32_t i = 0; i < queueFamilyProperties.size(); ++i) {
         const bool graphics = queueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT;
         const bool compute = queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT;
         if (compute && (queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED || !graphics)) {
             queueFamilyIndex = i;
         }
+        if (video_encode_queue && encodeQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED
+            && (queueFamilyProperties[i].queueFlags & VK_QUEUE_VIDEO_ENCODE_BIT_KHR)) {
+            encodeQueueFamilyIndex = i;
+        }
         VkDeviceQueueCreateInfo queueInfo = {};
         queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queueInfo.queueFamilyIndex = i;
@@ -173,8 +250,27 @@ alvr::VkContext::VkContext(
         queueInfos.push_back(queueInfo);
     }
 
+    // Vulkan Video submits its work with synchronization 2
+    VkPhysicalDeviceSynchronization2FeaturesKHR sync2Features = {};
+    sync2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    if (encodeQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED) {
+        VkPhysicalDeviceFeatures2 supported = {};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supported.pNext = &sync2Features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+        if (!sync2Features.synchronization2) {
+            Warn("Vulkan Video encoding needs synchronization2, which the device lacks");
+            encodeQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        }
+    } else if (video_encode) {
+        Warn("The Vulkan device has no video encode queue");
+    }
+
     VkPhysicalDeviceVulkan12Features features12 = {};
     features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    if (encodeQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED) {
+        features12.pNext = &sync2Features;
+    }
     features12.timelineSemaphore = true;
 
     VkPhysicalDeviceFeatures2 features = {};
@@ -189,7 +285,45 @@ alvr::VkContext::VkContext(
     deviceInfo.pQueueCreateInfos = queueInfos.data();
     deviceInfo.enabledExtensionCount = deviceExtensions.size();
     deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
-    VK_CHECK(vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device));
+
+    // Same as FrameRender::SetGpuPriority on Windows: the queue of the renderer gets the highest
+    // global priority allowed. Realtime needs CAP_SYS_NICE on most drivers, which refuse the
+    // device otherwise, so each level is tried in turn down to the default one.
+    VkDeviceQueueGlobalPriorityCreateInfoEXT priorityInfo = {};
+    priorityInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_GLOBAL_PRIORITY_CREATE_INFO_EXT;
+    VkDeviceQueueCreateInfo& renderQueueInfo = queueInfos[queueFamilyIndex];
+    bool raisePriority = Settings::Instance().m_raiseGpuPriority;
+    if (raisePriority && has_extension(deviceExtensions, VK_EXT_GLOBAL_PRIORITY_EXTENSION_NAME)) {
+        for (VkQueueGlobalPriorityEXT priority :
+             { VK_QUEUE_GLOBAL_PRIORITY_REALTIME_EXT, VK_QUEUE_GLOBAL_PRIORITY_HIGH_EXT }) {
+            priorityInfo.globalPriority = priority;
+            renderQueueInfo.pNext = &priorityInfo;
+            VkResult res = vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device);
+            if (res == VK_SUCCESS) {
+                globalPriority = priority;
+                break;
+            }
+            device = VK_NULL_HANDLE;
+            if (res != VK_ERROR_NOT_PERMITTED_EXT && res != VK_ERROR_INITIALIZATION_FAILED) {
+                VK_CHECK(res);
+            }
+        }
+    }
+    if (device == VK_NULL_HANDLE) {
+        renderQueueInfo.pNext = nullptr;
+        VK_CHECK(vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device));
+    }
+    if (!raisePriority) {
+        Info("Render queue family %u keeps the default GPU priority", queueFamilyIndex);
+    } else if (globalPriority == VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_EXT) {
+        Warn("Could not raise the GPU priority of the render queue");
+    } else {
+        Info(
+            "Render queue family %u uses %s GPU priority",
+            queueFamilyIndex,
+            globalPriority == VK_QUEUE_GLOBAL_PRIORITY_REALTIME_EXT ? "realtime" : "high"
+        );
+    }
 
     for (int i = 128; i < 136; ++i) {
         auto path = "/dev/dri/renderD" + std::to_string(i);
@@ -214,6 +348,32 @@ alvr::VkContext::VkContext(
         devicePath = "/dev/dri/renderD128";
     }
     Info("Using device path %s", devicePath.c_str());
+    numaNode = drm_device_numa_node(devicePath);
+    if (numaNode >= 0) {
+        Info("GPU is on NUMA node %d", numaNode);
+    }
+
+    encodeDevicePath = devicePath;
+    encodeAmd = amd;
+    encodeIntel = intel;
+    const std::string& encodeDevice = Settings::Instance().m_linuxEncodeDevice;
+    if (!encodeDevice.empty() && encodeDevice != devicePath
+        && !Settings::Instance().m_force_sw_encoding) {
+        uint32_t vendor = drm_device_vendor(encodeDevice);
+        if (vendor == 0) {
+            Warn(
+                "Encode device %s not found, encoding on %s",
+                encodeDevice.c_str(),
+                devicePath.c_str()
+            );
+        } else {
+            encodeDevicePath = encodeDevice;
+            crossDeviceEncode = true;
+            encodeAmd = vendor == 0x1002;
+            encodeIntel = vendor == 0x8086;
+            Info("Encoding on device path %s", encodeDevicePath.c_str());
+        }
+    }
 
     ctx = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_VULKAN);
     AVHWDeviceContext* hwctx = (AVHWDeviceContext*)ctx->data;
@@ -231,8 +391,13 @@ alvr::VkContext::VkContext(
     vkctx->queue_family_comp_index = queueFamilyIndex;
     vkctx->nb_comp_queues = 1;
     vkctx->get_proc_addr = vkGetInstanceProcAddr;
-    vkctx->queue_family_encode_index = -1;
-    vkctx->nb_encode_queues = 0;
+    if (encodeQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED) {
+        vkctx->queue_family_encode_index = encodeQueueFamilyIndex;
+        vkctx->nb_encode_queues = 1;
+    } else {
+        vkctx->queue_family_encode_index = -1;
+        vkctx->nb_encode_queues = 0;
+    }
     vkctx->queue_family_decode_index = -1;
     vkctx->nb_decode_queues = 0;
 
@@ -255,6 +420,29 @@ alvr::VkContext::VkContext(
         throw AvException("failed to initialize ffmpeg", ret);
 }
 
+bool alvr::VkContext::QueryMemoryBudget(uint64_t& usage, uint64_t& budget) const {
+    if (!memoryBudget) {
+        return false;
+    }
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps = {};
+    budgetProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 props = {};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    props.pNext = &budgetProps;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &props);
+
+    // The resizable BAR shows as a second device local heap, both count
+    usage = 0;
+    budget = 0;
+    for (uint32_t i = 0; i < props.memoryProperties.memoryHeapCount; i++) {
+        if (props.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            usage += budgetProps.heapUsage[i];
+            budget += budgetProps.heapBudget[i];
+        }
+    }
+    return true;
+}
+
 alvr::VkContext::~VkContext() {
     av_buffer_unref(&ctx);
     vkDestroyDevice(device, nullptr);
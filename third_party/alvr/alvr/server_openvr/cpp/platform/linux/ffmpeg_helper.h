@@ -39,6 +39,13 @@ private:
     static std::string makemsg(const std::string& msg, int averror);
 };
 
+// The encoder could not import the DmaBuf of the output, which a different DRM format modifier
+// may fix, see Renderer::RecreateOutput.
+class DrmImportError : public AvException {
+public:
+    using AvException::AvException;
+};
+
 class VkContext {
 public:
     VkContext(const uint8_t* deviceUUID, const std::vector<const char*>& requiredDeviceExtensions);
@@ -49,18 +56,34 @@ public:
     uint32_t get_vk_queue_family_index() const { return queueFamilyIndex; }
     std::vector<const char*> get_vk_instance_extensions() const { return instanceExtensions; }
     std::vector<const char*> get_vk_device_extensions() const { return deviceExtensions; }
+    // Device local memory this process uses and its budget, false without VK_EXT_memory_budget
+    bool QueryMemoryBudget(uint64_t& usage, uint64_t& budget) const;
 
     AVBufferRef* ctx = nullptr;
     VkInstance instance = VK_NULL_HANDLE;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device = VK_NULL_HANDLE;
     uint32_t queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    // Family of the Vulkan Video encode queue, only looked up when the Vulkan encoder is enabled
+    uint32_t encodeQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    // Global priority the queue of queueFamilyIndex got, medium is the default of the driver
+    VkQueueGlobalPriorityEXT globalPriority = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_EXT;
     std::vector<const char*> instanceExtensions;
     std::vector<const char*> deviceExtensions;
+    bool memoryBudget = false;
     bool amd = false;
     bool intel = false;
     bool nvidia = false;
     std::string devicePath;
+    // NUMA node of the GPU, where the software encoder keeps its readback and threads. -1 when
+    // unknown or on hosts with a single node.
+    int numaNode = -1;
+    // Render node VAAPI encodes on, another GPU than the Vulkan device when crossDeviceEncode is
+    // set. The vendor flags describe that GPU.
+    std::string encodeDevicePath;
+    bool crossDeviceEncode = false;
+    bool encodeAmd = false;
+    bool encodeIntel = false;
 };
 
 class VkFrameCtx {
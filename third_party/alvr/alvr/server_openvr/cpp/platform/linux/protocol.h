@@ -11,6 +11,11 @@
 #include <mutex>
 #include <vulkan/vulkan.h>
 
+// present_packet::image of a swapchain change. The packet is followed by the init_packet of the
+// new swapchain and its fds, sent like at connection. New images of the same size and format
+// replace the previous ones in place, others end the connection.
+const uint32_t REINIT_IMAGE = UINT32_MAX;
+
 struct present_packet {
     uint32_t image;
     uint32_t frame;
@@ -18,6 +23,20 @@ struct present_packet {
     float pose[3][4];
 };
 
+// Written back on the socket by the driver for each present_packet it takes, non-blocking, so that
+// the compositor can hold back presents the encoder would only drop. A compositor that never
+// reads them only fills the socket buffer, after which they are discarded.
+struct feedback_packet {
+    // present_packet::frame of the frame taken
+    uint32_t frame;
+    // Frames in the encoder including this one, at most the pipeline depth before it has to wait
+    uint32_t queue_depth;
+    // CLOCK_MONOTONIC time at which the encoder is predicted to take the next frame
+    uint64_t ready_ns;
+    // Presents superseded by a newer one before the encoder took them, since the connection
+    uint64_t dropped_frames;
+};
+
 struct init_packet {
     uint32_t num_images;
     std::array<uint8_t, VK_UUID_SIZE> device_uuid;
@@ -15,4 +15,9 @@ public:
     void Stop() { }
     void OnStreamStart() { }
     void InsertIDR() { }
+    void InvalidateFrames(uint64_t firstTs, uint64_t lastTs) { }
+    void AcknowledgeFrame(uint64_t /*targetTimestampNs*/) { }
+    void SetClientTiming(
+        uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+    ) { }
 };
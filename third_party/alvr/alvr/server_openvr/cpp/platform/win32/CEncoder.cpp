@@ -2,13 +2,160 @@
 // Original copyright preserved
 
 #include "CEncoder.h"
+#include "alvr_server/DisposableFrames.h"
+#include "alvr_server/DriverMetrics.h"
+#include "alvr_server/FrameIncidents.h"
+#include "alvr_server/FrameTrace.h"
+#include "alvr_server/GpuEngineUsage.h"
+#include "alvr_server/Instance.h"
+#include "alvr_server/TraceEvents.h"
+#include "alvr_server/VramBudget.h"
+#include "alvr_server/VsyncTiming.h"
+#include "alvr_server/bindings.h"
 
-CEncoder::CEncoder()
-    : m_bExiting(false)
-    , m_targetTimestampNs(0) {
-    m_encodeFinished.Set();
+#include <filesystem>
+#include <fstream>
+
+namespace {
+// In the order they are probed without a cached result
+enum EncoderBackend {
+    ENCODER_BACKEND_AMF,
+    ENCODER_BACKEND_NVENC,
+    ENCODER_BACKEND_VPL,
+#ifdef ALVR_GPL
+    ENCODER_BACKEND_SW,
+#endif
+    ENCODER_BACKEND_COUNT,
+};
+
+const char* const ENCODER_BACKEND_NAMES[] = { "AMF", "NVENC", "VPL", "SW" };
+
+std::filesystem::path ProbeCachePath() {
+    return std::filesystem::path(g_sessionPath).replace_filename("encoder_probe_cache.txt");
+}
+
+bool GetAdapterInfo(ID3D11Device* device, DXGI_ADAPTER_DESC& desc, LARGE_INTEGER& driverVersion) {
+    ComPtr<IDXGIDevice> dxgiDevice;
+    ComPtr<IDXGIAdapter> adapter;
+    if (FAILED(device->QueryInterface(__uuidof(IDXGIDevice), (void**)dxgiDevice.GetAddressOf()))
+        || FAILED(dxgiDevice->GetAdapter(&adapter)) || FAILED(adapter->GetDesc(&desc))) {
+        return false;
+    }
+    // Returns the user mode driver version for IDXGIDevice
+    return SUCCEEDED(adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion));
+}
+
+// The backend that works depends on the GPU, its driver and the codec settings. A driver update
+// can add or drop codecs, so its version is part of the key. LUIDs are only unique until the next
+// reboot, the first start after one probes again.
+std::string ProbeCacheKey(ID3D11Device* device) {
+    DXGI_ADAPTER_DESC desc;
+    LARGE_INTEGER driverVersion = {};
+    if (!GetAdapterInfo(device, desc, driverVersion)) {
+        return "";
+    }
+
+    char key[128];
+    snprintf(
+        key,
+        sizeof(key),
+        "%08lx%08lx-%04x:%04x-%016llx-%d-%d",
+        (unsigned long)desc.AdapterLuid.HighPart,
+        (unsigned long)desc.AdapterLuid.LowPart,
+        desc.VendorId,
+        desc.DeviceId,
+        (unsigned long long)driverVersion.QuadPart,
+        Settings::Instance().m_codec,
+        Settings::Instance().m_use10bitEncoder ? 1 : 0
+    );
+    return key;
 }
 
+// The rate control bias depends on the backend, the GPU, its driver and the codec. Unlike the
+// probe cache the key must survive reboots, so it has no LUID.
+std::string CalibrationKey(ID3D11Device* device, int backend) {
+    DXGI_ADAPTER_DESC desc;
+    LARGE_INTEGER driverVersion = {};
+    if (!GetAdapterInfo(device, desc, driverVersion)) {
+        return "";
+    }
+
+    char key[128];
+    snprintf(
+        key,
+        sizeof(key),
+        "%s-%04x:%04x-%016llx-%d",
+        ENCODER_BACKEND_NAMES[backend],
+        desc.VendorId,
+        desc.DeviceId,
+        (unsigned long long)driverVersion.QuadPart,
+        Settings::Instance().m_codec
+    );
+    return key;
+}
+
+// Names the adapter the same way in the other driver instances of the host, for the encoder
+// sessions
+std::string AdapterName(ID3D11Device* device) {
+    DXGI_ADAPTER_DESC desc;
+    LARGE_INTEGER driverVersion = {};
+    if (!GetAdapterInfo(device, desc, driverVersion)) {
+        return "unknown";
+    }
+
+    char name[32];
+    snprintf(
+        name,
+        sizeof(name),
+        "%08lx%08lx",
+        (unsigned long)desc.AdapterLuid.HighPart,
+        (unsigned long)desc.AdapterLuid.LowPart
+    );
+    return name;
+}
+
+// The cache holds a single line "<key> <backend name>", for the last adapter used
+int LoadProbedBackend(const std::string& key) {
+    std::ifstream is(ProbeCachePath());
+    std::string cachedKey, name;
+    if (key.empty() || !(is >> cachedKey >> name) || cachedKey != key) {
+        return -1;
+    }
+    for (int i = 0; i < ENCODER_BACKEND_COUNT; i++) {
+        if (name == ENCODER_BACKEND_NAMES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void SaveProbedBackend(const std::string& key, int backend) {
+    if (key.empty()) {
+        return;
+    }
+    // Written aside and renamed, so that an interrupted write never leaves a truncated cache
+    std::filesystem::path path = ProbeCachePath();
+    std::filesystem::path tmpPath = path;
+    tmpPath += InstanceSuffix() + ".tmp";
+    {
+        std::ofstream os(tmpPath, std::ios::out | std::ios::trunc);
+        os << key << " " << ENCODER_BACKEND_NAMES[backend] << "\n";
+        if (!os) {
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        Warn("Failed to write encoder probe cache %ls\n", path.c_str());
+        std::filesystem::remove(tmpPath, ec);
+    }
+}
+} // namespace
+
+CEncoder::CEncoder()
+    : m_bExiting(false) { }
+
 CEncoder::~CEncoder() {
     if (m_videoEncoder) {
         m_videoEncoder->Shutdown();
@@ -16,78 +163,145 @@ CEncoder::~CEncoder() {
     }
 }
 
-void CEncoder::Initialize(std::shared_ptr<CD3DRender> d3dRender) {
-    m_FrameRender = std::make_shared<FrameRender>(d3dRender);
+void CEncoder::Initialize(std::shared_ptr<CD3DRender> renderDevice) {
+    m_d3dRender = renderDevice;
+    m_FrameRender = std::make_shared<FrameRender>(renderDevice);
+    m_passTimer = std::make_shared<GpuPassTimer>(renderDevice);
+    m_FrameRender->SetPassTimer(m_passTimer);
     m_FrameRender->Startup();
     uint32_t encoderWidth, encoderHeight;
     m_FrameRender->GetEncodingResolution(&encoderWidth, &encoderHeight);
 
-    Exception vplException;
-    Exception vceException;
-    Exception nvencException;
-#ifdef ALVR_GPL
-    Exception swException;
+    // The encoders only see the encode adapter, the frames are composed on the one of the game
+    m_encodeRender = renderDevice;
+    int32_t encodeAdapter = Settings::Instance().m_encodeAdapterIndex;
+    if (encodeAdapter >= 0 && encodeAdapter != Settings::Instance().m_nAdapterIndex) {
+        auto encodeDevice = std::make_shared<CD3DRender>();
+        if (encodeDevice->Initialize(encodeAdapter)) {
+            m_encodeRender = encodeDevice;
+            m_crossAdapter = std::make_unique<CrossAdapterFrames>(renderDevice, encodeDevice);
+        } else {
+            Warn(
+                "Could not create a device for encode adapter %d, encoding on the render one.\n",
+                encodeAdapter
+            );
+        }
+    }
+    auto d3dRender = m_encodeRender;
 
-    if (Settings::Instance().m_force_sw_encoding) {
+    // Polled before the encoders are created, which keep fewer frames in flight under pressure
+    ComPtr<IDXGIDevice> dxgiDevice;
+    ComPtr<IDXGIAdapter> adapter;
+    if (SUCCEEDED(d3dRender->GetDevice()->QueryInterface(IID_PPV_ARGS(&dxgiDevice)))
+        && SUCCEEDED(dxgiDevice->GetAdapter(&adapter))) {
+        adapter.As(&m_vramAdapter);
+        DXGI_ADAPTER_DESC desc;
+        if (SUCCEEDED(adapter->GetDesc(&desc))) {
+            StartGpuEngineUsage(
+                ((uint64_t)(uint32_t)desc.AdapterLuid.HighPart << 32) | desc.AdapterLuid.LowPart
+            );
+        }
+    }
+    PollVramBudget();
+
+    std::string cacheKey = ProbeCacheKey(d3dRender->GetDevice());
+    int cachedBackend = LoadProbedBackend(cacheKey);
+
+    Exception exceptions[ENCODER_BACKEND_COUNT];
+    // NVENC was skipped for lack of a session, the backend found instead is not cached
+    bool sessionsTaken = false;
+    auto tryBackend = [&](int backend) {
+        Debug("Try to use VideoEncoder%s.\n", ENCODER_BACKEND_NAMES[backend]);
         try {
-            Debug("Try to use VideoEncoderSW.\n");
-            m_videoEncoder
-                = std::make_shared<VideoEncoderSW>(d3dRender, encoderWidth, encoderHeight);
+            switch (backend) {
+            case ENCODER_BACKEND_AMF:
+                m_videoEncoder
+                    = std::make_shared<VideoEncoderAMF>(d3dRender, encoderWidth, encoderHeight);
+                break;
+            case ENCODER_BACKEND_NVENC:
+                // The GeForce drivers cap the concurrent NVENC sessions, opening one more fails
+                m_encoderSession
+                    = std::make_unique<EncoderSession>(AdapterName(d3dRender->GetDevice()));
+                if (!m_encoderSession->IsAcquired()) {
+                    sessionsTaken = true;
+                    throw MakeException("All the NVENC sessions of this GPU are in use");
+                }
+                m_videoEncoder
+                    = std::make_shared<VideoEncoderNVENC>(d3dRender, encoderWidth, encoderHeight);
+                break;
+            case ENCODER_BACKEND_VPL:
+                m_videoEncoder
+                    = std::make_shared<VideoEncoderVPL>(d3dRender, encoderWidth, encoderHeight);
+                break;
+#ifdef ALVR_GPL
+            case ENCODER_BACKEND_SW:
+                m_videoEncoder
+                    = std::make_shared<VideoEncoderSW>(d3dRender, encoderWidth, encoderHeight);
+                break;
+#endif
+            }
             m_videoEncoder->Initialize();
-            return;
+            if (m_videoEncoder->SupportsBitrateCalibration()) {
+                m_videoEncoder->SetBitrateCalibration(std::make_shared<BitrateCalibration>(
+                    CalibrationKey(d3dRender->GetDevice(), backend), 1.0f
+                ));
+            }
+            return true;
         } catch (Exception e) {
-            swException = e;
+            exceptions[backend] = e;
+            m_videoEncoder.reset();
+            if (backend == ENCODER_BACKEND_NVENC) {
+                m_encoderSession.reset();
+            }
+            return false;
         }
+    };
+
+#ifdef ALVR_GPL
+    if (Settings::Instance().m_force_sw_encoding && tryBackend(ENCODER_BACKEND_SW)) {
+        return;
     }
 #endif
 
-    try {
-        Debug("Try to use VideoEncoderAMF.\n");
-        m_videoEncoder = std::make_shared<VideoEncoderAMF>(d3dRender, encoderWidth, encoderHeight);
-        m_videoEncoder->Initialize();
-        return;
-    } catch (Exception e) {
-        vceException = e;
-    }
-    try {
-        Debug("Try to use VideoEncoderNVENC.\n");
-        m_videoEncoder
-            = std::make_shared<VideoEncoderNVENC>(d3dRender, encoderWidth, encoderHeight);
-        m_videoEncoder->Initialize();
-        return;
-    } catch (Exception e) {
-        nvencException = e;
+    // Only NVENC takes the RGB output of HDR
+    if (m_FrameRender->OutputsHdrRgb()) {
+        if (tryBackend(ENCODER_BACKEND_NVENC)) {
+            return;
+        }
+        throw MakeException(
+            "NVENC RGB input is enabled but NVENC is not available: %s",
+            exceptions[ENCODER_BACKEND_NVENC].what()
+        );
     }
-    try {
-        Debug("Try to use VideoEncoderVPL.\n");
-        m_videoEncoder = std::make_shared<VideoEncoderVPL>(d3dRender, encoderWidth, encoderHeight);
-        m_videoEncoder->Initialize();
+
+    // The cached backend worked last time on this adapter and driver, trying it first skips
+    // loading the runtimes of the other vendors. If it stopped working, the full probe runs.
+    if (cachedBackend >= 0 && tryBackend(cachedBackend)) {
         return;
-    } catch (Exception e) {
-        vplException = e;
     }
-#ifdef ALVR_GPL
-    try {
-        Debug("Try to use VideoEncoderSW.\n");
-        m_videoEncoder = std::make_shared<VideoEncoderSW>(d3dRender, encoderWidth, encoderHeight);
-        m_videoEncoder->Initialize();
-        return;
-    } catch (Exception e) {
-        swException = e;
+    for (int backend = 0; backend < ENCODER_BACKEND_COUNT; backend++) {
+        if (backend != cachedBackend && tryBackend(backend)) {
+            if (!sessionsTaken) {
+                SaveProbedBackend(cacheKey, backend);
+            }
+            return;
+        }
     }
+
+#ifdef ALVR_GPL
     throw MakeException(
         "All VideoEncoder are not available. VCE: %s, NVENC: %s, VPL: %s, SW: %s",
-        vceException.what(),
-        nvencException.what(),
-        vplException.what(),
-        swException.what()
+        exceptions[ENCODER_BACKEND_AMF].what(),
+        exceptions[ENCODER_BACKEND_NVENC].what(),
+        exceptions[ENCODER_BACKEND_VPL].what(),
+        exceptions[ENCODER_BACKEND_SW].what()
     );
 #else
     throw MakeException(
         "All VideoEncoder are not available. VCE: %s, NVENC: %s, VPL: %s",
-        vceException.what(),
-        nvencException.what(),
-        vplException.what()
+        exceptions[ENCODER_BACKEND_AMF].what(),
+        exceptions[ENCODER_BACKEND_NVENC].what(),
+        exceptions[ENCODER_BACKEND_VPL].what()
     );
 #endif
 }
@@ -102,45 +316,174 @@ void CEncoder::SetViewParams(
 }
 
 bool CEncoder::CopyToStaging(
-    ID3D11Texture2D* pTexture[][2],
+    ID3D11ShaderResourceView* pViews[][2],
     vr::VRTextureBounds_t bounds[][2],
     vr::HmdMatrix34_t poses[],
     int layerCount,
     bool recentering,
     uint64_t presentationTime,
     uint64_t targetTimestampNs,
-    const std::string& message,
-    const std::string& debugText
+    const vr::HmdMatrix34_t* latePose
 ) {
-    m_presentationTime = presentationTime;
-    m_targetTimestampNs = targetTimestampNs;
-    m_FrameRender->Startup();
+    ALVR_TRACE_SCOPE("Compose");
+    uint64_t presentNs = FrameTraceNow();
+    m_FrameRender->SetPhotonMarker(targetTimestampNs);
+
+    ID3D11Texture2D* output = m_FrameRender->GetTexture().Get();
+    if (!output || !PrepareFrameSlots(output)) {
+        return false;
+    }
+    FrameSlot& slot = m_frameSlots[m_presentSlot];
+    if (m_crossAdapter && !m_crossAdapter->BeginWrite(m_presentSlot)) {
+        return false;
+    }
 
-    m_FrameRender->RenderFrame(
-        pTexture, bounds, poses, layerCount, recentering, message, debugText
+    // CPU submission times, the GPU time of the passes goes to m_passTimer
+    FrameTraceMark(targetTimestampNs, FRAME_TRACE_RENDER_BEGIN);
+    m_passTimer->BeginFrame();
+    // A layer the composition would leave unchanged goes to the slot without the detour through
+    // the FrameRender output
+    bool copied = m_FrameRender->CopyLayer(
+        pViews, bounds, latePose, layerCount, recentering, slot.texture.Get()
     );
+    if (!copied) {
+        m_FrameRender->RenderFrame(pViews, bounds, poses, latePose, layerCount, recentering);
+    }
+    FrameTraceMark(targetTimestampNs, FRAME_TRACE_RENDER_END);
+    uint64_t renderNs = FrameTraceNow() - presentNs;
+    m_pacer.OnFrameComposed(renderNs);
+
+    if (!copied) {
+        m_d3dRender->GetContext()->CopyResource(slot.texture.Get(), output);
+    }
+    m_passTimer->Mark(GPU_PASS_ENCODER_COPY);
+    m_passTimer->EndFrame();
+    if (m_crossAdapter) {
+        m_crossAdapter->EndWrite(m_presentSlot);
+    }
+    slot.presentationTime = presentationTime;
+    slot.targetTimestampNs = targetTimestampNs;
+    slot.presentNs = presentNs;
+    slot.renderNs = renderNs;
+    m_presentSlotFilled = true;
+    return true;
+}
+
+void CEncoder::PollVramBudget() {
+    m_vramPollNs = FrameTraceNow();
+    DXGI_QUERY_VIDEO_MEMORY_INFO info;
+    if (m_vramAdapter
+        && SUCCEEDED(
+            m_vramAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info)
+        )) {
+        ReportVramBudget(info.CurrentUsage, info.Budget);
+    }
+}
+
+// The slots have the size and format of the FrameRender output, which is fixed once it started
+bool CEncoder::PrepareFrameSlots(ID3D11Texture2D* source) {
+    if (m_frameSlots[0].texture) {
+        return true;
+    }
+
+    D3D11_TEXTURE2D_DESC desc;
+    source->GetDesc(&desc);
+    desc.MiscFlags = 0;
+    if (m_crossAdapter) {
+        try {
+            m_crossAdapter->Create(desc, FRAME_SLOT_COUNT);
+        } catch (Exception& e) {
+            Error("Failed to create the cross-adapter frame slots: %s\n", e.what());
+            return false;
+        }
+        for (uint32_t i = 0; i < FRAME_SLOT_COUNT; i++) {
+            m_frameSlots[i].texture = m_crossAdapter->GetTexture(i);
+        }
+        return true;
+    }
+    ID3D11Texture2D* surfaces[FRAME_SLOT_COUNT];
+    if (m_videoEncoder && m_videoEncoder->CreateInputSurfaces(desc, FRAME_SLOT_COUNT, surfaces)) {
+        Debug("The frame slots are input surfaces of the encoder.\n");
+        for (uint32_t i = 0; i < FRAME_SLOT_COUNT; i++) {
+            m_frameSlots[i].texture = surfaces[i];
+        }
+        return true;
+    }
+    for (uint32_t i = 0; i < FRAME_SLOT_COUNT; i++) {
+        HRESULT hr
+            = m_d3dRender->GetDevice()->CreateTexture2D(&desc, nullptr, &m_frameSlots[i].texture);
+        if (FAILED(hr)) {
+            Error("Failed to create encoder frame slot: %p %ls\n", hr, GetErrorStr(hr).c_str());
+            for (uint32_t j = 0; j < FRAME_SLOT_COUNT; j++) {
+                m_frameSlots[j].texture.Reset();
+            }
+            return false;
+        }
+    }
     return true;
 }
 
 void CEncoder::Run() {
     Debug("CEncoder: Start thread. Id=%d\n", GetCurrentThreadId());
-    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_MOST_URGENT);
 
     while (!m_bExiting) {
         m_newFrameReady.Wait();
         if (m_bExiting)
             break;
 
-        if (m_FrameRender->GetTexture()) {
-            m_videoEncoder->Transmit(
-                m_FrameRender->GetTexture().Get(),
-                m_presentationTime,
-                m_targetTimestampNs,
-                m_scheduler.CheckIDRInsertion()
-            );
+        // The event can be left set by a frame that was already taken
+        if (!(m_pendingSlot.load(std::memory_order_relaxed) & FRAME_SLOT_NEW)) {
+            continue;
+        }
+        if (FrameTraceNow() - m_vramPollNs >= VRAM_POLL_INTERVAL_NS) {
+            PollVramBudget();
+        }
+        // Acquire pairs with the release in NewFrameReady, the slot metadata is visible. The
+        // previous slot goes back to the present thread only now that its copy was submitted.
+        m_encodeSlot = m_pendingSlot.exchange(m_encodeSlot, std::memory_order_acq_rel)
+            & ~FRAME_SLOT_NEW;
+        const FrameSlot& frame = m_frameSlots[m_encodeSlot];
+        ID3D11Texture2D* texture = frame.texture.Get();
+        if (texture && m_crossAdapter) {
+            texture = m_crossAdapter->BeginRead(m_encodeSlot);
         }
 
-        m_encodeFinished.Set();
+        if (texture) {
+            ALVR_TRACE_SCOPE("Encode");
+            FrameTraceMark(frame.targetTimestampNs, FRAME_TRACE_ENCODE_SUBMIT);
+            uint64_t firstInvalidTs;
+            if (m_scheduler.CheckInvalidation(firstInvalidTs)
+                && !m_videoEncoder->InvalidateFrames(firstInvalidTs)) {
+                m_scheduler.InsertRecovery();
+            }
+            if (m_scheduler.CheckLtrRecovery() && !m_videoEncoder->RecoverWithLtr()) {
+                m_scheduler.InsertFallbackRecovery();
+            }
+            bool insertIDR = m_scheduler.CheckIDRInsertion() != 0;
+            if (!insertIDR && m_scheduler.CheckIntraRefreshInsertion()) {
+                m_videoEncoder->InsertIntraRefresh();
+            }
+            // A skipped frame leaves the recovery state set above to the next one
+            uint64_t submitNs = FrameTraceNow();
+            if (m_pacer.ShouldEncode(frame.targetTimestampNs, submitNs, insertIDR)) {
+                m_videoEncoder->Transmit(
+                    texture, frame.presentationTime, frame.targetTimestampNs, insertIDR
+                );
+                uint64_t sentNs = FrameTraceNow();
+                m_pacer.OnFrameEncoded(sentNs - submitNs);
+                VsyncTimingOnFrameSent(sentNs - frame.presentNs);
+                int step = m_presetController.OnFrameEncoded(
+                    sentNs - submitNs, frame.renderNs, sentNs
+                );
+                if (step != 0) {
+                    bool applied = m_videoEncoder->StepQualityPreset(step);
+                    m_presetController.OnStepApplied(step, applied, sentNs);
+                }
+            }
+            if (m_crossAdapter) {
+                m_crossAdapter->EndRead(m_encodeSlot);
+            }
+        }
     }
 }
 
@@ -148,18 +491,63 @@ void CEncoder::Stop() {
     m_bExiting = true;
     m_newFrameReady.Set();
     Join();
+    StopGpuEngineUsage();
     m_FrameRender.reset();
 }
 
 void CEncoder::NewFrameReady() {
-    m_encodeFinished.Reset();
+    // Only the present thread has been writing to its slot since it got it back
+    if (!m_presentSlotFilled) {
+        return;
+    }
+    m_presentSlotFilled = false;
+    uint32_t previous
+        = m_pendingSlot.exchange(m_presentSlot | FRAME_SLOT_NEW, std::memory_order_acq_rel);
+    m_presentSlot = previous & ~FRAME_SLOT_NEW;
+    if (previous & FRAME_SLOT_NEW) {
+        MetricsCount(DRIVER_COUNTER_PRESENTS_DROPPED);
+        FrameIncidentsOnPresentsDropped(1);
+    }
     m_newFrameReady.Set();
 }
 
-void CEncoder::WaitForEncode() { m_encodeFinished.Wait(); }
+void CEncoder::OnStreamStart() {
+    m_pacer.Reset();
+    m_scheduler.SetIntraRefresh(m_videoEncoder && m_videoEncoder->SupportsIntraRefresh());
+    m_scheduler.SetRefInvalidation(m_videoEncoder && m_videoEncoder->SupportsRefInvalidation());
+    m_scheduler.SetLtrRecovery(m_videoEncoder && m_videoEncoder->SupportsLtrRecovery());
+    m_scheduler.OnStreamStart();
+}
 
-void CEncoder::OnStreamStart() { m_scheduler.OnStreamStart(); }
+// Called by RequestIDR, when the client lost a frame
+void CEncoder::InsertIDR() { m_scheduler.InsertRecovery(); }
 
-void CEncoder::InsertIDR() { m_scheduler.InsertIDR(); }
+// Called by InvalidateFrames, when the client lost the frames from firstTs to lastTs. The frames
+// it received after lastTs were predicted from the lost ones, so they are invalid too.
+void CEncoder::InvalidateFrames(uint64_t firstTs, uint64_t lastTs) {
+    // No frame was predicted from disposable ones, losing only them needs no recovery
+    if (DisposableFrames::OnlyDisposableLost(firstTs, lastTs)) {
+        Debug("Lost disposable frames from %llu to %llu\n", firstTs, lastTs);
+        return;
+    }
+    Debug("Invalidating frames from %llu (lost up to %llu)\n", firstTs, lastTs);
+    m_scheduler.InvalidateFrames(firstTs);
+}
+
+void CEncoder::AcknowledgeFrame(uint64_t targetTimestampNs) {
+    if (m_videoEncoder) {
+        m_videoEncoder->AcknowledgeFrame(targetTimestampNs);
+    }
+}
+
+void CEncoder::SetClientTiming(
+    uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+) {
+    m_pacer.SetClientTiming(vsyncNs, periodNs, serverToClientNs, networkLatencyNs);
+}
+
+uint64_t CEncoder::GetComposeDelayNs(uint64_t targetTimestampNs) {
+    return m_pacer.GetComposeDelay(targetTimestampNs, FrameTraceNow());
+}
 
 void CEncoder::CaptureFrame() { }
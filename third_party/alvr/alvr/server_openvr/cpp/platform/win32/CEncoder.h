@@ -6,14 +6,19 @@
 
 #include "shared/threadtools.h"
 
+#include "CrossAdapterFrames.h"
 #include "FrameRender.h"
+#include "GpuPassTimer.h"
 #include "VideoEncoder.h"
 #include "VideoEncoderAMF.h"
 #include "VideoEncoderNVENC.h"
 #include "VideoEncoderVPL.h"
+#include "alvr_server/EncoderSession.h"
 #include "alvr_server/Utils.h"
+#include <atomic>
 #include <d3d11.h>
 #include <d3d11_1.h>
+#include <dxgi1_4.h>
 #include <map>
 #include <wincodec.h>
 #include <wincodecsdk.h>
@@ -21,14 +26,16 @@
 #ifdef ALVR_GPL
 #include "VideoEncoderSW.h"
 #endif
+#include "alvr_server/FramePacer.h"
 #include "alvr_server/IDRScheduler.h"
+#include "alvr_server/PresetController.h"
 
 using Microsoft::WRL::ComPtr;
 
 //----------------------------------------------------------------------------
-// Blocks on reading backbuffer from gpu, so WaitForPresent can return
-// as soon as we know rendering made it this frame.  This step of the pipeline
-// should run about 3ms per frame.
+// Encodes the frames composed by the present thread on its own thread. Present
+// returns as soon as the frame is queued on the GPU, the encoder picks up the
+// newest one when it is done with the previous one.
 //----------------------------------------------------------------------------
 class CEncoder : public CThread {
 public:
@@ -45,39 +52,94 @@ public:
     );
 
     bool CopyToStaging(
-        ID3D11Texture2D* pTexture[][2],
+        ID3D11ShaderResourceView* pViews[][2],
         vr::VRTextureBounds_t bounds[][2],
         vr::HmdMatrix34_t poses[],
         int layerCount,
         bool recentering,
         uint64_t presentationTime,
         uint64_t targetTimestampNs,
-        const std::string& message,
-        const std::string& debugText
+        const vr::HmdMatrix34_t* latePose
     );
 
     virtual void Run();
 
     virtual void Stop();
 
+    // Hands the frame rendered by the last CopyToStaging to the encoder thread. Never blocks, a
+    // frame the encoder didn't pick up in time is replaced by the new one.
     void NewFrameReady();
 
-    void WaitForEncode();
-
     void OnStreamStart();
 
     void InsertIDR();
 
+    void InvalidateFrames(uint64_t firstTs, uint64_t lastTs);
+
+    void AcknowledgeFrame(uint64_t targetTimestampNs);
+
+    void SetClientTiming(
+        uint64_t vsyncNs, uint64_t periodNs, int64_t serverToClientNs, uint64_t networkLatencyNs
+    );
+
+    // How long the frame of targetTimestampNs can wait before CopyToStaging, see jit_composition
+    uint64_t GetComposeDelayNs(uint64_t targetTimestampNs);
+
     void CaptureFrame();
 
 private:
-    CThreadEvent m_newFrameReady, m_encodeFinished;
+    // Rendered frames waiting for the encoder, as a triple buffer: the present thread copies the
+    // FrameRender output into its slot and swaps it with the pending one, the encoder thread swaps
+    // its slot with the pending one when it is marked new. Both threads always own a slot, neither
+    // waits for the other.
+    //
+    // The GPU work of both threads goes through the same immediate context and runs in submission
+    // order. A slot only returns to the present thread after the encoder submitted its copy of it
+    // in Transmit, so the next render into it is queued after that copy. The slots can be input
+    // surfaces of the encoder, which then has finished reading one when Transmit returns.
+    struct FrameSlot {
+        ComPtr<ID3D11Texture2D> texture;
+        uint64_t presentationTime;
+        uint64_t targetTimestampNs;
+        // FrameTraceNow() when the compositor presented the frame, and the time it took to render
+        uint64_t presentNs;
+        uint64_t renderNs;
+    };
+    static const uint32_t FRAME_SLOT_COUNT = 3;
+    static const uint32_t FRAME_SLOT_NEW = 0x100;
+    static const uint64_t VRAM_POLL_INTERVAL_NS = 1'000'000'000;
+
+    bool PrepareFrameSlots(ID3D11Texture2D* source);
+    // Reports the video memory of the process on the encode adapter, see VramBudget.h
+    void PollVramBudget();
+
+    FrameSlot m_frameSlots[FRAME_SLOT_COUNT];
+    uint32_t m_presentSlot = 0;
+    // Whether the present slot holds a frame that wasn't handed over yet
+    bool m_presentSlotFilled = false;
+    uint32_t m_encodeSlot = 1;
+    // Index of the pending slot, with FRAME_SLOT_NEW set until the encoder takes it
+    std::atomic<uint32_t> m_pendingSlot { 2 };
+
+    std::shared_ptr<CD3DRender> m_d3dRender;
+    // Device of the encoder, m_d3dRender unless encode_adapter_index picks another adapter. Then
+    // the slots are handed over by m_crossAdapter.
+    std::shared_ptr<CD3DRender> m_encodeRender;
+    std::unique_ptr<CrossAdapterFrames> m_crossAdapter;
+    // Null on the systems without DXGI 1.4
+    ComPtr<IDXGIAdapter3> m_vramAdapter;
+    uint64_t m_vramPollNs = 0;
+    CThreadEvent m_newFrameReady;
+    // Held while m_videoEncoder is NVENC, with an encoder_session_limit
+    std::unique_ptr<EncoderSession> m_encoderSession;
     std::shared_ptr<VideoEncoder> m_videoEncoder;
     bool m_bExiting;
-    uint64_t m_presentationTime;
-    uint64_t m_targetTimestampNs;
 
     std::shared_ptr<FrameRender> m_FrameRender;
+    // Shared with m_FrameRender, a frame spans the composition and the copy into its slot
+    std::shared_ptr<GpuPassTimer> m_passTimer;
 
     IDRScheduler m_scheduler;
+    FramePacer m_pacer;
+    PresetController m_presetController;
 };
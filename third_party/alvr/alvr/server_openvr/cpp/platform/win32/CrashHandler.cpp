@@ -1,26 +1,143 @@
 // Derived from ALVR (MIT)
 // Original copyright preserved
 
+#include "../../alvr_server/CrashReport.h"
 #include "../../alvr_server/bindings.h"
 
-#include "../../alvr_server/Logger.h"
-#include "../../shared/backward.hpp"
-#include <ostream>
+#include <atomic>
+#include <filesystem>
+#include <string>
 #include <windows.h>
 
-static LONG WINAPI handler(PEXCEPTION_POINTERS ptrs) {
-    backward::StackTrace stacktrace;
-    backward::Printer printer;
-    std::ostringstream stream;
+namespace {
 
-    stacktrace.load_from(ptrs->ExceptionRecord->ExceptionAddress);
-    printer.print(stacktrace, stream);
-    std::string str = stream.str();
-    Error("Unhandled exception: %X\n%s", ptrs->ExceptionRecord->ExceptionCode, str.c_str());
+std::atomic<bool> g_crashed { false };
 
-    Sleep(2000);
+// Everything the filter touches is allocated before it runs
+std::wstring g_reportPath;
+CrashReport g_report;
+uint64_t g_frames[CrashReport::MAX_FRAMES];
+uint64_t g_modules[CrashReport::MAX_FRAMES];
+char g_modulePath[MAX_PATH];
+
+void writeRegisters(const CONTEXT& context) {
+    const struct {
+        const char* name;
+        DWORD64 value;
+    } REGISTERS[] = {
+        { "rip", context.Rip }, { "rsp", context.Rsp }, { "rbp", context.Rbp },
+        { "rax", context.Rax }, { "rbx", context.Rbx }, { "rcx", context.Rcx },
+        { "rdx", context.Rdx }, { "rsi", context.Rsi }, { "rdi", context.Rdi },
+        { "r8", context.R8 },   { "r9", context.R9 },   { "r10", context.R10 },
+        { "r11", context.R11 }, { "r12", context.R12 }, { "r13", context.R13 },
+        { "r14", context.R14 }, { "r15", context.R15 }, { "eflags", context.EFlags },
+    };
+    for (const auto& reg : REGISTERS) {
+        g_report.Register(reg.name, reg.value);
+    }
+}
+
+// Walks the unwind tables from the faulting context, the stack may not have frame pointers
+int unwind(CONTEXT context) {
+    int count = 0;
+    // A corrupt stack ends the walk instead of faulting in the filter
+    __try {
+        while (count < CrashReport::MAX_FRAMES && context.Rip != 0) {
+            g_frames[count++] = context.Rip;
+
+            DWORD64 imageBase;
+            PRUNTIME_FUNCTION function = RtlLookupFunctionEntry(context.Rip, &imageBase, nullptr);
+            if (function == nullptr) {
+                // Leaf function, the return address is on top of the stack
+                context.Rip = *reinterpret_cast<DWORD64*>(context.Rsp);
+                context.Rsp += sizeof(DWORD64);
+                continue;
+            }
+            PVOID handlerData;
+            DWORD64 establisherFrame;
+            RtlVirtualUnwind(
+                UNW_FLAG_NHANDLER,
+                imageBase,
+                context.Rip,
+                function,
+                &context,
+                &handlerData,
+                &establisherFrame,
+                nullptr
+            );
+        }
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+    }
+    return count;
+}
+
+void writeModule(uint64_t pc, int& moduleCount) {
+    PVOID base = nullptr;
+    if (RtlPcToFileHeader(reinterpret_cast<PVOID>(pc), &base) == nullptr) {
+        return;
+    }
+    for (int i = 0; i < moduleCount; i++) {
+        if (g_modules[i] == reinterpret_cast<uint64_t>(base)) {
+            return;
+        }
+    }
+    g_modules[moduleCount++] = reinterpret_cast<uint64_t>(base);
+
+    auto dos = static_cast<const IMAGE_DOS_HEADER*>(base);
+    auto nt = reinterpret_cast<const IMAGE_NT_HEADERS*>(
+        static_cast<const char*>(base) + dos->e_lfanew
+    );
+    if (GetModuleFileNameA(static_cast<HMODULE>(base), g_modulePath, MAX_PATH) == 0) {
+        g_modulePath[0] = '\0';
+    }
+    g_report.Module(
+        reinterpret_cast<uint64_t>(base),
+        reinterpret_cast<uint64_t>(base) + nt->OptionalHeader.SizeOfImage,
+        g_modulePath
+    );
+}
+
+LONG WINAPI handler(PEXCEPTION_POINTERS ptrs) {
+    if (g_crashed.exchange(true)) {
+        return EXCEPTION_EXECUTE_HANDLER;
+    }
+
+    g_report.Begin();
+    g_report.Hex("exception", ptrs->ExceptionRecord->ExceptionCode);
+    g_report.Hex("address", reinterpret_cast<uint64_t>(ptrs->ExceptionRecord->ExceptionAddress));
+    writeRegisters(*ptrs->ContextRecord);
+
+    int count = unwind(*ptrs->ContextRecord);
+    for (int i = 0; i < count; i++) {
+        g_report.Frame(g_frames[i]);
+    }
+    int moduleCount = 0;
+    for (int i = 0; i < count; i++) {
+        writeModule(g_frames[i], moduleCount);
+    }
+
+    HANDLE file = CreateFileW(
+        g_reportPath.c_str(),
+        GENERIC_WRITE,
+        0,
+        nullptr,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (file != INVALID_HANDLE_VALUE) {
+        DWORD written;
+        WriteFile(file, g_report.Data(), static_cast<DWORD>(g_report.Size()), &written, nullptr);
+        CloseHandle(file);
+    }
 
     return EXCEPTION_EXECUTE_HANDLER;
 }
 
-void HookCrashHandler() { SetUnhandledExceptionFilter(handler); }
+} // namespace
+
+void HookCrashHandler() {
+    g_reportPath
+        = std::filesystem::path(g_sessionPath).replace_filename(CRASH_REPORT_FILE_NAME).wstring();
+    SetUnhandledExceptionFilter(handler);
+}
@@ -0,0 +1,149 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "CrossAdapterFrames.h"
+
+#include "alvr_server/Logger.h"
+#include "d3d-render-utils/RenderUtils.h"
+#include <algorithm>
+
+using Microsoft::WRL::ComPtr;
+
+CrossAdapterFrames::CrossAdapterFrames(
+    std::shared_ptr<CD3DRender> renderDevice, std::shared_ptr<CD3DRender> encodeDevice
+)
+    : m_renderDevice(renderDevice)
+    , m_encodeDevice(encodeDevice) { }
+
+void CrossAdapterFrames::Create(const D3D11_TEXTURE2D_DESC& desc, uint32_t count) {
+    count = std::min(count, MAX_SLOTS);
+    m_shared = createShared(desc, count);
+    if (m_shared) {
+        Info("Encoding on another adapter, the frames are shared across adapters.\n");
+        return;
+    }
+    for (auto& slot : m_slots) {
+        slot = {};
+    }
+    createStaging(desc, count);
+    Info("Encoding on another adapter, the frames are copied through system memory.\n");
+}
+
+bool CrossAdapterFrames::createShared(const D3D11_TEXTURE2D_DESC& desc, uint32_t count) {
+    ComPtr<ID3D11Device1> encodeDevice;
+    if (FAILED(m_encodeDevice->GetDevice()->QueryInterface(IID_PPV_ARGS(&encodeDevice)))) {
+        return false;
+    }
+
+    D3D11_TEXTURE2D_DESC sharedDesc = desc;
+    sharedDesc.MiscFlags
+        = D3D11_RESOURCE_MISC_SHARED_NTHANDLE | D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX;
+    for (uint32_t i = 0; i < count; i++) {
+        Slot& slot = m_slots[i];
+        ComPtr<IDXGIResource1> resource;
+        HANDLE handle = nullptr;
+        HRESULT hr
+            = m_renderDevice->GetDevice()->CreateTexture2D(&sharedDesc, nullptr, &slot.texture);
+        if (SUCCEEDED(hr)) {
+            hr = slot.texture.As(&resource);
+        }
+        if (SUCCEEDED(hr)) {
+            hr = resource->CreateSharedHandle(
+                nullptr, DXGI_SHARED_RESOURCE_READ | DXGI_SHARED_RESOURCE_WRITE, nullptr, &handle
+            );
+        }
+        if (SUCCEEDED(hr)) {
+            // Fails on the drivers that can't share across these adapters
+            hr = encodeDevice->OpenSharedResource1(handle, IID_PPV_ARGS(&slot.encodeTexture));
+            CloseHandle(handle);
+        }
+        if (SUCCEEDED(hr)) {
+            hr = slot.texture.As(&slot.writeMutex);
+        }
+        if (SUCCEEDED(hr)) {
+            hr = slot.encodeTexture.As(&slot.readMutex);
+        }
+        if (FAILED(hr)) {
+            Debug("Cross-adapter frame sharing failed HR=%p %ls\n", hr, GetErrorStr(hr).c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void CrossAdapterFrames::createStaging(const D3D11_TEXTURE2D_DESC& desc, uint32_t count) {
+    D3D11_TEXTURE2D_DESC slotDesc = desc;
+    slotDesc.MiscFlags = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        OK_OR_THROW(
+            m_renderDevice->GetDevice()->CreateTexture2D(&slotDesc, nullptr, &m_slots[i].texture),
+            "Failed to create the frame slot."
+        );
+    }
+
+    D3D11_TEXTURE2D_DESC stagingDesc = slotDesc;
+    stagingDesc.Usage = D3D11_USAGE_STAGING;
+    stagingDesc.BindFlags = 0;
+    stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    OK_OR_THROW(
+        m_renderDevice->GetDevice()->CreateTexture2D(&stagingDesc, nullptr, &m_staging),
+        "Failed to create the cross-adapter staging texture."
+    );
+    OK_OR_THROW(
+        m_encodeDevice->GetDevice()->CreateTexture2D(&slotDesc, nullptr, &m_upload),
+        "Failed to create the cross-adapter upload texture."
+    );
+}
+
+bool CrossAdapterFrames::BeginWrite(uint32_t slot) {
+    if (!m_shared) {
+        return true;
+    }
+    // A slot that was written but never encoded comes back with the written key
+    Slot& s = m_slots[slot];
+    return s.writeMutex->AcquireSync(s.releasedKey, SYNC_TIMEOUT_MS) == S_OK;
+}
+
+void CrossAdapterFrames::EndWrite(uint32_t slot) {
+    if (!m_shared) {
+        return;
+    }
+    Slot& s = m_slots[slot];
+    s.writeMutex->ReleaseSync(KEY_WRITTEN);
+    s.releasedKey = KEY_WRITTEN;
+}
+
+ID3D11Texture2D* CrossAdapterFrames::BeginRead(uint32_t slot) {
+    Slot& s = m_slots[slot];
+    if (m_shared) {
+        if (s.readMutex->AcquireSync(KEY_WRITTEN, SYNC_TIMEOUT_MS) != S_OK) {
+            return nullptr;
+        }
+        return s.encodeTexture.Get();
+    }
+
+    // Waits for the render adapter, the encoder thread has nothing else to do meanwhile
+    ID3D11DeviceContext* renderContext = m_renderDevice->GetContext();
+    renderContext->CopyResource(m_staging.Get(), s.texture.Get());
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(renderContext->Map(m_staging.Get(), 0, D3D11_MAP_READ, 0, &mapped))) {
+        return nullptr;
+    }
+    // The planes of NV12 and P010 follow each other with the same pitch, the whole subresource
+    // is uploaded at once
+    m_encodeDevice->GetContext()->UpdateSubresource(
+        m_upload.Get(), 0, nullptr, mapped.pData, mapped.RowPitch, mapped.DepthPitch
+    );
+    renderContext->Unmap(m_staging.Get(), 0);
+    return m_upload.Get();
+}
+
+void CrossAdapterFrames::EndRead(uint32_t slot) {
+    if (!m_shared) {
+        return;
+    }
+    // The copies the encoder queued in Transmit are ordered before the next write
+    Slot& s = m_slots[slot];
+    s.readMutex->ReleaseSync(KEY_READ);
+    s.releasedKey = KEY_READ;
+}
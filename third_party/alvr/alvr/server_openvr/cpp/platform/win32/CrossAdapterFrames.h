@@ -0,0 +1,69 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "shared/d3drender.h"
+#include <d3d11.h>
+#include <d3d11_1.h>
+#include <dxgi.h>
+#include <memory>
+#include <stdint.h>
+#include <wrl.h>
+
+// The frame slots of CEncoder when the encoder runs on another adapter than the compositor, see
+// encode_adapter_index. The slots are created on the render adapter and shared with NT handles and
+// a keyed mutex, which some drivers allow across adapters. Otherwise each frame is read back to a
+// staging texture and uploaded to the encode adapter.
+//
+// A slot belongs to one thread at a time, like the CEncoder slots: the present thread writes it
+// between BeginWrite and EndWrite, the encoder thread reads it between BeginRead and EndRead.
+class CrossAdapterFrames {
+public:
+    static const uint32_t MAX_SLOTS = 3;
+
+    CrossAdapterFrames(
+        std::shared_ptr<CD3DRender> renderDevice, std::shared_ptr<CD3DRender> encodeDevice
+    );
+
+    // Creates the slots on the render adapter, desc has the size and format of the frames
+    void Create(const D3D11_TEXTURE2D_DESC& desc, uint32_t count);
+    // The slot on the render adapter, for the present thread to copy the frame into
+    ID3D11Texture2D* GetTexture(uint32_t slot) { return m_slots[slot].texture.Get(); }
+
+    bool IsShared() { return m_shared; }
+
+    // Returns false if the slot can't be written, the frame is dropped
+    bool BeginWrite(uint32_t slot);
+    void EndWrite(uint32_t slot);
+    // The frame on the encode adapter, valid until EndRead. Null if it can't be read.
+    ID3D11Texture2D* BeginRead(uint32_t slot);
+    void EndRead(uint32_t slot);
+
+private:
+    // Keys of the keyed mutex, the slot was last released by the writer or the reader
+    static const uint64_t KEY_READ = 0;
+    static const uint64_t KEY_WRITTEN = 1;
+    static const DWORD SYNC_TIMEOUT_MS = 100;
+
+    struct Slot {
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+        Microsoft::WRL::ComPtr<IDXGIKeyedMutex> writeMutex;
+        // The same texture opened on the encode adapter, shared mode only
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> encodeTexture;
+        Microsoft::WRL::ComPtr<IDXGIKeyedMutex> readMutex;
+        uint64_t releasedKey = KEY_READ;
+    };
+
+    bool createShared(const D3D11_TEXTURE2D_DESC& desc, uint32_t count);
+    void createStaging(const D3D11_TEXTURE2D_DESC& desc, uint32_t count);
+
+    std::shared_ptr<CD3DRender> m_renderDevice;
+    std::shared_ptr<CD3DRender> m_encodeDevice;
+    Slot m_slots[MAX_SLOTS];
+    bool m_shared = false;
+
+    // Staging mode, used by the encoder thread only
+    Microsoft::WRL::ComPtr<ID3D11Texture2D> m_staging;
+    Microsoft::WRL::ComPtr<ID3D11Texture2D> m_upload;
+};
@@ -3,9 +3,11 @@
 
 #include "FrameRender.h"
 #include "alvr_server/Logger.h"
+#include "alvr_server/PhotonMarker.h"
 #include "alvr_server/Settings.h"
 #include "alvr_server/Utils.h"
 #include "alvr_server/bindings.h"
+#include <cmath>
 
 extern uint64_t g_DriverTestMode;
 
@@ -83,6 +85,17 @@ static DirectX::XMMATRIX HmdMatrix_AsDxMatPosOnly(const vr::HmdMatrix34_t& m) {
     return DirectX::XMLoadFloat4x4(&f);
 }
 
+static bool IsNvidiaAdapter(ID3D11Device* device) {
+    ComPtr<IDXGIDevice> dxgiDevice;
+    ComPtr<IDXGIAdapter> adapter;
+    DXGI_ADAPTER_DESC desc;
+    if (FAILED(device->QueryInterface(__uuidof(IDXGIDevice), (void**)dxgiDevice.GetAddressOf()))
+        || FAILED(dxgiDevice->GetAdapter(&adapter)) || FAILED(adapter->GetDesc(&desc))) {
+        return false;
+    }
+    return desc.VendorId == 0x10DE;
+}
+
 FrameRender::FrameRender(std::shared_ptr<CD3DRender> pD3DRender)
     : m_pD3DRender(pD3DRender) {
     // Set safe defaults for tangents and eye-to-HMD
@@ -90,8 +103,21 @@ FrameRender::FrameRender(std::shared_ptr<CD3DRender> pD3DRender)
     HmdMatrix_SetIdentity(&m_eyeToHead[1]);
     m_viewProj[0] = { -1.0f, 1.0f, 1.0f, -1.0f };
     m_viewProj[1] = { -1.0f, 1.0f, 1.0f, -1.0f };
+    UpdateViewTransforms();
 
-    FrameRender::SetGpuPriority(m_pD3DRender->GetDevice());
+    if (Settings::Instance().m_raiseGpuPriority) {
+        FrameRender::SetGpuPriority(m_pD3DRender->GetDevice());
+    }
+
+    if (Settings::Instance().m_enableHdr && Settings::Instance().m_hdrNvencRgbInput) {
+        if (Settings::Instance().m_force_sw_encoding) {
+            Warn("NVENC RGB input is ignored with software encoding.\n");
+        } else if (!IsNvidiaAdapter(m_pD3DRender->GetDevice())) {
+            Warn("NVENC RGB input needs an NVIDIA GPU, converting HDR to YUV in shader.\n");
+        } else {
+            m_hdrRgbOutput = true;
+        }
+    }
 }
 
 FrameRender::~FrameRender() { }
@@ -110,9 +136,7 @@ bool FrameRender::Startup() {
     ZeroMemory(&compositionTextureDesc, sizeof(compositionTextureDesc));
     compositionTextureDesc.Width = Settings::Instance().m_renderWidth;
     compositionTextureDesc.Height = Settings::Instance().m_renderHeight;
-    compositionTextureDesc.Format = Settings::Instance().m_enableHdr
-        ? DXGI_FORMAT_R16G16B16A16_FLOAT
-        : DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    compositionTextureDesc.Format = GetCompositionFormat();
     compositionTextureDesc.MipLevels = 1;
     compositionTextureDesc.ArraySize = 1;
     compositionTextureDesc.SampleDesc.Count = 1;
@@ -271,11 +295,11 @@ bool FrameRender::Startup() {
     // Src texture has various geometry and we should use the part of the textures.
     // That part are defined by uv-coordinates of "bounds" passed to
     // IVRDriverDirectModeComponent::SubmitLayer. So we should update uv-coordinates for every
-    // frames and layers.
+    // frames and layers. All layers of a frame are written at once, one after the other.
     D3D11_BUFFER_DESC bd;
     ZeroMemory(&bd, sizeof(bd));
     bd.Usage = D3D11_USAGE_DYNAMIC;
-    bd.ByteWidth = sizeof(SimpleVertex) * 8;
+    bd.ByteWidth = sizeof(SimpleVertex) * LAYER_VERTEX_COUNT * MAX_LAYERS;
     bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
     bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 
@@ -398,16 +422,19 @@ bool FrameRender::Startup() {
 
     enableColorCorrection = Settings::Instance().m_enableColorCorrection;
     if (enableColorCorrection) {
-        std::vector<uint8_t> colorCorrectionShaderCSO(
-            COLOR_CORRECTION_CSO_PTR, COLOR_CORRECTION_CSO_PTR + COLOR_CORRECTION_CSO_LEN
-        );
+        // Without the sharpening taps when they would be weighted by 0
+        bool sharpening = Settings::Instance().m_sharpening != 0.f;
+        const unsigned char* cso
+            = sharpening ? COLOR_CORRECTION_CSO_PTR : COLOR_CORRECTION_UNSHARPENED_CSO_PTR;
+        unsigned int csoLen
+            = sharpening ? COLOR_CORRECTION_CSO_LEN : COLOR_CORRECTION_UNSHARPENED_CSO_LEN;
+        std::vector<uint8_t> colorCorrectionShaderCSO(cso, cso + csoLen);
 
         ComPtr<ID3D11Texture2D> colorCorrectedTexture = CreateTexture(
             m_pD3DRender->GetDevice(),
             Settings::Instance().m_renderWidth,
             Settings::Instance().m_renderHeight,
-            Settings::Instance().m_enableHdr ? DXGI_FORMAT_R16G16B16A16_FLOAT
-                                             : DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+            GetCompositionFormat()
         );
 
         struct ColorCorrection {
@@ -449,7 +476,21 @@ bool FrameRender::Startup() {
         m_pStagingTexture = m_ffr->GetOutputTexture();
     }
 
-    if (Settings::Instance().m_enableHdr) {
+    // The marker is stamped in RGB, where black and white don't depend on the YUV matrix
+    if (Settings::Instance().m_photonMarker) {
+        hr = m_pD3DRender->GetDevice()->CreateRenderTargetView(
+            m_pStagingTexture.Get(), NULL, &m_markerTarget
+        );
+        if (SUCCEEDED(hr)) {
+            hr = m_pD3DRender->GetContext()->QueryInterface(IID_PPV_ARGS(&m_markerContext));
+        }
+        if (FAILED(hr)) {
+            Warn("Photon marker disabled, ClearView is not available: %p\n", hr);
+            m_markerTarget.Reset();
+        }
+    }
+
+    if (Settings::Instance().m_enableHdr && !m_hdrRgbOutput) {
         std::vector<uint8_t> yuv420ShaderCSO(
             RGBTOYUV420_CSO_PTR, RGBTOYUV420_CSO_PTR + RGBTOYUV420_CSO_LEN
         );
@@ -554,16 +595,48 @@ void FrameRender::SetViewParams(
     m_eyeToHead[0] = eyeToHeadLeft;
     m_viewProj[1] = projRight;
     m_eyeToHead[1] = eyeToHeadRight;
+    UpdateViewTransforms();
+}
+
+// The view params only change with the headset configuration, the per frame work is left with the
+// poses
+void FrameRender::UpdateViewTransforms() {
+    const auto nearZ = 0.001f;
+    const auto farZ = 1.0f;
+    // The quads are placed at this depth, their z is discarded
+    const auto depth = 700.0f;
+    for (int eye = 0; eye < 2; eye++) {
+        const vr::HmdRect2_t& proj = m_viewProj[eye];
+        DirectX::XMMATRIX projectionMat = DirectX::XMMatrixPerspectiveOffCenterRH(
+            proj.vTopLeft.v[0] * nearZ,
+            proj.vBottomRight.v[0] * nearZ,
+            -proj.vTopLeft.v[1] * nearZ,
+            -proj.vBottomRight.v[1] * nearZ,
+            nearZ,
+            farZ
+        );
+        DirectX::XMMATRIX hmdToEyeMat
+            = DirectX::XMMatrixInverse(nullptr, HmdMatrix_AsDxMatPosOnly(m_eyeToHead[eye]));
+        DirectX::XMStoreFloat4x4(&m_eyeTransform[eye], hmdToEyeMat * projectionMat);
+
+        float left = proj.vTopLeft.v[0] * depth;
+        float top = -proj.vTopLeft.v[1] * depth;
+        float right = proj.vBottomRight.v[0] * depth;
+        float bottom = -proj.vBottomRight.v[1] * depth;
+        m_quadCorners[eye][0] = { left, top, -depth, 1.0f };
+        m_quadCorners[eye][1] = { right, bottom, -depth, 1.0f };
+        m_quadCorners[eye][2] = { right, top, -depth, 1.0f };
+        m_quadCorners[eye][3] = { left, bottom, -depth, 1.0f };
+    }
 }
 
 bool FrameRender::RenderFrame(
-    ID3D11Texture2D* pTexture[][2],
+    ID3D11ShaderResourceView* pViews[][2],
     vr::VRTextureBounds_t bounds[][2],
     vr::HmdMatrix34_t poses[],
+    const vr::HmdMatrix34_t* latePose,
     int layerCount,
-    bool recentering,
-    const std::string& message,
-    const std::string& debugText
+    bool recentering
 ) {
     // Set render target
     m_pD3DRender->GetContext()->OMSetRenderTargets(1, m_pRenderTargetView.GetAddressOf(), NULL);
@@ -582,118 +655,88 @@ bool FrameRender::RenderFrame(
         layerCount++;
     }
 
-    // Set up our projection, HMD, and HMD-to-eye transforms once
-    const auto nearZ = 0.001f;
-    const auto farZ = 1.0f;
-    DirectX::XMMATRIX projectionMatL = DirectX::XMMatrixPerspectiveOffCenterRH(
-        m_viewProj[0].vTopLeft.v[0] * nearZ,
-        m_viewProj[0].vBottomRight.v[0] * nearZ,
-        -m_viewProj[0].vTopLeft.v[1] * nearZ,
-        -m_viewProj[0].vBottomRight.v[1] * nearZ,
-        nearZ,
-        farZ
-    );
-    DirectX::XMMATRIX projectionMatR = DirectX::XMMatrixPerspectiveOffCenterRH(
-        m_viewProj[1].vTopLeft.v[0] * nearZ,
-        m_viewProj[1].vBottomRight.v[0] * nearZ,
-        -m_viewProj[1].vTopLeft.v[1] * nearZ,
-        -m_viewProj[1].vBottomRight.v[1] * nearZ,
-        nearZ,
-        farZ
-    );
-    DirectX::XMMATRIX hmdToEyeMatL
-        = DirectX::XMMatrixInverse(nullptr, HmdMatrix_AsDxMatPosOnly(m_eyeToHead[0]));
-    DirectX::XMMATRIX hmdToEyeMatR
-        = DirectX::XMMatrixInverse(nullptr, HmdMatrix_AsDxMatPosOnly(m_eyeToHead[1]));
+    // The projection and HMD-to-eye transforms come from UpdateViewTransforms
+    DirectX::XMMATRIX eyeMatL = DirectX::XMLoadFloat4x4(&m_eyeTransform[0]);
+    DirectX::XMMATRIX eyeMatR = DirectX::XMLoadFloat4x4(&m_eyeTransform[1]);
     DirectX::XMMATRIX hmdPoseForTargetTs
         = HmdMatrix_AsDxMatOrientOnly(poses[0]); // Set to HmdMatrix_AsDxMat to debug the rendering
+    if (latePose) {
+        // Late latching: viewMatDiff below also rotates the layers by the head motion since the
+        // game rendered them. Only the rotation is corrected, like the client's ATW.
+        hmdPoseForTargetTs = HmdMatrix_AsDxMatOrientOnly(*latePose);
+    }
 
     // I think the negative Y basis is a handedness thing?
     DirectX::XMMATRIX identityMat = DirectX::XMLoadFloat4x4(&_identityMat);
 
+    if (layerCount > MAX_LAYERS) {
+        Debug("Ignore layers past %d. layers=%d\n", MAX_LAYERS, layerCount);
+        layerCount = MAX_LAYERS;
+        recenterLayer = recentering ? MAX_LAYERS - 1 : -1;
+    }
+
+    // The layers are batched: their vertices are uploaded with a single Map, then each eye draws
+    // all of them with only the views and the blend state changing in between
+    SimpleVertex layerVertices[MAX_LAYERS][LAYER_VERTEX_COUNT];
+    ID3D11ShaderResourceView* layerViews[MAX_LAYERS][2];
+    bool layerFirst[MAX_LAYERS];
+    int drawCount = 0;
+
     for (int i = 0; i < layerCount; i++) {
-        ID3D11Texture2D* textures[2];
+        ID3D11ShaderResourceView* views[2];
         vr::VRTextureBounds_t bound[2];
 
         if (i == recenterLayer) {
-            textures[0] = (ID3D11Texture2D*)m_recenterTexture.Get();
-            textures[1] = (ID3D11Texture2D*)m_recenterTexture.Get();
+            views[0] = m_recenterResourceView.Get();
+            views[1] = m_recenterResourceView.Get();
             bound[0].uMin = bound[0].vMin = bound[1].uMin = bound[1].vMin = 0.0f;
             bound[0].uMax = bound[0].vMax = bound[1].uMax = bound[1].vMax = 1.0f;
         } else {
-            textures[0] = pTexture[i][0];
-            textures[1] = pTexture[i][1];
+            views[0] = pViews[i][0];
+            views[1] = pViews[i][1];
             bound[0] = bounds[i][0];
             bound[1] = bounds[i][1];
         }
-        if (textures[0] == NULL || textures[1] == NULL) {
+        if (views[0] == NULL || views[1] == NULL) {
             Debug(
-                "Ignore NULL layer. layer=%d/%d%s%s\n",
+                "Ignore NULL layer. layer=%d/%d%s\n",
                 i,
                 layerCount,
-                recentering ? L" (recentering)" : L"",
-                !message.empty() ? L" (message)" : L""
+                recentering ? L" (recentering)" : L""
             );
             continue;
         }
 
-        D3D11_TEXTURE2D_DESC srcDesc;
-        textures[0]->GetDesc(&srcDesc);
-
-        D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
-        SRVDesc.Format = srcDesc.Format;
-        SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-        SRVDesc.Texture2D.MostDetailedMip = 0;
-        SRVDesc.Texture2D.MipLevels = 1;
-
-        ComPtr<ID3D11ShaderResourceView> pShaderResourceView[2];
-
-        HRESULT hr = m_pD3DRender->GetDevice()->CreateShaderResourceView(
-            textures[0], &SRVDesc, pShaderResourceView[0].ReleaseAndGetAddressOf()
-        );
-        if (FAILED(hr)) {
-            Error("CreateShaderResourceView %p %ls\n", hr, GetErrorStr(hr).c_str());
-            return false;
-        }
-        hr = m_pD3DRender->GetDevice()->CreateShaderResourceView(
-            textures[1], &SRVDesc, pShaderResourceView[1].ReleaseAndGetAddressOf()
-        );
-        if (FAILED(hr)) {
-            Error("CreateShaderResourceView %p %ls\n", hr, GetErrorStr(hr).c_str());
-            return false;
-        }
-
-        if (i == 0) {
-            m_pD3DRender->GetContext()->OMSetBlendState(m_pBlendStateFirst.Get(), NULL, 0xffffffff);
-        } else {
-            m_pD3DRender->GetContext()->OMSetBlendState(m_pBlendState.Get(), NULL, 0xffffffff);
-        }
+        D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc;
+        views[0]->GetDesc(&SRVDesc);
+        DXGI_FORMAT format = SRVDesc.Format;
 
         uint32_t inputColorAdjust = 0;
+        auto live = Settings::Instance().Live();
         if (Settings::Instance().m_enableHdr) {
-            if (SRVDesc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
-                || SRVDesc.Format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB
-                || SRVDesc.Format == DXGI_FORMAT_B8G8R8X8_UNORM_SRGB) {
+            if (format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+                || format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB
+                || format == DXGI_FORMAT_B8G8R8X8_UNORM_SRGB) {
                 inputColorAdjust = 1; // do sRGB manually
             }
-            if (Settings::Instance().m_forceHdrSrgbCorrection) {
+            if (live->m_forceHdrSrgbCorrection) {
                 inputColorAdjust = 1;
             }
-            if (Settings::Instance().m_clampHdrExtendedRange) {
+            if (live->m_clampHdrExtendedRange) {
                 inputColorAdjust |= 0x10; // Clamp values to 0.0 to 1.0
             }
         } else {
-            if (SRVDesc.Format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
-                && SRVDesc.Format != DXGI_FORMAT_B8G8R8A8_UNORM_SRGB
-                && SRVDesc.Format != DXGI_FORMAT_B8G8R8X8_UNORM_SRGB) {
+            if (format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+                && format != DXGI_FORMAT_B8G8R8A8_UNORM_SRGB
+                && format != DXGI_FORMAT_B8G8R8X8_UNORM_SRGB) {
                 inputColorAdjust = 2; // undo sRGB?
 
-                if (Settings::Instance().m_forceHdrSrgbCorrection) {
+                if (live->m_forceHdrSrgbCorrection) {
                     inputColorAdjust = 0;
                 }
             }
 
-            if (Settings::Instance().m_clampHdrExtendedRange) {
+            if (live->m_clampHdrExtendedRange) {
                 inputColorAdjust |= 0x10; // Clamp values to 0.0 to 1.0
             }
         }
@@ -711,64 +754,28 @@ bool FrameRender::RenderFrame(
         DirectX::XMMATRIX viewMatDiff
             = DirectX::XMMatrixInverse(nullptr, hmdPoseForTargetTs * framePoseInv);
 
-        DirectX::XMMATRIX transformMatL = viewMatDiff * hmdToEyeMatL * projectionMatL;
-        DirectX::XMMATRIX transformMatR = viewMatDiff * hmdToEyeMatR * projectionMatR;
+        DirectX::XMMATRIX transformMatL = viewMatDiff * eyeMatL;
+        DirectX::XMMATRIX transformMatR = viewMatDiff * eyeMatR;
 
         if (i == recenterLayer) {
             transformMatL = identityMat;
             transformMatR = identityMat;
         }
 
-        const auto depth = 700.0f;
-        const auto m = 1.0f;
         DirectX::XMFLOAT4 vertsL[4];
         DirectX::XMFLOAT4 vertsR[4];
-
-        DirectX::XMVECTORF32 vertsL_VF32[4]
-            = { { { { -1.0f * -m_viewProj[0].vTopLeft.v[0] * depth * m,
-                      1.0f * -m_viewProj[0].vTopLeft.v[1] * depth * m,
-                      -depth,
-                      1.0f } } },
-                { { { 1.0f * m_viewProj[0].vBottomRight.v[0] * depth * m,
-                      -1.0f * m_viewProj[0].vBottomRight.v[1] * depth * m,
-                      -depth,
-                      1.0f } } },
-                { { { 1.0f * m_viewProj[0].vBottomRight.v[0] * depth * m,
-                      1.0f * -m_viewProj[0].vTopLeft.v[1] * depth * m,
-                      -depth,
-                      1.0f } } },
-                { { { -1.0f * -m_viewProj[0].vTopLeft.v[0] * depth * m,
-                      -1.0f * m_viewProj[0].vBottomRight.v[1] * depth * m,
-                      -depth,
-                      1.0f } } } };
-
-        for (int i = 0; i < 4; i++) {
+        for (int c = 0; c < 4; c++) {
             DirectX::XMStoreFloat4(
-                &vertsL[i], DirectX::XMVector3Transform(vertsL_VF32[i], transformMatL)
+                &vertsL[c],
+                DirectX::XMVector3Transform(
+                    DirectX::XMLoadFloat4(&m_quadCorners[0][c]), transformMatL
+                )
             );
-        }
-
-        DirectX::XMVECTORF32 vertsR_VF32[4]
-            = { { { { -1.0f * -m_viewProj[1].vTopLeft.v[0] * depth * m,
-                      1.0f * -m_viewProj[1].vTopLeft.v[1] * depth * m,
-                      -depth,
-                      1.0f } } },
-                { { { 1.0f * m_viewProj[1].vBottomRight.v[0] * depth * m,
-                      -1.0f * m_viewProj[1].vBottomRight.v[1] * depth * m,
-                      -depth,
-                      1.0f } } },
-                { { { 1.0f * m_viewProj[1].vBottomRight.v[0] * depth * m,
-                      1.0f * -m_viewProj[1].vTopLeft.v[1] * depth * m,
-                      -depth,
-                      1.0f } } },
-                { { { -1.0f * -m_viewProj[1].vTopLeft.v[0] * depth * m,
-                      -1.0f * m_viewProj[1].vBottomRight.v[1] * depth * m,
-                      -depth,
-                      1.0f } } } };
-
-        for (int i = 0; i < 4; i++) {
             DirectX::XMStoreFloat4(
-                &vertsR[i], DirectX::XMVector3Transform(vertsR_VF32[i], transformMatR)
+                &vertsR[c],
+                DirectX::XMVector3Transform(
+                    DirectX::XMLoadFloat4(&m_quadCorners[1][c]), transformMatR
+                )
             );
         }
 
@@ -803,15 +810,23 @@ bool FrameRender::RenderFrame(
               1 + (inputColorAdjust * 2) },
         };
 
+        memcpy(layerVertices[drawCount], vertices, sizeof(vertices));
+        layerViews[drawCount][0] = views[0];
+        layerViews[drawCount][1] = views[1];
+        layerFirst[drawCount] = i == 0;
+        drawCount++;
+    }
+
+    if (drawCount > 0) {
         D3D11_MAPPED_SUBRESOURCE mapped = { 0 };
-        hr = m_pD3DRender->GetContext()->Map(
+        HRESULT hr = m_pD3DRender->GetContext()->Map(
             m_pVertexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped
         );
         if (FAILED(hr)) {
             Error("Map %p %ls\n", hr, GetErrorStr(hr).c_str());
             return false;
         }
-        memcpy(mapped.pData, vertices, sizeof(vertices));
+        memcpy(mapped.pData, layerVertices, sizeof(layerVertices[0]) * drawCount);
 
         m_pD3DRender->GetContext()->Unmap(m_pVertexBuffer.Get(), 0);
 
@@ -841,52 +856,206 @@ bool FrameRender::RenderFrame(
         m_pD3DRender->GetContext()->VSSetShader(m_pVertexShader.Get(), nullptr, 0);
         m_pD3DRender->GetContext()->PSSetShader(m_pPixelShader.Get(), nullptr, 0);
 
-        ID3D11ShaderResourceView* shaderResourceView[2]
-            = { pShaderResourceView[0].Get(), pShaderResourceView[1].Get() };
-        m_pD3DRender->GetContext()->PSSetShaderResources(0, 2, shaderResourceView);
-
         m_pD3DRender->GetContext()->PSSetSamplers(0, 1, m_pSamplerLinear.GetAddressOf());
 
         //
         // Draw
         //
 
-        // Left eye
-        m_pD3DRender->GetContext()->RSSetViewports(1, &m_viewportL);
-        m_pD3DRender->GetContext()->RSSetScissorRects(1, &m_scissorL);
-        m_pD3DRender->GetContext()->DrawIndexed(VERTEX_INDEX_COUNT / 2, 0, 0);
-
-        // Right eye
-        m_pD3DRender->GetContext()->RSSetViewports(1, &m_viewportR);
-        m_pD3DRender->GetContext()->RSSetScissorRects(1, &m_scissorR);
-        m_pD3DRender->GetContext()->DrawIndexed(
-            VERTEX_INDEX_COUNT / 2, (VERTEX_INDEX_COUNT / 2), 0
-        );
+        const D3D11_VIEWPORT* viewports[2] = { &m_viewportL, &m_viewportR };
+        const D3D11_RECT* scissors[2] = { &m_scissorL, &m_scissorR };
+        for (int eye = 0; eye < 2; eye++) {
+            m_pD3DRender->GetContext()->RSSetViewports(1, viewports[eye]);
+            m_pD3DRender->GetContext()->RSSetScissorRects(1, scissors[eye]);
+
+            for (int d = 0; d < drawCount; d++) {
+                if (d == 0 || layerFirst[d] != layerFirst[d - 1]) {
+                    m_pD3DRender->GetContext()->OMSetBlendState(
+                        layerFirst[d] ? m_pBlendStateFirst.Get() : m_pBlendState.Get(),
+                        NULL,
+                        0xffffffff
+                    );
+                }
+                m_pD3DRender->GetContext()->PSSetShaderResources(0, 2, layerViews[d]);
+                m_pD3DRender->GetContext()->DrawIndexed(
+                    VERTEX_INDEX_COUNT / 2,
+                    eye * (VERTEX_INDEX_COUNT / 2),
+                    d * LAYER_VERTEX_COUNT
+                );
+            }
+        }
     }
 
     // Restore full viewport/scissor rect for the rest
     m_pD3DRender->GetContext()->RSSetViewports(1, &m_viewport);
     m_pD3DRender->GetContext()->RSSetScissorRects(1, &m_scissor);
 
+    if (m_passTimer) {
+        m_passTimer->Mark(GPU_PASS_LAYERS);
+    }
+
     if (enableColorCorrection) {
         m_colorCorrectionPipeline->Render();
+        if (m_passTimer) {
+            m_passTimer->Mark(GPU_PASS_COLOR_CORRECTION);
+        }
     }
 
     if (enableFFE) {
         m_ffr->Render();
+        if (m_passTimer) {
+            m_passTimer->Mark(GPU_PASS_FOVEATION);
+        }
     }
 
-    if (Settings::Instance().m_enableHdr) {
+    if (m_markerTarget) {
+        StampPhotonMarker();
+    }
+
+    if (m_yuvPipeline) {
         m_yuvPipeline->Render();
+        if (m_passTimer) {
+            m_passTimer->Mark(GPU_PASS_YUV_CONVERT);
+        }
+    }
+
+    m_pD3DRender->GetContext()->Flush();
+
+    return true;
+}
+
+bool FrameRender::CopyLayer(
+    ID3D11ShaderResourceView* pViews[][2],
+    vr::VRTextureBounds_t bounds[][2],
+    const vr::HmdMatrix34_t* latePose,
+    int layerCount,
+    bool recentering,
+    ID3D11Texture2D* target
+) {
+    // The other passes and HDR change the pixels, the layers pass alone samples them 1:1
+    bool copyable = layerCount == 1 && !recentering && !latePose && !enableColorCorrection
+        && !enableFFE && !m_yuvPipeline && !m_markerTarget && !Settings::Instance().m_enableHdr
+        && pViews[0][0] && pViews[0][1];
+    D3D11_BOX boxes[2];
+    for (int eye = 0; eye < 2 && copyable; eye++) {
+        copyable = GetCopyBox(pViews[0][eye], bounds[0][eye], &boxes[eye]);
+    }
+    if (copyable != m_passthrough) {
+        Debug("Passthrough %s\n", copyable ? "started" : "stopped");
+        m_passthrough = copyable;
+    }
+    if (!copyable) {
+        return false;
     }
 
+    UINT eyeWidth = Settings::Instance().m_renderWidth / 2;
+    for (int eye = 0; eye < 2; eye++) {
+        ComPtr<ID3D11Resource> source;
+        pViews[0][eye]->GetResource(&source);
+        m_pD3DRender->GetContext()->CopySubresourceRegion(
+            target, 0, eye * eyeWidth, 0, 0, source.Get(), 0, &boxes[eye]
+        );
+    }
+    if (m_passTimer) {
+        m_passTimer->Mark(GPU_PASS_LAYERS);
+    }
     m_pD3DRender->GetContext()->Flush();
+    return true;
+}
 
+bool FrameRender::GetCopyBox(
+    ID3D11ShaderResourceView* view, const vr::VRTextureBounds_t& bound, D3D11_BOX* box
+) {
+    // The render target is sRGB, so an sRGB view is written back with the same bits. Other
+    // formats are converted by the pixel shader, and BGRA can't be copied into RGBA.
+    D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+    view->GetDesc(&viewDesc);
+    if (viewDesc.Format != GetCompositionFormat()
+        || viewDesc.ViewDimension != D3D11_SRV_DIMENSION_TEXTURE2D
+        || viewDesc.Texture2D.MostDetailedMip != 0) {
+        return false;
+    }
+    ComPtr<ID3D11Resource> resource;
+    view->GetResource(&resource);
+    ComQIPtr<ID3D11Texture2D> texture = resource.Get();
+    if (!texture) {
+        return false;
+    }
+    D3D11_TEXTURE2D_DESC desc;
+    texture->GetDesc(&desc);
+    if (desc.SampleDesc.Count != 1) {
+        return false;
+    }
+
+    // Flipped or scaled crops are not a copy
+    auto toTexel = [](float coord, UINT size, UINT* texel) {
+        float value = coord * size;
+        *texel = (UINT)std::lround(value);
+        return std::abs(value - *texel) < 0.01f;
+    };
+    UINT left, top, right, bottom;
+    if (!toTexel(bound.uMin, desc.Width, &left) || !toTexel(bound.uMax, desc.Width, &right)
+        || !toTexel(bound.vMin, desc.Height, &top) || !toTexel(bound.vMax, desc.Height, &bottom)
+        || right <= left || bottom <= top || right > desc.Width || bottom > desc.Height
+        || right - left != Settings::Instance().m_renderWidth / 2
+        || bottom - top != Settings::Instance().m_renderHeight) {
+        return false;
+    }
+    *box = { left, top, 0, right, bottom, 1 };
     return true;
 }
 
 ComPtr<ID3D11Texture2D> FrameRender::GetTexture() { return m_pStagingTexture; }
 
+void FrameRender::StampPhotonMarker() {
+    uint8_t cells[PHOTON_MARKER_CELLS];
+    GetPhotonMarkerCells(m_markerTimestampNs, m_markerFrame++, cells);
+
+    // The white cells of a row are cleared together, a row has at most half its cells in runs
+    D3D11_RECT white[PHOTON_MARKER_CELLS / 2];
+    UINT whiteCount = 0;
+    for (uint32_t row = 0; row < PHOTON_MARKER_ROWS; row++) {
+        const uint8_t* rowCells = &cells[row * PHOTON_MARKER_COLUMNS];
+        for (uint32_t column = 0; column < PHOTON_MARKER_COLUMNS; column++) {
+            if (!rowCells[column]) {
+                continue;
+            }
+            uint32_t end = column + 1;
+            while (end < PHOTON_MARKER_COLUMNS && rowCells[end]) {
+                end++;
+            }
+            white[whiteCount++] = {
+                (LONG)(column * PHOTON_MARKER_CELL_SIZE),
+                (LONG)(row * PHOTON_MARKER_CELL_SIZE),
+                (LONG)(end * PHOTON_MARKER_CELL_SIZE),
+                (LONG)((row + 1) * PHOTON_MARKER_CELL_SIZE),
+            };
+            column = end;
+        }
+    }
+
+    const D3D11_RECT marker = { 0, 0, PHOTON_MARKER_WIDTH, PHOTON_MARKER_HEIGHT };
+    const FLOAT black[4] = { 0, 0, 0, 1 };
+    const FLOAT whiteColor[4] = { 1, 1, 1, 1 };
+    m_markerContext->ClearView(m_markerTarget.Get(), black, &marker, 1);
+    if (whiteCount > 0) {
+        m_markerContext->ClearView(m_markerTarget.Get(), whiteColor, white, whiteCount);
+    }
+}
+
+// HDR keeps float16 for the YUV shader. For NVENC it is UNORM, which the encoder takes as
+// ABGR10/ABGR, so the extended range is clamped.
+DXGI_FORMAT FrameRender::GetCompositionFormat() const {
+    if (!Settings::Instance().m_enableHdr) {
+        return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    }
+    if (!m_hdrRgbOutput) {
+        return DXGI_FORMAT_R16G16B16A16_FLOAT;
+    }
+    return Settings::Instance().m_use10bitEncoder ? DXGI_FORMAT_R10G10B10A2_UNORM
+                                                  : DXGI_FORMAT_R8G8B8A8_UNORM;
+}
+
 void FrameRender::GetEncodingResolution(uint32_t* width, uint32_t* height) {
     if (enableFFE) {
         m_ffr->GetOptimizedResolution(width, height);
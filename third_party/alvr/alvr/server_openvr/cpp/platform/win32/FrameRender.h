@@ -8,6 +8,7 @@
 #include <string>
 
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <d3dcompiler.h>
 #include <directxcolors.h>
 #include <directxmath.h>
@@ -19,6 +20,7 @@
 #include <windows.h>
 
 #include "FFR.h"
+#include "GpuPassTimer.h"
 #include "alvr_server/openvr_driver_wrap.h"
 #include "d3d-render-utils/RenderPipelineYUV.h"
 #include "shared/d3drender.h"
@@ -54,21 +56,51 @@ public:
         vr::HmdRect2_t projRight,
         vr::HmdMatrix34_t eyeToHeadRight
     );
+    // latePose is a newer HMD pose the layers are rotated to, null to keep the pose of poses[0].
+    // The layers are sampled through the views of their swap textures, which outlive the frame.
     bool RenderFrame(
-        ID3D11Texture2D* pTexture[][2],
+        ID3D11ShaderResourceView* pViews[][2],
         vr::VRTextureBounds_t bounds[][2],
         vr::HmdMatrix34_t poses[],
+        const vr::HmdMatrix34_t* latePose,
+        int layerCount,
+        bool recentering
+    );
+    // Passthrough: copies a single layer straight into target, which has the size and format of
+    // GetTexture, when rendering it would leave it unchanged. That is without recentering, late
+    // latching or any pass after the layers, and with eye crops of exactly the eye size. Returns
+    // false, with nothing written, if the frame has to go through RenderFrame.
+    bool CopyLayer(
+        ID3D11ShaderResourceView* pViews[][2],
+        vr::VRTextureBounds_t bounds[][2],
+        const vr::HmdMatrix34_t* latePose,
         int layerCount,
         bool recentering,
-        const std::string& message,
-        const std::string& debugText
+        ID3D11Texture2D* target
     );
+    // Timestamp of the frame being rendered, stamped into it with photon_marker
+    void SetPhotonMarker(uint64_t targetTimestampNs) { m_markerTimestampNs = targetTimestampNs; }
+    // Times the passes of RenderFrame, within a frame the caller began on the timer
+    void SetPassTimer(std::shared_ptr<GpuPassTimer> passTimer) { m_passTimer = passTimer; }
     void GetEncodingResolution(uint32_t* width, uint32_t* height);
 
     ComPtr<ID3D11Texture2D> GetTexture();
+    // HDR is output as RGB for NVENC to convert instead of NV12/P010, see hdr_nvenc_rgb_input
+    bool OutputsHdrRgb() const { return m_hdrRgbOutput; }
 
 private:
+    DXGI_FORMAT GetCompositionFormat() const;
+    // The source box of an eye of the layer, false if it can't be copied as is
+    bool GetCopyBox(
+        ID3D11ShaderResourceView* view, const vr::VRTextureBounds_t& bound, D3D11_BOX* box
+    );
+    // Clears the cells of the photon marker in the RGB output, before the YUV conversion
+    void StampPhotonMarker();
+    // Recomputes the transforms derived from m_viewProj and m_eyeToHead
+    void UpdateViewTransforms();
+
     std::shared_ptr<CD3DRender> m_pD3DRender;
+    std::shared_ptr<GpuPassTimer> m_passTimer;
     ComPtr<ID3D11Texture2D> m_pStagingTexture;
 
     ComPtr<ID3D11VertexShader> m_pVertexShader;
@@ -97,6 +129,9 @@ private:
 
     vr::HmdRect2_t m_viewProj[2];
     vr::HmdMatrix34_t m_eyeToHead[2];
+    // From the view params: HMD to clip space of each eye, and the corners of the layer quads
+    DirectX::XMFLOAT4X4 m_eyeTransform[2];
+    DirectX::XMFLOAT4 m_quadCorners[2][4];
 
     struct SimpleVertex {
         DirectX::XMFLOAT4 Pos;
@@ -105,6 +140,10 @@ private:
     };
     // Parameter for Draw method. 2-triangles for both eyes.
     static const int VERTEX_INDEX_COUNT = 12;
+    // Vertices of one layer, the quads of both eyes
+    static const int LAYER_VERTEX_COUNT = 8;
+    // Layers of a frame, the submitted ones and the recentering overlay
+    static const int MAX_LAYERS = 11;
 
     std::unique_ptr<d3d_render_utils::RenderPipeline> m_colorCorrectionPipeline;
     bool enableColorCorrection;
@@ -113,6 +152,15 @@ private:
     bool enableFFE;
 
     std::unique_ptr<d3d_render_utils::RenderPipelineYUV> m_yuvPipeline;
+    bool m_hdrRgbOutput = false;
+    // Whether the last frame was copied by CopyLayer, to log the switches
+    bool m_passthrough = false;
+
+    // Null without photon_marker
+    ComPtr<ID3D11RenderTargetView> m_markerTarget;
+    ComPtr<ID3D11DeviceContext1> m_markerContext;
+    uint64_t m_markerTimestampNs = 0;
+    uint32_t m_markerFrame = 0;
 
     static bool SetGpuPriority(ID3D11Device* device) {
         typedef enum _D3DKMT_SCHEDULINGPRIORITYCLASS {
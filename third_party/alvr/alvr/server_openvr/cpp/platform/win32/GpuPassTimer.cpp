@@ -0,0 +1,115 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "GpuPassTimer.h"
+
+#include "alvr_server/GpuPassStats.h"
+#include "alvr_server/Logger.h"
+
+GpuPassTimer::GpuPassTimer(std::shared_ptr<CD3DRender> pD3DRender)
+    : m_pD3DRender(pD3DRender) { }
+
+bool GpuPassTimer::createQueries() {
+    ID3D11Device* device = m_pD3DRender->GetDevice();
+    D3D11_QUERY_DESC disjointDesc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+    D3D11_QUERY_DESC timestampDesc = { D3D11_QUERY_TIMESTAMP, 0 };
+    for (Frame& frame : m_frames) {
+        HRESULT hr = device->CreateQuery(&disjointDesc, &frame.disjoint);
+        for (auto& timestamp : frame.timestamps) {
+            if (SUCCEEDED(hr)) {
+                hr = device->CreateQuery(&timestampDesc, &timestamp);
+            }
+        }
+        if (FAILED(hr)) {
+            Warn("Could not create the GPU timestamp queries, the passes are not timed.\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GpuPassTimer::collect(Frame& frame) {
+    ID3D11DeviceContext* context = m_pD3DRender->GetContext();
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    if (context->GetData(
+            frame.disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH
+        )
+        != S_OK) {
+        return false;
+    }
+    uint64_t timestamps[GPU_PASS_COUNT + 1];
+    for (uint32_t i = 0; i <= frame.passCount; i++) {
+        if (context->GetData(
+                frame.timestamps[i].Get(),
+                &timestamps[i],
+                sizeof(uint64_t),
+                D3D11_ASYNC_GETDATA_DONOTFLUSH
+            )
+            != S_OK) {
+            return false;
+        }
+    }
+    frame.pending = false;
+
+    // The clock changed frequency during the frame, the timestamps can't be compared
+    if (disjoint.Disjoint || disjoint.Frequency == 0) {
+        return true;
+    }
+    for (uint32_t i = 0; i < frame.passCount; i++) {
+        uint64_t ticks = timestamps[i + 1] - timestamps[i];
+        GpuPassRecord(frame.passes[i], ticks * 1'000'000'000 / disjoint.Frequency);
+    }
+    return true;
+}
+
+void GpuPassTimer::BeginFrame() {
+    m_active = nullptr;
+    if (m_failed || !GpuPassStatsEnabled()) {
+        return;
+    }
+    if (!m_created) {
+        m_created = true;
+        m_failed = !createQueries();
+        if (m_failed) {
+            return;
+        }
+    }
+
+    // Oldest first, the ones behind a frame that isn't ready are not ready either
+    for (uint32_t i = 1; i <= FRAMES; i++) {
+        Frame& frame = m_frames[(m_frameIndex + i) % FRAMES];
+        if (frame.pending && !collect(frame)) {
+            break;
+        }
+    }
+
+    m_frameIndex = (m_frameIndex + 1) % FRAMES;
+    Frame& frame = m_frames[m_frameIndex];
+    if (frame.pending) {
+        return;
+    }
+    ID3D11DeviceContext* context = m_pD3DRender->GetContext();
+    context->Begin(frame.disjoint.Get());
+    context->End(frame.timestamps[0].Get());
+    frame.passCount = 0;
+    m_active = &frame;
+}
+
+void GpuPassTimer::Mark(FfiGpuPass pass) {
+    if (!m_active || m_active->passCount == GPU_PASS_COUNT) {
+        return;
+    }
+    Frame& frame = *m_active;
+    frame.passes[frame.passCount] = pass;
+    frame.passCount++;
+    m_pD3DRender->GetContext()->End(frame.timestamps[frame.passCount].Get());
+}
+
+void GpuPassTimer::EndFrame() {
+    if (!m_active) {
+        return;
+    }
+    m_pD3DRender->GetContext()->End(m_active->disjoint.Get());
+    m_active->pending = true;
+    m_active = nullptr;
+}
@@ -0,0 +1,48 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "alvr_server/bindings.h"
+#include "shared/d3drender.h"
+#include <d3d11.h>
+#include <memory>
+#include <stdint.h>
+#include <wrl.h>
+
+// GPU time of the passes of a frame with D3D11 timestamp queries, reported to GpuPassRecord. The
+// queries of a frame are read back FRAMES frames later at most, without flushing or waiting: a
+// frame whose queries aren't ready by the time its slot comes back is not counted.
+class GpuPassTimer {
+public:
+    static const uint32_t FRAMES = 4;
+
+    explicit GpuPassTimer(std::shared_ptr<CD3DRender> pD3DRender);
+
+    // Does nothing until the histograms are read
+    void BeginFrame();
+    // Ends `pass`, which started at the previous mark or at BeginFrame
+    void Mark(FfiGpuPass pass);
+    void EndFrame();
+
+private:
+    struct Frame {
+        Microsoft::WRL::ComPtr<ID3D11Query> disjoint;
+        Microsoft::WRL::ComPtr<ID3D11Query> timestamps[GPU_PASS_COUNT + 1];
+        FfiGpuPass passes[GPU_PASS_COUNT] = {};
+        uint32_t passCount = 0;
+        bool pending = false;
+    };
+
+    bool createQueries();
+    // Returns false if the queries of the frame are not ready yet
+    bool collect(Frame& frame);
+
+    std::shared_ptr<CD3DRender> m_pD3DRender;
+    Frame m_frames[FRAMES];
+    uint32_t m_frameIndex = 0;
+    // The frame being recorded, null between frames or when it is not timed
+    Frame* m_active = nullptr;
+    bool m_created = false;
+    bool m_failed = false;
+};
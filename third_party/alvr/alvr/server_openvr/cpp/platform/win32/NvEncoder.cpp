@@ -459,7 +459,8 @@ void NvEncoder::MapResources(uint32_t bfrIdx)
 {
     NV_ENC_MAP_INPUT_RESOURCE mapInputResource = { NV_ENC_MAP_INPUT_RESOURCE_VER };
 
-    mapInputResource.registeredResource = m_vRegisteredResources[bfrIdx];
+    mapInputResource.registeredResource = m_pNextExternalInput ? m_pNextExternalInput : m_vRegisteredResources[bfrIdx];
+    m_pNextExternalInput = nullptr;
     NVENC_API_CALL(m_nvenc.nvEncMapInputResource(m_hEncoder, &mapInputResource));
     m_vMappedInputBuffers[bfrIdx] = mapInputResource.mappedResource;
 
@@ -496,6 +497,60 @@ void NvEncoder::EncodeFrame(std::vector<std::vector<uint8_t>> &vPacket, NV_ENC_P
     }
 }
 
+void NvEncoder::EncodeFrame(const std::function<void(const uint8_t *pData, uint32_t nSize)> &onPacket, NV_ENC_PIC_PARAMS *pPicParams)
+{
+    if (!IsHWEncoderInitialized())
+    {
+        NVENC_THROW_ERROR("Encoder device not found", NV_ENC_ERR_NO_ENCODE_DEVICE);
+    }
+
+    int bfrIdx = m_iToSend % m_nEncoderBuffer;
+
+    MapResources(bfrIdx);
+
+    NVENCSTATUS nvStatus = DoEncode(m_vMappedInputBuffers[bfrIdx], m_vBitstreamOutputBuffer[bfrIdx], pPicParams);
+
+    if (nvStatus == NV_ENC_SUCCESS || nvStatus == NV_ENC_ERR_NEED_MORE_INPUT)
+    {
+        m_iToSend++;
+        GetEncodedPacket(m_vBitstreamOutputBuffer, [&](const uint8_t *pData, uint32_t nSize, uint64_t) { onPacket(pData, nSize); }, true);
+    }
+    else
+    {
+        NVENC_THROW_ERROR("nvEncEncodePicture API failed", nvStatus);
+    }
+}
+
+void NvEncoder::SubmitFrame(NV_ENC_PIC_PARAMS *pPicParams)
+{
+    if (!IsHWEncoderInitialized())
+    {
+        NVENC_THROW_ERROR("Encoder device not found", NV_ENC_ERR_NO_ENCODE_DEVICE);
+    }
+
+    if (!m_initializeParams.enableEncodeAsync)
+    {
+        NVENC_THROW_ERROR("Frames can only be submitted to an async encoder", NV_ENC_ERR_INVALID_PARAM);
+    }
+
+    int bfrIdx = m_iToSend % m_nEncoderBuffer;
+
+    MapResources(bfrIdx);
+
+    NVENCSTATUS nvStatus = DoEncode(m_vMappedInputBuffers[bfrIdx], m_vBitstreamOutputBuffer[bfrIdx], pPicParams);
+
+    if (nvStatus != NV_ENC_SUCCESS && nvStatus != NV_ENC_ERR_NEED_MORE_INPUT)
+    {
+        NVENC_THROW_ERROR("nvEncEncodePicture API failed", nvStatus);
+    }
+    m_iToSend++;
+}
+
+void NvEncoder::GetSubmittedFrame(const std::function<void(const uint8_t *pData, uint32_t nSize)> &onPacket)
+{
+    GetNextEncodedPacket(m_vBitstreamOutputBuffer, [&](const uint8_t *pData, uint32_t nSize, uint64_t) { onPacket(pData, nSize); });
+}
+
 void NvEncoder::RunMotionEstimation(std::vector<uint8_t> &mvData)
 {
     if (!m_hEncoder)
@@ -584,25 +639,29 @@ void NvEncoder::EndEncode(std::vector<std::vector<uint8_t>> &vPacket)
     GetEncodedPacket(m_vBitstreamOutputBuffer, vPacket, false);
 }
 
+void NvEncoder::EndEncode(const std::function<void(const uint8_t *pData, uint32_t nSize)> &onPacket)
+{
+    if (!IsHWEncoderInitialized())
+    {
+        NVENC_THROW_ERROR("Encoder device not initialized", NV_ENC_ERR_ENCODER_NOT_INITIALIZED);
+    }
+
+    SendEOS();
+
+    GetEncodedPacket(m_vBitstreamOutputBuffer, [&](const uint8_t *pData, uint32_t nSize, uint64_t) { onPacket(pData, nSize); }, false);
+}
+
 void NvEncoder::GetEncodedPacket(std::vector<NV_ENC_OUTPUT_PTR> &vOutputBuffer, std::vector<std::vector<uint8_t>> &vPacket, bool bOutputDelay)
 {
     unsigned i = 0;
-    int iEnd = bOutputDelay ? m_iToSend - m_nOutputDelay : m_iToSend;
-    for (; m_iGot < iEnd; m_iGot++)
-    {
-        WaitForCompletionEvent(m_iGot % m_nEncoderBuffer);
-        NV_ENC_LOCK_BITSTREAM lockBitstreamData = { NV_ENC_LOCK_BITSTREAM_VER };
-        lockBitstreamData.outputBitstream = vOutputBuffer[m_iGot % m_nEncoderBuffer];
-        lockBitstreamData.doNotWait = false;
-        NVENC_API_CALL(m_nvenc.nvEncLockBitstream(m_hEncoder, &lockBitstreamData));
-  
-        uint8_t *pData = (uint8_t *)lockBitstreamData.bitstreamBufferPtr;
+    GetEncodedPacket(vOutputBuffer, [&](const uint8_t *pData, uint32_t nSize, uint64_t nTimestamp)
+    {
         if (vPacket.size() < i + 1)
         {
             vPacket.push_back(std::vector<uint8_t>());
         }
         vPacket[i].clear();
-       
+
         if ((m_initializeParams.encodeGUID == NV_ENC_CODEC_AV1_GUID) && (m_bUseIVFContainer))
         {
             if (m_bWriteIVFFileHeader)
@@ -611,26 +670,57 @@ void NvEncoder::GetEncodedPacket(std::vector<NV_ENC_OUTPUT_PTR> &vOutputBuffer,
                 m_bWriteIVFFileHeader = false;
             }
 
-            m_IVFUtils.WriteFrameHeader(vPacket[i], lockBitstreamData.bitstreamSizeInBytes, lockBitstreamData.outputTimeStamp);
+            m_IVFUtils.WriteFrameHeader(vPacket[i], nSize, nTimestamp);
         }
-        vPacket[i].insert(vPacket[i].end(), &pData[0], &pData[lockBitstreamData.bitstreamSizeInBytes]);
-        
+        vPacket[i].insert(vPacket[i].end(), &pData[0], &pData[nSize]);
+
         i++;
+    }, bOutputDelay);
+}
 
-        NVENC_API_CALL(m_nvenc.nvEncUnlockBitstream(m_hEncoder, lockBitstreamData.outputBitstream));
+void NvEncoder::GetEncodedPacket(std::vector<NV_ENC_OUTPUT_PTR> &vOutputBuffer, const std::function<void(const uint8_t *pData, uint32_t nSize, uint64_t nTimestamp)> &onPacket, bool bOutputDelay)
+{
+    int iEnd = bOutputDelay ? m_iToSend - m_nOutputDelay : m_iToSend;
+    while (m_iGot < iEnd)
+    {
+        GetNextEncodedPacket(vOutputBuffer, onPacket);
+    }
+}
 
-        if (m_vMappedInputBuffers[m_iGot % m_nEncoderBuffer])
-        {
-            NVENC_API_CALL(m_nvenc.nvEncUnmapInputResource(m_hEncoder, m_vMappedInputBuffers[m_iGot % m_nEncoderBuffer]));
-            m_vMappedInputBuffers[m_iGot % m_nEncoderBuffer] = nullptr;
-        }
+void NvEncoder::GetNextEncodedPacket(std::vector<NV_ENC_OUTPUT_PTR> &vOutputBuffer, const std::function<void(const uint8_t *pData, uint32_t nSize, uint64_t nTimestamp)> &onPacket)
+{
+    WaitForCompletionEvent(m_iGot % m_nEncoderBuffer);
+    NV_ENC_LOCK_BITSTREAM lockBitstreamData = { NV_ENC_LOCK_BITSTREAM_VER };
+    lockBitstreamData.outputBitstream = vOutputBuffer[m_iGot % m_nEncoderBuffer];
+    lockBitstreamData.doNotWait = false;
+    NVENC_API_CALL(m_nvenc.nvEncLockBitstream(m_hEncoder, &lockBitstreamData));
 
-        if (m_bMotionEstimationOnly && m_vMappedRefBuffers[m_iGot % m_nEncoderBuffer])
-        {
-            NVENC_API_CALL(m_nvenc.nvEncUnmapInputResource(m_hEncoder, m_vMappedRefBuffers[m_iGot % m_nEncoderBuffer]));
-            m_vMappedRefBuffers[m_iGot % m_nEncoderBuffer] = nullptr;
-        }
+    // Unlock even if the consumer throws, the output buffer would be unusable otherwise
+    try
+    {
+        onPacket((const uint8_t *)lockBitstreamData.bitstreamBufferPtr, lockBitstreamData.bitstreamSizeInBytes, lockBitstreamData.outputTimeStamp);
+    }
+    catch (...)
+    {
+        m_nvenc.nvEncUnlockBitstream(m_hEncoder, lockBitstreamData.outputBitstream);
+        throw;
+    }
+
+    NVENC_API_CALL(m_nvenc.nvEncUnlockBitstream(m_hEncoder, lockBitstreamData.outputBitstream));
+
+    if (m_vMappedInputBuffers[m_iGot % m_nEncoderBuffer])
+    {
+        NVENC_API_CALL(m_nvenc.nvEncUnmapInputResource(m_hEncoder, m_vMappedInputBuffers[m_iGot % m_nEncoderBuffer]));
+        m_vMappedInputBuffers[m_iGot % m_nEncoderBuffer] = nullptr;
+    }
+
+    if (m_bMotionEstimationOnly && m_vMappedRefBuffers[m_iGot % m_nEncoderBuffer])
+    {
+        NVENC_API_CALL(m_nvenc.nvEncUnmapInputResource(m_hEncoder, m_vMappedRefBuffers[m_iGot % m_nEncoderBuffer]));
+        m_vMappedRefBuffers[m_iGot % m_nEncoderBuffer] = nullptr;
     }
+
+    m_iGot++;
 }
 
 bool NvEncoder::Reconfigure(const NV_ENC_RECONFIGURE_PARAMS *pReconfigureParams)
@@ -651,6 +741,11 @@ bool NvEncoder::Reconfigure(const NV_ENC_RECONFIGURE_PARAMS *pReconfigureParams)
     return true;
 }
 
+void NvEncoder::InvalidateRefFrame(uint64_t inputTimeStamp)
+{
+    NVENC_API_CALL(m_nvenc.nvEncInvalidateRefFrames(m_hEncoder, inputTimeStamp));
+}
+
 NV_ENC_REGISTERED_PTR NvEncoder::RegisterResource(void *pBuffer, NV_ENC_INPUT_RESOURCE_TYPE eResourceType,
     int width, int height, int pitch, NV_ENC_BUFFER_FORMAT bufferFormat, NV_ENC_BUFFER_USAGE bufferUsage, 
     NV_ENC_FENCE_POINT_D3D12* pInputFencePoint)
@@ -669,6 +764,13 @@ NV_ENC_REGISTERED_PTR NvEncoder::RegisterResource(void *pBuffer, NV_ENC_INPUT_RE
     return registerResource.registeredResource;
 }
 
+NV_ENC_REGISTERED_PTR NvEncoder::RegisterExternalInput(void *pBuffer, NV_ENC_INPUT_RESOURCE_TYPE eResourceType)
+{
+    NV_ENC_REGISTERED_PTR registeredPtr = RegisterResource(pBuffer, eResourceType, GetMaxEncodeWidth(), GetMaxEncodeHeight(), 0, GetPixelFormat(), NV_ENC_INPUT_IMAGE);
+    m_vExternalInputs.push_back(registeredPtr);
+    return registeredPtr;
+}
+
 void NvEncoder::RegisterInputResources(std::vector<void*> inputframes, NV_ENC_INPUT_RESOURCE_TYPE eResourceType,
                                          int width, int height, int pitch, NV_ENC_BUFFER_FORMAT bufferFormat, bool bReferenceFrame)
 {
@@ -767,6 +869,12 @@ void NvEncoder::UnregisterInputResources()
     }
     m_vRegisteredResourcesForReference.clear();
 
+    for (uint32_t i = 0; i < m_vExternalInputs.size(); ++i)
+    {
+        m_nvenc.nvEncUnregisterResource(m_hEncoder, m_vExternalInputs[i]);
+    }
+    m_vExternalInputs.clear();
+    m_pNextExternalInput = nullptr;
 }
 
 
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <vector>
+#include <functional>
 #include "alvr_server/nvEncodeAPI.h"
 #include <stdint.h>
 #include <mutex>
@@ -112,6 +113,14 @@ public:
     */
     bool Reconfigure(const NV_ENC_RECONFIGURE_PARAMS *pReconfigureParams);
 
+    /**
+    *  @brief  This function is used to invalidate a reference frame.
+    *  The frame is identified by the NV_ENC_PIC_PARAMS::inputTimeStamp it was
+    *  encoded with. The following frames are predicted from the remaining
+    *  valid references.
+    */
+    void InvalidateRefFrame(uint64_t inputTimeStamp);
+
     /**
     *  @brief  This function is used to get the next available input buffer.
     *  Applications must call this function to obtain a pointer to the next
@@ -121,6 +130,19 @@ public:
     const NvEncInputFrame* GetNextInputFrame();
 
 
+    /**
+    *  @brief  This function registers a texture of the application as an input of the size
+    *  and format of the input buffers. It is unregistered with the input buffers.
+    */
+    NV_ENC_REGISTERED_PTR RegisterExternalInput(void *pBuffer, NV_ENC_INPUT_RESOURCE_TYPE eResourceType);
+
+    /**
+    *  @brief  This function makes the next encoded frame read the input registered with
+    *  RegisterExternalInput() instead of the buffer returned by GetNextInputFrame().
+    *  The application must not write the input until that frame is read back.
+    */
+    void SetNextInput(NV_ENC_REGISTERED_PTR registeredInput) { m_pNextExternalInput = registeredInput; }
+
     /**
     *  @brief  This function is used to encode a frame.
     *  Applications must call EncodeFrame() function to encode the uncompressed
@@ -129,6 +151,33 @@ public:
     */
     virtual void EncodeFrame(std::vector<std::vector<uint8_t>> &vPacket, NV_ENC_PIC_PARAMS *pPicParams = nullptr);
 
+    /**
+    *  @brief  This function is used to encode a frame without copying the output.
+    *  onPacket is called with the locked bitstream of every packet that is ready, which is
+    *  unlocked once the call returns. The data is not wrapped in an IVF container.
+    */
+    void EncodeFrame(const std::function<void(const uint8_t *pData, uint32_t nSize)> &onPacket, NV_ENC_PIC_PARAMS *pPicParams = nullptr);
+
+    /**
+    *  @brief  This function is used to submit a frame to an async encoder without waiting
+    *  for its output, which is read back with GetSubmittedFrame(), possibly from another
+    *  thread. The caller must keep at most GetEncoderBufferCount() frames outstanding; the
+    *  input frame and output buffer of a frame are reused once it has been read back.
+    */
+    void SubmitFrame(NV_ENC_PIC_PARAMS *pPicParams = nullptr);
+
+    /**
+    *  @brief  This function waits for the oldest frame passed to SubmitFrame() and hands its
+    *  locked bitstream to onPacket, as in EncodeFrame().
+    */
+    void GetSubmittedFrame(const std::function<void(const uint8_t *pData, uint32_t nSize)> &onPacket);
+
+    /**
+    *  @brief  This function must be called before CreateEncoder() to change the output delay
+    *  set at construction.
+    */
+    void SetExtraOutputDelay(uint32_t nExtraOutputDelay) { m_nExtraOutputDelay = nExtraOutputDelay; }
+
     /**
     *  @brief  This function to flush the encoder queue.
     *  The encoder might be queuing frames for B picture encoding or lookahead;
@@ -138,6 +187,12 @@ public:
     */
     virtual void EndEncode(std::vector<std::vector<uint8_t>> &vPacket);
 
+    /**
+    *  @brief  Same as EndEncode(), with the queued packets passed to onPacket as in
+    *  EncodeFrame().
+    */
+    void EndEncode(const std::function<void(const uint8_t *pData, uint32_t nSize)> &onPacket);
+
     /**
     *  @brief  This function is used to query hardware encoder capabilities.
     *  Applications can call this function to query capabilities like maximum encode
@@ -364,6 +419,18 @@ private:
     */
     void GetEncodedPacket(std::vector<NV_ENC_OUTPUT_PTR> &vOutputBuffer, std::vector<std::vector<uint8_t>> &vPacket, bool bOutputDelay);
 
+    /**
+    *  @brief Same as above, with the locked bitstreams passed to onPacket instead of being
+    *         copied. onPacket gets the lock timestamp as well.
+    */
+    void GetEncodedPacket(std::vector<NV_ENC_OUTPUT_PTR> &vOutputBuffer, const std::function<void(const uint8_t *pData, uint32_t nSize, uint64_t nTimestamp)> &onPacket, bool bOutputDelay);
+
+    /**
+    *  @brief This is a private function which waits for the output of frame m_iGot, passes
+    *         it to onPacket and releases its buffers.
+    */
+    void GetNextEncodedPacket(std::vector<NV_ENC_OUTPUT_PTR> &vOutputBuffer, const std::function<void(const uint8_t *pData, uint32_t nSize, uint64_t nTimestamp)> &onPacket);
+
     /**
     *  @brief This is a private function which is used to initialize the bitstream buffers.
     *  This is only used in the encoding mode.
@@ -422,6 +489,8 @@ protected:
     std::vector<NV_ENC_REGISTERED_PTR> m_vRegisteredResources;
     std::vector<NvEncInputFrame> m_vReferenceFrames;
     std::vector<NV_ENC_REGISTERED_PTR> m_vRegisteredResourcesForReference;
+    std::vector<NV_ENC_REGISTERED_PTR> m_vExternalInputs;
+    NV_ENC_REGISTERED_PTR m_pNextExternalInput = nullptr;
     std::vector<NV_ENC_INPUT_PTR> m_vMappedInputBuffers;
     std::vector<NV_ENC_INPUT_PTR> m_vMappedRefBuffers;
     std::vector<void *> m_vpCompletionEvent;
@@ -21,6 +21,11 @@
 #include <d3d11.h>
 #include "NvEncoder.h"
 
+/**
+*  @brief  Returns the DXGI format of the input textures for an NVENC buffer format.
+*/
+DXGI_FORMAT GetD3D11Format(NV_ENC_BUFFER_FORMAT eBufferFormat);
+
 class NvEncoderD3D11 : public NvEncoder
 {
 public:
@@ -2,13 +2,29 @@
 // Original copyright preserved
 
 #include "OvrDirectModeComponent.h"
+#include "alvr_server/FrameTrace.h"
+#include "alvr_server/RenderTargetScale.h"
+#include "alvr_server/TraceEvents.h"
+#include <thread>
+
+namespace {
+// Kernel handles are multiples of 4, the low bits carry no information
+size_t HashHandle(HANDLE handle, size_t mask) {
+    uint64_t h = (uint64_t)(uintptr_t)handle >> 2;
+    return (size_t)((h * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+} // namespace
 
 OvrDirectModeComponent::OvrDirectModeComponent(
     std::shared_ptr<CD3DRender> pD3DRender, std::shared_ptr<PoseHistory> poseHistory
 )
     : m_pD3DRender(pD3DRender)
     , m_poseHistory(poseHistory)
-    , m_submitLayer(0) { }
+    , m_submitLayer(0)
+    , m_targetTimestampNs(0)
+    , m_prevTargetTimestampNs(0) {
+    RebuildHandles(INITIAL_HANDLE_SLOTS);
+}
 
 void OvrDirectModeComponent::SetEncoder(std::shared_ptr<CEncoder> pEncoder) {
     m_pEncoder = pEncoder;
@@ -59,6 +75,7 @@ void OvrDirectModeComponent::CreateSwapTextureSet(
     ProcessResource* processResource = new ProcessResource();
     processResource->pid = unPid;
 
+    int created = 0;
     for (int i = 0; i < 3; i++) {
         HRESULT hr = m_pD3DRender->GetDevice()->CreateTexture2D(
             &SharedTextureDesc, NULL, &processResource->textures[i]
@@ -91,18 +108,43 @@ void OvrDirectModeComponent::CreateSwapTextureSet(
         // LogDriver("GetSharedHandle %p res:%d %s", processResource->sharedHandles[i], hr,
         // GetDxErrorStr(hr).c_str());
 
-        m_handleMap.insert(
-            std::make_pair(processResource->sharedHandles[i], std::make_pair(processResource, i))
-        );
+        // Created once for the life of the set, not for every frame the texture is submitted in
+        if (SharedTextureDesc.BindFlags & D3D11_BIND_SHADER_RESOURCE) {
+            D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
+            SRVDesc.Format = format;
+            SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+            SRVDesc.Texture2D.MostDetailedMip = 0;
+            SRVDesc.Texture2D.MipLevels = 1;
+            hr = m_pD3DRender->GetDevice()->CreateShaderResourceView(
+                processResource->textures[i].Get(), &SRVDesc, &processResource->views[i]
+            );
+            if (FAILED(hr)) {
+                Error(
+                    "CreateSwapTextureSet CreateShaderResourceView %p %ls",
+                    hr,
+                    GetErrorStr(hr).c_str()
+                );
+                delete processResource;
+                pResource->Release();
+                break;
+            }
+        }
 
         pOutSwapTextureSet->rSharedTextureHandles[i]
             = (vr::SharedTextureHandle_t)processResource->sharedHandles[i];
 
         pResource->Release();
+        created++;
 
         Debug("Created Texture %d %p", i, processResource->sharedHandles[i]);
     }
-    // m_processMap.insert(std::pair<uint32_t, ProcessResource *>(unPid, processResource));
+
+    // The failure paths above already deleted the resource, none of its handles may be looked up
+    if (created == 3) {
+        for (int i = 0; i < 3; i++) {
+            InsertHandle(processResource->sharedHandles[i], processResource, i);
+        }
+    }
 }
 
 /** Used to textures created using CreateSwapTextureSet.  Only one of the set's handles needs to be
@@ -110,14 +152,10 @@ void OvrDirectModeComponent::CreateSwapTextureSet(
 void OvrDirectModeComponent::DestroySwapTextureSet(vr::SharedTextureHandle_t sharedTextureHandle) {
     Debug("OvrDirectModeComponent::DestroySwapTextureSet %p", sharedTextureHandle);
 
-    auto it = m_handleMap.find((HANDLE)sharedTextureHandle);
-    if (it != m_handleMap.end()) {
+    HandleSlot* slot = FindHandle((HANDLE)sharedTextureHandle);
+    if (slot) {
         // Release all reference (a bit forcible)
-        ProcessResource* p = it->second.first;
-        m_handleMap.erase(p->sharedHandles[0]);
-        m_handleMap.erase(p->sharedHandles[1]);
-        m_handleMap.erase(p->sharedHandles[2]);
-        delete p;
+        DestroyResource(slot->resource);
     } else {
         Debug("Requested to destroy not managing texture. handle:%p", sharedTextureHandle);
     }
@@ -127,18 +165,90 @@ void OvrDirectModeComponent::DestroySwapTextureSet(vr::SharedTextureHandle_t sha
 void OvrDirectModeComponent::DestroyAllSwapTextureSets(uint32_t unPid) {
     Debug("OvrDirectModeComponent::DestroyAllSwapTextureSets pid=%d", unPid);
 
-    for (auto it = m_handleMap.begin(); it != m_handleMap.end();) {
-        if (it->second.first->pid == unPid) {
-            if (it->second.second == 0) {
-                delete it->second.first;
-            }
-            m_handleMap.erase(it++);
-        } else {
-            ++it;
+    // Each set is visited through its first texture only, DestroyResource erases the other two
+    for (size_t i = 0; i < m_handleSlots.size(); i++) {
+        HandleSlot& slot = m_handleSlots[i];
+        if (slot.resource && slot.index == 0 && slot.resource->pid == unPid) {
+            DestroyResource(slot.resource);
+        }
+    }
+}
+
+OvrDirectModeComponent::HandleSlot* OvrDirectModeComponent::FindHandle(HANDLE handle) {
+    if (!handle) {
+        return nullptr;
+    }
+    size_t mask = m_handleSlots.size() - 1;
+    for (size_t i = HashHandle(handle, mask);; i = (i + 1) & mask) {
+        HandleSlot& slot = m_handleSlots[i];
+        if (!slot.handle) {
+            return nullptr;
+        }
+        if (slot.handle == handle && slot.resource) {
+            return &slot;
+        }
+    }
+}
+
+void OvrDirectModeComponent::InsertHandle(HANDLE handle, ProcessResource* resource, int index) {
+    // Keep at least half of the slots empty so a miss ends quickly
+    if ((m_handleSlotsUsed + 1) * 2 > m_handleSlots.size()) {
+        size_t live = 0;
+        for (const HandleSlot& slot : m_handleSlots) {
+            live += slot.resource ? 1 : 0;
+        }
+        size_t capacity = m_handleSlots.size();
+        while ((live + 1) * 4 > capacity) {
+            capacity *= 2;
+        }
+        RebuildHandles(capacity);
+    }
+
+    size_t mask = m_handleSlots.size() - 1;
+    for (size_t i = HashHandle(handle, mask);; i = (i + 1) & mask) {
+        HandleSlot& slot = m_handleSlots[i];
+        // Tombstones are not reused, the same handle could still be live further down the probe
+        // sequence. Handles are unique among live textures.
+        if (!slot.handle) {
+            slot = { handle,
+                     resource,
+                     resource->textures[index].Get(),
+                     resource->views[index].Get(),
+                     index };
+            m_handleSlotsUsed++;
+            return;
+        }
+    }
+}
+
+void OvrDirectModeComponent::EraseHandle(HANDLE handle) {
+    HandleSlot* slot = FindHandle(handle);
+    if (slot) {
+        slot->resource = nullptr;
+        slot->texture = nullptr;
+        slot->view = nullptr;
+    }
+}
+
+void OvrDirectModeComponent::RebuildHandles(size_t capacity) {
+    std::vector<HandleSlot> slots(capacity, HandleSlot {});
+    m_handleSlots.swap(slots);
+    m_handleSlotsUsed = 0;
+
+    for (const HandleSlot& slot : slots) {
+        if (slot.resource) {
+            InsertHandle(slot.handle, slot.resource, slot.index);
         }
     }
 }
 
+void OvrDirectModeComponent::DestroyResource(ProcessResource* resource) {
+    EraseHandle(resource->sharedHandles[0]);
+    EraseHandle(resource->sharedHandles[1]);
+    EraseHandle(resource->sharedHandles[2]);
+    delete resource;
+}
+
 /** After Present returns, calls this to get the next index to use for rendering. */
 void OvrDirectModeComponent::GetNextSwapTextureSetIndex(
     vr::SharedTextureHandle_t sharedTextureHandles[2], uint32_t (*pIndices)[2]
@@ -157,13 +267,13 @@ void OvrDirectModeComponent::GetNextSwapTextureSetIndex(
 void OvrDirectModeComponent::SubmitLayer(const SubmitLayerPerEye_t (&perEye)[2]) {
     Debug("OvrDirectModeComponent::SubmitLayer");
 
-    m_presentMutex.lock();
-
     // mHmdPose is the same pose for both eyes, getting the eye view pose
     //  requires some records keeping, unfortunately (m_eyeToHead)
     auto pPose = &perEye[0].mHmdPose;
 
     if (m_submitLayer == 0) {
+        uint64_t receiveNs = FrameTraceNow();
+
         // Detect FrameIndex of submitted frame by pPose.
         // This is important part to achieve smooth headtracking.
         // We search for history of TrackingInfo and find the TrackingInfo which have nearest matrix
@@ -174,6 +284,8 @@ void OvrDirectModeComponent::SubmitLayer(const SubmitLayerPerEye_t (&perEye)[2])
             // found the frameIndex
             m_prevTargetTimestampNs = m_targetTimestampNs;
             m_targetTimestampNs = pose->targetTimestampNs;
+            FrameTraceMark(m_targetTimestampNs, FRAME_TRACE_IPC_RECEIVE, receiveNs);
+            FrameTraceMark(m_targetTimestampNs, FRAME_TRACE_POSE_MATCH);
 
             m_prevFramePoseRotation = m_framePoseRotation;
             m_framePoseRotation.x = pose->motion.pose.orientation.x;
@@ -194,17 +306,15 @@ void OvrDirectModeComponent::SubmitLayer(const SubmitLayerPerEye_t (&perEye)[2])
     }
 
     // CopyTexture();
-
-    m_presentMutex.unlock();
 }
 
 /** Submits queued layers for display. */
 void OvrDirectModeComponent::Present(vr::SharedTextureHandle_t syncTexture) {
+    ALVR_TRACE_SCOPE("Present");
     Debug("OvrDirectModeComponent::Present");
 
-    m_presentMutex.lock();
-
     ReportPresent(m_targetTimestampNs, 0);
+    ReportGameFrame(m_prevTargetTimestampNs == m_targetTimestampNs);
 
     bool useMutex = true;
 
@@ -218,10 +328,18 @@ void OvrDirectModeComponent::Present(vr::SharedTextureHandle_t syncTexture) {
         // return;
     }
 
-    ID3D11Texture2D* pSyncTexture = m_pD3DRender->GetSharedTexture((HANDLE)syncTexture);
-    if (!pSyncTexture) {
+    if ((HANDLE)syncTexture != m_syncTextureHandle || !m_pSyncTexture) {
+        m_syncKeyedMutex.Reset();
+        m_pSyncTexture = m_pD3DRender->GetSharedTexture((HANDLE)syncTexture);
+        m_syncTextureHandle = (HANDLE)syncTexture;
+        if (m_pSyncTexture) {
+            m_pSyncTexture->QueryInterface(
+                __uuidof(IDXGIKeyedMutex), (void**)m_syncKeyedMutex.GetAddressOf()
+            );
+        }
+    }
+    if (!m_pSyncTexture) {
         Warn("[VDispDvr] SyncTexture is NULL!");
-        m_presentMutex.unlock();
         return;
     }
 
@@ -229,16 +347,14 @@ void OvrDirectModeComponent::Present(vr::SharedTextureHandle_t syncTexture) {
         // Access to shared texture must be wrapped in AcquireSync/ReleaseSync
         // to ensure the compositor has finished rendering to it before it gets used.
         // This enforces scheduling of work on the gpu between processes.
-        if (SUCCEEDED(pSyncTexture->QueryInterface(__uuidof(IDXGIKeyedMutex), (void**)&pKeyedMutex)
-            )) {
+        pKeyedMutex = m_syncKeyedMutex.Get();
+        if (pKeyedMutex) {
             // TODO: Reasonable timeout and timeout handling
             HRESULT hr = pKeyedMutex->AcquireSync(0, 10);
             if (hr != S_OK) {
                 Debug(
                     "[VDispDvr] ACQUIRESYNC FAILED!!! hr=%d %p %ls", hr, hr, GetErrorStr(hr).c_str()
                 );
-                pKeyedMutex->Release();
-                m_presentMutex.unlock();
                 return;
             }
         }
@@ -249,7 +365,6 @@ void OvrDirectModeComponent::Present(vr::SharedTextureHandle_t syncTexture) {
     if (useMutex) {
         if (pKeyedMutex) {
             pKeyedMutex->ReleaseSync(0);
-            pKeyedMutex->Release();
         }
     }
 
@@ -258,8 +373,6 @@ void OvrDirectModeComponent::Present(vr::SharedTextureHandle_t syncTexture) {
     if (m_pEncoder) {
         m_pEncoder->NewFrameReady();
     }
-
-    m_presentMutex.unlock();
 }
 
 void OvrDirectModeComponent::PostPresent() {
@@ -272,16 +385,18 @@ void OvrDirectModeComponent::CopyTexture(uint32_t layerCount) {
 
     uint64_t presentationTime = GetTimestampUs();
 
-    ID3D11Texture2D* pTexture[MAX_LAYERS][2];
-    ComPtr<ID3D11Texture2D> Texture[MAX_LAYERS][2];
+    ID3D11ShaderResourceView* pViews[MAX_LAYERS][2];
     vr::VRTextureBounds_t bounds[MAX_LAYERS][2];
     vr::HmdMatrix34_t poses[MAX_LAYERS];
 
     for (uint32_t i = 0; i < layerCount; i++) {
+        pViews[i][0] = nullptr;
+        pViews[i][1] = nullptr;
+
         // Find left eye texture.
         HANDLE leftEyeTexture = (HANDLE)m_submitLayers[i][0].hTexture;
-        auto it = m_handleMap.find(leftEyeTexture);
-        if (it == m_handleMap.end()) {
+        const HandleSlot* left = FindHandle(leftEyeTexture);
+        if (!left) {
             // Ignore this layer.
             Debug(
                 "Submitted texture is not found on HandleMap. eye=right layer=%d/%d Texture "
@@ -291,14 +406,10 @@ void OvrDirectModeComponent::CopyTexture(uint32_t layerCount) {
                 leftEyeTexture
             );
         } else {
-            Texture[i][0] = it->second.first->textures[it->second.second];
-            D3D11_TEXTURE2D_DESC desc;
-            Texture[i][0]->GetDesc(&desc);
-
             // Find right eye texture.
             HANDLE rightEyeTexture = (HANDLE)m_submitLayers[i][1].hTexture;
-            it = m_handleMap.find(rightEyeTexture);
-            if (it == m_handleMap.end()) {
+            const HandleSlot* right = FindHandle(rightEyeTexture);
+            if (!right) {
                 // Ignore this layer
                 Debug(
                     "Submitted texture is not found on HandleMap. eye=left layer=%d/%d Texture "
@@ -307,14 +418,13 @@ void OvrDirectModeComponent::CopyTexture(uint32_t layerCount) {
                     layerCount,
                     rightEyeTexture
                 );
-                Texture[i][0].Reset();
             } else {
-                Texture[i][1] = it->second.first->textures[it->second.second];
+                // The sets are destroyed from this same thread, the textures outlive the frame
+                pViews[i][0] = left->view;
+                pViews[i][1] = right->view;
             }
         }
 
-        pTexture[i][0] = Texture[i][0].Get();
-        pTexture[i][1] = Texture[i][1].Get();
         bounds[i][0] = m_submitLayers[i][0].bounds;
         bounds[i][1] = m_submitLayers[i][1].bounds;
         poses[i] = m_submitLayers[i][0].mHmdPose;
@@ -324,25 +434,50 @@ void OvrDirectModeComponent::CopyTexture(uint32_t layerCount) {
     m_pD3DRender->GetContext()->Flush();
 
     if (m_pEncoder) {
-        // Wait for the encoder to be ready.  This is important because the encoder thread
-        // blocks on transmit which uses our shared d3d context (which is not thread safe).
-        m_pEncoder->WaitForEncode();
-
-        std::string debugText;
-
+        // The encoder keeps its own copies of the composed frames, this one can be rendered while
+        // the previous one is still being encoded
         uint64_t submitFrameIndex = m_targetTimestampNs;
 
+        // Late latching: reproject to the newest pose received while the game was rendering. The
+        // client has to know the rotation the frame was corrected by, or its ATW would apply it
+        // twice.
+        vr::HmdMatrix34_t latePose;
+        bool lateLatch = false;
+        if (Settings::Instance().Live()->m_lateLatchReprojection && ReportReprojection
+            && m_targetTimestampNs != 0) {
+            // Composed as late as the encode and network times allow, for a newer pose
+            if (Settings::Instance().m_jitComposition) {
+                uint64_t delayNs = m_pEncoder->GetComposeDelayNs(m_targetTimestampNs);
+                if (delayNs > 0) {
+                    ALVR_TRACE_SCOPE("ComposeDelay");
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(delayNs));
+                }
+            }
+            auto latest = m_poseHistory->GetLatestPose();
+            if (latest && latest->targetTimestampNs > m_targetTimestampNs) {
+                FfiQuat frameOrientation = { (float)m_framePoseRotation.x,
+                                             (float)m_framePoseRotation.y,
+                                             (float)m_framePoseRotation.z,
+                                             (float)m_framePoseRotation.w };
+                latePose = latest->rotationMatrix;
+                lateLatch = true;
+                ReportReprojection(
+                    m_targetTimestampNs,
+                    QuatDelta(frameOrientation, latest->motion.pose.orientation)
+                );
+            }
+        }
+
         // Copy entire texture to staging so we can read the pixels to send to remote device.
         m_pEncoder->CopyToStaging(
-            pTexture,
+            pViews,
             bounds,
             poses,
             layerCount,
             false,
             presentationTime,
             submitFrameIndex,
-            "",
-            debugText
+            lateLatch ? &latePose : nullptr
         );
 
         m_pD3DRender->GetContext()->Flush();
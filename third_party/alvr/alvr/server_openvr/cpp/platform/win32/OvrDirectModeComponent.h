@@ -9,7 +9,7 @@
 
 #include "alvr_server/Settings.h"
 
-#include <mutex>
+#include <vector>
 
 class OvrDirectModeComponent : public vr::IVRDriverDirectModeComponent {
 public:
@@ -61,11 +61,42 @@ private:
     // Resource for each process
     struct ProcessResource {
         ComPtr<ID3D11Texture2D> textures[3];
+        // Views the layers are composed from, null for depth textures
+        ComPtr<ID3D11ShaderResourceView> views[3];
         HANDLE sharedHandles[3];
         uint32_t pid;
     };
-    std::map<HANDLE, std::pair<ProcessResource*, int>> m_handleMap;
 
+    // Open-addressed table from the shared handles of the swap texture sets to their textures,
+    // looked up for both eyes of every layer of every frame. Linear probing, erased slots become
+    // tombstones so the probe sequences stay intact until the table is rebuilt.
+    struct HandleSlot {
+        HANDLE handle; // null if the slot was never used
+        ProcessResource* resource; // null for a tombstone
+        ID3D11Texture2D* texture; // owned by resource
+        ID3D11ShaderResourceView* view; // owned by resource
+        int index;
+    };
+    static const size_t INITIAL_HANDLE_SLOTS = 64;
+
+    HandleSlot* FindHandle(HANDLE handle);
+    void InsertHandle(HANDLE handle, ProcessResource* resource, int index);
+    void EraseHandle(HANDLE handle);
+    void RebuildHandles(size_t capacity);
+    void DestroyResource(ProcessResource* resource);
+
+    std::vector<HandleSlot> m_handleSlots;
+    // Live entries and tombstones, the probe sequences get long as it approaches the capacity
+    size_t m_handleSlotsUsed = 0;
+
+    // SteamVR presents with the same sync texture every frame, CD3DRender::GetSharedTexture
+    // searches its cache linearly and the keyed mutex would be queried again each time
+    HANDLE m_syncTextureHandle = nullptr;
+    ID3D11Texture2D* m_pSyncTexture = nullptr; // owned by the CD3DRender cache
+    ComPtr<IDXGIKeyedMutex> m_syncKeyedMutex;
+
+    // SubmitLayer, Present and PostPresent are called in sequence from the compositor's present
+    // thread, the layers of a frame need no lock between them
     static const int MAX_LAYERS = 10;
     int m_submitLayer;
     SubmitLayerPerEye_t m_submitLayers[MAX_LAYERS][2];
@@ -73,6 +104,4 @@ private:
     vr::HmdQuaternion_t m_framePoseRotation;
     uint64_t m_targetTimestampNs;
     uint64_t m_prevTargetTimestampNs;
-
-    std::mutex m_presentMutex;
 };
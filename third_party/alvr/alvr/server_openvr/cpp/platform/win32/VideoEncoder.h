@@ -4,6 +4,7 @@
 #pragma once
 
 #include "NvEncoderD3D11.h"
+#include "alvr_server/BitrateCalibration.h"
 #include "shared/d3drender.h"
 #include <functional>
 #include <memory>
@@ -19,4 +20,48 @@ public:
         uint64_t targetTimestampNs,
         bool insertIDR
     ) = 0;
+
+    // Input surfaces registered by the encoder itself, for CEncoder to use as its frame slots.
+    // desc has the size and format of the frames, the surfaces are copy compatible with it and
+    // stay owned by the encoder. Transmit then encodes a surface in place instead of copying it
+    // into an input of its own. Returns false if the encoder can't, the slots are then CEncoder's.
+    virtual bool CreateInputSurfaces(
+        const D3D11_TEXTURE2D_DESC& desc, uint32_t count, ID3D11Texture2D* surfaces[]
+    ) {
+        return false;
+    }
+
+    // Whether loss recovery can use InsertIntraRefresh instead of an IDR, once initialized
+    virtual bool SupportsIntraRefresh() { return false; }
+    // Starts an intra refresh wave with the next transmitted frame. Encoders that refresh
+    // continuously have nothing to do.
+    virtual void InsertIntraRefresh() { }
+
+    // Whether loss recovery can use InvalidateFrames instead of an IDR, once initialized
+    virtual bool SupportsRefInvalidation() { return false; }
+    // Stops the next transmitted frames from referencing the frames from firstTs on. Returns false
+    // if no older reference is left, the loss then needs a recovery.
+    virtual bool InvalidateFrames(uint64_t firstTs) { return false; }
+
+    // Whether loss recovery can use RecoverWithLtr instead of an IDR, once initialized
+    virtual bool SupportsLtrRecovery() { return false; }
+    // Predicts the next transmitted frame from the newest acknowledged long-term reference.
+    // Returns false if there is none.
+    virtual bool RecoverWithLtr() { return false; }
+    // The client decoded this frame, may be called from any thread
+    virtual void AcknowledgeFrame(uint64_t targetTimestampNs) { }
+
+    // Moves the preset one step towards quality for a positive step, towards speed otherwise,
+    // from the next transmitted frame on. Returns false if there is no preset in that direction.
+    virtual bool StepQualityPreset(int step) { return false; }
+
+    // Whether the bitrate follows SetBitrateCalibration, the others only take the requested one
+    virtual bool SupportsBitrateCalibration() { return false; }
+    // Set once initialized, before the first transmitted frame
+    void SetBitrateCalibration(std::shared_ptr<BitrateCalibration> calibration) {
+        m_bitrateCalibration = calibration;
+    }
+
+protected:
+    std::shared_ptr<BitrateCalibration> m_bitrateCalibration;
 };
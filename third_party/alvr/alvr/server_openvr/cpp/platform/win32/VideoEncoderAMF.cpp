@@ -3,8 +3,14 @@
 
 #include "VideoEncoderAMF.h"
 
+#include "alvr_server/EncoderRoi.h"
+#include "alvr_server/FrameBudget.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
+#include "alvr_server/ThreadProfiles.h"
+#include "alvr_server/VideoBufferLease.h"
+#include <algorithm>
+#include <chrono>
 
 #define AMF_THROW_IF(expr)                                                                         \
     {                                                                                              \
@@ -17,51 +23,118 @@
 const wchar_t* VideoEncoderAMF::START_TIME_PROPERTY = L"StartTimeProperty";
 const wchar_t* VideoEncoderAMF::FRAME_INDEX_PROPERTY = L"FrameIndexProperty";
 
+namespace {
+// Weight of a frame in the repeated frame ratio. Interpolation starts once about every other frame
+// is a repeat, and stops once the game is back to nearly full rate.
+const double FRC_AVERAGE_WEIGHT = 0.05;
+const double FRC_START_RATIO = 0.4;
+const double FRC_STOP_RATIO = 0.15;
+// AMF timestamps are in 100 ns units
+const uint64_t AMF_PTS_NS = 100;
+}
+
 AMFPipe::AMFPipe(amf::AMFComponentPtr src, AMFDataReceiver receiver)
     : m_amfComponentSrc(src)
     , m_receiver(receiver) { }
 
 AMFPipe::~AMFPipe() {
+    Stop();
     Debug("AMFPipe::~AMFPipe()  m_amfComponentSrc->Drain\n");
     m_amfComponentSrc->Drain();
 }
 
-void AMFPipe::doPassthrough(bool hasQueryTimeout, uint32_t timerResolution) {
-    amf::AMFDataPtr data = nullptr;
-    if (hasQueryTimeout) {
-        AMF_RESULT res = m_amfComponentSrc->QueryOutput(&data);
-        if (res == AMF_OK && data) {
-            m_receiver(data);
-        } else {
-            Debug("Failed to get AMF component data. Last status: %d.\n", res);
-        }
-    } else {
-        uint16_t timeout = 1000; // 1s timeout
-        AMF_RESULT res = m_amfComponentSrc->QueryOutput(&data);
+void AMFPipe::Start() { m_thread = std::thread(&AMFPipe::ReceiveLoop, this); }
+
+void AMFPipe::Stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void AMFPipe::OnInputSubmitted() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending++;
+    }
+    m_cv.notify_all();
+}
+
+void AMFPipe::WaitIdle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [&] { return m_stop || m_pending == 0; });
+}
 
-        timeBeginPeriod(timerResolution);
-        while (!data && --timeout != 0) {
-            amf_sleep(1);
-            res = m_amfComponentSrc->QueryOutput(&data);
+void AMFPipe::OnInputCompleted() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending--;
+    }
+    m_cv.notify_all();
+}
+
+void AMFPipe::ReceiveLoop() {
+    ApplyThreadProfile(EncoderThreadProfile());
+
+    // Same limit as the query timeout, an input without output by then is given up on
+    const auto outputTimeout = std::chrono::seconds(1);
+    auto waitStart = std::chrono::steady_clock::now();
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_pending == 0) {
+                m_cv.wait(lock, [&] { return m_stop || m_pending > 0; });
+                waitStart = std::chrono::steady_clock::now();
+            }
+            if (m_stop) {
+                break;
+            }
         }
-        timeEndPeriod(timerResolution);
 
-        if (data) {
-            m_receiver(data);
-        } else {
+        amf::AMFDataPtr data = nullptr;
+        AMF_RESULT res = m_amfComponentSrc->QueryOutput(&data);
+        if (res == AMF_OK && data) {
+            if (m_receiver(data)) {
+                OnInputCompleted();
+            }
+            waitStart = std::chrono::steady_clock::now();
+        } else if (std::chrono::steady_clock::now() - waitStart > outputTimeout) {
             Debug("Failed to get AMF component data. Last status: %d.\n", res);
+            OnInputCompleted();
+            waitStart = std::chrono::steady_clock::now();
+        } else {
+            // With a query timeout this only happens once it expired, otherwise the output is
+            // not ready yet
+            std::this_thread::yield();
         }
     }
 }
 
-AMFSolidPipe::AMFSolidPipe(amf::AMFComponentPtr src, amf::AMFComponentPtr dst)
+AMFSolidPipe::AMFSolidPipe(
+    amf::AMFComponentPtr src, amf::AMFComponentPtr dst, AMFDataFilter filter
+)
     : AMFPipe(src, std::bind(&AMFSolidPipe::Passthrough, this, std::placeholders::_1))
-    , m_amfComponentDst(dst) { }
-
-void AMFSolidPipe::Passthrough(AMFDataPtr data) {
+    , m_amfComponentDst(dst)
+    , m_filter(filter) { }
+
+bool AMFSolidPipe::Passthrough(AMFDataPtr data) {
+    // Converters and the preprocessor produce one output per input
+    bool completesInput = m_filter ? m_filter(data) : true;
+    if (!data) {
+        return completesInput;
+    }
     auto res = m_amfComponentDst->SubmitInput(data);
     switch (res) {
     case AMF_OK:
+        if (m_next) {
+            m_next->OnInputSubmitted();
+        }
         break;
     case AMF_INPUT_FULL:
         Debug("m_amfComponentDst->SubmitInput returns AMF_INPUT_FULL.\n");
@@ -73,25 +146,42 @@ void AMFSolidPipe::Passthrough(AMFDataPtr data) {
         Debug("m_amfComponentDst->SubmitInput returns code %d.\n", res);
         break;
     }
+    return completesInput;
 }
 
 AMFPipeline::AMFPipeline()
-    : m_pipes() {
-    TIMECAPS tc;
-    m_timerResolution = timeGetDevCaps(&tc, sizeof(tc)) == TIMERR_NOERROR ? tc.wPeriodMin : 1;
-}
+    : m_pipes() { }
 
 AMFPipeline::~AMFPipeline() {
+    // All the threads are stopped before any component gets drained
+    for (auto& pipe : m_pipes) {
+        pipe->Stop();
+    }
     for (auto& pipe : m_pipes) {
         delete pipe;
     }
 }
 
-void AMFPipeline::Connect(AMFPipePtr pipe) { m_pipes.emplace_back(pipe); }
+void AMFPipeline::Connect(AMFPipePtr pipe) {
+    if (!m_pipes.empty()) {
+        m_pipes.back()->m_next = pipe;
+    }
+    m_pipes.emplace_back(pipe);
+}
 
-void AMFPipeline::Run(bool hasQueryTimeout) {
+void AMFPipeline::Start() {
     for (auto& pipe : m_pipes) {
-        pipe->doPassthrough(hasQueryTimeout, m_timerResolution);
+        pipe->Start();
+    }
+}
+
+void AMFPipeline::OnInputSubmitted() { m_pipes.front()->OnInputSubmitted(); }
+
+void AMFPipeline::WaitIdle() {
+    // A pipe counts its output as submitted to the next one before completing its own input, so
+    // in order no frame is missed
+    for (auto& pipe : m_pipes) {
+        pipe->WaitIdle();
     }
 }
 
@@ -108,10 +198,18 @@ VideoEncoderAMF::VideoEncoderAMF(std::shared_ptr<CD3DRender> d3dRender, int widt
     , m_bitrateInMBits(30)
     , m_surfaceFormat(amf::AMF_SURFACE_RGBA)
     , m_use10bit(Settings::Instance().m_use10bitEncoder)
-    , m_hasQueryTimeout(false) {
+    , m_hasQueryTimeout(false)
+    , m_hasRoi(false)
+    , m_intraRefresh(false)
+    , m_qualityPreset(std::min<uint32_t>(Settings::Instance().m_encoderQualityPreset, ALVR_SPEED))
+    , m_resolutionLadder(width, height) {
     if (Settings::Instance().m_enableHdr) {
         // Bypass preprocessor and converters for HDR, since it will already be YUV
         m_surfaceFormat = m_use10bit ? amf::AMF_SURFACE_P010 : amf::AMF_SURFACE_NV12;
+        if (m_resolutionLadder.IsEnabled()) {
+            Warn("Dynamic resolution is not supported with HDR.\n");
+            m_resolutionLadder.Disable();
+        }
     }
 }
 
@@ -200,29 +298,13 @@ amf::AMFComponentPtr VideoEncoderAMF::MakeEncoder(
         amfEncoder->SetProperty(AMF_VIDEO_ENCODER_FRAMERATE, ::AMFConstructRate(frameRateIn, 1));
         amfEncoder->SetProperty(AMF_VIDEO_ENCODER_B_PIC_PATTERN, 0);
 
-        switch (Settings::Instance().m_encoderQualityPreset) {
-        case ALVR_QUALITY:
-            amfEncoder->SetProperty(
-                AMF_VIDEO_ENCODER_QUALITY_PRESET, AMF_VIDEO_ENCODER_QUALITY_PRESET_QUALITY
-            );
-            break;
-        case ALVR_BALANCED:
-            amfEncoder->SetProperty(
-                AMF_VIDEO_ENCODER_QUALITY_PRESET, AMF_VIDEO_ENCODER_QUALITY_PRESET_BALANCED
-            );
-            break;
-        case ALVR_SPEED:
-        default:
-            amfEncoder->SetProperty(
-                AMF_VIDEO_ENCODER_QUALITY_PRESET, AMF_VIDEO_ENCODER_QUALITY_PRESET_SPEED
-            );
-            break;
-        }
+        SetQualityPreset(amfEncoder, ALVR_CODEC_H264);
 
         amf::AMFCapsPtr caps;
         if (amfEncoder->GetCaps(&caps) == AMF_OK) {
             caps->GetProperty(AMF_VIDEO_ENCODER_CAP_PRE_ANALYSIS, &m_hasPreAnalysis);
             caps->GetProperty(AMF_VIDEO_ENCODER_CAPS_QUERY_TIMEOUT_SUPPORT, &m_hasQueryTimeout);
+            caps->GetProperty(AMF_VIDEO_ENCODER_CAP_ROI, &m_hasRoi);
         }
 
         if (Settings::Instance().m_enableAmfPreAnalysis) {
@@ -305,7 +387,17 @@ amf::AMFComponentPtr VideoEncoderAMF::MakeEncoder(
         if (m_hasQueryTimeout) {
             amfEncoder->SetProperty(AMF_VIDEO_ENCODER_QUERY_TIMEOUT, 1000); // 1s timeout
         }
-    }
+
+        if (Settings::Instance().m_encoderMaxSliceBytes > 0) {
+            Warn("AMF can't cap the slice size in bytes, using the slice count.\n");
+        }
+        if (Settings::Instance().m_encoderSlicesPerFrame > 1) {
+            amfEncoder->SetProperty(
+                AMF_VIDEO_ENCODER_SLICES_PER_FRAME,
+                (int64_t)Settings::Instance().m_encoderSlicesPerFrame
+            );
+        }
+    } break;
     case ALVR_CODEC_HEVC: {
         amfEncoder->SetProperty(
             AMF_VIDEO_ENCODER_HEVC_USAGE, AMF_VIDEO_ENCODER_HEVC_USAGE_ULTRA_LOW_LATENCY
@@ -337,25 +429,7 @@ amf::AMFComponentPtr VideoEncoderAMF::MakeEncoder(
             AMF_VIDEO_ENCODER_HEVC_FRAMERATE, ::AMFConstructRate(frameRateIn, 1)
         );
 
-        switch (Settings::Instance().m_encoderQualityPreset) {
-        case ALVR_QUALITY:
-            amfEncoder->SetProperty(
-                AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET, AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET_QUALITY
-            );
-            break;
-        case ALVR_BALANCED:
-            amfEncoder->SetProperty(
-                AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET,
-                AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET_BALANCED
-            );
-            break;
-        case ALVR_SPEED:
-        default:
-            amfEncoder->SetProperty(
-                AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET, AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET_SPEED
-            );
-            break;
-        }
+        SetQualityPreset(amfEncoder, ALVR_CODEC_HEVC);
 
         if (m_use10bit) {
             amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_COLOR_BIT_DEPTH, AMF_COLOR_BIT_DEPTH_10);
@@ -375,6 +449,7 @@ amf::AMFComponentPtr VideoEncoderAMF::MakeEncoder(
             caps->GetProperty(
                 AMF_VIDEO_ENCODER_CAPS_HEVC_QUERY_TIMEOUT_SUPPORT, &m_hasQueryTimeout
             );
+            caps->GetProperty(AMF_VIDEO_ENCODER_HEVC_CAP_ROI, &m_hasRoi);
         }
 
         if (Settings::Instance().m_enableAmfPreAnalysis) {
@@ -469,7 +544,17 @@ amf::AMFComponentPtr VideoEncoderAMF::MakeEncoder(
         if (m_hasQueryTimeout) {
             amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_QUERY_TIMEOUT, 1000); // 1s timeout
         }
-    }
+
+        if (Settings::Instance().m_encoderMaxSliceBytes > 0) {
+            Warn("AMF can't cap the slice size in bytes, using the slice count.\n");
+        }
+        if (Settings::Instance().m_encoderSlicesPerFrame > 1) {
+            amfEncoder->SetProperty(
+                AMF_VIDEO_ENCODER_HEVC_SLICES_PER_FRAME,
+                (int64_t)Settings::Instance().m_encoderSlicesPerFrame
+            );
+        }
+    } break;
     case ALVR_CODEC_AV1: {
         amfEncoder->SetProperty(
             AMF_VIDEO_ENCODER_AV1_USAGE, AMF_VIDEO_ENCODER_AV1_USAGE_ULTRA_LOW_LATENCY
@@ -499,24 +584,7 @@ amf::AMFComponentPtr VideoEncoderAMF::MakeEncoder(
             AMF_VIDEO_ENCODER_AV1_FRAMERATE, ::AMFConstructRate(frameRateIn, 1)
         );
 
-        switch (Settings::Instance().m_encoderQualityPreset) {
-        case ALVR_QUALITY:
-            amfEncoder->SetProperty(
-                AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET, AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET_QUALITY
-            );
-            break;
-        case ALVR_BALANCED:
-            amfEncoder->SetProperty(
-                AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET, AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET_BALANCED
-            );
-            break;
-        case ALVR_SPEED:
-        default:
-            amfEncoder->SetProperty(
-                AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET, AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET_SPEED
-            );
-            break;
-        }
+        SetQualityPreset(amfEncoder, ALVR_CODEC_AV1);
 
         if (m_use10bit) {
             amfEncoder->SetProperty(AMF_VIDEO_ENCODER_AV1_COLOR_BIT_DEPTH, AMF_COLOR_BIT_DEPTH_10);
@@ -547,6 +615,8 @@ amf::AMFComponentPtr VideoEncoderAMF::MakeEncoder(
         if (amfEncoder->GetCaps(&caps) == AMF_OK) {
             caps->GetProperty(AMF_VIDEO_ENCODER_AV1_CAP_PRE_ANALYSIS, &m_hasPreAnalysis);
         }
+        // There is no ROI cap for AV1, all the AV1 capable VCN versions take ROI maps
+        m_hasRoi = true;
 
         if (Settings::Instance().m_enableAmfPreAnalysis) {
             if (!Settings::Instance().m_useAmfPreproc || Settings::Instance().m_use10bitEncoder) {
@@ -590,9 +660,27 @@ amf::AMFComponentPtr VideoEncoderAMF::MakeEncoder(
         if (m_hasQueryTimeout) {
             amfEncoder->SetProperty(AMF_VIDEO_ENCODER_AV1_QUERY_TIMEOUT, 1000); // 1s timeout
         }
+
+        int64_t tiles = (int64_t)std::max<uint32_t>(Settings::Instance().m_encoderAv1TileColumns, 1)
+            * std::max<uint32_t>(Settings::Instance().m_encoderAv1TileRows, 1);
+        if (tiles > 1) {
+            amfEncoder->SetProperty(AMF_VIDEO_ENCODER_AV1_TILES_PER_FRAME, tiles);
+        }
     }
     }
 
+    if (Settings::Instance().m_intraRefreshFrames > 0) {
+        EnableIntraRefresh(amfEncoder, codec, width, height);
+    }
+    m_disposable.UseTopTemporalLayer(m_temporalLayers);
+    if (m_temporalLayers.IsEnabled()) {
+        EnableTemporalLayers(amfEncoder, codec);
+    }
+    m_disposable.DisableWithoutLayers(m_temporalLayers);
+    if (m_ltr.IsEnabled()) {
+        EnableLtr(amfEncoder, codec);
+    }
+
     Debug("Configured %s.\n", pCodec);
     AMF_THROW_IF(amfEncoder->Init(inputFormat, width, height));
 
@@ -601,6 +689,160 @@ amf::AMFComponentPtr VideoEncoderAMF::MakeEncoder(
     return amfEncoder;
 }
 
+void VideoEncoderAMF::EnableIntraRefresh(
+    const amf::AMFComponentPtr& amfEncoder, int codec, int width, int height
+) {
+    int frames = Settings::Instance().m_intraRefreshFrames;
+    AMF_RESULT res = AMF_NOT_SUPPORTED;
+    switch (codec) {
+    case ALVR_CODEC_H264: {
+        int64_t mbs = (int64_t)((width + 15) / 16) * ((height + 15) / 16);
+        res = amfEncoder->SetProperty(
+            AMF_VIDEO_ENCODER_INTRA_REFRESH_NUM_MBS_PER_SLOT, (mbs + frames - 1) / frames
+        );
+        break;
+    }
+    case ALVR_CODEC_HEVC: {
+        int64_t ctbs = (int64_t)((width + 63) / 64) * ((height + 63) / 64);
+        res = amfEncoder->SetProperty(
+            AMF_VIDEO_ENCODER_HEVC_INTRA_REFRESH_NUM_CTBS_PER_SLOT, (ctbs + frames - 1) / frames
+        );
+        break;
+    }
+    case ALVR_CODEC_AV1:
+        res = amfEncoder->SetProperty(
+            AMF_VIDEO_ENCODER_AV1_INTRA_REFRESH_MODE,
+            AMF_VIDEO_ENCODER_AV1_INTRA_REFRESH_MODE__CONTINUOUS
+        );
+        if (res == AMF_OK) {
+            res = amfEncoder->SetProperty(
+                AMF_VIDEO_ENCODER_AV1_INTRAREFRESH_STRIPES, (int64_t)frames
+            );
+        }
+        break;
+    }
+
+    m_intraRefresh = res == AMF_OK;
+    if (!m_intraRefresh) {
+        Warn("Intra refresh is not supported by this encoder, recovering with IDRs.\n");
+    }
+}
+
+void VideoEncoderAMF::SetQualityPreset(const amf::AMFComponentPtr& amfEncoder, int codec) {
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        amfEncoder->SetProperty(
+            AMF_VIDEO_ENCODER_QUALITY_PRESET,
+            m_qualityPreset == ALVR_QUALITY        ? AMF_VIDEO_ENCODER_QUALITY_PRESET_QUALITY
+                : m_qualityPreset == ALVR_BALANCED ? AMF_VIDEO_ENCODER_QUALITY_PRESET_BALANCED
+                                                   : AMF_VIDEO_ENCODER_QUALITY_PRESET_SPEED
+        );
+        break;
+    case ALVR_CODEC_HEVC:
+        amfEncoder->SetProperty(
+            AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET,
+            m_qualityPreset == ALVR_QUALITY        ? AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET_QUALITY
+                : m_qualityPreset == ALVR_BALANCED ? AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET_BALANCED
+                                                   : AMF_VIDEO_ENCODER_HEVC_QUALITY_PRESET_SPEED
+        );
+        break;
+    case ALVR_CODEC_AV1:
+        amfEncoder->SetProperty(
+            AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET,
+            m_qualityPreset == ALVR_QUALITY        ? AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET_QUALITY
+                : m_qualityPreset == ALVR_BALANCED ? AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET_BALANCED
+                                                   : AMF_VIDEO_ENCODER_AV1_QUALITY_PRESET_SPEED
+        );
+        break;
+    }
+}
+
+bool VideoEncoderAMF::StepQualityPreset(int step) {
+    // ALVR_QUALITY is 0 and ALVR_SPEED 2
+    int preset = (int)m_qualityPreset + (step > 0 ? -1 : 1);
+    if (preset < ALVR_QUALITY || preset > ALVR_SPEED) {
+        return false;
+    }
+    m_qualityPreset = preset;
+    m_presetChanged = true;
+    return true;
+}
+
+void VideoEncoderAMF::EnableLtr(const amf::AMFComponentPtr& amfEncoder, int codec) {
+    // Keeping unused LTRs, the acknowledged one is only referenced after a loss
+    AMF_RESULT res = AMF_NOT_SUPPORTED;
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        res = amfEncoder->SetProperty(
+            AMF_VIDEO_ENCODER_MAX_LTR_FRAMES, (int64_t)LtrManager::SLOT_COUNT
+        );
+        if (res == AMF_OK) {
+            res = amfEncoder->SetProperty(
+                AMF_VIDEO_ENCODER_LTR_MODE, AMF_VIDEO_ENCODER_LTR_MODE_KEEP_UNUSED
+            );
+        }
+        break;
+    case ALVR_CODEC_HEVC:
+        res = amfEncoder->SetProperty(
+            AMF_VIDEO_ENCODER_HEVC_MAX_LTR_FRAMES, (int64_t)LtrManager::SLOT_COUNT
+        );
+        if (res == AMF_OK) {
+            res = amfEncoder->SetProperty(
+                AMF_VIDEO_ENCODER_HEVC_LTR_MODE, AMF_VIDEO_ENCODER_HEVC_LTR_MODE_KEEP_UNUSED
+            );
+        }
+        break;
+    case ALVR_CODEC_AV1:
+        res = amfEncoder->SetProperty(
+            AMF_VIDEO_ENCODER_AV1_MAX_LTR_FRAMES, (int64_t)LtrManager::SLOT_COUNT
+        );
+        if (res == AMF_OK) {
+            res = amfEncoder->SetProperty(
+                AMF_VIDEO_ENCODER_AV1_LTR_MODE, AMF_VIDEO_ENCODER_AV1_LTR_MODE_KEEP_UNUSED
+            );
+        }
+        break;
+    }
+
+    if (res != AMF_OK) {
+        Warn("Long-term references are not supported by this encoder.\n");
+        m_ltr.Disable();
+    }
+}
+
+void VideoEncoderAMF::EnableTemporalLayers(const amf::AMFComponentPtr& amfEncoder, int codec) {
+    int64_t layers = m_temporalLayers.GetLayerCount();
+    AMF_RESULT res = AMF_NOT_SUPPORTED;
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        res = amfEncoder->SetProperty(AMF_VIDEO_ENCODER_MAX_NUM_TEMPORAL_LAYERS, layers);
+        if (res == AMF_OK) {
+            res = amfEncoder->SetProperty(AMF_VIDEO_ENCODER_NUM_TEMPORAL_ENHANCMENT_LAYERS, layers);
+        }
+        break;
+    case ALVR_CODEC_HEVC:
+        res = amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_MAX_NUM_TEMPORAL_LAYERS, layers);
+        if (res == AMF_OK) {
+            res = amfEncoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_NUM_TEMPORAL_LAYERS, layers);
+        }
+        break;
+    case ALVR_CODEC_AV1:
+        res = amfEncoder->SetProperty(AMF_VIDEO_ENCODER_AV1_MAX_NUM_TEMPORAL_LAYERS, layers);
+        if (res == AMF_OK) {
+            res = amfEncoder->SetProperty(AMF_VIDEO_ENCODER_AV1_NUM_TEMPORAL_LAYERS, layers);
+        }
+        break;
+    }
+
+    if (res != AMF_OK) {
+        Warn("Temporal layers are not supported by this encoder.\n");
+        m_temporalLayers.Disable();
+    } else if (m_ltr.IsEnabled()) {
+        Warn("Long-term reference recovery is disabled with temporal layers.\n");
+        m_ltr.Disable();
+    }
+}
+
 amf::AMFComponentPtr VideoEncoderAMF::MakeConverter(
     amf::AMF_SURFACE_FORMAT inputFormat, int width, int height, amf::AMF_SURFACE_FORMAT outputFormat
 ) {
@@ -642,6 +884,59 @@ VideoEncoderAMF::MakePreprocessor(amf::AMF_SURFACE_FORMAT inputFormat, int width
     return amfPreprocessor;
 }
 
+amf::AMFComponentPtr
+VideoEncoderAMF::MakeScaler(amf::AMF_SURFACE_FORMAT inputFormat, int width, int height) {
+    amf::AMFComponentPtr amfScaler;
+    if (g_AMFFactory.GetFactory()->CreateComponent(m_amfContext, AMFHQScaler, &amfScaler)
+        != AMF_OK) {
+        Warn("This AMF runtime has no HQ scaler, the video converter scales instead.\n");
+        return nullptr;
+    }
+
+    AMF_THROW_IF(amfScaler->SetProperty(AMF_HQ_SCALER_ENGINE_TYPE, amf::AMF_MEMORY_DX11));
+    AMF_THROW_IF(amfScaler->SetProperty(AMF_HQ_SCALER_ALGORITHM, AMF_HQ_SCALER_ALGORITHM_BICUBIC));
+    // The frames are already YUV, and the ladder keeps the aspect ratio itself
+    AMF_THROW_IF(amfScaler->SetProperty(AMF_HQ_SCALER_FROM_SRGB, false));
+    AMF_THROW_IF(amfScaler->SetProperty(AMF_HQ_SCALER_KEEP_ASPECT_RATIO, false));
+    AMF_THROW_IF(
+        amfScaler->SetProperty(AMF_HQ_SCALER_OUTPUT_SIZE, ::AMFConstructSize(width, height))
+    );
+
+    AMF_THROW_IF(amfScaler->Init(inputFormat, width, height));
+
+    Debug("Initialized %s.\n", AMFHQScaler);
+    return amfScaler;
+}
+
+amf::AMFComponentPtr VideoEncoderAMF::MakeFrameRateConverter(
+    amf::AMF_SURFACE_FORMAT inputFormat, int width, int height
+) {
+    // FRC runs its kernels on OpenCL, which shares the surfaces with the DX11 context
+    if (m_amfContext->InitOpenCL() != AMF_OK) {
+        Warn("AMF can't use OpenCL on this GPU, frame rate conversion is disabled.\n");
+        return nullptr;
+    }
+    amf::AMFComponentPtr amfFrc;
+    if (g_AMFFactory.GetFactory()->CreateComponent(m_amfContext, AMFFRC, &amfFrc) != AMF_OK) {
+        Warn("This AMF runtime has no FRC component, frame rate conversion is disabled.\n");
+        return nullptr;
+    }
+
+    AMF_THROW_IF(amfFrc->SetProperty(AMF_FRC_ENGINE_TYPE, FRC_ENGINE_OPENCL));
+    // Off until the game drops to half rate
+    AMF_THROW_IF(amfFrc->SetProperty(AMF_FRC_MODE, FRC_OFF));
+    // Frames it can't interpolate are repeated rather than distorted
+    AMF_THROW_IF(amfFrc->SetProperty(AMF_FRC_ENABLE_FALLBACK, true));
+    AMF_THROW_IF(amfFrc->SetProperty(AMF_FRC_PROFILE, FRC_PROFILE_LOW));
+    AMF_THROW_IF(amfFrc->SetProperty(AMF_FRC_MV_SEARCH_MODE, FRC_MV_SEARCH_PERFORMANCE));
+    AMF_THROW_IF(amfFrc->SetProperty(AMF_FRC_OUTPUT_SIZE, ::AMFConstructSize(width, height)));
+
+    AMF_THROW_IF(amfFrc->Init(inputFormat, width, height));
+
+    Debug("Initialized %s.\n", AMFFRC);
+    return amfFrc;
+}
+
 void VideoEncoderAMF::Initialize() {
     Debug("Initializing VideoEncoderAMF.\n");
     AMF_THROW_IF(g_AMFFactory.Init());
@@ -665,6 +960,32 @@ void VideoEncoderAMF::Initialize() {
                 MakeConverter(m_surfaceFormat, m_renderWidth, m_renderHeight, inFormat)
             );
             m_amfComponents.emplace_back(MakePreprocessor(inFormat, m_renderWidth, m_renderHeight));
+        } else if (m_resolutionLadder.IsEnabled()) {
+            // Same format in and out, only there to scale the frames of the ladder. With the HQ
+            // scaler it converts to YUV for the encoder instead
+            if (Settings::Instance().m_amfHqScaler) {
+                inFormat = amf::AMF_SURFACE_NV12;
+            }
+            m_amfComponents.emplace_back(
+                MakeConverter(m_surfaceFormat, m_renderWidth, m_renderHeight, inFormat)
+            );
+        }
+    }
+    if (m_resolutionLadder.IsEnabled() && Settings::Instance().m_amfHqScaler) {
+        // Right after the converter, so the preprocessor only sees the scaled frames
+        if (auto scaler = MakeScaler(inFormat, m_renderWidth, m_renderHeight)) {
+            m_amfComponents.insert(m_amfComponents.begin() + 1, scaler);
+            m_scalerIndex = 1;
+        }
+    }
+    if (Settings::Instance().m_amfFrameRateConversion) {
+        if (m_ltr.IsEnabled() || m_temporalLayers.IsEnabled()) {
+            // The interpolated frames would be references these don't know about
+            Warn("Frame rate conversion is not supported with long-term references or temporal "
+                 "layers.\n");
+        } else if (auto frc = MakeFrameRateConverter(inFormat, m_renderWidth, m_renderHeight)) {
+            m_frcIndex = (int)m_amfComponents.size();
+            m_amfComponents.emplace_back(frc);
         }
     }
     m_amfComponents.emplace_back(MakeEncoder(
@@ -673,12 +994,19 @@ void VideoEncoderAMF::Initialize() {
 
     m_pipeline = new AMFPipeline();
     for (int i = 0; i < m_amfComponents.size() - 1; i++) {
-        m_pipeline->Connect(new AMFSolidPipe(m_amfComponents[i], m_amfComponents[i + 1]));
+        AMFDataFilter filter = nullptr;
+        if (i == m_frcIndex) {
+            filter = std::bind(
+                &VideoEncoderAMF::PaceInterpolatedFrame, this, std::placeholders::_1
+            );
+        }
+        m_pipeline->Connect(new AMFSolidPipe(m_amfComponents[i], m_amfComponents[i + 1], filter));
     }
 
     m_pipeline->Connect(new AMFPipe(
         m_amfComponents.back(), std::bind(&VideoEncoderAMF::Receive, this, std::placeholders::_1)
     ));
+    m_pipeline->Start();
 
     Debug("Successfully initialized VideoEncoderAMF.\n");
 }
@@ -698,9 +1026,6 @@ void VideoEncoderAMF::Shutdown() {
 
     g_AMFFactory.Terminate();
 
-    if (fpOut) {
-        fpOut.close();
-    }
     Debug("Successfully shutdown VideoEncoderAMF.\n");
 }
 
@@ -710,9 +1035,24 @@ void VideoEncoderAMF::Transmit(
     amf::AMFSurfacePtr surface;
     // Surface is cached by AMF.
 
+    if (m_frcIndex >= 0 && UpdateFrameRateConversion(targetTimestampNs, insertIDR)) {
+        return;
+    }
+
     auto params = GetDynamicEncoderParams();
     if (params.updated) {
-        amf_int64 bitRateIn = params.bitrate_bps / params.framerate * m_refreshRate; // in bps
+        m_targetBitrateBps = params.bitrate_bps;
+        m_targetFramerate = params.framerate;
+        if (m_bitrateCalibration) {
+            m_bitrateCalibration->SetTarget(params.bitrate_bps);
+        }
+    }
+    float correction = m_bitrateCalibration ? m_bitrateCalibration->GetFactor() : 1.0f;
+    bool recalibrated = correction != m_bitrateCorrection && m_targetBitrateBps > 0;
+    m_bitrateCorrection = correction;
+    if (params.updated || recalibrated) {
+        amf_int64 bitRateIn = m_targetBitrateBps * m_bitrateCorrection / m_targetFramerate
+            * m_refreshRate; // in bps
 
         const amf_int64 maxRate = 1'000'000'000;
         if (bitRateIn > maxRate) {
@@ -738,11 +1078,37 @@ void VideoEncoderAMF::Transmit(
             );
         }
 
-        if (Settings::Instance().m_amdBitrateCorruptionFix) {
-            RequestIDR();
+        if (params.updated && Settings::Instance().m_amdBitrateCorruptionFix) {
+            // A real IDR, loss recovery could be served from a long-term reference or an intra
+            // refresh
+            insertIDR = true;
         }
     }
 
+    if (m_resolutionLadder.Update(params)) {
+        Resize();
+        insertIDR = true;
+    }
+
+    if (m_presetChanged) {
+        // The preset is a static property, the encoder is reinitialized once the frames in flight
+        // are out like for a resize
+        m_presetChanged = false;
+        m_pipeline->WaitIdle();
+        SetQualityPreset(m_amfComponents.back(), m_codec);
+        AMF_THROW_IF(m_amfComponents.back()->ReInit(
+            m_resolutionLadder.GetWidth(), m_resolutionLadder.GetHeight()
+        ));
+        insertIDR = true;
+    }
+
+    // Takes effect with the next frame, unlike the VBV buffer that follows the bitrate
+    uint32_t frameBudget = GetEncoderFrameBudget();
+    if (frameBudget != m_frameBudget) {
+        m_frameBudget = frameBudget;
+        ApplyFrameBudget();
+    }
+
     AMF_THROW_IF(m_amfContext->AllocSurface(
         amf::AMF_MEMORY_DX11, m_surfaceFormat, m_renderWidth, m_renderHeight, &surface
     ));
@@ -755,12 +1121,103 @@ void VideoEncoderAMF::Transmit(
     surface->SetProperty(FRAME_INDEX_PROPERTY, targetTimestampNs);
 
     ApplyFrameProperties(surface, insertIDR);
+    ApplyLtr(surface, m_ltr.OnFrame(targetTimestampNs, insertIDR));
+    // In step with the layers, which restart at each IDR only
+    m_disposable.OnFrame(targetTimestampNs, insertIDR);
+    if (m_hasRoi) {
+        ApplyRoiMap(surface);
+    }
+
+    if (m_frcIndex >= 0) {
+        // Matched with the FRC output by pts, the interpolated frames have the pts in between
+        surface->SetPts(targetTimestampNs / AMF_PTS_NS);
+        std::lock_guard<std::mutex> lock(m_frcMutex);
+        m_frcInputs.push_back(targetTimestampNs);
+    }
+
+    // The output is forwarded and sent by the pipe threads
+    AMF_RESULT res = m_amfComponents.front()->SubmitInput(surface);
+    if (res == AMF_OK) {
+        m_pipeline->OnInputSubmitted();
+    } else {
+        Debug("SubmitInput returns code %d, dropping frame.\n", res);
+        if (m_frcIndex >= 0) {
+            std::lock_guard<std::mutex> lock(m_frcMutex);
+            m_frcInputs.pop_back();
+        }
+    }
+}
+
+bool VideoEncoderAMF::UpdateFrameRateConversion(uint64_t targetTimestampNs, bool insertIDR) {
+    // The compositor presents the last frame of the game again when the game misses a refresh, it
+    // keeps the target timestamp of the pose it was rendered with
+    bool repeated = targetTimestampNs == m_lastTargetTimestampNs;
+    m_lastTargetTimestampNs = targetTimestampNs;
+    m_repeatRatio += FRC_AVERAGE_WEIGHT * ((repeated ? 1.0 : 0.0) - m_repeatRatio);
+
+    bool active = m_repeatRatio > (m_frcActive ? FRC_STOP_RATIO : FRC_START_RATIO);
+    if (active != m_frcActive) {
+        // The mode applies from the next input on, so the frames in flight are let out first
+        m_pipeline->WaitIdle();
+        m_amfComponents[m_frcIndex]->SetProperty(AMF_FRC_MODE, active ? FRC_x2_PRESENT : FRC_OFF);
+        m_frcActive = active;
+        Info(
+            "AMF FRC %s, %.0f%% of the frames repeated\n",
+            active ? "interpolating" : "off",
+            m_repeatRatio * 100
+        );
+    }
+    // An IDR can't wait for the next frame of the game
+    return m_frcActive && repeated && !insertIDR;
+}
+
+bool VideoEncoderAMF::PaceInterpolatedFrame(AMFDataPtr& data) {
+    uint64_t pts = (uint64_t)data->GetPts();
+    uint64_t inputNs = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_frcMutex);
+        // Inputs FRC gave up on are skipped
+        while (m_frcInputs.size() > 1 && m_frcInputs.front() / AMF_PTS_NS < pts) {
+            m_frcInputs.pop_front();
+        }
+        if (!m_frcInputs.empty()) {
+            inputNs = m_frcInputs.front();
+        }
+    }
+    auto period = std::chrono::nanoseconds(1'000'000'000 / m_refreshRate);
+
+    bool interpolated = inputNs != 0 && pts < inputNs / AMF_PTS_NS;
+    if (interpolated) {
+        // Only a frame between two inputs two refreshes apart has a display slot of its own
+        uint64_t gapNs = inputNs - m_frcLastTimestampNs;
+        if (m_frcLastTimestampNs == 0 || gapNs < (uint64_t)(period.count() * 3 / 2)) {
+            data = nullptr;
+            return false;
+        }
+        uint64_t timestampNs = m_frcLastTimestampNs + gapNs / 2;
+        data->SetProperty(START_TIME_PROPERTY, amf_high_precision_clock());
+        data->SetProperty(FRAME_INDEX_PROPERTY, timestampNs);
+        m_frcInterpolatedTime = std::chrono::steady_clock::now();
+        m_frcHoldNext = true;
+        return false;
+    }
 
-    m_amfComponents.front()->SubmitInput(surface);
-    m_pipeline->Run(m_hasQueryTimeout);
+    if (m_frcHoldNext) {
+        // The input follows its interpolated frame by a refresh, as if the game rendered both
+        m_frcHoldNext = false;
+        std::this_thread::sleep_until(m_frcInterpolatedTime + period);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_frcMutex);
+        if (!m_frcInputs.empty()) {
+            m_frcInputs.pop_front();
+        }
+    }
+    m_frcLastTimestampNs = inputNs;
+    return true;
 }
 
-void VideoEncoderAMF::Receive(AMFDataPtr data) {
+bool VideoEncoderAMF::Receive(AMFDataPtr data) {
     amf_pts current_time = amf_high_precision_clock();
     amf_pts start_time = 0;
     uint64_t targetTimestampNs;
@@ -772,8 +1229,8 @@ void VideoEncoderAMF::Receive(AMFDataPtr data) {
     char* p = reinterpret_cast<char*>(buffer->GetNative());
     int length = static_cast<int>(buffer->GetSize());
 
-    if (fpOut) {
-        fpOut.write(p, length);
+    if (m_bitrateCalibration) {
+        m_bitrateCalibration->OnFrame(length);
     }
 
     uint64_t type;
@@ -786,7 +1243,114 @@ void VideoEncoderAMF::Receive(AMFDataPtr data) {
         isIdr = type == AMF_VIDEO_ENCODER_HEVC_OUTPUT_DATA_TYPE_IDR;
     }
 
-    ParseFrameNals(m_codec, reinterpret_cast<uint8_t*>(p), length, targetTimestampNs, isIdr);
+    // The AMF buffer is ref-counted, keep a reference until the transport is done with it
+    ParseFrameNalsLeased(
+        m_codec,
+        reinterpret_cast<uint8_t*>(p),
+        length,
+        targetTimestampNs,
+        isIdr,
+        [buffer]() mutable { buffer = nullptr; }
+    );
+    return true;
+}
+
+void VideoEncoderAMF::Resize() {
+    // The components are reinitialized in place once the frames in flight are out, which is at
+    // most the frame being encoded
+    m_pipeline->WaitIdle();
+
+    uint32_t width = m_resolutionLadder.GetWidth();
+    uint32_t height = m_resolutionLadder.GetHeight();
+
+    // The components before the scaler stay at the render size
+    auto& scaler = m_amfComponents[m_scalerIndex];
+    AMF_THROW_IF(scaler->SetProperty(
+        m_scalerIndex == 0 ? AMF_VIDEO_CONVERTER_OUTPUT_SIZE : AMF_HQ_SCALER_OUTPUT_SIZE,
+        ::AMFConstructSize(width, height)
+    ));
+    AMF_THROW_IF(scaler->ReInit(m_renderWidth, m_renderHeight));
+
+    auto& encoder = m_amfComponents.back();
+    switch (m_codec) {
+    case ALVR_CODEC_H264:
+        encoder->SetProperty(AMF_VIDEO_ENCODER_FRAMESIZE, ::AMFConstructSize(width, height));
+        break;
+    case ALVR_CODEC_HEVC:
+        encoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_FRAMESIZE, ::AMFConstructSize(width, height));
+        break;
+    case ALVR_CODEC_AV1:
+        encoder->SetProperty(AMF_VIDEO_ENCODER_AV1_FRAMESIZE, ::AMFConstructSize(width, height));
+        break;
+    }
+    for (size_t i = m_scalerIndex + 1; i < m_amfComponents.size(); i++) {
+        AMF_THROW_IF(m_amfComponents[i]->ReInit(width, height));
+    }
+}
+
+void VideoEncoderAMF::ApplyFrameBudget() {
+    // In bits, 0 lifts the limit
+    amf_int64 maxBits = (amf_int64)m_frameBudget * 8;
+    auto& encoder = m_amfComponents.back();
+    switch (m_codec) {
+    case ALVR_CODEC_H264:
+        encoder->SetProperty(AMF_VIDEO_ENCODER_MAX_AU_SIZE, maxBits);
+        break;
+    case ALVR_CODEC_HEVC:
+        encoder->SetProperty(AMF_VIDEO_ENCODER_HEVC_MAX_AU_SIZE, maxBits);
+        break;
+    case ALVR_CODEC_AV1:
+        encoder->SetProperty(AMF_VIDEO_ENCODER_AV1_MAX_COMPRESSED_FRAME_SIZE, maxBits);
+        break;
+    }
+}
+
+void VideoEncoderAMF::ApplyRoiMap(const amf::AMFSurfacePtr& surface) {
+    uint32_t width = m_resolutionLadder.GetWidth();
+    uint32_t height = m_resolutionLadder.GetHeight();
+    EncoderRoi roi;
+    if (!GetEncoderRoi(width, height, roi)) {
+        return;
+    }
+
+    // One value per MB for h264 and per 64x64 block for HEVC and AV1
+    uint32_t blockSize = m_codec == ALVR_CODEC_H264 ? 16 : 64;
+    BuildRoiQpDeltaMap(roi, width, height, blockSize, m_roiQpDeltaMap);
+    int blocksX = (width + blockSize - 1) / blockSize;
+    int blocksY = (height + blockSize - 1) / blockSize;
+
+    amf::AMFSurfacePtr roiSurface;
+    if (m_amfContext->AllocSurface(
+            amf::AMF_MEMORY_HOST, amf::AMF_SURFACE_GRAY32, blocksX, blocksY, &roiSurface
+        )
+        != AMF_OK) {
+        return;
+    }
+    amf::AMFPlanePtr plane = roiSurface->GetPlaneAt(0);
+    uint8_t* rows = static_cast<uint8_t*>(plane->GetNative());
+    int pitch = plane->GetHPitch();
+
+    // AMF takes importance levels from 0 to 10 rather than QP offsets, the gaze gets the highest
+    for (int y = 0; y < blocksY; y++) {
+        amf_uint32* row = reinterpret_cast<amf_uint32*>(rows + y * pitch);
+        for (int x = 0; x < blocksX; x++) {
+            int delta = m_roiQpDeltaMap[y * blocksX + x];
+            row[x] = 10 - delta * 10 / roi.maxQpDelta;
+        }
+    }
+
+    // Carried to the encoder input by the converters, like the other frame properties
+    switch (m_codec) {
+    case ALVR_CODEC_H264:
+        surface->SetProperty(AMF_VIDEO_ENCODER_ROI_DATA, roiSurface);
+        break;
+    case ALVR_CODEC_HEVC:
+        surface->SetProperty(AMF_VIDEO_ENCODER_HEVC_ROI_DATA, roiSurface);
+        break;
+    case ALVR_CODEC_AV1:
+        surface->SetProperty(AMF_VIDEO_ENCODER_AV1_ROI_DATA, roiSurface);
+        break;
+    }
 }
 
 void VideoEncoderAMF::ApplyFrameProperties(const amf::AMFSurfacePtr& surface, bool insertIDR) {
@@ -830,3 +1394,29 @@ void VideoEncoderAMF::ApplyFrameProperties(const amf::AMFSurfacePtr& surface, bo
         throw MakeException("Invalid video codec");
     }
 }
+
+void VideoEncoderAMF::ApplyLtr(const amf::AMFSurfacePtr& surface, LtrManager::FrameLtr ltr) {
+    const wchar_t* markProperty;
+    const wchar_t* referenceProperty;
+    switch (m_codec) {
+    case ALVR_CODEC_H264:
+        markProperty = AMF_VIDEO_ENCODER_MARK_CURRENT_WITH_LTR_INDEX;
+        referenceProperty = AMF_VIDEO_ENCODER_FORCE_LTR_REFERENCE_BITFIELD;
+        break;
+    case ALVR_CODEC_HEVC:
+        markProperty = AMF_VIDEO_ENCODER_HEVC_MARK_CURRENT_WITH_LTR_INDEX;
+        referenceProperty = AMF_VIDEO_ENCODER_HEVC_FORCE_LTR_REFERENCE_BITFIELD;
+        break;
+    default:
+        markProperty = AMF_VIDEO_ENCODER_AV1_MARK_CURRENT_WITH_LTR_INDEX;
+        referenceProperty = AMF_VIDEO_ENCODER_AV1_FORCE_LTR_REFERENCE_BITFIELD;
+        break;
+    }
+
+    if (ltr.markSlot >= 0) {
+        surface->SetProperty(markProperty, (int64_t)ltr.markSlot);
+    }
+    if (ltr.useSlot >= 0) {
+        surface->SetProperty(referenceProperty, (int64_t)1 << ltr.useSlot);
+    }
+}
@@ -3,43 +3,83 @@
 
 #pragma once
 #include "VideoEncoder.h"
+#include "alvr_server/DisposableFrames.h"
+#include "alvr_server/LtrManager.h"
+#include "alvr_server/ResolutionLadder.h"
+#include "alvr_server/TemporalLayers.h"
 
 #include "../../shared/amf/public/common/AMFFactory.h"
 #include "../../shared/amf/public/common/AMFSTL.h"
 #include "../../shared/amf/public/common/Thread.h"
+#include "../../shared/amf/public/include/components/FRC.h"
+#include "../../shared/amf/public/include/components/HQScaler.h"
 #include "../../shared/amf/public/include/components/PreProcessing.h"
 #include "../../shared/amf/public/include/components/VideoConverter.h"
 #include "../../shared/amf/public/include/components/VideoEncoderAV1.h"
 #include "../../shared/amf/public/include/components/VideoEncoderHEVC.h"
 #include "../../shared/amf/public/include/components/VideoEncoderVCE.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 typedef amf::AMFData* AMFDataPtr;
-typedef std::function<void(AMFDataPtr)> AMFDataReceiver;
+// Returns whether the data completes the input it was produced from, frame rate conversion
+// produces several outputs
+typedef std::function<bool(AMFDataPtr)> AMFDataReceiver;
+// Same as an AMFDataReceiver, resetting the data drops it instead of passing it on
+typedef std::function<bool(AMFDataPtr&)> AMFDataFilter;
 
 class AMFPipeline;
 
+// Forwards the output of a component from its own thread. The thread sleeps while the component
+// has no input in flight and otherwise blocks in QueryOutput, or yields when the component has no
+// query timeout.
 class AMFPipe {
 public:
     AMFPipe(amf::AMFComponentPtr src, AMFDataReceiver receiver);
     virtual ~AMFPipe();
 
-    void doPassthrough(bool hasQueryTimeout, uint32_t timerResolution);
+    void Start();
+    void Stop();
+    // Called once an input has been submitted to the source component
+    void OnInputSubmitted();
+    // Blocks until every submitted input has been forwarded
+    void WaitIdle();
 
 protected:
+    friend class AMFPipeline;
+
+    void ReceiveLoop();
+    void OnInputCompleted();
+
     amf::AMFComponentPtr m_amfComponentSrc;
     AMFDataReceiver m_receiver;
+    // Pipe fed by the output of this one, if any
+    AMFPipe* m_next = nullptr;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    uint32_t m_pending = 0;
+    bool m_stop = false;
 };
 
 typedef AMFPipe* AMFPipePtr;
 
+// Submits the output of a component to the next one. The filter, if any, sees each output first.
 class AMFSolidPipe : public AMFPipe {
 public:
-    AMFSolidPipe(amf::AMFComponentPtr src, amf::AMFComponentPtr dst);
+    AMFSolidPipe(
+        amf::AMFComponentPtr src, amf::AMFComponentPtr dst, AMFDataFilter filter = nullptr
+    );
 
 protected:
-    void Passthrough(AMFDataPtr);
+    bool Passthrough(AMFDataPtr);
 
     amf::AMFComponentPtr m_amfComponentDst;
+    AMFDataFilter m_filter;
 };
 
 class AMFPipeline {
@@ -48,11 +88,13 @@ public:
     ~AMFPipeline();
 
     void Connect(AMFPipePtr pipe);
-    void Run(bool hasQueryTimeout);
+    void Start();
+    // Called once an input has been submitted to the first component
+    void OnInputSubmitted();
+    // Blocks until the frames in flight have gone through all the components
+    void WaitIdle();
 
 protected:
-    uint32_t m_timerResolution;
-
     std::vector<AMFPipePtr> m_pipes;
 };
 
@@ -73,7 +115,16 @@ public:
         uint64_t targetTimestampNs,
         bool insertIDR
     );
-    void Receive(AMFDataPtr data);
+    bool Receive(AMFDataPtr data);
+
+    // The encoder refreshes continuously, so recovery needs no keyframe
+    bool SupportsIntraRefresh() { return m_intraRefresh; }
+
+    bool SupportsLtrRecovery() { return m_ltr.IsEnabled(); }
+    bool RecoverWithLtr() { return m_ltr.Recover(); }
+    void AcknowledgeFrame(uint64_t targetTimestampNs) { m_ltr.Acknowledge(targetTimestampNs); }
+    bool SupportsBitrateCalibration() { return true; }
+    bool StepQualityPreset(int step);
 
 private:
     static const wchar_t* START_TIME_PROPERTY;
@@ -87,6 +138,22 @@ private:
     );
     amf::AMFComponentPtr
     MakePreprocessor(amf::AMF_SURFACE_FORMAT inputFormat, int width, int height);
+    // Bicubic scaler of the ladder frames, or null if the runtime has none
+    amf::AMFComponentPtr MakeScaler(amf::AMF_SURFACE_FORMAT inputFormat, int width, int height);
+    // FRC component in the x2 present mode while the game renders at half rate, or null if FRC
+    // can't run on this GPU
+    amf::AMFComponentPtr
+    MakeFrameRateConverter(amf::AMF_SURFACE_FORMAT inputFormat, int width, int height);
+    // Spreads intra refresh over intra_refresh_frames frames, sets m_intraRefresh
+    void EnableIntraRefresh(
+        const amf::AMFComponentPtr& amfEncoder, int codec, int width, int height
+    );
+    // Sets the m_qualityPreset preset
+    void SetQualityPreset(const amf::AMFComponentPtr& amfEncoder, int codec);
+    // Keeps the LtrManager slots as LTRs, disables m_ltr if the encoder can't
+    void EnableLtr(const amf::AMFComponentPtr& amfEncoder, int codec);
+    // Sets the layer count of m_temporalLayers, disables it if the encoder can't
+    void EnableTemporalLayers(const amf::AMFComponentPtr& amfEncoder, int codec);
     amf::AMFComponentPtr MakeEncoder(
         amf::AMF_SURFACE_FORMAT inputFormat,
         int width,
@@ -99,8 +166,6 @@ private:
     AMFPipelinePtr m_pipeline;
     std::vector<amf::AMFComponentPtr> m_amfComponents;
 
-    std::ofstream fpOut;
-
     std::shared_ptr<CD3DRender> m_d3dRender;
 
     bool m_use10bit;
@@ -111,9 +176,61 @@ private:
     int m_renderWidth;
     int m_renderHeight;
     int m_bitrateInMBits;
+    // Last requested bitrate, and the calibration factor it was given to the encoder with
+    uint64_t m_targetBitrateBps = 0;
+    float m_targetFramerate = 0.0f;
+    float m_bitrateCorrection = 1.0f;
 
     bool m_hasQueryTimeout;
     bool m_hasPreAnalysis;
+    bool m_hasRoi;
+    bool m_intraRefresh;
+    // ALVR_ENCODER_QUALITY_PRESET, from encoder_quality_preset and then StepQualityPreset
+    uint32_t m_qualityPreset;
+    bool m_presetChanged = false;
+
+    // Low bitrate encodes at a lower resolution, scaled by the first converter
+    ResolutionLadder m_resolutionLadder;
+    // Index of the component scaling to the ladder size, the converter or the HQ scaler after it
+    size_t m_scalerIndex = 0;
+    // Reinitializes the components for the current ladder size
+    void Resize();
 
     void ApplyFrameProperties(const amf::AMFSurfacePtr& surface, bool insertIDR);
+    // Caps the encoded frames to the SetEncoderFrameBudget budget, m_frameBudget bytes
+    void ApplyFrameBudget();
+    uint32_t m_frameBudget = 0;
+    // Attaches the gaze ROI map, if there is a gaze
+    void ApplyRoiMap(const amf::AMFSurfacePtr& surface);
+    std::vector<int8_t> m_roiQpDeltaMap;
+
+    // Loss recovery from acknowledged long-term references
+    LtrManager m_ltr;
+    void ApplyLtr(const amf::AMFSurfacePtr& surface, LtrManager::FrameLtr ltr);
+
+    // Temporal SVC, the golden frames of m_ltr could be dropped with it so only one is enabled
+    TemporalLayers m_temporalLayers;
+    // The top temporal layer, AMF has no per-frame reference flag
+    DisposableFrames m_disposable;
+
+    // Frame rate conversion, see amf_frame_rate_conversion. Follows the rate the game renders at
+    // from the repeated frames and switches the FRC mode between frames. Returns whether the frame
+    // is a repeat left to FRC to replace.
+    bool UpdateFrameRateConversion(uint64_t targetTimestampNs, bool insertIDR);
+    // Filter of the FRC output: interpolated frames get the display slot between their inputs,
+    // and the input after them is held back by a refresh so the encoder is fed at full rate
+    bool PaceInterpolatedFrame(AMFDataPtr& data);
+    // Index of the FRC component in m_amfComponents, -1 without FRC
+    int m_frcIndex = -1;
+    bool m_frcActive = false;
+    // Fraction of the recent frames that repeated the previous one
+    double m_repeatRatio = 0;
+    uint64_t m_lastTargetTimestampNs = 0;
+    // Target timestamps of the FRC inputs not output yet, shared with the pipe thread
+    std::mutex m_frcMutex;
+    std::deque<uint64_t> m_frcInputs;
+    // Pipe thread only: last input output by FRC, and when the last interpolated frame left
+    uint64_t m_frcLastTimestampNs = 0;
+    std::chrono::steady_clock::time_point m_frcInterpolatedTime;
+    bool m_frcHoldNext = false;
 };
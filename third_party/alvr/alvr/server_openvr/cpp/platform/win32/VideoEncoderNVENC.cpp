@@ -4,9 +4,65 @@
 #include "VideoEncoderNVENC.h"
 #include "NvCodecUtils.h"
 
+#include "alvr_server/EncoderRoi.h"
+#include "alvr_server/FrameBudget.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
+#include "alvr_server/ThreadProfiles.h"
 #include "alvr_server/Utils.h"
+#include "alvr_server/VramBudget.h"
+#include <algorithm>
+
+namespace {
+GUID codecGuid(int codec) {
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        return NV_ENC_CODEC_H264_GUID;
+    case ALVR_CODEC_HEVC:
+        return NV_ENC_CODEC_HEVC_GUID;
+    default:
+        return NV_ENC_CODEC_AV1_GUID;
+    }
+}
+
+// Intra refresh for loss recovery only: waves start when forced by a frame, the period just has
+// to outlast the session. A periodic refresh set up by the user is kept as is.
+template <typename Config> void enableRecoveryRefresh(Config& config, int refreshRate) {
+    if (Settings::Instance().m_nvencEnableIntraRefresh) {
+        return;
+    }
+    config.enableIntraRefresh = 1;
+    config.intraRefreshPeriod = refreshRate * 3600;
+    config.intraRefreshCnt = Settings::Instance().m_intraRefreshFrames;
+}
+
+// Long-term references marked and used per picture, as told by LtrManager
+template <typename Config> void enableManualLtr(Config& config) {
+    config.enableLTR = 1;
+    config.ltrTrustMode = 0;
+    config.ltrNumFrames = LtrManager::SLOT_COUNT;
+}
+
+template <typename PicParams> void applyLtr(PicParams& picParams, LtrManager::FrameLtr ltr) {
+    if (ltr.markSlot >= 0) {
+        picParams.ltrMarkFrame = 1;
+        picParams.ltrMarkFrameIdx = ltr.markSlot;
+    }
+    if (ltr.useSlot >= 0) {
+        picParams.ltrUseFrames = 1;
+        picParams.ltrUseFrameBitmap = 1 << ltr.useSlot;
+    }
+}
+
+// Whether CopyResource can copy between the formats, the sRGB output of FrameRender goes to
+// the UNORM input of NVENC
+bool isCopyCompatible(DXGI_FORMAT a, DXGI_FORMAT b) {
+    auto isRgba8 = [](DXGI_FORMAT format) {
+        return format == DXGI_FORMAT_R8G8B8A8_UNORM || format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    };
+    return a == b || (isRgba8(a) && isRgba8(b));
+}
+}
 
 VideoEncoderNVENC::VideoEncoderNVENC(std::shared_ptr<CD3DRender> pD3DRender, int width, int height)
     : m_pD3DRender(pD3DRender)
@@ -14,7 +70,17 @@ VideoEncoderNVENC::VideoEncoderNVENC(std::shared_ptr<CD3DRender> pD3DRender, int
     , m_refreshRate(Settings::Instance().m_refreshRate)
     , m_renderWidth(width)
     , m_renderHeight(height)
-    , m_bitrateInMBits(30) { }
+    , m_bitrateInMBits(30)
+    , m_framerate(Settings::Instance().m_refreshRate)
+    , m_qualityPreset(std::clamp<int>(Settings::Instance().m_nvencQualityPreset, 1, 7))
+    , m_intraRefresh(false)
+    , m_insertIntraRefresh(false)
+    , m_refInvalidation(false)
+    , m_resolutionLadder(width, height)
+    , m_asyncEncode(false)
+    , m_stopCompletion(false)
+    , m_qpDeltaMapBlockSize(16)
+    , m_nextQpDeltaMap(0) { }
 
 VideoEncoderNVENC::~VideoEncoderNVENC() { }
 
@@ -23,24 +89,38 @@ void VideoEncoderNVENC::Initialize() {
     // Initialize Encoder
     //
 
-    NV_ENC_BUFFER_FORMAT format
-        = Settings::Instance().m_enableHdr ? NV_ENC_BUFFER_FORMAT_NV12 : NV_ENC_BUFFER_FORMAT_ABGR;
+    // With RGB input for HDR, NVENC converts like for SDR instead of the YUV shader. Matches
+    // FrameRender::OutputsHdrRgb, NVENC only runs on NVIDIA adapters.
+    const bool yuvInput = Settings::Instance().m_enableHdr
+        && (!Settings::Instance().m_hdrNvencRgbInput || Settings::Instance().m_force_sw_encoding);
+    NV_ENC_BUFFER_FORMAT format = yuvInput ? NV_ENC_BUFFER_FORMAT_NV12 : NV_ENC_BUFFER_FORMAT_ABGR;
 
     if (Settings::Instance().m_use10bitEncoder) {
-        format = Settings::Instance().m_enableHdr ? NV_ENC_BUFFER_FORMAT_YUV420_10BIT
-                                                  : NV_ENC_BUFFER_FORMAT_ABGR10;
+        format = yuvInput ? NV_ENC_BUFFER_FORMAT_YUV420_10BIT : NV_ENC_BUFFER_FORMAT_ABGR10;
+    }
+
+    m_inputFormat = format;
+
+    if (Settings::Instance().m_nvencStereoInterleave) {
+        // The IVF framing of AV1 holds one picture per frame
+        if (m_codec == ALVR_CODEC_AV1) {
+            Warn("NVENC stereo interleaving is not supported with AV1.\n");
+        } else {
+            m_stereoInterleave = true;
+        }
     }
+    const int encodeWidth = m_renderWidth / (int)PicturesPerFrame();
 
     Debug(
         "Initializing CNvEncoder. Width=%d Height=%d Format=%d\n",
-        m_renderWidth,
+        encodeWidth,
         m_renderHeight,
         format
     );
 
     try {
         m_NvNecoder = std::make_shared<NvEncoderD3D11>(
-            m_pD3DRender->GetDevice(), m_renderWidth, m_renderHeight, format, 0
+            m_pD3DRender->GetDevice(), encodeWidth, m_renderHeight, format, 0
         );
     } catch (NVENCException e) {
         throw MakeException(
@@ -48,6 +128,112 @@ void VideoEncoderNVENC::Initialize() {
         );
     }
 
+    if (Settings::Instance().m_intraRefreshFrames > 0) {
+        m_intraRefresh = m_NvNecoder->GetCapabilityValue(
+            codecGuid(m_codec), NV_ENC_CAPS_SUPPORT_INTRA_REFRESH
+        );
+        if (!m_intraRefresh) {
+            Warn("NVENC does not support intra refresh, recovering with IDR frames.\n");
+        }
+    }
+
+    if (Settings::Instance().m_encoderChroma444) {
+        if (m_codec == ALVR_CODEC_AV1) {
+            Warn("NVENC can't encode AV1 in 4:4:4, encoding 4:2:0.\n");
+        } else if (yuvInput) {
+            // The HDR conversion shader only writes 4:2:0
+            Warn("4:4:4 needs NVENC RGB input with HDR, encoding 4:2:0.\n");
+        } else if (!m_NvNecoder->GetCapabilityValue(
+                       codecGuid(m_codec), NV_ENC_CAPS_SUPPORT_YUV444_ENCODE
+                   )) {
+            Warn("NVENC does not support 4:4:4 encoding, encoding 4:2:0.\n");
+        } else {
+            m_chroma444 = true;
+        }
+    }
+
+    m_refInvalidation = m_NvNecoder->GetCapabilityValue(
+        codecGuid(m_codec), NV_ENC_CAPS_SUPPORT_REF_PIC_INVALIDATION
+    );
+
+    if (m_stereoInterleave) {
+        // These expect one picture per frame, losses are recovered with IDR frames
+        if (m_intraRefresh || m_ltr.IsEnabled() || m_temporalLayers.IsEnabled()
+            || m_disposable.IsEnabled() || m_resolutionLadder.IsEnabled()) {
+            Warn(
+                "Intra refresh, LTR, temporal layers, disposable frames and dynamic resolution are "
+                "disabled with stereo interleaving.\n"
+            );
+        }
+        m_intraRefresh = false;
+        m_refInvalidation = false;
+        m_ltr.Disable();
+        m_temporalLayers.Disable();
+        m_disposable.Disable();
+        m_resolutionLadder.Disable();
+    }
+
+    m_disposable.UseTopTemporalLayer(m_temporalLayers);
+    if (m_temporalLayers.IsEnabled()) {
+        // This SDK only has temporal SVC for H264, HEVC and AV1 just have hierarchical coding
+        if (m_codec != ALVR_CODEC_H264) {
+            Warn("NVENC temporal layers are only supported with h264.\n");
+            m_temporalLayers.Disable();
+        } else if (!m_NvNecoder->GetCapabilityValue(
+                       codecGuid(m_codec), NV_ENC_CAPS_SUPPORT_TEMPORAL_SVC
+                   )
+                   || m_NvNecoder->GetCapabilityValue(
+                          codecGuid(m_codec), NV_ENC_CAPS_NUM_MAX_TEMPORAL_LAYERS
+                      ) < (int)m_temporalLayers.GetLayerCount()) {
+            Warn("NVENC does not support %u temporal layers.\n", m_temporalLayers.GetLayerCount());
+            m_temporalLayers.Disable();
+        } else if (m_ltr.IsEnabled()) {
+            // A golden frame in an upper layer could be dropped on the way to the client
+            Warn("Long-term reference recovery is disabled with temporal layers.\n");
+            m_ltr.Disable();
+        }
+    }
+
+    m_disposable.DisableWithoutLayers(m_temporalLayers);
+
+    if (m_ltr.IsEnabled()) {
+        // The AV1 picture params have no long-term reference control
+        if (m_codec == ALVR_CODEC_AV1) {
+            Warn("NVENC long-term references are not supported with AV1.\n");
+            m_ltr.Disable();
+        } else if (m_NvNecoder->GetCapabilityValue(
+                       codecGuid(m_codec), NV_ENC_CAPS_NUM_MAX_LTR_FRAMES
+                   ) < LtrManager::SLOT_COUNT) {
+            Warn("NVENC does not support enough long-term references.\n");
+            m_ltr.Disable();
+        }
+    }
+
+    if (m_resolutionLadder.IsEnabled()) {
+        if (Settings::Instance().m_enableHdr) {
+            // The video processor scales RGB, HDR frames are already YUV
+            Warn("Dynamic resolution is not supported with HDR.\n");
+            m_resolutionLadder.Disable();
+        } else if (!m_NvNecoder->GetCapabilityValue(
+                       codecGuid(m_codec), NV_ENC_CAPS_SUPPORT_DYN_RES_CHANGE
+                   )) {
+            Warn("NVENC does not support dynamic resolution changes.\n");
+            m_resolutionLadder.Disable();
+        } else {
+            try {
+                m_scaler = std::make_unique<VideoScaler>(
+                    m_pD3DRender->GetDevice(),
+                    m_renderWidth,
+                    m_renderHeight,
+                    GetD3D11Format(format)
+                );
+            } catch (std::exception& e) {
+                Warn("Dynamic resolution disabled: %s\n", e.what());
+                m_resolutionLadder.Disable();
+            }
+        }
+    }
+
     NV_ENC_INITIALIZE_PARAMS initializeParams = { NV_ENC_INITIALIZE_PARAMS_VER };
     NV_ENC_CONFIG encodeConfig = { NV_ENC_CONFIG_VER };
     initializeParams.encodeConfig = &encodeConfig;
@@ -55,10 +241,20 @@ void VideoEncoderNVENC::Initialize() {
     FillEncodeConfig(
         initializeParams,
         m_refreshRate,
-        m_renderWidth,
+        encodeWidth,
         m_renderHeight,
         m_bitrateInMBits * 1'000'000L
     );
+
+    // Frames can only be overlapped in async mode, and the completion thread expects one packet
+    // per frame in submission order, so no B frames, lookahead or stereo interleaving
+    uint32_t asyncDepth = VramLimitedDepth(Settings::Instance().m_nvencAsyncDepth);
+    m_asyncEncode = asyncDepth > 1 && !m_stereoInterleave && initializeParams.enableEncodeAsync
+        && encodeConfig.frameIntervalP == 1 && encodeConfig.rcParams.lookaheadDepth == 0;
+    if (m_asyncEncode) {
+        m_NvNecoder->SetExtraOutputDelay(asyncDepth - 1);
+    }
+
     try {
         m_NvNecoder->CreateEncoder(&initializeParams);
     } catch (NVENCException e) {
@@ -70,95 +266,363 @@ void VideoEncoderNVENC::Initialize() {
         throw MakeException("NvEnc CreateEncoder failed. Code=%d %hs", e.getErrorCode(), e.what());
     }
 
-    Debug("CNvEncoder is successfully initialized.\n");
+    if (Settings::Instance().m_gazeRoiQpDelta > 0) {
+        m_qpDeltaMaps.resize(m_NvNecoder->GetEncoderBufferCount());
+    }
+
+    if (m_asyncEncode) {
+        m_completionThread = std::thread(&VideoEncoderNVENC::CompletionLoop, this);
+    }
+
+    Debug(
+        "CNvEncoder is successfully initialized. Async depth=%u\n", m_asyncEncode ? asyncDepth : 1
+    );
 }
 
 void VideoEncoderNVENC::Shutdown() {
-    std::vector<std::vector<uint8_t>> vPacket;
-    if (m_NvNecoder)
-        m_NvNecoder->EndEncode(vPacket);
-
-    for (std::vector<uint8_t>& packet : vPacket) {
-        if (fpOut) {
-            fpOut.write(reinterpret_cast<char*>(packet.data()), packet.size());
+    // Drains the frames still being encoded
+    if (m_completionThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_stopCompletion = true;
         }
+        m_pendingCv.notify_all();
+        m_completionThread.join();
+    }
+
+    if (m_NvNecoder) {
+        // The stream is over, the last packets are dropped
+        m_NvNecoder->EndEncode([](const uint8_t* data, uint32_t size) { });
     }
     if (m_NvNecoder) {
         m_NvNecoder->DestroyEncoder();
         m_NvNecoder.reset();
     }
+    m_inputSurfaces.clear();
 
     Debug("CNvEncoder::Shutdown\n");
+}
+
+bool VideoEncoderNVENC::CreateInputSurfaces(
+    const D3D11_TEXTURE2D_DESC& desc, uint32_t count, ID3D11Texture2D* surfaces[]
+) {
+    // An async frame is still read after Transmit returned, when its slot may be rendered into.
+    // Interleaved eyes are copied into half width inputs.
+    if (!m_NvNecoder || m_asyncEncode || m_stereoInterleave || desc.Width != (UINT)m_renderWidth
+        || desc.Height != (UINT)m_renderHeight
+        || !isCopyCompatible(desc.Format, GetD3D11Format(m_inputFormat))) {
+        return false;
+    }
 
-    if (fpOut) {
-        fpOut.close();
+    D3D11_TEXTURE2D_DESC surfaceDesc = desc;
+    surfaceDesc.Format = GetD3D11Format(m_inputFormat);
+    surfaceDesc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+    std::vector<InputSurface> inputSurfaces(count);
+    for (auto& surface : inputSurfaces) {
+        HRESULT hr = m_pD3DRender->GetDevice()->CreateTexture2D(
+            &surfaceDesc, nullptr, &surface.texture
+        );
+        if (FAILED(hr)) {
+            Warn("Failed to create an NVENC input surface: %p %ls\n", hr, GetErrorStr(hr).c_str());
+            return false;
+        }
+        try {
+            surface.registered = m_NvNecoder->RegisterExternalInput(
+                surface.texture.Get(), NV_ENC_INPUT_RESOURCE_TYPE_DIRECTX
+            );
+        } catch (NVENCException e) {
+            // The surfaces registered so far are unregistered with the encoder
+            Warn(
+                "Failed to register an NVENC input surface. Code=%d %hs\n",
+                e.getErrorCode(),
+                e.what()
+            );
+            return false;
+        }
+    }
+    m_inputSurfaces = std::move(inputSurfaces);
+    for (uint32_t i = 0; i < count; i++) {
+        surfaces[i] = m_inputSurfaces[i].texture.Get();
     }
+    return true;
 }
 
 void VideoEncoderNVENC::Transmit(
     ID3D11Texture2D* pTexture, uint64_t presentationTime, uint64_t targetTimestampNs, bool insertIDR
 ) {
     auto params = GetDynamicEncoderParams();
-    if (params.updated) {
-        m_bitrateInMBits = params.bitrate_bps / 1'000'000;
+    bool resized = m_resolutionLadder.Update(params);
+    const uint32_t encodeWidth = m_resolutionLadder.GetWidth() / PicturesPerFrame();
+    const uint32_t encodeHeight = m_resolutionLadder.GetHeight();
+    // A budget change only reconfigures the VBV buffer, which applies from the next frame on
+    uint32_t frameBudget = GetEncoderFrameBudget();
+    bool budgetChanged = frameBudget != m_frameBudget;
+    m_frameBudget = frameBudget;
+    float correction = m_bitrateCalibration ? m_bitrateCalibration->GetFactor() : 1.0f;
+    bool recalibrated = correction != m_bitrateCorrection;
+    m_bitrateCorrection = correction;
+    bool presetChanged = m_presetChanged;
+    m_presetChanged = false;
+    if (params.updated || resized || budgetChanged || recalibrated || presetChanged) {
+        if (params.updated) {
+            m_bitrateInMBits = params.bitrate_bps / 1'000'000;
+            m_framerate = (int)params.framerate;
+            if (m_bitrateCalibration) {
+                m_bitrateCalibration->SetTarget(params.bitrate_bps);
+            }
+        }
         NV_ENC_INITIALIZE_PARAMS initializeParams = { NV_ENC_INITIALIZE_PARAMS_VER };
         NV_ENC_CONFIG encodeConfig = { NV_ENC_CONFIG_VER };
         initializeParams.encodeConfig = &encodeConfig;
         FillEncodeConfig(
             initializeParams,
-            params.framerate,
-            m_renderWidth,
-            m_renderHeight,
-            m_bitrateInMBits * 1'000'000L
+            m_framerate,
+            encodeWidth,
+            encodeHeight,
+            (uint64_t)(m_bitrateInMBits * 1'000'000L * m_bitrateCorrection)
         );
         NV_ENC_RECONFIGURE_PARAMS reconfigureParams = { NV_ENC_RECONFIGURE_PARAMS_VER };
         reconfigureParams.reInitEncodeParams = initializeParams;
+        if (resized || presetChanged) {
+            // The frames in flight were submitted at the previous size or preset. With at most one
+            // frame of wait the new ones start on the next IDR, without rebuilding the session.
+            if (m_asyncEncode) {
+                std::unique_lock<std::mutex> lock(m_pendingMutex);
+                m_pendingCv.wait(lock, [&] { return m_pending.empty(); });
+            }
+            reconfigureParams.resetEncoder = 1;
+            reconfigureParams.forceIDR = 1;
+            insertIDR = true;
+        }
         m_NvNecoder->Reconfigure(&reconfigureParams);
     }
 
-    std::vector<std::vector<uint8_t>> vPacket;
+    if (m_stereoInterleave) {
+        TransmitStereo(pTexture, targetTimestampNs, insertIDR);
+        return;
+    }
+
+    if (m_asyncEncode) {
+        // The input texture and output buffer of the oldest frame get reused
+        std::unique_lock<std::mutex> lock(m_pendingMutex);
+        m_pendingCv.wait(lock, [&] {
+            return m_pending.size() < m_NvNecoder->GetEncoderBufferCount();
+        });
+    }
 
     const NvEncInputFrame* encoderInputFrame = m_NvNecoder->GetNextInputFrame();
 
     ID3D11Texture2D* pInputTexture
         = reinterpret_cast<ID3D11Texture2D*>(encoderInputFrame->inputPtr);
-    m_pD3DRender->GetContext()->CopyResource(pInputTexture, pTexture);
+    auto surface = std::find_if(m_inputSurfaces.begin(), m_inputSurfaces.end(), [&](auto& s) {
+        return s.texture.Get() == pTexture;
+    });
+    if (m_resolutionLadder.GetLevel() > 0) {
+        // NVENC reads the encodeWidth x encodeHeight top-left corner of its input
+        m_scaler->Scale(pTexture, pInputTexture, encodeWidth, encodeHeight);
+    } else if (surface != m_inputSurfaces.end()) {
+        m_NvNecoder->SetNextInput(surface->registered);
+    } else {
+        m_pD3DRender->GetContext()->CopyResource(pInputTexture, pTexture);
+    }
 
     NV_ENC_PIC_PARAMS picParams = {};
     if (insertIDR) {
         Debug("Inserting IDR frame.\n");
         picParams.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR;
+    } else if (m_insertIntraRefresh) {
+        Debug("Starting intra refresh.\n");
+        uint32_t frames = Settings::Instance().m_intraRefreshFrames;
+        switch (m_codec) {
+        case ALVR_CODEC_H264:
+            picParams.codecPicParams.h264PicParams.forceIntraRefreshWithFrameCnt = frames;
+            break;
+        case ALVR_CODEC_HEVC:
+            picParams.codecPicParams.hevcPicParams.forceIntraRefreshWithFrameCnt = frames;
+            break;
+        case ALVR_CODEC_AV1:
+            picParams.codecPicParams.av1PicParams.forceIntraRefreshWithFrameCnt = frames;
+            break;
+        }
+    }
+    m_insertIntraRefresh = false;
+
+    auto ltr = m_ltr.OnFrame(targetTimestampNs, insertIDR);
+    // In step with the layers, which restart at each IDR only
+    m_disposable.OnFrame(targetTimestampNs, insertIDR);
+    if (m_codec == ALVR_CODEC_H264) {
+        applyLtr(picParams.codecPicParams.h264PicParams, ltr);
+    } else if (m_codec == ALVR_CODEC_HEVC) {
+        applyLtr(picParams.codecPicParams.hevcPicParams, ltr);
     }
-    m_NvNecoder->EncodeFrame(vPacket, &picParams);
 
-    for (std::vector<uint8_t>& packet : vPacket) {
-        uint8_t* buf = packet.data();
-        int len = (int)packet.size();
+    picParams.inputTimeStamp = targetTimestampNs;
+    if (m_refInvalidation) {
+        // An IDR flushes the references
+        if (insertIDR) {
+            m_refHistory.clear();
+        }
+        m_refHistory.push_back(targetTimestampNs);
+        if (m_refHistory.size() > MAX_REF_HISTORY) {
+            m_refHistory.pop_front();
+        }
+    }
 
-        // NVENC's AV1 encoding includes a bunch of IVF wrapping,
-        // so we need to strip it down to just the OBUs
-        if (m_codec == ALVR_CODEC_AV1) {
-            const uint8_t ivf_magic[4] = { 0x44, 0x4B, 0x49, 0x46 };
-            if (len >= 4 && !memcmp(buf, ivf_magic, 4)) {
-                buf += 32;
-                len -= 32;
-            }
-            if (len <= 12) {
-                continue;
-            }
-            buf += 12; // skip past the IVF packet size header thing
-            len -= 12;
+    EncoderRoi roi;
+    if (!m_qpDeltaMaps.empty() && GetEncoderRoi(encodeWidth, encodeHeight, roi)) {
+        // One map per encoder buffer, NVENC may still read it while later frames are submitted
+        auto& map = m_qpDeltaMaps[m_nextQpDeltaMap];
+        m_nextQpDeltaMap = (m_nextQpDeltaMap + 1) % m_qpDeltaMaps.size();
+        BuildRoiQpDeltaMap(roi, encodeWidth, encodeHeight, m_qpDeltaMapBlockSize, map);
+        picParams.qpDeltaMap = map.data();
+        picParams.qpDeltaMapSize = (uint32_t)map.size();
+    }
+
+    if (m_asyncEncode) {
+        // Frame N + 1 can be accepted while NVENC is still encoding frame N, the output is sent by
+        // the completion thread
+        m_NvNecoder->SubmitFrame(&picParams);
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_pending.push_back({ targetTimestampNs, insertIDR });
         }
+        m_pendingCv.notify_all();
+        return;
+    }
+
+    // The raw bitstream is used, without the IVF wrapping NvEncoder adds to copied AV1 packets
+    m_NvNecoder->EncodeFrame(
+        [&](const uint8_t* data, uint32_t size) {
+            SendPacket(data, size, targetTimestampNs, insertIDR);
+        },
+        &picParams
+    );
+}
+
+void VideoEncoderNVENC::TransmitStereo(
+    ID3D11Texture2D* pTexture, uint64_t targetTimestampNs, bool insertIDR
+) {
+    const UINT eyeWidth = m_renderWidth / 2;
+    uint64_t frameBytes = 0;
+    for (UINT eye = 0; eye < 2; eye++) {
+        const NvEncInputFrame* encoderInputFrame = m_NvNecoder->GetNextInputFrame();
+        ID3D11Texture2D* pInputTexture
+            = reinterpret_cast<ID3D11Texture2D*>(encoderInputFrame->inputPtr);
+        D3D11_BOX box = { eye * eyeWidth, 0, 0, (eye + 1) * eyeWidth, (UINT)m_renderHeight, 1 };
+        m_pD3DRender->GetContext()->CopySubresourceRegion(
+            pInputTexture, 0, 0, 0, 0, pTexture, 0, &box
+        );
+
+        // The right eye is predicted from the left one of the same frame, only the left one is
+        // made an IDR picture
+        NV_ENC_PIC_PARAMS picParams = {};
+        bool idr = insertIDR && eye == 0;
+        if (idr) {
+            Debug("Inserting IDR frame.\n");
+            picParams.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR;
+        }
+        picParams.inputTimeStamp = targetTimestampNs;
+
+        m_NvNecoder->EncodeFrame(
+            [&](const uint8_t* data, uint32_t size) {
+                frameBytes += size;
+                SendBitstream(data, size, targetTimestampNs, idr);
+            },
+            &picParams
+        );
+    }
+    m_insertIntraRefresh = false;
+
+    if (frameBytes == 0) {
+        return;
+    }
+    if (m_bitrateCalibration) {
+        m_bitrateCalibration->OnFrame(frameBytes);
+    }
+}
+
+bool VideoEncoderNVENC::StepQualityPreset(int step) {
+    // Higher numbers are slower presets of better quality
+    int preset = m_qualityPreset + (step > 0 ? 1 : -1);
+    if (preset < 1 || preset > 7) {
+        return false;
+    }
+    m_qualityPreset = preset;
+    m_presetChanged = true;
+    return true;
+}
+
+bool VideoEncoderNVENC::InvalidateFrames(uint64_t firstTs) {
+    // Without a frame encoded before the loss, nothing valid is left to predict from
+    if (m_refHistory.empty() || m_refHistory.front() >= firstTs) {
+        return false;
+    }
+
+    while (m_refHistory.back() >= firstTs) {
+        try {
+            m_NvNecoder->InvalidateRefFrame(m_refHistory.back());
+        } catch (NVENCException e) {
+            Warn("NvEnc InvalidateRefFrame failed. Code=%d %hs\n", e.getErrorCode(), e.what());
+            return false;
+        }
+        m_refHistory.pop_back();
+    }
+    return true;
+}
+
+void VideoEncoderNVENC::SendPacket(
+    const uint8_t* data, uint32_t size, uint64_t targetTimestampNs, bool insertIDR
+) {
+    if (size == 0) {
+        return;
+    }
 
-        if (len <= 0) {
-            continue;
+    if (m_bitrateCalibration) {
+        m_bitrateCalibration->OnFrame(size);
+    }
+    SendBitstream(data, size, targetTimestampNs, insertIDR);
+}
+
+void VideoEncoderNVENC::SendBitstream(
+    const uint8_t* data, uint32_t size, uint64_t targetTimestampNs, bool insertIDR
+) {
+    if (size == 0) {
+        return;
+    }
+    // NVENC only has a few output buffers, so frames are not leased: VideoSend makes the one
+    // copy the send thread needs straight from the locked bitstream, which is unlocked once it
+    // returns
+    ParseFrameNals(m_codec, const_cast<uint8_t*>(data), (int)size, targetTimestampNs, insertIDR);
+}
+
+void VideoEncoderNVENC::CompletionLoop() {
+    ApplyThreadProfile(EncoderThreadProfile());
+
+    while (true) {
+        PendingFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_pendingMutex);
+            m_pendingCv.wait(lock, [&] { return m_stopCompletion || !m_pending.empty(); });
+            if (m_pending.empty()) {
+                break;
+            }
+            frame = m_pending.front();
         }
 
-        if (fpOut) {
-            fpOut.write(reinterpret_cast<char*>(buf), len);
+        try {
+            m_NvNecoder->GetSubmittedFrame([&](const uint8_t* data, uint32_t size) {
+                SendPacket(data, size, frame.targetTimestampNs, frame.insertIDR);
+            });
+        } catch (NVENCException e) {
+            Error("NvEnc completion failed. Code=%d %hs\n", e.getErrorCode(), e.what());
         }
 
-        ParseFrameNals(m_codec, buf, len, targetTimestampNs, insertIDR);
+        // Popped only now so that Transmit doesn't reuse the buffers of this frame early
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_pending.pop_front();
+        }
+        m_pendingCv.notify_all();
     }
 }
 
@@ -187,7 +651,7 @@ void VideoEncoderNVENC::FillEncodeConfig(
     GUID qualityPreset;
     // See recommended NVENC settings for low-latency encoding.
     // https://docs.nvidia.com/video-technologies/video-codec-sdk/nvenc-video-encoder-api-prog-guide/#recommended-nvenc-settings
-    switch (Settings::Instance().m_nvencQualityPreset) {
+    switch (m_qualityPreset) {
     case 7:
         qualityPreset = NV_ENC_PRESET_P7_GUID;
         break;
@@ -219,9 +683,15 @@ void VideoEncoderNVENC::FillEncodeConfig(
         &initializeParams, encoderGUID, qualityPreset, tuningPreset
     );
 
+    uint32_t slicesPerFrame = Settings::Instance().m_encoderSlicesPerFrame;
+    uint32_t maxSliceBytes = Settings::Instance().m_encoderMaxSliceBytes;
+
     initializeParams.encodeWidth = initializeParams.darWidth = renderWidth;
     initializeParams.encodeHeight = initializeParams.darHeight = renderHeight;
-    initializeParams.frameRateNum = refreshRate;
+    // The resolution ladder reconfigures to sizes up to the renderer output
+    initializeParams.maxEncodeWidth = m_renderWidth / PicturesPerFrame();
+    initializeParams.maxEncodeHeight = m_renderHeight;
+    initializeParams.frameRateNum = refreshRate * PicturesPerFrame();
     initializeParams.frameRateDen = 1;
 
     if (Settings::Instance().m_nvencRefreshRate != -1) {
@@ -239,6 +709,11 @@ void VideoEncoderNVENC::FillEncodeConfig(
     if (Settings::Instance().m_nvencMaxNumRefFrames != -1) {
         maxNumRefFrames = Settings::Instance().m_nvencMaxNumRefFrames;
     }
+    // Each eye is predicted from the other eye of the same frame and from itself in the previous
+    // frame, two pictures back
+    if (m_stereoInterleave && maxNumRefFrames < 2) {
+        maxNumRefFrames = 2;
+    }
     if (Settings::Instance().m_nvencGopLength != -1) {
         gopLength = Settings::Instance().m_nvencGopLength;
     }
@@ -255,6 +730,10 @@ void VideoEncoderNVENC::FillEncodeConfig(
         if (Settings::Instance().m_nvencIntraRefreshCount != -1) {
             config.intraRefreshCnt = Settings::Instance().m_nvencIntraRefreshCount;
         }
+        if (m_intraRefresh) {
+            enableRecoveryRefresh(config, refreshRate);
+            config.outputRecoveryPointSEI = 1;
+        }
 
         switch (Settings::Instance().m_entropyCoding) {
         case ALVR_CABAC:
@@ -266,12 +745,49 @@ void VideoEncoderNVENC::FillEncodeConfig(
         }
 
         config.maxNumRefFrames = maxNumRefFrames;
+        if (m_stereoInterleave) {
+            config.numRefL0 = NV_ENC_NUM_REF_FRAMES_2;
+        }
         config.idrPeriod = gopLength;
+        if (m_ltr.IsEnabled()) {
+            enableManualLtr(config);
+        }
+
+        if (maxSliceBytes > 0) {
+            config.sliceMode = 1; // maximum number of bytes per slice
+            config.sliceModeData = maxSliceBytes;
+        } else if (slicesPerFrame > 1) {
+            config.sliceMode = 3; // fixed number of slices per picture
+            config.sliceModeData = slicesPerFrame;
+        }
+
+        if (m_temporalLayers.IsEnabled()) {
+            uint32_t layers = m_temporalLayers.GetLayerCount();
+            config.enableTemporalSVC = 1;
+            config.numTemporalLayers = layers;
+            config.maxTemporalLayers = layers;
+            // The layer of a frame follows from the fixed pattern, no prefix units are needed
+            config.disableSVCPrefixNalu = 1;
+            // NVENC needs (layers - 2) * 2 references for the pattern
+            if (maxNumRefFrames != 0 && maxNumRefFrames < (layers - 2) * 2) {
+                config.maxNumRefFrames = (layers - 2) * 2;
+            }
+        }
 
         if (Settings::Instance().m_fillerData) {
             config.enableFillerDataInsertion = Settings::Instance().m_rateControlMode == ALVR_CBR;
         }
 
+        if (m_chroma444) {
+            encodeConfig.profileGUID = NV_ENC_H264_PROFILE_HIGH_444_GUID;
+            config.chromaFormatIDC = 3;
+        } else if (Settings::Instance().m_encoderChroma444) {
+            // The fallback tells the client where the chroma samples are to upsample them
+            config.h264VUIParameters.chromaSampleLocationFlag = 1;
+            config.h264VUIParameters.chromaSampleLocationTop = 0;
+            config.h264VUIParameters.chromaSampleLocationBot = 0;
+        }
+
         config.h264VUIParameters.videoSignalTypePresentFlag = 1;
         config.h264VUIParameters.videoFormat = NV_ENC_VUI_VIDEO_FORMAT_UNSPECIFIED;
         config.h264VUIParameters.videoFullRangeFlag = 1;
@@ -299,9 +815,27 @@ void VideoEncoderNVENC::FillEncodeConfig(
         if (Settings::Instance().m_nvencIntraRefreshCount != -1) {
             config.intraRefreshCnt = Settings::Instance().m_nvencIntraRefreshCount;
         }
+        if (m_intraRefresh) {
+            enableRecoveryRefresh(config, refreshRate);
+            config.outputRecoveryPointSEI = 1;
+        }
 
         config.maxNumRefFramesInDPB = maxNumRefFrames;
+        if (m_stereoInterleave) {
+            config.numRefL0 = NV_ENC_NUM_REF_FRAMES_2;
+        }
         config.idrPeriod = gopLength;
+        if (m_ltr.IsEnabled()) {
+            enableManualLtr(config);
+        }
+
+        if (maxSliceBytes > 0) {
+            config.sliceMode = 1; // maximum number of bytes per slice
+            config.sliceModeData = maxSliceBytes;
+        } else if (slicesPerFrame > 1) {
+            config.sliceMode = 3; // fixed number of slices per picture
+            config.sliceModeData = slicesPerFrame;
+        }
 
         if (Settings::Instance().m_use10bitEncoder) {
             encodeConfig.encodeCodecConfig.hevcConfig.pixelBitDepthMinus8 = 2;
@@ -311,6 +845,15 @@ void VideoEncoderNVENC::FillEncodeConfig(
             config.enableFillerDataInsertion = Settings::Instance().m_rateControlMode == ALVR_CBR;
         }
 
+        if (m_chroma444) {
+            encodeConfig.profileGUID = NV_ENC_HEVC_PROFILE_FREXT_GUID;
+            config.chromaFormatIDC = 3;
+        } else if (Settings::Instance().m_encoderChroma444) {
+            config.hevcVUIParameters.chromaSampleLocationFlag = 1;
+            config.hevcVUIParameters.chromaSampleLocationTop = 0;
+            config.hevcVUIParameters.chromaSampleLocationBot = 0;
+        }
+
         config.hevcVUIParameters.videoSignalTypePresentFlag = 1;
         config.hevcVUIParameters.videoFormat = NV_ENC_VUI_VIDEO_FORMAT_UNSPECIFIED;
         config.hevcVUIParameters.videoFullRangeFlag = 1;
@@ -330,6 +873,17 @@ void VideoEncoderNVENC::FillEncodeConfig(
     case ALVR_CODEC_AV1: {
         auto& config = encodeConfig.encodeCodecConfig.av1Config;
         config.repeatSeqHdr = 1;
+        if (maxSliceBytes > 0) {
+            Warn("NVENC AV1 has no slices capped in bytes, ignoring the maximum slice size.\n");
+        }
+        // Uniform tiles, all in one tile group as NVENC has no tile group control. 0 leaves the
+        // fewest tiles the resolution allows.
+        if (Settings::Instance().m_encoderAv1TileColumns > 1) {
+            config.numTileColumns = Settings::Instance().m_encoderAv1TileColumns;
+        }
+        if (Settings::Instance().m_encoderAv1TileRows > 1) {
+            config.numTileRows = Settings::Instance().m_encoderAv1TileRows;
+        }
         config.enableIntraRefresh = Settings::Instance().m_nvencEnableIntraRefresh;
 
         if (Settings::Instance().m_nvencIntraRefreshPeriod != -1) {
@@ -338,6 +892,9 @@ void VideoEncoderNVENC::FillEncodeConfig(
         if (Settings::Instance().m_nvencIntraRefreshCount != -1) {
             config.intraRefreshCnt = Settings::Instance().m_nvencIntraRefreshCount;
         }
+        if (m_intraRefresh) {
+            enableRecoveryRefresh(config, refreshRate);
+        }
 
         config.maxNumRefFramesInDPB = maxNumRefFrames;
         config.idrPeriod = gopLength;
@@ -390,7 +947,9 @@ void VideoEncoderNVENC::FillEncodeConfig(
             = Settings::Instance().m_nvencLowDelayKeyFrameScale;
     }
 
-    uint32_t maxFrameSize = static_cast<uint32_t>(bitrate_bps / refreshRate);
+    // Sized per picture, an interleaved frame is two of them
+    uint32_t maxFrameSize
+        = static_cast<uint32_t>(bitrate_bps / (refreshRate * PicturesPerFrame()));
     Debug("VideoEncoderNVENC: maxFrameSize=%d bits\n", maxFrameSize);
     encodeConfig.rcParams.vbvBufferSize = maxFrameSize * 1.1;
     encodeConfig.rcParams.vbvInitialDelay = maxFrameSize * 1.1;
@@ -418,4 +977,28 @@ void VideoEncoderNVENC::FillEncodeConfig(
     if (Settings::Instance().m_nvencRcAverageBitrate != -1) {
         encodeConfig.rcParams.averageBitRate = Settings::Instance().m_nvencRcAverageBitrate;
     }
+
+    if (Settings::Instance().m_gazeRoiQpDelta > 0) {
+        // The map has one value per MB for h264, per CTB for HEVC and per SB for AV1
+        encodeConfig.rcParams.qpMapMode = NV_ENC_QP_MAP_DELTA;
+        switch (m_codec) {
+        case ALVR_CODEC_H264:
+            m_qpDeltaMapBlockSize = 16;
+            break;
+        case ALVR_CODEC_HEVC:
+            encodeConfig.encodeCodecConfig.hevcConfig.maxCUSize = NV_ENC_HEVC_CUSIZE_32x32;
+            m_qpDeltaMapBlockSize = 32;
+            break;
+        case ALVR_CODEC_AV1:
+            m_qpDeltaMapBlockSize = 64;
+            break;
+        }
+    }
+
+    // The VBV buffer only shrinks while congested
+    uint32_t pictureBudget = m_frameBudget / PicturesPerFrame();
+    if (pictureBudget > 0 && pictureBudget * 8 < encodeConfig.rcParams.vbvBufferSize) {
+        encodeConfig.rcParams.vbvBufferSize = pictureBudget * 8;
+        encodeConfig.rcParams.vbvInitialDelay = pictureBudget * 8;
+    }
 }
@@ -5,8 +5,18 @@
 
 #include "NvEncoderD3D11.h"
 #include "VideoEncoder.h"
+#include "VideoScaler.h"
+#include "alvr_server/DisposableFrames.h"
+#include "alvr_server/LtrManager.h"
+#include "alvr_server/ResolutionLadder.h"
+#include "alvr_server/TemporalLayers.h"
 #include "shared/d3drender.h"
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 enum AdaptiveQuantizationMode { SpatialAQ = 1, TemporalAQ = 2 };
 
@@ -26,7 +36,37 @@ public:
         bool insertIDR
     );
 
+    bool SupportsIntraRefresh() { return m_intraRefresh; }
+    void InsertIntraRefresh() { m_insertIntraRefresh = true; }
+
+    bool SupportsRefInvalidation() { return m_refInvalidation; }
+    bool InvalidateFrames(uint64_t firstTs);
+
+    bool SupportsLtrRecovery() { return m_ltr.IsEnabled(); }
+    bool RecoverWithLtr() { return m_ltr.Recover(); }
+    void AcknowledgeFrame(uint64_t targetTimestampNs) { m_ltr.Acknowledge(targetTimestampNs); }
+    bool SupportsBitrateCalibration() { return true; }
+    bool StepQualityPreset(int step);
+
+    bool CreateInputSurfaces(
+        const D3D11_TEXTURE2D_DESC& desc, uint32_t count, ID3D11Texture2D* surfaces[]
+    );
+
 private:
+    struct PendingFrame {
+        uint64_t targetTimestampNs;
+        bool insertIDR;
+    };
+
+    void SendPacket(const uint8_t* data, uint32_t size, uint64_t targetTimestampNs, bool insertIDR);
+    // Sends an encoded picture, without the per frame bookkeeping of SendPacket
+    void SendBitstream(
+        const uint8_t* data, uint32_t size, uint64_t targetTimestampNs, bool insertIDR
+    );
+    void CompletionLoop();
+    void TransmitStereo(ID3D11Texture2D* pTexture, uint64_t targetTimestampNs, bool insertIDR);
+    uint32_t PicturesPerFrame() { return m_stereoInterleave ? 2 : 1; }
+
     void FillEncodeConfig(
         NV_ENC_INITIALIZE_PARAMS& initializeParams,
         int refreshRate,
@@ -35,7 +75,6 @@ private:
         uint64_t bitrate_bps
     );
 
-    std::ofstream fpOut;
     std::shared_ptr<NvEncoder> m_NvNecoder;
 
     std::shared_ptr<CD3DRender> m_pD3DRender;
@@ -45,4 +84,62 @@ private:
     int m_renderWidth;
     int m_renderHeight;
     int m_bitrateInMBits;
+    int m_framerate;
+    // Budget of SetEncoderFrameBudget the encoder was last configured with, in bytes
+    uint32_t m_frameBudget = 0;
+    // Bitrate calibration factor the encoder was last configured with
+    float m_bitrateCorrection = 1.0f;
+    // P1 to P7, from nvenc_quality_preset and then StepQualityPreset
+    int m_qualityPreset;
+    bool m_presetChanged = false;
+    // Full resolution chroma, see encoder_chroma_444. NVENC converts the RGB input itself.
+    bool m_chroma444 = false;
+    // Loss recovery with forced intra refresh waves
+    bool m_intraRefresh;
+    bool m_insertIntraRefresh;
+
+    // Loss recovery with reference invalidation. Frames are encoded with their target timestamp
+    // as input timestamp, which is how NVENC identifies the frames to invalidate. The history
+    // holds the frames since the last IDR that may still be references, oldest first.
+    static const size_t MAX_REF_HISTORY = 16;
+    bool m_refInvalidation;
+    std::deque<uint64_t> m_refHistory;
+
+    // Loss recovery from acknowledged long-term references, H264 and HEVC only
+    LtrManager m_ltr;
+
+    // Temporal SVC, H264 only
+    TemporalLayers m_temporalLayers;
+    // The top temporal layer, NVENC ignores the reference flag of the pictures it types itself
+    DisposableFrames m_disposable;
+
+    // Lower resolution encodes at low bitrates, scaled into the full size input textures
+    ResolutionLadder m_resolutionLadder;
+    std::unique_ptr<VideoScaler> m_scaler;
+
+    // The CEncoder frame slots, encoded in place at full resolution, see CreateInputSurfaces
+    struct InputSurface {
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+        NV_ENC_REGISTERED_PTR registered = nullptr;
+    };
+    NV_ENC_BUFFER_FORMAT m_inputFormat = NV_ENC_BUFFER_FORMAT_ABGR;
+    std::vector<InputSurface> m_inputSurfaces;
+
+    // See nvenc_stereo_interleave: the eyes are encoded as two half width pictures, left first,
+    // so that the right one is predicted from the left one. Both are sent with the frame
+    // timestamp, in two VideoSend calls.
+    bool m_stereoInterleave = false;
+
+    // Async mode: Transmit submits frames and m_completionThread sends them once encoded
+    bool m_asyncEncode;
+    std::thread m_completionThread;
+    std::mutex m_pendingMutex;
+    std::condition_variable m_pendingCv;
+    std::deque<PendingFrame> m_pending;
+    bool m_stopCompletion;
+
+    // Gaze ROI QP delta maps, used in turn by the frames in flight
+    std::vector<std::vector<int8_t>> m_qpDeltaMaps;
+    uint32_t m_qpDeltaMapBlockSize;
+    size_t m_nextQpDeltaMap;
 };
@@ -5,12 +5,15 @@
 
 #include "VideoEncoderSW.h"
 
+#include "alvr_server/FrameTrace.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
 #include "alvr_server/Utils.h"
+#include "alvr_server/VideoBufferLease.h"
 
 #include <algorithm>
 #include <array>
+#include <delayimp.h>
 #include <iostream>
 #include <string>
 
@@ -41,6 +44,15 @@ void VideoEncoderSW::Initialize() {
     int err;
     Debug("Initializing VideoEncoderSW.\n");
 
+#ifdef ALVR_FFMPEG_DLLS
+    // Delay loaded, see build.rs
+    for (const char* dll : { ALVR_FFMPEG_DLLS }) {
+        if (FAILED(__HrLoadAllImportsForDll(dll))) {
+            throw MakeException("Failed to load %s", dll);
+        }
+    }
+#endif
+
     const auto& settings = Settings::Instance();
 
     // Query codec
@@ -102,6 +114,12 @@ void VideoEncoderSW::Initialize() {
     }
     m_codecContext->max_b_frames = 0;
     m_codecContext->gop_size = 0;
+    if (settings.m_intraRefreshFrames > 0) {
+        // With intra refresh the keyframe interval is the length of a refresh wave, x264 then
+        // never sends an IDR on its own
+        av_dict_set(&opt, "intra-refresh", "1", 0);
+        m_codecContext->gop_size = settings.m_intraRefreshFrames;
+    }
     m_codecContext->bit_rate = m_bitrateInMBits * 1'000'000L;
     m_codecContext->rc_buffer_size = m_codecContext->bit_rate / settings.m_refreshRate * 1.1;
     switch (settings.m_rateControlMode) {
@@ -116,6 +134,10 @@ void VideoEncoderSW::Initialize() {
     }
     m_codecContext->rc_max_rate = m_codecContext->bit_rate;
     m_codecContext->thread_count = settings.m_swThreadCount;
+    // x264 only leaves B frames unreferenced, and the stream has none
+    if (settings.m_encoderDisposableFrames > 0) {
+        Warn("Disposable frames are not supported by the software encoder");
+    }
 
     if ((err = avcodec_open2(m_codecContext, codec, &opt)))
         throw MakeException("Cannot open video encoder codec: %d", err);
@@ -146,6 +168,10 @@ void VideoEncoderSW::Shutdown() {
     Debug("Successfully shutdown VideoEncoderSW.\n");
 }
 
+bool VideoEncoderSW::SupportsIntraRefresh() {
+    return Settings::Instance().m_intraRefreshFrames > 0;
+}
+
 void VideoEncoderSW::Transmit(
     ID3D11Texture2D* pTexture, uint64_t presentationTime, uint64_t targetTimestampNs, bool insertIDR
 ) {
@@ -158,28 +184,57 @@ void VideoEncoderSW::Transmit(
         m_codecContext->rc_max_rate = m_codecContext->bit_rate;
     }
 
-    // Setup staging texture if not defined yet; we can only define it here as we now have the
+    // Setup staging textures if not defined yet; we can only define them here as we now have the
     // texture's size
-    if (!m_stagingTex) {
-        HRESULT hr = SetupStagingTexture(pTexture);
+    if (!m_staging[0].texture) {
+        HRESULT hr = SetupStagingTextures(pTexture);
         if (FAILED(hr)) {
             Error("Failed to create staging texture: %p %ls", hr, GetErrorStr(hr).c_str());
             return;
         }
-        Debug("Success in creating staging texture");
+        Debug("Success in creating staging textures");
     }
 
-    // Copy texture and map it to memory
     /// SteamVR crashes if the swapchain textures are set to staging, which is needed to be read by
     /// the CPU. Unless there's another solution we have to copy the texture every time, which is
     /// gonna be another performance hit.
-    HRESULT hr = CopyTexture(pTexture);
-    if (FAILED(hr)) {
-        Error("Failed to copy texture to staging: %p %ls", hr, GetErrorStr(hr).c_str());
-        return;
+    StagingSlot& written = m_staging[(m_stagingRead + m_stagingPending) % STAGING_RING_SIZE];
+    m_d3dRender->GetContext()->CopyResource(written.texture.Get(), pTexture);
+    // Starts the copy now, the map of the previous frame below doesn't wait for it
+    m_d3dRender->GetContext()->Flush();
+    written.targetTimestampNs = targetTimestampNs;
+    written.insertIDR = insertIDR;
+    m_stagingPending++;
+
+    // The newest frame is left to the GPU, the CPU encodes the one before it meanwhile. A copy
+    // still running is left for the next frame too, unless the ring is full.
+    while (m_stagingPending > 1) {
+        StagingSlot& slot = m_staging[m_stagingRead];
+        D3D11_MAPPED_SUBRESOURCE map;
+        HRESULT hr = m_d3dRender->GetContext()->Map(
+            slot.texture.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &map
+        );
+        if (hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+            if (m_stagingPending < STAGING_RING_SIZE) {
+                break;
+            }
+            hr = m_d3dRender->GetContext()->Map(slot.texture.Get(), 0, D3D11_MAP_READ, 0, &map);
+        }
+        m_stagingRead = (m_stagingRead + 1) % STAGING_RING_SIZE;
+        m_stagingPending--;
+        if (FAILED(hr)) {
+            Error("Failed to map staging texture: %p %ls", hr, GetErrorStr(hr).c_str());
+            continue;
+        }
+
+        EncodeMapped(map, slot.targetTimestampNs, slot.insertIDR);
+        m_d3dRender->GetContext()->Unmap(slot.texture.Get(), 0);
     }
-    // Debug("Success in mapping staging texture");
+}
 
+void VideoEncoderSW::EncodeMapped(
+    const D3D11_MAPPED_SUBRESOURCE& map, uint64_t targetTimestampNs, bool insertIDR
+) {
     AVPixelFormat inputFormat = AV_PIX_FMT_RGBA;
     if (Settings::Instance().m_enableHdr) {
         inputFormat
@@ -203,17 +258,17 @@ void VideoEncoderSW::Transmit(
         );
         if (!m_scalerContext) {
             Error("Couldn't initialize SWScaler.");
-            m_d3dRender->GetContext()->Unmap(m_stagingTex.Get(), 0);
             return;
         }
         Debug("Successfully initialized SWScaler.");
     }
 
-    // We got the texture, populate tansferredFrame with data
+    // We got the texture, populate tansferredFrame with data. SWScaler reads the mapped staging
+    // memory directly, there is no row copy in between.
     m_transferredFrame->width = m_stagingTexDesc.Width;
     m_transferredFrame->height = m_stagingTexDesc.Height;
-    m_transferredFrame->data[0] = (uint8_t*)m_stagingTexMap.pData;
-    m_transferredFrame->linesize[0] = m_stagingTexMap.RowPitch;
+    m_transferredFrame->data[0] = (uint8_t*)map.pData;
+    m_transferredFrame->linesize[0] = map.RowPitch;
     m_transferredFrame->format = inputFormat;
     m_transferredFrame->pts = targetTimestampNs;
 
@@ -229,10 +284,10 @@ void VideoEncoderSW::Transmit(
         )
         == 0) {
         Error("SWScale failed.");
-        m_d3dRender->GetContext()->Unmap(m_stagingTex.Get(), 0);
         return;
     }
     // Debug("SWScale succeeded.");
+    FrameTraceMark(targetTimestampNs, FRAME_TRACE_FORMAT_CONVERT);
 
     // Send frame for encoding
     m_encoderFrame->pict_type = insertIDR ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
@@ -241,7 +296,6 @@ void VideoEncoderSW::Transmit(
     int err;
     if ((err = avcodec_send_frame(m_codecContext, m_encoderFrame)) < 0) {
         Error("Encoding frame failed: err code %d", err);
-        m_d3dRender->GetContext()->Unmap(m_stagingTex.Get(), 0);
         return;
     }
     // Debug("Send frame succeeded.");
@@ -256,19 +310,22 @@ void VideoEncoderSW::Transmit(
         }
         // Send encoded frame to client
         bool isIdr = (packet->flags & AV_PKT_FLAG_KEY) != 0;
-        ParseFrameNals(m_codec, packet->data, packet->size, packet->pts, isIdr);
+        ParseFrameNalsLeased(
+            m_codec,
+            packet->data,
+            packet->size,
+            packet->pts,
+            isIdr,
+            [packet]() mutable { av_packet_free(&packet); }
+        );
         // Debug("Sent encoded packet to client");
-        av_packet_free(&packet);
     }
     if (err == AVERROR(EINVAL)) {
         Error("Received encoded frame failed: err code %d", err);
     }
-
-    // Unmap the copied texture and delete it
-    m_d3dRender->GetContext()->Unmap(m_stagingTex.Get(), 0);
 }
 
-HRESULT VideoEncoderSW::SetupStagingTexture(ID3D11Texture2D* pTexture) {
+HRESULT VideoEncoderSW::SetupStagingTextures(ID3D11Texture2D* pTexture) {
     D3D11_TEXTURE2D_DESC desc;
     pTexture->GetDesc(&desc);
     m_stagingTexDesc.Width = desc.Width;
@@ -282,14 +339,18 @@ HRESULT VideoEncoderSW::SetupStagingTexture(ID3D11Texture2D* pTexture) {
     m_stagingTexDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
     m_stagingTexDesc.MiscFlags = 0;
 
-    return m_d3dRender->GetDevice()->CreateTexture2D(&m_stagingTexDesc, nullptr, &m_stagingTex);
-}
-
-HRESULT VideoEncoderSW::CopyTexture(ID3D11Texture2D* pTexture) {
-    m_d3dRender->GetContext()->CopyResource(m_stagingTex.Get(), pTexture);
-    return m_d3dRender->GetContext()->Map(
-        m_stagingTex.Get(), 0, D3D11_MAP_READ, 0, &m_stagingTexMap
-    );
+    for (auto& slot : m_staging) {
+        HRESULT hr = m_d3dRender->GetDevice()->CreateTexture2D(
+            &m_stagingTexDesc, nullptr, &slot.texture
+        );
+        if (FAILED(hr)) {
+            for (auto& created : m_staging) {
+                created.texture.Reset();
+            }
+            return hr;
+        }
+    }
+    return S_OK;
 }
 
 AVCodecID VideoEncoderSW::ToFFMPEGCodec(ALVR_CODEC codec) {
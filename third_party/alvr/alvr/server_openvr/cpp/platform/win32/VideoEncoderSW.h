@@ -39,19 +39,35 @@ public:
         uint64_t targetTimestampNs,
         bool insertIDR
     );
-    HRESULT SetupStagingTexture(ID3D11Texture2D* pTexture);
-    HRESULT CopyTexture(ID3D11Texture2D* pTexture);
+    // x264 refreshes continuously, so recovery needs no keyframe
+    bool SupportsIntraRefresh();
 
 private:
+    // Frames are read back through a ring, so that the CPU encodes one frame while the GPU
+    // copies the next one instead of stalling on the map
+    static constexpr uint32_t STAGING_RING_SIZE = 3;
+    struct StagingSlot {
+        ComPtr<ID3D11Texture2D> texture;
+        uint64_t targetTimestampNs = 0;
+        bool insertIDR = false;
+    };
+
+    HRESULT SetupStagingTextures(ID3D11Texture2D* pTexture);
+    void EncodeMapped(
+        const D3D11_MAPPED_SUBRESOURCE& map, uint64_t targetTimestampNs, bool insertIDR
+    );
+
     std::shared_ptr<CD3DRender> m_d3dRender;
 
     AVCodecContext* m_codecContext;
     AVFrame *m_transferredFrame, *m_encoderFrame;
     SwsContext* m_scalerContext = nullptr;
 
-    ComPtr<ID3D11Texture2D> m_stagingTex;
+    StagingSlot m_staging[STAGING_RING_SIZE];
     D3D11_TEXTURE2D_DESC m_stagingTexDesc;
-    D3D11_MAPPED_SUBRESOURCE m_stagingTexMap;
+    // Oldest copied frame not encoded yet, and the number of them
+    uint32_t m_stagingRead = 0;
+    uint32_t m_stagingPending = 0;
 
     ALVR_CODEC m_codec;
     int m_refreshRate;
@@ -4,7 +4,11 @@
 #include "VideoEncoderVPL.h"
 #include "alvr_server/Logger.h"
 #include "alvr_server/Settings.h"
+#include "alvr_server/ThreadProfiles.h"
 #include "alvr_server/Utils.h"
+#include "alvr_server/VramBudget.h"
+#include <algorithm>
+#include <chrono>
 
 #define VPLVERSION(major, minor) (major << 16 | minor)
 #define MAJOR_API_VERSION_REQUIRED 2
@@ -36,7 +40,8 @@ VideoEncoderVPL::VideoEncoderVPL(std::shared_ptr<CD3DRender> pD3DRender, int wid
     : m_pD3DRender(pD3DRender)
     , m_renderWidth(width)
     , m_renderHeight(height)
-    , m_bitrateInMBits(30) {
+    , m_bitrateInMBits(30)
+    , m_resolutionLadder(width, height) {
     VPL_DEBUG("constructed");
 }
 
@@ -46,104 +51,235 @@ void VideoEncoderVPL::Initialize() {
     VPL_DEBUG("initialize");
 
     ChooseParams();
-    InitTransferTex();
+    if (m_resolutionLadder.IsEnabled() && Settings::Instance().m_enableHdr) {
+        // The video processor scales RGB, HDR frames are already YUV
+        VPL_WARN("dynamic resolution is not supported with HDR");
+        m_resolutionLadder.Disable();
+    } else if (m_resolutionLadder.IsEnabled()) {
+        try {
+            m_scaler = std::make_unique<VideoScaler>(
+                m_pD3DRender->GetDevice(), m_renderWidth, m_renderHeight, m_dxColorFormat
+            );
+        } catch (std::exception& e) {
+            VPL_WARN("dynamic resolution disabled: %s", e.what());
+            m_resolutionLadder.Disable();
+        }
+    }
+    if (m_ltr.IsEnabled() && m_codec == ALVR_CODEC_AV1) {
+        // mfxExtAVCRefListCtrl is only read by the AVC and HEVC encoders
+        VPL_WARN("long-term references are not supported with AV1");
+        m_ltr.Disable();
+    }
     InitVpl();
     InitVplEncode();
+    InitTransferTex();
+    InitBitstreams();
 
-    // Prepare output bitstream
-    m_vplBitstream.MaxLength = m_renderWidth * m_renderHeight * 8;
-    m_vplBitstream.Data = (mfxU8*)calloc(m_vplBitstream.MaxLength, sizeof(mfxU8));
+    m_syncThread = std::thread(&VideoEncoderVPL::SyncLoop, this);
 }
 
 void VideoEncoderVPL::Shutdown() {
     VPL_DEBUG("shutdown");
 
+    if (m_syncThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_stopSync = true;
+        }
+        m_pendingCv.notify_all();
+        m_syncThread.join();
+    }
+
     MFXVideoENCODE_Close(m_vplSession);
-    MFXClose(m_vplSession);
 
-    if (m_vplBitstream.Data)
-        free(m_vplBitstream.Data);
+    for (auto& slot : m_slots) {
+        if (slot.surface) {
+            slot.surface->FrameInterface->Release(slot.surface);
+        }
+        if (slot.bitstream.Data) {
+            free(slot.bitstream.Data);
+        }
+    }
+    m_slots.clear();
+
+    MFXClose(m_vplSession);
 
     if (m_vplLoader)
         MFXUnload(m_vplLoader);
 }
 
+bool VideoEncoderVPL::StepQualityPreset(int step) {
+    // The target usages go from 1, the best quality, to 7, the best speed
+    mfxU32 preset = m_vplQualityPreset + (step > 0 ? -1 : 1);
+    if (preset < MFX_TARGETUSAGE_BEST_QUALITY || preset > MFX_TARGETUSAGE_BEST_SPEED) {
+        return false;
+    }
+    m_vplQualityPreset = preset;
+    m_presetChanged = true;
+    return true;
+}
+
 void VideoEncoderVPL::Transmit(
     ID3D11Texture2D* pTexture, uint64_t presentationTime, uint64_t targetTimestampNs, bool insertIDR
 ) {
     // VPL_DEBUG("transmit");
 
     auto dynParams = GetDynamicEncoderParams();
-    if (dynParams.updated) {
-        m_vplEncodeParams.mfx.TargetKbps = dynParams.bitrate_bps / 1000;
+    bool resized = m_resolutionLadder.Update(dynParams);
+    bool presetChanged = m_presetChanged;
+    m_presetChanged = false;
+    if (dynParams.updated || resized || presetChanged) {
+        // Reset drops the frames in flight
+        WaitForPendingFrames();
+        if (dynParams.updated) {
+            m_vplEncodeParams.mfx.TargetKbps = dynParams.bitrate_bps / 1000;
+        }
+        // The surfaces keep their full size, only the crop is encoded. A new crop starts a new
+        // sequence.
+        m_vplEncodeParams.mfx.FrameInfo.CropW = m_resolutionLadder.GetWidth();
+        m_vplEncodeParams.mfx.FrameInfo.CropH = m_resolutionLadder.GetHeight();
+        m_vplEncodeParams.mfx.TargetUsage = m_vplQualityPreset;
         MFXVideoENCODE_Reset(m_vplSession, &m_vplEncodeParams);
+        insertIDR |= resized || presetChanged;
     }
 
-    auto encSurface = VplImportTexture(pTexture);
+    // Slots complete in submission order, so the next one is free once less than all of them
+    // are pending
+    {
+        std::unique_lock<std::mutex> lock(m_pendingMutex);
+        m_pendingCv.wait(lock, [&] { return m_pending.size() < m_slots.size(); });
+    }
+    Slot& slot = m_slots[m_nextSlot];
+    m_nextSlot = (m_nextSlot + 1) % m_slots.size();
+
+    if (m_resolutionLadder.GetLevel() > 0) {
+        m_scaler->Scale(
+            pTexture,
+            slot.transferTex.p,
+            m_resolutionLadder.GetWidth(),
+            m_resolutionLadder.GetHeight()
+        );
+    } else {
+        m_pD3DRender->GetContext()->CopyResource(slot.transferTex.p, pTexture);
+    }
 
-    mfxEncodeCtrl encodeCtrl = {};
-    encodeCtrl.FrameType = insertIDR ? MFX_FRAMETYPE_IDR : 0;
+    mfxFrameSurface1* encSurface = slot.surface;
+    if (!m_sharedSurfaces) {
+        encSurface = VplImportTexture(
+            slot.transferTex.p, MFX_SURFACE_FLAG_IMPORT_SHARED | MFX_SURFACE_FLAG_IMPORT_COPY
+        );
+        VERIFY(encSurface != nullptr, "texture import failed");
+    }
 
-    mfxStatus sts = MFX_ERR_NONE;
-    mfxSyncPoint syncp = {};
-    bool isEncGoing = true;
-    bool isDraining = false;
+    // The control and bitstream must stay untouched until the frame has been synced
+    slot.encodeCtrl = {};
+    slot.encodeCtrl.FrameType = insertIDR ? MFX_FRAMETYPE_IDR : 0;
+    encSurface->Data.FrameOrder = m_frameOrder;
+    auto ltr = m_ltr.OnFrame(targetTimestampNs, insertIDR);
+    ApplyLtr(slot, ltr);
+    // Golden and recovery frames must stay references
+    bool reference = insertIDR || ltr.markSlot >= 0 || ltr.useSlot >= 0;
+    if (m_disposable.OnFrame(targetTimestampNs, reference)) {
+        slot.encodeCtrl.FrameType = MFX_FRAMETYPE_P;
+    }
+    m_frameOrder++;
+    slot.targetTimestampNs = targetTimestampNs;
+    slot.insertIDR = insertIDR;
+    slot.syncp = nullptr;
 
-    while (isEncGoing) {
-        isDraining = encSurface == nullptr;
+    mfxStatus sts;
+    while (true) {
         sts = MFXVideoENCODE_EncodeFrameAsync(
-            m_vplSession, &encodeCtrl, encSurface, &m_vplBitstream, &syncp
+            m_vplSession, &slot.encodeCtrl, encSurface, &slot.bitstream, &slot.syncp
         );
-
-        if (encSurface) {
-            VPL_VERIFY(encSurface->FrameInterface->Release(encSurface));
-            encSurface = nullptr;
+        if (sts != MFX_WRN_DEVICE_BUSY) {
+            break;
         }
+        VPL_DEBUG("device busy");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    if (!m_sharedSurfaces) {
+        VPL_VERIFY(encSurface->FrameInterface->Release(encSurface));
+    }
 
-        switch (sts) {
-        case MFX_ERR_NONE:
-            // MFX_ERR_NONE and syncp indicate output is available
-            if (syncp) {
-                // Encode output is not available on CPU until sync operation completes
-                do {
-                    sts = MFXVideoCORE_SyncOperation(m_vplSession, syncp, WAIT_100_MILLISECONDS);
-                    if (MFX_ERR_NONE == sts) {
-                        ParseFrameNals(
-                            m_codec,
-                            reinterpret_cast<uint8_t*>(
-                                m_vplBitstream.Data + m_vplBitstream.DataOffset
-                            ),
-                            m_vplBitstream.DataLength,
-                            targetTimestampNs,
-                            insertIDR
-                        );
-                        m_vplBitstream.DataLength = 0;
-                    }
-                } while (sts == MFX_WRN_IN_EXECUTION);
+    switch (sts) {
+    case MFX_ERR_NONE:
+        // MFX_ERR_NONE and syncp indicate output is available, once the sync thread has waited
+        // for it
+        if (slot.syncp) {
+            {
+                std::lock_guard<std::mutex> lock(m_pendingMutex);
+                m_pending.push_back(&slot);
             }
-            break;
+            m_pendingCv.notify_all();
+        }
+        break;
 
-        case MFX_ERR_NOT_ENOUGH_BUFFER:
-            ERROR_THROW("not enough buffer");
+    case MFX_ERR_NOT_ENOUGH_BUFFER:
+        ERROR_THROW("not enough buffer");
 
-        case MFX_ERR_MORE_DATA:
-            if (isDraining == true)
-                isEncGoing = false;
-            break;
+    case MFX_ERR_MORE_DATA:
+        VPL_DEBUG("frame buffered without output");
+        break;
 
-        case MFX_ERR_DEVICE_LOST:
-            ERROR_THROW("device lost");
+    case MFX_ERR_DEVICE_LOST:
+        ERROR_THROW("device lost");
 
-        case MFX_WRN_DEVICE_BUSY:
-            VPL_DEBUG("device busy");
-            break;
+    default:
+        ERROR_THROW("unknown encoding status %d", sts);
+    }
+}
 
-        default:
-            ERROR_THROW("unknown encoding status %d", sts);
+void VideoEncoderVPL::SyncLoop() {
+    ApplyThreadProfile(EncoderThreadProfile());
+
+    while (true) {
+        Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(m_pendingMutex);
+            m_pendingCv.wait(lock, [&] { return m_stopSync || !m_pending.empty(); });
+            if (m_pending.empty()) {
+                break;
+            }
+            slot = m_pending.front();
         }
+
+        // Encode output is not available on CPU until sync operation completes
+        mfxStatus sts;
+        do {
+            sts = MFXVideoCORE_SyncOperation(m_vplSession, slot->syncp, WAIT_100_MILLISECONDS);
+        } while (sts == MFX_WRN_IN_EXECUTION);
+
+        if (sts == MFX_ERR_NONE) {
+            // VideoSendSlice copies the tile groups like VideoSend does the frame
+            auto parse = m_sendTileGroups ? ParseFrameSliceNals : ParseFrameNals;
+            parse(
+                m_codec,
+                reinterpret_cast<uint8_t*>(slot->bitstream.Data + slot->bitstream.DataOffset),
+                slot->bitstream.DataLength,
+                slot->targetTimestampNs,
+                slot->insertIDR
+            );
+        } else {
+            VPL_LOG(Error, "sync operation failed with %d", sts);
+        }
+        slot->bitstream.DataOffset = 0;
+        slot->bitstream.DataLength = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_pending.pop_front();
+        }
+        m_pendingCv.notify_all();
     }
 }
 
+void VideoEncoderVPL::WaitForPendingFrames() {
+    std::unique_lock<std::mutex> lock(m_pendingMutex);
+    m_pendingCv.wait(lock, [&] { return m_pending.empty(); });
+}
+
 void VideoEncoderVPL::InitTransferTex() {
     D3D11_TEXTURE2D_DESC transferTexDesc = { UINT(m_renderWidth),
                                              UINT(m_renderHeight),
@@ -155,11 +291,55 @@ void VideoEncoderVPL::InitTransferTex() {
                                              D3D11_BIND_SHADER_RESOURCE,
                                              0,
                                              D3D11_RESOURCE_MISC_SHARED };
+    if (m_scaler) {
+        // Written by the video processor
+        transferTexDesc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+    }
+
+    // Query may have corrected the depth
+    m_slots.resize(m_vplEncodeParams.AsyncDepth > 0 ? m_vplEncodeParams.AsyncDepth : 1);
+    for (auto& slot : m_slots) {
+        HRESULT hr = m_pD3DRender->GetDevice()->CreateTexture2D(
+            &transferTexDesc, nullptr, &slot.transferTex
+        );
+        if (FAILED(hr))
+            ERROR_THROW(
+                "failed to create transfer texture HR=%p %ls", hr, GetErrorStr(hr).c_str()
+            );
+    }
 
-    HRESULT hr
-        = m_pD3DRender->GetDevice()->CreateTexture2D(&transferTexDesc, nullptr, &m_transferTex);
-    if (FAILED(hr))
-        ERROR_THROW("failed to create transfer texture HR=%p %ls", hr, GetErrorStr(hr).c_str());
+    // Surfaces that share the texture can be imported once and reused by every frame of the
+    // slot. A copying import snapshots the texture, so it has to happen per frame.
+    m_sharedSurfaces = true;
+    for (auto& slot : m_slots) {
+        slot.surface = VplImportTexture(slot.transferTex.p, MFX_SURFACE_FLAG_IMPORT_SHARED);
+        if (!slot.surface) {
+            m_sharedSurfaces = false;
+            break;
+        }
+    }
+    if (!m_sharedSurfaces) {
+        for (auto& slot : m_slots) {
+            if (slot.surface) {
+                slot.surface->FrameInterface->Release(slot.surface);
+                slot.surface = nullptr;
+            }
+        }
+    }
+
+    VPL_INFO(
+        "%zu frames in flight, %s surfaces",
+        m_slots.size(),
+        m_sharedSurfaces ? "pre-imported shared" : "copied"
+    );
+}
+
+void VideoEncoderVPL::InitBitstreams() {
+    for (auto& slot : m_slots) {
+        slot.bitstream.MaxLength = m_renderWidth * m_renderHeight * 8;
+        slot.bitstream.Data = (mfxU8*)calloc(slot.bitstream.MaxLength, sizeof(mfxU8));
+        VERIFY(slot.bitstream.Data != nullptr, "bitstream allocation failed");
+    }
 }
 
 void VideoEncoderVPL::InitVpl() {
@@ -183,7 +363,14 @@ void VideoEncoderVPL::InitVpl() {
 void VideoEncoderVPL::InitVplEncode() {
     m_vplEncodeParams.IOPattern = MFX_IOPATTERN_IN_VIDEO_MEMORY;
     m_vplEncodeParams.mfx.LowPower = MFX_CODINGOPTION_ON;
-    m_vplEncodeParams.AsyncDepth = 1;
+    uint32_t asyncDepth = VramLimitedDepth(Settings::Instance().m_vplAsyncDepth);
+    m_vplEncodeParams.AsyncDepth = asyncDepth > 0 ? asyncDepth : 1;
+    // No B frames, every submitted frame has its own output
+    m_vplEncodeParams.mfx.GopRefDist = 1;
+    if (m_ltr.IsEnabled()) {
+        // The long-term references and the previous frame
+        m_vplEncodeParams.mfx.NumRefFrame = LtrManager::SLOT_COUNT + 1;
+    }
     m_vplEncodeParams.mfx.CodecId = m_vplCodec;
     m_vplEncodeParams.mfx.CodecProfile = m_vplCodecProfile;
     m_vplEncodeParams.mfx.TargetUsage = m_vplQualityPreset;
@@ -198,7 +385,39 @@ void VideoEncoderVPL::InitVplEncode() {
     m_vplEncodeParams.mfx.FrameInfo.Width = ALIGN16(m_renderWidth);
     m_vplEncodeParams.mfx.FrameInfo.Height = ALIGN16(m_renderHeight);
 
+    const auto& s = Settings::Instance();
+    mfxU16 tileColumns = std::max<mfxU16>(s.m_encoderAv1TileColumns, 1);
+    mfxU16 tileRows = std::max<mfxU16>(s.m_encoderAv1TileRows, 1);
+    if (m_codec == ALVR_CODEC_AV1 && tileColumns * tileRows > 1) {
+        m_vplAv1Tiles.Header.BufferId = MFX_EXTBUFF_AV1_TILE_PARAM;
+        m_vplAv1Tiles.Header.BufferSz = sizeof(m_vplAv1Tiles);
+        m_vplAv1Tiles.NumTileColumns = tileColumns;
+        m_vplAv1Tiles.NumTileRows = tileRows;
+        m_vplAv1Tiles.NumTileGroups = std::min<mfxU16>(
+            std::max<mfxU16>(s.m_encoderSlicesPerFrame, 1), tileColumns * tileRows
+        );
+        m_vplEncodeExtParams[m_vplEncodeParams.NumExtParam++] = &m_vplAv1Tiles.Header;
+    }
+    if (s.m_vplHyperEncode) {
+        // The runtime opens the other adapter itself, the transfer textures are already shared.
+        // Adaptive keeps a single adapter when splitting the work wouldn't be faster.
+        m_vplHyperMode.Header.BufferId = MFX_EXTBUFF_HYPER_MODE_PARAM;
+        m_vplHyperMode.Header.BufferSz = sizeof(m_vplHyperMode);
+        m_vplHyperMode.Mode = MFX_HYPERMODE_ADAPTIVE;
+        m_vplEncodeExtParams[m_vplEncodeParams.NumExtParam++] = &m_vplHyperMode.Header;
+        // The adapters encode alternate GOPs, an endless one would stay on a single adapter
+        m_vplEncodeParams.mfx.GopPicSize = m_refreshRate;
+        m_vplEncodeParams.mfx.IdrInterval = 0;
+    }
+    m_vplEncodeParams.ExtParam = m_vplEncodeParams.NumExtParam > 0 ? m_vplEncodeExtParams : nullptr;
+
     mfxStatus sts = MFXVideoENCODE_Query(m_vplSession, &m_vplEncodeParams, &m_vplEncodeParams);
+    if (sts == MFX_ERR_UNSUPPORTED && s.m_vplHyperEncode) {
+        VPL_WARN("Hyper Encode is not available, encoding on a single adapter");
+        m_vplEncodeParams.NumExtParam--;
+        m_vplEncodeParams.mfx.GopPicSize = 0;
+        sts = MFXVideoENCODE_Query(m_vplSession, &m_vplEncodeParams, &m_vplEncodeParams);
+    }
     switch (sts) {
     case MFX_WRN_INCOMPATIBLE_VIDEO_PARAM:
         VPL_WARN("incompatible video params, auto-correcting");
@@ -214,25 +433,65 @@ void VideoEncoderVPL::InitVplEncode() {
 
     // Initialize ENCODE
     VPL_VERIFY(MFXVideoENCODE_Init(m_vplSession, &m_vplEncodeParams));
+    // The query may have corrected the tile groups
+    m_sendTileGroups = m_vplAv1Tiles.Header.BufferId != 0 && m_vplAv1Tiles.NumTileGroups > 1
+        && SliceOutputEnabled();
 }
 
-mfxFrameSurface1* VideoEncoderVPL::VplImportTexture(ID3D11Texture2D* texture) {
-    m_pD3DRender->GetContext()->CopyResource(m_transferTex.p, texture);
+void VideoEncoderVPL::ApplyLtr(Slot& slot, LtrManager::FrameLtr ltr) {
+    if (ltr.markSlot < 0 && ltr.useSlot < 0) {
+        return;
+    }
 
+    auto& ctrl = slot.refListCtrl;
+    ctrl = {};
+    ctrl.Header.BufferId = MFX_EXTBUFF_AVC_REFLIST_CTRL;
+    ctrl.Header.BufferSz = sizeof(ctrl);
+    for (auto& ref : ctrl.PreferredRefList) {
+        ref.FrameOrder = MFX_FRAMEORDER_UNKNOWN;
+    }
+    for (auto& ref : ctrl.RejectedRefList) {
+        ref.FrameOrder = MFX_FRAMEORDER_UNKNOWN;
+    }
+    for (auto& ref : ctrl.LongTermRefList) {
+        ref.FrameOrder = MFX_FRAMEORDER_UNKNOWN;
+    }
+
+    if (ltr.markSlot >= 0) {
+        ctrl.LongTermRefList[0].FrameOrder = m_frameOrder;
+        ctrl.LongTermRefList[0].PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+        m_ltrFrameOrders[ltr.markSlot] = m_frameOrder;
+    }
+    if (ltr.useSlot >= 0) {
+        // The only active reference, so nothing predicted from the lost frames is used
+        ctrl.NumRefIdxL0Active = 1;
+        ctrl.PreferredRefList[0].FrameOrder = m_ltrFrameOrders[ltr.useSlot];
+        ctrl.PreferredRefList[0].PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+    }
+
+    slot.extParams[0] = &ctrl.Header;
+    slot.encodeCtrl.ExtParam = slot.extParams;
+    slot.encodeCtrl.NumExtParam = 1;
+}
+
+mfxFrameSurface1* VideoEncoderVPL::VplImportTexture(ID3D11Texture2D* texture, mfxU32 flags) {
     mfxSurfaceD3D11Tex2D extSurfD3D11 = {};
     extSurfD3D11.SurfaceInterface.Header.SurfaceType = MFX_SURFACE_TYPE_D3D11_TEX2D;
-    extSurfD3D11.SurfaceInterface.Header.SurfaceFlags
-        = MFX_SURFACE_FLAG_IMPORT_SHARED | MFX_SURFACE_FLAG_IMPORT_COPY;
+    extSurfD3D11.SurfaceInterface.Header.SurfaceFlags = flags;
     extSurfD3D11.SurfaceInterface.Header.StructSize = sizeof(mfxSurfaceD3D11Tex2D);
-    extSurfD3D11.texture2D = m_transferTex.p;
+    extSurfD3D11.texture2D = texture;
 
     mfxFrameSurface1* encSurface = nullptr;
-    VPL_VERIFY(m_vplMemoryInterface->ImportFrameSurface(
+    mfxStatus sts = m_vplMemoryInterface->ImportFrameSurface(
         m_vplMemoryInterface,
         MFX_SURFACE_COMPONENT_ENCODE,
         &extSurfD3D11.SurfaceInterface.Header,
         &encSurface
-    ));
+    );
+    if (sts != MFX_ERR_NONE) {
+        VPL_DEBUG("import with flags %u failed with %d", flags, sts);
+        return nullptr;
+    }
 
     return encSurface;
 }
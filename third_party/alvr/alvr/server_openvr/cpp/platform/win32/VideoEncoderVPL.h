@@ -4,10 +4,18 @@
 #pragma once
 
 #include "VideoEncoder.h"
+#include "VideoScaler.h"
+#include "alvr_server/DisposableFrames.h"
+#include "alvr_server/LtrManager.h"
+#include "alvr_server/ResolutionLadder.h"
 #include "shared/d3drender.h"
 #include <atlbase.h>
+#include <condition_variable>
 #include <d3d11.h>
+#include <deque>
 #include <dxgi.h>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "vpl/mfx.h"
@@ -34,13 +42,37 @@ public:
         bool insertIDR
     );
 
+    bool SupportsLtrRecovery() { return m_ltr.IsEnabled(); }
+    bool RecoverWithLtr() { return m_ltr.Recover(); }
+    void AcknowledgeFrame(uint64_t targetTimestampNs) { m_ltr.Acknowledge(targetTimestampNs); }
+    bool StepQualityPreset(int step);
+
 private:
+    // One frame in flight: its input texture, the surface VPL encodes from and the output
+    struct Slot {
+        CComPtr<ID3D11Texture2D> transferTex;
+        // Imported once when VPL can share the texture, otherwise imported per frame
+        mfxFrameSurface1* surface = nullptr;
+        mfxBitstream bitstream = {};
+        mfxEncodeCtrl encodeCtrl = {};
+        // Long-term reference marking and use, attached to encodeCtrl when needed
+        mfxExtAVCRefListCtrl refListCtrl = {};
+        mfxExtBuffer* extParams[1] = {};
+        mfxSyncPoint syncp = nullptr;
+        uint64_t targetTimestampNs = 0;
+        bool insertIDR = false;
+    };
+
     void CheckVPLConfig();
     void ChooseParams();
     void InitTransferTex();
+    void InitBitstreams();
+    void SyncLoop();
+    void WaitForPendingFrames();
     void InitVpl();
     void InitVplEncode();
-    mfxFrameSurface1* VplImportTexture(ID3D11Texture2D* texture);
+    void ApplyLtr(Slot& slot, LtrManager::FrameLtr ltr);
+    mfxFrameSurface1* VplImportTexture(ID3D11Texture2D* texture, mfxU32 flags);
     void LogImplementationInfo();
 
     std::shared_ptr<CD3DRender> m_pD3DRender;
@@ -54,14 +86,43 @@ private:
     mfxU32 m_vplCodecProfile;
     mfxU32 m_vplColorFormat;
     mfxU32 m_vplChromaFormat;
+    // Target usage, from encoder_quality_preset and then StepQualityPreset
     mfxU32 m_vplQualityPreset;
+    bool m_presetChanged = false;
     mfxU32 m_vplRateControlMode;
     DXGI_FORMAT m_dxColorFormat;
     mfxVideoParam m_vplEncodeParams = {};
+    // Attached to m_vplEncodeParams for AV1 tiles and Hyper Encode, kept for the resets
+    mfxExtAV1TileParam m_vplAv1Tiles = {};
+    mfxExtHyperModeParam m_vplHyperMode = {};
+    mfxExtBuffer* m_vplEncodeExtParams[2] = {};
+    // AV1 tile groups are sent one by one, like slices
+    bool m_sendTileGroups = false;
 
     mfxLoader m_vplLoader = nullptr;
     mfxSession m_vplSession = nullptr;
-    mfxBitstream m_vplBitstream = {};
     mfxMemoryInterface* m_vplMemoryInterface = nullptr;
-    CComPtr<ID3D11Texture2D> m_transferTex;
+
+    // AsyncDepth slots, Transmit fills the next free one and m_syncThread waits for its output
+    std::vector<Slot> m_slots;
+    bool m_sharedSurfaces = false;
+    uint32_t m_nextSlot = 0;
+    std::deque<Slot*> m_pending;
+    std::mutex m_pendingMutex;
+    std::condition_variable m_pendingCv;
+    std::thread m_syncThread;
+    bool m_stopSync = false;
+
+    // Lower resolution encodes at low bitrates, scaled into the crop of the transfer textures
+    ResolutionLadder m_resolutionLadder;
+    std::unique_ptr<VideoScaler> m_scaler;
+
+    // Loss recovery from acknowledged long-term references. VPL identifies the references by
+    // FrameOrder, which is set on every encoded surface.
+    LtrManager m_ltr;
+    mfxU32 m_frameOrder = 0;
+    mfxU32 m_ltrFrameOrders[LtrManager::SLOT_COUNT] = {};
+
+    // Typed per frame, a P frame without MFX_FRAMETYPE_REF is never referenced
+    DisposableFrames m_disposable;
 };
@@ -0,0 +1,101 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#include "VideoScaler.h"
+#include "d3d-render-utils/RenderUtils.h"
+
+using Microsoft::WRL::ComPtr;
+
+VideoScaler::VideoScaler(
+    ID3D11Device* device, uint32_t inputWidth, uint32_t inputHeight, DXGI_FORMAT format
+)
+    : m_inputWidth(inputWidth)
+    , m_inputHeight(inputHeight) {
+    OK_OR_THROW(QUERY(device, &m_videoDevice), "Failed to query the D3D11 video device.");
+
+    ComPtr<ID3D11DeviceContext> context;
+    device->GetImmediateContext(&context);
+    OK_OR_THROW(QUERY(context, &m_videoContext), "Failed to query the D3D11 video context.");
+
+    D3D11_VIDEO_PROCESSOR_CONTENT_DESC contentDesc = {};
+    contentDesc.InputFrameFormat = D3D11_VIDEO_FRAME_FORMAT_PROGRESSIVE;
+    contentDesc.InputWidth = inputWidth;
+    contentDesc.InputHeight = inputHeight;
+    contentDesc.OutputWidth = inputWidth;
+    contentDesc.OutputHeight = inputHeight;
+    contentDesc.Usage = D3D11_VIDEO_USAGE_OPTIMAL_SPEED;
+    OK_OR_THROW(
+        m_videoDevice->CreateVideoProcessorEnumerator(&contentDesc, &m_enumerator),
+        "Failed to create the video processor enumerator."
+    );
+
+    UINT formatSupport = 0;
+    m_enumerator->CheckVideoProcessorFormat(format, &formatSupport);
+    const UINT requiredSupport = D3D11_VIDEO_PROCESSOR_FORMAT_SUPPORT_INPUT
+        | D3D11_VIDEO_PROCESSOR_FORMAT_SUPPORT_OUTPUT;
+    if ((formatSupport & requiredSupport) != requiredSupport) {
+        throw MakeException("The video processor cannot scale DXGI format %d.", format);
+    }
+
+    OK_OR_THROW(
+        m_videoDevice->CreateVideoProcessor(m_enumerator.Get(), 0, &m_processor),
+        "Failed to create the video processor."
+    );
+
+    // Plain scaling: full range RGB in and out, no denoise or other driver processing
+    D3D11_VIDEO_PROCESSOR_COLOR_SPACE colorSpace = {};
+    colorSpace.RGB_Range = 0;
+    m_videoContext->VideoProcessorSetStreamColorSpace(m_processor.Get(), 0, &colorSpace);
+    m_videoContext->VideoProcessorSetOutputColorSpace(m_processor.Get(), &colorSpace);
+    m_videoContext->VideoProcessorSetStreamAutoProcessingMode(m_processor.Get(), 0, FALSE);
+    m_videoContext->VideoProcessorSetStreamFrameFormat(
+        m_processor.Get(), 0, D3D11_VIDEO_FRAME_FORMAT_PROGRESSIVE
+    );
+
+    RECT sourceRect = { 0, 0, (LONG)inputWidth, (LONG)inputHeight };
+    m_videoContext->VideoProcessorSetStreamSourceRect(m_processor.Get(), 0, TRUE, &sourceRect);
+}
+
+void VideoScaler::Scale(
+    ID3D11Texture2D* input, ID3D11Texture2D* output, uint32_t width, uint32_t height
+) {
+    RECT destRect = { 0, 0, (LONG)width, (LONG)height };
+    m_videoContext->VideoProcessorSetStreamDestRect(m_processor.Get(), 0, TRUE, &destRect);
+    m_videoContext->VideoProcessorSetOutputTargetRect(m_processor.Get(), TRUE, &destRect);
+
+    D3D11_VIDEO_PROCESSOR_STREAM stream = {};
+    stream.Enable = TRUE;
+    stream.pInputSurface = inputView(input);
+    OK_OR_THROW(
+        m_videoContext->VideoProcessorBlt(m_processor.Get(), outputView(output), 0, 1, &stream),
+        "Failed to scale the frame."
+    );
+}
+
+ID3D11VideoProcessorInputView* VideoScaler::inputView(ID3D11Texture2D* texture) {
+    auto& view = m_inputViews[texture];
+    if (!view) {
+        D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC desc = {};
+        desc.ViewDimension = D3D11_VPIV_DIMENSION_TEXTURE2D;
+        OK_OR_THROW(
+            m_videoDevice->CreateVideoProcessorInputView(texture, m_enumerator.Get(), &desc, &view),
+            "Failed to create the video processor input view."
+        );
+    }
+    return view.Get();
+}
+
+ID3D11VideoProcessorOutputView* VideoScaler::outputView(ID3D11Texture2D* texture) {
+    auto& view = m_outputViews[texture];
+    if (!view) {
+        D3D11_VIDEO_PROCESSOR_OUTPUT_VIEW_DESC desc = {};
+        desc.ViewDimension = D3D11_VPOV_DIMENSION_TEXTURE2D;
+        OK_OR_THROW(
+            m_videoDevice->CreateVideoProcessorOutputView(
+                texture, m_enumerator.Get(), &desc, &view
+            ),
+            "Failed to create the video processor output view."
+        );
+    }
+    return view.Get();
+}
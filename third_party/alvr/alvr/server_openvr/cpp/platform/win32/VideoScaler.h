@@ -0,0 +1,42 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include <d3d11.h>
+#include <map>
+#include <stdint.h>
+#include <wrl.h>
+
+// Downscales the renderer output with the D3D11 video processor, for the encoders of the
+// resolution ladder. Both textures have the same format, the output needs
+// D3D11_BIND_RENDER_TARGET.
+class VideoScaler {
+public:
+    // inputWidth x inputHeight is the size of the textures that will be scaled. Throws if the
+    // video processor can't scale this format.
+    VideoScaler(
+        ID3D11Device* device, uint32_t inputWidth, uint32_t inputHeight, DXGI_FORMAT format
+    );
+
+    // Scales the whole input into the width x height top-left corner of the output. The rest of
+    // the output is left untouched.
+    void Scale(ID3D11Texture2D* input, ID3D11Texture2D* output, uint32_t width, uint32_t height);
+
+private:
+    ID3D11VideoProcessorInputView* inputView(ID3D11Texture2D* texture);
+    ID3D11VideoProcessorOutputView* outputView(ID3D11Texture2D* texture);
+
+    uint32_t m_inputWidth;
+    uint32_t m_inputHeight;
+
+    Microsoft::WRL::ComPtr<ID3D11VideoDevice> m_videoDevice;
+    Microsoft::WRL::ComPtr<ID3D11VideoContext> m_videoContext;
+    Microsoft::WRL::ComPtr<ID3D11VideoProcessorEnumerator> m_enumerator;
+    Microsoft::WRL::ComPtr<ID3D11VideoProcessor> m_processor;
+
+    // The encoders use a few textures in turn, their views are created once
+    std::map<ID3D11Texture2D*, Microsoft::WRL::ComPtr<ID3D11VideoProcessorInputView>> m_inputViews;
+    std::map<ID3D11Texture2D*, Microsoft::WRL::ComPtr<ID3D11VideoProcessorOutputView>>
+        m_outputViews;
+};
@@ -4,10 +4,13 @@
 //===================== Copyright (c) Valve Corporation. All Rights Reserved. ======================
 #include "d3drender.h"
 #include <d3d11_4.h>
+#include <d3d11on12.h>
+#include <d3d12.h>
 #include <evntprov.h>
 
 #pragma comment( lib, "dxgi.lib" )
 #pragma comment( lib, "d3d11.lib" )
+#pragma comment( lib, "d3d12.lib" )
 #pragma comment( lib, "rpcrt4.lib" )
 
 #define Log( ... )
@@ -46,7 +49,32 @@ namespace
 		return false;
 	}
 
-	bool CreateDevice( IDXGIAdapter *pDXGIAdapter, ID3D11Device **pD3D11Device, ID3D11DeviceContext **pD3D11Context )
+	// D3D11 on a D3D12 direct queue of high priority, the GPU schedules its work ahead of the
+	// game's. D3D11On12 only takes direct queues, so there is no async compute.
+	HRESULT CreateDeviceOn12( IDXGIAdapter *pDXGIAdapter, UINT creationFlags, ID3D11Device **pD3D11Device, ID3D11DeviceContext **pD3D11Context, D3D_FEATURE_LEVEL *pFeatureLevel )
+	{
+		ID3D12Device *pD3D12Device = NULL;
+		HRESULT hRes = D3D12CreateDevice( pDXGIAdapter, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS( &pD3D12Device ) );
+		if ( FAILED( hRes ) )
+			return hRes;
+
+		D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+		queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+		queueDesc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_HIGH;
+		ID3D12CommandQueue *pQueue = NULL;
+		hRes = pD3D12Device->CreateCommandQueue( &queueDesc, IID_PPV_ARGS( &pQueue ) );
+		if ( SUCCEEDED( hRes ) )
+		{
+			IUnknown *pQueues[] = { pQueue };
+			hRes = D3D11On12CreateDevice( pD3D12Device, creationFlags, NULL, 0, pQueues, 1, 0, pD3D11Device, pD3D11Context, pFeatureLevel );
+			pQueue->Release();
+		}
+		// The D3D11 device keeps its own references
+		pD3D12Device->Release();
+		return hRes;
+	}
+
+	bool CreateDevice( IDXGIAdapter *pDXGIAdapter, ID3D11Device **pD3D11Device, ID3D11DeviceContext **pD3D11Context, bool bHighPriorityQueue = false )
 	{
 		UINT creationFlags = 0;
 #if _DEBUG
@@ -54,7 +82,15 @@ namespace
 #endif
 		D3D_FEATURE_LEVEL eFeatureLevel;
 
-		HRESULT hRes = D3D11CreateDevice( pDXGIAdapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, creationFlags, NULL, 0, D3D11_SDK_VERSION, pD3D11Device, &eFeatureLevel, pD3D11Context );
+		HRESULT hRes = E_FAIL;
+		if ( bHighPriorityQueue )
+		{
+			hRes = CreateDeviceOn12( pDXGIAdapter, creationFlags, pD3D11Device, pD3D11Context, &eFeatureLevel );
+			if ( FAILED( hRes ) )
+				Log( "Failed to create D3D11 on 12 device, using D3D11! (err=%u)", hRes );
+		}
+		if ( FAILED( hRes ) )
+			hRes = D3D11CreateDevice( pDXGIAdapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, creationFlags, NULL, 0, D3D11_SDK_VERSION, pD3D11Device, &eFeatureLevel, pD3D11Context );
 #if _DEBUG
 		// CreateDevice fails on Win10 in debug if the Win10 SDK isn't installed.
 		if ( pD3D11Device == NULL )
@@ -246,7 +282,7 @@ ID3D11Texture2D *CD3DRender::GetSharedTexture( HANDLE hSharedTexture )
 
 //--------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------
-bool CD3DRender::Initialize( uint32_t nAdapterIndex )
+bool CD3DRender::Initialize( uint32_t nAdapterIndex, bool bHighPriorityQueue )
 {
 	Shutdown();
 
@@ -257,7 +293,7 @@ bool CD3DRender::Initialize( uint32_t nAdapterIndex )
 	if ( FAILED( m_pDXGIFactory->EnumAdapters( nAdapterIndex, &pDXGIAdapter ) ) )
 		return false;
 
-	bool bSuccess = CreateDevice( pDXGIAdapter, &m_pD3D11Device, &m_pD3D11Context );
+	bool bSuccess = CreateDevice( pDXGIAdapter, &m_pD3D11Device, &m_pD3D11Context, bHighPriorityQueue );
 
 	pDXGIAdapter->Release();
 
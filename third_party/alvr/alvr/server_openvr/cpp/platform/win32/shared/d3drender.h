@@ -24,7 +24,9 @@ public:
 	~CD3DRender();
 
 	bool Initialize( uint32_t nDisplayWidth, uint32_t nDisplayHeight );
-	bool Initialize( uint32_t nAdapterIndex );
+	// bHighPriorityQueue creates the device with D3D11On12 over a high priority D3D12 queue, it
+	// falls back to plain D3D11
+	bool Initialize( uint32_t nAdapterIndex, bool bHighPriorityQueue = false );
 	void Shutdown();
 
 	void GetDisplayPos( int32_t *pDisplayX, int32_t *pDisplayY );
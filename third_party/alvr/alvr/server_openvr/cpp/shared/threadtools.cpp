@@ -3,6 +3,312 @@
 
 //===================== Copyright (c) Valve Corporation. All Rights Reserved. ======================
 #include "threadtools.h"
+#include "alvr_server/Logger.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#if defined( __x86_64__ ) || defined( _M_X64 ) || defined( __i386__ ) || defined( _M_IX86 )
+#include <immintrin.h>
+#define CPU_RELAX() _mm_pause()
+#else
+#define CPU_RELAX() std::this_thread::yield()
+#endif
+
+#ifdef _WIN32
+#include <avrt.h>
+#pragma comment( lib, "avrt.lib" )
+#pragma comment( lib, "Synchronization.lib" )
+#elif defined( __linux__ )
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+//--------------------------------------------------------------------------------------------------
+// Reverts the MMCSS registration of the thread when it exits
+//--------------------------------------------------------------------------------------------------
+struct MmcssRegistration
+{
+	HANDLE hTask = NULL;
+	~MmcssRegistration()
+	{
+		if ( hTask )
+		{
+			AvRevertMmThreadCharacteristics( hTask );
+		}
+	}
+};
+static thread_local MmcssRegistration s_mmcss;
+#elif defined( __linux__ )
+//--------------------------------------------------------------------------------------------------
+// rtkit grants realtime scheduling to processes without the permission over the system bus.
+// libdbus is loaded at runtime so that it isn't a build dependency.
+//--------------------------------------------------------------------------------------------------
+static bool MakeThreadRealtimeWithRtkit( pid_t nThreadId, int nPriority )
+{
+	// Layout of DBusError, its flags are bitfields in one unsigned int
+	struct DBusError
+	{
+		const char *name;
+		const char *message;
+		unsigned int dummy;
+		void *padding;
+	};
+	const int DBUS_BUS_SYSTEM = 1;
+	const int DBUS_TYPE_INVALID = 0;
+	const int DBUS_TYPE_UINT32 = 'u';
+	const int DBUS_TYPE_UINT64 = 't';
+
+	static void *s_pLib = dlopen( "libdbus-1.so.3", RTLD_LAZY );
+	if ( !s_pLib )
+	{
+		Warn( "rtkit: libdbus is not available" );
+		return false;
+	}
+	auto pErrorInit = ( void ( * )( DBusError * ) )dlsym( s_pLib, "dbus_error_init" );
+	auto pErrorFree = ( void ( * )( DBusError * ) )dlsym( s_pLib, "dbus_error_free" );
+	auto pBusGetPrivate = ( void *( * )( int, DBusError * ) )dlsym( s_pLib, "dbus_bus_get_private" );
+	auto pNewMethodCall = ( void *( * )( const char *, const char *, const char *, const char * ) )
+		dlsym( s_pLib, "dbus_message_new_method_call" );
+	auto pAppendArgs = ( int ( * )( void *, int, ... ) )dlsym( s_pLib, "dbus_message_append_args" );
+	auto pSendWithReply = ( void *( * )( void *, void *, int, DBusError * ) )
+		dlsym( s_pLib, "dbus_connection_send_with_reply_and_block" );
+	auto pMessageUnref = ( void ( * )( void * ) )dlsym( s_pLib, "dbus_message_unref" );
+	auto pConnectionClose = ( void ( * )( void * ) )dlsym( s_pLib, "dbus_connection_close" );
+	auto pConnectionUnref = ( void ( * )( void * ) )dlsym( s_pLib, "dbus_connection_unref" );
+	if ( !pErrorInit || !pErrorFree || !pBusGetPrivate || !pNewMethodCall || !pAppendArgs
+		|| !pSendWithReply || !pMessageUnref || !pConnectionClose || !pConnectionUnref )
+	{
+		Warn( "rtkit: libdbus is missing symbols" );
+		return false;
+	}
+
+	// rtkit only serves processes with a bounded realtime budget, so that a spinning thread gets
+	// SIGXCPU instead of locking up the core. Our threads block on every frame.
+	struct rlimit limit;
+	if ( getrlimit( RLIMIT_RTTIME, &limit ) == 0
+		&& ( limit.rlim_max == RLIM_INFINITY || limit.rlim_max > 200000 ) )
+	{
+		limit.rlim_cur = limit.rlim_max = 200000;
+		setrlimit( RLIMIT_RTTIME, &limit );
+	}
+
+	DBusError error;
+	pErrorInit( &error );
+	void *pConnection = pBusGetPrivate( DBUS_BUS_SYSTEM, &error );
+	if ( !pConnection )
+	{
+		Warn( "rtkit: can't connect to the system bus: %s", error.message );
+		pErrorFree( &error );
+		return false;
+	}
+
+	bool bSuccess = false;
+	void *pMessage = pNewMethodCall( "org.freedesktop.RealtimeKit1",
+		"/org/freedesktop/RealtimeKit1", "org.freedesktop.RealtimeKit1", "MakeThreadRealtime" );
+	uint64_t nThread = nThreadId;
+	uint32_t nPrio = nPriority;
+	if ( pMessage && pAppendArgs( pMessage, DBUS_TYPE_UINT64, &nThread, DBUS_TYPE_UINT32, &nPrio,
+		DBUS_TYPE_INVALID ) )
+	{
+		void *pReply = pSendWithReply( pConnection, pMessage, 1000, &error );
+		if ( pReply )
+		{
+			pMessageUnref( pReply );
+			bSuccess = true;
+		}
+		else
+		{
+			Warn( "rtkit: MakeThreadRealtime failed: %s", error.message );
+		}
+	}
+	if ( pMessage )
+	{
+		pMessageUnref( pMessage );
+	}
+	pErrorFree( &error );
+	pConnectionClose( pConnection );
+	pConnectionUnref( pConnection );
+	return bSuccess;
+}
+#endif
+
+//--------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------
+void ApplyThreadProfile( const ThreadProfile &profile )
+{
+#ifdef _WIN32
+	if ( profile.bUrgent )
+	{
+		SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_MOST_URGENT );
+	}
+	if ( profile.nRealtimePriority > 0 && !s_mmcss.hTask )
+	{
+		DWORD nTaskIndex = 0;
+		s_mmcss.hTask = AvSetMmThreadCharacteristicsA( profile.pMmcssTask, &nTaskIndex );
+		if ( s_mmcss.hTask )
+		{
+			AvSetMmThreadPriority( s_mmcss.hTask, AVRT_PRIORITY_HIGH );
+		}
+		else
+		{
+			Warn( "Failed to register thread with MMCSS task %s: %d\n", profile.pMmcssTask,
+				GetLastError() );
+		}
+	}
+	if ( profile.nAffinityMask
+		&& !SetThreadAffinityMask( GetCurrentThread(), ( DWORD_PTR )profile.nAffinityMask ) )
+	{
+		Warn( "Failed to set thread affinity: %d\n", GetLastError() );
+	}
+#elif defined( __linux__ )
+	if ( profile.nRealtimePriority > 0 )
+	{
+		sched_param param = {};
+		param.sched_priority = profile.nRealtimePriority;
+		int nPolicy = profile.bRoundRobin ? SCHED_RR : SCHED_FIFO;
+		int nResult = pthread_setschedparam( pthread_self(), nPolicy, &param );
+		if ( nResult == EPERM )
+		{
+			// rtkit caps the priority, 20 by default
+			int nPriority = profile.nRealtimePriority < 20 ? profile.nRealtimePriority : 20;
+			if ( MakeThreadRealtimeWithRtkit( ( pid_t )syscall( SYS_gettid ), nPriority ) )
+			{
+				nResult = 0;
+			}
+		}
+		if ( nResult != 0 )
+		{
+			Warn( "Failed to make thread realtime: %s", strerror( nResult ) );
+		}
+	}
+	if ( profile.nAffinityMask )
+	{
+		cpu_set_t cpus;
+		CPU_ZERO( &cpus );
+		for ( int i = 0; i < 64 && i < CPU_SETSIZE; i++ )
+		{
+			if ( profile.nAffinityMask & ( 1ull << i ) )
+			{
+				CPU_SET( i, &cpus );
+			}
+		}
+		int nResult = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+		if ( nResult != 0 )
+		{
+			Warn( "Failed to set thread affinity: %s", strerror( nResult ) );
+		}
+	}
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------
+uint64_t LastCoresMask( uint32_t nCores )
+{
+	uint32_t nCount = std::thread::hardware_concurrency();
+	if ( nCount > 64 )
+	{
+		nCount = 64;
+	}
+	if ( nCores == 0 || nCores >= nCount )
+	{
+		return 0;
+	}
+	uint64_t nMask = 0;
+	for ( uint32_t i = nCount - nCores; i < nCount; i++ )
+	{
+		nMask |= 1ull << i;
+	}
+	return nMask;
+}
+
+//--------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------
+uint64_t NumaNodeCoresMask( int nNode )
+{
+	if ( nNode < 0 )
+	{
+		return 0;
+	}
+#ifdef _WIN32
+	GROUP_AFFINITY affinity = {};
+	// Our masks only cover the first processor group
+	if ( !GetNumaNodeProcessorMaskEx( ( USHORT )nNode, &affinity ) || affinity.Group != 0 )
+	{
+		return 0;
+	}
+	return affinity.Mask;
+#elif defined( __linux__ )
+	// A list of ranges like "0-15,32-47"
+	std::ifstream file( "/sys/devices/system/node/node" + std::to_string( nNode ) + "/cpulist" );
+	std::string list;
+	if ( !std::getline( file, list ) )
+	{
+		return 0;
+	}
+	uint64_t nMask = 0;
+	std::stringstream ranges( list );
+	std::string range;
+	while ( std::getline( ranges, range, ',' ) )
+	{
+		unsigned int nFirst = 0, nLast = 0;
+		int nCount = sscanf( range.c_str(), "%u-%u", &nFirst, &nLast );
+		if ( nCount < 1 )
+		{
+			continue;
+		}
+		if ( nCount == 1 )
+		{
+			nLast = nFirst;
+		}
+		for ( unsigned int i = nFirst; i <= nLast && i < 64; i++ )
+		{
+			nMask |= 1ull << i;
+		}
+	}
+	return nMask;
+#else
+	return 0;
+#endif
+}
+
+#ifdef __linux__
+//--------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------
+CScopedAffinity::CScopedAffinity( uint64_t nAffinityMask )
+{
+	if ( nAffinityMask
+		&& pthread_getaffinity_np( pthread_self(), sizeof( m_previous ), &m_previous ) == 0 )
+	{
+		ThreadProfile profile;
+		profile.nAffinityMask = nAffinityMask;
+		ApplyThreadProfile( profile );
+		m_bRestore = true;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------
+CScopedAffinity::~CScopedAffinity()
+{
+	if ( m_bRestore )
+	{
+		pthread_setaffinity_np( pthread_self(), sizeof( m_previous ), &m_previous );
+	}
+}
+#endif
 
 //--------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------
@@ -23,10 +329,18 @@ void CThread::Start()
 {
 	if ( Init() )
 	{
-		m_pThread = new std::thread( &CThread::Run, this );
+		m_pThread = new std::thread( &CThread::ThreadMain, this );
 	}
 }
 
+//--------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------
+void CThread::ThreadMain()
+{
+	ApplyThreadProfile( m_profile );
+	Run();
+}
+
 //--------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------
 void CThread::Join()
@@ -39,43 +353,122 @@ void CThread::Join()
 	}
 }
 
-#ifdef _WIN32
+#if defined( _WIN32 ) || defined( __linux__ )
 //--------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------
-CThreadEvent::CThreadEvent( bool bManualReset )
-{
-	m_hSyncObject = CreateEvent( NULL, bManualReset, FALSE, NULL );
-}
+CThreadEvent::CThreadEvent( bool bManualReset, uint32_t nSpinCount )
+	: m_nSignaled( 0 )
+	, m_nWaiters( 0 )
+	, m_bManualReset( bManualReset )
+	, m_nSpinCount( nSpinCount )
+{}
 
 //--------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------
 CThreadEvent::~CThreadEvent()
+{}
+
+//--------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------
+bool CThreadEvent::TryConsume()
 {
-	if ( m_hSyncObject )
+	if ( m_bManualReset )
 	{
-		CloseHandle( m_hSyncObject );
+		return m_nSignaled.load() != 0;
 	}
+	uint32_t nExpected = 1;
+	return m_nSignaled.compare_exchange_strong( nExpected, 0 );
+}
+
+//--------------------------------------------------------------------------------------------------
+// Sleeps while the event is not signaled, returns early on wakeups, spurious ones included
+//--------------------------------------------------------------------------------------------------
+void CThreadEvent::Park( uint32_t nTimeoutMs )
+{
+#ifdef _WIN32
+	uint32_t nUnsignaled = 0;
+	WaitOnAddress( &m_nSignaled, &nUnsignaled, sizeof( nUnsignaled ), nTimeoutMs );
+#else
+	timespec timeout = { ( time_t )( nTimeoutMs / 1000 ), ( long )( nTimeoutMs % 1000 ) * 1000000 };
+	syscall( SYS_futex, ( uint32_t * )&m_nSignaled, FUTEX_WAIT_PRIVATE, 0,
+		nTimeoutMs == INFINITE ? NULL : &timeout, NULL, 0 );
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------
+void CThreadEvent::WakeAll()
+{
+#ifdef _WIN32
+	WakeByAddressAll( &m_nSignaled );
+#else
+	syscall( SYS_futex, ( uint32_t * )&m_nSignaled, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0 );
+#endif
 }
 
 //--------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------
 bool CThreadEvent::Wait( uint32_t nTimeoutMs )
 {
-	return WaitForSingleObject( m_hSyncObject, nTimeoutMs ) == WAIT_OBJECT_0;
+	for ( uint32_t i = 0; i < m_nSpinCount; i++ )
+	{
+		if ( TryConsume() )
+		{
+			return true;
+		}
+		CPU_RELAX();
+	}
+	if ( TryConsume() )
+	{
+		return true;
+	}
+	if ( nTimeoutMs == 0 )
+	{
+		return false;
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( nTimeoutMs );
+	// Counted before the state is checked again, Set sees either the waiter or the waiter sees
+	// the new state
+	m_nWaiters++;
+	bool bSignaled = false;
+	while ( !( bSignaled = TryConsume() ) )
+	{
+		uint32_t nRemainingMs = INFINITE;
+		if ( nTimeoutMs != INFINITE )
+		{
+			auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now() );
+			if ( remaining.count() <= 0 )
+			{
+				break;
+			}
+			nRemainingMs = ( uint32_t )remaining.count();
+		}
+		Park( nRemainingMs );
+	}
+	m_nWaiters--;
+	return bSignaled;
 }
 
 //--------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------
 bool CThreadEvent::Set()
 {
-	return SetEvent( m_hSyncObject ) != 0;
+	m_nSignaled.store( 1 );
+	if ( m_nWaiters.load() > 0 )
+	{
+		WakeAll();
+	}
+	return true;
 }
 
 //--------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------
 bool CThreadEvent::Reset()
 {
-	return ResetEvent( m_hSyncObject ) != 0;
+	m_nSignaled.store( 0 );
+	return true;
 }
 
 #endif
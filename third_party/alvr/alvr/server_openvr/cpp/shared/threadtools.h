@@ -8,13 +8,61 @@
 //==================================================================================================
 #pragma once
 
+#include <atomic>
+#include <stdint.h>
 #include <thread>
 #ifdef _WIN32
 #include <windows.h>
+#else
+#ifdef __linux__
+#include <sched.h>
+#endif
+#ifndef INFINITE
+#define INFINITE 0xFFFFFFFF
+#endif
 #endif
 
 #define THREAD_PRIORITY_MOST_URGENT 15
 
+// Scheduling of a latency critical thread. Each part is best effort, what can't be applied is
+// logged and the thread keeps running with the rest.
+struct ThreadProfile
+{
+	// THREAD_PRIORITY_MOST_URGENT on Windows
+	bool bUrgent = false;
+	// 0 keeps the normal scheduler. On Linux the SCHED_FIFO (SCHED_RR) priority, from rtkit when
+	// the process may not set it itself. On Windows the thread is registered with MMCSS.
+	int nRealtimePriority = 0;
+	bool bRoundRobin = false;
+	const char *pMmcssTask = "Pro Audio";
+	// Cores the thread may run on, one bit per logical core. 0 leaves the affinity alone.
+	uint64_t nAffinityMask = 0;
+};
+
+// Applies the profile to the calling thread
+void ApplyThreadProfile( const ThreadProfile &profile );
+
+// Mask of the last nCores logical cores, to keep our threads away from the cores the game
+// threads are scheduled on first. 0 if nCores doesn't leave any core to the rest.
+uint64_t LastCoresMask( uint32_t nCores );
+
+// Mask of the logical cores of NUMA node nNode, 0 if unknown
+uint64_t NumaNodeCoresMask( int nNode );
+
+#ifdef __linux__
+// Restricts the calling thread to nAffinityMask (if not 0) while in scope. The threads it starts
+// meanwhile inherit the mask, which pins the worker pools that libraries start on their own.
+class CScopedAffinity
+{
+public:
+	explicit CScopedAffinity( uint64_t nAffinityMask );
+	~CScopedAffinity();
+private:
+	cpu_set_t m_previous;
+	bool m_bRestore = false;
+};
+#endif
+
 class CThread
 {
 public:
@@ -22,22 +70,37 @@ public:
 	virtual ~CThread();
 	virtual bool Init() { return true; }
 	virtual void Run() = 0;
+	// Applied by the thread to itself before Run, set before Start
+	void SetProfile( const ThreadProfile &profile ) { m_profile = profile; }
 	void Start();
 	void Join();
 private:
+	void ThreadMain();
+
 	std::thread *m_pThread;
+	ThreadProfile m_profile;
 };
 
-#ifdef _WIN32
+#if defined( _WIN32 ) || defined( __linux__ )
+// Event parked on its own state word, a futex on Linux and WaitOnAddress on Windows. Set and an
+// uncontended Wait don't enter the kernel. With nSpinCount, Wait polls that many times before
+// parking, for handoffs that are expected within microseconds.
 class CThreadEvent
 {
 public:
-	CThreadEvent( bool bManualReset = false );
+	CThreadEvent( bool bManualReset = false, uint32_t nSpinCount = 0 );
 	~CThreadEvent();
 	bool Wait( uint32_t nTimeoutMs = INFINITE );
 	bool Set();
 	bool Reset();
 private:
-	HANDLE m_hSyncObject;
+	bool TryConsume();
+	void Park( uint32_t nTimeoutMs );
+	void WakeAll();
+
+	std::atomic<uint32_t> m_nSignaled;
+	std::atomic<uint32_t> m_nWaiters;
+	bool m_bManualReset;
+	uint32_t m_nSpinCount;
 };
 #endif
@@ -0,0 +1,254 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+#pragma once
+
+#include "alvr_server/openvr_driver_wrap.h"
+
+#include <atomic>
+#include <cstring>
+
+// Stands in for vrserver in the tools: devices are activated as soon as they are added, and
+// everything they submit is counted and dropped. The counters can be read while the driver calls
+// in from several threads.
+class FakeServerDriverHost : public vr::IVRServerDriverHost {
+public:
+    bool TrackedDeviceAdded(
+        const char*, vr::ETrackedDeviceClass, vr::ITrackedDeviceServerDriver* pDriver
+    ) override {
+        devicesAdded.fetch_add(1, std::memory_order_relaxed);
+        return pDriver->Activate(m_nextIndex++) == vr::VRInitError_None;
+    }
+    void TrackedDevicePoseUpdated(uint32_t, const vr::DriverPose_t& newPose, uint32_t) override {
+        // Read the pose like vrserver copies it
+        vr::DriverPose_t pose;
+        memcpy(&pose, &newPose, sizeof(pose));
+        poseUpdates.fetch_add(pose.poseIsValid ? 1 : 0, std::memory_order_relaxed);
+        invalidPoseUpdates.fetch_add(pose.poseIsValid ? 0 : 1, std::memory_order_relaxed);
+    }
+    void VsyncEvent(double) override { }
+    void VendorSpecificEvent(uint32_t, vr::EVREventType, const vr::VREvent_Data_t&, double)
+        override { }
+    bool IsExiting() override { return false; }
+    bool PollNextEvent(vr::VREvent_t*, uint32_t) override { return false; }
+    void GetRawTrackedDevicePoses(float, vr::TrackedDevicePose_t*, uint32_t) override { }
+    void RequestRestart(const char*, const char*, const char*, const char*) override { }
+    uint32_t GetFrameTimings(vr::Compositor_FrameTiming*, uint32_t) override { return 0; }
+    void SetDisplayEyeToHead(uint32_t, const vr::HmdMatrix34_t&, const vr::HmdMatrix34_t&)
+        override { }
+    void SetDisplayProjectionRaw(uint32_t, const vr::HmdRect2_t&, const vr::HmdRect2_t&)
+        override { }
+    void SetRecommendedRenderTargetSize(uint32_t, uint32_t, uint32_t) override { }
+
+    std::atomic<uint64_t> devicesAdded { 0 };
+    std::atomic<uint64_t> poseUpdates { 0 };
+    // Poses of untracked or disconnected devices
+    std::atomic<uint64_t> invalidPoseUpdates { 0 };
+
+private:
+    std::atomic<vr::TrackedDeviceIndex_t> m_nextIndex { 1 };
+};
+
+class FakeDriverInput : public vr::IVRDriverInput {
+public:
+    vr::EVRInputError CreateBooleanComponent(
+        vr::PropertyContainerHandle_t, const char*, vr::VRInputComponentHandle_t* pHandle
+    ) override {
+        return create(pHandle);
+    }
+    vr::EVRInputError UpdateBooleanComponent(vr::VRInputComponentHandle_t, bool, double) override {
+        return update();
+    }
+    vr::EVRInputError CreateScalarComponent(
+        vr::PropertyContainerHandle_t,
+        const char*,
+        vr::VRInputComponentHandle_t* pHandle,
+        vr::EVRScalarType,
+        vr::EVRScalarUnits
+    ) override {
+        return create(pHandle);
+    }
+    vr::EVRInputError UpdateScalarComponent(vr::VRInputComponentHandle_t, float, double) override {
+        return update();
+    }
+    vr::EVRInputError CreateHapticComponent(
+        vr::PropertyContainerHandle_t, const char*, vr::VRInputComponentHandle_t* pHandle
+    ) override {
+        return create(pHandle);
+    }
+    vr::EVRInputError CreateSkeletonComponent(
+        vr::PropertyContainerHandle_t,
+        const char*,
+        const char*,
+        const char*,
+        vr::EVRSkeletalTrackingLevel,
+        const vr::VRBoneTransform_t*,
+        uint32_t,
+        vr::VRInputComponentHandle_t* pHandle
+    ) override {
+        return create(pHandle);
+    }
+    vr::EVRInputError UpdateSkeletonComponent(
+        vr::VRInputComponentHandle_t,
+        vr::EVRSkeletalMotionRange,
+        const vr::VRBoneTransform_t* pTransforms,
+        uint32_t unTransformCount
+    ) override {
+        // Read the bones like vrserver copies them
+        vr::VRBoneTransform_t bones[64];
+        uint32_t count = unTransformCount < 64 ? unTransformCount : 64;
+        memcpy(bones, pTransforms, count * sizeof(vr::VRBoneTransform_t));
+        skeletonUpdates.fetch_add(1, std::memory_order_relaxed);
+        return vr::VRInputError_None;
+    }
+    vr::EVRInputError CreatePoseComponent(
+        vr::PropertyContainerHandle_t, const char*, vr::VRInputComponentHandle_t* pHandle
+    ) override {
+        return create(pHandle);
+    }
+    vr::EVRInputError UpdatePoseComponent(
+        vr::VRInputComponentHandle_t, const vr::HmdMatrix34_t*, double
+    ) override {
+        return update();
+    }
+    vr::EVRInputError CreateEyeTrackingComponent(
+        vr::PropertyContainerHandle_t, const char*, vr::VRInputComponentHandle_t* pHandle
+    ) override {
+        return create(pHandle);
+    }
+    vr::EVRInputError UpdateEyeTrackingComponent(
+        vr::VRInputComponentHandle_t, const vr::VREyeTrackingData_t*, double
+    ) override {
+        return update();
+    }
+
+    std::atomic<uint64_t> componentUpdates { 0 };
+    std::atomic<uint64_t> skeletonUpdates { 0 };
+
+private:
+    vr::EVRInputError create(vr::VRInputComponentHandle_t* pHandle) {
+        *pHandle = m_nextHandle.fetch_add(1, std::memory_order_relaxed);
+        return vr::VRInputError_None;
+    }
+    vr::EVRInputError update() {
+        componentUpdates.fetch_add(1, std::memory_order_relaxed);
+        return vr::VRInputError_None;
+    }
+
+    std::atomic<vr::VRInputComponentHandle_t> m_nextHandle { 1 };
+};
+
+class FakeProperties : public vr::IVRProperties {
+public:
+    vr::ETrackedPropertyError
+    ReadPropertyBatch(vr::PropertyContainerHandle_t, vr::PropertyRead_t*, uint32_t) override {
+        return vr::TrackedProp_UnknownProperty;
+    }
+    vr::ETrackedPropertyError
+    WritePropertyBatch(vr::PropertyContainerHandle_t, vr::PropertyWrite_t* pBatch, uint32_t count)
+        override {
+        for (uint32_t i = 0; i < count; i++) {
+            pBatch[i].eError = vr::TrackedProp_Success;
+        }
+        propertyWrites.fetch_add(count, std::memory_order_relaxed);
+        return vr::TrackedProp_Success;
+    }
+    const char* GetPropErrorNameFromEnum(vr::ETrackedPropertyError) override { return "error"; }
+    vr::PropertyContainerHandle_t
+    TrackedDeviceToPropertyContainer(vr::TrackedDeviceIndex_t nDevice) override {
+        return nDevice + 1;
+    }
+
+    std::atomic<uint64_t> propertyWrites { 0 };
+};
+
+// Every setting reads as unset, the driver keeps its defaults
+class FakeSettings : public vr::IVRSettings {
+public:
+    const char* GetSettingsErrorNameFromEnum(vr::EVRSettingsError) override { return "error"; }
+    void SetBool(const char*, const char*, bool, vr::EVRSettingsError* peError) override {
+        none(peError);
+    }
+    void SetInt32(const char*, const char*, int32_t, vr::EVRSettingsError* peError) override {
+        none(peError);
+    }
+    void SetFloat(const char*, const char*, float, vr::EVRSettingsError* peError) override {
+        none(peError);
+    }
+    void SetString(const char*, const char*, const char*, vr::EVRSettingsError* peError)
+        override {
+        none(peError);
+    }
+    bool GetBool(const char*, const char*, vr::EVRSettingsError* peError) override {
+        unset(peError);
+        return false;
+    }
+    int32_t GetInt32(const char*, const char*, vr::EVRSettingsError* peError) override {
+        unset(peError);
+        return 0;
+    }
+    float GetFloat(const char*, const char*, vr::EVRSettingsError* peError) override {
+        unset(peError);
+        return 0;
+    }
+    void GetString(
+        const char*, const char*, char* pchValue, uint32_t unValueLen, vr::EVRSettingsError* peError
+    ) override {
+        if (pchValue && unValueLen > 0) {
+            pchValue[0] = 0;
+        }
+        unset(peError);
+    }
+    void RemoveSection(const char*, vr::EVRSettingsError* peError) override { none(peError); }
+    void RemoveKeyInSection(const char*, const char*, vr::EVRSettingsError* peError) override {
+        none(peError);
+    }
+
+private:
+    static void none(vr::EVRSettingsError* peError) {
+        if (peError) {
+            *peError = vr::VRSettingsError_None;
+        }
+    }
+    static void unset(vr::EVRSettingsError* peError) {
+        if (peError) {
+            *peError = vr::VRSettingsError_UnsetSettingHasNoDefault;
+        }
+    }
+};
+
+class FakeDriverLog : public vr::IVRDriverLog {
+public:
+    void Log(const char*) override { }
+};
+
+class FakeDriverContext : public vr::IVRDriverContext {
+public:
+    void* GetGenericInterface(const char* pchInterfaceVersion, vr::EVRInitError* peError) override {
+        void* interface = nullptr;
+        if (strcmp(pchInterfaceVersion, vr::IVRServerDriverHost_Version) == 0) {
+            interface = &host;
+        } else if (strcmp(pchInterfaceVersion, vr::IVRDriverInput_Version) == 0) {
+            interface = &input;
+        } else if (strcmp(pchInterfaceVersion, vr::IVRProperties_Version) == 0) {
+            interface = &properties;
+        } else if (strcmp(pchInterfaceVersion, vr::IVRSettings_Version) == 0) {
+            interface = &m_settings;
+        } else if (strcmp(pchInterfaceVersion, vr::IVRDriverLog_Version) == 0) {
+            interface = &m_log;
+        }
+        if (peError) {
+            *peError = interface ? vr::VRInitError_None : vr::VRInitError_Init_InterfaceNotFound;
+        }
+        return interface;
+    }
+    vr::DriverHandle_t GetDriverHandle() override { return 1; }
+
+    FakeServerDriverHost host;
+    FakeDriverInput input;
+    FakeProperties properties;
+
+private:
+    FakeSettings m_settings;
+    FakeDriverLog m_log;
+};
@@ -0,0 +1,127 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+/*
+Checks of the client clock model (alvr_server/ClientClock.h), which needs nothing of SteamVR.
+build.rs skips the tools directory, build it from cpp/:
+
+    g++ -std=c++17 -O2 -Ialvr_server tools/client_clock_test.cpp \
+        alvr_server/{ClientClock,ClockSync}.cpp -lpthread -o client_clock_test
+
+    ./client_clock_test
+
+Prints the failed checks and exits with 1 if there were any.
+
+- Reset: no offset before the first measurement and after ClientClockReset.
+- Jitter: measurements around a fixed offset, the noisy ones on a slow network moving the model
+  less than the precise ones.
+- Drift: a client clock running 100 ppm fast, the offset extrapolated a second past the last
+  measurement.
+- Resync: a measurement far from the model, like after the client slept, is taken as is.
+*/
+
+#include "ClientClock.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+const int64_t MS = 1'000'000;
+const uint64_t SECOND = 1'000'000'000;
+
+int g_failures = 0;
+
+void Check(bool ok, const char* what, int64_t value) {
+    if (!ok) {
+        printf("FAILED: %s (%lld)\n", what, (long long)value);
+        g_failures++;
+    }
+}
+
+int64_t Abs(int64_t value) { return value < 0 ? -value : value; }
+
+void TestReset() {
+    ClientClockReset();
+    Check(ClientClockServerToClientNs(SECOND) == 0, "no offset before a measurement", 0);
+
+    ClientClockAddOffset(SECOND, 7 * MS, 1 * MS);
+    int64_t offset = ClientClockServerToClientNs(SECOND);
+    Check(offset == 7 * MS, "first measurement taken as is", offset);
+
+    ClientClockReset();
+    offset = ClientClockServerToClientNs(2 * SECOND);
+    Check(offset == 0, "no offset after a reset", offset);
+}
+
+void TestJitter() {
+    ClientClockReset();
+    const int64_t trueOffset = 20 * MS;
+    uint64_t hostNs = SECOND;
+    // +-2 ms of network jitter every 10 ms
+    for (int i = 0; i < 200; i++) {
+        int64_t jitter = (i % 2 == 0 ? 2 : -2) * MS;
+        ClientClockAddOffset(hostNs, trueOffset + jitter, 2 * MS);
+        hostNs += 10 * MS;
+    }
+    int64_t error = ClientClockServerToClientNs(hostNs) - trueOffset;
+    Check(Abs(error) < 1 * MS, "jitter filtered", error);
+
+    // One measurement off by 10 ms, once precise and once taken on a 40 ms network
+    ClientClockAddOffset(hostNs, trueOffset + 10 * MS, 2 * MS);
+    int64_t preciseMove = ClientClockServerToClientNs(hostNs) - trueOffset - error;
+    hostNs += 10 * MS;
+    for (int i = 0; i < 50; i++) {
+        ClientClockAddOffset(hostNs, trueOffset, 2 * MS);
+        hostNs += 10 * MS;
+    }
+    int64_t settled = ClientClockServerToClientNs(hostNs) - trueOffset;
+    ClientClockAddOffset(hostNs, trueOffset + 10 * MS, 40 * MS);
+    int64_t noisyMove = ClientClockServerToClientNs(hostNs) - trueOffset - settled;
+    Check(preciseMove > 0, "precise measurement moves the model", preciseMove);
+    Check(noisyMove < preciseMove / 4, "noisy measurement moves the model less", noisyMove);
+}
+
+void TestDrift() {
+    ClientClockReset();
+    // The client clock gains 100 us per second
+    auto clientOffset = [](uint64_t hostNs) { return 5 * MS + (int64_t)(hostNs / 10'000); };
+    uint64_t hostNs = SECOND;
+    for (int i = 0; i < 1000; i++) {
+        ClientClockAddOffset(hostNs, clientOffset(hostNs), 1 * MS);
+        hostNs += 10 * MS;
+    }
+    uint64_t laterNs = hostNs + SECOND;
+    int64_t error = ClientClockServerToClientNs(laterNs) - clientOffset(laterNs);
+    // Without the drift the model would be 100 us behind
+    Check(Abs(error) < 30'000, "drift extrapolated", error);
+}
+
+void TestResync() {
+    ClientClockReset();
+    uint64_t hostNs = SECOND;
+    for (int i = 0; i < 100; i++) {
+        ClientClockAddOffset(hostNs, 5 * MS, 1 * MS);
+        hostNs += 10 * MS;
+    }
+    // Within the resync threshold the model converges slowly
+    ClientClockAddOffset(hostNs, 25 * MS, 1 * MS);
+    int64_t offset = ClientClockServerToClientNs(hostNs);
+    Check(offset < 25 * MS, "small jump filtered", offset);
+
+    hostNs += 10 * MS;
+    ClientClockAddOffset(hostNs, 500 * MS, 1 * MS);
+    offset = ClientClockServerToClientNs(hostNs);
+    Check(offset == 500 * MS, "large jump taken as is", offset);
+}
+}
+
+int main() {
+    TestReset();
+    TestJitter();
+    TestDrift();
+    TestResync();
+    if (g_failures == 0) {
+        printf("All checks passed\n");
+    }
+    return g_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
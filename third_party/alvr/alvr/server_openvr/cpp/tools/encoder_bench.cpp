@@ -0,0 +1,1314 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+/*
+Standalone benchmark for the Linux EncodePipeline backends (VAAPI, NvEnc, x264), without SteamVR
+or a headset. build.rs skips the tools directory, build it next to the driver sources from cpp/:
+
+    g++ -std=c++17 -O2 -I. -Ialvr_server -Iplatform/linux -I<ffmpeg>/include -I<x264>/include \
+        tools/encoder_bench.cpp platform/linux/{EncodePipeline,EncodePipelineSW,EncodePipelineVAAPI,\
+EncodePipelineNvEnc,EncodePipelineSVT,FormatConverter,Renderer,FrameRender,\
+ffmpeg_helper}.cpp alvr_server/{Settings,FrameTrace,ClockSync,PhotonMarker,\
+EncoderSession,Instance,DriverMetrics,VramBudget,IDRScheduler}.cpp shared/threadtools.cpp \
+        ALVR-common/exception.cpp -L<ffmpeg>/lib -L<x264>/lib -lavfilter -lavcodec -lavutil \
+        -lx264 -lvulkan -lpthread -o encoder_bench
+
+    ./encoder_bench --session <session.json> [--codec h264,hevc,av1] [--size 2880x1600,...]
+        [--bitrate 30,100] [--fps 90] [--frames 600] [--input frames.rgba] [--sw]
+        [--replay <dir>] [--hashes <file>] [--loss 2] [--burst 3] [--jitter 5] [--rtt 20]
+        [--recovery idr,intra] [--seed 1]
+
+The encoder settings come from the openvr_config section of the session file. A fake compositor
+fills the renderer input images, with a moving synthetic pattern or with raw RGBA8 frames read
+from --input at the encoding size, then each frame goes through Renderer::Render, PushFrame and
+GetEncoded like in CEncoder. --fps 0 runs unpaced to measure throughput.
+
+--replay plays back the input frames of a flight recorder dump (record with a downscale of 1)
+through FrameRender instead, so that the whole render chain of the session (color correction,
+foveation, custom shaders) is run on the recorded content at the eye resolution of the session.
+The frames are replayed in order and looped up to --frames, the gaze stays at the configured
+foveation center.
+
+For every codec, size and bitrate it reports the encode latency percentiles (from the render
+submit to the packet being available), the GPU time of the render chain, the achieved bitrate
+against the one given to SetParams and the throughput. The hash of the whole bitstream is printed
+after each run when replaying, and --hashes writes the size and hash of every packet, to check
+that a change to the render chain or the encoder keeps its output bit-exact.
+
+--loss (in percent, in bursts of --burst frames on average) and --jitter (in milliseconds) send the
+packets through a simulated network to a client with the ffmpeg decoder, which reports the frames
+it misses to an IDRScheduler half a --rtt later, like InvalidateFrames. Each run is repeated for
+every --recovery strategy with the same losses: idr recovers with IDRs, intra with intra refresh
+waves (of intra_refresh_frames, or 30 frames when the session has none). The pipelines keep no
+long-term references, reference invalidation and LTR recovery are only benched on Windows. The
+frames are sent at the times of --fps whether the run is paced or not. For each strategy it reports
+the frames the client shows corrupted or not at all, and for each loss episode, until the client
+decodes a frame bit-exact with a loss free decoder, the time to that clean picture and the bitrate
+overshoot against the frames outside of the episodes.
+*/
+
+#include "ALVR-common/packet_types.h"
+#include "EncodePipeline.h"
+#include "FrameRender.h"
+#include "Renderer.h"
+#include "alvr_server/IDRScheduler.h"
+#include "alvr_server/Logger.h"
+#include "alvr_server/Settings.h"
+#include "alvr_server/bindings.h"
+#include "ffmpeg_helper.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Symbols normally provided by alvr_server.cpp and the Rust side
+
+const char* g_sessionPath;
+uint64_t g_DriverTestMode = 0;
+
+const unsigned char* QUAD_SHADER_COMP_SPV_PTR;
+unsigned int QUAD_SHADER_COMP_SPV_LEN;
+const unsigned char* COLOR_SHADER_COMP_SPV_PTR;
+unsigned int COLOR_SHADER_COMP_SPV_LEN;
+const unsigned char* FFR_SHADER_COMP_SPV_PTR;
+unsigned int FFR_SHADER_COMP_SPV_LEN;
+const unsigned char* RGBTOYUV420_SHADER_COMP_SPV_PTR;
+unsigned int RGBTOYUV420_SHADER_COMP_SPV_LEN;
+
+namespace {
+void log(const char* level, const char* format, va_list args) {
+    fprintf(stderr, "[%s] ", level);
+    vfprintf(stderr, format, args);
+    if (format[0] != '\0' && format[strlen(format) - 1] != '\n') {
+        fputc('\n', stderr);
+    }
+}
+}
+
+Exception MakeException(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    Exception e = FormatExceptionV(format, args);
+    va_end(args);
+    return e;
+}
+
+#define DEFINE_LOG(name, level)                                                                    \
+    void name(const char* format, ...) {                                                           \
+        va_list args;                                                                              \
+        va_start(args, format);                                                                    \
+        log(level, format, args);                                                                  \
+        va_end(args);                                                                              \
+    }
+DEFINE_LOG(Error, "error")
+DEFINE_LOG(Warn, "warn")
+DEFINE_LOG(Info, "info")
+#ifdef ALVR_DEBUG_LOG
+DEFINE_LOG(Debug, "debug")
+#endif
+#undef DEFINE_LOG
+
+void LogPeriod(const char*, const char*, ...) { }
+
+namespace {
+// Intra refresh period of the intra recovery when the session has none
+const uint32_t INTRA_REFRESH_FRAMES = 30;
+
+enum Recovery {
+    // No simulated network
+    RECOVERY_NONE,
+    RECOVERY_IDR,
+    RECOVERY_INTRA_REFRESH,
+};
+
+struct Options {
+    std::string session;
+    std::string shaders = "platform/linux/shader";
+    std::string input;
+    std::string replay;
+    std::string hashes;
+    std::vector<int> codecs;
+    std::vector<std::pair<uint32_t, uint32_t>> sizes;
+    std::vector<uint64_t> bitrates = { 30'000'000 };
+    float fps = 0;
+    bool fpsSet = false;
+    uint32_t frames = 600;
+    bool framesSet = false;
+    bool sw = false;
+    // Simulated network, see LossyChannel
+    double lossPercent = 0;
+    double burstFrames = 1;
+    double jitterMs = 0;
+    double rttMs = 20;
+    uint32_t seed = 1;
+    std::vector<Recovery> recoveries;
+};
+
+// Outcome of the simulated network. An episode starts at a frame that the client doesn't show
+// intact and ends at the next frame it decodes bit-exact with the loss free decoder.
+struct LossStats {
+    // Lost or overtaken by a later packet
+    uint32_t lostPackets = 0;
+    uint32_t affectedFrames = 0;
+    uint32_t episodes = 0;
+    // For each ended episode, from the send of its first frame to the arrival of its clean frame
+    std::vector<double> cleanAfterMs;
+    // For each ended episode, its bytes over those of as many frames outside of the episodes
+    std::vector<double> overshoot;
+    // Largest frame of the episodes over the mean frame outside of them
+    double peak = 0;
+};
+
+struct Result {
+    std::vector<double> latenciesMs;
+    std::vector<double> renderMs;
+    uint32_t frames = 0;
+    uint64_t bytes = 0;
+    uint32_t packets = 0;
+    double wallSeconds = 0;
+    // FNV-1a of the whole bitstream, and of every packet
+    uint64_t hash = 0xcbf29ce484222325;
+    std::vector<std::pair<int, uint64_t>> packetHashes;
+    LossStats loss;
+};
+
+uint64_t fnv1a(const uint8_t* data, size_t size, uint64_t hash = 0xcbf29ce484222325) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> parts;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, sep)) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+std::vector<unsigned char> readFile(const std::string& path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) {
+        throw MakeException("Failed to open %s", path.c_str());
+    }
+    return std::vector<unsigned char>(
+        std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()
+    );
+}
+
+// P6 header as written by the flight recorder, leaves the stream at the pixels
+void readPpmHeader(std::ifstream& is, const std::string& path, uint32_t& width, uint32_t& height) {
+    std::string magic;
+    unsigned maxValue = 0;
+    is >> magic >> width >> height >> maxValue;
+    is.get();
+    if (!is || magic != "P6" || maxValue != 255) {
+        throw MakeException("%s is not an 8 bit binary PPM", path.c_str());
+    }
+}
+
+// Input frames of a flight recorder dump, in the order they were rendered
+std::vector<std::string> listRecording(const std::string& dir) {
+    std::vector<std::pair<uint64_t, std::string>> frames;
+    for (auto& entry : std::filesystem::directory_iterator(dir)) {
+        unsigned long long frame;
+        char suffix[16];
+        if (sscanf(entry.path().filename().c_str(), "frame_%llu_%15s", &frame, suffix) == 2
+            && strcmp(suffix, "input.ppm") == 0) {
+            frames.push_back({ frame, entry.path().string() });
+        }
+    }
+    if (frames.empty()) {
+        throw MakeException("No recorded input frames in %s", dir.c_str());
+    }
+    std::sort(frames.begin(), frames.end());
+    std::vector<std::string> paths;
+    for (auto& frame : frames) {
+        paths.push_back(frame.second);
+    }
+    return paths;
+}
+
+const char* recoveryName(Recovery recovery) {
+    return recovery == RECOVERY_INTRA_REFRESH ? "intra" : "idr";
+}
+
+const char* codecName(int codec) {
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        return "h264";
+    case ALVR_CODEC_HEVC:
+        return "hevc";
+    case ALVR_CODEC_AV1:
+        return "av1";
+    default:
+        return "?";
+    }
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, (size_t)(p * (values.size() - 1) + 0.5));
+    return values[index];
+}
+
+// Stands in for the SteamVR compositor: owns the exported input images and their timeline
+// semaphores, and fills them from a staging buffer before every render.
+class FakeCompositor {
+public:
+    static constexpr uint32_t IMAGE_COUNT = 3;
+
+    FakeCompositor(
+        alvr::VkContext& ctx,
+        uint32_t width,
+        uint32_t height,
+        const std::string& input,
+        const std::vector<std::string>& replay = {}
+    )
+        : m_dev(ctx.get_vk_device())
+        , m_width(width)
+        , m_height(height)
+        , m_replay(replay) {
+        auto vkGetMemoryFdKHR
+            = (PFN_vkGetMemoryFdKHR)vkGetDeviceProcAddr(m_dev, "vkGetMemoryFdKHR");
+        auto vkGetSemaphoreFdKHR
+            = (PFN_vkGetSemaphoreFdKHR)vkGetDeviceProcAddr(m_dev, "vkGetSemaphoreFdKHR");
+
+        vkGetDeviceQueue(m_dev, ctx.get_vk_queue_family_index(), 0, &m_queue);
+
+        VkPhysicalDeviceMemoryProperties memProps;
+        vkGetPhysicalDeviceMemoryProperties(ctx.get_vk_phys_device(), &memProps);
+        auto memoryType = [&](uint32_t typeBits, VkMemoryPropertyFlags flags) {
+            for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+                if ((typeBits & (1 << i)) && (memProps.memoryTypes[i].propertyFlags & flags) == flags) {
+                    return i;
+                }
+            }
+            throw std::runtime_error("No suitable memory type");
+        };
+
+        m_imageInfo = {};
+        m_imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        m_imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        m_imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        m_imageInfo.extent = { width, height, 1 };
+        m_imageInfo.mipLevels = 1;
+        m_imageInfo.arrayLayers = 1;
+        m_imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        m_imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        m_imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        m_imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        m_imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        for (uint32_t i = 0; i < IMAGE_COUNT; i++) {
+            VkExternalMemoryImageCreateInfo extMemImageInfo = {};
+            extMemImageInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+            extMemImageInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+            VkImageCreateInfo imageInfo = m_imageInfo;
+            imageInfo.pNext = &extMemImageInfo;
+            VK_CHECK(vkCreateImage(m_dev, &imageInfo, nullptr, &m_images[i].image));
+
+            VkMemoryRequirements req;
+            vkGetImageMemoryRequirements(m_dev, m_images[i].image, &req);
+            m_memoryIndex = memoryType(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+            VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+            dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+            dedicatedInfo.image = m_images[i].image;
+            VkExportMemoryAllocateInfo exportInfo = {};
+            exportInfo.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+            exportInfo.pNext = &dedicatedInfo;
+            exportInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+            VkMemoryAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.pNext = &exportInfo;
+            allocInfo.allocationSize = req.size;
+            allocInfo.memoryTypeIndex = m_memoryIndex;
+            VK_CHECK(vkAllocateMemory(m_dev, &allocInfo, nullptr, &m_images[i].memory));
+            VK_CHECK(vkBindImageMemory(m_dev, m_images[i].image, m_images[i].memory, 0));
+
+            VkMemoryGetFdInfoKHR memFdInfo = {};
+            memFdInfo.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+            memFdInfo.memory = m_images[i].memory;
+            memFdInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+            VK_CHECK(vkGetMemoryFdKHR(m_dev, &memFdInfo, &m_images[i].memoryFd));
+
+            VkExportSemaphoreCreateInfo exportSemInfo = {};
+            exportSemInfo.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
+            exportSemInfo.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+            VkSemaphoreTypeCreateInfo timelineInfo = {};
+            timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+            timelineInfo.pNext = &exportSemInfo;
+            timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+            VkSemaphoreCreateInfo semInfo = {};
+            semInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            semInfo.pNext = &timelineInfo;
+            VK_CHECK(vkCreateSemaphore(m_dev, &semInfo, nullptr, &m_images[i].semaphore));
+
+            VkSemaphoreGetFdInfoKHR semFdInfo = {};
+            semFdInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+            semFdInfo.semaphore = m_images[i].semaphore;
+            semFdInfo.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+            VK_CHECK(vkGetSemaphoreFdKHR(m_dev, &semFdInfo, &m_images[i].semaphoreFd));
+        }
+
+        // Staging buffer, one frame of RGBA8
+        m_frameSize = (VkDeviceSize)width * height * 4;
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = m_frameSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        VK_CHECK(vkCreateBuffer(m_dev, &bufferInfo, nullptr, &m_staging));
+        VkMemoryRequirements req;
+        vkGetBufferMemoryRequirements(m_dev, m_staging, &req);
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = req.size;
+        allocInfo.memoryTypeIndex = memoryType(
+            req.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        );
+        VK_CHECK(vkAllocateMemory(m_dev, &allocInfo, nullptr, &m_stagingMemory));
+        VK_CHECK(vkBindBufferMemory(m_dev, m_staging, m_stagingMemory, 0));
+        VK_CHECK(vkMapMemory(m_dev, m_stagingMemory, 0, m_frameSize, 0, (void**)&m_stagingData));
+
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = ctx.get_vk_queue_family_index();
+        VK_CHECK(vkCreateCommandPool(m_dev, &poolInfo, nullptr, &m_commandPool));
+        VkCommandBufferAllocateInfo cmdInfo = {};
+        cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmdInfo.commandPool = m_commandPool;
+        cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cmdInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(m_dev, &cmdInfo, &m_commandBuffer));
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VK_CHECK(vkCreateFence(m_dev, &fenceInfo, nullptr, &m_fence));
+
+        if (!input.empty()) {
+            m_input.open(input, std::ios::binary);
+            if (!m_input) {
+                throw MakeException("Failed to open %s", input.c_str());
+            }
+        }
+    }
+
+    ~FakeCompositor() {
+        vkDeviceWaitIdle(m_dev);
+        vkDestroyFence(m_dev, m_fence, nullptr);
+        vkDestroyCommandPool(m_dev, m_commandPool, nullptr);
+        vkDestroyBuffer(m_dev, m_staging, nullptr);
+        vkFreeMemory(m_dev, m_stagingMemory, nullptr);
+        for (auto& image : m_images) {
+            vkDestroySemaphore(m_dev, image.semaphore, nullptr);
+            vkDestroyImage(m_dev, image.image, nullptr);
+            vkFreeMemory(m_dev, image.memory, nullptr);
+        }
+    }
+
+    // Hands the images to the renderer, which takes ownership of the fds
+    void Attach(Renderer& render) {
+        for (auto& image : m_images) {
+            render.AddImage(m_imageInfo, m_memoryIndex, image.memoryFd, image.semaphoreFd);
+        }
+    }
+
+    // Same as the handshake of the compositor with CEncoder, for FrameRender. The renderer takes
+    // ownership of the fds.
+    init_packet GetInit(int fds[6]) {
+        init_packet init = {};
+        init.num_images = IMAGE_COUNT;
+        init.image_create_info = m_imageInfo;
+        init.mem_index = m_memoryIndex;
+        for (uint32_t i = 0; i < IMAGE_COUNT; i++) {
+            fds[2 * i] = m_images[i].memoryFd;
+            fds[2 * i + 1] = m_images[i].semaphoreFd;
+        }
+        return init;
+    }
+
+    // Fills the next image and returns its index. `value` is the timeline value to wait for.
+    uint32_t Present(uint32_t frame, uint64_t& value) {
+        fill(frame);
+
+        uint32_t index = frame % IMAGE_COUNT;
+        Image& image = m_images[index];
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK(vkBeginCommandBuffer(m_commandBuffer, &beginInfo));
+
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image.image;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            m_commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0,
+            nullptr,
+            0,
+            nullptr,
+            1,
+            &barrier
+        );
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        region.imageExtent = { m_width, m_height, 1 };
+        vkCmdCopyBufferToImage(
+            m_commandBuffer,
+            m_staging,
+            image.image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &region
+        );
+
+        // The renderer transitions from UNDEFINED itself, leave it in a layout it can sample
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(
+            m_commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            0,
+            nullptr,
+            0,
+            nullptr,
+            1,
+            &barrier
+        );
+        VK_CHECK(vkEndCommandBuffer(m_commandBuffer));
+
+        value = ++image.value;
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &image.value;
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &image.semaphore;
+        VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, m_fence));
+
+        // The staging buffer and command buffer are reused by the next frame
+        VK_CHECK(vkWaitForFences(m_dev, 1, &m_fence, VK_TRUE, UINT64_MAX));
+        VK_CHECK(vkResetFences(m_dev, 1, &m_fence));
+        return index;
+    }
+
+private:
+    struct Image {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        int memoryFd = -1;
+        int semaphoreFd = -1;
+        uint64_t value = 0;
+    };
+
+    void fill(uint32_t frame) {
+        if (!m_replay.empty()) {
+            const std::string& path = m_replay[frame % m_replay.size()];
+            std::ifstream is(path, std::ios::binary);
+            uint32_t width, height;
+            readPpmHeader(is, path, width, height);
+            if (width != m_width || height != m_height) {
+                throw MakeException("%s doesn't have the size of the first frame", path.c_str());
+            }
+            std::vector<uint8_t> row(m_width * 3);
+            for (uint32_t y = 0; y < m_height; y++) {
+                if (!is.read((char*)row.data(), row.size())) {
+                    throw MakeException("%s is truncated", path.c_str());
+                }
+                uint8_t* pixel = m_stagingData + (size_t)y * m_width * 4;
+                for (uint32_t x = 0; x < m_width; x++, pixel += 4) {
+                    memcpy(pixel, &row[x * 3], 3);
+                    pixel[3] = 255;
+                }
+            }
+            return;
+        }
+
+        if (m_input.is_open()) {
+            if (!m_input.read((char*)m_stagingData, m_frameSize)) {
+                // Loop the recording
+                m_input.clear();
+                m_input.seekg(0);
+                if (!m_input.read((char*)m_stagingData, m_frameSize)) {
+                    throw std::runtime_error("Input is smaller than one frame at this size");
+                }
+            }
+            return;
+        }
+
+        // Scrolling gradients with a band of noise, so that motion estimation and rate control
+        // both have something to work with
+        uint32_t noiseTop = (frame * 7) % m_height;
+        uint32_t noiseBottom = std::min(m_height, noiseTop + m_height / 8);
+        uint32_t seed = frame * 2654435761u;
+        for (uint32_t y = 0; y < m_height; y++) {
+            uint8_t* row = m_stagingData + (size_t)y * m_width * 4;
+            bool noise = y >= noiseTop && y < noiseBottom;
+            for (uint32_t x = 0; x < m_width; x++) {
+                uint8_t* pixel = row + x * 4;
+                pixel[0] = (uint8_t)(x + frame * 4);
+                pixel[1] = (uint8_t)(y + frame * 2);
+                pixel[2] = (uint8_t)((x ^ y) + frame);
+                pixel[3] = 255;
+                if (noise) {
+                    seed = seed * 1664525u + 1013904223u;
+                    pixel[0] ^= seed >> 24;
+                    pixel[1] ^= seed >> 16;
+                }
+            }
+        }
+    }
+
+    VkDevice m_dev;
+    VkQueue m_queue = VK_NULL_HANDLE;
+    uint32_t m_width;
+    uint32_t m_height;
+    VkImageCreateInfo m_imageInfo;
+    uint32_t m_memoryIndex = 0;
+    Image m_images[IMAGE_COUNT];
+    VkDeviceSize m_frameSize = 0;
+    VkBuffer m_staging = VK_NULL_HANDLE;
+    VkDeviceMemory m_stagingMemory = VK_NULL_HANDLE;
+    uint8_t* m_stagingData = nullptr;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+    VkFence m_fence = VK_NULL_HANDLE;
+    std::ifstream m_input;
+    std::vector<std::string> m_replay;
+};
+
+uint64_t hashFrame(const AVFrame* frame) {
+    auto format = (AVPixelFormat)frame->format;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+    uint64_t hash = 0xcbf29ce484222325;
+    for (int plane = 0; plane < 4 && frame->data[plane]; plane++) {
+        bool chroma = plane == 1 || plane == 2;
+        int rows = chroma ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+        int bytes = av_image_get_linesize(format, frame->width, plane);
+        for (int y = 0; y < rows; y++) {
+            hash = fnv1a(frame->data[plane] + (size_t)y * frame->linesize[plane], bytes, hash);
+        }
+    }
+    return hash;
+}
+
+// Software decoder of the client, with one frame out for each packet in
+class Decoder {
+public:
+    explicit Decoder(int codec) {
+        AVCodecID id = AV_CODEC_ID_AV1;
+        if (codec == ALVR_CODEC_H264) {
+            id = AV_CODEC_ID_H264;
+        } else if (codec == ALVR_CODEC_HEVC) {
+            id = AV_CODEC_ID_HEVC;
+        }
+        const AVCodec* decoder = avcodec_find_decoder(id);
+        if (!decoder) {
+            throw MakeException("No %s decoder in this ffmpeg", codecName(codec));
+        }
+        m_ctx = avcodec_alloc_context3(decoder);
+        m_ctx->thread_count = 1;
+        m_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        if (avcodec_open2(m_ctx, decoder, nullptr) < 0) {
+            avcodec_free_context(&m_ctx);
+            throw MakeException("Failed to open the %s decoder", codecName(codec));
+        }
+        m_packet = av_packet_alloc();
+        m_frame = av_frame_alloc();
+    }
+
+    ~Decoder() {
+        av_frame_free(&m_frame);
+        av_packet_free(&m_packet);
+        avcodec_free_context(&m_ctx);
+    }
+
+    // data is followed by AV_INPUT_BUFFER_PADDING_SIZE zeros. Returns false if no frame came out,
+    // like for a frame the decoder can't conceal.
+    bool Decode(uint8_t* data, int size, uint64_t& hash) {
+        m_packet->data = data;
+        m_packet->size = size;
+        int ret = avcodec_send_packet(m_ctx, m_packet);
+        m_packet->data = nullptr;
+        m_packet->size = 0;
+        if (ret < 0) {
+            return false;
+        }
+        bool decoded = false;
+        while (avcodec_receive_frame(m_ctx, m_frame) >= 0) {
+            hash = hashFrame(m_frame);
+            decoded = true;
+            av_frame_unref(m_frame);
+        }
+        return decoded;
+    }
+
+private:
+    AVCodecContext* m_ctx = nullptr;
+    AVPacket* m_packet = nullptr;
+    AVFrame* m_frame = nullptr;
+};
+
+// Simulated network between the encoder and the client. Losses come in bursts, from a two state
+// Markov chain with the mean loss rate and burst length of the options, and the one way delay is
+// half the RTT plus a uniform jitter. The client drops the packets overtaken by a later one like
+// the lost ones, and on a gap reports the first missing frame, which reaches the IDRScheduler half
+// a RTT later. The random draws only depend on the packet count, every recovery strategy of a run
+// sees the same losses.
+class LossyChannel {
+public:
+    LossyChannel(const Options& options, int codec, Recovery recovery)
+        : m_options(options)
+        , m_random(options.seed)
+        , m_reference(codec)
+        , m_client(codec) {
+        double loss = std::min(options.lossPercent / 100, 0.99);
+        m_burstEnd = 1 / std::max(options.burstFrames, 1.0);
+        m_burstStart = loss * m_burstEnd / (1 - loss);
+        m_scheduler.SetIntraRefresh(recovery == RECOVERY_INTRA_REFRESH);
+        m_scheduler.OnStreamStart();
+    }
+
+    // Before pushing the frame sent at nowNs, the recovery of the reports received by then.
+    // Returns whether the frame is an IDR.
+    bool BeginFrame(uint64_t nowNs, alvr::EncodePipeline& pipeline) {
+        deliver(nowNs);
+        while (!m_reports.empty() && m_reports.front().first <= nowNs) {
+            m_scheduler.InvalidateFrames(m_reports.front().second);
+            m_reports.pop_front();
+        }
+        bool idr = m_scheduler.CheckIDRInsertion() != 0;
+        if (!idr && m_scheduler.CheckIntraRefreshInsertion()) {
+            pipeline.InsertIntraRefresh();
+        }
+        return idr;
+    }
+
+    void Send(const alvr::FramePacket& packet, uint64_t nowNs) {
+        Packet sent;
+        sent.pts = packet.pts;
+        sent.size = packet.size;
+        sent.sendNs = nowNs;
+        sent.data.assign(packet.data, packet.data + packet.size);
+        sent.data.resize(packet.size + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+        sent.referenceDecoded
+            = m_reference.Decode(sent.data.data(), sent.size, sent.referenceHash);
+
+        m_burst = std::bernoulli_distribution(m_burst ? 1 - m_burstEnd : m_burstStart)(m_random);
+        std::uniform_real_distribution<double> jitter(0, m_options.jitterMs * 1e6);
+        sent.arrivalNs = nowNs + (uint64_t)(m_options.rttMs * 0.5e6 + jitter(m_random));
+        sent.lost = m_burst;
+        if (sent.lost) {
+            sent.data = {};
+        } else {
+            m_inFlight.insert({ sent.arrivalNs, m_packets.size() });
+        }
+        m_packets.push_back(std::move(sent));
+    }
+
+    LossStats Finish() {
+        deliver(UINT64_MAX);
+
+        // Episodes as [first, clean) ranges of packets, clean is the end for an unfinished one
+        std::vector<std::pair<size_t, size_t>> episodes;
+        std::vector<bool> inEpisode(m_packets.size());
+        for (size_t i = 0; i < m_packets.size(); i++) {
+            if (m_packets[i].clean) {
+                continue;
+            }
+            size_t clean = i;
+            while (clean < m_packets.size() && !m_packets[clean].clean) {
+                inEpisode[clean++] = true;
+            }
+            if (clean < m_packets.size()) {
+                inEpisode[clean] = true;
+            }
+            episodes.push_back({ i, clean });
+            i = clean;
+        }
+
+        // The first IDR is no steady state either
+        double steadyBytes = 0;
+        uint32_t steadyFrames = 0;
+        for (size_t i = 1; i < m_packets.size(); i++) {
+            if (!inEpisode[i]) {
+                steadyBytes += m_packets[i].size;
+                steadyFrames++;
+            }
+        }
+        double steadyMean = steadyFrames > 0 ? steadyBytes / steadyFrames : 0;
+
+        LossStats stats;
+        for (const Packet& packet : m_packets) {
+            stats.lostPackets += packet.lost || packet.late;
+            stats.affectedFrames += !packet.clean;
+        }
+        stats.episodes = episodes.size();
+        for (auto [first, clean] : episodes) {
+            if (clean == m_packets.size() || steadyMean == 0) {
+                continue;
+            }
+            double bytes = 0;
+            for (size_t i = first; i <= clean; i++) {
+                bytes += m_packets[i].size;
+                stats.peak = std::max(stats.peak, m_packets[i].size / steadyMean);
+            }
+            stats.cleanAfterMs.push_back(
+                (m_packets[clean].arrivalNs - m_packets[first].sendNs) / 1e6
+            );
+            stats.overshoot.push_back(bytes / ((clean - first + 1) * steadyMean) - 1);
+        }
+        return stats;
+    }
+
+private:
+    struct Packet {
+        uint64_t pts = 0;
+        int size = 0;
+        uint64_t sendNs = 0;
+        uint64_t arrivalNs = 0;
+        // Padded for the decoder, released once the packet is delivered or lost
+        std::vector<uint8_t> data;
+        bool referenceDecoded = false;
+        uint64_t referenceHash = 0;
+        bool lost = false;
+        bool late = false;
+        // Decoded by the client bit-exact with the reference decoder
+        bool clean = false;
+    };
+
+    // The client receives the packets that arrived by nowNs
+    void deliver(uint64_t nowNs) {
+        while (!m_inFlight.empty() && m_inFlight.begin()->first <= nowNs) {
+            int64_t index = (int64_t)m_inFlight.begin()->second;
+            m_inFlight.erase(m_inFlight.begin());
+            Packet& packet = m_packets[index];
+            if (index <= m_highest) {
+                // The decoder has moved past it
+                packet.late = true;
+                packet.data = {};
+                continue;
+            }
+            if (index > m_highest + 1) {
+                uint64_t reportNs = packet.arrivalNs + (uint64_t)(m_options.rttMs * 0.5e6);
+                m_reports.push_back({ reportNs, m_packets[m_highest + 1].pts });
+            }
+            m_highest = index;
+            uint64_t hash = 0;
+            packet.clean = m_client.Decode(packet.data.data(), packet.size, hash)
+                && packet.referenceDecoded && hash == packet.referenceHash;
+            packet.data = {};
+        }
+    }
+
+    const Options& m_options;
+    std::mt19937 m_random;
+    double m_burstStart = 0;
+    double m_burstEnd = 1;
+    bool m_burst = false;
+    Decoder m_reference;
+    Decoder m_client;
+    IDRScheduler m_scheduler;
+    std::vector<Packet> m_packets;
+    // Arrival time to index in m_packets, of the packets not lost
+    std::multimap<uint64_t, size_t> m_inFlight;
+    // Reception time by the server and first lost frame, in the order they were sent
+    std::deque<std::pair<uint64_t, uint64_t>> m_reports;
+    // Last packet the client decoded
+    int64_t m_highest = -1;
+};
+
+// Encodes `frames` frames rendered from the compositor to the output of render, which must have
+// been created. With a channel, the packets are sent through it and it decides the IDRs.
+Result encodeFrames(
+    alvr::VkContext& ctx,
+    Renderer& render,
+    FakeCompositor& compositor,
+    uint32_t frames,
+    uint32_t width,
+    uint32_t height,
+    uint64_t bitrate,
+    float fps,
+    LossyChannel* channel
+) {
+    auto& output = render.GetOutput();
+
+    alvr::VkFrame frame(
+        ctx, output.image, output.imageInfo, output.size, output.memory, output.drm
+    );
+    auto pipeline
+        = alvr::EncodePipeline::Create(&render, ctx, frame, output.imageInfo, width, height);
+
+    FfiDynamicEncoderParams params = {};
+    params.updated = true;
+    params.bitrate_bps = bitrate;
+    params.framerate = fps > 0 ? fps : Settings::Instance().m_refreshRate;
+    pipeline->SetParams(params);
+    if (channel && Settings::Instance().m_intraRefreshFrames > 0
+        && !pipeline->SupportsIntraRefresh()) {
+        throw MakeException("%s has no intra refresh", pipeline->GetEncoderName().c_str());
+    }
+
+    Result result;
+    result.frames = frames;
+    result.latenciesMs.reserve(frames);
+
+    using clock = std::chrono::steady_clock;
+    auto frameInterval = std::chrono::nanoseconds(fps > 0 ? (int64_t)(1e9 / fps) : 0);
+    auto start = clock::now();
+    auto deadline = start;
+    double sendIntervalNs = 1e9 / params.framerate;
+    for (uint32_t i = 0; i < frames; i++) {
+        uint64_t waitValue;
+        uint32_t index = compositor.Present(i, waitValue);
+
+        auto begin = clock::now();
+        uint64_t targetTimestampNs = (uint64_t)(begin - start).count() + 1;
+        uint64_t renderFrame = render.Render(index, waitValue);
+        uint64_t sendNs = (uint64_t)(i * sendIntervalNs);
+        bool idr = channel ? channel->BeginFrame(sendNs, *pipeline) : i == 0;
+        pipeline->PushFrame(targetTimestampNs, idr);
+
+        alvr::FramePacket packet;
+        if (pipeline->GetEncoded(packet)) {
+            auto end = clock::now();
+            result.latenciesMs.push_back(
+                std::chrono::duration<double, std::milli>(end - begin).count()
+            );
+            result.bytes += packet.size;
+            result.packets++;
+            result.hash = fnv1a(packet.data, packet.size, result.hash);
+            result.packetHashes.push_back({ packet.size, fnv1a(packet.data, packet.size) });
+            if (channel) {
+                channel->Send(packet, sendNs);
+            }
+        }
+        if (auto release = pipeline->LeasePacket()) {
+            release();
+        }
+        // The render has completed once its frame was encoded
+        Renderer::Timestamps timestamps;
+        if (render.GetTimestamps(renderFrame, timestamps)) {
+            result.renderMs.push_back((timestamps.renderComplete - timestamps.renderBegin) / 1e6);
+        }
+
+        if (fps > 0) {
+            deadline += frameInterval;
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+    result.wallSeconds = std::chrono::duration<double>(clock::now() - start).count();
+    if (channel) {
+        result.loss = channel->Finish();
+    }
+
+    return result;
+}
+
+Result runOne(
+    alvr::VkContext& ctx,
+    const Options& options,
+    uint32_t width,
+    uint32_t height,
+    uint64_t bitrate,
+    float fps,
+    LossyChannel* channel
+) {
+    Renderer render(
+        ctx.get_vk_instance(),
+        ctx.get_vk_device(),
+        ctx.get_vk_phys_device(),
+        ctx.get_vk_queue_family_index(),
+        ctx.get_vk_device_extensions()
+    );
+    render.m_quadShaderSize = QUAD_SHADER_COMP_SPV_LEN;
+    render.m_quadShaderCode = reinterpret_cast<const uint32_t*>(QUAD_SHADER_COMP_SPV_PTR);
+    render.Startup(width, height, VK_FORMAT_R8G8B8A8_UNORM);
+
+    FakeCompositor compositor(ctx, width, height, options.input);
+    compositor.Attach(render);
+
+    RenderPipeline quad(&render);
+    quad.SetShader(QUAD_SHADER_COMP_SPV_PTR, QUAD_SHADER_COMP_SPV_LEN);
+    render.AddPipeline(&quad);
+
+    // Same choice as FrameRender
+    Renderer::ExternalHandle handle = Renderer::ExternalHandle::None;
+    if (Settings::Instance().m_force_sw_encoding) {
+        handle = Renderer::ExternalHandle::None;
+    } else if (ctx.amd || ctx.intel) {
+        handle = Renderer::ExternalHandle::DmaBuf;
+    } else if (ctx.nvidia) {
+        handle = Renderer::ExternalHandle::OpaqueFd;
+    }
+    render.CreateOutput(width, height, handle);
+
+    return encodeFrames(
+        ctx, render, compositor, options.frames, width, height, bitrate, fps, channel
+    );
+}
+
+// Replays the recording through the render chain of the session
+Result runReplay(
+    alvr::VkContext& ctx,
+    const Options& options,
+    const std::vector<std::string>& recording,
+    uint64_t bitrate,
+    float fps,
+    LossyChannel* channel
+) {
+    std::ifstream is(recording[0], std::ios::binary);
+    uint32_t inputWidth, inputHeight;
+    readPpmHeader(is, recording[0], inputWidth, inputHeight);
+
+    FakeCompositor compositor(ctx, inputWidth, inputHeight, "", recording);
+    int fds[6];
+    init_packet init = compositor.GetInit(fds);
+    FrameRender render(ctx, init, fds);
+    render.CreateOutput();
+
+    uint32_t frames = options.framesSet ? options.frames : recording.size();
+    return encodeFrames(
+        ctx,
+        render,
+        compositor,
+        frames,
+        render.GetEncodingWidth(),
+        render.GetEncodingHeight(),
+        bitrate,
+        fps,
+        channel
+    );
+}
+
+void printResult(
+    const Result& result,
+    int codec,
+    uint32_t width,
+    uint32_t height,
+    uint64_t bitrate,
+    float fps,
+    bool replay,
+    std::ofstream& hashes
+) {
+    // The achieved bitrate is measured against the stream duration at the paced rate, or against
+    // the wall time when unpaced
+    double seconds = fps > 0 ? result.frames / fps : result.wallSeconds;
+    double actual = seconds > 0 ? result.bytes * 8 / seconds : 0;
+    char size[32];
+    snprintf(size, sizeof(size), "%ux%u", width, height);
+    printf(
+        "%-5s %-10s %7.1fM %7.1fM %8.2f %8.2f %8.2f %10.2f %8.2f %8.1f %8u\n",
+        codecName(codec),
+        size,
+        bitrate / 1e6,
+        actual / 1e6,
+        percentile(result.latenciesMs, 0.5),
+        percentile(result.latenciesMs, 0.9),
+        percentile(result.latenciesMs, 0.99),
+        percentile(result.latenciesMs, 1.0),
+        percentile(result.renderMs, 0.5),
+        result.packets / result.wallSeconds,
+        result.packets
+    );
+    if (replay) {
+        printf("      stream hash %016llx\n", (unsigned long long)result.hash);
+    }
+    if (hashes.is_open()) {
+        hashes << codecName(codec) << " " << size << " " << bitrate << "\n";
+        for (auto [bytes, hash] : result.packetHashes) {
+            char line[48];
+            snprintf(line, sizeof(line), "%d %016llx\n", bytes, (unsigned long long)hash);
+            hashes << line;
+        }
+    }
+}
+
+void printLoss(const LossStats& loss, Recovery recovery) {
+    double overshoot = 0;
+    for (double episode : loss.overshoot) {
+        overshoot += episode;
+    }
+    if (!loss.overshoot.empty()) {
+        overshoot /= loss.overshoot.size();
+    }
+    printf(
+        "      %-5s %u lost, %u affected, %u episodes, clean after p50 %.1f p90 %.1f max %.1f ms, "
+        "overshoot %+.0f%%, peak %.1fx\n",
+        recoveryName(recovery),
+        loss.lostPackets,
+        loss.affectedFrames,
+        loss.episodes,
+        percentile(loss.cleanAfterMs, 0.5),
+        percentile(loss.cleanAfterMs, 0.9),
+        percentile(loss.cleanAfterMs, 1.0),
+        overshoot * 100,
+        loss.peak
+    );
+}
+
+void usage() {
+    fprintf(
+        stderr,
+        "usage: encoder_bench --session <session.json> [--codec h264,hevc,av1] "
+        "[--size WxH,...] [--bitrate Mbps,...] [--fps N] [--frames N] [--input frames.rgba] "
+        "[--shaders dir] [--sw] [--replay dir] [--hashes file] [--loss percent] "
+        "[--burst frames] [--jitter ms] [--rtt ms] [--recovery idr,intra] [--seed N]\n"
+    );
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw MakeException("Missing value for %s", arg.c_str());
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--session") {
+            options.session = value();
+        } else if (arg == "--shaders") {
+            options.shaders = value();
+        } else if (arg == "--input") {
+            options.input = value();
+        } else if (arg == "--replay") {
+            options.replay = value();
+        } else if (arg == "--hashes") {
+            options.hashes = value();
+        } else if (arg == "--codec") {
+            for (auto& name : split(value(), ',')) {
+                if (name == "h264") {
+                    options.codecs.push_back(ALVR_CODEC_H264);
+                } else if (name == "hevc") {
+                    options.codecs.push_back(ALVR_CODEC_HEVC);
+                } else if (name == "av1") {
+                    options.codecs.push_back(ALVR_CODEC_AV1);
+                } else {
+                    throw MakeException("Unknown codec %s", name.c_str());
+                }
+            }
+        } else if (arg == "--size") {
+            for (auto& size : split(value(), ',')) {
+                unsigned width, height;
+                if (sscanf(size.c_str(), "%ux%u", &width, &height) != 2) {
+                    throw MakeException("Invalid size %s", size.c_str());
+                }
+                options.sizes.push_back({ width & ~1u, height & ~1u });
+            }
+        } else if (arg == "--bitrate") {
+            options.bitrates.clear();
+            for (auto& mbps : split(value(), ',')) {
+                options.bitrates.push_back((uint64_t)(std::stod(mbps) * 1'000'000));
+            }
+        } else if (arg == "--fps") {
+            options.fps = std::stof(value());
+            options.fpsSet = true;
+        } else if (arg == "--frames") {
+            options.frames = std::stoul(value());
+            options.framesSet = true;
+        } else if (arg == "--sw") {
+            options.sw = true;
+        } else if (arg == "--loss") {
+            options.lossPercent = std::stod(value());
+        } else if (arg == "--burst") {
+            options.burstFrames = std::stod(value());
+        } else if (arg == "--jitter") {
+            options.jitterMs = std::stod(value());
+        } else if (arg == "--rtt") {
+            options.rttMs = std::stod(value());
+        } else if (arg == "--seed") {
+            options.seed = std::stoul(value());
+        } else if (arg == "--recovery") {
+            for (auto& name : split(value(), ',')) {
+                if (name == "idr") {
+                    options.recoveries.push_back(RECOVERY_IDR);
+                } else if (name == "intra") {
+                    options.recoveries.push_back(RECOVERY_INTRA_REFRESH);
+                } else {
+                    throw MakeException("Unknown recovery %s", name.c_str());
+                }
+            }
+        } else {
+            throw MakeException("Unknown option %s", arg.c_str());
+        }
+    }
+    if (options.session.empty()) {
+        throw MakeException("--session is required");
+    }
+    if (options.lossPercent > 0 || options.jitterMs > 0) {
+        if (options.recoveries.empty()) {
+            options.recoveries = { RECOVERY_IDR, RECOVERY_INTRA_REFRESH };
+        }
+    } else {
+        options.recoveries = { RECOVERY_NONE };
+    }
+    return options;
+}
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        usage();
+        return 1;
+    }
+
+    try {
+        g_sessionPath = options.session.c_str();
+        Settings& settings = Settings::Instance();
+        settings.Load();
+        if (!settings.IsLoaded()) {
+            throw MakeException("Failed to load %s", options.session.c_str());
+        }
+        settings.m_force_sw_encoding |= options.sw;
+
+        auto quad = readFile(options.shaders + "/quad.comp.spv");
+        auto color = readFile(options.shaders + "/color.comp.spv");
+        auto ffr = readFile(options.shaders + "/ffr.comp.spv");
+        auto rgbtoyuv = readFile(options.shaders + "/rgbtoyuv420.comp.spv");
+        QUAD_SHADER_COMP_SPV_PTR = quad.data();
+        QUAD_SHADER_COMP_SPV_LEN = quad.size();
+        COLOR_SHADER_COMP_SPV_PTR = color.data();
+        COLOR_SHADER_COMP_SPV_LEN = color.size();
+        FFR_SHADER_COMP_SPV_PTR = ffr.data();
+        FFR_SHADER_COMP_SPV_LEN = ffr.size();
+        RGBTOYUV420_SHADER_COMP_SPV_PTR = rgbtoyuv.data();
+        RGBTOYUV420_SHADER_COMP_SPV_LEN = rgbtoyuv.size();
+
+        if (options.codecs.empty()) {
+            options.codecs.push_back(settings.m_codec);
+        }
+        std::vector<std::string> recording;
+        if (!options.replay.empty()) {
+            recording = listRecording(options.replay);
+            // FrameRender encodes at the eye resolution of the session
+            options.sizes = { { settings.m_renderWidth, settings.m_renderHeight } };
+        }
+        if (options.sizes.empty()) {
+            options.sizes.push_back({ settings.m_renderWidth, settings.m_renderHeight });
+        }
+        std::ofstream hashes;
+        if (!options.hashes.empty()) {
+            hashes.open(options.hashes);
+            if (!hashes) {
+                throw MakeException("Failed to open %s", options.hashes.c_str());
+            }
+        }
+        float fps = options.fpsSet ? options.fps : settings.m_refreshRate;
+
+        // No compositor to match, the first device is used
+        uint8_t uuid[VK_UUID_SIZE] = {};
+        alvr::VkContext ctx(uuid, {});
+
+        printf(
+            "%-5s %-10s %8s %8s %8s %8s %8s %10s %8s %8s %8s\n",
+            "codec",
+            "size",
+            "target",
+            "actual",
+            "p50 ms",
+            "p90 ms",
+            "p99 ms",
+            "max ms",
+            "gpu ms",
+            "fps",
+            "frames"
+        );
+        for (int codec : options.codecs) {
+            settings.m_codec = codec;
+            for (auto [width, height] : options.sizes) {
+                for (uint64_t bitrate : options.bitrates) {
+                    for (Recovery recovery : options.recoveries) {
+                        uint32_t intraRefreshFrames = settings.m_intraRefreshFrames;
+                        std::unique_ptr<LossyChannel> channel;
+                        if (recovery == RECOVERY_IDR) {
+                            settings.m_intraRefreshFrames = 0;
+                        } else if (recovery == RECOVERY_INTRA_REFRESH && intraRefreshFrames == 0) {
+                            settings.m_intraRefreshFrames = INTRA_REFRESH_FRAMES;
+                        }
+                        Result result;
+                        try {
+                            if (recovery != RECOVERY_NONE) {
+                                channel = std::make_unique<LossyChannel>(options, codec, recovery);
+                            }
+                            result = recording.empty()
+                                ? runOne(ctx, options, width, height, bitrate, fps, channel.get())
+                                : runReplay(ctx, options, recording, bitrate, fps, channel.get());
+                        } catch (std::exception& e) {
+                            Error(
+                                "%s %ux%u failed: %s", codecName(codec), width, height, e.what()
+                            );
+                            settings.m_intraRefreshFrames = intraRefreshFrames;
+                            continue;
+                        }
+                        settings.m_intraRefreshFrames = intraRefreshFrames;
+                        printResult(
+                            result, codec, width, height, bitrate, fps, !recording.empty(), hashes
+                        );
+                        if (recovery != RECOVERY_NONE) {
+                            printLoss(result.loss, recovery);
+                        }
+                    }
+                }
+            }
+        }
+    } catch (std::exception& e) {
+        fprintf(stderr, "encoder_bench: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
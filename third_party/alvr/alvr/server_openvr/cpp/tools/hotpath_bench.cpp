@@ -0,0 +1,594 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+/*
+Microbenchmarks of the alvr_server hot paths, without SteamVR or the Rust side. The bindings.h
+callbacks are stubs and a fake OpenVR driver context stands in for vrserver. build.rs skips the
+tools directory, build it next to the driver sources from cpp/:
+
+    g++ -std=c++17 -O2 -I. -Ialvr_server -I<openvr>/headers tools/hotpath_bench.cpp \
+        alvr_server/{PoseHistory,NalParsing,NalIndex,Controller,TrackedDevice,PosePredictor,Paths,\
+Logger,Settings,FrameTrace,Instance,DriverMetrics,CpuFeatures}.cpp ALVR-common/exception.cpp \
+        -lpthread -o hotpath_bench
+
+    ./hotpath_bench [--session <session.json>] [--filter <substring>] [--min-time 0.5]
+        [--stream h264:<file>] [--stream hevc:<file>] [--stream av1:<file>] [--json <file>]
+
+Like Google Benchmark, each benchmark runs with a growing iteration count until a run takes at
+least --min-time seconds, and reports the time per iteration of that run. The session file is
+optional, without it the settings keep their defaults.
+
+- PoseHistory: OnPoseUpdated at the tracking rate, GetPoseAt and GetBestPoseMatch on a full
+  history.
+- ParseFrameNals: the access units of a recorded Annex B (h264, hevc) or low overhead OBU (av1)
+  stream, split at the AUDs or temporal delimiters. Without --stream, a synthetic 90 fps stream of
+  every codec is used. The frame is copied before each call since the parsing can rewrite it.
+- Controller: OnPoseUpdate of a hand tracker (bone transforms from the skeleton) and of a
+  controller (animated hand pose), with the pose and skeleton going to the fake vrserver.
+- SetTracking: the per-device work of a SetTracking call, which is the head pose history and both
+  hands. SetTracking itself lives in alvr_server.cpp, which needs the platform encoder.
+- Logger: Info with and without the background worker, Error always being synchronous.
+*/
+
+#include "ALVR-common/packet_types.h"
+#include "alvr_server/Controller.h"
+#include "alvr_server/Logger.h"
+#include "alvr_server/NalIndex.h"
+#include "alvr_server/Paths.h"
+#include "alvr_server/PoseHistory.h"
+#include "alvr_server/Settings.h"
+#include "alvr_server/bindings.h"
+#include "alvr_server/openvr_driver_wrap.h"
+#include "tools/FakeVrServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Symbols normally provided by alvr_server.cpp and the Rust side
+
+const char* g_sessionPath;
+uint64_t g_DriverTestMode = 0;
+
+namespace {
+std::atomic<uint64_t> g_sentBytes { 0 };
+std::atomic<uint64_t> g_logMessages { 0 };
+// Results of the lookups, so that they aren't optimized out
+volatile uint64_t g_sink = 0;
+
+void countLog(const char*) { g_logMessages.fetch_add(1, std::memory_order_relaxed); }
+void countPeriodicLog(const char*, const char*) { }
+
+// Only called by the consistency check of init_paths
+unsigned long long hashPath(const char* path) { return PathHash(path); }
+
+unsigned long long serialNumber(unsigned long long, char* outString) {
+    const char serial[] = "ALVR bench";
+    if (outString) {
+        memcpy(outString, serial, sizeof(serial));
+    }
+    return sizeof(serial);
+}
+
+void noProps(void*, unsigned long long) { }
+void noConfig(const unsigned char*, int, int) { }
+void countVideo(unsigned long long, unsigned char*, int len, bool) {
+    g_sentBytes.fetch_add(len, std::memory_order_relaxed);
+}
+}
+
+void (*LogError)(const char* stringPtr) = countLog;
+void (*LogWarn)(const char* stringPtr) = countLog;
+void (*LogInfo)(const char* stringPtr) = countLog;
+void (*LogDebug)(const char* stringPtr) = countLog;
+void (*LogEncoder)(const char* stringPtr) = countLog;
+void (*LogPeriodically)(const char* tag, const char* stringPtr) = countPeriodicLog;
+unsigned long long (*PathStringToHash)(const char* path) = hashPath;
+unsigned long long (*GetSerialNumber)(unsigned long long deviceID, char* outString) = serialNumber;
+void (*SetOpenvrProps)(void* instancePtr, unsigned long long deviceID) = noProps;
+void (*RegisterButtons)(void* instancePtr, unsigned long long deviceID) = noProps;
+void (*SetVideoConfigNals)(const unsigned char* configBuffer, int len, int codec) = noConfig;
+void (*VideoSend)(unsigned long long targetTimestampNs, unsigned char* buf, int len, bool isIdr)
+    = countVideo;
+void (*VideoSendSlice)(
+    unsigned long long targetTimestampNs, unsigned char* buf, int len, bool isIdr, bool isLastSlice
+) = nullptr;
+
+namespace {
+struct Options {
+    std::string session;
+    std::string filter;
+    std::string json;
+    double minTime = 0.5;
+    std::vector<std::pair<int, std::string>> streams;
+};
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double nsPerIteration;
+    // Processed per second, 0 if the benchmark doesn't count bytes
+    double bytesPerSecond;
+};
+
+// Runs `body` for a number of iterations and returns the bytes it processed
+typedef std::function<uint64_t(uint64_t iterations)> Body;
+
+class Runner {
+public:
+    explicit Runner(const Options& options)
+        : m_options(options) { }
+
+    void Run(const std::string& name, const Body& body) {
+        if (!m_options.filter.empty() && name.find(m_options.filter) == std::string::npos) {
+            return;
+        }
+        uint64_t iterations = 1;
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t bytes = body(iterations);
+            double seconds
+                = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (seconds >= m_options.minTime || iterations >= 1'000'000'000) {
+                Result result = {
+                    name, iterations, seconds * 1e9 / iterations, bytes > 0 ? bytes / seconds : 0,
+                };
+                print(result);
+                m_results.push_back(result);
+                return;
+            }
+            // Aim a bit past the minimum time, growing by at most 10x like Google Benchmark
+            double scale = seconds > 0 ? m_options.minTime * 1.4 / seconds : 10;
+            iterations = std::max<uint64_t>(iterations + 1, iterations * std::min(scale, 10.0));
+        }
+    }
+
+    void WriteJson() const {
+        if (m_options.json.empty()) {
+            return;
+        }
+        std::ofstream out(m_options.json);
+        out << "{\"benchmarks\":[";
+        for (size_t i = 0; i < m_results.size(); i++) {
+            const Result& r = m_results[i];
+            char line[256];
+            snprintf(
+                line,
+                sizeof(line),
+                "%s{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_iteration\":%.3f,"
+                "\"bytes_per_second\":%.0f}",
+                i ? "," : "",
+                r.name.c_str(),
+                (unsigned long long)r.iterations,
+                r.nsPerIteration,
+                r.bytesPerSecond
+            );
+            out << line;
+        }
+        out << "]}\n";
+    }
+
+private:
+    static void print(const Result& result) {
+        printf(
+            "%-40s %12llu %12.1f ns",
+            result.name.c_str(),
+            (unsigned long long)result.iterations,
+            result.nsPerIteration
+        );
+        if (result.bytesPerSecond > 0) {
+            printf(" %10.1f MB/s", result.bytesPerSecond / 1e6);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    const Options& m_options;
+    std::vector<Result> m_results;
+};
+
+const uint64_t FRAME_INTERVAL_NS = 11'111'111;
+
+FfiDeviceMotion motionAt(uint64_t frame) {
+    FfiDeviceMotion motion = {};
+    motion.deviceID = HEAD_ID;
+    // Slow yaw so that the rotations of the history are all different
+    float angle = frame * 0.002f;
+    motion.pose.orientation = { 0, std::sin(angle / 2), 0, std::cos(angle / 2) };
+    motion.pose.position[1] = 1.6f;
+    motion.angularVelocity[1] = 0.002f * 90;
+    return motion;
+}
+
+vr::HmdMatrix34_t rotationMatrix(const FfiQuat& q) {
+    vr::HmdMatrix34_t m = {};
+    m.m[0][0] = 1 - 2 * (q.y * q.y + q.z * q.z);
+    m.m[0][1] = 2 * (q.x * q.y - q.z * q.w);
+    m.m[0][2] = 2 * (q.x * q.z + q.y * q.w);
+    m.m[1][0] = 2 * (q.x * q.y + q.z * q.w);
+    m.m[1][1] = 1 - 2 * (q.x * q.x + q.z * q.z);
+    m.m[1][2] = 2 * (q.y * q.z - q.x * q.w);
+    m.m[2][0] = 2 * (q.x * q.z - q.y * q.w);
+    m.m[2][1] = 2 * (q.y * q.z + q.x * q.w);
+    m.m[2][2] = 1 - 2 * (q.x * q.x + q.y * q.y);
+    return m;
+}
+
+void benchPoseHistory(Runner& runner) {
+    // More than the capacity, so that the history is full and wraps
+    const uint64_t FILLED = 1000;
+    auto history = std::make_shared<PoseHistory>();
+    for (uint64_t i = 1; i <= FILLED; i++) {
+        history->OnPoseUpdated(i * FRAME_INTERVAL_NS, motionAt(i));
+    }
+
+    uint64_t next = FILLED + 1;
+    runner.Run("PoseHistory/OnPoseUpdated", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++, next++) {
+            history->OnPoseUpdated(next * FRAME_INTERVAL_NS, motionAt(next));
+        }
+        return 0;
+    });
+
+    // Frames the compositor looks up are a few frames old
+    std::mt19937 random(1);
+    std::vector<uint64_t> lookups(1024);
+    std::vector<vr::HmdMatrix34_t> rotations(lookups.size());
+    for (size_t i = 0; i < lookups.size(); i++) {
+        lookups[i] = next - 1 - random() % 100;
+        rotations[i] = rotationMatrix(motionAt(lookups[i]).pose.orientation);
+    }
+
+    runner.Run("PoseHistory/GetPoseAt", [&](uint64_t iterations) {
+        uint64_t found = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            found += history->GetPoseAt(lookups[i % lookups.size()] * FRAME_INTERVAL_NS)
+                         .has_value();
+        }
+        g_sink = g_sink + found;
+        return 0;
+    });
+
+    runner.Run("PoseHistory/GetBestPoseMatch", [&](uint64_t iterations) {
+        uint64_t found = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            found += history->GetBestPoseMatch(rotations[i % rotations.size()]).has_value();
+        }
+        g_sink = g_sink + found;
+        return 0;
+    });
+}
+
+struct Stream {
+    int codec;
+    std::string name;
+    std::vector<std::vector<unsigned char>> frames;
+    std::vector<bool> keyframes;
+};
+
+std::vector<unsigned char> readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw MakeException("Failed to open %s", path.c_str());
+    }
+    return std::vector<unsigned char>(
+        std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()
+    );
+}
+
+// Splits a stream into access units at its AUDs (h264, hevc) or temporal delimiters (av1)
+Stream loadStream(int codec, const std::string& path) {
+    std::vector<unsigned char> data = readFile(path);
+    std::vector<NalUnit> nals;
+    if (!BuildNalIndex(codec, data.data(), data.size(), nals) || nals.empty()) {
+        throw MakeException("%s is not a valid stream", path.c_str());
+    }
+    uint8_t delimiter = codec == ALVR_CODEC_H264 ? H264_NAL_TYPE_AUD
+        : codec == ALVR_CODEC_HEVC               ? HEVC_NAL_TYPE_AUD
+                                                 : AV1_OBU_TEMPORAL_DELIMITER;
+    Stream stream = { codec, path, {}, {} };
+    uint32_t start = nals[0].offset;
+    bool keyframe = IsKeyframeNal(codec, nals[0]);
+    for (size_t i = 1; i <= nals.size(); i++) {
+        if (i == nals.size() || nals[i].type == delimiter) {
+            uint32_t end = i == nals.size() ? data.size() : nals[i].offset;
+            stream.frames.emplace_back(data.begin() + start, data.begin() + end);
+            stream.keyframes.push_back(keyframe);
+            start = end;
+            keyframe = false;
+        }
+        if (i < nals.size() && IsKeyframeNal(codec, nals[i])) {
+            keyframe = true;
+        }
+    }
+    return stream;
+}
+
+// Payload bytes without zeros, so that they never form a start code
+void appendPayload(std::vector<unsigned char>& out, size_t size, std::mt19937& random) {
+    for (size_t i = 0; i < size; i++) {
+        out.push_back(1 + random() % 255);
+    }
+}
+
+void appendNal(
+    std::vector<unsigned char>& out, int codec, uint8_t type, size_t size, std::mt19937& random
+) {
+    const unsigned char startCode[] = { 0, 0, 0, 1 };
+    out.insert(out.end(), startCode, startCode + 4);
+    if (codec == ALVR_CODEC_H264) {
+        out.push_back(0x60 | type);
+    } else {
+        out.push_back(type << 1);
+        out.push_back(1);
+    }
+    appendPayload(out, size, random);
+}
+
+void appendObu(std::vector<unsigned char>& out, uint8_t type, size_t size, std::mt19937& random) {
+    // obu_has_size_field, with a leb128 size
+    out.push_back((type << 3) | 0x02);
+    size_t value = size;
+    do {
+        unsigned char byte = value & 0x7f;
+        value >>= 7;
+        out.push_back(byte | (value ? 0x80 : 0));
+    } while (value);
+    appendPayload(out, size, random);
+}
+
+// 90 frames of 30 Mbps with an IDR a second, the sizes of a typical stream
+Stream syntheticStream(int codec, const char* name) {
+    std::mt19937 random(codec + 1);
+    Stream stream = { codec, std::string("synthetic ") + name, {}, {} };
+    for (int frame = 0; frame < 90; frame++) {
+        bool idr = frame == 0;
+        size_t size = idr ? 200'000 : 30'000'000 / 8 / 90;
+        std::vector<unsigned char> out;
+        if (codec == ALVR_CODEC_AV1) {
+            appendObu(out, AV1_OBU_TEMPORAL_DELIMITER, 0, random);
+            if (idr) {
+                appendObu(out, AV1_OBU_SEQUENCE_HEADER, 12, random);
+            }
+            appendObu(out, AV1_OBU_FRAME, size, random);
+        } else if (codec == ALVR_CODEC_H264) {
+            appendNal(out, codec, H264_NAL_TYPE_AUD, 1, random);
+            if (idr) {
+                appendNal(out, codec, H264_NAL_TYPE_SPS, 16, random);
+                appendNal(out, codec, H264_NAL_TYPE_PPS, 4, random);
+            }
+            appendNal(out, codec, idr ? H264_NAL_TYPE_IDR : 1, size, random);
+        } else {
+            appendNal(out, codec, HEVC_NAL_TYPE_AUD, 1, random);
+            if (idr) {
+                appendNal(out, codec, HEVC_NAL_TYPE_VPS, 20, random);
+                appendNal(out, codec, HEVC_NAL_TYPE_SPS, 40, random);
+                appendNal(out, codec, HEVC_NAL_TYPE_PPS, 6, random);
+            }
+            appendNal(out, codec, idr ? HEVC_NAL_TYPE_IDR_W_RADL : 1, size, random);
+        }
+        stream.frames.push_back(std::move(out));
+        stream.keyframes.push_back(idr);
+    }
+    return stream;
+}
+
+void benchNalParsing(Runner& runner, const Options& options) {
+    std::vector<Stream> streams;
+    for (auto& [codec, path] : options.streams) {
+        streams.push_back(loadStream(codec, path));
+    }
+    if (streams.empty()) {
+        streams.push_back(syntheticStream(ALVR_CODEC_H264, "h264"));
+        streams.push_back(syntheticStream(ALVR_CODEC_HEVC, "hevc"));
+        streams.push_back(syntheticStream(ALVR_CODEC_AV1, "av1"));
+    }
+
+    const char* codecNames[] = { "h264", "hevc", "av1" };
+    for (const Stream& stream : streams) {
+        size_t largest = 0;
+        for (auto& frame : stream.frames) {
+            largest = std::max(largest, frame.size());
+        }
+        std::vector<unsigned char> scratch(largest);
+        std::string name = std::string("ParseFrameNals/") + codecNames[stream.codec];
+        Info("%s: %zu frames of %s\n", name.c_str(), stream.frames.size(), stream.name.c_str());
+        runner.Run(name, [&](uint64_t iterations) {
+            uint64_t bytes = 0;
+            for (uint64_t i = 0; i < iterations; i++) {
+                size_t index = i % stream.frames.size();
+                const std::vector<unsigned char>& frame = stream.frames[index];
+                memcpy(scratch.data(), frame.data(), frame.size());
+                ParseFrameNals(
+                    stream.codec,
+                    scratch.data(),
+                    frame.size(),
+                    (i + 1) * FRAME_INTERVAL_NS,
+                    stream.keyframes[index]
+                );
+                bytes += frame.size();
+            }
+            return bytes;
+        });
+    }
+}
+
+FfiHandSkeleton makeSkeleton(uint64_t frame) {
+    FfiHandSkeleton skeleton = {};
+    for (int j = 0; j < 31; j++) {
+        float angle = (frame + j) * 0.01f;
+        skeleton.jointRotations[j] = { std::sin(angle / 2), 0, 0, std::cos(angle / 2) };
+        skeleton.jointPositions[j][0] = 0.01f * j;
+        skeleton.jointPositions[j][1] = 1.2f;
+        skeleton.jointPositions[j][2] = -0.3f;
+    }
+    return skeleton;
+}
+
+void benchControllers(Runner& runner) {
+    static FakeDriverContext context;
+    vr::InitServerDriverContext(&context);
+
+    Controller handTracker(HAND_TRACKER_LEFT_ID, vr::VRSkeletalTracking_Full);
+    Controller controller(HAND_LEFT_ID, vr::VRSkeletalTracking_Partial);
+    Controller rightController(HAND_RIGHT_ID, vr::VRSkeletalTracking_Partial);
+    if (!handTracker.register_device(true) || !controller.register_device(true)
+        || !rightController.register_device(true)) {
+        throw MakeException("Failed to activate the controllers");
+    }
+
+    std::vector<FfiHandSkeleton> skeletons(64);
+    for (size_t i = 0; i < skeletons.size(); i++) {
+        skeletons[i] = makeSkeleton(i);
+    }
+    runner.Run("Controller/HandTrackerSkeleton", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            FfiHandData hand = { nullptr, &skeletons[i % skeletons.size()], true, true };
+            handTracker.OnPoseUpdate((i + 1) * FRAME_INTERVAL_NS, 0.03f, hand);
+        }
+        return 0;
+    });
+
+    // The trigger and grip move every frame, so that the hand pose is blended again each time
+    runner.Run("Controller/AnimatedHandPose", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            FfiButtonValue value = {};
+            value.type = BUTTON_TYPE_SCALAR;
+            value.scalar = (i % 100) / 100.f;
+            controller.SetButton(LEFT_TRIGGER_VALUE_ID, value);
+            controller.SetButton(LEFT_SQUEEZE_VALUE_ID, value);
+            FfiDeviceMotion motion = motionAt(i);
+            motion.deviceID = HAND_LEFT_ID;
+            FfiHandData hand = { &motion, nullptr, false, false };
+            controller.OnPoseUpdate((i + 1) * FRAME_INTERVAL_NS, 0.03f, hand);
+        }
+        return 0;
+    });
+
+    auto history = std::make_shared<PoseHistory>();
+    runner.Run("SetTracking/Devices", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            uint64_t targetTimestampNs = (i + 1) * FRAME_INTERVAL_NS;
+            history->OnPoseUpdated(targetTimestampNs, motionAt(i));
+            FfiDeviceMotion left = motionAt(i);
+            left.deviceID = HAND_LEFT_ID;
+            FfiDeviceMotion right = motionAt(i);
+            right.deviceID = HAND_RIGHT_ID;
+            FfiHandData leftHand = { &left, nullptr, false, false };
+            FfiHandData rightHand = { &right, nullptr, false, false };
+            controller.OnPoseUpdate(targetTimestampNs, 0.03f, leftHand);
+            rightController.OnPoseUpdate(targetTimestampNs, 0.03f, rightHand);
+        }
+        return 0;
+    });
+}
+
+void benchLogger(Runner& runner) {
+    runner.Run("Logger/InfoSync", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            Info("Frame %llu encoded in %.2f ms\n", (unsigned long long)i, 3.5);
+        }
+        return 0;
+    });
+
+    StartLogWorker();
+    runner.Run("Logger/InfoQueued", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            Info("Frame %llu encoded in %.2f ms\n", (unsigned long long)i, 3.5);
+        }
+        return 0;
+    });
+    runner.Run("Logger/Error", [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            Error("Frame %llu failed\n", (unsigned long long)i);
+        }
+        return 0;
+    });
+    StopLogWorker();
+}
+
+void usage() {
+    fprintf(
+        stderr,
+        "Usage: hotpath_bench [--session <session.json>] [--filter <substring>] "
+        "[--min-time <seconds>] [--stream <h264|hevc|av1>:<file>]... [--json <file>]\n"
+    );
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw MakeException("Missing value for %s", arg.c_str());
+        }
+        std::string value = argv[++i];
+        if (arg == "--session") {
+            options.session = value;
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--json") {
+            options.json = value;
+        } else if (arg == "--min-time") {
+            options.minTime = std::max(std::stod(value), 0.01);
+        } else if (arg == "--stream") {
+            size_t colon = value.find(':');
+            std::string codec = value.substr(0, colon);
+            if (colon == std::string::npos
+                || (codec != "h264" && codec != "hevc" && codec != "av1")) {
+                throw MakeException("Invalid stream %s", value.c_str());
+            }
+            int id = codec == "h264" ? ALVR_CODEC_H264
+                : codec == "hevc"    ? ALVR_CODEC_HEVC
+                                     : ALVR_CODEC_AV1;
+            options.streams.push_back({ id, value.substr(colon + 1) });
+        } else {
+            throw MakeException("Unknown option %s", arg.c_str());
+        }
+    }
+    return options;
+}
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        usage();
+        return 1;
+    }
+
+    try {
+        if (!options.session.empty()) {
+            g_sessionPath = options.session.c_str();
+            Settings::Instance().Load();
+            if (!Settings::Instance().IsLoaded()) {
+                throw MakeException("Failed to load %s", options.session.c_str());
+            }
+        }
+        init_paths();
+
+        printf("%-40s %12s %15s\n", "benchmark", "iterations", "time");
+        Runner runner(options);
+        benchPoseHistory(runner);
+        benchNalParsing(runner, options);
+        benchControllers(runner);
+        benchLogger(runner);
+        runner.WriteJson();
+    } catch (std::exception& e) {
+        fprintf(stderr, "hotpath_bench: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
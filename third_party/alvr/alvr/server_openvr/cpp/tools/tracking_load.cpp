@@ -0,0 +1,549 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+/*
+Load generator for the tracking and input entry points of bindings.h, to check that the driver
+keeps up with full body tracking setups. Each kind of call comes from a thread of its own at a
+fixed rate, like the tracking, input and battery packets of a client, through the real SetTracking,
+SetButton, SetButtons and SetBattery of alvr_server.cpp. A fake vrserver (tools/FakeVrServer.h)
+activates the devices and counts what they submit, and a frame thread calls RunFrame like the main
+loop of vrserver. build.rs skips the tools directory, build it from cpp/ with every driver source of
+the platform, like build.rs does:
+
+    g++ -std=c++17 -O2 -I. -Ialvr_server -I<openvr>/headers -I<ffmpeg>/include \
+        $(pkg-config --cflags libdrm) tools/tracking_load.cpp \
+        $(find alvr_server platform/linux shared ALVR-common -name '*.cpp' -not -path '*amf*') \
+        -L<ffmpeg>/lib -L<openvr>/lib/linux64 \
+        $(pkg-config --static --libs libavfilter libavcodec libavutil libdrm) -lx264 -lvulkan \
+        -lopenvr_api -lpthread -o tracking_load
+
+    ./tracking_load --session <session.json> [--duration 10] [--tracking-rate 90]
+        [--input-rate 500] [--buttons 1] [--battery-rate 1] [--frame-rate 90] [--trackers 8]
+        [--hands controllers|skeletons]
+
+The devices are those the session enables: controllers_enabled, use_separate_hand_trackers for
+the hand trackers and body_tracking_vive_enabled with body_tracking_has_legs for the body
+trackers. The streaming starts like for a client, the encoder then waits for the compositor
+layer, which never connects.
+
+- SetTracking at --tracking-rate with the head, both hands and --trackers body motions, the body
+  trackers first and then motions of unknown devices for the trackers the driver has no device
+  for. --hands skeletons sends the hand tracking skeletons for the hand trackers.
+- SetButton at --input-rate, or SetButtons with --buttons changes per call, cycling through every
+  button of both controllers, the binary ones toggling and the scalar ones sweeping.
+- SetBattery at --battery-rate for the head, both hands and every body tracker.
+- RunFrame at --frame-rate.
+
+For each call it reports the time per call percentiles and the calls that started after their next
+one was already due. Then the devices the driver registered and the rate of what they submitted to
+vrserver, and the CPU time of each thread of the process over the run, from /proc.
+*/
+
+#include "alvr_server/Logger.h"
+#include "alvr_server/Paths.h"
+#include "alvr_server/Settings.h"
+#include "alvr_server/bindings.h"
+#include "alvr_server/openvr_driver_wrap.h"
+#include "tools/FakeVrServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Set by the Rust side
+uint64_t g_DriverTestMode = 0;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+std::atomic<uint64_t> g_logMessages { 0 };
+
+void countLog(const char*) { g_logMessages.fetch_add(1, std::memory_order_relaxed); }
+void printLog(const char* message) { fprintf(stderr, "driver: %s\n", message); }
+void countPeriodicLog(const char*, const char*) { }
+
+unsigned long long hashPath(const char* path) { return PathHash(path); }
+
+unsigned long long serialNumber(unsigned long long deviceID, char* outString) {
+    char serial[32];
+    int length = snprintf(serial, sizeof(serial), "ALVR load %016llx", deviceID);
+    if (outString) {
+        memcpy(outString, serial, length + 1);
+    }
+    return length + 1;
+}
+
+void noProps(void*, unsigned long long) { }
+
+// Like the Rust side, every button of the profile of the controller
+void registerButtons(void* instancePtr, unsigned long long deviceID) {
+    bool left = deviceID == HAND_LEFT_ID || deviceID == HAND_TRACKER_LEFT_ID;
+    auto& mapping = left ? LEFT_CONTROLLER_BUTTON_MAPPING : RIGHT_CONTROLLER_BUTTON_MAPPING;
+    for (auto& [id, info] : mapping) {
+        RegisterButton(instancePtr, id);
+    }
+}
+
+void driverReady(bool) { }
+void noHaptics(unsigned long long, float, float, float) { }
+void noShutdown() { }
+FfiDynamicEncoderParams noEncoderParams() { return {}; }
+void noVSync() { }
+
+struct Options {
+    std::string session;
+    double duration = 10;
+    double trackingRate = 90;
+    double inputRate = 500;
+    int buttons = 1;
+    double batteryRate = 1;
+    double frameRate = 90;
+    int trackers = 8;
+    bool skeletons = false;
+};
+
+// Time of each call of one entry point, in nanoseconds. Only touched by its load thread until
+// the thread is joined.
+struct CallStats {
+    explicit CallStats(std::string name)
+        : name(std::move(name)) { }
+
+    std::string name;
+    std::vector<uint64_t> ns;
+    // Ticks that started after the next tick was already due
+    uint64_t late = 0;
+
+    template <typename F> void time(const F& call) {
+        auto start = Clock::now();
+        call();
+        ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start)
+                         .count());
+    }
+};
+
+// Calls tick at rateHz until stop is set. A late tick doesn't make up for the missed ones, the
+// schedule restarts from it, like a client that sends its latest state.
+void runAt(
+    const char* threadName,
+    double rateHz,
+    const std::atomic<bool>& stop,
+    CallStats& stats,
+    const std::function<void(uint64_t)>& tick
+) {
+    pthread_setname_np(pthread_self(), threadName);
+    auto period = std::chrono::nanoseconds((int64_t)(1e9 / rateHz));
+    auto next = Clock::now();
+    for (uint64_t i = 0; !stop.load(std::memory_order_relaxed); i++) {
+        std::this_thread::sleep_until(next);
+        tick(i);
+        next += period;
+        auto now = Clock::now();
+        if (now > next) {
+            stats.late++;
+            next = now;
+        }
+    }
+}
+
+uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch())
+        .count();
+}
+
+// Circles of 5 cm around the rest position, with a slow yaw
+FfiDeviceMotion motionAt(uint64_t id, double t, float x, float y, float z) {
+    float angle = t * 2;
+    FfiDeviceMotion motion = {};
+    motion.deviceID = id;
+    motion.pose.orientation = { 0, std::sin(angle / 4), 0, std::cos(angle / 4) };
+    motion.pose.position[0] = x + 0.05f * std::cos(angle);
+    motion.pose.position[1] = y + 0.05f * std::sin(angle);
+    motion.pose.position[2] = z;
+    motion.linearVelocity[0] = -0.1f * std::sin(angle);
+    motion.linearVelocity[1] = 0.1f * std::cos(angle);
+    motion.angularVelocity[1] = 0.5f;
+    return motion;
+}
+
+FfiHandSkeleton skeletonAt(double t, float x) {
+    FfiHandSkeleton skeleton = {};
+    for (int j = 0; j < 31; j++) {
+        float angle = (t + j * 0.1) * 2;
+        skeleton.jointRotations[j] = { std::sin(angle / 2), 0, 0, std::cos(angle / 2) };
+        skeleton.jointPositions[j][0] = x + 0.01f * j;
+        skeleton.jointPositions[j][1] = 1.2f;
+        skeleton.jointPositions[j][2] = -0.3f;
+    }
+    return skeleton;
+}
+
+// The body trackers of the driver first, the others have no device and are ignored by it
+std::vector<uint64_t> trackerIds(int count) {
+    const uint64_t bodyIds[] = {
+        BODY_CHEST_ID,     BODY_HIPS_ID,      BODY_LEFT_ELBOW_ID, BODY_RIGHT_ELBOW_ID,
+        BODY_LEFT_KNEE_ID, BODY_LEFT_FOOT_ID, BODY_RIGHT_KNEE_ID, BODY_RIGHT_FOOT_ID,
+    };
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < count; i++) {
+        if (i < (int)std::size(bodyIds)) {
+            ids.push_back(bodyIds[i]);
+        } else {
+            std::string path = "/user/body/extra_" + std::to_string(i);
+            ids.push_back(PathHash(path.c_str()));
+        }
+    }
+    return ids;
+}
+
+struct ThreadCpu {
+    std::string name;
+    uint64_t ticks;
+};
+
+// User and system CPU time of every thread of the process, in clock ticks, by thread id
+std::map<int, ThreadCpu> threadCpu() {
+    std::map<int, ThreadCpu> threads;
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        return threads;
+    }
+    while (dirent* entry = readdir(dir)) {
+        int tid = atoi(entry->d_name);
+        if (tid <= 0) {
+            continue;
+        }
+        std::string base = std::string("/proc/self/task/") + entry->d_name;
+        std::ifstream statFile(base + "/stat");
+        std::string stat((std::istreambuf_iterator<char>(statFile)), {});
+        // The name in the stat line can contain spaces, the fields are counted from its end.
+        // utime and stime are the 12th and 13th after it.
+        size_t end = stat.rfind(')');
+        if (end == std::string::npos) {
+            continue;
+        }
+        unsigned long long utime = 0, stime = 0;
+        if (sscanf(
+                stat.c_str() + end + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                &utime, &stime
+            )
+            != 2) {
+            continue;
+        }
+        std::ifstream commFile(base + "/comm");
+        std::string name;
+        std::getline(commFile, name);
+        threads[tid] = { name, utime + stime };
+    }
+    closedir(dir);
+    return threads;
+}
+
+double processCpuSeconds() {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec
+        + usage.ru_stime.tv_usec / 1e6;
+}
+
+void printCalls(const CallStats& stats) {
+    if (stats.ns.empty()) {
+        return;
+    }
+    std::vector<uint64_t> sorted = stats.ns;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p) {
+        return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))] / 1e3;
+    };
+    printf(
+        "%-20s %10zu %8llu %9.1f %9.1f %9.1f %9.1f\n",
+        stats.name.c_str(),
+        sorted.size(),
+        (unsigned long long)stats.late,
+        percentile(0.5),
+        percentile(0.99),
+        percentile(0.999),
+        sorted.back() / 1e3
+    );
+}
+
+void usage() {
+    fprintf(
+        stderr,
+        "Usage: tracking_load --session <session.json> [--duration <seconds>] "
+        "[--tracking-rate <hz>] [--input-rate <hz>] [--buttons <count>] [--battery-rate <hz>] "
+        "[--frame-rate <hz>] [--trackers <count>] [--hands controllers|skeletons]\n"
+    );
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw MakeException("Missing value for %s", arg.c_str());
+        }
+        std::string value = argv[++i];
+        if (arg == "--session") {
+            options.session = value;
+        } else if (arg == "--duration") {
+            options.duration = std::max(std::stod(value), 1.0);
+        } else if (arg == "--tracking-rate") {
+            options.trackingRate = std::max(std::stod(value), 1.0);
+        } else if (arg == "--input-rate") {
+            options.inputRate = std::max(std::stod(value), 1.0);
+        } else if (arg == "--buttons") {
+            options.buttons = std::max(std::stoi(value), 1);
+        } else if (arg == "--battery-rate") {
+            options.batteryRate = std::max(std::stod(value), 0.1);
+        } else if (arg == "--frame-rate") {
+            options.frameRate = std::max(std::stod(value), 1.0);
+        } else if (arg == "--trackers") {
+            options.trackers = std::max(std::stoi(value), 0);
+        } else if (arg == "--hands") {
+            if (value != "controllers" && value != "skeletons") {
+                throw MakeException("Invalid hands %s", value.c_str());
+            }
+            options.skeletons = value == "skeletons";
+        } else {
+            throw MakeException("Unknown option %s", arg.c_str());
+        }
+    }
+    if (options.session.empty()) {
+        throw MakeException("Missing --session");
+    }
+    return options;
+}
+
+void run(const Options& options) {
+    static FakeDriverContext context;
+
+    g_sessionPath = options.session.c_str();
+    g_driverRootDir = ".";
+    CppInit(false);
+    if (!Settings::Instance().IsLoaded()) {
+        throw MakeException("Failed to load %s", options.session.c_str());
+    }
+
+    int returnCode = 0;
+    auto provider = (vr::IServerTrackedDeviceProvider*)CppOpenvrEntryPoint(
+        vr::IServerTrackedDeviceProvider_Version, &returnCode
+    );
+    if (!provider || provider->Init(&context) != vr::VRInitError_None) {
+        throw MakeException("Failed to initialize the driver");
+    }
+    if (!InitializeStreaming()) {
+        throw MakeException("Failed to start streaming");
+    }
+
+    std::vector<uint64_t> trackers = trackerIds(options.trackers);
+    std::vector<uint64_t> batteryDevices = { HEAD_ID, HAND_LEFT_ID, HAND_RIGHT_ID };
+    batteryDevices.insert(batteryDevices.end(), trackers.begin(), trackers.end());
+
+    std::vector<FfiButtonEntry> buttons;
+    for (auto* mapping : { &LEFT_CONTROLLER_BUTTON_MAPPING, &RIGHT_CONTROLLER_BUTTON_MAPPING }) {
+        for (auto& [id, info] : *mapping) {
+            FfiButtonEntry entry = {};
+            entry.id = id;
+            entry.value.type
+                = info.type == ButtonType::Binary ? BUTTON_TYPE_BINARY : BUTTON_TYPE_SCALAR;
+            buttons.push_back(entry);
+        }
+    }
+
+    CallStats tracking("SetTracking");
+    CallStats input(
+        options.buttons == 1 ? "SetButton" : "SetButtons x" + std::to_string(options.buttons)
+    );
+    CallStats battery("SetBattery");
+    CallStats frame("RunFrame");
+    size_t expected = options.duration * 1.1;
+    tracking.ns.reserve(expected * options.trackingRate);
+    input.ns.reserve(expected * options.inputRate);
+    battery.ns.reserve(expected * options.batteryRate * batteryDevices.size());
+    frame.ns.reserve(expected * options.frameRate);
+
+    uint64_t posesBefore = context.host.poseUpdates;
+    uint64_t invalidPosesBefore = context.host.invalidPoseUpdates;
+    uint64_t componentsBefore = context.input.componentUpdates;
+    uint64_t skeletonsBefore = context.input.skeletonUpdates;
+    uint64_t propertiesBefore = context.properties.propertyWrites;
+    std::map<int, ThreadCpu> cpuBefore = threadCpu();
+    double processBefore = processCpuSeconds();
+    auto start = Clock::now();
+
+    std::atomic<bool> stop { false };
+    std::vector<std::thread> threads;
+    threads.emplace_back([&] {
+        std::vector<FfiDeviceMotion> motions(trackers.size());
+        runAt("load tracking", options.trackingRate, stop, tracking, [&](uint64_t) {
+            double t = std::chrono::duration<double>(Clock::now() - start).count();
+            FfiDeviceMotion head = motionAt(HEAD_ID, t, 0, 1.6f, 0);
+            FfiDeviceMotion left = motionAt(HAND_LEFT_ID, t, -0.2f, 1.2f, -0.3f);
+            FfiDeviceMotion right = motionAt(HAND_RIGHT_ID, t + 1, 0.2f, 1.2f, -0.3f);
+            FfiHandSkeleton leftSkeleton, rightSkeleton;
+            FfiHandData leftHand = { &left, nullptr, false, false };
+            FfiHandData rightHand = { &right, nullptr, false, false };
+            if (options.skeletons) {
+                leftSkeleton = skeletonAt(t, -0.2f);
+                rightSkeleton = skeletonAt(t + 1, 0.2f);
+                leftHand = { &left, &leftSkeleton, true, true };
+                rightHand = { &right, &rightSkeleton, true, true };
+            }
+            for (size_t i = 0; i < trackers.size(); i++) {
+                motions[i] = motionAt(trackers[i], t + i, 0.1f * (i % 5) - 0.2f, 0.2f * (i / 5), 0);
+            }
+            // Predicted for a display a few frames ahead, like the client does
+            uint64_t targetTimestampNs = nowNs() + 40'000'000;
+            tracking.time([&] {
+                SetTracking(
+                    targetTimestampNs,
+                    0.03f,
+                    head,
+                    leftHand,
+                    rightHand,
+                    motions.data(),
+                    (int)motions.size()
+                );
+            });
+        });
+    });
+    threads.emplace_back([&] {
+        std::vector<FfiButtonEntry> batch(options.buttons);
+        size_t next = 0;
+        runAt("load input", options.inputRate, stop, input, [&](uint64_t tick) {
+            for (FfiButtonEntry& entry : batch) {
+                entry = buttons[next++ % buttons.size()];
+                if (entry.value.type == BUTTON_TYPE_BINARY) {
+                    entry.value.binary = (next / buttons.size() + tick) % 2;
+                } else {
+                    entry.value.scalar = (tick % 100) / 100.f;
+                }
+            }
+            if (batch.size() == 1) {
+                input.time([&] { SetButton(batch[0].id, batch[0].value); });
+            } else {
+                input.time([&] { SetButtons(batch.data(), (int)batch.size()); });
+            }
+        });
+    });
+    threads.emplace_back([&] {
+        runAt("load battery", options.batteryRate, stop, battery, [&](uint64_t tick) {
+            float gauge = 1 - (tick % 100) / 100.f;
+            for (uint64_t id : batteryDevices) {
+                battery.time([&] { SetBattery(id, gauge, tick % 2); });
+            }
+        });
+    });
+    threads.emplace_back([&] {
+        runAt("vrserver frame", options.frameRate, stop, frame, [&](uint64_t) {
+            frame.time([&] { provider->RunFrame(); });
+        });
+    });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.duration));
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double processSeconds = processCpuSeconds() - processBefore;
+    std::map<int, ThreadCpu> cpuAfter = threadCpu();
+
+    printf(
+        "%-20s %10s %8s %9s %9s %9s %9s\n", "call", "calls", "late", "p50 us", "p99 us",
+        "p99.9 us", "max us"
+    );
+    for (const CallStats* stats : { &tracking, &input, &battery, &frame }) {
+        printCalls(*stats);
+    }
+
+    printf(
+        "\n%llu devices registered, each tracking tick sends the head, both %s and %zu body "
+        "motions\n",
+        (unsigned long long)context.host.devicesAdded.load(),
+        options.skeletons ? "hand skeletons" : "controllers",
+        trackers.size()
+    );
+    auto rate = [&](uint64_t after, uint64_t before) { return (after - before) / seconds; };
+    printf("%-20s %10.0f /s\n", "poses", rate(context.host.poseUpdates, posesBefore));
+    printf(
+        "%-20s %10.0f /s\n",
+        "untracked poses",
+        rate(context.host.invalidPoseUpdates, invalidPosesBefore)
+    );
+    printf("%-20s %10.0f /s\n", "skeletons", rate(context.input.skeletonUpdates, skeletonsBefore));
+    printf(
+        "%-20s %10.0f /s\n",
+        "input components",
+        rate(context.input.componentUpdates, componentsBefore)
+    );
+    printf(
+        "%-20s %10.0f /s\n",
+        "property writes",
+        rate(context.properties.propertyWrites, propertiesBefore)
+    );
+
+    // Threads that ended during the run are only in the process total
+    double tick = sysconf(_SC_CLK_TCK);
+    printf("\n%-20s %8s %8s\n", "thread", "tid", "cpu %");
+    for (auto& [tid, after] : cpuAfter) {
+        auto before = cpuBefore.find(tid);
+        uint64_t ticks = after.ticks - (before != cpuBefore.end() ? before->second.ticks : 0);
+        printf("%-20s %8d %8.2f\n", after.name.c_str(), tid, ticks / tick / seconds * 100);
+    }
+    printf("%-20s %8s %8.2f\n", "process", "", processSeconds / seconds * 100);
+
+    DeinitializeStreaming();
+    provider->Cleanup();
+}
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        usage();
+        return 1;
+    }
+
+    LogError = printLog;
+    LogWarn = printLog;
+    LogInfo = countLog;
+    LogDebug = countLog;
+    LogEncoder = countLog;
+    LogPeriodically = countPeriodicLog;
+    DriverReadyIdle = driverReady;
+    PathStringToHash = hashPath;
+    GetSerialNumber = serialNumber;
+    SetOpenvrProps = noProps;
+    RegisterButtons = registerButtons;
+    HapticsSend = noHaptics;
+    ShutdownRuntime = noShutdown;
+    GetDynamicEncoderParams = noEncoderParams;
+    WaitForVSync = noVSync;
+
+    try {
+        run(options);
+    } catch (std::exception& e) {
+        fprintf(stderr, "tracking_load: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,853 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+/*
+Standalone benchmark for the Windows VideoEncoder backends (AMF, NVENC, VPL, SW), without SteamVR
+or a headset. build.rs skips the tools directory, build it next to the driver sources from cpp/ in
+a developer command prompt:
+
+    cl /std:c++17 /O2 /EHsc /I. /Ialvr_server /Iplatform/win32 /Ishared/amf/public/include \
+        /I<openvr>/headers /I<vpl>/include tools/win32_encoder_bench.cpp \
+        platform/win32/{FrameRender,FFR,GpuPassTimer,VideoEncoderAMF,VideoEncoderNVENC,\
+VideoEncoderVPL,VideoEncoderSW,NvEncoder,NvEncoderD3D11,VideoScaler}.cpp \
+        platform/win32/shared/d3drender.cpp platform/win32/d3d-render-utils/*.cpp \
+        shared/amf/public/common/*.cpp alvr_server/{Settings,NalParsing,NalIndex,VideoBufferLease,\
+FrameTrace,FrameBudget,EncoderRoi,BitrateCalibration,ResolutionLadder,TemporalLayers,\
+DisposableFrames,LtrManager,GpuPassStats,TraceEvents,PhotonMarker,RenderTargetScale,\
+Instance,DriverMetrics,VramBudget,CpuFeatures}.cpp \
+        ALVR-common/exception.cpp /link <vpl>/lib/vpl.lib d3d11.lib dxgi.lib d3dcompiler.lib \
+        /out:win32_encoder_bench.exe
+
+    win32_encoder_bench --session <session.json> [--backend amf,nvenc,vpl,sw]
+        [--codec h264,hevc,av1] [--bitrate 30,100] [--fps 90] [--frames 600]
+        [--input frames.rgba] [--shaders platform/win32] [--json <file>]
+
+Add /DALVR_GPL and the FFmpeg sources and libraries to bench the SW backend. The encoder and
+render settings come from the openvr_config section of the session file, the compositor shaders
+from the .cso files in --shaders. The permutations that build.rs writes to its OUT_DIR are used
+when they were copied there too.
+
+A fake compositor fills a ring of game layer textures at the eye resolution of the session, with a
+moving synthetic pattern or with raw RGBA8 frames read from --input, uploaded once before the run.
+Every frame goes through FrameRender::RenderFrame and the copy into an encoder slot like in
+CEncoder, then through Transmit on the same thread. --fps 0 runs unpaced to measure throughput.
+
+For every backend, codec and bitrate it prints the latency percentiles (from the render submit to
+VideoSend), the achieved bitrate against the one returned by GetDynamicEncoderParams, the
+throughput and the mean GPU time of each compositor pass. --json writes the same results with the
+adapter and its driver version, to compare drivers and backends across machines.
+*/
+
+#include "ALVR-common/packet_types.h"
+#include "FrameRender.h"
+#include "GpuPassTimer.h"
+#include "VideoEncoder.h"
+#include "VideoEncoderAMF.h"
+#include "VideoEncoderNVENC.h"
+#include "VideoEncoderVPL.h"
+#ifdef ALVR_GPL
+#include "VideoEncoderSW.h"
+#endif
+#include "alvr_server/Logger.h"
+#include "alvr_server/Settings.h"
+#include "alvr_server/bindings.h"
+#include "shared/d3drender.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Microsoft::WRL::ComPtr;
+
+// Symbols normally provided by alvr_server.cpp and the Rust side
+
+const char* g_sessionPath;
+const char* g_driverRootDir = ".";
+uint64_t g_DriverTestMode = 0;
+
+const unsigned char* FRAME_RENDER_VS_CSO_PTR;
+unsigned int FRAME_RENDER_VS_CSO_LEN;
+const unsigned char* FRAME_RENDER_PS_CSO_PTR;
+unsigned int FRAME_RENDER_PS_CSO_LEN;
+const unsigned char* QUAD_SHADER_CSO_PTR;
+unsigned int QUAD_SHADER_CSO_LEN;
+const unsigned char* COMPRESS_AXIS_ALIGNED_CSO_PTR;
+unsigned int COMPRESS_AXIS_ALIGNED_CSO_LEN;
+const unsigned char* COLOR_CORRECTION_CSO_PTR;
+unsigned int COLOR_CORRECTION_CSO_LEN;
+const unsigned char* COLOR_CORRECTION_UNSHARPENED_CSO_PTR;
+unsigned int COLOR_CORRECTION_UNSHARPENED_CSO_LEN;
+const unsigned char* RGBTOYUV420_CSO_PTR;
+unsigned int RGBTOYUV420_CSO_LEN;
+
+namespace {
+void log(const char* level, const char* format, va_list args) {
+    fprintf(stderr, "[%s] ", level);
+    vfprintf(stderr, format, args);
+    if (format[0] != '\0' && format[strlen(format) - 1] != '\n') {
+        fputc('\n', stderr);
+    }
+}
+}
+
+Exception MakeException(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    Exception e = FormatExceptionV(format, args);
+    va_end(args);
+    return e;
+}
+
+#define DEFINE_LOG(name, level)                                                                    \
+    void name(const char* format, ...) {                                                           \
+        va_list args;                                                                              \
+        va_start(args, format);                                                                    \
+        log(level, format, args);                                                                  \
+        va_end(args);                                                                              \
+    }
+DEFINE_LOG(Error, "error")
+DEFINE_LOG(Warn, "warn")
+DEFINE_LOG(Info, "info")
+#ifdef ALVR_DEBUG_LOG
+DEFINE_LOG(Debug, "debug")
+#endif
+#undef DEFINE_LOG
+
+void LogPeriod(const char*, const char*, ...) { }
+
+namespace {
+enum Backend {
+    BACKEND_AMF,
+    BACKEND_NVENC,
+    BACKEND_VPL,
+    BACKEND_SW,
+    BACKEND_COUNT,
+};
+const char* const BACKEND_NAMES[] = { "amf", "nvenc", "vpl", "sw" };
+
+const char* const GPU_PASS_NAMES[GPU_PASS_COUNT] = {
+    "layers", "color_correction", "foveation", "custom_shader", "yuv_convert", "encoder_copy",
+};
+
+// Frames uploaded before the run and cycled through, the synthetic pattern moves between them
+const uint32_t SYNTHETIC_RING = 8;
+const uint32_t MAX_INPUT_RING = 60;
+
+struct Options {
+    std::string session;
+    std::string shaders = "platform/win32";
+    std::string input;
+    std::string json;
+    std::vector<int> backends;
+    std::vector<int> codecs;
+    std::vector<uint64_t> bitrates = { 30'000'000 };
+    float fps = 0;
+    bool fpsSet = false;
+    uint32_t frames = 600;
+};
+
+struct PassTime {
+    uint64_t count = 0;
+    double meanUs = 0;
+    double maxUs = 0;
+};
+
+struct Result {
+    int backend = 0;
+    int codec = 0;
+    uint64_t bitrate = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<double> latenciesMs;
+    uint32_t frames = 0;
+    uint64_t bytes = 0;
+    uint32_t packets = 0;
+    uint32_t idrs = 0;
+    double wallSeconds = 0;
+    PassTime passes[GPU_PASS_COUNT];
+};
+
+// State shared with the FFI stubs, the encoders may send from their own threads
+struct Capture {
+    std::mutex mutex;
+    std::map<uint64_t, std::chrono::steady_clock::time_point> submits;
+    Result* result = nullptr;
+    FfiDynamicEncoderParams params = {};
+    // Slices of the frame being received, the latency is taken at the last one
+    uint64_t sliceBytes = 0;
+};
+Capture g_capture;
+
+void onFrame(uint64_t targetTimestampNs, uint64_t bytes, bool isIdr) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(g_capture.mutex);
+    Result* result = g_capture.result;
+    if (!result) {
+        return;
+    }
+    result->bytes += bytes;
+    result->packets++;
+    result->idrs += isIdr ? 1 : 0;
+    auto submit = g_capture.submits.find(targetTimestampNs);
+    if (submit != g_capture.submits.end()) {
+        result->latenciesMs.push_back(
+            std::chrono::duration<double, std::milli>(now - submit->second).count()
+        );
+        g_capture.submits.erase(submit);
+    }
+}
+
+void videoSend(unsigned long long targetTimestampNs, unsigned char*, int len, bool isIdr) {
+    onFrame(targetTimestampNs, len, isIdr);
+}
+
+void videoSendSlice(
+    unsigned long long targetTimestampNs, unsigned char*, int len, bool isIdr, bool isLastSlice
+) {
+    g_capture.sliceBytes += len;
+    if (isLastSlice) {
+        onFrame(targetTimestampNs, g_capture.sliceBytes, isIdr);
+        g_capture.sliceBytes = 0;
+    }
+}
+
+// The bitrate of the run is given once, like the first update of the dynamic encoder params
+FfiDynamicEncoderParams getDynamicEncoderParams() {
+    std::lock_guard<std::mutex> lock(g_capture.mutex);
+    FfiDynamicEncoderParams params = g_capture.params;
+    g_capture.params.updated = 0;
+    return params;
+}
+}
+
+void (*LogError)(const char*) = [](const char* s) { fprintf(stderr, "%s", s); };
+void (*LogWarn)(const char*) = [](const char* s) { fprintf(stderr, "%s", s); };
+void (*LogInfo)(const char*) = [](const char* s) { fprintf(stderr, "%s", s); };
+void (*LogDebug)(const char*) = [](const char*) { };
+void (*LogEncoder)(const char*) = [](const char*) { };
+void (*LogPeriodically)(const char*, const char*) = [](const char*, const char*) { };
+void (*SetVideoConfigNals)(const unsigned char*, int, int) = [](const unsigned char*, int, int) { };
+void (*VideoSend)(unsigned long long, unsigned char*, int, bool) = videoSend;
+// Null so that the leased buffers fall back to VideoSend
+void (*VideoSendLeased)(unsigned long long, unsigned char*, int, bool, unsigned long long)
+    = nullptr;
+void (*VideoSendSlice)(unsigned long long, unsigned char*, int, bool, bool) = videoSendSlice;
+FfiDynamicEncoderParams (*GetDynamicEncoderParams)() = getDynamicEncoderParams;
+
+namespace {
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> parts;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, sep)) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+std::vector<unsigned char> readFile(const std::string& path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) {
+        throw MakeException("Failed to open %s", path.c_str());
+    }
+    return std::vector<unsigned char>(
+        std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()
+    );
+}
+
+// A permutation of build.rs, or the shader that handles every case at runtime
+std::vector<unsigned char> readPermutation(
+    const std::string& dir, const char* name, const char* fallback
+) {
+    std::ifstream is(dir + "/" + name, std::ios::binary);
+    return is ? readFile(dir + "/" + name) : readFile(dir + "/" + fallback);
+}
+
+const char* codecName(int codec) {
+    switch (codec) {
+    case ALVR_CODEC_H264:
+        return "h264";
+    case ALVR_CODEC_HEVC:
+        return "hevc";
+    case ALVR_CODEC_AV1:
+        return "av1";
+    default:
+        return "?";
+    }
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, (size_t)(p * (values.size() - 1) + 0.5));
+    return values[index];
+}
+
+// Stands in for the SteamVR compositor: owns the game layer textures, both eyes sample the same one
+class FakeCompositor {
+public:
+    FakeCompositor(
+        std::shared_ptr<CD3DRender> render,
+        uint32_t width,
+        uint32_t height,
+        const std::string& input
+    )
+        : m_width(width)
+        , m_height(height) {
+        std::vector<uint32_t> pixels((size_t)width * height);
+        if (input.empty()) {
+            for (uint32_t i = 0; i < SYNTHETIC_RING; i++) {
+                fillSynthetic(pixels, i);
+                addTexture(render, pixels);
+            }
+        } else {
+            std::ifstream is(input, std::ios::binary);
+            if (!is) {
+                throw MakeException("Failed to open %s", input.c_str());
+            }
+            size_t frameBytes = pixels.size() * sizeof(uint32_t);
+            while (m_views.size() < MAX_INPUT_RING && is.read((char*)pixels.data(), frameBytes)) {
+                addTexture(render, pixels);
+            }
+            if (m_views.empty()) {
+                throw MakeException(
+                    "%s has no full %ux%u RGBA8 frame", input.c_str(), width, height
+                );
+            }
+        }
+    }
+
+    ID3D11ShaderResourceView* GetView(uint32_t frame) {
+        return m_views[frame % m_views.size()].Get();
+    }
+
+private:
+    // A diagonal gradient with a grid moving by 16 pixels a frame, over static noise so that the
+    // encoder has some detail to code
+    void fillSynthetic(std::vector<uint32_t>& pixels, uint32_t index) {
+        uint32_t shift = index * 16;
+        for (uint32_t y = 0; y < m_height; y++) {
+            for (uint32_t x = 0; x < m_width; x++) {
+                uint32_t noise = (x * 73856093u ^ y * 19349663u) >> 27;
+                uint32_t grid = ((x + shift) % 64 < 4 || (y + shift) % 64 < 4) ? 96 : 0;
+                uint32_t r = std::min(255u, (x * 255 / m_width) / 2 + grid + noise);
+                uint32_t g = std::min(255u, (y * 255 / m_height) / 2 + grid + noise);
+                uint32_t b = std::min(255u, ((x + y + shift) % 256) / 2 + noise);
+                pixels[(size_t)y * m_width + x] = r | (g << 8) | (b << 16) | 0xFF000000;
+            }
+        }
+    }
+
+    void addTexture(std::shared_ptr<CD3DRender> render, const std::vector<uint32_t>& pixels) {
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width = m_width;
+        desc.Height = m_height;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        D3D11_SUBRESOURCE_DATA data = { pixels.data(), m_width * (UINT)sizeof(uint32_t), 0 };
+
+        ComPtr<ID3D11Texture2D> texture;
+        ComPtr<ID3D11ShaderResourceView> view;
+        HRESULT hr = render->GetDevice()->CreateTexture2D(&desc, &data, &texture);
+        if (SUCCEEDED(hr)) {
+            hr = render->GetDevice()->CreateShaderResourceView(texture.Get(), nullptr, &view);
+        }
+        if (FAILED(hr)) {
+            throw MakeException("Failed to create a game layer texture: %p", hr);
+        }
+        m_views.push_back(view);
+    }
+
+    uint32_t m_width;
+    uint32_t m_height;
+    std::vector<ComPtr<ID3D11ShaderResourceView>> m_views;
+};
+
+std::shared_ptr<VideoEncoder>
+createEncoder(int backend, std::shared_ptr<CD3DRender> render, uint32_t width, uint32_t height) {
+    switch (backend) {
+    case BACKEND_AMF:
+        return std::make_shared<VideoEncoderAMF>(render, width, height);
+    case BACKEND_NVENC:
+        return std::make_shared<VideoEncoderNVENC>(render, width, height);
+    case BACKEND_VPL:
+        return std::make_shared<VideoEncoderVPL>(render, width, height);
+#ifdef ALVR_GPL
+    case BACKEND_SW:
+        return std::make_shared<VideoEncoderSW>(render, width, height);
+#endif
+    default:
+        throw MakeException("%s was not built in", BACKEND_NAMES[backend]);
+    }
+}
+
+vr::HmdMatrix34_t identityPose() {
+    vr::HmdMatrix34_t pose = {};
+    for (int i = 0; i < 3; i++) {
+        pose.m[i][i] = 1;
+    }
+    return pose;
+}
+
+Result runOne(
+    std::shared_ptr<CD3DRender> render,
+    FrameRender& frameRender,
+    std::shared_ptr<GpuPassTimer> passTimer,
+    FakeCompositor& compositor,
+    int backend,
+    uint64_t bitrate,
+    float fps,
+    uint32_t frames
+) {
+    Result result;
+    result.backend = backend;
+    result.codec = Settings::Instance().m_codec;
+    result.bitrate = bitrate;
+    frameRender.GetEncodingResolution(&result.width, &result.height);
+
+    ID3D11Texture2D* output = frameRender.GetTexture().Get();
+    D3D11_TEXTURE2D_DESC slotDesc;
+    output->GetDesc(&slotDesc);
+    slotDesc.MiscFlags = 0;
+    ComPtr<ID3D11Texture2D> slot;
+    if (FAILED(render->GetDevice()->CreateTexture2D(&slotDesc, nullptr, &slot))) {
+        throw MakeException("Failed to create the encoder frame slot");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_capture.mutex);
+        g_capture.submits.clear();
+        g_capture.result = &result;
+        g_capture.params.updated = 1;
+        g_capture.params.bitrate_bps = bitrate;
+        g_capture.params.framerate = fps > 0 ? fps : Settings::Instance().m_refreshRate;
+    }
+    auto encoder = createEncoder(backend, render, result.width, result.height);
+    try {
+        encoder->Initialize();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(g_capture.mutex);
+        g_capture.result = nullptr;
+        throw;
+    }
+
+    // Resets the histograms, the passes of the warm up frame of Startup are not counted
+    FfiGpuPassHistogram histograms[GPU_PASS_COUNT];
+    GetGpuPassHistograms(histograms);
+
+    vr::VRTextureBounds_t bounds[1][2] = { { { 0, 0, 1, 1 }, { 0, 0, 1, 1 } } };
+    vr::HmdMatrix34_t poses[1] = { identityPose() };
+    auto frameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(fps > 0 ? 1.0 / fps : 0)
+    );
+    uint64_t intervalNs = (uint64_t)(1e9 / (fps > 0 ? fps : Settings::Instance().m_refreshRate));
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frames; i++) {
+        if (fps > 0) {
+            std::this_thread::sleep_until(start + frameInterval * i);
+        }
+        uint64_t targetTimestampNs = (i + 1) * intervalNs;
+        {
+            std::lock_guard<std::mutex> lock(g_capture.mutex);
+            g_capture.submits[targetTimestampNs] = std::chrono::steady_clock::now();
+        }
+
+        ID3D11ShaderResourceView* view = compositor.GetView(i);
+        ID3D11ShaderResourceView* views[1][2] = { { view, view } };
+        passTimer->BeginFrame();
+        frameRender.RenderFrame(views, bounds, poses, nullptr, 1, false);
+        render->GetContext()->CopyResource(slot.Get(), output);
+        passTimer->Mark(GPU_PASS_ENCODER_COPY);
+        passTimer->EndFrame();
+
+        encoder->Transmit(slot.Get(), targetTimestampNs, targetTimestampNs, i == 0);
+    }
+
+    // The encoders that output from a thread of their own may still have frames in flight
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (std::chrono::steady_clock::now() < deadline) {
+        {
+            std::lock_guard<std::mutex> lock(g_capture.mutex);
+            if (g_capture.submits.empty()) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    result.wallSeconds
+        = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    encoder->Shutdown();
+    {
+        std::lock_guard<std::mutex> lock(g_capture.mutex);
+        g_capture.result = nullptr;
+    }
+    result.frames = frames;
+
+    GetGpuPassHistograms(histograms);
+    for (int pass = 0; pass < GPU_PASS_COUNT; pass++) {
+        const FfiGpuPassHistogram& h = histograms[pass];
+        result.passes[pass].count = h.count;
+        result.passes[pass].meanUs = h.count > 0 ? h.totalNs / 1e3 / h.count : 0;
+        result.passes[pass].maxUs = h.maxNs / 1e3;
+    }
+    return result;
+}
+
+// Description and user mode driver version of the adapter of the device
+void adapterInfo(ID3D11Device* device, std::string& name, std::string& driver) {
+    ComPtr<IDXGIDevice> dxgiDevice;
+    ComPtr<IDXGIAdapter> adapter;
+    DXGI_ADAPTER_DESC desc;
+    if (FAILED(device->QueryInterface(IID_PPV_ARGS(&dxgiDevice)))
+        || FAILED(dxgiDevice->GetAdapter(&adapter)) || FAILED(adapter->GetDesc(&desc))) {
+        return;
+    }
+    char description[256];
+    snprintf(description, sizeof(description), "%ls", desc.Description);
+    name = description;
+    LARGE_INTEGER version;
+    if (SUCCEEDED(adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &version))) {
+        char text[64];
+        snprintf(
+            text,
+            sizeof(text),
+            "%u.%u.%u.%u",
+            HIWORD(version.HighPart),
+            LOWORD(version.HighPart),
+            HIWORD(version.LowPart),
+            LOWORD(version.LowPart)
+        );
+        driver = text;
+    }
+}
+
+// Escapes the quotes and backslashes of the adapter name, the only free text in the output
+std::string jsonString(const std::string& s) {
+    std::string escaped = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+void writeJson(
+    const std::string& path,
+    const std::string& adapter,
+    const std::string& driver,
+    float fps,
+    const std::vector<Result>& results
+) {
+    std::ofstream out(path);
+    if (!out) {
+        throw MakeException("Failed to open %s", path.c_str());
+    }
+    out << "{\"adapter\":" << jsonString(adapter) << ",\"driver\":" << jsonString(driver)
+        << ",\"runs\":[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double seconds = fps > 0 ? r.frames / fps : r.wallSeconds;
+        char line[512];
+        snprintf(
+            line,
+            sizeof(line),
+            "%s{\"backend\":\"%s\",\"codec\":\"%s\",\"width\":%u,\"height\":%u,"
+            "\"target_bitrate_bps\":%llu,\"achieved_bitrate_bps\":%.0f,\"frames\":%u,"
+            "\"packets\":%u,\"idrs\":%u,\"fps\":%.2f,\"latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,"
+            "\"p99\":%.3f,\"max\":%.3f},\"gpu_passes\":{",
+            i ? "," : "",
+            BACKEND_NAMES[r.backend],
+            codecName(r.codec),
+            r.width,
+            r.height,
+            (unsigned long long)r.bitrate,
+            seconds > 0 ? r.bytes * 8 / seconds : 0,
+            r.frames,
+            r.packets,
+            r.idrs,
+            r.wallSeconds > 0 ? r.packets / r.wallSeconds : 0,
+            percentile(r.latenciesMs, 0.5),
+            percentile(r.latenciesMs, 0.9),
+            percentile(r.latenciesMs, 0.99),
+            percentile(r.latenciesMs, 1.0)
+        );
+        out << line;
+        bool first = true;
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++) {
+            const PassTime& p = r.passes[pass];
+            if (p.count == 0) {
+                continue;
+            }
+            snprintf(
+                line,
+                sizeof(line),
+                "%s\"%s\":{\"count\":%llu,\"mean_us\":%.2f,\"max_us\":%.2f}",
+                first ? "" : ",",
+                GPU_PASS_NAMES[pass],
+                (unsigned long long)p.count,
+                p.meanUs,
+                p.maxUs
+            );
+            out << line;
+            first = false;
+        }
+        out << "}}";
+    }
+    out << "]}\n";
+}
+
+void usage() {
+    fprintf(
+        stderr,
+        "usage: win32_encoder_bench --session <session.json> [--backend amf,nvenc,vpl,sw] "
+        "[--codec h264,hevc,av1] [--bitrate Mbps,...] [--fps N] [--frames N] "
+        "[--input frames.rgba] [--shaders dir] [--json file]\n"
+    );
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw MakeException("Missing value for %s", arg.c_str());
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--session") {
+            options.session = value();
+        } else if (arg == "--shaders") {
+            options.shaders = value();
+        } else if (arg == "--input") {
+            options.input = value();
+        } else if (arg == "--json") {
+            options.json = value();
+        } else if (arg == "--backend") {
+            for (auto& name : split(value(), ',')) {
+                auto found = std::find_if(
+                    std::begin(BACKEND_NAMES), std::end(BACKEND_NAMES), [&](const char* backend) {
+                        return name == backend;
+                    }
+                );
+                if (found == std::end(BACKEND_NAMES)) {
+                    throw MakeException("Unknown backend %s", name.c_str());
+                }
+                options.backends.push_back((int)(found - std::begin(BACKEND_NAMES)));
+            }
+        } else if (arg == "--codec") {
+            for (auto& name : split(value(), ',')) {
+                if (name == "h264") {
+                    options.codecs.push_back(ALVR_CODEC_H264);
+                } else if (name == "hevc") {
+                    options.codecs.push_back(ALVR_CODEC_HEVC);
+                } else if (name == "av1") {
+                    options.codecs.push_back(ALVR_CODEC_AV1);
+                } else {
+                    throw MakeException("Unknown codec %s", name.c_str());
+                }
+            }
+        } else if (arg == "--bitrate") {
+            options.bitrates.clear();
+            for (auto& mbps : split(value(), ',')) {
+                options.bitrates.push_back((uint64_t)(std::stod(mbps) * 1'000'000));
+            }
+        } else if (arg == "--fps") {
+            options.fps = std::stof(value());
+            options.fpsSet = true;
+        } else if (arg == "--frames") {
+            options.frames = std::stoul(value());
+        } else {
+            throw MakeException("Unknown option %s", arg.c_str());
+        }
+    }
+    if (options.session.empty()) {
+        throw MakeException("--session is required");
+    }
+    if (options.backends.empty()) {
+        options.backends = { BACKEND_AMF, BACKEND_NVENC, BACKEND_VPL };
+#ifdef ALVR_GPL
+        options.backends.push_back(BACKEND_SW);
+#endif
+    }
+    return options;
+}
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        usage();
+        return 1;
+    }
+
+    try {
+        g_sessionPath = options.session.c_str();
+        Settings& settings = Settings::Instance();
+        settings.Load();
+        if (!settings.IsLoaded()) {
+            throw MakeException("Failed to load %s", options.session.c_str());
+        }
+        if (options.codecs.empty()) {
+            options.codecs.push_back(settings.m_codec);
+        }
+        float fps = options.fpsSet ? options.fps : settings.m_refreshRate;
+
+        auto frameVs = readFile(options.shaders + "/FrameRenderVS.cso");
+        auto framePs = readFile(options.shaders + "/FrameRenderPS.cso");
+        auto quad = readFile(options.shaders + "/QuadVertexShader.cso");
+        auto compress = readFile(options.shaders + "/CompressAxisAlignedPixelShader.cso");
+        const char* colorCso = "ColorCorrectionPixelShader.cso";
+        auto color = readPermutation(options.shaders, "ColorCorrection.cso", colorCso);
+        auto colorUnsharpened
+            = readPermutation(options.shaders, "ColorCorrectionUnsharpened.cso", colorCso);
+        auto rgbtoyuv = readFile(options.shaders + "/rgbtoyuv420.cso");
+        FRAME_RENDER_VS_CSO_PTR = frameVs.data();
+        FRAME_RENDER_VS_CSO_LEN = frameVs.size();
+        FRAME_RENDER_PS_CSO_PTR = framePs.data();
+        FRAME_RENDER_PS_CSO_LEN = framePs.size();
+        QUAD_SHADER_CSO_PTR = quad.data();
+        QUAD_SHADER_CSO_LEN = quad.size();
+        COMPRESS_AXIS_ALIGNED_CSO_PTR = compress.data();
+        COMPRESS_AXIS_ALIGNED_CSO_LEN = compress.size();
+        COLOR_CORRECTION_CSO_PTR = color.data();
+        COLOR_CORRECTION_CSO_LEN = color.size();
+        COLOR_CORRECTION_UNSHARPENED_CSO_PTR = colorUnsharpened.data();
+        COLOR_CORRECTION_UNSHARPENED_CSO_LEN = colorUnsharpened.size();
+        RGBTOYUV420_CSO_PTR = rgbtoyuv.data();
+        RGBTOYUV420_CSO_LEN = rgbtoyuv.size();
+
+        auto render = std::make_shared<CD3DRender>();
+        if (!render->Initialize(settings.m_nAdapterIndex)) {
+            throw MakeException(
+                "Failed to create a device on adapter %d", settings.m_nAdapterIndex
+            );
+        }
+        std::string adapter, driver;
+        adapterInfo(render->GetDevice(), adapter, driver);
+        Info("Adapter %s, driver %s\n", adapter.c_str(), driver.c_str());
+
+        // A 90 degree field of view for both eyes, the layers cover it whole
+        vr::HmdRect2_t proj = { { -1, 1 }, { 1, -1 } };
+        vr::HmdMatrix34_t eyeToHead = identityPose();
+        FakeCompositor compositor(
+            render, settings.m_renderWidth / 2, settings.m_renderHeight, options.input
+        );
+
+        printf(
+            "%-6s %-5s %-10s %8s %8s %8s %8s %8s %10s %8s %8s %8s\n",
+            "enc",
+            "codec",
+            "size",
+            "target",
+            "actual",
+            "p50 ms",
+            "p90 ms",
+            "p99 ms",
+            "max ms",
+            "gpu us",
+            "fps",
+            "frames"
+        );
+        std::vector<Result> results;
+        for (int codec : options.codecs) {
+            settings.m_codec = codec;
+            for (int backend : options.backends) {
+                // The compositor is created per backend, its output format depends on the codec
+                // and on whether HDR is converted by NVENC
+                FrameRender frameRender(render);
+                auto passTimer = std::make_shared<GpuPassTimer>(render);
+                frameRender.SetPassTimer(passTimer);
+                frameRender.SetViewParams(proj, eyeToHead, proj, eyeToHead);
+                if (!frameRender.Startup()) {
+                    throw MakeException("FrameRender::Startup failed");
+                }
+                if (frameRender.OutputsHdrRgb() && backend != BACKEND_NVENC) {
+                    Warn(
+                        "%s skipped, the HDR RGB output is only taken by NVENC\n",
+                        BACKEND_NAMES[backend]
+                    );
+                    continue;
+                }
+                for (uint64_t bitrate : options.bitrates) {
+                    Result result;
+                    try {
+                        result = runOne(
+                            render,
+                            frameRender,
+                            passTimer,
+                            compositor,
+                            backend,
+                            bitrate,
+                            fps,
+                            options.frames
+                        );
+                    } catch (std::exception& e) {
+                        Error(
+                            "%s %s failed: %s", BACKEND_NAMES[backend], codecName(codec), e.what()
+                        );
+                        continue;
+                    }
+
+                    double gpuUs = 0;
+                    for (const PassTime& pass : result.passes) {
+                        gpuUs += pass.meanUs;
+                    }
+                    // The achieved bitrate is measured against the stream duration at the paced
+                    // rate, or against the wall time when unpaced
+                    double seconds = fps > 0 ? result.frames / fps : result.wallSeconds;
+                    double actual = seconds > 0 ? result.bytes * 8 / seconds : 0;
+                    char size[32];
+                    snprintf(size, sizeof(size), "%ux%u", result.width, result.height);
+                    printf(
+                        "%-6s %-5s %-10s %7.1fM %7.1fM %8.2f %8.2f %8.2f %10.2f %8.1f %8.1f "
+                        "%8u\n",
+                        BACKEND_NAMES[backend],
+                        codecName(codec),
+                        size,
+                        bitrate / 1e6,
+                        actual / 1e6,
+                        percentile(result.latenciesMs, 0.5),
+                        percentile(result.latenciesMs, 0.9),
+                        percentile(result.latenciesMs, 0.99),
+                        percentile(result.latenciesMs, 1.0),
+                        gpuUs,
+                        result.packets / result.wallSeconds,
+                        result.packets
+                    );
+                    results.push_back(std::move(result));
+                }
+            }
+        }
+        if (!options.json.empty()) {
+            writeJson(options.json, adapter, driver, fps, results);
+        }
+    } catch (std::exception& e) {
+        fprintf(stderr, "win32_encoder_bench: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+// Derived from ALVR (MIT)
+// Original copyright preserved
+
+// The crash handlers of the C++ side only record raw addresses (see CrashReport.h). The report
+// left by the previous run is logged here as module and offset pairs, ready for addr2line or
+// llvm-symbolizer against the matching binaries, then removed.
+
+use alvr_common::{error, warn};
+use std::{fmt::Write, fs, path::Path};
+
+// Keep in sync with CRASH_REPORT_FILE_NAME
+const CRASH_REPORT_FNAME: &str = "crash_report.txt";
+
+struct Module {
+    start: u64,
+    end: u64,
+    file_offset: u64,
+    path: String,
+}
+
+fn parse_hex(text: &str) -> Option<u64> {
+    u64::from_str_radix(text.trim_start_matches("0x"), 16).ok()
+}
+
+// "start-end perms offset dev inode path", anonymous mappings are skipped
+fn parse_maps_line(line: &str) -> Option<Module> {
+    let mut fields = line.split_whitespace();
+    let (start, end) = fields.next()?.split_once('-')?;
+    let perms = fields.next()?;
+    let file_offset = parse_hex(fields.next()?)?;
+    let path = fields.nth(2)?;
+    if !perms.contains('x') || !path.starts_with('/') {
+        return None;
+    }
+
+    Some(Module {
+        start: parse_hex(start)?,
+        end: parse_hex(end)?,
+        file_offset,
+        path: path.to_owned(),
+    })
+}
+
+fn parse_module_line(line: &str) -> Option<Module> {
+    let mut fields = line.splitn(3, ' ');
+
+    Some(Module {
+        start: parse_hex(fields.next()?)?,
+        end: parse_hex(fields.next()?)?,
+        file_offset: 0,
+        path: fields.next().unwrap_or_default().to_owned(),
+    })
+}
+
+fn format_report(report: &str) -> String {
+    let mut header = Vec::new();
+    let mut registers = Vec::new();
+    let mut frames = Vec::new();
+    let mut modules = Vec::new();
+
+    let mut lines = report.lines();
+    for line in lines.by_ref() {
+        if line == "maps" {
+            break;
+        }
+        let Some((key, value)) = line.split_once(' ') else {
+            continue;
+        };
+        match key {
+            "alvr_crash_report" => (),
+            "reg" => registers.push(value.replacen(' ', "=", 1)),
+            "frame" => frames.extend(parse_hex(value)),
+            "module" => modules.extend(parse_module_line(value)),
+            _ => header.push(format!("{key} {value}")),
+        }
+    }
+    modules.extend(lines.filter_map(parse_maps_line));
+
+    let mut message = format!(
+        "The driver crashed in the previous run ({})",
+        header.join(", ")
+    );
+    if !registers.is_empty() {
+        write!(message, "\nRegisters: {}", registers.join(" ")).ok();
+    }
+    for (index, pc) in frames.into_iter().enumerate() {
+        match modules
+            .iter()
+            .find(|module| (module.start..module.end).contains(&pc))
+        {
+            Some(module) => write!(
+                message,
+                "\n#{index} {}+{:#x}",
+                module.path,
+                pc - module.start + module.file_offset
+            ),
+            None => write!(message, "\n#{index} {pc:#x}"),
+        }
+        .ok();
+    }
+
+    message
+}
+
+pub fn report_previous_crash(session_path: &Path) {
+    let path = session_path.with_file_name(CRASH_REPORT_FNAME);
+    let Ok(bytes) = fs::read(&path) else {
+        return;
+    };
+
+    error!("{}", format_report(&String::from_utf8_lossy(&bytes)));
+
+    if let Err(e) = fs::remove_file(&path) {
+        warn!("Failed to remove {}: {e}", path.display());
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn maps_line() {
+        let module = parse_maps_line(
+            "7f1c2a000000-7f1c2a400000 r-xp 00021000 fd:01 1234567 \
+             /home/user/.steam/alvr/bin/linux64/driver_alvr_server.so",
+        )
+        .unwrap();
+        assert_eq!(module.start, 0x7f1c2a000000);
+        assert_eq!(module.end, 0x7f1c2a400000);
+        assert_eq!(module.file_offset, 0x21000);
+        assert_eq!(
+            module.path,
+            "/home/user/.steam/alvr/bin/linux64/driver_alvr_server.so"
+        );
+
+        // Not executable
+        assert!(
+            parse_maps_line("7f1c2a400000-7f1c2a500000 r--p 00000000 fd:01 1234567 /lib/a.so")
+                .is_none()
+        );
+        // Anonymous and special mappings
+        assert!(parse_maps_line("7ffd1000-7ffd3000 r-xp 00000000 00:00 0").is_none());
+        assert!(parse_maps_line("7ffd1000-7ffd3000 r-xp 00000000 00:00 0 [vdso]").is_none());
+        assert!(parse_maps_line("not a maps line").is_none());
+    }
+
+    #[test]
+    fn report() {
+        let report = "alvr_crash_report 1\n\
+                      signal 11\n\
+                      address 0x0\n\
+                      reg rip 0x7f1c2a001234\n\
+                      reg rsp 0x7ffd0000\n\
+                      frame 0x7f1c2a001234\n\
+                      frame 0x140001000\n\
+                      frame 0xdead\n\
+                      module 0x140000000 0x140100000 C:\\Steam\\driver_alvr_server.dll\n\
+                      maps\n\
+                      7f1c2a000000-7f1c2a400000 r-xp 00021000 fd:01 1234567 /opt/alvr/driver.so\n\
+                      7ffd0000-7ffd3000 rw-p 00000000 00:00 0 [stack]\n";
+
+        assert_eq!(
+            format_report(report),
+            "The driver crashed in the previous run (signal 11, address 0x0)\n\
+             Registers: rip=0x7f1c2a001234 rsp=0x7ffd0000\n\
+             #0 /opt/alvr/driver.so+0x22234\n\
+             #1 C:\\Steam\\driver_alvr_server.dll+0x1000\n\
+             #2 0xdead"
+        );
+    }
+
+    #[test]
+    fn report_without_frames() {
+        assert_eq!(
+            format_report("alvr_crash_report 1\nexception 0xc0000005\n"),
+            "The driver crashed in the previous run (exception 0xc0000005)"
+        );
+    }
+}
@@ -6,8 +6,11 @@ static FRAME_RENDER_PS_CSO: &[u8] = include_bytes!("../cpp/platform/win32/FrameR
 static QUAD_SHADER_CSO: &[u8] = include_bytes!("../cpp/platform/win32/QuadVertexShader.cso");
 static COMPRESS_AXIS_ALIGNED_CSO: &[u8] =
     include_bytes!("../cpp/platform/win32/CompressAxisAlignedPixelShader.cso");
+// Permutations compiled by build.rs
 static COLOR_CORRECTION_CSO: &[u8] =
-    include_bytes!("../cpp/platform/win32/ColorCorrectionPixelShader.cso");
+    include_bytes!(concat!(env!("OUT_DIR"), "/ColorCorrection.cso"));
+static COLOR_CORRECTION_UNSHARPENED_CSO: &[u8] =
+    include_bytes!(concat!(env!("OUT_DIR"), "/ColorCorrectionUnsharpened.cso"));
 static RGBTOYUV420_CSO: &[u8] = include_bytes!("../cpp/platform/win32/rgbtoyuv420.cso");
 
 static QUAD_SHADER_COMP_SPV: &[u8] = include_bytes!("../cpp/platform/linux/shader/quad.comp.spv");
@@ -28,6 +31,8 @@ pub fn initialize_shaders() {
         crate::COMPRESS_AXIS_ALIGNED_CSO_LEN = COMPRESS_AXIS_ALIGNED_CSO.len() as _;
         crate::COLOR_CORRECTION_CSO_PTR = COLOR_CORRECTION_CSO.as_ptr();
         crate::COLOR_CORRECTION_CSO_LEN = COLOR_CORRECTION_CSO.len() as _;
+        crate::COLOR_CORRECTION_UNSHARPENED_CSO_PTR = COLOR_CORRECTION_UNSHARPENED_CSO.as_ptr();
+        crate::COLOR_CORRECTION_UNSHARPENED_CSO_LEN = COLOR_CORRECTION_UNSHARPENED_CSO.len() as _;
         crate::RGBTOYUV420_CSO_PTR = RGBTOYUV420_CSO.as_ptr();
         crate::RGBTOYUV420_CSO_LEN = RGBTOYUV420_CSO.len() as _;
         crate::QUAD_SHADER_COMP_SPV_PTR = QUAD_SHADER_COMP_SPV.as_ptr();
@@ -1,6 +1,7 @@
 // Derived from ALVR (MIT)
 // Original copyright preserved
 
+mod crash_report;
 mod graphics;
 mod props;
 mod tracking;
@@ -20,6 +21,7 @@ use bindings::*;
 use alvr_common::{
     BUTTON_INFO, HAND_LEFT_ID, HAND_RIGHT_ID, HAND_TRACKER_LEFT_ID, HAND_TRACKER_RIGHT_ID, HEAD_ID,
     Pose, ViewParams, error,
+    glam::Quat,
     parking_lot::{Mutex, RwLock},
     settings_schema::Switch,
     warn,
@@ -31,8 +33,10 @@ use alvr_session::{CodecType, ControllersConfig};
 use std::{
     collections::VecDeque,
     ffi::{CString, OsStr, c_char, c_void},
+    fs,
+    path::PathBuf,
     ptr,
-    sync::{Once, mpsc},
+    sync::{Once, OnceLock, mpsc},
     thread,
     time::{Duration, Instant},
 };
@@ -40,15 +44,125 @@ use std::{
 static SERVER_CORE_CONTEXT: RwLock<Option<ServerCoreContext>> = RwLock::new(None);
 static LOCAL_VIEW_PARAMS: RwLock<[ViewParams; 2]> = RwLock::new([ViewParams::DUMMY; 2]);
 static HEAD_POSE_QUEUE: Mutex<VecDeque<(Duration, Pose)>> = Mutex::new(VecDeque::new());
+// Rotation of the late latched frames, by target timestamp, until they are sent
+static FRAME_REPROJECTIONS: Mutex<VecDeque<(Duration, Quat)>> = Mutex::new(VecDeque::new());
+
+// Frames waiting for the video send thread. More frames than the encoders keep in flight, a
+// full queue blocks the encoder thread like a synchronous send would.
+const VIDEO_SEND_QUEUE_SIZE: usize = 8;
+static VIDEO_SEND_QUEUE: OnceLock<mpsc::SyncSender<VideoSendItem>> = OnceLock::new();
+// Slices of the frame being encoded, by target timestamp. The streamer has no per-slice packets,
+// the slices are joined back and the frame is queued whole with its last slice, so sending slices
+// doesn't get the frame out any earlier.
+static PENDING_SLICES: Mutex<Option<(Duration, Vec<u8>)>> = Mutex::new(None);
+
+// Owned by the encoder until ReleaseVideoBuffer
+struct LeasedBuffer {
+    ptr: *const u8,
+    len: usize,
+    lease_id: u64,
+}
+
+// The buffer is not touched by the encoder until it is released
+unsafe impl Send for LeasedBuffer {}
+
+enum VideoBuffer {
+    Owned(Vec<u8>),
+    Leased(LeasedBuffer),
+}
+
+impl VideoBuffer {
+    fn into_vec(self) -> Vec<u8> {
+        match self {
+            VideoBuffer::Owned(buffer) => buffer,
+            VideoBuffer::Leased(lease) => {
+                // send_video_nal takes an owned buffer, so the leased frame is still copied once.
+                // The lease only moves that copy from the encoder thread to the send thread.
+                let buffer = unsafe { std::slice::from_raw_parts(lease.ptr, lease.len) }.to_vec();
+                unsafe { ReleaseVideoBuffer(lease.lease_id) };
+
+                buffer
+            }
+        }
+    }
+}
 
-fn event_loop(events_receiver: mpsc::Receiver<ServerCoreEvent>) {
+// The config NALs go through the same queue, so that they stay ordered with the frames
+enum VideoSendItem {
+    ConfigNals {
+        buffer: Vec<u8>,
+        codec: CodecType,
+    },
+    Frame {
+        timestamp: Duration,
+        view_params: [ViewParams; 2],
+        is_idr: bool,
+        buffer: VideoBuffer,
+    },
+}
+
+// Sends the frames queued by the encoder threads, which return as soon as a frame is queued
+fn video_send_loop(receiver: mpsc::Receiver<VideoSendItem>) {
+    thread::spawn(move || {
+        while let Ok(item) = receiver.recv() {
+            // The frames queued meanwhile are sent in one go, under one lock of the context
+            let context = SERVER_CORE_CONTEXT.read();
+            for item in std::iter::once(item).chain(receiver.try_iter()) {
+                match item {
+                    VideoSendItem::ConfigNals { buffer, codec } => {
+                        if let Some(context) = &*context {
+                            context.set_video_config_nals(buffer, codec);
+                        }
+                    }
+                    VideoSendItem::Frame {
+                        timestamp,
+                        view_params,
+                        is_idr,
+                        buffer,
+                    } => {
+                        // A leased buffer is released even when the frame is dropped
+                        let buffer = buffer.into_vec();
+                        if let Some(context) = &*context {
+                            context.send_video_nal(timestamp, view_params, is_idr, buffer);
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+fn queue_video_send(item: VideoSendItem) {
+    if let Some(queue) = VIDEO_SEND_QUEUE.get() {
+        queue.send(item).ok();
+    }
+}
+
+// The dashboard and the server core save the session, ReloadSettings applies the live settings
+// once its modification time changed
+const SESSION_POLL_INTERVAL: Duration = Duration::from_secs(1);
+
+fn event_loop(events_receiver: mpsc::Receiver<ServerCoreEvent>, session_path: PathBuf) {
     thread::spawn(move || {
         if let Some(context) = &*SERVER_CORE_CONTEXT.read() {
             context.start_connection();
         }
 
+        let session_modified = || fs::metadata(&session_path).and_then(|m| m.modified()).ok();
+        let mut last_session_poll = Instant::now();
+        let mut last_session_modified = session_modified();
+
         let mut last_resync = Instant::now();
         loop {
+            if last_session_poll.elapsed() >= SESSION_POLL_INTERVAL {
+                last_session_poll = Instant::now();
+                let modified = session_modified();
+                if modified != last_session_modified {
+                    last_session_modified = modified;
+                    unsafe { ReloadSettings() };
+                }
+            }
+
             let event = match events_receiver.recv_timeout(Duration::from_millis(5)) {
                 Ok(event) => event,
                 Err(mpsc::RecvTimeoutError::Timeout) => continue,
@@ -257,22 +371,28 @@ fn event_loop(events_receiver: mpsc::Receiver<ServerCoreEvent>) {
                     }
                 }
                 ServerCoreEvent::Buttons(entries) => {
-                    for entry in entries {
-                        let value = match entry.value {
-                            ButtonValue::Binary(value) => FfiButtonValue {
-                                type_: FfiButtonType_BUTTON_TYPE_BINARY,
-                                __bindgen_anon_1: FfiButtonValue__bindgen_ty_1 {
-                                    binary: value.into(),
+                    let ffi_entries = entries
+                        .iter()
+                        .map(|entry| FfiButtonEntry {
+                            id: entry.path_id,
+                            value: match entry.value {
+                                ButtonValue::Binary(value) => FfiButtonValue {
+                                    type_: FfiButtonType_BUTTON_TYPE_BINARY,
+                                    __bindgen_anon_1: FfiButtonValue__bindgen_ty_1 {
+                                        binary: value.into(),
+                                    },
+                                },
+                                ButtonValue::Scalar(value) => FfiButtonValue {
+                                    type_: FfiButtonType_BUTTON_TYPE_SCALAR,
+                                    __bindgen_anon_1: FfiButtonValue__bindgen_ty_1 {
+                                        scalar: value,
+                                    },
                                 },
                             },
+                        })
+                        .collect::<Vec<_>>();
 
-                            ButtonValue::Scalar(value) => FfiButtonValue {
-                                type_: FfiButtonType_BUTTON_TYPE_SCALAR,
-                                __bindgen_anon_1: FfiButtonValue__bindgen_ty_1 { scalar: value },
-                            },
-                        };
-                        unsafe { SetButton(entry.path_id, value) };
-                    }
+                    unsafe { SetButtons(ffi_entries.as_ptr(), ffi_entries.len() as i32) };
                 }
                 ServerCoreEvent::RequestIDR => unsafe { RequestIDR() },
                 ServerCoreEvent::CaptureFrame => unsafe { CaptureFrame() },
@@ -311,16 +431,13 @@ fn event_loop(events_receiver: mpsc::Receiver<ServerCoreEvent>) {
 }
 
 extern "C" fn driver_ready_idle(set_default_chap: bool) {
-    thread::spawn(move || {
-        unsafe { InitOpenvrClient() };
+    // Both only queue work for the chaperone worker, which owns the OpenVR client. Calling the
+    // client on the driver thread would crash SteamVR.
+    unsafe { InitOpenvrClient() };
 
-        if set_default_chap {
-            // call this when inside a new thread. Calling this on the parent thread will crash SteamVR
-            unsafe {
-                SetChaperoneArea(2.0, 2.0);
-            }
-        }
-    });
+    if set_default_chap {
+        unsafe { SetChaperoneArea(2.0, 2.0) };
+    }
 }
 
 /// # Safety
@@ -371,39 +488,134 @@ extern "C" fn set_video_config_nals(buffer_ptr: *const u8, len: i32, codec: i32)
 
     unsafe { ptr::copy_nonoverlapping(buffer_ptr, config_buffer.as_mut_ptr(), len as usize) };
 
-    if let Some(context) = &*SERVER_CORE_CONTEXT.read() {
-        context.set_video_config_nals(config_buffer, codec);
+    queue_video_send(VideoSendItem::ConfigNals {
+        buffer: config_buffer,
+        codec,
+    });
+}
+
+// The pose of the frame is looked up before queuing it, HEAD_POSE_QUEUE moves on meanwhile
+fn frame_view_params(timestamp: Duration) -> Option<[ViewParams; 2]> {
+    let mut head_pose = HEAD_POSE_QUEUE
+        .lock()
+        .iter()
+        .find_map(|(ts, pose)| (*ts == timestamp).then_some(*pose))?;
+
+    // A late latched frame shows the newer orientation, the client reprojects from that one
+    {
+        let mut reprojections = FRAME_REPROJECTIONS.lock();
+        if let Some((_, delta)) = reprojections.iter().find(|(ts, _)| *ts == timestamp) {
+            head_pose.orientation = *delta * head_pose.orientation;
+        }
+        // Frames are sent in order, the older ones were dropped
+        reprojections.retain(|(ts, _)| *ts > timestamp);
     }
+
+    let local_views_params = LOCAL_VIEW_PARAMS.read();
+
+    Some([
+        ViewParams {
+            pose: head_pose * local_views_params[0].pose,
+            fov: local_views_params[0].fov,
+        },
+        ViewParams {
+            pose: head_pose * local_views_params[1].pose,
+            fov: local_views_params[1].fov,
+        },
+    ])
 }
 
 extern "C" fn send_video(timestamp_ns: u64, buffer_ptr: *mut u8, len: i32, is_idr: bool) {
-    if let Some(context) = &*SERVER_CORE_CONTEXT.read() {
-        let timestamp = Duration::from_nanos(timestamp_ns);
+    let timestamp = Duration::from_nanos(timestamp_ns);
+    // We can't submit the frame without its pose
+    if let Some(view_params) = frame_view_params(timestamp) {
         let buffer = unsafe { std::slice::from_raw_parts(buffer_ptr, len as usize) };
 
-        let Some(head_pose) = HEAD_POSE_QUEUE
-            .lock()
-            .iter()
-            .find_map(|(ts, pose)| (*ts == timestamp).then_some(*pose))
-        else {
-            // We can't submit the frame without its pose
-            return;
-        };
+        queue_video_send(VideoSendItem::Frame {
+            timestamp,
+            view_params,
+            is_idr,
+            buffer: VideoBuffer::Owned(buffer.to_vec()),
+        });
+    }
+}
 
-        let local_views_params = LOCAL_VIEW_PARAMS.read();
+// Like send_video, without the copy on the encoder thread
+extern "C" fn send_video_leased(
+    timestamp_ns: u64,
+    buffer_ptr: *mut u8,
+    len: i32,
+    is_idr: bool,
+    lease_id: u64,
+) {
+    let buffer = LeasedBuffer {
+        ptr: buffer_ptr,
+        len: len as usize,
+        lease_id,
+    };
 
-        let global_view_params = [
-            ViewParams {
-                pose: head_pose * local_views_params[0].pose,
-                fov: local_views_params[0].fov,
-            },
-            ViewParams {
-                pose: head_pose * local_views_params[1].pose,
-                fov: local_views_params[1].fov,
-            },
-        ];
+    let timestamp = Duration::from_nanos(timestamp_ns);
+    if let Some(view_params) = frame_view_params(timestamp) {
+        queue_video_send(VideoSendItem::Frame {
+            timestamp,
+            view_params,
+            is_idr,
+            buffer: VideoBuffer::Leased(buffer),
+        });
+    } else {
+        unsafe { ReleaseVideoBuffer(buffer.lease_id) };
+    }
+}
 
-        context.send_video_nal(timestamp, global_view_params, is_idr, buffer.to_vec());
+// Like send_video, once the last slice of the frame came
+extern "C" fn send_video_slice(
+    timestamp_ns: u64,
+    buffer_ptr: *mut u8,
+    len: i32,
+    is_idr: bool,
+    is_last_slice: bool,
+) {
+    let timestamp = Duration::from_nanos(timestamp_ns);
+
+    let mut pending = PENDING_SLICES.lock();
+    // The slices of a frame an encoder error cut short are dropped with the next frame
+    if pending.as_ref().is_none_or(|(ts, _)| *ts != timestamp) {
+        *pending = Some((timestamp, Vec::new()));
+    }
+    if let Some((_, buffer)) = &mut *pending
+        && len > 0
+    {
+        buffer.extend_from_slice(unsafe { std::slice::from_raw_parts(buffer_ptr, len as usize) });
+    }
+    if !is_last_slice {
+        return;
+    }
+    let Some((_, buffer)) = pending.take() else {
+        return;
+    };
+    drop(pending);
+
+    if !buffer.is_empty()
+        && let Some(view_params) = frame_view_params(timestamp)
+    {
+        queue_video_send(VideoSendItem::Frame {
+            timestamp,
+            view_params,
+            is_idr,
+            buffer: VideoBuffer::Owned(buffer),
+        });
+    }
+}
+
+extern "C" fn report_reprojection(timestamp_ns: u64, rotation_delta: FfiQuat) {
+    let mut reprojections = FRAME_REPROJECTIONS.lock();
+    reprojections.push_back((
+        Duration::from_nanos(timestamp_ns),
+        tracking::from_ffi_quat(rotation_delta),
+    ));
+    // Bounded like HEAD_POSE_QUEUE, in case frames stop being sent
+    while reprojections.len() > 360 {
+        reprojections.pop_front();
     }
 }
 
@@ -511,6 +723,7 @@ pub unsafe extern "C" fn HmdDriverFactory(
             log_to_disk.then(|| filesystem_layout.session_log()),
             Some(filesystem_layout.crash_log()),
         );
+        crash_report::report_previous_crash(&filesystem_layout.session());
 
         unsafe {
             g_sessionPath = CString::new(filesystem_layout.session().to_string_lossy().to_string())
@@ -528,6 +741,10 @@ pub unsafe extern "C" fn HmdDriverFactory(
 
         graphics::initialize_shaders();
 
+        let (video_send_sender, video_send_receiver) = mpsc::sync_channel(VIDEO_SEND_QUEUE_SIZE);
+        VIDEO_SEND_QUEUE.set(video_send_sender).ok();
+        video_send_loop(video_send_receiver);
+
         unsafe {
             LogError = Some(alvr_server_core::alvr_error);
             LogWarn = Some(alvr_server_core::alvr_warn);
@@ -543,9 +760,12 @@ pub unsafe extern "C" fn HmdDriverFactory(
             HapticsSend = Some(send_haptics);
             SetVideoConfigNals = Some(set_video_config_nals);
             VideoSend = Some(send_video);
+            VideoSendLeased = Some(send_video_leased);
+            VideoSendSlice = Some(send_video_slice);
             GetDynamicEncoderParams = Some(get_dynamic_encoder_params);
             ReportComposed = Some(report_composed);
             ReportPresent = Some(report_present);
+            ReportReprojection = Some(report_reprojection);
             WaitForVSync = Some(wait_for_vsync);
             ShutdownRuntime = Some(shutdown_driver);
 
@@ -561,7 +781,7 @@ pub unsafe extern "C" fn HmdDriverFactory(
 
         *SERVER_CORE_CONTEXT.write() = Some(context);
 
-        event_loop(events_receiver);
+        event_loop(events_receiver, filesystem_layout.session());
     });
 
     unsafe { CppOpenvrEntryPoint(interface_name, return_code) }
@@ -50,6 +50,10 @@ fn to_ffi_quat(quat: Quat) -> FfiQuat {
     }
 }
 
+pub fn from_ffi_quat(quat: FfiQuat) -> Quat {
+    Quat::from_xyzw(quat.x, quat.y, quat.z, quat.w)
+}
+
 fn to_ffi_pose(pose: Pose) -> FfiPose {
     FfiPose {
         orientation: to_ffi_quat(pose.orientation),
@@ -42,6 +42,12 @@ pub struct OpenvrConfig {
     pub enable_vive_tracker_proxy: bool,
     pub minimum_idr_interval_ms: u64,
     pub adapter_index: u32,
+    // -1 to encode on adapter_index
+    pub encode_adapter_index: i32,
+    // 0 for no limit
+    pub encoder_session_limit: u32,
+    pub d3d12_high_priority_queue: bool,
+    pub raise_gpu_priority: bool,
     pub codec: u8,
     pub h264_profile: u32,
     pub refresh_rate: u32,
@@ -50,22 +56,41 @@ pub struct OpenvrConfig {
     pub enable_hdr: bool,
     pub force_hdr_srgb_correction: bool,
     pub clamp_hdr_extended_range: bool,
+    pub hdr_nvenc_rgb_input: bool,
     pub enable_amf_pre_analysis: bool,
     pub enable_vbaq: bool,
     pub enable_amf_hmqb: bool,
     pub use_amf_preproc: bool,
     pub amf_preproc_sigma: u32,
     pub amf_preproc_tor: u32,
+    pub amf_frame_rate_conversion: bool,
+    pub amf_hq_scaler: bool,
     pub encoder_quality_preset: u32,
+    pub dynamic_encoder_preset: bool,
     pub rate_control_mode: u32,
     pub filler_data: bool,
+    pub encoder_slices_per_frame: u32,
+    pub encoder_max_slice_bytes: u32,
+    pub encoder_av1_tile_columns: u32,
+    pub encoder_av1_tile_rows: u32,
+    pub encoder_temporal_layers: u32,
+    pub encoder_disposable_frames: u32,
+    pub vpl_async_depth: u32,
+    pub vpl_hyper_encode: bool,
+    pub gaze_roi_qp_delta: u32,
+    pub gaze_roi_radius: f32,
+    pub dynamic_resolution_bitrate_mbps: u32,
+    pub intra_refresh_frames: u32,
+    pub long_term_reference_recovery: bool,
     pub entropy_coding: u32,
+    pub encoder_decode_feedback: bool,
     pub force_sw_encoding: bool,
     pub sw_thread_count: u32,
     pub controller_is_tracker: bool,
     pub controllers_enabled: bool,
     pub body_tracking_vive_enabled: bool,
     pub body_tracking_has_legs: bool,
+    pub pose_prediction_model: u32,
     pub enable_foveated_encoding: bool,
     pub foveation_center_size_x: f32,
     pub foveation_center_size_y: f32,
@@ -74,6 +99,15 @@ pub struct OpenvrConfig {
     pub foveation_edge_ratio_x: f32,
     pub foveation_edge_ratio_y: f32,
     pub enable_color_correction: bool,
+    pub late_latch_reprojection: bool,
+    pub jit_composition: bool,
+    pub adaptive_render_resolution: bool,
+    pub half_rate_fallback: bool,
+    pub vsync_latency_compensation: bool,
+    pub photon_marker: bool,
+    pub encoder_chroma_444: bool,
+    pub realtime_threads: bool,
+    pub isolated_cores: u32,
     pub brightness: f32,
     pub contrast: f32,
     pub saturation: f32,
@@ -81,6 +115,13 @@ pub struct OpenvrConfig {
     pub sharpening: f32,
     pub linux_async_compute: bool,
     pub linux_async_reprojection: bool,
+    pub linux_encode_device: String,
+    pub linux_encode_pipeline_depth: u32,
+    pub linux_idle_mode: bool,
+    pub linux_local_display_connector: String,
+    pub linux_local_display_device: String,
+    pub linux_quality_metrics_interval_ms: u32,
+    pub linux_vulkan_video_encode: bool,
     pub nvenc_quality_preset: u32,
     pub nvenc_tuning_preset: u32,
     pub nvenc_multi_pass: u32,
@@ -99,8 +140,15 @@ pub struct OpenvrConfig {
     pub rc_max_bitrate: i64,
     pub rc_average_bitrate: i64,
     pub nvenc_enable_weighted_prediction: bool,
+    pub nvenc_async_depth: u32,
+    pub nvenc_split_encode_mode: u32,
+    pub nvenc_stereo_interleave: bool,
     pub capture_frame_dir: String,
+    pub flight_recorder_duration_s: f32,
+    pub flight_recorder_downscale: u32,
+    pub flight_recorder_dump_on_glitch: bool,
     pub amd_bitrate_corruption_fix: bool,
+    pub bitrate_calibration: bool,
     pub use_separate_hand_trackers: bool,
 
     // these settings are not used on the C++ side, but we need them to correctly trigger a SteamVR
@@ -148,13 +196,38 @@ impl Default for SessionConfig {
                 target_eye_resolution_width: 800,
                 target_eye_resolution_height: 900,
                 adapter_index: 0,
+                encode_adapter_index: -1,
+                raise_gpu_priority: true,
                 refresh_rate: 60,
                 controllers_enabled: false,
                 body_tracking_vive_enabled: false,
                 enable_foveated_encoding: false,
                 enable_color_correction: false,
+                late_latch_reprojection: false,
                 linux_async_reprojection: false,
+                linux_encode_device: "".into(),
+                linux_encode_pipeline_depth: 1,
+                linux_idle_mode: false,
+                linux_local_display_connector: "".into(),
+                linux_local_display_device: "".into(),
+                linux_vulkan_video_encode: false,
+                encoder_slices_per_frame: 1,
+                encoder_max_slice_bytes: 0,
+                encoder_av1_tile_columns: 1,
+                encoder_av1_tile_rows: 1,
+                encoder_temporal_layers: 1,
+                encoder_disposable_frames: 0,
+                nvenc_async_depth: 2,
+                nvenc_split_encode_mode: 0,
+                nvenc_stereo_interleave: false,
+                vpl_async_depth: 2,
+                gaze_roi_qp_delta: 6,
+                gaze_roi_radius: 0.3,
+                dynamic_resolution_bitrate_mbps: 0,
+                intra_refresh_frames: 0,
+                long_term_reference_recovery: false,
                 capture_frame_dir: "/tmp".into(),
+                flight_recorder_downscale: 4,
                 ..<_>::default()
             },
             client_connections: HashMap::new(),
@@ -90,6 +90,20 @@ pub enum NvencAdaptiveQuantizationMode {
     Temporal = 2,
 }
 
+#[repr(u32)]
+#[derive(SettingsSchema, Serialize, Deserialize, Clone, PartialEq)]
+pub enum NvencSplitEncodeMode {
+    #[schema(strings(display_name = "Driver default"))]
+    Auto = 0,
+    Disabled = 1,
+    #[schema(strings(display_name = "All engines"))]
+    Forced = 2,
+    #[schema(strings(display_name = "2 engines"))]
+    TwoEngines = 3,
+    #[schema(strings(display_name = "3 engines"))]
+    ThreeEngines = 4,
+}
+
 #[repr(u8)]
 #[derive(SettingsSchema, Serialize, Deserialize, Clone, PartialEq)]
 #[schema(gui = "button_group")]
@@ -160,6 +174,29 @@ Temporal: Helps improve overall encoding quality, very small trade-off in speed.
     pub rc_average_bitrate: i64,
     #[schema(flag = "steamvr-restart")]
     pub enable_weighted_prediction: bool,
+    #[schema(strings(
+        help = "Number of frames NVENC can have in flight. Above 1, a frame can be submitted while \
+the previous one is still being encoded, and the output is read back on a separate thread. Not \
+used when streaming slices."
+    ))]
+    #[schema(gui(slider(min = 1, max = 4)))]
+    #[schema(flag = "steamvr-restart")]
+    pub async_depth: u32,
+    #[schema(strings(
+        help = "Encodes each frame with several NVENC engines in parallel, on GPUs that have more \
+than one. HEVC and AV1 only. Needs FFmpeg 7.1 or newer on Linux, not available on Windows yet."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub split_encode_mode: NvencSplitEncodeMode,
+    #[cfg_attr(not(target_os = "windows"), schema(flag = "hidden"))]
+    #[schema(strings(
+        help = "Encodes the eyes as two half width pictures, left then right, so that the right \
+eye is predicted from the left one and the bitrate goes to the differences between the eyes. \
+Needs a client that decodes both pictures of a frame. H264 and HEVC only, turns off slices, \
+async encoding, intra refresh, long-term references, temporal layers and dynamic resolution."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub stereo_interleave: bool,
 }
 
 #[derive(SettingsSchema, Serialize, Deserialize, Clone, PartialEq)]
@@ -191,6 +228,24 @@ Does not work with the "Reduce color banding" option, requires enabling "Use pre
         flag = "steamvr-restart"
     )]
     pub enable_pre_analysis: bool,
+    #[schema(
+        strings(
+            display_name = "Frame rate conversion",
+            help = r#"When the game only renders every other frame, the missing frames are interpolated by AMF FRC on the GPU instead of being sent repeated. The real frames are then one frame later.
+Not used with long-term references or temporal layers"#
+        ),
+        flag = "steamvr-restart"
+    )]
+    pub frame_rate_conversion: bool,
+    #[schema(
+        strings(
+            display_name = "High quality scaler",
+            help = r#"The frames of the dynamic resolution are converted to YUV by the AMF video converter and scaled bicubic by the AMF HQ scaler, instead of the bilinear scaling of the converter.
+Falls back to the converter if the driver has no HQ scaler"#
+        ),
+        flag = "steamvr-restart"
+    )]
+    pub hq_scaler: bool,
 }
 
 #[derive(SettingsSchema, Serialize, Deserialize, Clone, PartialEq)]
@@ -231,6 +286,14 @@ pub struct HDRConfig {
     ))]
     #[schema(flag = "steamvr-restart")]
     pub clamp_hdr_extended_range: bool,
+
+    #[schema(strings(
+        display_name = "NVENC RGB input",
+        help = "NVIDIA only. Composites to 10 bit RGB (8 bit without 10 bit encoding) and lets NVENC convert it to YUV on its own hardware, skipping the YUV shader pass. The extended range is clamped."
+    ))]
+    #[cfg_attr(not(target_os = "windows"), schema(flag = "hidden"))]
+    #[schema(flag = "steamvr-restart")]
+    pub nvenc_rgb_input: bool,
 }
 
 #[derive(SettingsSchema, Serialize, Deserialize, Clone, PartialEq)]
@@ -243,6 +306,14 @@ pub struct EncoderConfig {
     ))]
     pub quality_preset: EncoderQualityPreset,
 
+    #[schema(strings(
+        help = "Steps the encoder preset at runtime from the measured encode time: a faster preset \
+when the encoder runs out of the frame time, a slower one of better quality when it has plenty to \
+spare. Starts from the quality presets above. Works with NVENC, AMF and VPL on Windows, and x264."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub dynamic_quality_preset: bool,
+
     #[schema(
         strings(
             display_name = "Enable VBAQ/CAQ",
@@ -270,12 +341,142 @@ CABAC produces better compression but it's significantly slower and may lead to
     #[schema(flag = "steamvr-restart")]
     pub entropy_coding: EntropyCoding,
 
+    #[cfg_attr(not(target_os = "linux"), schema(flag = "hidden"))]
+    #[schema(strings(
+        display_name = "Adapt to the client decoder",
+        help = "This works only on Linux. When the client needs most of the frame time to decode, \
+switch h264 to CAVLC, and encode more slices if it decodes them in parallel. Each change restarts \
+the encoder."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub decode_feedback: bool,
+
     #[schema(strings(
         help = r#"In CBR mode, this makes sure the bitrate does not fall below the assigned value. This is mostly useful for debugging."#
     ))]
     #[schema(flag = "steamvr-restart")]
     pub filler_data: bool,
 
+    #[schema(strings(
+        help = "Splits each frame into this many slices, which the client can decode in parallel. \
+The frame is still sent whole once it is encoded. 1 disables slicing."
+    ))]
+    #[schema(gui(slider(min = 1, max = 8)))]
+    #[schema(flag = "steamvr-restart")]
+    pub slices_per_frame: u32,
+
+    #[schema(strings(
+        help = "Caps the size of each slice to this many bytes instead of using a fixed slice count. \
+Set it to a multiple of the video packet payload, so that each packet carries whole slices and a \
+lost packet only costs its slices. Supported by NVENC on Windows (h264/HEVC) and x264. 0 disables \
+it."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub max_slice_bytes: u32,
+
+    #[schema(strings(
+        help = "Splits each AV1 frame into this many tile columns, which multi-core decoders on \
+the client decode in parallel. Rounded down to a power of two by the encoders."
+    ))]
+    #[schema(gui(slider(min = 1, max = 8)))]
+    #[schema(flag = "steamvr-restart")]
+    pub av1_tile_columns: u32,
+
+    #[schema(strings(
+        help = "Splits each AV1 frame into this many tile rows. With more than 1 slice per frame, \
+the tiles are coded in that many tile groups (AMF, VAAPI and VPL), which are streamed separately \
+like slices."
+    ))]
+    #[schema(gui(slider(min = 1, max = 8)))]
+    #[schema(flag = "steamvr-restart")]
+    pub av1_tile_rows: u32,
+
+    #[schema(strings(
+        help = "Encodes the stream in this many temporal layers (2 for L1T2, 3 for L1T3). Frames of \
+the upper layers are never referenced by the lower ones, so a relay or a congested client can drop \
+them and halve the frame rate without an IDR. Supported by NVENC on Windows (h264) and AMF. \
+Disables long-term reference recovery. 1 disables it."
+    ))]
+    #[schema(gui(slider(min = 1, max = 3)))]
+    #[schema(flag = "steamvr-restart")]
+    pub temporal_layers: u32,
+
+    #[schema(strings(
+        help = "Codes this many P frames after each reference frame as non-reference. No frame is \
+predicted from them, so a loss on one costs that frame only, without a recovery. Intel VPL supports any count, NVENC (h264) and AMF only every \
+other frame, as the top temporal layer. 0 disables it."
+    ))]
+    #[schema(gui(slider(min = 0, max = 3)))]
+    #[schema(flag = "steamvr-restart")]
+    pub disposable_frames: u32,
+
+    #[cfg_attr(not(target_os = "windows"), schema(flag = "hidden"))]
+    #[schema(strings(
+        display_name = "Intel VPL: Async depth",
+        help = "Number of frames the Intel VPL encoder can have in flight. Above 1, the next frame \
+is submitted while the previous one is still being encoded."
+    ))]
+    #[schema(gui(slider(min = 1, max = 4)))]
+    #[schema(flag = "steamvr-restart")]
+    pub vpl_async_depth: u32,
+
+    #[cfg_attr(not(target_os = "windows"), schema(flag = "hidden"))]
+    #[schema(strings(
+        display_name = "Intel VPL: Hyper Encode",
+        help = "On machines with both an Intel integrated and discrete GPU, the Intel VPL encoder \
+encodes on both of them. The adapters take turns by GOP, so an IDR frame is encoded every second. \
+Falls back to a single adapter if Hyper Encode is not available."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub vpl_hyper_encode: bool,
+
+    #[schema(strings(
+        display_name = "Gaze ROI: QP offset",
+        help = "With eye tracking, raises the quantizer of the parts of the frame away from the \
+gaze by up to this much, so that the bitrate goes where the user is looking. 0 disables it."
+    ))]
+    #[schema(gui(slider(min = 0, max = 20)))]
+    #[schema(flag = "steamvr-restart")]
+    pub gaze_roi_qp_delta: u32,
+
+    #[schema(strings(
+        display_name = "Gaze ROI: Radius",
+        help = "Radius of the full quality region around the gaze, relative to the eye width. The \
+quality then decreases over the same distance."
+    ))]
+    #[schema(gui(slider(min = 0.05, max = 0.5, step = 0.01)))]
+    #[schema(flag = "steamvr-restart")]
+    pub gaze_roi_radius: f32,
+
+    #[schema(strings(
+        display_name = "Dynamic resolution: bitrate",
+        help = "When the adaptive bitrate goes below this many Mbps, frames are encoded at 75% of \
+the resolution, and at 50% below half of it. The encoder is reconfigured in place with an IDR. \
+0 disables it."
+    ))]
+    #[schema(gui(slider(min = 0, max = 100)), suffix = "Mbps")]
+    #[schema(flag = "steamvr-restart")]
+    pub dynamic_resolution_bitrate_mbps: u32,
+
+    #[schema(strings(
+        display_name = "Intra refresh recovery",
+        help = "Recovers from packet loss with a wave of intra blocks spread over this many frames \
+instead of a full IDR frame, which avoids the bitrate spike of keyframes. The stream still starts \
+with an IDR. Supported by NVENC, AMF and x264, the other encoders keep IDR frames. 0 disables it."
+    ))]
+    #[schema(gui(slider(min = 0, max = 60)), suffix = " frames")]
+    #[schema(flag = "steamvr-restart")]
+    pub intra_refresh_frames: u32,
+
+    #[schema(strings(
+        display_name = "Long-term reference recovery",
+        help = "Keeps a long-term reference frame per second that the client acknowledges. After a \
+loss the next frame is predicted from the last acknowledged one, so the stream recovers in one frame \
+without a keyframe. Supported by NVENC (h264/HEVC), AMF and VPL."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub long_term_reference_recovery: bool,
+
     #[schema(strings(
         display_name = "10-bit encoding",
         help = "Sets the encoder to use 10 bits per channel instead of 8, if the client has no preference. Does not work on Linux with Nvidia"
@@ -432,6 +633,13 @@ This has an effect only on AMD GPUs."
     ))]
     #[schema(flag = "steamvr-restart")]
     pub image_corruption_fix: bool,
+
+    #[schema(strings(
+        help = "Measures the bitrate each encoder actually produces and corrects its target until \
+it matches the requested bitrate. The correction is saved for each encoder, GPU and driver."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub encoder_calibration: bool,
 }
 
 #[repr(u8)]
@@ -735,6 +943,79 @@ If you want to reduce the amount of pixelation on the edges, increase the center
     #[schema(flag = "real-time")]
     pub enforce_server_frame_pacing: bool,
 
+    #[cfg_attr(not(target_os = "windows"), schema(flag = "hidden"))]
+    #[schema(strings(
+        help = r"This works only on Windows. Rotates the game frame to the newest headset pose just before encoding, so the headset has less to correct when the game frame is late."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub late_latch_reprojection: bool,
+
+    #[cfg_attr(not(target_os = "windows"), schema(flag = "hidden"))]
+    #[schema(strings(
+        help = "This works only on Windows, with late latch reprojection. Delays the composition \
+of each game frame until just enough time is left to encode and send it for its display refresh, \
+so that it is rotated to a newer headset pose."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub jit_composition: bool,
+
+    #[schema(strings(
+        help = "Lower the resolution SteamVR recommends to the games while the dynamic resolution \
+encodes fewer pixels than they render, or while they miss frames, and raise it back once they \
+keep up. Games that read the recommended size only at startup are not affected."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub adaptive_render_resolution: bool,
+
+    #[schema(strings(
+        help = "When the encoder or the network can't keep up with the refresh rate, encode every \
+other frame at a fixed cadence instead of dropping frames irregularly, the client reprojection \
+fills the refreshes in between. Full rate resumes once the encoder has time \
+to spare."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub half_rate_fallback: bool,
+
+    #[schema(strings(
+        help = "Place the vsync reported to SteamVR one measured pipeline latency before the \
+client vsync, and report that latency as the vsync to photons time, so that games predict their \
+poses for when the frames are shown. Follows the encode, network and client timing at runtime."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub vsync_latency_compensation: bool,
+
+    #[schema(strings(
+        help = "Diagnostic mode for measuring latency. Stamp a 128x64 barcode of the frame \
+timestamp and a frame counter in the top left corner of every frame, which the client reads back \
+after decoding and at present to report the render to photon latency of each frame. The client \
+needs to support it."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub photon_marker: bool,
+
+    #[cfg_attr(not(target_os = "windows"), schema(flag = "hidden"))]
+    #[schema(strings(
+        help = "This works only on Windows with NVENC, for h264 and HEVC without HDR. Encode the \
+chroma at full resolution, keeping text and thin lines sharp in desktop sessions. Falls back to \
+4:2:0 if the GPU can't, with the chroma position signalled for the client upsampling."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub chroma_444: bool,
+
+    #[schema(strings(
+        help = "Schedule the encoder threads in real time (MMCSS on Windows, SCHED_FIFO or rtkit \
+on Linux), so that the worker threads of the game don't preempt them."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub realtime_threads: bool,
+
+    #[schema(strings(
+        help = "Pin the encoder threads to this many of the last CPU cores, 0 to let them run on \
+any. Works best when the game is kept off these cores."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub isolated_cores: u32,
+
     #[schema(flag = "steamvr-restart")]
     pub encoder_config: EncoderConfig,
 
@@ -769,6 +1050,42 @@ If you want to reduce the amount of pixelation on the edges, increase the center
     #[schema(flag = "steamvr-restart")]
     pub adapter_index: u32,
 
+    #[cfg_attr(not(target_os = "windows"), schema(flag = "hidden"))]
+    #[schema(strings(
+        help = "Encode on another adapter than the one of the game, like an integrated or a spare \
+GPU. The frames are shared across the adapters if the drivers allow it, otherwise they are copied \
+through system memory."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub encode_adapter_index: Option<u32>,
+
+    #[schema(strings(
+        help = "Number of NVENC sessions the streaming instances of this host may use on each GPU, \
+at most what its driver allows. An instance that finds them all taken falls back to another \
+encoder instead of failing to open one. 0 leaves the limit to the driver."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub encoder_session_limit: u32,
+
+    #[cfg_attr(not(target_os = "windows"), schema(flag = "hidden"))]
+    #[schema(strings(
+        display_name = "D3D12 high priority queue",
+        help = "Run the compositor of ALVR through D3D11 on 12 on a high priority D3D12 queue, so \
+the GPU schedules it ahead of the game. The encoder shares the device, if it fails to start pick \
+another encode adapter or turn this off."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub d3d12_high_priority_queue: bool,
+
+    #[schema(strings(
+        display_name = "Raise GPU priority",
+        help = "Schedule the compositor of ALVR ahead of the other work of the GPU. Turn it off \
+for the secondary instances that share a GPU with another stream, like spectators or recording, \
+so that they don't preempt it."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub raise_gpu_priority: bool,
+
     #[schema(strings(display_name = "Client-side foveation"))]
     pub clientside_foveation: Switch<ClientsideFoveationConfig>,
 
@@ -1177,6 +1494,15 @@ pub struct HandSkeletonConfig {
     pub predict: bool,
 }
 
+#[repr(u8)]
+#[derive(SettingsSchema, Serialize, Deserialize, Clone, Copy, PartialEq)]
+#[schema(gui = "button_group")]
+pub enum PosePredictionModel {
+    ConstantVelocity = 0,
+    ConstantAcceleration = 1,
+    Filtered = 2,
+}
+
 #[derive(SettingsSchema, Serialize, Deserialize, Clone)]
 #[schema(collapsible)]
 pub struct ControllersConfig {
@@ -1205,6 +1531,13 @@ Currently this cannot be reliably estimated automatically. The correct value sho
     #[schema(gui(slider(min = 1.0, max = 10.0, logarithmic)), suffix = "frames")]
     pub steamvr_pipeline_frames: f32,
 
+    #[schema(flag = "real-time")]
+    #[schema(strings(
+        help = r"How SteamVR extrapolates the controller and tracker poses over the prediction time.
+Constant acceleration follows the start and end of fast movements better, filtered hides the jitter of long predictions on high latency networks."
+    ))]
+    pub pose_prediction_model: PosePredictionModel,
+
     #[schema(flag = "real-time")]
     pub haptics: Switch<HapticsConfig>,
 
@@ -1572,6 +1905,29 @@ pub struct RollingVideoFilesConfig {
     pub duration_s: u64,
 }
 
+#[derive(SettingsSchema, Serialize, Deserialize, Clone)]
+pub struct FlightRecorderConfig {
+    #[schema(strings(
+        help = "Seconds of frames kept in memory. Every frame takes width * height * 8 / \
+downscale^2 bytes of host memory."
+    ))]
+    #[schema(gui(slider(min = 0.5, max = 10.0, step = 0.5)))]
+    #[schema(suffix = "s")]
+    #[schema(flag = "steamvr-restart")]
+    pub duration_s: f32,
+
+    #[schema(strings(help = "The frames are kept at their size divided by this factor"))]
+    #[schema(gui(slider(min = 1, max = 8)))]
+    #[schema(flag = "steamvr-restart")]
+    pub downscale: u32,
+
+    #[schema(strings(
+        help = "Also write the frames out when the client loses a frame or the encoder fails"
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub dump_on_glitch: bool,
+}
+
 #[derive(SettingsSchema, Serialize, Deserialize, Clone)]
 pub struct CaptureConfig {
     #[schema(strings(display_name = "Start video recording at client connection"))]
@@ -1581,6 +1937,14 @@ pub struct CaptureConfig {
 
     #[schema(flag = "steamvr-restart")]
     pub capture_frame_dir: String,
+
+    #[schema(strings(
+        help = "Keep the last input and output frames in memory and write them to the capture \
+frame directory when a frame capture is requested, instead of a single frame. Copying the frames \
+doesn't delay the stream."
+    ))]
+    #[cfg_attr(not(target_os = "linux"), schema(flag = "hidden"))]
+    pub flight_recorder: Switch<FlightRecorderConfig>,
 }
 
 #[derive(SettingsSchema, Serialize, Deserialize, Clone)]
@@ -1595,6 +1959,56 @@ pub struct Patches {
     ))]
     #[schema(flag = "steamvr-restart")]
     pub linux_async_reprojection: bool,
+    #[schema(strings(
+        help = "Number of frames the Linux encoder keeps in flight. With 2 or 3, compositing of \
+the next frame overlaps with encoding and sending of the previous one. 1 keeps the serial loop."
+    ))]
+    #[schema(gui(slider(min = 1, max = 3)))]
+    #[schema(flag = "steamvr-restart")]
+    pub linux_encode_pipeline_depth: u32,
+    #[schema(strings(
+        help = "Encode with Vulkan Video on the compositor's device instead of VAAPI or NVENC. \
+Needs FFmpeg 7.1 or newer and a driver exposing VK_KHR_video_encode_queue, falls back to the \
+other encoders otherwise."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub linux_vulkan_video_encode: bool,
+    #[schema(strings(
+        help = "Render node of another GPU to encode on with VAAPI, for example /dev/dri/renderD129. \
+The compositor GPU exports each frame as a linear dma-buf that the other GPU imports. Empty \
+encodes on the compositor GPU."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub linux_encode_device: String,
+    #[schema(strings(
+        help = "Measure the PSNR and SSIM of one frame per this many milliseconds, 0 to disable. \
+The stream is decoded in software on a background thread and the sampled frames are compared \
+with the images given to the encoder, then written to the log. Costs the CPU time of a decoder."
+    ))]
+    #[schema(suffix = "ms")]
+    #[schema(flag = "steamvr-restart")]
+    pub linux_quality_metrics_interval_ms: u32,
+    #[schema(strings(
+        help = "Card to show the composed frames on for local monitoring, for example \
+/dev/dri/card1. The frames are scanned out directly with DRM atomic commits, skipping frames \
+instead of waiting for the display. The card or the connector can't be used by a desktop \
+compositor at the same time, use a second GPU or start SteamVR from a VT. Empty disables it."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub linux_local_display_device: String,
+    #[schema(strings(
+        help = "Connector of the local display, as named by the kernel, for example DP-2. Empty \
+takes the first connected one."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub linux_local_display_connector: String,
+    #[schema(strings(
+        help = "Encode one frame per second while the headset is not worn. The encoders stay \
+open, and the full rate comes back with an IDR when the headset is put on or moves. Frees encoder \
+and GPU time for other sessions on a shared GPU."
+    ))]
+    #[schema(flag = "steamvr-restart")]
+    pub linux_idle_mode: bool,
 }
 
 #[derive(SettingsSchema, Serialize, Deserialize, Clone)]
@@ -1720,12 +2134,25 @@ pub fn session_settings_default() -> SettingsDefault {
                 },
             },
             adapter_index: 0,
+            encode_adapter_index: None,
+            encoder_session_limit: 0,
+            d3d12_high_priority_queue: false,
+            raise_gpu_priority: true,
             transcoding_view_resolution: view_resolution.clone(),
             emulated_headset_view_resolution: view_resolution,
             preferred_fps: 72.,
             max_buffering_frames: 2.0,
             buffering_history_weight: 0.90,
             enforce_server_frame_pacing: true,
+            late_latch_reprojection: false,
+            jit_composition: false,
+            adaptive_render_resolution: false,
+            half_rate_fallback: false,
+            vsync_latency_compensation: false,
+            photon_marker: false,
+            chroma_444: false,
+            realtime_threads: false,
+            isolated_cores: 0,
             bitrate: BitrateConfigDefault {
                 gui_collapsed: false,
                 mode: BitrateModeDefault {
@@ -1771,6 +2198,7 @@ pub fn session_settings_default() -> SettingsDefault {
                 },
                 history_size: 256,
                 image_corruption_fix: false,
+                encoder_calibration: false,
             },
             preferred_codec: CodecTypeDefault {
                 variant: CodecTypeDefaultVariant::H264,
@@ -1781,12 +2209,26 @@ pub fn session_settings_default() -> SettingsDefault {
                     variant: RateControlModeDefaultVariant::Cbr,
                 },
                 filler_data: false,
+                slices_per_frame: 1,
+                max_slice_bytes: 0,
+                av1_tile_columns: 1,
+                av1_tile_rows: 1,
+                temporal_layers: 1,
+                disposable_frames: 0,
+                vpl_async_depth: 2,
+                vpl_hyper_encode: false,
+                gaze_roi_qp_delta: 6,
+                gaze_roi_radius: 0.3,
+                dynamic_resolution_bitrate_mbps: 0,
+                intra_refresh_frames: 0,
+                long_term_reference_recovery: false,
                 h264_profile: H264ProfileDefault {
                     variant: H264ProfileDefaultVariant::High,
                 },
                 entropy_coding: EntropyCodingDefault {
                     variant: EntropyCodingDefaultVariant::Cavlc,
                 },
+                decode_feedback: false,
                 use_10bit: OptionalDefault {
                     set: false,
                     content: false,
@@ -1803,6 +2245,7 @@ pub fn session_settings_default() -> SettingsDefault {
                     },
                     force_hdr_srgb_correction: false,
                     clamp_hdr_extended_range: false,
+                    nvenc_rgb_input: false,
                 },
                 nvenc: NvencConfigDefault {
                     gui_collapsed: true,
@@ -1832,10 +2275,16 @@ pub fn session_settings_default() -> SettingsDefault {
                     rc_max_bitrate: -1,
                     rc_average_bitrate: -1,
                     enable_weighted_prediction: false,
+                    async_depth: 2,
+                    split_encode_mode: NvencSplitEncodeModeDefault {
+                        variant: NvencSplitEncodeModeDefaultVariant::Auto,
+                    },
+                    stereo_interleave: false,
                 },
                 quality_preset: EncoderQualityPresetDefault {
                     variant: EncoderQualityPresetDefaultVariant::Speed,
                 },
+                dynamic_quality_preset: false,
                 enable_vbaq: false,
                 amf: AmfConfigDefault {
                     gui_collapsed: true,
@@ -1844,6 +2293,8 @@ pub fn session_settings_default() -> SettingsDefault {
                     use_preproc: false,
                     preproc_sigma: 4,
                     preproc_tor: 7,
+                    frame_rate_conversion: false,
+                    hq_scaler: false,
                 },
                 software: SoftwareEncodingConfigDefault {
                     gui_collapsed: true,
@@ -2121,6 +2572,9 @@ pub fn session_settings_default() -> SettingsDefault {
                         },
                     },
                     steamvr_pipeline_frames: 2.1,
+                    pose_prediction_model: PosePredictionModelDefault {
+                        variant: PosePredictionModelDefaultVariant::ConstantVelocity,
+                    },
                     linear_velocity_cutoff: 0.05,
                     angular_velocity_cutoff: 10.0,
                     left_controller_position_offset: ArrayDefault {
@@ -2263,10 +2717,25 @@ pub fn session_settings_default() -> SettingsDefault {
                 } else {
                     "".into()
                 },
+                flight_recorder: SwitchDefault {
+                    enabled: false,
+                    content: FlightRecorderConfigDefault {
+                        duration_s: 2.0,
+                        downscale: 4,
+                        dump_on_glitch: false,
+                    },
+                },
             },
             patches: PatchesDefault {
                 linux_async_compute: false,
                 linux_async_reprojection: false,
+                linux_encode_pipeline_depth: 1,
+                linux_vulkan_video_encode: false,
+                linux_encode_device: "".into(),
+                linux_quality_metrics_interval_ms: 0,
+                linux_local_display_device: "".into(),
+                linux_local_display_connector: "".into(),
+                linux_idle_mode: false,
             },
             velocities_multiplier: 1.0,
             open_setup_wizard: alvr_common::is_stable() || alvr_common::is_nightly(),
@@ -6,15 +6,16 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <xf86drmMode.h>
 
-#include <fstream>
 #include <filesystem>
 
-#define PICOJSON_USE_INT64
-#include "../server_openvr/cpp/alvr_server/include/picojson.h"
+#include "../server_openvr/cpp/alvr_server/include/drm_lease_config.h"
 
+// The real functions are resolved once in lib_init, this only catches libraries that were loaded
+// later with dlopen
 #define LOAD_FN(f) \
     if (!real_##f) { \
         real_##f = reinterpret_cast<decltype(real_##f)>(dlsym(RTLD_NEXT, #f)); \
@@ -66,9 +67,15 @@ static struct wp_drm_lease_v1 {} fake_lease_id;
 static int drm_fd = -1;
 static int drm_connector_id = -1;
 
+// Written by the driver, see drm_lease_config.h. A zero mode when the file was missing.
+static drm_lease_config::Config lease_config = {};
+
+static drmModeResPtr (*real_drmModeGetResources)(int fd);
+static drmModeConnectorPtr (*real_drmModeGetConnector)(int fd, uint32_t connectorId);
+static void *(*real_SDL_LoadFunction)(void *handle, const char *name);
+
 static void open_drm_fd()
 {
-    static drmModeResPtr (*real_drmModeGetResources)(int fd) = nullptr;
     LOAD_FN(drmModeGetResources);
     for(auto cardCandidate : std::filesystem::directory_iterator("/dev/dri")) {
         if(cardCandidate.path().filename().string().rfind("card", 0) == 0) {
@@ -77,6 +84,13 @@ static void open_drm_fd()
             auto res = real_drmModeGetResources(drm_fd);
             if (res && res->count_connectors) {
                 drm_connector_id = res->connectors[0];
+                if (lease_config.connectorId != 0) {
+                    for (int i = 0; i < res->count_connectors; i++) {
+                        if (res->connectors[i] == lease_config.connectorId) {
+                            drm_connector_id = lease_config.connectorId;
+                        }
+                    }
+                }
                 break;
             }
         }
@@ -187,7 +201,6 @@ static struct wl_proxy *hooked_wl_proxy_marshal_flags(struct wl_proxy *proxy, ui
 
 extern "C" void *SDL_LoadFunction(void *handle, const char *name)
 {
-    static void *(*real_SDL_LoadFunction)(void *handle, const char *name) = nullptr;
     LOAD_FN(SDL_LoadFunction);
 
 #define HOOK(f) \
@@ -209,28 +222,62 @@ extern "C" drmModeConnectorPtr drmModeGetConnector(int fd, uint32_t connectorId)
 {
     LOG("CALL drmModeGetConnector(%d, %u)", fd, connectorId);
 
-    static drmModeConnectorPtr (*real_drmModeGetConnector)(int fd, uint32_t connectorId) = nullptr;
     LOAD_FN(drmModeGetConnector);
 
     auto con = real_drmModeGetConnector(fd, connectorId);
-    if (con) {
-        auto sessionFile = std::ifstream(getenv("ALVR_SESSION_JSON"));
-        auto json = std::string(std::istreambuf_iterator<char>(sessionFile), std::istreambuf_iterator<char>());
-        picojson::value v;
-        picojson::parse(v, json);
-        auto config = v.get("openvr_config");
-
+    if (con && lease_config.modeWidth != 0) {
         con->count_modes = 1;
         con->modes = (drmModeModeInfo*)calloc(1, sizeof(drmModeModeInfo));
-        con->modes->hdisplay = config.get("eye_resolution_width").get<int64_t>() * 2;
-        con->modes->vdisplay = config.get("eye_resolution_height").get<int64_t>();
+        con->modes->hdisplay = lease_config.modeWidth;
+        con->modes->vdisplay = lease_config.modeHeight;
+        con->modes->vrefresh = lease_config.refreshRate;
     }
     return con;
 }
 
+static void load_config()
+{
+    const char *path = getenv(drm_lease_config::PATH_ENV);
+    if (!path) {
+        ERR("ALVR: %s not set", drm_lease_config::PATH_ENV);
+        return;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        ERR("ALVR: failed to open %s", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    void *mapped = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        ERR("ALVR: failed to map %s", path);
+        return;
+    }
+    auto config = static_cast<const drm_lease_config::Config*>(mapped);
+    if (drm_lease_config::IsValid(*config, st.st_size)) {
+        lease_config = *config;
+        LOG("ALVR: lease mode %ux%u@%u", lease_config.modeWidth, lease_config.modeHeight, lease_config.refreshRate);
+    } else {
+        ERR("ALVR: invalid %s, keeping the modes of the connector", path);
+    }
+    munmap(mapped, st.st_size);
+}
+
 __attribute__((constructor)) static void lib_init()
 {
     LOG("ALVR: drm-lease shim loaded");
 
     unsetenv("LD_PRELOAD");
+
+    load_config();
+
+    // The hooks only compare pointers from now on. SDL and libdrm are normally linked by
+    // vrcompositor already, LOAD_FN resolves them on first use otherwise.
+    real_drmModeGetResources = reinterpret_cast<decltype(real_drmModeGetResources)>(dlsym(RTLD_NEXT, "drmModeGetResources"));
+    real_drmModeGetConnector = reinterpret_cast<decltype(real_drmModeGetConnector)>(dlsym(RTLD_NEXT, "drmModeGetConnector"));
+    real_SDL_LoadFunction = reinterpret_cast<decltype(real_SDL_LoadFunction)>(dlsym(RTLD_NEXT, "SDL_LoadFunction"));
 }
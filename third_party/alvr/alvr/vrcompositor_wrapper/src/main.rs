@@ -34,12 +34,12 @@ fn main() {
         };
         unsafe {
             std::env::set_var("LD_PRELOAD", drm_lease_shim_path);
+            // Written by the driver next to the session, drm_lease_config.h has the layout
             std::env::set_var(
-                "ALVR_SESSION_JSON",
+                "ALVR_DRM_LEASE_CONFIG",
                 alvr_filesystem::filesystem_layout_invalid()
                     .session()
-                    .to_string_lossy()
-                    .to_string(),
+                    .with_file_name("drm_lease_shim.bin"),
             );
         }
     }